@@ -0,0 +1,627 @@
+#define _DEFAULT_SOURCE 1
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "barista_transport.h"
+
+/*
+ * Barista Update Bus
+ *
+ * Resident coalescer between the native helpers and SketchyBar. Helpers reach
+ * it through barista_send(), which prefers the bus socket whenever a daemon
+ * is listening, so a burst of updates from several helpers leaves as one
+ * SketchyBar request per frame instead of a dozen.
+ *
+ * Within one frame window:
+ * - `--set item key=value` updates merge: the latest value per item and key
+ *   wins and keeps the position where that item first appeared.
+ * - `--trigger`, `--push`, `--add` and the other ordered commands are
+ *   barriers. Sets before a barrier are emitted before it. A `=toggle` value
+ *   is a barrier too, since two toggles are not one.
+ * - Any other command (`--animate`, `--query`, ...) changes how the rest of
+ *   its message applies, so that message is sent on its own.
+ * A request that wants a reply flushes the frame at once and is answered
+ * with SketchyBar's verdict on the combined payload.
+ *
+ * Usage:
+ *   barista_busd [serve] [--socket PATH] [--frame-ms N]
+ *   barista_busd stats [--socket PATH]
+ */
+
+#define BUSD_DEFAULT_FRAME_MS 12
+#define BUSD_MAX_FRAME_MS 100
+#define BUSD_MAX_CLIENTS 64
+#define BUSD_MAX_ITEMS 512
+#define BUSD_MAX_PROPS 2048
+#define BUSD_HASH_SLOTS 4096
+#define BUSD_ARENA_BYTES (2 * BARISTA_TRANSPORT_MAX_PAYLOAD_BYTES)
+#define BUSD_READ_TIMEOUT_MS 50
+#define BUSD_STATS_TIMEOUT_MS 500
+/* Request flag understood only by the daemon: answer with the counters. */
+#define BUSD_FRAME_STATS 0x100u
+
+static const char SET_COMMAND[] = "--set";
+
+static const char *BARRIER_COMMANDS[] = {
+  "--add", "--bar", "--clone", "--default", "--event", "--move", "--push",
+  "--remove", "--rename", "--reorder", "--subscribe", "--trigger",
+};
+static const size_t BARRIER_COMMAND_COUNT =
+  sizeof(BARRIER_COMMANDS) / sizeof(BARRIER_COMMANDS[0]);
+
+typedef struct {
+  uint32_t offset;
+  uint32_t length;
+} Span;
+
+typedef struct {
+  Span name;
+  int first_prop;
+  int last_prop;
+} PendingItem;
+
+typedef struct {
+  int item;
+  uint32_t key_length;
+  Span token;
+  int next;
+} PendingProp;
+
+typedef struct {
+  uint64_t messages_in;
+  uint64_t replies_requested;
+  uint64_t payloads_out;
+  uint64_t props_in;
+  uint64_t props_out;
+  uint64_t barriers;
+  uint64_t isolated;
+  uint64_t invalid;
+  uint64_t upstream_failures;
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+} BusStats;
+
+/* One frame in flight: closed tables and barriers already rendered into
+ * `out`, plus the open table of merged sets. */
+typedef struct {
+  uint8_t out[BARISTA_TRANSPORT_MAX_PAYLOAD_BYTES];
+  size_t out_length;
+  char arena[BUSD_ARENA_BYTES];
+  size_t arena_used;
+  PendingItem items[BUSD_MAX_ITEMS];
+  int item_count;
+  PendingProp props[BUSD_MAX_PROPS];
+  int prop_count;
+  int item_slots[BUSD_HASH_SLOTS];
+  int prop_slots[BUSD_HASH_SLOTS];
+  size_t table_bytes;
+  int message_count;
+} BusFrame;
+
+static volatile sig_atomic_t g_stop = 0;
+
+static int64_t monotonic_milliseconds(void) {
+  struct timespec value = {0};
+  if (clock_gettime(CLOCK_MONOTONIC, &value) != 0) return 0;
+  return (int64_t)value.tv_sec * 1000 + (int64_t)value.tv_nsec / 1000000;
+}
+
+static uint64_t hash_bytes(uint64_t hash, const char *bytes, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (uint8_t)bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static uint64_t hash_seed(void) {
+  return 14695981039346656037ULL;
+}
+
+static int is_command(const char *token) {
+  return token[0] == '-' && token[1] == '-';
+}
+
+static int is_barrier_command(const char *token) {
+  for (size_t i = 0; i < BARRIER_COMMAND_COUNT; i++) {
+    if (strcmp(token, BARRIER_COMMANDS[i]) == 0) return 1;
+  }
+  return 0;
+}
+
+/* Returns the token at *cursor and advances past it; NULL at the payload's
+ * closing NUL. The payload is already known to be valid. */
+static const char *next_token(const uint8_t *payload, size_t length, size_t *cursor,
+                              size_t *token_length) {
+  if (*cursor >= length || payload[*cursor] == '\0') return NULL;
+  const char *token = (const char *)payload + *cursor;
+  size_t span = strlen(token);
+  *cursor += span + 1;
+  if (token_length) *token_length = span;
+  return token;
+}
+
+static void frame_reset(BusFrame *frame) {
+  frame->out_length = 0;
+  frame->arena_used = 0;
+  frame->item_count = 0;
+  frame->prop_count = 0;
+  frame->table_bytes = 0;
+  frame->message_count = 0;
+  memset(frame->item_slots, 0, sizeof(frame->item_slots));
+  memset(frame->prop_slots, 0, sizeof(frame->prop_slots));
+}
+
+static int frame_empty(const BusFrame *frame) {
+  return frame->out_length == 0 && frame->item_count == 0;
+}
+
+static void out_append(BusFrame *frame, const char *token, size_t length) {
+  /* frame_fits() reserves room for the worst case before a merge starts, so
+   * this guard only protects the buffer. */
+  if (frame->out_length + length + 1 >= sizeof(frame->out)) return;
+  memcpy(frame->out + frame->out_length, token, length);
+  frame->out_length += length;
+  frame->out[frame->out_length++] = '\0';
+}
+
+static const char *arena_string(const BusFrame *frame, Span span) {
+  return frame->arena + span.offset;
+}
+
+static int arena_store(BusFrame *frame, const char *bytes, size_t length, Span *span) {
+  if (frame->arena_used + length + 1 > sizeof(frame->arena)) return -1;
+  memcpy(frame->arena + frame->arena_used, bytes, length);
+  frame->arena[frame->arena_used + length] = '\0';
+  span->offset = (uint32_t)frame->arena_used;
+  span->length = (uint32_t)length;
+  frame->arena_used += length + 1;
+  return 0;
+}
+
+static void frame_close_table(BusFrame *frame, BusStats *stats) {
+  if (frame->item_count == 0) return;
+  for (int i = 0; i < frame->item_count; i++) {
+    const PendingItem *item = &frame->items[i];
+    out_append(frame, SET_COMMAND, sizeof(SET_COMMAND) - 1);
+    out_append(frame, arena_string(frame, item->name), item->name.length);
+    for (int prop = item->first_prop; prop >= 0; prop = frame->props[prop].next) {
+      Span token = frame->props[prop].token;
+      out_append(frame, arena_string(frame, token), token.length);
+      if (stats) stats->props_out++;
+    }
+  }
+  frame->arena_used = 0;
+  frame->item_count = 0;
+  frame->prop_count = 0;
+  frame->table_bytes = 0;
+  memset(frame->item_slots, 0, sizeof(frame->item_slots));
+  memset(frame->prop_slots, 0, sizeof(frame->prop_slots));
+}
+
+static int find_item(BusFrame *frame, const char *name, size_t length, int create) {
+  size_t slot = (size_t)hash_bytes(hash_seed(), name, length) & (BUSD_HASH_SLOTS - 1);
+  for (;;) {
+    int index = frame->item_slots[slot] - 1;
+    if (index < 0) break;
+    Span existing = frame->items[index].name;
+    if (existing.length == length && memcmp(arena_string(frame, existing), name, length) == 0) {
+      return index;
+    }
+    slot = (slot + 1) & (BUSD_HASH_SLOTS - 1);
+  }
+  if (!create) return -1;
+
+  PendingItem *item = &frame->items[frame->item_count];
+  if (arena_store(frame, name, length, &item->name) != 0) return -1;
+  item->first_prop = -1;
+  item->last_prop = -1;
+  frame->item_slots[slot] = frame->item_count + 1;
+  frame->table_bytes += sizeof(SET_COMMAND) + length + 1;
+  return frame->item_count++;
+}
+
+/* Merges one `key=value` token for an item into the open table. */
+static void frame_set(BusFrame *frame, BusStats *stats, const char *name, size_t name_length,
+                      const char *token, size_t token_length, size_t key_length) {
+  if (frame->item_count >= BUSD_MAX_ITEMS || frame->prop_count >= BUSD_MAX_PROPS
+      || frame->arena_used + name_length + token_length + 2 > sizeof(frame->arena)) {
+    frame_close_table(frame, stats);
+  }
+
+  uint64_t hash = hash_bytes(hash_seed(), name, name_length);
+  hash = hash_bytes(hash ^ 0xff, token, key_length);
+  size_t slot = (size_t)hash & (BUSD_HASH_SLOTS - 1);
+  for (;;) {
+    int index = frame->prop_slots[slot] - 1;
+    if (index < 0) break;
+    PendingProp *prop = &frame->props[index];
+    Span item_name = frame->items[prop->item].name;
+    if (prop->key_length == key_length && item_name.length == name_length
+        && memcmp(arena_string(frame, prop->token), token, key_length) == 0
+        && memcmp(arena_string(frame, item_name), name, name_length) == 0) {
+      if (prop->token.length == token_length
+          && memcmp(arena_string(frame, prop->token), token, token_length) == 0) {
+        return;
+      }
+      Span replacement;
+      if (arena_store(frame, token, token_length, &replacement) != 0) return;
+      frame->table_bytes = frame->table_bytes - prop->token.length + token_length;
+      prop->token = replacement;
+      return;
+    }
+    slot = (slot + 1) & (BUSD_HASH_SLOTS - 1);
+  }
+
+  int item_index = find_item(frame, name, name_length, 1);
+  if (item_index < 0) return;
+  PendingProp *prop = &frame->props[frame->prop_count];
+  if (arena_store(frame, token, token_length, &prop->token) != 0) return;
+  prop->item = item_index;
+  prop->key_length = (uint32_t)key_length;
+  prop->next = -1;
+  PendingItem *item = &frame->items[item_index];
+  if (item->last_prop >= 0) frame->props[item->last_prop].next = frame->prop_count;
+  else item->first_prop = frame->prop_count;
+  item->last_prop = frame->prop_count;
+  frame->prop_slots[slot] = frame->prop_count + 1;
+  frame->table_bytes += token_length + 1;
+  frame->prop_count++;
+}
+
+/* Returns 1 when a message must travel alone rather than merge into the
+ * frame. Otherwise *bound is the most bytes merging it can add to the frame:
+ * at worst every set token is rendered under its own `--set item` header. */
+static int scan_message(const uint8_t *payload, size_t length, size_t *bound) {
+  size_t cursor = 0;
+  size_t token_length = 0;
+  size_t header_length = 0;
+  const char *token = NULL;
+  *bound = 0;
+  while ((token = next_token(payload, length, &cursor, &token_length)) != NULL) {
+    if (is_command(token)) {
+      if (strcmp(token, SET_COMMAND) != 0 && !is_barrier_command(token)) return 1;
+      header_length = 0;
+      if (strcmp(token, SET_COMMAND) == 0 && cursor < length && payload[cursor] != '\0') {
+        header_length = sizeof(SET_COMMAND) + strlen((const char *)payload + cursor) + 1;
+      }
+    }
+    *bound += token_length + 1 + header_length;
+  }
+  return 0;
+}
+
+static int frame_fits(const BusFrame *frame, size_t bound) {
+  return frame->out_length + frame->table_bytes + bound + 1
+    <= BARISTA_TRANSPORT_MAX_PAYLOAD_BYTES;
+}
+
+static void merge_message(BusFrame *frame, BusStats *stats, const uint8_t *payload,
+                          size_t length) {
+  size_t cursor = 0;
+  size_t token_length = 0;
+  const char *token = next_token(payload, length, &cursor, &token_length);
+  while (token) {
+    if (strcmp(token, SET_COMMAND) == 0) {
+      size_t name_length = 0;
+      const char *name = next_token(payload, length, &cursor, &name_length);
+      if (name && !is_command(name) && name[0] != '/') {
+        token = next_token(payload, length, &cursor, &token_length);
+        while (token && !is_command(token)) {
+          const char *separator = strchr(token, '=');
+          if (stats) stats->props_in++;
+          if (separator && strcmp(separator + 1, "toggle") != 0) {
+            frame_set(frame, stats, name, name_length, token, token_length,
+                      (size_t)(separator - token));
+          } else {
+            frame_close_table(frame, stats);
+            out_append(frame, SET_COMMAND, sizeof(SET_COMMAND) - 1);
+            out_append(frame, name, name_length);
+            out_append(frame, token, token_length);
+            if (stats) stats->barriers++;
+          }
+          token = next_token(payload, length, &cursor, &token_length);
+        }
+        continue;
+      }
+      /* A regex target may touch any item, so it keeps its place in order. */
+      frame_close_table(frame, stats);
+      out_append(frame, SET_COMMAND, sizeof(SET_COMMAND) - 1);
+      token = name;
+      token_length = name_length;
+      if (stats) stats->barriers++;
+    } else {
+      frame_close_table(frame, stats);
+      out_append(frame, token, token_length);
+      if (stats) stats->barriers++;
+      token = next_token(payload, length, &cursor, &token_length);
+    }
+    while (token && !is_command(token)) {
+      out_append(frame, token, token_length);
+      token = next_token(payload, length, &cursor, &token_length);
+    }
+  }
+  frame->message_count++;
+}
+
+/* Sends the frame upstream and empties it. An empty frame reports success. */
+static BaristaSendResult frame_flush(BusFrame *frame, BusStats *stats, int timeout_ms) {
+  frame_close_table(frame, stats);
+  if (frame->out_length == 0) {
+    frame_reset(frame);
+    return BARISTA_SEND_CONFIRMED_SUCCESS;
+  }
+  frame->out[frame->out_length++] = '\0';
+  BaristaSendResult result = barista_send_direct(frame->out, frame->out_length, timeout_ms);
+  stats->payloads_out++;
+  stats->bytes_out += frame->out_length;
+  if (result == BARISTA_SEND_NOT_SENT) stats->upstream_failures++;
+  frame_reset(frame);
+  return result;
+}
+
+static void reply_result(int fd, BaristaSendResult result) {
+  static const char rejected[] = "[!] barista_busd: SketchyBar rejected the combined request";
+  switch (result) {
+    case BARISTA_SEND_CONFIRMED_SUCCESS:
+      barista_frame_write(fd, "", 1, 0, BUSD_READ_TIMEOUT_MS);
+      break;
+    case BARISTA_SEND_CONFIRMED_ERROR:
+      barista_frame_write(fd, rejected, sizeof(rejected), 0, BUSD_READ_TIMEOUT_MS);
+      break;
+    case BARISTA_SEND_SENT_UNCONFIRMED:
+      barista_frame_write(fd, NULL, 0, 0, BUSD_READ_TIMEOUT_MS);
+      break;
+    case BARISTA_SEND_NOT_SENT:
+      barista_frame_write(fd, NULL, 0, BARISTA_FRAME_NOT_DELIVERED, BUSD_READ_TIMEOUT_MS);
+      break;
+  }
+}
+
+static int format_stats(const BusStats *stats, int frame_ms, char *buffer, size_t capacity) {
+  return snprintf(buffer, capacity,
+                  "frame_ms=%d\n"
+                  "messages_in=%llu\n"
+                  "replies_requested=%llu\n"
+                  "payloads_out=%llu\n"
+                  "props_in=%llu\n"
+                  "props_out=%llu\n"
+                  "barriers=%llu\n"
+                  "isolated=%llu\n"
+                  "invalid=%llu\n"
+                  "upstream_failures=%llu\n"
+                  "bytes_in=%llu\n"
+                  "bytes_out=%llu\n",
+                  frame_ms,
+                  (unsigned long long)stats->messages_in,
+                  (unsigned long long)stats->replies_requested,
+                  (unsigned long long)stats->payloads_out,
+                  (unsigned long long)stats->props_in,
+                  (unsigned long long)stats->props_out,
+                  (unsigned long long)stats->barriers,
+                  (unsigned long long)stats->isolated,
+                  (unsigned long long)stats->invalid,
+                  (unsigned long long)stats->upstream_failures,
+                  (unsigned long long)stats->bytes_in,
+                  (unsigned long long)stats->bytes_out);
+}
+
+/* Handles one request frame. Returns 1 when the frame should flush at the
+ * end of the current window. */
+static int handle_request(int fd, BusFrame *frame, BusStats *stats, int frame_ms,
+                          const uint8_t *payload, size_t length, uint32_t flags) {
+  if (flags & BUSD_FRAME_STATS) {
+    char text[1024];
+    int written = format_stats(stats, frame_ms, text, sizeof(text));
+    if (written > 0 && (size_t)written < sizeof(text)) {
+      barista_frame_write(fd, text, (size_t)written + 1, 0, BUSD_READ_TIMEOUT_MS);
+    }
+    return 0;
+  }
+
+  int wants_reply = !(flags & BARISTA_FRAME_NO_REPLY);
+  stats->messages_in++;
+  stats->bytes_in += length;
+  if (wants_reply) stats->replies_requested++;
+  if (!barista_payload_valid(payload, length)) {
+    stats->invalid++;
+    if (wants_reply) reply_result(fd, BARISTA_SEND_CONFIRMED_ERROR);
+    return 0;
+  }
+
+  size_t bound = 0;
+  if (scan_message(payload, length, &bound)
+      || bound + 1 > BARISTA_TRANSPORT_MAX_PAYLOAD_BYTES) {
+    stats->isolated++;
+    frame_flush(frame, stats, 0);
+    BaristaSendResult result = barista_send_direct(payload, length, wants_reply ? -1 : 0);
+    stats->payloads_out++;
+    stats->bytes_out += length;
+    if (result == BARISTA_SEND_NOT_SENT) stats->upstream_failures++;
+    if (wants_reply) reply_result(fd, result);
+    return 0;
+  }
+
+  if (!frame_fits(frame, bound)) frame_flush(frame, stats, 0);
+  merge_message(frame, stats, payload, length);
+  if (wants_reply) {
+    reply_result(fd, frame_flush(frame, stats, -1));
+    return 0;
+  }
+  return frame_empty(frame) ? 0 : 1;
+}
+
+static void handle_stop(int signal_number) {
+  (void)signal_number;
+  g_stop = 1;
+}
+
+static int set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0) return -1;
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int serve(const char *path, int frame_ms) {
+  /* The daemon's own sends must go to the bar, not back to itself. */
+  setenv("BARISTA_BUSD_DISABLE", "1", 1);
+  signal(SIGPIPE, SIG_IGN);
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handle_stop;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGTERM, &action, NULL);
+  sigaction(SIGINT, &action, NULL);
+
+  int listener = barista_socket_listen(path);
+  if (listener < 0 || set_nonblocking(listener) != 0) {
+    fprintf(stderr, "barista_busd: cannot listen on %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  static BusFrame frame;
+  static uint8_t request[BARISTA_TRANSPORT_MAX_PAYLOAD_BYTES];
+  BusStats stats;
+  memset(&stats, 0, sizeof(stats));
+  frame_reset(&frame);
+
+  struct pollfd descriptors[1 + BUSD_MAX_CLIENTS];
+  int client_count = 0;
+  int64_t deadline = -1;
+  descriptors[0].fd = listener;
+  descriptors[0].events = POLLIN;
+
+  while (!g_stop) {
+    int timeout = -1;
+    if (deadline >= 0) {
+      int64_t now = monotonic_milliseconds();
+      timeout = deadline > now ? (int)(deadline - now) : 0;
+    }
+    int ready = poll(descriptors, (nfds_t)(1 + client_count), timeout);
+    if (ready < 0 && errno != EINTR) break;
+
+    if (ready > 0 && (descriptors[0].revents & POLLIN)) {
+      for (;;) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) break;
+        if (client_count >= BUSD_MAX_CLIENTS || set_nonblocking(client) != 0) {
+          close(client);
+          continue;
+        }
+        client_count++;
+        descriptors[client_count].fd = client;
+        descriptors[client_count].events = POLLIN;
+        descriptors[client_count].revents = 0;
+      }
+    }
+
+    for (int i = client_count; ready > 0 && i >= 1; i--) {
+      if (!(descriptors[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+      size_t length = 0;
+      uint32_t flags = 0;
+      int fd = descriptors[i].fd;
+      if (barista_frame_read(fd, request, sizeof(request), &length, &flags,
+                             BUSD_READ_TIMEOUT_MS) != 0) {
+        close(fd);
+        descriptors[i] = descriptors[client_count];
+        client_count--;
+        continue;
+      }
+      if (handle_request(fd, &frame, &stats, frame_ms, request, length, flags)
+          && deadline < 0) {
+        deadline = monotonic_milliseconds() + frame_ms;
+      }
+      if (frame_empty(&frame)) deadline = -1;
+    }
+
+    if (deadline >= 0 && monotonic_milliseconds() >= deadline) {
+      frame_flush(&frame, &stats, 0);
+      deadline = -1;
+    }
+  }
+
+  frame_flush(&frame, &stats, 0);
+  for (int i = 1; i <= client_count; i++) close(descriptors[i].fd);
+  close(listener);
+  unlink(path);
+  return 0;
+}
+
+static int print_stats(const char *path) {
+  int fd = barista_socket_connect(path);
+  if (fd < 0) {
+    fprintf(stderr, "barista_busd: not running at %s\n", path);
+    return 1;
+  }
+  static const uint8_t probe[] = {0};
+  static char text[BARISTA_TRANSPORT_MAX_RESPONSE_BYTES];
+  size_t length = 0;
+  int status = 1;
+  if (barista_frame_write(fd, probe, sizeof(probe), BUSD_FRAME_STATS, BUSD_STATS_TIMEOUT_MS) == 0
+      && barista_frame_read(fd, text, sizeof(text) - 1, &length, NULL, BUSD_STATS_TIMEOUT_MS) == 0) {
+    text[length] = '\0';
+    fputs(text, stdout);
+    status = 0;
+  }
+  close(fd);
+  return status;
+}
+
+static void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [serve] [--socket PATH] [--frame-ms N]\n"
+          "       %s stats [--socket PATH]\n",
+          program, program);
+}
+
+int main(int argc, char **argv) {
+  const char *command = "serve";
+  int index = 1;
+  if (index < argc && argv[index][0] != '-') command = argv[index++];
+
+  char default_path[256];
+  const char *path = NULL;
+  int frame_ms = BUSD_DEFAULT_FRAME_MS;
+  const char *env_frame = getenv("BARISTA_BUSD_FRAME_MS");
+  if (env_frame && env_frame[0] != '\0') frame_ms = atoi(env_frame);
+
+  for (; index < argc; index++) {
+    if (strcmp(argv[index], "--socket") == 0 && index + 1 < argc) {
+      path = argv[++index];
+    } else if (strcmp(argv[index], "--frame-ms") == 0 && index + 1 < argc) {
+      frame_ms = atoi(argv[++index]);
+    } else {
+      print_usage(argv[0]);
+      return 2;
+    }
+  }
+  if (frame_ms < 0) frame_ms = 0;
+  if (frame_ms > BUSD_MAX_FRAME_MS) frame_ms = BUSD_MAX_FRAME_MS;
+
+  if (!path) {
+    /* Resolve the same default helpers use, even if the bus is disabled for
+     * this shell. */
+    unsetenv("BARISTA_BUSD_DISABLE");
+    if (!barista_bus_socket_path(default_path, sizeof(default_path))) {
+      fprintf(stderr, "barista_busd: no usable socket path\n");
+      return 1;
+    }
+    path = default_path;
+  }
+
+  if (strcmp(command, "serve") == 0) return serve(path, frame_ms);
+  if (strcmp(command, "stats") == 0) return print_stats(path);
+  print_usage(argv[0]);
+  return 2;
+}
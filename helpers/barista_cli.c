@@ -0,0 +1,66 @@
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE 1
+#endif
+
+#include "barista_cli.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+const char *barista_cli_binary(void) {
+  const char *value = getenv("BARISTA_SKETCHYBAR_BIN");
+  if (value && value[0] != '\0') return value;
+  value = getenv("SKETCHYBAR_BIN");
+  return value && value[0] != '\0' ? value : "sketchybar";
+}
+
+int barista_cli_spawn(char *const argv[]) {
+  if (!argv || !argv[0]) return -1;
+  pid_t pid = fork();
+  if (pid < 0) return -1;
+  if (pid == 0) {
+    execvp(argv[0], argv);
+    _exit(127);
+  }
+
+  int status = 0;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) return -1;
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+BaristaSendResult barista_cli_exec(const void *payload, size_t length) {
+  if (!barista_payload_valid(payload, length)) return BARISTA_SEND_NOT_SENT;
+  const char *bytes = payload;
+
+  /* Tokens end in NUL, so they can be pointed at in place as argv strings;
+   * the final byte is the closing NUL and starts no token. */
+  size_t count = 0;
+  for (size_t i = 0; i + 1 < length; i++) count += bytes[i] == '\0';
+  char **argv = calloc(count + 2, sizeof(*argv));
+  if (!argv) return BARISTA_SEND_NOT_SENT;
+  argv[0] = (char *)barista_cli_binary();
+  size_t used = 1;
+  for (size_t start = 0; start + 1 < length && used <= count;) {
+    argv[used++] = (char *)bytes + start;
+    start += strlen(bytes + start) + 1;
+  }
+
+  int status = barista_cli_spawn(argv);
+  free(argv);
+  if (status == 0) return BARISTA_SEND_CONFIRMED_SUCCESS;
+  /* 127 is execvp failing in the child: the CLI never ran. */
+  if (status < 0 || status == 127) return BARISTA_SEND_NOT_SENT;
+  return BARISTA_SEND_CONFIRMED_ERROR;
+}
+
+BaristaSendResult barista_sketchybar(const void *payload, size_t length, int timeout_ms) {
+  BaristaSendResult result = barista_send(payload, length, timeout_ms);
+  if (result != BARISTA_SEND_NOT_SENT) return result;
+  return barista_cli_exec(payload, length);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+/*
+ * Barista CLI Fallback
+ *
+ * The one place helpers reach the sketchybar binary. Updates go through
+ * barista_send() first; only a payload the transport reports as
+ * BARISTA_SEND_NOT_SENT is replayed by exec'ing the CLI with the payload
+ * tokens as its argv. No path here goes through /bin/sh, so values need no
+ * quoting and a helper invocation costs at most one process spawn.
+ *
+ * The binary is BARISTA_SKETCHYBAR_BIN, then SKETCHYBAR_BIN, then
+ * "sketchybar" on PATH.
+ */
+
+#include <stddef.h>
+
+#include "barista_transport.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const char *barista_cli_binary(void);
+
+/* fork + execvp + waitpid. Returns the exit status, or -1 when the process
+ * could not be started or did not exit normally. */
+int barista_cli_spawn(char *const argv[]);
+
+/* Run the CLI with one argument per payload token. CONFIRMED_SUCCESS on exit
+ * status 0, CONFIRMED_ERROR on any other status, NOT_SENT when the payload is
+ * malformed or the CLI could not be started. */
+BaristaSendResult barista_cli_exec(const void *payload, size_t length);
+
+/* barista_send(), falling back to barista_cli_exec() only on NOT_SENT. */
+BaristaSendResult barista_sketchybar(const void *payload, size_t length, int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
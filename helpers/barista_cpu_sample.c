@@ -0,0 +1,287 @@
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE 1
+#endif
+
+#include "barista_cpu_sample.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#include <mach/mach_host.h>
+#include <sys/sysctl.h>
+#include <sys/time.h>
+#else
+#include <pthread.h>
+
+#include "event_providers/proc_scan.h"
+#endif
+
+#define CPU_SAMPLE_MAGIC 0x42435331u
+#define CPU_SAMPLE_VERSION 1u
+/* Summed over every core, so this is 1 s on one core and far less on many;
+ * closer runs reuse the last percentage rather than report noise. */
+#define CPU_SAMPLE_MIN_TICKS 100
+#define CPU_SAMPLE_WRITER_SPINS 1000
+#define MAX_BAR_NAME_BYTES 128
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t sequence; /* 0 until the first sample; odd while one is written */
+  uint64_t boot_time;
+  uint64_t ticks[BARISTA_CPU_STATES];
+  uint32_t counter_bits;
+  uint32_t has_percent;
+  double percent;
+  uint64_t reserved[4];
+} CpuSampleFile;
+
+#ifdef __APPLE__
+int barista_cpu_ticks_read(BaristaCpuTicks *ticks) {
+  if (!ticks) return 0;
+  host_cpu_load_info_data_t load;
+  mach_msg_type_number_t count = HOST_CPU_LOAD_INFO_COUNT;
+  mach_port_t host = mach_host_self();
+  kern_return_t result = host_statistics(host, HOST_CPU_LOAD_INFO, (host_info_t)&load, &count);
+  mach_port_deallocate(mach_task_self(), host);
+  struct timeval boot_time = {0};
+  size_t length = sizeof(boot_time);
+  if (result != KERN_SUCCESS
+      || sysctlbyname("kern.boottime", &boot_time, &length, NULL, 0) != 0
+      || boot_time.tv_sec <= 0) {
+    return 0;
+  }
+  ticks->ticks[BARISTA_CPU_USER] = load.cpu_ticks[CPU_STATE_USER];
+  ticks->ticks[BARISTA_CPU_NICE] = load.cpu_ticks[CPU_STATE_NICE];
+  ticks->ticks[BARISTA_CPU_SYSTEM] = load.cpu_ticks[CPU_STATE_SYSTEM];
+  ticks->ticks[BARISTA_CPU_IDLE] = load.cpu_ticks[CPU_STATE_IDLE];
+  ticks->counter_bits = 32;
+  ticks->boot_time = (uint64_t)boot_time.tv_sec;
+  return 1;
+}
+#else
+/* Scans /proc/stat with the providers' /proc scanner: the aggregate `cpu`
+ * row and `btime`. Interrupt and steal time count as system, iowait as idle.
+ * `btime` follows the per-core and interrupt rows, which can outgrow the
+ * scanner's buffer on big machines, so later windows of the file are read
+ * until it turns up; a row cut off at a window's end starts the next one. */
+static int scan_proc_stat(struct proc_file *file, BaristaCpuTicks *ticks) {
+  uint64_t cpu[8] = {0};
+  int columns = 0;
+  uint64_t boot_time = 0;
+  off_t offset = 0;
+  int inside_row = 0; /* the window starts within a row longer than the buffer */
+  for (;;) {
+    if (proc_file_read_from(file, offset) != 0) return 0;
+    const char *row = file->data;
+    const char *end = file->data + file->length;
+    int more = proc_file_truncated(file);
+    if (inside_row) {
+      const char *newline = memchr(row, '\n', (size_t)(end - row));
+      if (!newline) {
+        if (!more) break;
+        offset += (off_t)file->length;
+        continue;
+      }
+      row = newline + 1;
+      inside_row = 0;
+    }
+    while (row < end) {
+      const char *newline = memchr(row, '\n', (size_t)(end - row));
+      if (!newline && more) break;
+      struct proc_scanner scanner = {row, newline ? newline : end};
+      const char *word;
+      size_t length = proc_scan_word(&scanner, &word);
+      if (length == 3 && memcmp(word, "cpu", 3) == 0) {
+        columns = 0;
+        while (columns < 8 && proc_scan_u64(&scanner, &cpu[columns])) columns++;
+      } else if (length == 5 && memcmp(word, "btime", 5) == 0) {
+        proc_scan_u64(&scanner, &boot_time);
+      }
+      row = newline ? newline + 1 : end;
+    }
+    if (boot_time != 0 || !more) break;
+    if (row == file->data) {
+      inside_row = 1;
+      offset += (off_t)file->length;
+    } else {
+      offset += (off_t)(row - file->data);
+    }
+  }
+  if (columns < 4 || boot_time == 0) return 0;
+  ticks->ticks[BARISTA_CPU_USER] = cpu[0];
+  ticks->ticks[BARISTA_CPU_NICE] = cpu[1];
+  ticks->ticks[BARISTA_CPU_SYSTEM] = cpu[2] + cpu[5] + cpu[6] + cpu[7];
+  ticks->ticks[BARISTA_CPU_IDLE] = cpu[3] + cpu[4];
+  ticks->counter_bits = 64;
+  ticks->boot_time = boot_time;
+  return 1;
+}
+
+/* One descriptor for the life of the process, as the providers keep theirs;
+ * the probe pool may read from several threads. */
+static pthread_mutex_t g_stat_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct proc_file g_stat;
+static int g_stat_open = 0;
+
+int barista_cpu_ticks_read(BaristaCpuTicks *ticks) {
+  if (!ticks) return 0;
+  pthread_mutex_lock(&g_stat_lock);
+  if (!g_stat_open) g_stat_open = proc_file_open(&g_stat, "/proc/stat") == 0;
+  int parsed = g_stat_open && scan_proc_stat(&g_stat, ticks);
+  pthread_mutex_unlock(&g_stat_lock);
+  return parsed;
+}
+#endif
+
+/* Same boot and counter width, and no 64-bit counter went backwards (those
+ * never wrap in practice, so that means different counters). */
+static int comparable(const BaristaCpuTicks *before, const BaristaCpuTicks *after) {
+  if (before->boot_time != after->boot_time || before->counter_bits != after->counter_bits
+      || (after->counter_bits != 32 && after->counter_bits != 64)) {
+    return 0;
+  }
+  for (int state = 0; state < BARISTA_CPU_STATES && after->counter_bits == 64; state++) {
+    if (after->ticks[state] < before->ticks[state]) return 0;
+  }
+  return 1;
+}
+
+int barista_cpu_ticks_busy_percent(const BaristaCpuTicks *before, const BaristaCpuTicks *after,
+                                   uint64_t min_ticks, double *percent) {
+  if (!before || !after || !percent || !comparable(before, after)) return 0;
+  uint64_t mask = after->counter_bits == 64 ? UINT64_MAX : 0xffffffffull;
+  uint64_t delta[BARISTA_CPU_STATES];
+  uint64_t total = 0;
+  for (int state = 0; state < BARISTA_CPU_STATES; state++) {
+    delta[state] = (after->ticks[state] - before->ticks[state]) & mask;
+    total += delta[state];
+  }
+  if (total == 0 || total < min_ticks) return 0;
+  *percent = (double)(total - delta[BARISTA_CPU_IDLE]) * 100.0 / (double)total;
+  return 1;
+}
+
+int barista_cpu_sample_path(char *buffer, size_t capacity) {
+  if (!buffer || capacity == 0) return 0;
+  buffer[0] = '\0';
+  const char *tmpdir = getenv("TMPDIR");
+  const char *bar_name = getenv("BAR_NAME");
+  if (!tmpdir || tmpdir[0] == '\0') tmpdir = "/tmp";
+  if (!bar_name || bar_name[0] == '\0') bar_name = "sketchybar";
+  if (strlen(bar_name) > MAX_BAR_NAME_BYTES || strchr(bar_name, '/')) return 0;
+  size_t tmpdir_length = strlen(tmpdir);
+  while (tmpdir_length > 1 && tmpdir[tmpdir_length - 1] == '/') tmpdir_length--;
+  int written = snprintf(buffer, capacity, "%.*s/barista_cpu_sample.%s", (int)tmpdir_length,
+                         tmpdir, bar_name);
+  if (written <= 0 || (size_t)written >= capacity) {
+    buffer[0] = '\0';
+    return 0;
+  }
+  return 1;
+}
+
+static CpuSampleFile *cpu_sample_map(const char *path) {
+  int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) return NULL;
+  struct stat status;
+  if (fstat(fd, &status) != 0
+      || (status.st_size < (off_t)sizeof(CpuSampleFile)
+          && ftruncate(fd, (off_t)sizeof(CpuSampleFile)) != 0)) {
+    close(fd);
+    return NULL;
+  }
+  void *mapping = mmap(NULL, sizeof(CpuSampleFile), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) return NULL;
+
+  CpuSampleFile *file = mapping;
+  if (__atomic_load_n(&file->magic, __ATOMIC_ACQUIRE) == 0) {
+    file->version = CPU_SAMPLE_VERSION;
+    uint32_t expected = 0;
+    __atomic_compare_exchange_n(&file->magic, &expected, CPU_SAMPLE_MAGIC, 0, __ATOMIC_RELEASE,
+                                __ATOMIC_ACQUIRE);
+  }
+  if (__atomic_load_n(&file->magic, __ATOMIC_ACQUIRE) != CPU_SAMPLE_MAGIC
+      || file->version != CPU_SAMPLE_VERSION) {
+    munmap(mapping, sizeof(CpuSampleFile));
+    return NULL;
+  }
+  return file;
+}
+
+static int read_record(const CpuSampleFile *file, BaristaCpuTicks *ticks, uint32_t *has_percent,
+                       double *percent) {
+  uint64_t sequence = __atomic_load_n(&file->sequence, __ATOMIC_ACQUIRE);
+  if (sequence == 0 || (sequence & 1)) return 0;
+  ticks->boot_time = __atomic_load_n(&file->boot_time, __ATOMIC_RELAXED);
+  for (int state = 0; state < BARISTA_CPU_STATES; state++) {
+    ticks->ticks[state] = __atomic_load_n(&file->ticks[state], __ATOMIC_RELAXED);
+  }
+  ticks->counter_bits = __atomic_load_n(&file->counter_bits, __ATOMIC_RELAXED);
+  *has_percent = __atomic_load_n(&file->has_percent, __ATOMIC_RELAXED);
+  __atomic_load(&file->percent, percent, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&file->sequence, __ATOMIC_RELAXED) == sequence;
+}
+
+/* Takes the record for writing by making the sequence odd. One still odd
+ * after CPU_SAMPLE_WRITER_SPINS yields belongs to a run that died mid-write
+ * and is taken over instead of staying stuck. Returns 0 when another run won
+ * the race; its sample is as fresh as ours. */
+static int write_record(CpuSampleFile *file, const BaristaCpuTicks *ticks, uint32_t has_percent,
+                        double percent) {
+  uint64_t sequence = __atomic_load_n(&file->sequence, __ATOMIC_RELAXED);
+  for (int spin = 0; (sequence & 1) && spin < CPU_SAMPLE_WRITER_SPINS; spin++) {
+    sched_yield();
+    sequence = __atomic_load_n(&file->sequence, __ATOMIC_RELAXED);
+  }
+  uint64_t claimed = sequence + ((sequence & 1) ? 2 : 1);
+  if (!__atomic_compare_exchange_n(&file->sequence, &sequence, claimed, 0, __ATOMIC_ACQUIRE,
+                                   __ATOMIC_RELAXED)) {
+    return 0;
+  }
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&file->boot_time, ticks->boot_time, __ATOMIC_RELAXED);
+  for (int state = 0; state < BARISTA_CPU_STATES; state++) {
+    __atomic_store_n(&file->ticks[state], ticks->ticks[state], __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&file->counter_bits, ticks->counter_bits, __ATOMIC_RELAXED);
+  __atomic_store_n(&file->has_percent, has_percent, __ATOMIC_RELAXED);
+  __atomic_store(&file->percent, &percent, __ATOMIC_RELAXED);
+  __atomic_store_n(&file->sequence, claimed + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+int barista_cpu_sample_update(const char *path, const BaristaCpuTicks *current, double *percent) {
+  if (!path || !current || !percent) return 0;
+  CpuSampleFile *file = cpu_sample_map(path);
+  if (!file) return 0;
+
+  BaristaCpuTicks previous;
+  uint32_t had_percent = 0;
+  double last_percent = 0.0;
+  int result = 0;
+  if (!read_record(file, &previous, &had_percent, &last_percent)
+      || !comparable(&previous, current)) {
+    /* First run of this boot, or a record no longer worth comparing. */
+    write_record(file, current, 0, 0.0);
+  } else if (barista_cpu_ticks_busy_percent(&previous, current, CPU_SAMPLE_MIN_TICKS, percent)) {
+    write_record(file, current, 1, *percent);
+    result = 1;
+  } else if (had_percent) {
+    /* Too close to the baseline: keep it for the next run. */
+    *percent = last_percent;
+    result = 1;
+  }
+  munmap(file, sizeof(CpuSampleFile));
+  return result;
+}
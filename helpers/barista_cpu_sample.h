@@ -0,0 +1,69 @@
+#pragma once
+
+/*
+ * Barista CPU Sample
+ *
+ * Real CPU utilisation for one-shot helpers. The kernel's cumulative tick
+ * counters (host_statistics HOST_CPU_LOAD_INFO on macOS, the `cpu` line of
+ * /proc/stat on Linux) only mean something as a difference, and a helper that
+ * runs once and exits has no earlier sample of its own. The previous sample
+ * therefore lives in a small record mapped from
+ * $TMPDIR/barista_cpu_sample.<BAR_NAME>: each run compares against it,
+ * stores its own counters, and reports busy / total ticks since the last
+ * run.
+ *
+ * The record is keyed by boot time, so counters from before a reboot are
+ * never compared with fresh ones. macOS counts in 32-bit integers summed over
+ * every core, which wrap after a few weeks of uptime; deltas are taken modulo
+ * the counter width so a wrap between two runs still yields the right value
+ * (two wraps between runs cannot be detected).
+ *
+ * Runs that race update the record under a sequence word (odd while it is
+ * being written); a reader that sees a write in progress treats the run as
+ * the first one rather than mixing two samples.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+  BARISTA_CPU_USER,
+  BARISTA_CPU_NICE,
+  BARISTA_CPU_SYSTEM,
+  BARISTA_CPU_IDLE,
+  BARISTA_CPU_STATES
+};
+
+typedef struct {
+  uint64_t ticks[BARISTA_CPU_STATES];
+  uint32_t counter_bits; /* 32 or 64; deltas wrap modulo 2^counter_bits */
+  uint64_t boot_time;    /* seconds since the epoch; identifies the boot */
+} BaristaCpuTicks;
+
+/* Reads the system-wide counters. Returns 0 on failure. */
+int barista_cpu_ticks_read(BaristaCpuTicks *ticks);
+
+/* Busy share of the ticks between two samples, 0..100. Returns 0 when the
+ * samples are from different boots or counter widths, a 64-bit counter went
+ * backwards, or fewer than `min_ticks` (at least 1) ticks passed. */
+int barista_cpu_ticks_busy_percent(const BaristaCpuTicks *before, const BaristaCpuTicks *after,
+                                   uint64_t min_ticks, double *percent);
+
+/* $TMPDIR/barista_cpu_sample.<BAR_NAME>; 0 when it cannot be formed. */
+int barista_cpu_sample_path(char *buffer, size_t capacity);
+
+/* Compares `current` with the record at `path` and stores it for the next
+ * run. Returns 1 with *percent set when there was a comparable previous
+ * sample. When too few ticks have passed since it, the last percentage is
+ * reported again and the older baseline is kept. Returns 0 on the first run
+ * of a boot or when the record is unavailable; callers fall back to the load
+ * average. */
+int barista_cpu_sample_update(const char *path, const BaristaCpuTicks *current, double *percent);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,269 @@
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE 1
+#endif
+
+#include "barista_executor.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef enum {
+  JOB_QUEUED,
+  JOB_RUNNING,
+  JOB_DONE,
+  JOB_SKIPPED,
+} JobState;
+
+typedef struct Batch Batch;
+
+typedef struct Job {
+  struct Job *next;
+  Batch *batch;
+  BaristaProbeFunction run;
+  const void *argument;
+  void *scratch;
+  size_t scratch_bytes;
+  JobState state;
+  int64_t started_us;
+  int64_t finished_us;
+} Job;
+
+struct Batch {
+  size_t references; /* the caller, plus every job not yet done or skipped */
+  size_t remaining;
+  int abandoned;     /* the caller returned; skip what is still queued */
+  size_t count;
+  Job jobs[];
+};
+
+struct BaristaExecutor {
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+  Job *head;
+  Job *tail;
+  int stopping;
+  size_t thread_count;
+  pthread_t threads[BARISTA_EXECUTOR_MAX_THREADS];
+};
+
+static int64_t monotonic_microseconds(void) {
+  struct timespec value = {0};
+  if (clock_gettime(CLOCK_MONOTONIC, &value) != 0) return 0;
+  return (int64_t)value.tv_sec * 1000000 + (int64_t)value.tv_nsec / 1000;
+}
+
+/* The batch deadline follows CLOCK_MONOTONIC so a wall-clock step cannot
+ * stretch or cut short a refresh.  macOS has no pthread_condattr_setclock,
+ * so there the wait is relative and recomputed on every wakeup. */
+static void done_init(pthread_cond_t *done) {
+#ifdef __APPLE__
+  pthread_cond_init(done, NULL);
+#else
+  pthread_condattr_t attributes;
+  pthread_condattr_init(&attributes);
+  pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+  pthread_cond_init(done, &attributes);
+  pthread_condattr_destroy(&attributes);
+#endif
+}
+
+static int done_wait_until(BaristaExecutor *executor, int64_t deadline_us) {
+  int64_t remaining = deadline_us - monotonic_microseconds();
+  if (remaining <= 0) return ETIMEDOUT;
+#ifdef __APPLE__
+  struct timespec wait = {
+    .tv_sec = (time_t)(remaining / 1000000),
+    .tv_nsec = (long)(remaining % 1000000) * 1000L,
+  };
+  return pthread_cond_timedwait_relative_np(&executor->done, &executor->lock, &wait);
+#else
+  struct timespec deadline = {
+    .tv_sec = (time_t)(deadline_us / 1000000),
+    .tv_nsec = (long)(deadline_us % 1000000) * 1000L,
+  };
+  return pthread_cond_timedwait(&executor->done, &executor->lock, &deadline);
+#endif
+}
+
+static void batch_free(Batch *batch) {
+  for (size_t index = 0; index < batch->count; index++) free(batch->jobs[index].scratch);
+  free(batch);
+}
+
+/* Caller holds the executor lock. */
+static void batch_release(Batch *batch) {
+  if (--batch->references == 0) batch_free(batch);
+}
+
+static void *worker_main(void *context) {
+  BaristaExecutor *executor = context;
+  pthread_mutex_lock(&executor->lock);
+  for (;;) {
+    while (!executor->head && !executor->stopping) {
+      pthread_cond_wait(&executor->work, &executor->lock);
+    }
+    Job *job = executor->head;
+    if (!job) break;
+    executor->head = job->next;
+    if (!executor->head) executor->tail = NULL;
+
+    Batch *batch = job->batch;
+    if (batch->abandoned || executor->stopping) {
+      job->state = JOB_SKIPPED;
+    } else {
+      job->state = JOB_RUNNING;
+      job->started_us = monotonic_microseconds();
+      pthread_mutex_unlock(&executor->lock);
+      job->run(job->argument, job->scratch);
+      int64_t finished = monotonic_microseconds();
+      pthread_mutex_lock(&executor->lock);
+      job->finished_us = finished;
+      job->state = JOB_DONE;
+    }
+    if (--batch->remaining == 0) pthread_cond_broadcast(&executor->done);
+    batch_release(batch);
+  }
+  pthread_mutex_unlock(&executor->lock);
+  return NULL;
+}
+
+BaristaExecutor *barista_executor_create(size_t threads) {
+  if (threads == 0) threads = 1;
+  if (threads > BARISTA_EXECUTOR_MAX_THREADS) threads = BARISTA_EXECUTOR_MAX_THREADS;
+  BaristaExecutor *executor = calloc(1, sizeof(*executor));
+  if (!executor) return NULL;
+  pthread_mutex_init(&executor->lock, NULL);
+  pthread_cond_init(&executor->work, NULL);
+  done_init(&executor->done);
+
+  /* Workers block every signal so handlers run on the caller's threads. */
+  sigset_t all;
+  sigset_t previous;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &previous);
+  for (size_t index = 0; index < threads; index++) {
+    if (pthread_create(&executor->threads[executor->thread_count], NULL, worker_main, executor) != 0) {
+      break;
+    }
+    executor->thread_count++;
+  }
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+  if (executor->thread_count == 0) {
+    pthread_cond_destroy(&executor->done);
+    pthread_cond_destroy(&executor->work);
+    pthread_mutex_destroy(&executor->lock);
+    free(executor);
+    return NULL;
+  }
+  return executor;
+}
+
+static size_t run_inline(BaristaProbeTask *tasks, size_t count) {
+  for (size_t index = 0; index < count; index++) {
+    BaristaProbeTask *task = &tasks[index];
+    if (task->result && task->result_bytes > 0) memset(task->result, 0, task->result_bytes);
+    int64_t started = monotonic_microseconds();
+    task->run(task->argument, task->result);
+    task->elapsed_us = (uint64_t)(monotonic_microseconds() - started);
+    task->finished = 1;
+  }
+  return count;
+}
+
+static Batch *batch_create(const BaristaProbeTask *tasks, size_t count) {
+  Batch *batch = calloc(1, sizeof(*batch) + count * sizeof(Job));
+  if (!batch) return NULL;
+  batch->count = count;
+  for (size_t index = 0; index < count; index++) {
+    Job *job = &batch->jobs[index];
+    job->batch = batch;
+    job->run = tasks[index].run;
+    job->argument = tasks[index].argument;
+    job->scratch_bytes = tasks[index].result ? tasks[index].result_bytes : 0;
+    if (job->scratch_bytes > 0) {
+      job->scratch = calloc(1, job->scratch_bytes);
+      if (!job->scratch) {
+        batch_free(batch);
+        return NULL;
+      }
+    }
+  }
+  return batch;
+}
+
+size_t barista_executor_run(BaristaExecutor *executor,
+                            BaristaProbeTask *tasks,
+                            size_t count,
+                            int timeout_ms) {
+  if (!tasks || count == 0) return 0;
+  for (size_t index = 0; index < count; index++) {
+    tasks[index].finished = 0;
+    tasks[index].elapsed_us = 0;
+  }
+  Batch *batch = executor ? batch_create(tasks, count) : NULL;
+  if (!batch) return run_inline(tasks, count);
+
+  int64_t deadline_us = timeout_ms >= 0 ? monotonic_microseconds() + (int64_t)timeout_ms * 1000 : 0;
+
+  pthread_mutex_lock(&executor->lock);
+  batch->references = count + 1;
+  batch->remaining = count;
+  for (size_t index = 0; index < count; index++) {
+    Job *job = &batch->jobs[index];
+    if (executor->tail) {
+      executor->tail->next = job;
+    } else {
+      executor->head = job;
+    }
+    executor->tail = job;
+  }
+  pthread_cond_broadcast(&executor->work);
+
+  while (batch->remaining > 0) {
+    if (timeout_ms < 0) {
+      pthread_cond_wait(&executor->done, &executor->lock);
+    } else if (done_wait_until(executor, deadline_us) == ETIMEDOUT) {
+      break;
+    }
+  }
+
+  int64_t now = monotonic_microseconds();
+  size_t finished = 0;
+  for (size_t index = 0; index < count; index++) {
+    const Job *job = &batch->jobs[index];
+    BaristaProbeTask *task = &tasks[index];
+    if (job->state == JOB_DONE) {
+      if (job->scratch) memcpy(task->result, job->scratch, job->scratch_bytes);
+      task->finished = 1;
+      task->elapsed_us = (uint64_t)(job->finished_us - job->started_us);
+      finished++;
+    } else if (job->state == JOB_RUNNING) {
+      task->elapsed_us = (uint64_t)(now - job->started_us);
+    }
+  }
+  batch->abandoned = 1;
+  batch_release(batch);
+  pthread_mutex_unlock(&executor->lock);
+  return finished;
+}
+
+void barista_executor_destroy(BaristaExecutor *executor) {
+  if (!executor) return;
+  pthread_mutex_lock(&executor->lock);
+  executor->stopping = 1;
+  pthread_cond_broadcast(&executor->work);
+  pthread_mutex_unlock(&executor->lock);
+  for (size_t index = 0; index < executor->thread_count; index++) {
+    pthread_join(executor->threads[index], NULL);
+  }
+  pthread_cond_destroy(&executor->done);
+  pthread_cond_destroy(&executor->work);
+  pthread_mutex_destroy(&executor->lock);
+  free(executor);
+}
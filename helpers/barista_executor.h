@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+ * Barista Executor
+ *
+ * Runs a batch of independent probes concurrently on a fixed pool of worker
+ * threads and returns when every probe finished or one deadline for the
+ * whole batch passed, whichever comes first.
+ *
+ * Each probe writes into a zeroed scratch buffer the executor owns. Only
+ * probes that finished in time have their scratch copied to the caller's
+ * `result`; a probe that misses the deadline keeps its worker until it
+ * returns on its own, and its result is thrown away. That is why `argument`
+ * must outlive the executor rather than the call (static data works), while
+ * `result` only has to outlive barista_executor_run(). Queued probes of a
+ * batch that already returned are skipped.
+ *
+ * Several threads may run batches on one executor at the same time; they
+ * share its workers.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BARISTA_EXECUTOR_MAX_THREADS 32
+
+typedef void (*BaristaProbeFunction)(const void *argument, void *result);
+
+typedef struct {
+  BaristaProbeFunction run;
+  const void *argument;
+  void *result;
+  size_t result_bytes;
+  /* Set by barista_executor_run(). */
+  int finished;
+  uint64_t elapsed_us; /* run time; for a missed probe, how long it had run */
+} BaristaProbeTask;
+
+typedef struct BaristaExecutor BaristaExecutor;
+
+/* Starts `threads` workers (clamped to 1..MAX_THREADS). NULL when none could
+ * be started; callers then run their probes inline. */
+BaristaExecutor *barista_executor_create(size_t threads);
+
+/* Runs `tasks` and waits at most `timeout_ms`. Returns how many finished. */
+size_t barista_executor_run(BaristaExecutor *executor,
+                            BaristaProbeTask *tasks,
+                            size_t count,
+                            int timeout_ms);
+
+/* Stops the workers, waiting for probes still running. */
+void barista_executor_destroy(BaristaExecutor *executor);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,264 @@
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE 1
+#endif
+
+#include "barista_history.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HISTORY_MAGIC 0x42484931u
+#define HISTORY_VERSION 1u
+#define MAX_BAR_NAME_BYTES 128
+#define MAX_SERIES_BYTES 64
+
+typedef struct {
+  uint64_t sequence;
+  uint64_t timestamp_ns;
+  double values[BARISTA_HISTORY_MAX_FIELDS];
+} HistorySlot;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t capacity;
+  uint32_t field_count;
+  uint64_t head;
+  uint64_t reserved[5];
+  char names[BARISTA_HISTORY_MAX_FIELDS][BARISTA_HISTORY_FIELD_BYTES];
+  HistorySlot slots[];
+} HistoryFile;
+
+struct BaristaHistory {
+  HistoryFile *file;
+  size_t size;
+  dev_t device;
+  ino_t inode;
+  char path[1024];
+};
+
+static size_t history_file_size(uint32_t capacity) {
+  return sizeof(HistoryFile) + (size_t)capacity * sizeof(HistorySlot);
+}
+
+static int valid_series(const char *series) {
+  size_t length = series ? strlen(series) : 0;
+  if (length == 0 || length > MAX_SERIES_BYTES || series[0] == '.') return 0;
+  for (size_t i = 0; i < length; i++) {
+    char c = series[i];
+    int ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+             || c == '.' || c == '-' || c == '_';
+    if (!ok) return 0;
+  }
+  return 1;
+}
+
+int barista_history_path(const char *series, char *buffer, size_t capacity) {
+  if (!buffer || capacity == 0) return 0;
+  buffer[0] = '\0';
+  if (!valid_series(series)) return 0;
+  const char *directory = getenv("BARISTA_HISTORY_DIR");
+  if (!directory || directory[0] == '\0') directory = getenv("TMPDIR");
+  if (!directory || directory[0] == '\0') directory = "/tmp";
+  const char *bar_name = getenv("BAR_NAME");
+  if (!bar_name || bar_name[0] == '\0') bar_name = "sketchybar";
+  if (strlen(bar_name) > MAX_BAR_NAME_BYTES || strchr(bar_name, '/')) return 0;
+  size_t directory_length = strlen(directory);
+  while (directory_length > 1 && directory[directory_length - 1] == '/') directory_length--;
+  int written = snprintf(buffer, capacity, "%.*s/barista_history.%s.%s",
+                         (int)directory_length, directory, bar_name, series);
+  if (written <= 0 || (size_t)written >= capacity) {
+    buffer[0] = '\0';
+    return 0;
+  }
+  return 1;
+}
+
+BaristaHistory *barista_history_create(const char *series, uint32_t capacity,
+                                       uint32_t field_count, const char *const names[]) {
+  if (capacity == 0 || capacity > BARISTA_HISTORY_MAX_CAPACITY
+      || field_count == 0 || field_count > BARISTA_HISTORY_MAX_FIELDS || !names) {
+    return NULL;
+  }
+  uint32_t rounded = 1;
+  while (rounded < capacity) rounded <<= 1;
+
+  BaristaHistory *history = calloc(1, sizeof(*history));
+  if (!history) return NULL;
+  char temporary[1040];
+  if (!barista_history_path(series, history->path, sizeof(history->path))
+      || snprintf(temporary, sizeof(temporary), "%s.XXXXXX", history->path)
+           >= (int)sizeof(temporary)) {
+    free(history);
+    return NULL;
+  }
+  int fd = mkstemp(temporary);
+  if (fd < 0) {
+    free(history);
+    return NULL;
+  }
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  history->size = history_file_size(rounded);
+  struct stat status;
+  void *mapping = MAP_FAILED;
+  if (ftruncate(fd, (off_t)history->size) == 0 && fstat(fd, &status) == 0) {
+    mapping = mmap(NULL, history->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    unlink(temporary);
+    free(history);
+    return NULL;
+  }
+
+  HistoryFile *file = mapping;
+  file->version = HISTORY_VERSION;
+  file->capacity = rounded;
+  file->field_count = field_count;
+  for (uint32_t i = 0; i < field_count; i++) {
+    snprintf(file->names[i], sizeof(file->names[i]), "%s", names[i] ? names[i] : "");
+  }
+  __atomic_store_n(&file->magic, HISTORY_MAGIC, __ATOMIC_RELEASE);
+  /* Readers only ever find the path once the ring is complete. */
+  if (rename(temporary, history->path) != 0) {
+    munmap(mapping, history->size);
+    unlink(temporary);
+    free(history);
+    return NULL;
+  }
+  history->file = file;
+  history->device = status.st_dev;
+  history->inode = status.st_ino;
+  return history;
+}
+
+BaristaHistory *barista_history_open(const char *series) {
+  BaristaHistory *history = calloc(1, sizeof(*history));
+  if (!history) return NULL;
+  if (!barista_history_path(series, history->path, sizeof(history->path))) {
+    free(history);
+    return NULL;
+  }
+  int fd = open(history->path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    free(history);
+    return NULL;
+  }
+  struct stat status;
+  HistoryFile header;
+  if (fstat(fd, &status) != 0 || status.st_size < (off_t)sizeof(HistoryFile)
+      || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+      || header.magic != HISTORY_MAGIC || header.version != HISTORY_VERSION
+      || header.capacity == 0 || header.capacity > BARISTA_HISTORY_MAX_CAPACITY
+      || (header.capacity & (header.capacity - 1)) != 0
+      || header.field_count == 0 || header.field_count > BARISTA_HISTORY_MAX_FIELDS
+      || status.st_size < (off_t)history_file_size(header.capacity)) {
+    close(fd);
+    free(history);
+    return NULL;
+  }
+  history->size = history_file_size(header.capacity);
+  void *mapping = mmap(NULL, history->size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    free(history);
+    return NULL;
+  }
+  history->file = mapping;
+  history->device = status.st_dev;
+  history->inode = status.st_ino;
+  return history;
+}
+
+void barista_history_close(BaristaHistory *history) {
+  if (!history) return;
+  if (history->file) munmap(history->file, history->size);
+  free(history);
+}
+
+void barista_history_append(BaristaHistory *history, uint64_t timestamp_ns,
+                            const double *values) {
+  if (!history || !values) return;
+  HistoryFile *file = history->file;
+  uint64_t index = __atomic_load_n(&file->head, __ATOMIC_RELAXED);
+  HistorySlot *slot = &file->slots[index & (file->capacity - 1)];
+
+  /* Odd while the slot is rewritten; the fence keeps the value stores
+   * after it. */
+  __atomic_store_n(&slot->sequence, 2 * index + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&slot->timestamp_ns, timestamp_ns, __ATOMIC_RELAXED);
+  for (uint32_t i = 0; i < file->field_count; i++) {
+    double value = values[i];
+    __atomic_store(&slot->values[i], &value, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&slot->sequence, 2 * (index + 1), __ATOMIC_RELEASE);
+  __atomic_store_n(&file->head, index + 1, __ATOMIC_RELEASE);
+}
+
+size_t barista_history_read(const BaristaHistory *history, uint64_t since,
+                            BaristaHistorySample *samples, size_t max) {
+  if (!history || !samples || max == 0) return 0;
+  const HistoryFile *file = history->file;
+  uint64_t head = __atomic_load_n(&file->head, __ATOMIC_ACQUIRE);
+  uint64_t first = head > file->capacity ? head - file->capacity : 0;
+  if (since > first) first = since;
+  /* Keep the newest `max` when the caller asked for fewer than are
+   * available. */
+  if (head > first && head - first > max) first = head - max;
+
+  size_t count = 0;
+  for (uint64_t index = first; index < head && count < max; index++) {
+    const HistorySlot *slot = &file->slots[index & (file->capacity - 1)];
+    uint64_t expected = 2 * (index + 1);
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != expected) continue;
+    BaristaHistorySample *sample = &samples[count];
+    memset(sample, 0, sizeof(*sample));
+    sample->sequence = index;
+    sample->timestamp_ns = __atomic_load_n(&slot->timestamp_ns, __ATOMIC_RELAXED);
+    for (uint32_t i = 0; i < file->field_count; i++) {
+      __atomic_load(&slot->values[i], &sample->values[i], __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != expected) continue;
+    count++;
+  }
+  return count;
+}
+
+uint64_t barista_history_count(const BaristaHistory *history) {
+  return history ? __atomic_load_n(&history->file->head, __ATOMIC_ACQUIRE) : 0;
+}
+
+uint32_t barista_history_capacity(const BaristaHistory *history) {
+  return history ? history->file->capacity : 0;
+}
+
+uint32_t barista_history_field_count(const BaristaHistory *history) {
+  return history ? history->file->field_count : 0;
+}
+
+const char *barista_history_field_name(const BaristaHistory *history, uint32_t index) {
+  if (!history || index >= history->file->field_count) return NULL;
+  return history->file->names[index];
+}
+
+int barista_history_field_index(const BaristaHistory *history, const char *name) {
+  if (!history || !name) return -1;
+  for (uint32_t i = 0; i < history->file->field_count; i++) {
+    if (strncmp(history->file->names[i], name, BARISTA_HISTORY_FIELD_BYTES) == 0) return (int)i;
+  }
+  return -1;
+}
+
+int barista_history_stale(const BaristaHistory *history) {
+  if (!history) return 1;
+  struct stat status;
+  return stat(history->path, &status) != 0
+         || status.st_dev != history->device || status.st_ino != history->inode;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+/*
+ * Barista History
+ *
+ * Fixed-size rings of timestamped samples that event providers publish into
+ * shared memory, so graph items and popups can read recent history (a 60s
+ * sparkline, `--push` graph data) without sampling again or keeping state in
+ * shell scripts.
+ *
+ * Each series is one file mapped from
+ * $TMPDIR/barista_history.<BAR_NAME>.<series> (BARISTA_HISTORY_DIR replaces
+ * the directory). A series has one writer and any number of readers; neither
+ * side takes a lock. Every slot carries a sequence word the writer makes odd
+ * while it rewrites the slot and sets to 2 * (sample index + 1) once the
+ * sample is complete, so a reader that raced the writer sees a mismatch and
+ * drops that sample instead of returning torn values. Readers never write to
+ * the mapping.
+ *
+ * A writer creates the file under a temporary name and renames it into
+ * place, so readers never map a half-initialised ring. A restarted writer
+ * starts a fresh file; readers holding the old one keep their mapping and
+ * should reopen when barista_history_stale() reports the swap.
+ *
+ * Usage:
+ *   BaristaHistory *ring = barista_history_create("cpu_update", 256, 2, names);
+ *   barista_history_append(ring, now_ns, values);
+ *
+ *   BaristaHistory *reader = barista_history_open("cpu_update");
+ *   size_t count = barista_history_read(reader, 0, samples, 256);
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BARISTA_HISTORY_MAX_FIELDS 8
+#define BARISTA_HISTORY_FIELD_BYTES 24
+#define BARISTA_HISTORY_MAX_CAPACITY 65536u
+
+typedef struct BaristaHistory BaristaHistory;
+
+typedef struct {
+  uint64_t sequence;     /* 0 for the first sample ever appended */
+  uint64_t timestamp_ns; /* CLOCK_REALTIME */
+  double values[BARISTA_HISTORY_MAX_FIELDS];
+} BaristaHistorySample;
+
+/* Writes the file path for `series`; 0 when it cannot be formed. Series
+ * names are limited to letters, digits, '.', '-' and '_'. */
+int barista_history_path(const char *series, char *buffer, size_t capacity);
+
+/* Creates (or replaces) the ring for `series` with room for `capacity`
+ * samples (rounded up to a power of two) of `field_count` named values.
+ * Returns NULL on failure. */
+BaristaHistory *barista_history_create(const char *series, uint32_t capacity,
+                                       uint32_t field_count, const char *const names[]);
+
+/* Maps an existing ring read-only. Returns NULL when it does not exist or
+ * has an unknown layout. */
+BaristaHistory *barista_history_open(const char *series);
+
+void barista_history_close(BaristaHistory *history);
+
+/* Appends one sample of field_count values. Writer only; NULL is a no-op so
+ * callers need not check whether history is enabled. */
+void barista_history_append(BaristaHistory *history, uint64_t timestamp_ns,
+                            const double *values);
+
+/* Copies the newest complete samples with sequence >= `since`, at most
+ * `max` of them, oldest first, and returns how many were copied. Samples
+ * already overwritten or being rewritten are skipped. Pass the last
+ * sequence seen plus one to poll incrementally. */
+size_t barista_history_read(const BaristaHistory *history, uint64_t since,
+                            BaristaHistorySample *samples, size_t max);
+
+/* Number of samples ever appended (the next sequence). */
+uint64_t barista_history_count(const BaristaHistory *history);
+
+uint32_t barista_history_capacity(const BaristaHistory *history);
+uint32_t barista_history_field_count(const BaristaHistory *history);
+
+/* Name of field `index`, or NULL. */
+const char *barista_history_field_name(const BaristaHistory *history, uint32_t index);
+
+/* Index of the field called `name`, or -1. */
+int barista_history_field_index(const BaristaHistory *history, const char *name);
+
+/* 1 when the file for this series was removed or replaced since it was
+ * opened, i.e. a reader should reopen it. */
+int barista_history_stale(const BaristaHistory *history);
+
+#ifdef __cplusplus
+}
+#endif
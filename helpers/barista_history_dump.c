@@ -0,0 +1,160 @@
+#define _DEFAULT_SOURCE 1
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "barista_history.h"
+
+/*
+ * Barista History Dump
+ *
+ * Prints a provider's shared-memory history ring (see barista_history.h)
+ * without touching the provider.
+ *
+ * Formats:
+ *   tsv    - a header row, then sequence, timestamp (ms) and every field
+ *   push   - one field scaled to 0..1, space separated, for
+ *            `sketchybar --push <graph> $(...)`
+ *   spark  - one field as a block-character sparkline for labels and popups
+ *
+ * push and spark scale by --max, or by the largest value shown when it is
+ * not given. --last keeps the newest N samples, --seconds those from the
+ * last S seconds.
+ *
+ * Usage:
+ *   barista_history_dump SERIES [--format tsv|push|spark] [--field NAME]
+ *                        [--last N] [--seconds S] [--max X]
+ */
+
+typedef struct {
+  const char *series;
+  const char *format;
+  const char *field;
+  size_t last;
+  double seconds;
+  double max;
+} DumpOptions;
+
+static uint64_t realtime_nanoseconds(void) {
+  struct timespec value = {0};
+  clock_gettime(CLOCK_REALTIME, &value);
+  return (uint64_t)value.tv_sec * 1000000000ull + (uint64_t)value.tv_nsec;
+}
+
+static void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s SERIES [--format tsv|push|spark] [--field NAME] [--last N] "
+          "[--seconds S] [--max X]\n",
+          program);
+}
+
+static void print_tsv(const BaristaHistory *history, const BaristaHistorySample *samples,
+                      size_t count) {
+  uint32_t fields = barista_history_field_count(history);
+  printf("sequence\ttimestamp_ms");
+  for (uint32_t i = 0; i < fields; i++) printf("\t%s", barista_history_field_name(history, i));
+  putchar('\n');
+  for (size_t n = 0; n < count; n++) {
+    printf("%llu\t%llu", (unsigned long long)samples[n].sequence,
+           (unsigned long long)(samples[n].timestamp_ns / 1000000ull));
+    for (uint32_t i = 0; i < fields; i++) printf("\t%.6g", samples[n].values[i]);
+    putchar('\n');
+  }
+}
+
+static void print_scaled(const BaristaHistorySample *samples, size_t count, int field,
+                         double max, int spark) {
+  static const char *const blocks[] = {"▁", "▂", "▃", "▄",
+                                       "▅", "▆", "▇", "█"};
+  if (max <= 0.0) {
+    for (size_t n = 0; n < count; n++) {
+      if (samples[n].values[field] > max) max = samples[n].values[field];
+    }
+  }
+  for (size_t n = 0; n < count; n++) {
+    double value = max > 0.0 ? samples[n].values[field] / max : 0.0;
+    if (!(value > 0.0)) value = 0.0;
+    if (value > 1.0) value = 1.0;
+    if (spark) {
+      fputs(blocks[(int)(value * 7.0 + 0.5)], stdout);
+    } else {
+      printf(n ? " %.3f" : "%.3f", value);
+    }
+  }
+  putchar('\n');
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argv[1][0] == '-') {
+    print_usage(argv[0]);
+    return 2;
+  }
+  DumpOptions options = {.series = argv[1], .format = "tsv", .field = NULL,
+                         .last = BARISTA_HISTORY_MAX_CAPACITY, .seconds = 0.0, .max = 0.0};
+  for (int index = 2; index < argc; index++) {
+    if (strcmp(argv[index], "--format") == 0 && index + 1 < argc) {
+      options.format = argv[++index];
+    } else if (strcmp(argv[index], "--field") == 0 && index + 1 < argc) {
+      options.field = argv[++index];
+    } else if (strcmp(argv[index], "--last") == 0 && index + 1 < argc) {
+      options.last = (size_t)strtoul(argv[++index], NULL, 10);
+    } else if (strcmp(argv[index], "--seconds") == 0 && index + 1 < argc) {
+      options.seconds = atof(argv[++index]);
+    } else if (strcmp(argv[index], "--max") == 0 && index + 1 < argc) {
+      options.max = atof(argv[++index]);
+    } else {
+      print_usage(argv[0]);
+      return 2;
+    }
+  }
+  int tsv = strcmp(options.format, "tsv") == 0;
+  int spark = strcmp(options.format, "spark") == 0;
+  if ((!tsv && !spark && strcmp(options.format, "push") != 0) || options.last == 0
+      || options.seconds < 0.0) {
+    print_usage(argv[0]);
+    return 2;
+  }
+
+  BaristaHistory *history = barista_history_open(options.series);
+  if (!history) {
+    fprintf(stderr, "barista_history_dump: no history for %s\n", options.series);
+    return 1;
+  }
+  int field = 0;
+  if (options.field) {
+    field = barista_history_field_index(history, options.field);
+    if (field < 0) {
+      fprintf(stderr, "barista_history_dump: %s has no field %s\n", options.series,
+              options.field);
+      barista_history_close(history);
+      return 1;
+    }
+  }
+
+  size_t capacity = barista_history_capacity(history);
+  if (options.last > capacity) options.last = capacity;
+  BaristaHistorySample *samples = calloc(options.last, sizeof(*samples));
+  if (!samples) {
+    barista_history_close(history);
+    return 1;
+  }
+  size_t count = barista_history_read(history, 0, samples, options.last);
+  if (options.seconds > 0.0) {
+    uint64_t window = (uint64_t)(options.seconds * 1e9);
+    uint64_t now = realtime_nanoseconds();
+    uint64_t cutoff = now > window ? now - window : 0;
+    size_t skip = 0;
+    while (skip < count && samples[skip].timestamp_ns < cutoff) skip++;
+    memmove(samples, samples + skip, (count - skip) * sizeof(*samples));
+    count -= skip;
+  }
+
+  if (tsv) print_tsv(history, samples, count);
+  else print_scaled(samples, count, field, options.max, spark);
+  free(samples);
+  barista_history_close(history);
+  return 0;
+}
@@ -0,0 +1,669 @@
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE 1
+#endif
+
+#include "barista_json.h"
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  const char *start;
+  const char *cursor;
+  const char *end;
+  int depth;
+  char key[BARISTA_JSON_MAX_KEY];
+  char text[BARISTA_JSON_MAX_TEXT];
+} Decoder;
+
+static int parse_value(Decoder *decoder, const BaristaJsonField *field, void *base);
+
+static void skip_space(Decoder *decoder) {
+  while (decoder->cursor < decoder->end) {
+    char c = *decoder->cursor;
+    if (c != ' ' && c != '\n' && c != '\r' && c != '\t') return;
+    decoder->cursor++;
+  }
+}
+
+/* Consumes `c` after optional whitespace. */
+static int expect(Decoder *decoder, char c) {
+  skip_space(decoder);
+  if (decoder->cursor >= decoder->end || *decoder->cursor != c) return 0;
+  decoder->cursor++;
+  return 1;
+}
+
+static int hex_digit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+/* The four hex digits after "\u", or -1. */
+static long scan_hex4(const char *p, const char *end) {
+  if (end - p < 4) return -1;
+  long value = 0;
+  for (int i = 0; i < 4; i++) {
+    int digit = hex_digit(p[i]);
+    if (digit < 0) return -1;
+    value = value * 16 + digit;
+  }
+  return value;
+}
+
+static size_t encode_utf8(unsigned long code, char *out) {
+  if (code < 0x80) {
+    out[0] = (char)code;
+    return 1;
+  }
+  if (code < 0x800) {
+    out[0] = (char)(0xC0 | (code >> 6));
+    out[1] = (char)(0x80 | (code & 0x3F));
+    return 2;
+  }
+  if (code < 0x10000) {
+    out[0] = (char)(0xE0 | (code >> 12));
+    out[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+    out[2] = (char)(0x80 | (code & 0x3F));
+    return 3;
+  }
+  out[0] = (char)(0xF0 | (code >> 18));
+  out[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+  out[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+  out[3] = (char)(0x80 | (code & 0x3F));
+  return 4;
+}
+
+typedef struct {
+  char *out;      /* NULL when only validating */
+  size_t capacity;
+  size_t length;
+  int fits;
+} Unescaped;
+
+static void put_bytes(Unescaped *string, const char *bytes, size_t count) {
+  if (string->fits && string->length + count < string->capacity) {
+    memcpy(string->out + string->length, bytes, count);
+  } else {
+    string->fits = 0;
+  }
+  string->length += count;
+}
+
+/* Scans the string at the cursor, unescaping it into `out` when given. On
+ * return `fits` says whether all of it, and its NUL, landed there. */
+static int scan_string(Decoder *decoder, char *out, size_t capacity, size_t *length, int *fits) {
+  const char *p = decoder->cursor + 1;
+  const char *end = decoder->end;
+  Unescaped string = {out, capacity, 0, out != NULL};
+  for (;;) {
+    const char *run = p;
+    while (p < end && *p != '"' && *p != '\\' && (unsigned char)*p >= 0x20) p++;
+    if (p > run) put_bytes(&string, run, (size_t)(p - run));
+    if (p >= end || (unsigned char)*p < 0x20) {
+      decoder->cursor = p;
+      return 0;
+    }
+    if (*p == '"') break;
+
+    const char *escape = p;
+    if (end - p < 2) {
+      decoder->cursor = p;
+      return 0;
+    }
+    char c = p[1];
+    p += 2;
+    char byte;
+    switch (c) {
+      case '"': byte = '"'; break;
+      case '\\': byte = '\\'; break;
+      case '/': byte = '/'; break;
+      case 'b': byte = '\b'; break;
+      case 'f': byte = '\f'; break;
+      case 'n': byte = '\n'; break;
+      case 'r': byte = '\r'; break;
+      case 't': byte = '\t'; break;
+      case 'u': {
+        long code = scan_hex4(p, end);
+        if (code < 0) {
+          decoder->cursor = escape;
+          return 0;
+        }
+        p += 4;
+        if (code >= 0xD800 && code <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+          long low = scan_hex4(p + 2, end);
+          if (low >= 0xDC00 && low <= 0xDFFF) {
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            p += 6;
+          }
+        }
+        if (code >= 0xD800 && code <= 0xDFFF) code = 0xFFFD; /* unpaired */
+        if (code == 0) string.fits = 0;                      /* no room in a C string */
+        char bytes[4];
+        put_bytes(&string, bytes, encode_utf8((unsigned long)code, bytes));
+        continue;
+      }
+      default:
+        decoder->cursor = escape;
+        return 0;
+    }
+    put_bytes(&string, &byte, 1);
+  }
+  if (string.fits) out[string.length] = '\0';
+  decoder->cursor = p + 1;
+  *length = string.length;
+  *fits = string.fits;
+  return 1;
+}
+
+static int is_digit(const char *p, const char *end) {
+  return p < end && *p >= '0' && *p <= '9';
+}
+
+static int scan_number(Decoder *decoder, double *value, int *integer) {
+  const char *p = decoder->cursor;
+  const char *end = decoder->end;
+  if (p < end && *p == '-') p++;
+  if (p < end && *p == '0') {
+    p++;
+  } else if (is_digit(p, end)) {
+    while (is_digit(p, end)) p++;
+  } else {
+    decoder->cursor = p;
+    return 0;
+  }
+  if (integer) *integer = !(p < end && (*p == '.' || *p == 'e' || *p == 'E'));
+  if (p < end && *p == '.') {
+    p++;
+    if (!is_digit(p, end)) {
+      decoder->cursor = p;
+      return 0;
+    }
+    while (is_digit(p, end)) p++;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    if (p < end && (*p == '+' || *p == '-')) p++;
+    if (!is_digit(p, end)) {
+      decoder->cursor = p;
+      return 0;
+    }
+    while (is_digit(p, end)) p++;
+  }
+  /* strtod() needs a terminator; numbers too long for the copy are valid
+   * but unusable. Skipped numbers are not converted at all. */
+  if (value) {
+    char copy[64];
+    size_t length = (size_t)(p - decoder->cursor);
+    if (length < sizeof(copy)) {
+      memcpy(copy, decoder->cursor, length);
+      copy[length] = '\0';
+      *value = strtod(copy, NULL);
+    } else {
+      *value = NAN;
+    }
+  }
+  decoder->cursor = p;
+  return 1;
+}
+
+static int scan_literal(Decoder *decoder, const char *word, size_t length) {
+  if ((size_t)(decoder->end - decoder->cursor) < length || memcmp(decoder->cursor, word, length) != 0) {
+    return 0;
+  }
+  decoder->cursor += length;
+  return 1;
+}
+
+/* Scans the scalar at the cursor. Unless `wanted` is set it is only
+ * validated; strings land in the scratch buffer when wanted and they fit,
+ * otherwise `string` stays NULL. */
+static int scan_scalar(Decoder *decoder, int wanted, BaristaJsonValue *value) {
+  memset(value, 0, sizeof(*value));
+  switch (*decoder->cursor) {
+    case '"': {
+      int fits = 0;
+      value->type = BARISTA_JSON_VALUE_STRING;
+      if (!scan_string(decoder, wanted ? decoder->text : NULL, sizeof(decoder->text),
+                       &value->length, &fits)) {
+        return 0;
+      }
+      if (fits) value->string = decoder->text;
+      return 1;
+    }
+    case 't':
+      value->type = BARISTA_JSON_VALUE_BOOL;
+      value->boolean = 1;
+      return scan_literal(decoder, "true", 4);
+    case 'f':
+      value->type = BARISTA_JSON_VALUE_BOOL;
+      return scan_literal(decoder, "false", 5);
+    case 'n':
+      value->type = BARISTA_JSON_VALUE_NULL;
+      return scan_literal(decoder, "null", 4);
+    default:
+      value->type = BARISTA_JSON_VALUE_NUMBER;
+      return scan_number(decoder, wanted ? &value->number : NULL, &value->integer);
+  }
+}
+
+/* "0xAARRGGBB" or "#RRGGBB": one to eight hex digits after the prefix. */
+static int parse_color(const char *text, uint32_t *color) {
+  if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+    text += 2;
+  } else if (text[0] == '#') {
+    text++;
+  } else {
+    return 0;
+  }
+  size_t digits = strlen(text);
+  if (digits == 0 || digits > 8) return 0;
+  uint32_t value = 0;
+  for (size_t i = 0; i < digits; i++) {
+    int digit = hex_digit(text[i]);
+    if (digit < 0) return 0;
+    value = value * 16 + (uint32_t)digit;
+  }
+  *color = value;
+  return 1;
+}
+
+static int sized(const BaristaJsonField *field, size_t size) {
+  return field->size == 0 || field->size == size;
+}
+
+static void store_value(const BaristaJsonField *field, void *base, const BaristaJsonValue *value) {
+  char *slot = (char *)base + field->offset;
+  switch (field->type) {
+    case BARISTA_JSON_STRING:
+      if (value->type == BARISTA_JSON_VALUE_STRING && value->string && value->length < field->size) {
+        memcpy(slot, value->string, value->length + 1);
+      }
+      break;
+    case BARISTA_JSON_INT:
+      if (value->type == BARISTA_JSON_VALUE_NUMBER && sized(field, sizeof(int))
+          && value->number >= INT_MIN && value->number <= INT_MAX) {
+        int number = (int)value->number;
+        memcpy(slot, &number, sizeof(number));
+      }
+      break;
+    case BARISTA_JSON_FLOAT:
+      if (value->type == BARISTA_JSON_VALUE_NUMBER && sized(field, sizeof(float))
+          && value->number >= -FLT_MAX && value->number <= FLT_MAX) {
+        float number = (float)value->number;
+        memcpy(slot, &number, sizeof(number));
+      }
+      break;
+    case BARISTA_JSON_BOOL:
+      if (value->type == BARISTA_JSON_VALUE_BOOL && sized(field, sizeof(int))) {
+        memcpy(slot, &value->boolean, sizeof(int));
+      }
+      break;
+    case BARISTA_JSON_COLOR: {
+      uint32_t color = 0;
+      int parsed = 0;
+      if (value->type == BARISTA_JSON_VALUE_STRING && value->string) {
+        parsed = parse_color(value->string, &color);
+      } else if (value->type == BARISTA_JSON_VALUE_NUMBER && value->number >= 0
+                 && value->number <= UINT32_MAX && value->number == (double)(uint32_t)value->number) {
+        color = (uint32_t)value->number;
+        parsed = 1;
+      }
+      if (parsed && sized(field, sizeof(uint32_t))) memcpy(slot, &color, sizeof(color));
+      break;
+    }
+    case BARISTA_JSON_ENUM:
+      if (value->type == BARISTA_JSON_VALUE_STRING && value->string && field->choices
+          && sized(field, sizeof(int))) {
+        for (int index = 0; field->choices[index]; index++) {
+          if (strcmp(field->choices[index], value->string) == 0) {
+            memcpy(slot, &index, sizeof(index));
+            break;
+          }
+        }
+      }
+      break;
+    default:
+      break; /* a scalar where the schema wants a container */
+  }
+}
+
+static const BaristaJsonField *find_field(const BaristaJsonField *fields, const char *key) {
+  for (; fields && fields->key; fields++) {
+    if (strcmp(fields->key, key) == 0) return fields;
+  }
+  return NULL;
+}
+
+/* A member of an ENTRIES object: scalars reach `entry` whole, containers
+ * are skipped and reported by type. */
+static int parse_entry(Decoder *decoder, BaristaJsonEntryFunction entry, void *object, int key_fits) {
+  skip_space(decoder);
+  if (decoder->cursor >= decoder->end) return 0;
+  BaristaJsonValue value;
+  char c = *decoder->cursor;
+  if (c == '{' || c == '[') {
+    if (!parse_value(decoder, NULL, NULL)) return 0;
+    memset(&value, 0, sizeof(value));
+    value.type = c == '{' ? BARISTA_JSON_VALUE_OBJECT : BARISTA_JSON_VALUE_ARRAY;
+  } else {
+    if (!scan_scalar(decoder, key_fits, &value)) return 0;
+    if (value.type == BARISTA_JSON_VALUE_STRING && !value.string) return 1;
+  }
+  if (key_fits) entry(object, decoder->key, &value);
+  return 1;
+}
+
+/* Either `fields` or `entry` (or neither, to skip) describes the members. */
+static int parse_object(Decoder *decoder, const BaristaJsonField *fields, void *object,
+                        BaristaJsonEntryFunction entry) {
+  if (++decoder->depth > BARISTA_JSON_MAX_DEPTH) return 0;
+  decoder->cursor++;
+  if (entry) entry(object, NULL, NULL);
+  skip_space(decoder);
+  if (decoder->cursor < decoder->end && *decoder->cursor == '}') {
+    decoder->cursor++;
+    decoder->depth--;
+    return 1;
+  }
+  int keyed = fields != NULL || entry != NULL;
+  for (;;) {
+    skip_space(decoder);
+    if (decoder->cursor >= decoder->end || *decoder->cursor != '"') return 0;
+    size_t key_length = 0;
+    int key_fits = 0;
+    if (!scan_string(decoder, keyed ? decoder->key : NULL, sizeof(decoder->key), &key_length, &key_fits)) {
+      return 0;
+    }
+    if (!expect(decoder, ':')) return 0;
+    if (entry) {
+      if (!parse_entry(decoder, entry, object, key_fits)) return 0;
+    } else if (!parse_value(decoder, key_fits ? find_field(fields, decoder->key) : NULL, object)) {
+      return 0;
+    }
+    skip_space(decoder);
+    if (decoder->cursor >= decoder->end) return 0;
+    char c = *decoder->cursor++;
+    if (c == '}') break;
+    if (c != ',') {
+      decoder->cursor--;
+      return 0;
+    }
+  }
+  decoder->depth--;
+  return 1;
+}
+
+static void store_count(const BaristaJsonField *field, void *base, size_t count) {
+  int value = (int)count;
+  memcpy((char *)base + field->count_offset, &value, sizeof(value));
+}
+
+static int parse_array(Decoder *decoder, const BaristaJsonField *field, void *base) {
+  if (++decoder->depth > BARISTA_JSON_MAX_DEPTH) return 0;
+  decoder->cursor++;
+  size_t count = 0;
+  char *elements = field ? (char *)base + field->offset : NULL;
+  if (field) store_count(field, base, 0);
+  skip_space(decoder);
+  if (decoder->cursor < decoder->end && *decoder->cursor == ']') {
+    decoder->cursor++;
+    decoder->depth--;
+    return 1;
+  }
+  for (;;) {
+    skip_space(decoder);
+    if (field && count < field->capacity && decoder->cursor < decoder->end && *decoder->cursor == '{') {
+      char *element = elements + count * field->size;
+      memset(element, 0, field->size);
+      if (!parse_object(decoder, field->fields, element, NULL)) return 0;
+      store_count(field, base, ++count);
+    } else if (!parse_value(decoder, NULL, NULL)) {
+      return 0;
+    }
+    skip_space(decoder);
+    if (decoder->cursor >= decoder->end) return 0;
+    char c = *decoder->cursor++;
+    if (c == ']') break;
+    if (c != ',') {
+      decoder->cursor--;
+      return 0;
+    }
+  }
+  decoder->depth--;
+  return 1;
+}
+
+/* `field` (NULL to skip) describes the value, `base` the struct it is in. */
+static int parse_value(Decoder *decoder, const BaristaJsonField *field, void *base) {
+  skip_space(decoder);
+  if (decoder->cursor >= decoder->end) return 0;
+  switch (*decoder->cursor) {
+    case '{':
+      if (field && field->type == BARISTA_JSON_OBJECT) {
+        return parse_object(decoder, field->fields, (char *)base + field->offset, NULL);
+      }
+      if (field && field->type == BARISTA_JSON_ENTRIES && field->entry) {
+        return parse_object(decoder, NULL, (char *)base + field->offset, field->entry);
+      }
+      return parse_object(decoder, NULL, NULL, NULL);
+    case '[':
+      if (field && field->type == BARISTA_JSON_ARRAY && field->size > 0) {
+        return parse_array(decoder, field, base);
+      }
+      return parse_array(decoder, NULL, NULL);
+    default: {
+      BaristaJsonValue value;
+      if (!scan_scalar(decoder, field != NULL, &value)) return 0;
+      if (field) store_value(field, base, &value);
+      return 1;
+    }
+  }
+}
+
+int barista_json_decode(const char *text,
+                        size_t length,
+                        const BaristaJsonField *root,
+                        void *target,
+                        size_t *error_offset) {
+  if (!text) return 0;
+  Decoder decoder;
+  decoder.start = text;
+  decoder.cursor = text;
+  decoder.end = text + length;
+  decoder.depth = 0;
+  if (length >= 3 && memcmp(text, "\xEF\xBB\xBF", 3) == 0) decoder.cursor += 3;
+
+  int valid = parse_value(&decoder, root, target);
+  if (valid) {
+    skip_space(&decoder);
+    valid = decoder.cursor == decoder.end;
+  }
+  if (!valid && error_offset) *error_offset = (size_t)(decoder.cursor - decoder.start);
+  return valid;
+}
+
+int barista_json_decode_file(const char *path,
+                             const BaristaJsonField *root,
+                             void *target,
+                             size_t *error_offset) {
+  FILE *file = path ? fopen(path, "rb") : NULL;
+  if (!file) return -1;
+  char *buffer = NULL;
+  long size = -1;
+  if (fseek(file, 0, SEEK_END) == 0) size = ftell(file);
+  if (size >= 0 && fseek(file, 0, SEEK_SET) == 0) buffer = malloc((size_t)size + 1);
+  if (!buffer || fread(buffer, 1, (size_t)size, file) != (size_t)size) {
+    free(buffer);
+    fclose(file);
+    return -1;
+  }
+  fclose(file);
+  int result = barista_json_decode(buffer, (size_t)size, root, target, error_offset);
+  free(buffer);
+  return result;
+}
+
+typedef struct {
+  Decoder decoder;
+  const BaristaJsonVisitor *visitor;
+  void *context;
+  char *key_spill; /* keys and strings too long for the scratch buffers */
+  char *text_spill;
+  int stopped;
+} Walker;
+
+static int walk_value(Walker *walker, const char *key, size_t key_length);
+
+/* Unescapes the string at the cursor into `scratch`, or into `*spill`,
+ * allocated to fit, when it is longer. `*text` is NULL for a string holding
+ * a NUL. */
+static int walk_string(Walker *walker, char *scratch, size_t capacity, char **spill,
+                       const char **text, size_t *length) {
+  Decoder *decoder = &walker->decoder;
+  const char *start = decoder->cursor;
+  int fits = 0;
+  if (!scan_string(decoder, scratch, capacity, length, &fits)) return 0;
+  *text = fits ? scratch : NULL;
+  if (fits || *length < capacity) return 1;
+  free(*spill);
+  *spill = malloc(*length + 1);
+  if (!*spill) {
+    walker->stopped = 1;
+    return 0;
+  }
+  decoder->cursor = start;
+  scan_string(decoder, *spill, *length + 1, length, &fits);
+  *text = fits ? *spill : NULL;
+  return 1;
+}
+
+static int walk_close(Walker *walker) {
+  walker->decoder.depth--;
+  if (walker->visitor->close && !walker->visitor->close(walker->context)) {
+    walker->stopped = 1;
+    return 0;
+  }
+  return 1;
+}
+
+static int walk_object(Walker *walker) {
+  Decoder *decoder = &walker->decoder;
+  if (++decoder->depth > BARISTA_JSON_MAX_DEPTH) return 0;
+  decoder->cursor++;
+  skip_space(decoder);
+  if (decoder->cursor < decoder->end && *decoder->cursor == '}') {
+    decoder->cursor++;
+    return walk_close(walker);
+  }
+  for (;;) {
+    skip_space(decoder);
+    if (decoder->cursor >= decoder->end || *decoder->cursor != '"') return 0;
+    const char *key = NULL;
+    size_t key_length = 0;
+    if (!walk_string(walker, decoder->key, sizeof(decoder->key), &walker->key_spill, &key, &key_length)) {
+      return 0;
+    }
+    if (!key) {
+      walker->stopped = 1;
+      return 0;
+    }
+    if (!expect(decoder, ':') || !walk_value(walker, key, key_length)) return 0;
+    skip_space(decoder);
+    if (decoder->cursor >= decoder->end) return 0;
+    char c = *decoder->cursor++;
+    if (c == '}') break;
+    if (c != ',') {
+      decoder->cursor--;
+      return 0;
+    }
+  }
+  return walk_close(walker);
+}
+
+static int walk_array(Walker *walker) {
+  Decoder *decoder = &walker->decoder;
+  if (++decoder->depth > BARISTA_JSON_MAX_DEPTH) return 0;
+  decoder->cursor++;
+  skip_space(decoder);
+  if (decoder->cursor < decoder->end && *decoder->cursor == ']') {
+    decoder->cursor++;
+    return walk_close(walker);
+  }
+  for (;;) {
+    if (!walk_value(walker, NULL, 0)) return 0;
+    skip_space(decoder);
+    if (decoder->cursor >= decoder->end) return 0;
+    char c = *decoder->cursor++;
+    if (c == ']') break;
+    if (c != ',') {
+      decoder->cursor--;
+      return 0;
+    }
+  }
+  return walk_close(walker);
+}
+
+static int walk_value(Walker *walker, const char *key, size_t key_length) {
+  Decoder *decoder = &walker->decoder;
+  skip_space(decoder);
+  if (decoder->cursor >= decoder->end) return 0;
+  BaristaJsonValue value;
+  memset(&value, 0, sizeof(value));
+  char c = *decoder->cursor;
+  if (c == '"') {
+    value.type = BARISTA_JSON_VALUE_STRING;
+    if (!walk_string(walker, decoder->text, sizeof(decoder->text), &walker->text_spill,
+                     &value.string, &value.length)) {
+      return 0;
+    }
+  } else if (c == '{' || c == '[') {
+    value.type = c == '{' ? BARISTA_JSON_VALUE_OBJECT : BARISTA_JSON_VALUE_ARRAY;
+  } else if (!scan_scalar(decoder, 1, &value)) {
+    return 0;
+  }
+  if (!walker->visitor->value(walker->context, key, key_length, &value)) {
+    walker->stopped = 1;
+    return 0;
+  }
+  if (c == '{') return walk_object(walker);
+  if (c == '[') return walk_array(walker);
+  return 1;
+}
+
+int barista_json_walk(const char *text,
+                      size_t length,
+                      const BaristaJsonVisitor *visitor,
+                      void *context,
+                      size_t *error_offset) {
+  if (!text || !visitor || !visitor->value) return 0;
+  Walker walker;
+  walker.decoder.start = text;
+  walker.decoder.cursor = text;
+  walker.decoder.end = text + length;
+  walker.decoder.depth = 0;
+  walker.visitor = visitor;
+  walker.context = context;
+  walker.key_spill = NULL;
+  walker.text_spill = NULL;
+  walker.stopped = 0;
+  if (length >= 3 && memcmp(text, "\xEF\xBB\xBF", 3) == 0) walker.decoder.cursor += 3;
+
+  int valid = walk_value(&walker, NULL, 0);
+  if (valid) {
+    skip_space(&walker.decoder);
+    valid = walker.decoder.cursor == walker.decoder.end;
+  }
+  free(walker.key_spill);
+  free(walker.text_spill);
+  if (walker.stopped) return -1;
+  if (!valid && error_offset) *error_offset = (size_t)(walker.decoder.cursor - walker.decoder.start);
+  return valid;
+}
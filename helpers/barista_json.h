@@ -0,0 +1,138 @@
+#pragma once
+
+/*
+ * Barista JSON
+ *
+ * One-pass JSON decoder that writes straight into the helpers' own C
+ * structs. The caller describes the members it cares about in a field
+ * table; the decoder walks the text once, front to back, and stores each
+ * value whose key path matches a field. Everything else (unknown keys,
+ * nested objects and arrays the schema does not mention) is validated and
+ * skipped without being stored anywhere, so a key only ever matches at the
+ * level its table sits at.
+ *
+ * Nothing is allocated while decoding: strings are unescaped into a fixed
+ * scratch buffer and copied into their field once they are known to fit. A
+ * string that does not fit its field is dropped, not truncated, so a field
+ * holds either the whole value or what it held before. Values of the wrong
+ * JSON type are dropped the same way. Numbers are stored in `int` or
+ * `float` members; colors accept "0xAARRGGBB" strings as well as numbers;
+ * enums store the index of the matching name as an `int`.
+ *
+ * Arrays decode objects into consecutive elements of `size` bytes, each
+ * zeroed first, up to `capacity`; later elements are skipped, and the
+ * number stored goes into the `int` at `count_offset`. Objects whose keys
+ * are data rather than schema ({"clock": true, ...}) use ENTRIES: `entry`
+ * is called once with a NULL key when the object opens, so it can reset
+ * what it fills, and then once per member. Nested values in such an object
+ * reach `entry` with only their type set.
+ *
+ * The decoder stops at the first syntax error. Fields decoded before it
+ * keep their values.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BARISTA_JSON_MAX_DEPTH 64
+#define BARISTA_JSON_MAX_KEY 256
+#define BARISTA_JSON_MAX_TEXT 1024 /* longest string value, with its NUL */
+
+typedef enum {
+  BARISTA_JSON_STRING = 1, /* char[size] */
+  BARISTA_JSON_INT,        /* int */
+  BARISTA_JSON_FLOAT,      /* float */
+  BARISTA_JSON_BOOL,       /* int, 0 or 1 */
+  BARISTA_JSON_COLOR,      /* uint32_t */
+  BARISTA_JSON_ENUM,       /* int index into `choices` */
+  BARISTA_JSON_OBJECT,     /* nested struct described by `fields` */
+  BARISTA_JSON_ARRAY,      /* array of structs described by `fields` */
+  BARISTA_JSON_ENTRIES,    /* object with data keys, passed to `entry` */
+} BaristaJsonFieldType;
+
+typedef enum {
+  BARISTA_JSON_VALUE_STRING = 1,
+  BARISTA_JSON_VALUE_NUMBER,
+  BARISTA_JSON_VALUE_BOOL,
+  BARISTA_JSON_VALUE_NULL,
+  BARISTA_JSON_VALUE_OBJECT,
+  BARISTA_JSON_VALUE_ARRAY,
+} BaristaJsonValueType;
+
+typedef struct {
+  BaristaJsonValueType type;
+  const char *string; /* STRING: unescaped and NUL-terminated */
+  size_t length;
+  double number;
+  int boolean;
+  int integer;        /* NUMBER: written without a fraction or exponent */
+} BaristaJsonValue;
+
+/* `object` is the struct the ENTRIES field sits in, offset applied. */
+typedef void (*BaristaJsonEntryFunction)(void *object, const char *key, const BaristaJsonValue *value);
+
+typedef struct BaristaJsonField BaristaJsonField;
+
+/* Field tables end with an entry whose key is NULL. */
+struct BaristaJsonField {
+  const char *key;
+  BaristaJsonFieldType type;
+  size_t offset;                   /* of the member in the enclosing struct */
+  size_t size;                     /* of the member; for ARRAY, of one element */
+  const BaristaJsonField *fields;  /* OBJECT, ARRAY */
+  size_t capacity;                 /* ARRAY: elements */
+  size_t count_offset;             /* ARRAY: int element count, in the enclosing struct */
+  const char *const *choices;      /* ENUM: names, NULL-terminated */
+  BaristaJsonEntryFunction entry;  /* ENTRIES */
+};
+
+/* `.offset` and `.size` of `member` in `Type`, for designated initializers. */
+#define BARISTA_JSON_MEMBER(Type, member) \
+  .offset = offsetof(Type, member), .size = sizeof(((Type *)0)->member)
+
+/* Decodes `text` against `root`, whose key is ignored; `target` is the
+ * struct root's offset applies to. Returns 1 when the whole text was valid
+ * JSON and 0 on a syntax error, with its byte offset in `*error_offset`
+ * when that is not NULL. */
+int barista_json_decode(const char *text,
+                        size_t length,
+                        const BaristaJsonField *root,
+                        void *target,
+                        size_t *error_offset);
+
+/* Reads the file at `path` in one go and decodes it. -1 when it could not
+ * be read. */
+int barista_json_decode_file(const char *path,
+                             const BaristaJsonField *root,
+                             void *target,
+                             size_t *error_offset);
+
+/*
+ * Walking: for callers that want the whole document rather than a schema's
+ * worth of it. `value` sees every value in document order: scalars, and
+ * objects and arrays as they open, after which their members follow until
+ * `close`. `key` is the member's key, NULL for array elements and the root.
+ * Keys and strings are unescaped whole, whatever their length. A string
+ * holding "\u0000" arrives with `string` NULL; a key holding one stops the
+ * walk. Returning 0 from a callback stops it too.
+ */
+typedef struct {
+  int (*value)(void *context, const char *key, size_t key_length, const BaristaJsonValue *value);
+  int (*close)(void *context);
+} BaristaJsonVisitor;
+
+/* Walks `text`. Returns 1 when the whole text was valid JSON, 0 on a syntax
+ * error, with its byte offset in `*error_offset` when that is not NULL, and
+ * -1 when the walk was stopped. */
+int barista_json_walk(const char *text,
+                      size_t length,
+                      const BaristaJsonVisitor *visitor,
+                      void *context,
+                      size_t *error_offset);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,805 @@
+#define _DEFAULT_SOURCE 1
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <regex.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "barista_transport.h"
+
+/*
+ * Barista Mock Bar
+ *
+ * A stand-in for SketchyBar on a Unix socket, so the native send paths can
+ * be exercised and benchmarked where there is no bar (Linux CI). Point
+ * helpers at it with BARISTA_TRANSPORT_SOCKET.
+ *
+ * It reads the same framed, NUL-separated token payloads the transport
+ * sends and applies them to an in-memory item/property table:
+ * - `--add <type> <name> ...` creates an item (brackets keep their members).
+ * - `--set <name|/regex/> key=value...`, `--default` and `--bar` store
+ *   properties; `--remove` drops items; `--query <name>` answers with the
+ *   item's properties as JSON.
+ * - `--trigger`, `--subscribe`, `--push`, `--animate` and the other
+ *   commands are accepted and counted.
+ * Problems are answered the way SketchyBar does, with `[!]` lines, so a
+ * confirmed send reports BARISTA_SEND_CONFIRMED_ERROR.
+ *
+ * Every request's receive latency - from the poll wakeup that saw it to its
+ * reply being written - lands in a histogram reported by `stats`.
+ *
+ * Usage:
+ *   barista_mock_bar [serve] [--socket PATH] [--auto-add] [--delay-us N]
+ *                    [--log PATH]
+ *   barista_mock_bar stats|reset [--socket PATH]
+ *   barista_mock_bar query NAME [--socket PATH]
+ *
+ * PATH defaults to BARISTA_TRANSPORT_SOCKET.
+ */
+
+#define MOCK_MAX_CLIENTS 64
+#define MOCK_MAX_ITEMS 4096
+#define MOCK_ITEM_SLOTS 8192
+#define MOCK_READ_TIMEOUT_MS 50
+#define MOCK_CONTROL_TIMEOUT_MS 500
+#define MOCK_MAX_REPLY_BYTES 8192
+/* Request flags understood only by the mock bar. */
+#define MOCK_FRAME_STATS 0x100u
+#define MOCK_FRAME_RESET 0x200u
+
+/* Latency buckets: exact below 8ns, then 8 linear steps per power of two,
+ * which keeps every percentile within 12.5% of the true value. */
+#define MOCK_HISTOGRAM_SUB_BITS 3
+#define MOCK_HISTOGRAM_BUCKETS ((64 - MOCK_HISTOGRAM_SUB_BITS + 1) << MOCK_HISTOGRAM_SUB_BITS)
+
+static const char BAR_ITEM[] = "bar";
+static const char DEFAULTS_ITEM[] = "defaults";
+
+typedef struct {
+  char *key;
+  char *value;
+} MockProperty;
+
+typedef struct {
+  char *name;
+  char *type;
+  MockProperty *properties;
+  int property_count;
+  int property_capacity;
+} MockItem;
+
+typedef struct {
+  uint64_t messages;
+  uint64_t replies;
+  uint64_t errors;
+  uint64_t invalid;
+  uint64_t commands;
+  uint64_t sets;
+  uint64_t properties;
+  uint64_t triggers;
+  uint64_t queries;
+  uint64_t bytes_in;
+  uint64_t latency_ns_max;
+  uint64_t histogram[MOCK_HISTOGRAM_BUCKETS];
+} MockStats;
+
+typedef struct {
+  MockItem items[MOCK_MAX_ITEMS];
+  int item_count;
+  int slots[MOCK_ITEM_SLOTS];
+  int auto_add;
+  MockStats stats;
+} MockBar;
+
+/* One reply under construction: `[!]` lines on failure, or query output. */
+typedef struct {
+  char text[MOCK_MAX_REPLY_BYTES];
+  size_t length;
+  int failed;
+} MockReply;
+
+static volatile sig_atomic_t g_stop = 0;
+
+static int64_t monotonic_nanoseconds(void) {
+  struct timespec value = {0};
+  if (clock_gettime(CLOCK_MONOTONIC, &value) != 0) return 0;
+  return (int64_t)value.tv_sec * 1000000000LL + value.tv_nsec;
+}
+
+static int histogram_bucket(uint64_t value) {
+  if (value < (1u << MOCK_HISTOGRAM_SUB_BITS)) return (int)value;
+  int exponent = 63 - __builtin_clzll(value);
+  int shift = exponent - MOCK_HISTOGRAM_SUB_BITS;
+  int sub = (int)((value >> shift) & ((1u << MOCK_HISTOGRAM_SUB_BITS) - 1));
+  return ((shift + 1) << MOCK_HISTOGRAM_SUB_BITS) + sub;
+}
+
+/* Largest value that still falls in the bucket. */
+static uint64_t histogram_upper(int bucket) {
+  if (bucket < (1 << MOCK_HISTOGRAM_SUB_BITS)) return (uint64_t)bucket;
+  int shift = (bucket >> MOCK_HISTOGRAM_SUB_BITS) - 1;
+  uint64_t sub = (uint64_t)(bucket & ((1 << MOCK_HISTOGRAM_SUB_BITS) - 1));
+  uint64_t lower = ((1ULL << MOCK_HISTOGRAM_SUB_BITS) + sub) << shift;
+  return lower + (1ULL << shift) - 1;
+}
+
+static void histogram_record(MockStats *stats, uint64_t nanoseconds) {
+  stats->histogram[histogram_bucket(nanoseconds)]++;
+  if (nanoseconds > stats->latency_ns_max) stats->latency_ns_max = nanoseconds;
+}
+
+/* Upper bound of the bucket holding the given percentile; 0 when empty. */
+static uint64_t histogram_percentile(const MockStats *stats, double percentile) {
+  uint64_t total = 0;
+  for (int i = 0; i < MOCK_HISTOGRAM_BUCKETS; i++) total += stats->histogram[i];
+  if (total == 0) return 0;
+  uint64_t rank = (uint64_t)((double)total * percentile / 100.0 + 0.5);
+  if (rank < 1) rank = 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < MOCK_HISTOGRAM_BUCKETS; i++) {
+    seen += stats->histogram[i];
+    if (seen >= rank) {
+      uint64_t upper = histogram_upper(i);
+      return upper < stats->latency_ns_max ? upper : stats->latency_ns_max;
+    }
+  }
+  return stats->latency_ns_max;
+}
+
+static uint64_t hash_name(const char *name) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char *cursor = name; *cursor; cursor++) {
+    hash ^= (uint8_t)*cursor;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static void reply_append(MockReply *reply, const char *format, ...)
+  __attribute__((format(printf, 2, 3)));
+
+static void reply_append(MockReply *reply, const char *format, ...) {
+  if (reply->length + 1 >= sizeof(reply->text)) return;
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(reply->text + reply->length, sizeof(reply->text) - reply->length,
+                          format, args);
+  va_end(args);
+  if (written < 0) return;
+  reply->length += (size_t)written;
+  if (reply->length >= sizeof(reply->text)) reply->length = sizeof(reply->text) - 1;
+}
+
+static void reply_error(MockReply *reply, const char *command, const char *message,
+                        const char *subject) {
+  reply->failed = 1;
+  reply_append(reply, "[!] %s: %s '%s'\n", command, message, subject ? subject : "");
+}
+
+/* Slot for name: either the item's slot or the empty slot it would take. */
+static int item_slot(const MockBar *bar, const char *name) {
+  size_t slot = (size_t)hash_name(name) & (MOCK_ITEM_SLOTS - 1);
+  for (;;) {
+    int index = bar->slots[slot] - 1;
+    if (index < 0 || strcmp(bar->items[index].name, name) == 0) return (int)slot;
+    slot = (slot + 1) & (MOCK_ITEM_SLOTS - 1);
+  }
+}
+
+static MockItem *find_item(MockBar *bar, const char *name) {
+  int index = bar->slots[item_slot(bar, name)] - 1;
+  return index >= 0 ? &bar->items[index] : NULL;
+}
+
+static MockItem *add_item(MockBar *bar, const char *name, const char *type) {
+  int slot = item_slot(bar, name);
+  if (bar->slots[slot] != 0 || bar->item_count >= MOCK_MAX_ITEMS) return NULL;
+  MockItem *item = &bar->items[bar->item_count];
+  memset(item, 0, sizeof(*item));
+  item->name = strdup(name);
+  item->type = strdup(type);
+  if (!item->name || !item->type) {
+    free(item->name);
+    free(item->type);
+    return NULL;
+  }
+  bar->slots[slot] = ++bar->item_count;
+  return item;
+}
+
+static void free_item(MockItem *item) {
+  for (int i = 0; i < item->property_count; i++) {
+    free(item->properties[i].key);
+    free(item->properties[i].value);
+  }
+  free(item->properties);
+  free(item->name);
+  free(item->type);
+}
+
+/* Removing compacts the item array, so the slot table is rebuilt. */
+static void remove_item(MockBar *bar, MockItem *item) {
+  int index = (int)(item - bar->items);
+  free_item(item);
+  memmove(&bar->items[index], &bar->items[index + 1],
+          sizeof(MockItem) * (size_t)(bar->item_count - index - 1));
+  bar->item_count--;
+  memset(bar->slots, 0, sizeof(bar->slots));
+  for (int i = 0; i < bar->item_count; i++) {
+    bar->slots[item_slot(bar, bar->items[i].name)] = i + 1;
+  }
+}
+
+static void clear_items(MockBar *bar) {
+  for (int i = 0; i < bar->item_count; i++) free_item(&bar->items[i]);
+  bar->item_count = 0;
+  memset(bar->slots, 0, sizeof(bar->slots));
+}
+
+/* Stores one `key=value` token; `key=toggle` flips an on/off value the way
+ * SketchyBar does. Returns 0 when the token is not a property. */
+static int set_property(MockItem *item, const char *token) {
+  const char *separator = strchr(token, '=');
+  if (!separator || separator == token) return 0;
+  size_t key_length = (size_t)(separator - token);
+  int toggle = strcmp(separator + 1, "toggle") == 0;
+  for (int i = 0; i < item->property_count; i++) {
+    MockProperty *property = &item->properties[i];
+    if (strlen(property->key) == key_length && memcmp(property->key, token, key_length) == 0) {
+      const char *next = separator + 1;
+      if (toggle) next = strcmp(property->value, "on") == 0 ? "off" : "on";
+      char *value = strdup(next);
+      if (!value) return 1;
+      free(property->value);
+      property->value = value;
+      return 1;
+    }
+  }
+  if (item->property_count == item->property_capacity) {
+    int capacity = item->property_capacity ? item->property_capacity * 2 : 8;
+    MockProperty *properties = realloc(item->properties, sizeof(MockProperty) * (size_t)capacity);
+    if (!properties) return 1;
+    item->properties = properties;
+    item->property_capacity = capacity;
+  }
+  MockProperty *property = &item->properties[item->property_count];
+  property->key = strndup(token, key_length);
+  property->value = strdup(toggle ? "on" : separator + 1);
+  if (!property->key || !property->value) {
+    free(property->key);
+    free(property->value);
+    return 1;
+  }
+  item->property_count++;
+  return 1;
+}
+
+static void set_named_property(MockItem *item, const char *key, const char *value) {
+  size_t length = strlen(key) + strlen(value) + 2;
+  char *token = malloc(length);
+  if (!token) return;
+  snprintf(token, length, "%s=%s", key, value);
+  set_property(item, token);
+  free(token);
+}
+
+static int is_command(const char *token) {
+  return token[0] == '-' && token[1] == '-';
+}
+
+/* Token cursor over a validated payload. */
+typedef struct {
+  const char *tokens[BARISTA_TRANSPORT_MAX_PAYLOAD_BYTES / 2];
+  int count;
+  int next;
+} TokenList;
+
+static void split_tokens(TokenList *list, const uint8_t *payload, size_t length) {
+  list->count = 0;
+  list->next = 0;
+  size_t cursor = 0;
+  while (cursor < length && payload[cursor] != '\0') {
+    const char *token = (const char *)payload + cursor;
+    list->tokens[list->count++] = token;
+    cursor += strlen(token) + 1;
+  }
+}
+
+static const char *peek_argument(const TokenList *list) {
+  if (list->next >= list->count || is_command(list->tokens[list->next])) return NULL;
+  return list->tokens[list->next];
+}
+
+static const char *take_argument(TokenList *list) {
+  const char *token = peek_argument(list);
+  if (token) list->next++;
+  return token;
+}
+
+static void skip_arguments(TokenList *list) {
+  while (take_argument(list)) {
+  }
+}
+
+static int is_regex_target(const char *name) {
+  size_t length = strlen(name);
+  return length >= 2 && name[0] == '/' && name[length - 1] == '/';
+}
+
+/* Calls apply() for the named item, or for every item a /regex/ matches.
+ * Returns the number of items visited. */
+static int for_each_target(MockBar *bar, const char *name,
+                           void (*apply)(MockBar *, MockItem *, void *), void *context) {
+  if (!is_regex_target(name)) {
+    MockItem *item = find_item(bar, name);
+    if (!item) return 0;
+    apply(bar, item, context);
+    return 1;
+  }
+  char pattern[256];
+  snprintf(pattern, sizeof(pattern), "%.*s", (int)strlen(name) - 2, name + 1);
+  regex_t regex;
+  if (regcomp(&regex, pattern, REG_EXTENDED | REG_NOSUB) != 0) return 0;
+  int visited = 0;
+  /* Walk backwards so apply() may remove the item it was given. */
+  for (int i = bar->item_count - 1; i >= 0; i--) {
+    if (regexec(&regex, bar->items[i].name, 0, NULL, 0) != 0) continue;
+    apply(bar, &bar->items[i], context);
+    visited++;
+  }
+  regfree(&regex);
+  return visited;
+}
+
+typedef struct {
+  TokenList *list;
+  int start;
+  int bad_property;
+} SetContext;
+
+static void apply_set(MockBar *bar, MockItem *item, void *opaque) {
+  SetContext *context = opaque;
+  for (int i = context->start; i < context->list->next; i++) {
+    if (set_property(item, context->list->tokens[i])) bar->stats.properties++;
+    else context->bad_property = i;
+  }
+}
+
+static void apply_remove(MockBar *bar, MockItem *item, void *unused) {
+  (void)unused;
+  remove_item(bar, item);
+}
+
+static void command_set(MockBar *bar, TokenList *list, MockReply *reply) {
+  const char *name = take_argument(list);
+  if (!name) {
+    reply_error(reply, "Set", "Missing item name for", "--set");
+    return;
+  }
+  SetContext context = {list, list->next, -1};
+  skip_arguments(list);
+  bar->stats.sets++;
+  if (!is_regex_target(name) && !find_item(bar, name) && bar->auto_add) {
+    add_item(bar, name, "item");
+  }
+  if (for_each_target(bar, name, apply_set, &context) == 0 && !is_regex_target(name)) {
+    reply_error(reply, "Set", "Item not found", name);
+    return;
+  }
+  if (context.bad_property >= 0) {
+    reply_error(reply, "Set", "Invalid property", list->tokens[context.bad_property]);
+  }
+}
+
+static void command_properties(MockBar *bar, TokenList *list, MockReply *reply,
+                               const char *command, const char *target) {
+  MockItem *item = find_item(bar, target);
+  if (!item) item = add_item(bar, target, target);
+  for (const char *token = take_argument(list); token; token = take_argument(list)) {
+    if (item && set_property(item, token)) bar->stats.properties++;
+    else reply_error(reply, command, "Invalid property", token);
+  }
+}
+
+static void command_add(MockBar *bar, TokenList *list, MockReply *reply) {
+  const char *type = take_argument(list);
+  const char *name = take_argument(list);
+  if (!type || !name) {
+    reply_error(reply, "Add", "Missing type or name for", "--add");
+    skip_arguments(list);
+    return;
+  }
+  if (strcmp(type, "event") == 0) {
+    skip_arguments(list);
+    return;
+  }
+  if (find_item(bar, name)) {
+    reply_error(reply, "Add", "Item already exists", name);
+    skip_arguments(list);
+    return;
+  }
+  MockItem *item = add_item(bar, name, type);
+  if (!item) {
+    reply_error(reply, "Add", "Item table full, dropped", name);
+    skip_arguments(list);
+    return;
+  }
+  /* position for items, member patterns for brackets, width for graphs */
+  int position = strcmp(type, "bracket") != 0;
+  char key[32];
+  for (int argument = 0; peek_argument(list); argument++) {
+    const char *token = take_argument(list);
+    if (argument == 0 && position) snprintf(key, sizeof(key), "position");
+    else snprintf(key, sizeof(key), "argument.%d", argument);
+    set_named_property(item, key, token);
+  }
+}
+
+static void command_remove(MockBar *bar, TokenList *list, MockReply *reply) {
+  const char *name = take_argument(list);
+  if (!name) {
+    reply_error(reply, "Remove", "Missing item name for", "--remove");
+    return;
+  }
+  skip_arguments(list);
+  if (for_each_target(bar, name, apply_remove, NULL) == 0 && !is_regex_target(name)) {
+    reply_error(reply, "Remove", "Item not found", name);
+  }
+}
+
+static void reply_json_string(MockReply *reply, const char *value) {
+  reply_append(reply, "\"");
+  for (const char *cursor = value; *cursor; cursor++) {
+    unsigned char c = (unsigned char)*cursor;
+    if (c == '"' || c == '\\') reply_append(reply, "\\%c", c);
+    else if (c < 0x20) reply_append(reply, "\\u%04x", c);
+    else reply_append(reply, "%c", c);
+  }
+  reply_append(reply, "\"");
+}
+
+static void command_query(MockBar *bar, TokenList *list, MockReply *reply) {
+  const char *name = take_argument(list);
+  skip_arguments(list);
+  bar->stats.queries++;
+  const MockItem *item = name ? find_item(bar, name) : NULL;
+  if (!item) {
+    reply_error(reply, "Query", "Item not found", name);
+    return;
+  }
+  reply_append(reply, "{\"name\":");
+  reply_json_string(reply, item->name);
+  reply_append(reply, ",\"type\":");
+  reply_json_string(reply, item->type);
+  reply_append(reply, ",\"properties\":{");
+  for (int i = 0; i < item->property_count; i++) {
+    if (i > 0) reply_append(reply, ",");
+    reply_json_string(reply, item->properties[i].key);
+    reply_append(reply, ":");
+    reply_json_string(reply, item->properties[i].value);
+  }
+  reply_append(reply, "}}\n");
+}
+
+/* Applies one request in order. Like SketchyBar, a failing command is
+ * reported and the rest of the request still applies. */
+static void apply_request(MockBar *bar, const uint8_t *payload, size_t length,
+                          MockReply *reply) {
+  static TokenList list;
+  split_tokens(&list, payload, length);
+  reply->length = 0;
+  reply->failed = 0;
+  reply->text[0] = '\0';
+
+  /* The CLI's legacy message flag. */
+  if (list.count > 0 && strcmp(list.tokens[0], "-m") == 0) list.next++;
+
+  while (list.next < list.count) {
+    const char *command = list.tokens[list.next++];
+    bar->stats.commands++;
+    if (!is_command(command)) {
+      reply_error(reply, "Parse", "Expected a command, got", command);
+      skip_arguments(&list);
+      continue;
+    }
+    if (strcmp(command, "--set") == 0) {
+      command_set(bar, &list, reply);
+    } else if (strcmp(command, "--add") == 0) {
+      command_add(bar, &list, reply);
+    } else if (strcmp(command, "--remove") == 0) {
+      command_remove(bar, &list, reply);
+    } else if (strcmp(command, "--default") == 0) {
+      command_properties(bar, &list, reply, "Default", DEFAULTS_ITEM);
+    } else if (strcmp(command, "--bar") == 0) {
+      command_properties(bar, &list, reply, "Bar", BAR_ITEM);
+    } else if (strcmp(command, "--query") == 0) {
+      command_query(bar, &list, reply);
+    } else if (strcmp(command, "--trigger") == 0) {
+      bar->stats.triggers++;
+      if (!take_argument(&list)) reply_error(reply, "Trigger", "Missing event for", command);
+      skip_arguments(&list);
+    } else if (strcmp(command, "--subscribe") == 0 || strcmp(command, "--push") == 0
+               || strcmp(command, "--animate") == 0 || strcmp(command, "--move") == 0
+               || strcmp(command, "--clone") == 0 || strcmp(command, "--rename") == 0
+               || strcmp(command, "--reorder") == 0 || strcmp(command, "--event") == 0
+               || strcmp(command, "--hotload") == 0 || strcmp(command, "--update") == 0) {
+      skip_arguments(&list);
+    } else {
+      reply_error(reply, "Parse", "Unknown command", command);
+      skip_arguments(&list);
+    }
+  }
+  if (reply->failed) bar->stats.errors++;
+}
+
+static int format_stats(const MockBar *bar, char *buffer, size_t capacity) {
+  const MockStats *stats = &bar->stats;
+  int written = snprintf(buffer, capacity,
+                         "items=%d\n"
+                         "messages=%llu\n"
+                         "replies=%llu\n"
+                         "errors=%llu\n"
+                         "invalid=%llu\n"
+                         "commands=%llu\n"
+                         "sets=%llu\n"
+                         "properties=%llu\n"
+                         "triggers=%llu\n"
+                         "queries=%llu\n"
+                         "bytes_in=%llu\n"
+                         "latency_p50_ns=%llu\n"
+                         "latency_p90_ns=%llu\n"
+                         "latency_p99_ns=%llu\n"
+                         "latency_max_ns=%llu\n",
+                         bar->item_count,
+                         (unsigned long long)stats->messages,
+                         (unsigned long long)stats->replies,
+                         (unsigned long long)stats->errors,
+                         (unsigned long long)stats->invalid,
+                         (unsigned long long)stats->commands,
+                         (unsigned long long)stats->sets,
+                         (unsigned long long)stats->properties,
+                         (unsigned long long)stats->triggers,
+                         (unsigned long long)stats->queries,
+                         (unsigned long long)stats->bytes_in,
+                         (unsigned long long)histogram_percentile(stats, 50.0),
+                         (unsigned long long)histogram_percentile(stats, 90.0),
+                         (unsigned long long)histogram_percentile(stats, 99.0),
+                         (unsigned long long)stats->latency_ns_max);
+  /* One line per non-empty bucket: upper bound in ns, then the count. */
+  for (int i = 0; written > 0 && (size_t)written < capacity && i < MOCK_HISTOGRAM_BUCKETS; i++) {
+    if (stats->histogram[i] == 0) continue;
+    written += snprintf(buffer + written, capacity - (size_t)written, "latency_le_ns.%llu=%llu\n",
+                        (unsigned long long)histogram_upper(i),
+                        (unsigned long long)stats->histogram[i]);
+  }
+  return written;
+}
+
+typedef struct {
+  int auto_add;
+  long delay_us;
+  FILE *log;
+} MockOptions;
+
+static void log_request(FILE *log, const uint8_t *payload, size_t length) {
+  if (!log) return;
+  for (size_t i = 0; i + 2 < length; i++) {
+    fputc(payload[i] == '\0' ? ' ' : payload[i], log);
+  }
+  fputc('\n', log);
+  fflush(log);
+}
+
+/* Handles one request frame and writes its reply. */
+static void handle_request(int fd, MockBar *bar, const MockOptions *options,
+                           const uint8_t *payload, size_t length, uint32_t flags) {
+  static MockReply reply;
+  if (flags & (MOCK_FRAME_STATS | MOCK_FRAME_RESET)) {
+    if (flags & MOCK_FRAME_RESET) {
+      memset(&bar->stats, 0, sizeof(bar->stats));
+      clear_items(bar);
+    }
+    static char text[BARISTA_TRANSPORT_MAX_RESPONSE_BYTES];
+    int written = format_stats(bar, text, sizeof(text));
+    if (written > 0 && (size_t)written < sizeof(text)) {
+      barista_frame_write(fd, text, (size_t)written + 1, 0, MOCK_READ_TIMEOUT_MS);
+    }
+    return;
+  }
+
+  int wants_reply = !(flags & BARISTA_FRAME_NO_REPLY);
+  bar->stats.messages++;
+  bar->stats.bytes_in += length;
+  if (!barista_payload_valid(payload, length)) {
+    bar->stats.invalid++;
+    if (wants_reply) {
+      static const char invalid[] = "[!] Parse: Malformed payload\n";
+      barista_frame_write(fd, invalid, sizeof(invalid), 0, MOCK_READ_TIMEOUT_MS);
+      bar->stats.replies++;
+    }
+    return;
+  }
+
+  log_request(options->log, payload, length);
+  apply_request(bar, payload, length, &reply);
+  if (options->delay_us > 0) usleep((useconds_t)options->delay_us);
+  if (!wants_reply) return;
+  barista_frame_write(fd, reply.text, reply.length + 1, 0, MOCK_READ_TIMEOUT_MS);
+  bar->stats.replies++;
+}
+
+static void handle_stop(int signal_number) {
+  (void)signal_number;
+  g_stop = 1;
+}
+
+static int set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0) return -1;
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int serve(const char *path, const MockOptions *options) {
+  signal(SIGPIPE, SIG_IGN);
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handle_stop;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGTERM, &action, NULL);
+  sigaction(SIGINT, &action, NULL);
+
+  int listener = barista_socket_listen(path);
+  if (listener < 0 || set_nonblocking(listener) != 0) {
+    fprintf(stderr, "barista_mock_bar: cannot listen on %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  static MockBar bar;
+  static uint8_t request[BARISTA_TRANSPORT_MAX_PAYLOAD_BYTES];
+  bar.auto_add = options->auto_add;
+
+  struct pollfd descriptors[1 + MOCK_MAX_CLIENTS];
+  int client_count = 0;
+  descriptors[0].fd = listener;
+  descriptors[0].events = POLLIN;
+
+  while (!g_stop) {
+    int ready = poll(descriptors, (nfds_t)(1 + client_count), -1);
+    if (ready < 0 && errno != EINTR) break;
+    int64_t woke = monotonic_nanoseconds();
+
+    if (ready > 0 && (descriptors[0].revents & POLLIN)) {
+      for (;;) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) break;
+        if (client_count >= MOCK_MAX_CLIENTS || set_nonblocking(client) != 0) {
+          close(client);
+          continue;
+        }
+        client_count++;
+        descriptors[client_count].fd = client;
+        descriptors[client_count].events = POLLIN;
+        descriptors[client_count].revents = 0;
+      }
+    }
+
+    for (int i = client_count; ready > 0 && i >= 1; i--) {
+      if (!(descriptors[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+      size_t length = 0;
+      uint32_t flags = 0;
+      int fd = descriptors[i].fd;
+      if (barista_frame_read(fd, request, sizeof(request), &length, &flags,
+                             MOCK_READ_TIMEOUT_MS) != 0) {
+        close(fd);
+        descriptors[i] = descriptors[client_count];
+        client_count--;
+        continue;
+      }
+      handle_request(fd, &bar, options, request, length, flags);
+      if (!(flags & (MOCK_FRAME_STATS | MOCK_FRAME_RESET))) {
+        histogram_record(&bar.stats, (uint64_t)(monotonic_nanoseconds() - woke));
+      }
+    }
+  }
+
+  for (int i = 1; i <= client_count; i++) close(descriptors[i].fd);
+  close(listener);
+  unlink(path);
+  clear_items(&bar);
+  return 0;
+}
+
+/* Sends one control or query request and prints the reply. */
+static int control(const char *path, const uint8_t *payload, size_t length, uint32_t flags) {
+  int fd = barista_socket_connect(path);
+  if (fd < 0) {
+    fprintf(stderr, "barista_mock_bar: not running at %s\n", path);
+    return 1;
+  }
+  static char text[BARISTA_TRANSPORT_MAX_RESPONSE_BYTES];
+  size_t reply_length = 0;
+  int status = 1;
+  if (barista_frame_write(fd, payload, length, flags, MOCK_CONTROL_TIMEOUT_MS) == 0
+      && barista_frame_read(fd, text, sizeof(text) - 1, &reply_length, NULL,
+                            MOCK_CONTROL_TIMEOUT_MS) == 0) {
+    text[reply_length] = '\0';
+    fputs(text, stdout);
+    status = barista_response_status(text, reply_length + 1) > 0 ? 0 : 1;
+  }
+  close(fd);
+  return status;
+}
+
+static void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [serve] [--socket PATH] [--auto-add] [--delay-us N] [--log PATH]\n"
+          "       %s stats|reset [--socket PATH]\n"
+          "       %s query NAME [--socket PATH]\n",
+          program, program, program);
+}
+
+int main(int argc, char **argv) {
+  const char *command = "serve";
+  const char *query_name = NULL;
+  int index = 1;
+  if (index < argc && argv[index][0] != '-') command = argv[index++];
+  if (strcmp(command, "query") == 0 && index < argc) query_name = argv[index++];
+
+  const char *path = getenv("BARISTA_TRANSPORT_SOCKET");
+  const char *log_path = NULL;
+  MockOptions options = {0, 0, NULL};
+  for (; index < argc; index++) {
+    if (strcmp(argv[index], "--socket") == 0 && index + 1 < argc) {
+      path = argv[++index];
+    } else if (strcmp(argv[index], "--auto-add") == 0) {
+      options.auto_add = 1;
+    } else if (strcmp(argv[index], "--delay-us") == 0 && index + 1 < argc) {
+      options.delay_us = atol(argv[++index]);
+    } else if (strcmp(argv[index], "--log") == 0 && index + 1 < argc) {
+      log_path = argv[++index];
+    } else {
+      print_usage(argv[0]);
+      return 2;
+    }
+  }
+  if (!path || path[0] == '\0') {
+    fprintf(stderr, "barista_mock_bar: pass --socket or set BARISTA_TRANSPORT_SOCKET\n");
+    return 2;
+  }
+
+  if (strcmp(command, "serve") == 0) {
+    if (log_path) {
+      options.log = fopen(log_path, "a");
+      if (!options.log) {
+        fprintf(stderr, "barista_mock_bar: cannot open %s: %s\n", log_path, strerror(errno));
+        return 1;
+      }
+    }
+    int status = serve(path, &options);
+    if (options.log) fclose(options.log);
+    return status;
+  }
+
+  static const uint8_t probe[] = {0};
+  if (strcmp(command, "stats") == 0) return control(path, probe, sizeof(probe), MOCK_FRAME_STATS);
+  if (strcmp(command, "reset") == 0) return control(path, probe, sizeof(probe), MOCK_FRAME_RESET);
+  if (strcmp(command, "query") == 0 && query_name) {
+    uint8_t payload[512];
+    int written = snprintf((char *)payload, sizeof(payload), "--query%c%s%c", '\0', query_name, '\0');
+    if (written <= 0 || (size_t)written + 1 > sizeof(payload)) return 2;
+    payload[written] = '\0';
+    return control(path, payload, (size_t)written + 1, 0);
+  }
+  print_usage(argv[0]);
+  return 2;
+}
@@ -0,0 +1,129 @@
+#include "barista_payload.h"
+
+#include <string.h>
+
+#define VERB(literal) {literal, sizeof(literal) - 1}
+
+static const struct {
+  const char *bytes;
+  size_t length;
+} kVerbs[BARISTA_VERB_COUNT] = {
+  [BARISTA_VERB_SET] = VERB("--set"),
+  [BARISTA_VERB_TRIGGER] = VERB("--trigger"),
+  [BARISTA_VERB_ADD] = VERB("--add"),
+  [BARISTA_VERB_EVENT] = VERB("event"),
+  [BARISTA_VERB_SUBSCRIBE] = VERB("--subscribe"),
+  [BARISTA_VERB_REMOVE] = VERB("--remove"),
+  [BARISTA_VERB_QUERY] = VERB("--query"),
+  [BARISTA_VERB_ANIMATE] = VERB("--animate"),
+  [BARISTA_VERB_BAR] = VERB("--bar"),
+  [BARISTA_VERB_DEFAULT] = VERB("--default"),
+};
+
+void barista_payload_init(BaristaPayload *payload, void *arena, size_t capacity) {
+  if (!payload) return;
+  payload->bytes = arena;
+  payload->capacity = arena ? capacity : 0;
+  payload->length = 0;
+  payload->arguments = 0;
+  payload->failed = !arena || capacity < 2;
+}
+
+static int payload_fail(BaristaPayload *payload) {
+  payload->failed = 1;
+  return 0;
+}
+
+/* Room for `length` more token bytes plus their NUL and the closing NUL. */
+static int payload_reserve(BaristaPayload *payload, size_t length) {
+  if (payload->failed) return 0;
+  if (length > payload->capacity || payload->capacity - length < payload->length + 2) {
+    return payload_fail(payload);
+  }
+  return 1;
+}
+
+static void payload_end_token(BaristaPayload *payload) {
+  payload->bytes[payload->length++] = 0;
+  payload->arguments++;
+}
+
+int barista_payload_token_bytes(BaristaPayload *payload, const char *bytes, size_t length) {
+  if (!payload) return 0;
+  if (!bytes || memchr(bytes, 0, length)) return payload_fail(payload);
+  if (!payload_reserve(payload, length)) return 0;
+  memcpy(payload->bytes + payload->length, bytes, length);
+  payload->length += length;
+  payload_end_token(payload);
+  return 1;
+}
+
+int barista_payload_token(BaristaPayload *payload, const char *token) {
+  if (!payload) return 0;
+  if (!token) return payload_fail(payload);
+  return barista_payload_token_bytes(payload, token, strlen(token));
+}
+
+int barista_payload_verb(BaristaPayload *payload, BaristaVerb verb) {
+  if (!payload) return 0;
+  if ((unsigned)verb >= BARISTA_VERB_COUNT) return payload_fail(payload);
+  return barista_payload_token_bytes(payload, kVerbs[verb].bytes, kVerbs[verb].length);
+}
+
+/* name and value are written separately so the token never passes through a
+ * format string or an intermediate buffer. */
+static int payload_property_bytes(BaristaPayload *payload,
+                                  const char *name,
+                                  const char *value,
+                                  size_t value_length) {
+  if (!payload) return 0;
+  if (!name || !value) return payload_fail(payload);
+  size_t name_length = strlen(name);
+  if (name_length == 0 || memchr(value, 0, value_length)) return payload_fail(payload);
+  if (!payload_reserve(payload, name_length + 1 + value_length)) return 0;
+  uint8_t *cursor = payload->bytes + payload->length;
+  memcpy(cursor, name, name_length);
+  cursor[name_length] = '=';
+  memcpy(cursor + name_length + 1, value, value_length);
+  payload->length += name_length + 1 + value_length;
+  payload_end_token(payload);
+  return 1;
+}
+
+int barista_payload_property(BaristaPayload *payload, const char *name, const char *value) {
+  if (!payload) return 0;
+  if (!value) return payload_fail(payload);
+  return payload_property_bytes(payload, name, value, strlen(value));
+}
+
+int barista_payload_property_int(BaristaPayload *payload,
+                                 const char *name,
+                                 long long value,
+                                 int min_digits) {
+  char digits[32];
+  size_t start = sizeof(digits);
+  unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value
+                                           : (unsigned long long)value;
+  int written = 0;
+  if (min_digits > 20) min_digits = 20;
+  do {
+    digits[--start] = (char)('0' + magnitude % 10ULL);
+    magnitude /= 10ULL;
+    written++;
+  } while (magnitude > 0);
+  while (written < min_digits) {
+    digits[--start] = '0';
+    written++;
+  }
+  if (value < 0) digits[--start] = '-';
+  return payload_property_bytes(payload, name, digits + start, sizeof(digits) - start);
+}
+
+size_t barista_payload_finish(BaristaPayload *payload) {
+  if (!payload || payload->failed || payload->arguments == 0
+      || payload->length + 1 > payload->capacity) {
+    return 0;
+  }
+  payload->bytes[payload->length++] = 0;
+  return payload->length;
+}
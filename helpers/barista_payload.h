@@ -0,0 +1,76 @@
+#pragma once
+
+/*
+ * Barista Payload Builder
+ *
+ * Writes SketchyBar request tokens straight into a caller-provided arena in
+ * the wire format barista_send() expects: every token ends in one NUL byte
+ * and barista_payload_finish() adds the closing NUL. Values are copied as
+ * they are, so quotes and spaces need no escaping and nothing is ever parsed
+ * back out of a shell-style command string.
+ *
+ * The builder never allocates. The first token that does not fit, or that
+ * contains a NUL byte, marks the payload failed; later calls are no-ops and
+ * barista_payload_finish() returns 0.
+ *
+ *   uint8_t arena[512];
+ *   BaristaPayload payload;
+ *   barista_payload_init(&payload, arena, sizeof(arena));
+ *   barista_payload_verb(&payload, BARISTA_VERB_TRIGGER);
+ *   barista_payload_token(&payload, "cpu_update");
+ *   barista_payload_property_int(&payload, "total_load", 42, 2);
+ *   size_t length = barista_payload_finish(&payload);
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  BARISTA_VERB_SET,
+  BARISTA_VERB_TRIGGER,
+  BARISTA_VERB_ADD,
+  BARISTA_VERB_EVENT,
+  BARISTA_VERB_SUBSCRIBE,
+  BARISTA_VERB_REMOVE,
+  BARISTA_VERB_QUERY,
+  BARISTA_VERB_ANIMATE,
+  BARISTA_VERB_BAR,
+  BARISTA_VERB_DEFAULT,
+  BARISTA_VERB_COUNT,
+} BaristaVerb;
+
+typedef struct {
+  uint8_t *bytes;
+  size_t capacity;
+  size_t length;
+  size_t arguments;
+  int failed;
+} BaristaPayload;
+
+void barista_payload_init(BaristaPayload *payload, void *arena, size_t capacity);
+
+/* Each append returns 1 on success and 0 once the payload has failed. */
+int barista_payload_verb(BaristaPayload *payload, BaristaVerb verb);
+int barista_payload_token(BaristaPayload *payload, const char *token);
+int barista_payload_token_bytes(BaristaPayload *payload, const char *bytes, size_t length);
+
+/* One `name=value` token. */
+int barista_payload_property(BaristaPayload *payload, const char *name, const char *value);
+
+/* `name=value` with value in decimal, zero-padded to min_digits. */
+int barista_payload_property_int(BaristaPayload *payload,
+                                 const char *name,
+                                 long long value,
+                                 int min_digits);
+
+/* Append the closing NUL. Returns the payload length, or 0 when the payload
+ * failed or holds no tokens. */
+size_t barista_payload_finish(BaristaPayload *payload);
+
+#ifdef __cplusplus
+}
+#endif
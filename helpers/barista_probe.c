@@ -0,0 +1,144 @@
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE 1
+#endif
+
+#include "barista_probe.h"
+
+#include <errno.h>
+#include <net/if.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <sys/mount.h>
+#include <SystemConfiguration/SystemConfiguration.h>
+#else
+#include <linux/wireless.h>
+#include <sys/ioctl.h>
+#include <sys/statvfs.h>
+#endif
+
+static const char *const SIZE_UNITS[] = {"B", "Ki", "Mi", "Gi", "Ti", "Pi", "Ei"};
+static const size_t SIZE_UNIT_COUNT = sizeof(SIZE_UNITS) / sizeof(SIZE_UNITS[0]);
+
+static int copy_name(const char *name, size_t length, char *buffer, size_t capacity) {
+  if (length == 0 || length >= capacity) return 0;
+  memcpy(buffer, name, length);
+  buffer[length] = '\0';
+  return 1;
+}
+
+int barista_disk_usage(const char *path, BaristaDiskUsage *usage) {
+  if (!path || !usage) return 0;
+  uint64_t unit = 0;
+  uint64_t blocks = 0;
+  uint64_t free_blocks = 0;
+  uint64_t available_blocks = 0;
+#ifdef __APPLE__
+  /* statvfs() on macOS narrows the counts to 32 bits; statfs() does not. */
+  struct statfs stats;
+  if (statfs(path, &stats) != 0) return 0;
+  unit = stats.f_bsize;
+#else
+  struct statvfs stats;
+  if (statvfs(path, &stats) != 0) return 0;
+  unit = stats.f_frsize ? stats.f_frsize : stats.f_bsize;
+#endif
+  blocks = stats.f_blocks;
+  free_blocks = stats.f_bfree;
+  available_blocks = stats.f_bavail;
+  if (unit == 0 || blocks == 0 || free_blocks > blocks) return 0;
+
+  uint64_t used_blocks = blocks - free_blocks;
+  uint64_t reachable = used_blocks + available_blocks;
+  usage->total_bytes = blocks * unit;
+  usage->used_bytes = used_blocks * unit;
+  usage->available_bytes = available_blocks * unit;
+  usage->percent = reachable == 0 ? 0 : (int)((used_blocks * 100 + reachable - 1) / reachable);
+  if (usage->percent > 100) usage->percent = 100;
+  return 1;
+}
+
+int barista_format_size(uint64_t bytes, char *buffer, size_t capacity) {
+  if (!buffer || capacity == 0) return 0;
+  double value = (double)bytes;
+  size_t unit = 0;
+  /* At most three digits, scaling up once rounding would reach 1000. */
+  while (unit + 1 < SIZE_UNIT_COUNT && value >= 999.5) {
+    value /= 1024.0;
+    unit++;
+  }
+  int written;
+  if (unit > 0 && value < 9.95) {
+    uint64_t tenths = (uint64_t)(value * 10.0 + 0.5);
+    written = snprintf(buffer, capacity, "%u.%u%s", (unsigned)(tenths / 10), (unsigned)(tenths % 10),
+                       SIZE_UNITS[unit]);
+  } else {
+    written = snprintf(buffer, capacity, "%llu%s", (unsigned long long)(value + 0.5), SIZE_UNITS[unit]);
+  }
+  if (written <= 0 || (size_t)written >= capacity) {
+    buffer[0] = '\0';
+    return 0;
+  }
+  return 1;
+}
+
+#ifdef __APPLE__
+int barista_wifi_ssid(const char *interface, char *buffer, size_t capacity) {
+  if (!interface || !buffer || capacity == 0 || strlen(interface) >= IF_NAMESIZE) return -1;
+  buffer[0] = '\0';
+  SCDynamicStoreRef store = SCDynamicStoreCreate(NULL, CFSTR("barista_probe"), NULL, NULL);
+  if (!store) return -1;
+  CFStringRef key = CFStringCreateWithFormat(NULL, NULL, CFSTR("State:/Network/Interface/%s/AirPort"),
+                                             interface);
+  CFPropertyListRef state = key ? SCDynamicStoreCopyValue(store, key) : NULL;
+  int result = -1;
+  if (state && CFGetTypeID(state) == CFDictionaryGetTypeID()) {
+    /* Missing while disassociated, and on recent macOS whenever the caller
+     * lacks location access; networksetup sees no more in either case. */
+    CFTypeRef ssid = CFDictionaryGetValue((CFDictionaryRef)state, CFSTR("SSID_STR"));
+    result = 0;
+    if (ssid && CFGetTypeID(ssid) == CFStringGetTypeID()
+        && CFStringGetCString((CFStringRef)ssid, buffer, (CFIndex)capacity, kCFStringEncodingUTF8)) {
+      result = buffer[0] != '\0' ? 1 : 0;
+    } else {
+      buffer[0] = '\0';
+    }
+  }
+  if (state) CFRelease(state);
+  if (key) CFRelease(key);
+  CFRelease(store);
+  return result;
+}
+
+#else
+int barista_wifi_ssid(const char *interface, char *buffer, size_t capacity) {
+  if (!interface || !buffer || capacity == 0 || strlen(interface) >= IFNAMSIZ) return -1;
+  buffer[0] = '\0';
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  char essid[IW_ESSID_MAX_SIZE + 1];
+  memset(essid, 0, sizeof(essid));
+  struct iwreq request;
+  memset(&request, 0, sizeof(request));
+  memcpy(request.ifr_name, interface, strlen(interface));
+  request.u.essid.pointer = essid;
+  request.u.essid.length = sizeof(essid);
+  int result = ioctl(fd, SIOCGIWESSID, &request);
+  int error = errno;
+  close(fd);
+  if (result != 0) {
+    /* Not a wireless interface, no such interface, or a kernel without
+     * wireless extensions. */
+    return error == EOPNOTSUPP || error == ENODEV || error == EINVAL || error == ENOTTY ? 0 : -1;
+  }
+  size_t length = request.u.essid.length;
+  if (length > IW_ESSID_MAX_SIZE) length = IW_ESSID_MAX_SIZE;
+  while (length > 0 && essid[length - 1] == '\0') length--;
+  return copy_name(essid, length, buffer, capacity);
+}
+
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+ * Barista Probe
+ *
+ * In-process replacements for the tools the system info popup used to spawn
+ * once per refresh:
+ *
+ *   df -h PATH             -> barista_disk_usage() + barista_format_size()
+ *   route -n get default   -> barista_default_route_interface()
+ *   networksetup -getairportnetwork IF -> barista_wifi_ssid()
+ *
+ * Disk usage comes from statvfs() with df's arithmetic: used is total minus
+ * free blocks, and the percentage is used over used-plus-available (blocks
+ * reserved for root count for neither), rounded up. Sizes are formatted the
+ * way macOS `df -h` prints them: binary units with an `i` suffix, one
+ * decimal below ten ("9.5Gi", "120Gi").
+ *
+ * The default route comes from barista_route.h, which the network event
+ * providers share.
+ *
+ * The SSID is read from the System Configuration dynamic store
+ * (State:/Network/Interface/IF/AirPort) on macOS and with SIOCGIWESSID on
+ * Linux.
+ *
+ * The route and SSID probes return 1 with an answer, 0 when the system
+ * answered that there is none (no default route, not associated, or an SSID
+ * the OS withholds), and -1 when the probe itself failed. Only -1 is a
+ * reason to fall back to the external tool.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "barista_route.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  uint64_t total_bytes;
+  uint64_t used_bytes;
+  uint64_t available_bytes; /* to unprivileged users */
+  int percent;              /* df's Capacity column, 0..100 */
+} BaristaDiskUsage;
+
+/* statvfs() of the file system holding `path`. Returns 0 on failure. */
+int barista_disk_usage(const char *path, BaristaDiskUsage *usage);
+
+/* Writes `bytes` as "512B", "9.5Gi", "120Gi". Returns 0 when it does not
+ * fit in `capacity`. */
+int barista_format_size(uint64_t bytes, char *buffer, size_t capacity);
+
+/* SSID of the network `interface` is associated with. */
+int barista_wifi_ssid(const char *interface, char *buffer, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,323 @@
+#define _DEFAULT_SOURCE 1
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "barista_transport.h"
+
+/*
+ * Barista Replay
+ *
+ * Plays a recorded session back through barista_send(), so an update storm
+ * captured from a real bar (space churn, hover sweeps) can be reproduced and
+ * two transport builds compared on the same traffic.
+ *
+ * Sessions come from record mode: run helpers with BARISTA_RECORD_PATH set
+ * and every payload they hand to the transport is appended to that file.
+ *
+ * `run` keeps the recorded spacing (scaled by --speed), or sends back to back
+ * with --max-rate. Each send keeps its recorded timeout unless --timeout-ms
+ * overrides it, so fire-and-forget updates stay fire-and-forget. The report
+ * prints send results, throughput, bytes per second and send latency
+ * percentiles; at recorded pace it also reports how far sends fell behind
+ * their schedule.
+ *
+ * The backend is whatever barista_send() picks for the environment:
+ * BARISTA_TRANSPORT_SOCKET (e.g. barista_mock_bar), the bus, or Mach.
+ *
+ * Usage:
+ *   barista_replay [run] FILE [--max-rate | --speed X] [--timeout-ms N]
+ *                  [--repeat N]
+ *   barista_replay print FILE
+ */
+
+typedef struct {
+  BaristaRecordHeader header;
+  const uint8_t *payload;
+} Record;
+
+typedef struct {
+  uint8_t *bytes;
+  Record *records;
+  size_t count;
+  int truncated;
+} Session;
+
+typedef struct {
+  int max_rate;
+  double speed;
+  int timeout_ms;
+  int repeat;
+} ReplayOptions;
+
+typedef struct {
+  uint64_t sent;
+  uint64_t confirmed;
+  uint64_t unconfirmed;
+  uint64_t errors;
+  uint64_t not_sent;
+  uint64_t bytes;
+  uint64_t elapsed_ns;
+  uint64_t lag_max_ns;
+  uint64_t *latencies;
+} ReplayStats;
+
+static uint64_t monotonic_nanoseconds(void) {
+  struct timespec value = {0};
+  clock_gettime(CLOCK_MONOTONIC, &value);
+  return (uint64_t)value.tv_sec * 1000000000ull + (uint64_t)value.tv_nsec;
+}
+
+static void sleep_until(uint64_t deadline) {
+  for (;;) {
+    uint64_t now = monotonic_nanoseconds();
+    if (now >= deadline) return;
+    uint64_t remaining = deadline - now;
+    struct timespec interval = {
+      .tv_sec = (time_t)(remaining / 1000000000ull),
+      .tv_nsec = (long)(remaining % 1000000000ull),
+    };
+    nanosleep(&interval, NULL);
+  }
+}
+
+static int read_file(const char *path, uint8_t **bytes, size_t *length) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return -1;
+  size_t capacity = 64 * 1024;
+  size_t used = 0;
+  uint8_t *buffer = malloc(capacity);
+  while (buffer) {
+    if (used == capacity) {
+      uint8_t *grown = realloc(buffer, capacity * 2);
+      if (!grown) break;
+      buffer = grown;
+      capacity *= 2;
+    }
+    ssize_t count = read(fd, buffer + used, capacity - used);
+    if (count < 0 && errno == EINTR) continue;
+    if (count < 0) break;
+    if (count == 0) {
+      close(fd);
+      *bytes = buffer;
+      *length = used;
+      return 0;
+    }
+    used += (size_t)count;
+  }
+  free(buffer);
+  close(fd);
+  return -1;
+}
+
+/* Indexes every complete record. A helper killed mid-write can leave a short
+ * tail, which is reported and skipped; anything else malformed rejects the
+ * whole file rather than replaying garbage at the bar. */
+static int load_session(const char *path, Session *session) {
+  memset(session, 0, sizeof(*session));
+  size_t length = 0;
+  if (read_file(path, &session->bytes, &length) != 0) {
+    fprintf(stderr, "barista_replay: cannot read %s\n", path);
+    return -1;
+  }
+
+  size_t capacity = 0;
+  size_t offset = 0;
+  while (offset < length) {
+    BaristaRecordHeader header;
+    if (length - offset < BARISTA_RECORD_HEADER_BYTES) {
+      session->truncated = 1;
+      break;
+    }
+    if (barista_record_decode(session->bytes + offset, &header) != 0) {
+      fprintf(stderr, "barista_replay: bad record at byte %zu\n", offset);
+      return -1;
+    }
+    const uint8_t *payload = session->bytes + offset + BARISTA_RECORD_HEADER_BYTES;
+    if (length - offset - BARISTA_RECORD_HEADER_BYTES < header.length) {
+      session->truncated = 1;
+      break;
+    }
+    if (!barista_payload_valid(payload, header.length)) {
+      fprintf(stderr, "barista_replay: bad payload at byte %zu\n", offset);
+      return -1;
+    }
+    if (session->count == capacity) {
+      capacity = capacity ? capacity * 2 : 256;
+      Record *grown = realloc(session->records, capacity * sizeof(*grown));
+      if (!grown) return -1;
+      session->records = grown;
+    }
+    session->records[session->count].header = header;
+    session->records[session->count].payload = payload;
+    session->count++;
+    offset += BARISTA_RECORD_HEADER_BYTES + header.length;
+  }
+  if (session->truncated) {
+    fprintf(stderr, "barista_replay: ignoring a truncated record at byte %zu\n", offset);
+  }
+  return 0;
+}
+
+static int compare_u64(const void *left, const void *right) {
+  uint64_t a = *(const uint64_t *)left;
+  uint64_t b = *(const uint64_t *)right;
+  return (a > b) - (a < b);
+}
+
+/* Nearest-rank percentile of sorted samples. */
+static uint64_t percentile(const uint64_t *sorted, uint64_t count, double rank) {
+  if (count == 0) return 0;
+  uint64_t index = (uint64_t)(rank / 100.0 * (double)count + 0.999999);
+  if (index == 0) index = 1;
+  if (index > count) index = count;
+  return sorted[index - 1];
+}
+
+static void replay_once(const Session *session, const ReplayOptions *options,
+                        ReplayStats *stats) {
+  uint64_t origin = session->records[0].header.timestamp_ns;
+  uint64_t started = monotonic_nanoseconds();
+  for (size_t i = 0; i < session->count; i++) {
+    const Record *record = &session->records[i];
+    if (!options->max_rate) {
+      uint64_t offset = record->header.timestamp_ns >= origin
+        ? record->header.timestamp_ns - origin : 0;
+      uint64_t due = started + (uint64_t)((double)offset / options->speed);
+      sleep_until(due);
+      uint64_t now = monotonic_nanoseconds();
+      if (now - due > stats->lag_max_ns) stats->lag_max_ns = now - due;
+    }
+
+    int timeout_ms = options->timeout_ms >= 0 ? options->timeout_ms
+                                               : record->header.timeout_ms;
+    uint64_t before = monotonic_nanoseconds();
+    BaristaSendResult result = barista_send(record->payload, record->header.length, timeout_ms);
+    stats->latencies[stats->sent++] = monotonic_nanoseconds() - before;
+    switch (result) {
+      case BARISTA_SEND_CONFIRMED_SUCCESS: stats->confirmed++; break;
+      case BARISTA_SEND_SENT_UNCONFIRMED: stats->unconfirmed++; break;
+      case BARISTA_SEND_CONFIRMED_ERROR: stats->errors++; break;
+      case BARISTA_SEND_NOT_SENT: stats->not_sent++; break;
+    }
+    if (result != BARISTA_SEND_NOT_SENT) stats->bytes += record->header.length;
+  }
+  stats->elapsed_ns += monotonic_nanoseconds() - started;
+}
+
+static void print_report(const ReplayStats *stats, const ReplayOptions *options) {
+  double seconds = (double)stats->elapsed_ns / 1e9;
+  double delivered = (double)(stats->sent - stats->not_sent);
+  qsort(stats->latencies, stats->sent, sizeof(uint64_t), compare_u64);
+  printf("records=%llu\n", (unsigned long long)stats->sent);
+  printf("confirmed=%llu\n", (unsigned long long)stats->confirmed);
+  printf("unconfirmed=%llu\n", (unsigned long long)stats->unconfirmed);
+  printf("errors=%llu\n", (unsigned long long)stats->errors);
+  printf("not_sent=%llu\n", (unsigned long long)stats->not_sent);
+  printf("bytes=%llu\n", (unsigned long long)stats->bytes);
+  printf("elapsed_ms=%.3f\n", seconds * 1e3);
+  printf("messages_per_s=%.1f\n", seconds > 0 ? delivered / seconds : 0.0);
+  printf("bytes_per_s=%.1f\n", seconds > 0 ? (double)stats->bytes / seconds : 0.0);
+  printf("latency_p50_ns=%llu\n",
+         (unsigned long long)percentile(stats->latencies, stats->sent, 50.0));
+  printf("latency_p99_ns=%llu\n",
+         (unsigned long long)percentile(stats->latencies, stats->sent, 99.0));
+  printf("latency_max_ns=%llu\n",
+         (unsigned long long)(stats->sent ? stats->latencies[stats->sent - 1] : 0));
+  if (!options->max_rate) {
+    printf("schedule_lag_max_ns=%llu\n", (unsigned long long)stats->lag_max_ns);
+  }
+}
+
+static int run(const Session *session, const ReplayOptions *options) {
+  if (session->count == 0) {
+    fprintf(stderr, "barista_replay: session is empty\n");
+    return 1;
+  }
+  ReplayStats stats;
+  memset(&stats, 0, sizeof(stats));
+  stats.latencies = malloc(session->count * (size_t)options->repeat * sizeof(uint64_t));
+  if (!stats.latencies) return 1;
+
+  for (int pass = 0; pass < options->repeat; pass++) replay_once(session, options, &stats);
+  print_report(&stats, options);
+  free(stats.latencies);
+  return stats.not_sent == stats.sent ? 1 : 0;
+}
+
+/* One line per record: offset from the first record, pid, timeout, tokens. */
+static int print_session(const Session *session) {
+  uint64_t origin = session->count ? session->records[0].header.timestamp_ns : 0;
+  for (size_t i = 0; i < session->count; i++) {
+    const Record *record = &session->records[i];
+    uint64_t offset = record->header.timestamp_ns >= origin
+      ? record->header.timestamp_ns - origin : 0;
+    printf("+%.3fms pid=%u timeout=%d", (double)offset / 1e6, record->header.pid,
+           record->header.timeout_ms);
+    const char *token = (const char *)record->payload;
+    const char *end = token + record->header.length - 1;
+    while (token < end) {
+      printf(" %s", token);
+      token += strlen(token) + 1;
+    }
+    printf("\n");
+  }
+  return 0;
+}
+
+static void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [run] FILE [--max-rate | --speed X] [--timeout-ms N] [--repeat N]\n"
+          "       %s print FILE\n",
+          program, program);
+}
+
+int main(int argc, char **argv) {
+  const char *command = "run";
+  int index = 1;
+  if (index < argc && (strcmp(argv[index], "run") == 0 || strcmp(argv[index], "print") == 0)) {
+    command = argv[index++];
+  }
+  if (index >= argc || argv[index][0] == '-') {
+    print_usage(argv[0]);
+    return 2;
+  }
+  const char *path = argv[index++];
+
+  ReplayOptions options = {.max_rate = 0, .speed = 1.0, .timeout_ms = -1, .repeat = 1};
+  for (; index < argc; index++) {
+    if (strcmp(argv[index], "--max-rate") == 0) {
+      options.max_rate = 1;
+    } else if (strcmp(argv[index], "--speed") == 0 && index + 1 < argc) {
+      options.speed = atof(argv[++index]);
+    } else if (strcmp(argv[index], "--timeout-ms") == 0 && index + 1 < argc) {
+      options.timeout_ms = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--repeat") == 0 && index + 1 < argc) {
+      options.repeat = atoi(argv[++index]);
+    } else {
+      print_usage(argv[0]);
+      return 2;
+    }
+  }
+  if (options.speed <= 0.0 || options.repeat < 1) {
+    print_usage(argv[0]);
+    return 2;
+  }
+
+  Session session;
+  if (load_session(path, &session) != 0) return 1;
+  /* Replaying must not append to the session being replayed. */
+  unsetenv("BARISTA_RECORD_PATH");
+
+  int status = strcmp(command, "print") == 0 ? print_session(&session)
+                                             : run(&session, &options);
+  free(session.records);
+  free(session.bytes);
+  return status;
+}
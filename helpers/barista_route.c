@@ -0,0 +1,265 @@
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE 1
+#endif
+
+#include "barista_route.h"
+
+#include <errno.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <net/if_dl.h>
+#include <net/route.h>
+#include <netinet/in.h>
+#else
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
+#define ROUTE_TIMEOUT_MS 200
+#define ROUTE_BUFFER_BYTES 16384
+
+static int copy_name(const char *name, size_t length, char *buffer, size_t capacity) {
+  if (length == 0 || length >= capacity) return 0;
+  memcpy(buffer, name, length);
+  buffer[length] = '\0';
+  return 1;
+}
+
+static int64_t monotonic_milliseconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/* Waits for `fd` to become readable before `deadline`; 0 on timeout. */
+static int wait_readable(int fd, int64_t deadline) {
+  for (;;) {
+    int64_t remaining = deadline - monotonic_milliseconds();
+    if (remaining <= 0) return 0;
+    struct pollfd descriptor = {.fd = fd, .events = POLLIN};
+    int ready = poll(&descriptor, 1, (int)remaining);
+    if (ready < 0 && errno == EINTR) continue;
+    return ready > 0 ? 1 : (ready == 0 ? 0 : -1);
+  }
+}
+
+#ifdef __APPLE__
+/* Sockaddrs in routing messages are padded to 32-bit boundaries. */
+#define ROUTE_SA_SIZE(length) \
+  ((length) > 0 ? (1 + (((size_t)(length) - 1) | (sizeof(uint32_t) - 1))) : sizeof(uint32_t))
+
+/* The interface named by the RTA_IFP address of an RTM_GET reply, else the
+ * route's interface index. */
+static int route_reply_interface(const struct rt_msghdr *reply, size_t length,
+                                 char *buffer, size_t capacity) {
+  const uint8_t *cursor = (const uint8_t *)(reply + 1);
+  const uint8_t *end = (const uint8_t *)reply + length;
+  for (int bit = 0; bit < RTAX_MAX && cursor < end; bit++) {
+    if ((reply->rtm_addrs & (1 << bit)) == 0) continue;
+    const struct sockaddr *address = (const struct sockaddr *)cursor;
+    size_t size = ROUTE_SA_SIZE(address->sa_len);
+    if (cursor + size > end) break;
+    if ((1 << bit) == RTA_IFP && address->sa_family == AF_LINK) {
+      const struct sockaddr_dl *link = (const struct sockaddr_dl *)address;
+      if (link->sdl_nlen > 0 && offsetof(struct sockaddr_dl, sdl_data) + link->sdl_nlen <= size) {
+        return copy_name(link->sdl_data, link->sdl_nlen, buffer, capacity);
+      }
+    }
+    cursor += size;
+  }
+  char name[IF_NAMESIZE];
+  if (reply->rtm_index > 0 && if_indextoname(reply->rtm_index, name)) {
+    return copy_name(name, strlen(name), buffer, capacity);
+  }
+  return 0;
+}
+
+int barista_default_route_interface(char *buffer, size_t capacity) {
+  if (!buffer || capacity == 0) return -1;
+  buffer[0] = '\0';
+  int fd = socket(PF_ROUTE, SOCK_RAW, 0);
+  if (fd < 0) return -1;
+
+  /* What `route -n get default` sends: a lookup of 0.0.0.0 asking for the
+   * interface of the route that matches it. */
+  struct {
+    struct rt_msghdr header;
+    struct sockaddr_in destination;
+    struct sockaddr_dl interface;
+  } request;
+  memset(&request, 0, sizeof(request));
+  static int sequence = 0;
+  int seq = ++sequence;
+  pid_t self = getpid();
+  request.header.rtm_msglen = sizeof(request);
+  request.header.rtm_version = RTM_VERSION;
+  request.header.rtm_type = RTM_GET;
+  request.header.rtm_flags = RTF_UP | RTF_GATEWAY;
+  request.header.rtm_addrs = RTA_DST | RTA_IFP;
+  request.header.rtm_seq = seq;
+  request.destination.sin_len = sizeof(request.destination);
+  request.destination.sin_family = AF_INET;
+  request.destination.sin_addr.s_addr = htonl(INADDR_ANY);
+  request.interface.sdl_len = sizeof(request.interface);
+  request.interface.sdl_family = AF_LINK;
+
+  if (write(fd, &request, sizeof(request)) != (ssize_t)sizeof(request)) {
+    int error = errno;
+    close(fd);
+    return error == ESRCH ? 0 : -1;
+  }
+
+  /* The socket also carries every other routing change on the system. */
+  union {
+    struct rt_msghdr header;
+    uint8_t bytes[ROUTE_BUFFER_BYTES];
+  } reply;
+  int64_t deadline = monotonic_milliseconds() + ROUTE_TIMEOUT_MS;
+  int result = -1;
+  while (wait_readable(fd, deadline) > 0) {
+    ssize_t count = read(fd, reply.bytes, sizeof(reply.bytes));
+    if (count < 0 && errno == EINTR) continue;
+    if (count < (ssize_t)sizeof(reply.header)) break;
+    if (reply.header.rtm_version != RTM_VERSION || reply.header.rtm_type != RTM_GET
+        || reply.header.rtm_seq != seq || reply.header.rtm_pid != self) {
+      continue;
+    }
+    if (reply.header.rtm_errno != 0) {
+      result = reply.header.rtm_errno == ESRCH ? 0 : -1;
+    } else {
+      size_t length = reply.header.rtm_msglen < (size_t)count ? reply.header.rtm_msglen : (size_t)count;
+      result = route_reply_interface(&reply.header, length, buffer, capacity) ? 1 : -1;
+    }
+    break;
+  }
+  close(fd);
+  return result;
+}
+
+#else
+
+
+typedef struct {
+  int found;
+  int interface_index;
+  uint32_t priority;
+} DefaultRoute;
+
+/* Scans one buffer of an RTM_GETROUTE dump for IPv4 defaults in the main
+ * table, keeping the lowest metric. Returns 1 at the end of the dump, 0 when
+ * more buffers follow and -1 on an error reply. */
+static int scan_route_dump(const void *bytes, size_t length, uint32_t sequence, DefaultRoute *best) {
+  const uint8_t *cursor = bytes;
+  while (length >= sizeof(struct nlmsghdr)) {
+    const struct nlmsghdr *header = (const struct nlmsghdr *)cursor;
+    if (header->nlmsg_len < sizeof(*header) || header->nlmsg_len > length) return -1;
+    size_t advance = NLMSG_ALIGN(header->nlmsg_len);
+    if (advance > length) advance = length;
+    if (header->nlmsg_seq == sequence) {
+      if (header->nlmsg_type == NLMSG_DONE) return 1;
+      if (header->nlmsg_type == NLMSG_ERROR) return -1;
+      if (header->nlmsg_type == RTM_NEWROUTE
+          && header->nlmsg_len >= NLMSG_LENGTH(sizeof(struct rtmsg))) {
+        const struct rtmsg *route = NLMSG_DATA(header);
+        uint32_t table = route->rtm_table;
+        int interface_index = 0;
+        uint32_t priority = 0;
+        size_t offset = NLMSG_LENGTH(NLMSG_ALIGN(sizeof(struct rtmsg)));
+        while (offset + sizeof(struct rtattr) <= header->nlmsg_len) {
+          const struct rtattr *attribute = (const struct rtattr *)(cursor + offset);
+          if (attribute->rta_len < sizeof(*attribute)
+              || offset + attribute->rta_len > header->nlmsg_len) {
+            break;
+          }
+          const void *data = RTA_DATA(attribute);
+          size_t data_length = attribute->rta_len - RTA_LENGTH(0);
+          if (data_length >= sizeof(uint32_t)) {
+            uint32_t value;
+            memcpy(&value, data, sizeof(value));
+            if (attribute->rta_type == RTA_TABLE) table = value;
+            if (attribute->rta_type == RTA_OIF) interface_index = (int)value;
+            if (attribute->rta_type == RTA_PRIORITY) priority = value;
+          }
+          offset += RTA_ALIGN(attribute->rta_len);
+        }
+        if (route->rtm_family == AF_INET && route->rtm_dst_len == 0
+            && route->rtm_type == RTN_UNICAST && table == RT_TABLE_MAIN && interface_index > 0
+            && (!best->found || priority < best->priority)) {
+          best->found = 1;
+          best->interface_index = interface_index;
+          best->priority = priority;
+        }
+      }
+    }
+    cursor += advance;
+    length -= advance;
+  }
+  return 0;
+}
+
+int barista_default_route_interface(char *buffer, size_t capacity) {
+  if (!buffer || capacity == 0) return -1;
+  buffer[0] = '\0';
+  int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+  if (fd < 0) return -1;
+
+  static uint32_t sequence = 0;
+  uint32_t seq = ++sequence;
+  struct {
+    struct nlmsghdr header;
+    struct rtmsg route;
+  } request;
+  memset(&request, 0, sizeof(request));
+  request.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+  request.header.nlmsg_type = RTM_GETROUTE;
+  request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  request.header.nlmsg_seq = seq;
+  request.route.rtm_family = AF_INET;
+  request.route.rtm_table = RT_TABLE_MAIN;
+  struct sockaddr_nl kernel;
+  memset(&kernel, 0, sizeof(kernel));
+  kernel.nl_family = AF_NETLINK;
+  if (sendto(fd, &request, request.header.nlmsg_len, 0, (struct sockaddr *)&kernel,
+             sizeof(kernel)) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  union {
+    struct nlmsghdr header;
+    uint8_t bytes[ROUTE_BUFFER_BYTES];
+  } reply;
+  DefaultRoute best = {0, 0, 0};
+  int64_t deadline = monotonic_milliseconds() + ROUTE_TIMEOUT_MS;
+  int status = 0;
+  while (status == 0) {
+    if (wait_readable(fd, deadline) <= 0) {
+      status = -1;
+      break;
+    }
+    ssize_t count = recv(fd, reply.bytes, sizeof(reply.bytes), MSG_DONTWAIT);
+    if (count < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+    if (count <= 0) {
+      status = -1;
+      break;
+    }
+    status = scan_route_dump(reply.bytes, (size_t)count, seq, &best);
+  }
+  close(fd);
+  if (status < 0) return -1;
+  if (!best.found) return 0;
+  char name[IF_NAMESIZE];
+  if (!if_indextoname((unsigned)best.interface_index, name)) return -1;
+  return copy_name(name, strlen(name), buffer, capacity) ? 1 : -1;
+}
+
+#endif
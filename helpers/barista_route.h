@@ -0,0 +1,25 @@
+#pragma once
+
+/*
+ * Barista Route
+ *
+ * The interface carrying the IPv4 default route, asked of the kernel
+ * directly instead of spawning `route -n get default`: an RTM_GET on a
+ * PF_ROUTE socket on macOS, an RTM_GETROUTE dump over NETLINK_ROUTE on Linux
+ * (lowest-metric IPv4 default in the main table). The system info probes
+ * (barista_probe.h) and the network event providers both use it.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Returns 1 with the interface name in `buffer`, 0 when the kernel answered
+ * that there is no default route, and -1 when the lookup itself failed. */
+int barista_default_route_interface(char *buffer, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
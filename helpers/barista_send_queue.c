@@ -0,0 +1,230 @@
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE 1
+#endif
+
+#include "barista_send_queue.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+  char key[BARISTA_SEND_QUEUE_MAX_KEY_BYTES];
+  uint8_t *bytes;
+  size_t length;
+  size_t capacity;
+  int64_t pushed_at;
+} QueueSlot;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_idle = PTHREAD_COND_INITIALIZER;
+static pthread_t g_thread;
+static QueueSlot g_slots[BARISTA_SEND_QUEUE_MAX_CAPACITY];
+static int g_capacity = 0;
+static int g_head = 0;
+static int g_count = 0;
+static int g_in_flight = 0;
+static int g_running = 0;
+static int g_stopping = 0;
+static int g_timeout_ms = 0;
+static int g_late_ms = 0;
+static int g_bar_gone = 0;
+static BaristaSendQueueStats g_stats;
+
+static int64_t monotonic_milliseconds(void) {
+  struct timespec value = {0};
+  if (clock_gettime(CLOCK_MONOTONIC, &value) != 0) return 0;
+  return (int64_t)value.tv_sec * 1000 + (int64_t)value.tv_nsec / 1000000;
+}
+
+static int slot_store(QueueSlot *slot, const char *key, const void *payload, size_t length) {
+  if (slot->capacity < length) {
+    uint8_t *bytes = realloc(slot->bytes, length);
+    if (!bytes) return 0;
+    slot->bytes = bytes;
+    slot->capacity = length;
+  }
+  memcpy(slot->bytes, payload, length);
+  slot->length = length;
+  slot->pushed_at = monotonic_milliseconds();
+  snprintf(slot->key, sizeof(slot->key), "%s", key ? key : "");
+  return 1;
+}
+
+static void *sender_main(void *unused) {
+  (void)unused;
+  /* The sender swaps buffers with the head slot so the send runs unlocked
+   * and steady-state pushes never allocate. */
+  QueueSlot in_flight = {0};
+  pthread_mutex_lock(&g_lock);
+  for (;;) {
+    while (g_count == 0 && !g_stopping) pthread_cond_wait(&g_wake, &g_lock);
+    if (g_count == 0) break;
+
+    QueueSlot *head = &g_slots[g_head];
+    QueueSlot swap = in_flight;
+    in_flight = *head;
+    head->bytes = swap.bytes;
+    head->capacity = swap.capacity;
+    head->length = 0;
+    head->key[0] = '\0';
+    g_head = (g_head + 1) % g_capacity;
+    g_count--;
+    g_in_flight = 1;
+    pthread_mutex_unlock(&g_lock);
+
+    /* Lateness is the wait in the queue; the reply wait is the bar's own. */
+    int64_t delay = monotonic_milliseconds() - in_flight.pushed_at;
+    BaristaSendResult result = barista_send(in_flight.bytes, in_flight.length, g_timeout_ms);
+    int gone = result == BARISTA_SEND_NOT_SENT && !barista_transport_probe();
+
+    pthread_mutex_lock(&g_lock);
+    if (result == BARISTA_SEND_NOT_SENT) {
+      g_stats.failed++;
+    } else {
+      g_stats.sent++;
+      if (g_late_ms > 0 && delay > g_late_ms) g_stats.late++;
+      if (delay > 0 && (uint64_t)delay > g_stats.max_delay_ms) {
+        g_stats.max_delay_ms = (uint64_t)delay;
+      }
+    }
+    if (gone) g_bar_gone = 1;
+    g_in_flight = 0;
+    if (g_count == 0) pthread_cond_broadcast(&g_idle);
+  }
+  pthread_cond_broadcast(&g_idle);
+  pthread_mutex_unlock(&g_lock);
+  free(in_flight.bytes);
+  return NULL;
+}
+
+int barista_send_queue_start(int capacity, int timeout_ms, int late_ms) {
+  if (capacity < 1) capacity = 1;
+  if (capacity > BARISTA_SEND_QUEUE_MAX_CAPACITY) capacity = BARISTA_SEND_QUEUE_MAX_CAPACITY;
+  pthread_mutex_lock(&g_lock);
+  if (g_running) {
+    pthread_mutex_unlock(&g_lock);
+    return -1;
+  }
+  g_capacity = capacity;
+  g_head = 0;
+  g_count = 0;
+  g_stopping = 0;
+  g_bar_gone = 0;
+  g_timeout_ms = timeout_ms;
+  g_late_ms = late_ms < 0 ? 0 : late_ms;
+  memset(&g_stats, 0, sizeof(g_stats));
+  if (pthread_create(&g_thread, NULL, sender_main, NULL) != 0) {
+    pthread_mutex_unlock(&g_lock);
+    return -1;
+  }
+  g_running = 1;
+  pthread_mutex_unlock(&g_lock);
+  return 0;
+}
+
+int barista_send_queue_running(void) {
+  pthread_mutex_lock(&g_lock);
+  int running = g_running;
+  pthread_mutex_unlock(&g_lock);
+  return running;
+}
+
+BaristaQueuePush barista_send_queue_push(const char *key, const void *payload, size_t length) {
+  if (!barista_payload_valid(payload, length)) return BARISTA_QUEUE_REFUSED;
+  if (key && strlen(key) >= BARISTA_SEND_QUEUE_MAX_KEY_BYTES) key = NULL;
+  BaristaQueuePush outcome = BARISTA_QUEUE_REFUSED;
+  pthread_mutex_lock(&g_lock);
+  if (!g_running || g_stopping) goto done;
+
+  if (key && key[0] != '\0') {
+    for (int i = 0; i < g_count; i++) {
+      QueueSlot *slot = &g_slots[(g_head + i) % g_capacity];
+      if (strcmp(slot->key, key) != 0) continue;
+      /* The slot keeps its place and its age: lateness is how long the
+       * key has waited, not how old the newest sample is. */
+      int64_t pushed_at = slot->pushed_at;
+      if (!slot_store(slot, key, payload, length)) goto done;
+      slot->pushed_at = pushed_at;
+      g_stats.queued++;
+      g_stats.dropped++;
+      outcome = BARISTA_QUEUE_REPLACED;
+      goto done;
+    }
+  }
+  if (g_count < g_capacity
+      && slot_store(&g_slots[(g_head + g_count) % g_capacity], key, payload, length)) {
+    g_count++;
+    g_stats.queued++;
+    outcome = BARISTA_QUEUE_ACCEPTED;
+    pthread_cond_signal(&g_wake);
+  }
+
+done:
+  if (outcome == BARISTA_QUEUE_REFUSED && g_running) g_stats.dropped++;
+  pthread_mutex_unlock(&g_lock);
+  return outcome;
+}
+
+int barista_send_queue_drain(int timeout_ms) {
+  struct timespec deadline = {0};
+  if (timeout_ms >= 0) {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+  }
+  pthread_mutex_lock(&g_lock);
+  while (g_running && (g_count > 0 || g_in_flight)) {
+    if (timeout_ms < 0) {
+      pthread_cond_wait(&g_idle, &g_lock);
+    } else if (pthread_cond_timedwait(&g_idle, &g_lock, &deadline) == ETIMEDOUT) {
+      break;
+    }
+  }
+  int drained = g_count == 0 && !g_in_flight;
+  pthread_mutex_unlock(&g_lock);
+  return drained;
+}
+
+void barista_send_queue_stop(void) {
+  pthread_mutex_lock(&g_lock);
+  if (!g_running) {
+    pthread_mutex_unlock(&g_lock);
+    return;
+  }
+  g_stopping = 1;
+  pthread_cond_signal(&g_wake);
+  pthread_mutex_unlock(&g_lock);
+  pthread_join(g_thread, NULL);
+
+  pthread_mutex_lock(&g_lock);
+  g_running = 0;
+  for (int i = 0; i < BARISTA_SEND_QUEUE_MAX_CAPACITY; i++) {
+    free(g_slots[i].bytes);
+    memset(&g_slots[i], 0, sizeof(g_slots[i]));
+  }
+  pthread_mutex_unlock(&g_lock);
+}
+
+void barista_send_queue_stats(BaristaSendQueueStats *stats) {
+  if (!stats) return;
+  pthread_mutex_lock(&g_lock);
+  *stats = g_stats;
+  stats->depth = (uint32_t)g_count;
+  pthread_mutex_unlock(&g_lock);
+}
+
+int barista_send_queue_bar_gone(void) {
+  pthread_mutex_lock(&g_lock);
+  int gone = g_bar_gone;
+  pthread_mutex_unlock(&g_lock);
+  return gone;
+}
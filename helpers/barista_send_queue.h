@@ -0,0 +1,76 @@
+#pragma once
+
+/*
+ * Barista Send Queue
+ *
+ * Asynchronous barista_send() for sampling loops. Payloads go into a bounded
+ * in-process queue drained by one sender thread, so a stalled bar delays
+ * delivery instead of the caller's next sample.
+ *
+ * A payload pushed with a key (an event name) replaces the stalest queued
+ * payload with the same key in place: once the bar falls behind, only the
+ * newest sample of an event is worth delivering. Unkeyed payloads are never
+ * coalesced, and a push that finds the queue full is refused.
+ *
+ * While the queue runs, the sender thread owns the transport; callers must
+ * not use barista_send() themselves until barista_send_queue_stop() returns.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "barista_transport.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BARISTA_SEND_QUEUE_MAX_CAPACITY 64
+#define BARISTA_SEND_QUEUE_MAX_KEY_BYTES 64
+
+typedef enum {
+  BARISTA_QUEUE_REFUSED,
+  BARISTA_QUEUE_ACCEPTED,
+  BARISTA_QUEUE_REPLACED,
+} BaristaQueuePush;
+
+typedef struct {
+  uint64_t queued;       /* accepted pushes, including replacements */
+  uint64_t sent;         /* payloads the transport did not report NOT_SENT */
+  uint64_t failed;       /* payloads the transport reported NOT_SENT */
+  uint64_t dropped;      /* stale payloads replaced, plus refused pushes */
+  uint64_t late;         /* waited more than late_ms in the queue */
+  uint64_t max_delay_ms; /* longest queue wait of a delivered payload */
+  uint32_t depth;        /* payloads waiting, excluding one in flight */
+} BaristaSendQueueStats;
+
+/*
+ * Start the sender thread. capacity is clamped to 1..MAX_CAPACITY,
+ * timeout_ms is passed to barista_send() for every payload, and a payload
+ * that waited longer than late_ms in the queue counts as late (0 disables
+ * the count). Returns 0 on success, -1 when the queue already runs or the
+ * thread cannot start.
+ */
+int barista_send_queue_start(int capacity, int timeout_ms, int late_ms);
+
+int barista_send_queue_running(void);
+
+/* Copy the payload into the queue; key may be NULL. */
+BaristaQueuePush barista_send_queue_push(const char *key, const void *payload, size_t length);
+
+/* Wait until nothing is queued or in flight. 1 when drained, 0 on timeout;
+ * a negative timeout waits indefinitely. */
+int barista_send_queue_drain(int timeout_ms);
+
+/* Deliver what is queued, then stop the sender thread. */
+void barista_send_queue_stop(void);
+
+void barista_send_queue_stats(BaristaSendQueueStats *stats);
+
+/* 1 once a NOT_SENT delivery was followed by a failed probe: the bar has
+ * exited and the caller should stop sampling. */
+int barista_send_queue_bar_gone(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,228 @@
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE 1
+#endif
+
+#include "barista_sent_cache.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SENT_CACHE_MAGIC 0x42534331u
+#define SENT_CACHE_VERSION 1u
+#define SENT_CACHE_SLOTS 4096u
+#define SENT_CACHE_PROBES 32u
+#define SENT_CACHE_REVALIDATE_MS 1000
+#define MAX_BAR_NAME_BYTES 128
+
+typedef struct {
+  uint64_t key;
+  uint64_t tag;
+} SentSlot;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slot_count;
+  uint32_t epoch;
+  uint64_t reserved[6];
+  SentSlot slots[SENT_CACHE_SLOTS];
+} SentCacheFile;
+
+static SentCacheFile *g_cache = NULL;
+static dev_t g_device = 0;
+static ino_t g_inode = 0;
+static int64_t g_validated_at = 0;
+static int g_disabled = -1;
+static int g_resynced = 0;
+
+static int64_t monotonic_milliseconds(void) {
+  struct timespec value = {0};
+  if (clock_gettime(CLOCK_MONOTONIC, &value) != 0) return 0;
+  return (int64_t)value.tv_sec * 1000 + (int64_t)value.tv_nsec / 1000000;
+}
+
+static uint64_t hash_bytes(uint64_t hash, const char *bytes, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (uint8_t)bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/* FNV-1a spreads poorly in the low bits the slot index uses; finish with a
+ * 64-bit mixer. */
+static uint64_t hash_finish(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash == 0 ? 1 : hash;
+}
+
+int barista_sent_cache_path(char *buffer, size_t capacity) {
+  if (!buffer || capacity == 0) return 0;
+  buffer[0] = '\0';
+  int written = 0;
+  const char *path = getenv("BARISTA_SENT_CACHE_PATH");
+  if (path && path[0] != '\0') {
+    written = snprintf(buffer, capacity, "%s", path);
+  } else {
+    const char *tmpdir = getenv("TMPDIR");
+    const char *bar_name = getenv("BAR_NAME");
+    if (!tmpdir || tmpdir[0] == '\0') tmpdir = "/tmp";
+    if (!bar_name || bar_name[0] == '\0') bar_name = "sketchybar";
+    if (strlen(bar_name) > MAX_BAR_NAME_BYTES || strchr(bar_name, '/')) return 0;
+    size_t tmpdir_length = strlen(tmpdir);
+    while (tmpdir_length > 1 && tmpdir[tmpdir_length - 1] == '/') tmpdir_length--;
+    written = snprintf(buffer, capacity, "%.*s/barista_sent_cache.%s",
+                       (int)tmpdir_length, tmpdir, bar_name);
+  }
+  if (written <= 0 || (size_t)written >= capacity) {
+    buffer[0] = '\0';
+    return 0;
+  }
+  return 1;
+}
+
+static void sent_cache_unmap(void) {
+  if (g_cache) munmap(g_cache, sizeof(*g_cache));
+  g_cache = NULL;
+}
+
+static SentCacheFile *sent_cache_map(const char *path) {
+  int fd = open(path, O_RDWR | O_CREAT, 0600);
+  if (fd < 0) return NULL;
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  struct stat status;
+  if (fstat(fd, &status) != 0
+      || (status.st_size < (off_t)sizeof(SentCacheFile)
+          && ftruncate(fd, (off_t)sizeof(SentCacheFile)) != 0)) {
+    close(fd);
+    return NULL;
+  }
+  void *mapping = mmap(NULL, sizeof(SentCacheFile), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) return NULL;
+
+  SentCacheFile *cache = mapping;
+  if (__atomic_load_n(&cache->magic, __ATOMIC_ACQUIRE) == 0) {
+    /* Racing initializers write identical values, so only the magic needs
+     * to be published exactly once. */
+    cache->version = SENT_CACHE_VERSION;
+    cache->slot_count = SENT_CACHE_SLOTS;
+    uint32_t expected = 0;
+    __atomic_compare_exchange_n(&cache->magic, &expected, SENT_CACHE_MAGIC, 0,
+                                __ATOMIC_RELEASE, __ATOMIC_ACQUIRE);
+  }
+  if (__atomic_load_n(&cache->magic, __ATOMIC_ACQUIRE) != SENT_CACHE_MAGIC
+      || cache->version != SENT_CACHE_VERSION
+      || cache->slot_count != SENT_CACHE_SLOTS) {
+    munmap(mapping, sizeof(SentCacheFile));
+    return NULL;
+  }
+  g_device = status.st_dev;
+  g_inode = status.st_ino;
+  return cache;
+}
+
+/* Maps the shared table, remapping when the file was removed or replaced so
+ * long-running providers follow a bar restart. */
+static SentCacheFile *sent_cache(void) {
+  if (g_disabled < 0) {
+    const char *disabled = getenv("BARISTA_SENT_CACHE_DISABLE");
+    g_disabled = disabled && strcmp(disabled, "1") == 0;
+  }
+  if (g_disabled) return NULL;
+
+  int64_t now = monotonic_milliseconds();
+  if (g_cache && g_resynced && now - g_validated_at < SENT_CACHE_REVALIDATE_MS) return g_cache;
+  g_validated_at = now;
+
+  char path[1024];
+  if (!barista_sent_cache_path(path, sizeof(path))) {
+    sent_cache_unmap();
+    return NULL;
+  }
+  struct stat status;
+  if (!g_cache || stat(path, &status) != 0
+      || status.st_dev != g_device || status.st_ino != g_inode) {
+    sent_cache_unmap();
+    g_cache = sent_cache_map(path);
+  }
+
+  /* The override applies once per process, on its first use of the table. */
+  if (g_cache && !g_resynced) {
+    g_resynced = 1;
+    const char *resync = getenv("BARISTA_SENT_CACHE_RESYNC");
+    if (resync && strcmp(resync, "1") == 0) {
+      __atomic_add_fetch(&g_cache->epoch, 1, __ATOMIC_ACQ_REL);
+    }
+  }
+  return g_cache;
+}
+
+static SentSlot *find_slot(SentCacheFile *cache, uint64_t key, int claim) {
+  for (uint32_t probe = 0; probe < SENT_CACHE_PROBES; probe++) {
+    SentSlot *slot = &cache->slots[(key + probe) & (SENT_CACHE_SLOTS - 1)];
+    uint64_t current = __atomic_load_n(&slot->key, __ATOMIC_ACQUIRE);
+    if (current == key) return slot;
+    if (current != 0) continue;
+    if (!claim) return NULL;
+    uint64_t expected = 0;
+    if (__atomic_compare_exchange_n(&slot->key, &expected, key, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+        || expected == key) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+int barista_sent_cache_check(const char *scope, const char *name, const char *value,
+                             BaristaSentEntry *entry) {
+  if (!entry) return 0;
+  entry->key = 0;
+  entry->tag = 0;
+  if (!scope || !name || !value) return 0;
+  SentCacheFile *cache = sent_cache();
+  if (!cache) return 0;
+
+  uint64_t key = hash_bytes(14695981039346656037ULL, scope, strlen(scope) + 1);
+  key = hash_bytes(key, name, strlen(name));
+  uint32_t epoch = __atomic_load_n(&cache->epoch, __ATOMIC_ACQUIRE);
+  uint64_t tag = hash_bytes(14695981039346656037ULL, (const char *)&epoch, sizeof(epoch));
+  tag = hash_bytes(tag, value, strlen(value));
+  entry->key = hash_finish(key);
+  entry->tag = hash_finish(tag);
+
+  SentSlot *slot = find_slot(cache, entry->key, 0);
+  return slot && __atomic_load_n(&slot->tag, __ATOMIC_ACQUIRE) == entry->tag;
+}
+
+void barista_sent_cache_record(const BaristaSentEntry *entry) {
+  if (!entry || entry->key == 0) return;
+  SentCacheFile *cache = sent_cache();
+  if (!cache) return;
+  SentSlot *slot = find_slot(cache, entry->key, 1);
+  if (slot) __atomic_store_n(&slot->tag, entry->tag, __ATOMIC_RELEASE);
+}
+
+void barista_sent_cache_forget(const BaristaSentEntry *entry) {
+  if (!entry || entry->key == 0) return;
+  SentCacheFile *cache = sent_cache();
+  if (!cache) return;
+  SentSlot *slot = find_slot(cache, entry->key, 0);
+  if (slot) __atomic_store_n(&slot->tag, 0, __ATOMIC_RELEASE);
+}
+
+void barista_sent_cache_resync(void) {
+  SentCacheFile *cache = sent_cache();
+  if (cache) __atomic_add_fetch(&cache->epoch, 1, __ATOMIC_ACQ_REL);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+/*
+ * Barista Sent Cache
+ *
+ * A small shared-memory table of what each helper last sent to SketchyBar,
+ * keyed by scope (an item or event name) and property. Helpers check a value
+ * before adding it to a payload and drop it when SketchyBar already has it,
+ * then record the values that were actually delivered.
+ *
+ * The table is a fixed-size, open-addressed array in a file mapped from
+ * $TMPDIR/barista_sent_cache.<BAR_NAME> (BARISTA_SENT_CACHE_PATH overrides).
+ * Each slot holds a 64-bit key hash and a 64-bit tag that hashes the value
+ * together with the table's epoch, so bumping the epoch invalidates every
+ * entry at once without touching the slots.
+ *
+ * Resync:
+ *   - main.lua removes the file whenever the bar starts or reloads, since a
+ *     new bar generation begins with default properties.
+ *   - BARISTA_SENT_CACHE_RESYNC=1 bumps the epoch once for that process.
+ *   - BARISTA_SENT_CACHE_DISABLE=1 turns suppression off entirely.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  uint64_t key;
+  uint64_t tag;
+} BaristaSentEntry;
+
+/* Fills *entry for scope/name=value and returns 1 when that exact value was
+ * the last one recorded, i.e. the property can be left out of the payload.
+ * Returns 0 when the value changed or the cache is unavailable. */
+int barista_sent_cache_check(const char *scope, const char *name, const char *value,
+                             BaristaSentEntry *entry);
+
+/* Marks an entry's value as delivered. Call only after a successful send. */
+void barista_sent_cache_record(const BaristaSentEntry *entry);
+
+/* Forgets an entry so its next check reports a change. Use after a failed
+ * send, since a fallback path may have applied different values. */
+void barista_sent_cache_forget(const BaristaSentEntry *entry);
+
+/* Invalidates every entry, e.g. after SketchyBar restarts. */
+void barista_sent_cache_resync(void);
+
+/* Writes the cache file path; 0 when it cannot be formed. */
+int barista_sent_cache_path(char *buffer, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,355 @@
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE 1
+#endif
+
+#include "barista_snapshot.h"
+#include "barista_json.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Largest magnitude a double holds every integer up to: 2^53. */
+#define EXACT_INTEGER 9007199254740992.0
+
+uint64_t barista_snapshot_hash(const void *data, size_t length) {
+  const unsigned char *bytes = data;
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+/* Growable array of `size`-byte items. */
+typedef struct {
+  unsigned char *items;
+  size_t size;
+  size_t count;
+  size_t capacity;
+} Vector;
+
+static void *vector_push(Vector *vector, size_t count) {
+  if (vector->count + count > vector->capacity) {
+    size_t capacity = vector->capacity ? vector->capacity : 64;
+    while (capacity < vector->count + count) capacity *= 2;
+    if (capacity > UINT32_MAX / 2) return NULL;
+    unsigned char *items = realloc(vector->items, capacity * vector->size);
+    if (!items) return NULL;
+    vector->items = items;
+    vector->capacity = capacity;
+  }
+  void *item = vector->items + vector->count * vector->size;
+  vector->count += count;
+  return item;
+}
+
+typedef struct {
+  uint32_t node;
+  size_t pending; /* where its members start in `pending` */
+} OpenContainer;
+
+typedef struct {
+  Vector nodes;    /* BaristaSnapshotNode */
+  Vector members;  /* BaristaSnapshotMember, closed containers */
+  Vector pending;  /* BaristaSnapshotMember, open containers */
+  Vector sorted;   /* BaristaSnapshotMember, merge scratch */
+  Vector open;     /* OpenContainer */
+  Vector strings;  /* char */
+} Builder;
+
+static int intern(Builder *builder, const char *text, size_t length, uint32_t *offset) {
+  if (length == 0) {
+    *offset = 0;
+    return 1;
+  }
+  *offset = (uint32_t)builder->strings.count;
+  char *copy = vector_push(&builder->strings, length + 1);
+  if (!copy) return 0;
+  memcpy(copy, text, length);
+  copy[length] = '\0';
+  return 1;
+}
+
+static int key_order(const Builder *builder, const BaristaSnapshotMember *a, const BaristaSnapshotMember *b) {
+  const char *strings = (const char *)builder->strings.items;
+  size_t shorter = a->key_length < b->key_length ? a->key_length : b->key_length;
+  int order = memcmp(strings + a->key, strings + b->key, shorter);
+  if (order) return order;
+  return (a->key_length > b->key_length) - (a->key_length < b->key_length);
+}
+
+/* Stable merge sort of `count` members by key, so that among equal keys the
+ * last one written ends up last. */
+static int sort_members(Builder *builder, BaristaSnapshotMember *members, size_t count) {
+  builder->sorted.count = 0;
+  BaristaSnapshotMember *scratch = vector_push(&builder->sorted, count);
+  if (!scratch) return 0;
+  BaristaSnapshotMember *from = members;
+  BaristaSnapshotMember *to = scratch;
+  for (size_t width = 1; width < count; width *= 2) {
+    for (size_t low = 0; low < count; low += 2 * width) {
+      size_t middle = low + width < count ? low + width : count;
+      size_t high = low + 2 * width < count ? low + 2 * width : count;
+      size_t left = low;
+      size_t right = middle;
+      size_t out = low;
+      while (left < middle && right < high) {
+        to[out++] = key_order(builder, &from[right], &from[left]) < 0 ? from[right++] : from[left++];
+      }
+      while (left < middle) to[out++] = from[left++];
+      while (right < high) to[out++] = from[right++];
+    }
+    BaristaSnapshotMember *swap = from;
+    from = to;
+    to = swap;
+  }
+  if (from != members) memcpy(members, from, count * sizeof(*members));
+  return 1;
+}
+
+static int build_value(void *context, const char *key, size_t key_length, const BaristaJsonValue *value) {
+  Builder *builder = context;
+  if (builder->nodes.count >= UINT32_MAX / 2) return 0;
+  uint32_t index = (uint32_t)builder->nodes.count;
+
+  if (builder->open.count > 0) {
+    BaristaSnapshotMember *member = vector_push(&builder->pending, 1);
+    if (!member) return 0;
+    member->node = index;
+    member->key_length = (uint32_t)key_length;
+    if (!key) member->key = 0;
+    else if (!intern(builder, key, key_length, &member->key)) return 0;
+  }
+
+  BaristaSnapshotNode *node = vector_push(&builder->nodes, 1);
+  if (!node) return 0;
+  memset(node, 0, sizeof(*node));
+  switch (value->type) {
+    case BARISTA_JSON_VALUE_NULL:
+      node->type = BARISTA_SNAPSHOT_NULL;
+      break;
+    case BARISTA_JSON_VALUE_BOOL:
+      node->type = BARISTA_SNAPSHOT_BOOL;
+      node->count = value->boolean ? 1 : 0;
+      break;
+    case BARISTA_JSON_VALUE_NUMBER:
+      if (value->integer && value->number >= -EXACT_INTEGER && value->number <= EXACT_INTEGER) {
+        node->type = BARISTA_SNAPSHOT_INTEGER;
+        node->value.integer = (int64_t)value->number;
+      } else {
+        node->type = BARISTA_SNAPSHOT_NUMBER;
+        node->value.number = value->number;
+      }
+      break;
+    case BARISTA_JSON_VALUE_STRING:
+      if (!value->string) return 0;
+      node->type = BARISTA_SNAPSHOT_STRING;
+      node->count = (uint32_t)value->length;
+      if (!intern(builder, value->string, value->length, &node->first)) return 0;
+      break;
+    case BARISTA_JSON_VALUE_OBJECT:
+    case BARISTA_JSON_VALUE_ARRAY: {
+      node->type = value->type == BARISTA_JSON_VALUE_OBJECT ? BARISTA_SNAPSHOT_OBJECT : BARISTA_SNAPSHOT_ARRAY;
+      OpenContainer *open = vector_push(&builder->open, 1);
+      if (!open) return 0;
+      open->node = index;
+      open->pending = builder->pending.count;
+      break;
+    }
+  }
+  return 1;
+}
+
+static int build_close(void *context) {
+  Builder *builder = context;
+  OpenContainer *open = (OpenContainer *)builder->open.items + --builder->open.count;
+  BaristaSnapshotNode *node = (BaristaSnapshotNode *)builder->nodes.items + open->node;
+  BaristaSnapshotMember *members = (BaristaSnapshotMember *)builder->pending.items + open->pending;
+  size_t count = builder->pending.count - open->pending;
+
+  if (node->type == BARISTA_SNAPSHOT_OBJECT && count > 1) {
+    if (!sort_members(builder, members, count)) return 0;
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (i + 1 < count && key_order(builder, &members[i], &members[i + 1]) == 0) continue;
+      members[kept++] = members[i];
+    }
+    count = kept;
+  }
+
+  node->first = (uint32_t)builder->members.count;
+  node->count = (uint32_t)count;
+  BaristaSnapshotMember *closed = vector_push(&builder->members, count);
+  if (!closed && count > 0) return 0;
+  if (count > 0) memcpy(closed, members, count * sizeof(*members));
+  builder->pending.count = open->pending;
+  return 1;
+}
+
+static const BaristaJsonVisitor kBuilder = {build_value, build_close};
+
+static size_t align8(size_t offset) {
+  return (offset + 7) & ~(size_t)7;
+}
+
+int barista_snapshot_build(const char *text, size_t length, void **out, size_t *out_size) {
+  Builder builder;
+  memset(&builder, 0, sizeof(builder));
+  builder.nodes.size = sizeof(BaristaSnapshotNode);
+  builder.members.size = sizeof(BaristaSnapshotMember);
+  builder.pending.size = sizeof(BaristaSnapshotMember);
+  builder.sorted.size = sizeof(BaristaSnapshotMember);
+  builder.open.size = sizeof(OpenContainer);
+  builder.strings.size = 1;
+
+  int result = -1;
+  unsigned char *buffer = NULL;
+  char *empty = vector_push(&builder.strings, 1);
+  if (empty) {
+    *empty = '\0';
+    result = barista_json_walk(text, length, &kBuilder, &builder, NULL);
+  }
+
+  size_t nodes = align8(sizeof(BaristaSnapshotHeader));
+  size_t members = nodes + builder.nodes.count * sizeof(BaristaSnapshotNode);
+  size_t strings = members + builder.members.count * sizeof(BaristaSnapshotMember);
+  size_t size = align8(strings + builder.strings.count);
+  if (result == 1 && size > UINT32_MAX) result = -1;
+  if (result == 1 && !(buffer = calloc(1, size))) result = -1;
+  if (result == 1) {
+    BaristaSnapshotHeader *header = (BaristaSnapshotHeader *)buffer;
+    header->magic = BARISTA_SNAPSHOT_MAGIC;
+    header->version = BARISTA_SNAPSHOT_VERSION;
+    header->source_hash = barista_snapshot_hash(text, length);
+    header->source_bytes = length;
+    header->node_count = (uint32_t)builder.nodes.count;
+    header->member_count = (uint32_t)builder.members.count;
+    header->nodes = (uint32_t)nodes;
+    header->members = (uint32_t)members;
+    header->strings = (uint32_t)strings;
+    header->string_bytes = (uint32_t)builder.strings.count;
+    memcpy(buffer + nodes, builder.nodes.items, builder.nodes.count * sizeof(BaristaSnapshotNode));
+    if (builder.members.count > 0) {
+      memcpy(buffer + members, builder.members.items, builder.members.count * sizeof(BaristaSnapshotMember));
+    }
+    memcpy(buffer + strings, builder.strings.items, builder.strings.count);
+    *out = buffer;
+    *out_size = size;
+  }
+
+  free(builder.nodes.items);
+  free(builder.members.items);
+  free(builder.pending.items);
+  free(builder.sorted.items);
+  free(builder.open.items);
+  free(builder.strings.items);
+  return result;
+}
+
+int barista_snapshot_write_file(const char *path, const char *text, size_t length) {
+  void *snapshot = NULL;
+  size_t size = 0;
+  int built = barista_snapshot_build(text, length, &snapshot, &size);
+  if (built != 1) return built;
+
+  /* A stale or missing snapshot only costs a slower load, so this skips the
+   * fsyncs state.json gets; the rename still keeps readers off a torn file. */
+  char temporary[1024];
+  int written = snprintf(temporary, sizeof(temporary), "%s.tmp.%d", path, (int)getpid()) < (int)sizeof(temporary);
+  FILE *file = written ? fopen(temporary, "wb") : NULL;
+  written = file && fwrite(snapshot, 1, size, file) == size;
+  if (file && fclose(file) != 0) written = 0;
+  free(snapshot);
+  if (!written || rename(temporary, path) != 0) {
+    if (file) unlink(temporary);
+    return -1;
+  }
+  return 1;
+}
+
+static int string_in_arena(const BaristaSnapshot *snapshot, uint32_t offset, uint32_t length) {
+  uint32_t bytes = snapshot->header->string_bytes;
+  return offset < bytes && length < bytes - offset && snapshot->strings[offset + length] == '\0';
+}
+
+int barista_snapshot_open(BaristaSnapshot *snapshot, const void *data, size_t size) {
+  memset(snapshot, 0, sizeof(*snapshot));
+  const BaristaSnapshotHeader *header = data;
+  if (!data || ((uintptr_t)data & 7) != 0 || size < sizeof(*header)) return 0;
+  if (header->magic != BARISTA_SNAPSHOT_MAGIC || header->version != BARISTA_SNAPSHOT_VERSION) return 0;
+
+  uint64_t nodes_end = header->nodes + (uint64_t)header->node_count * sizeof(BaristaSnapshotNode);
+  uint64_t members_end = header->members + (uint64_t)header->member_count * sizeof(BaristaSnapshotMember);
+  uint64_t strings_end = header->strings + (uint64_t)header->string_bytes;
+  if (header->node_count == 0 || header->string_bytes == 0) return 0;
+  if (header->nodes < sizeof(*header) || (header->nodes & 7) != 0 || nodes_end > size) return 0;
+  if (header->members < sizeof(*header) || (header->members & 3) != 0 || members_end > size) return 0;
+  if (header->strings < sizeof(*header) || strings_end > size) return 0;
+
+  snapshot->data = data;
+  snapshot->size = size;
+  snapshot->header = header;
+  snapshot->nodes = (const BaristaSnapshotNode *)((const unsigned char *)data + header->nodes);
+  snapshot->members = (const BaristaSnapshotMember *)((const unsigned char *)data + header->members);
+  snapshot->strings = (const char *)data + header->strings;
+  if (snapshot->strings[0] != '\0') return 0;
+
+  /* Members only point forward, so walking the tree always ends. */
+  for (uint32_t i = 0; i < header->node_count; i++) {
+    const BaristaSnapshotNode *node = &snapshot->nodes[i];
+    switch (node->type) {
+      case BARISTA_SNAPSHOT_NULL:
+      case BARISTA_SNAPSHOT_INTEGER:
+      case BARISTA_SNAPSHOT_NUMBER:
+        break;
+      case BARISTA_SNAPSHOT_BOOL:
+        if (node->count > 1) return 0;
+        break;
+      case BARISTA_SNAPSHOT_STRING:
+        if (!string_in_arena(snapshot, node->first, node->count)) return 0;
+        break;
+      case BARISTA_SNAPSHOT_OBJECT:
+      case BARISTA_SNAPSHOT_ARRAY:
+        if (node->first > header->member_count || node->count > header->member_count - node->first) return 0;
+        for (uint32_t m = 0; m < node->count; m++) {
+          const BaristaSnapshotMember *member = barista_snapshot_member(snapshot, node, m);
+          if (member->node <= i || member->node >= header->node_count) return 0;
+          if (!string_in_arena(snapshot, member->key, member->key_length)) return 0;
+        }
+        break;
+      default:
+        return 0;
+    }
+  }
+  return 1;
+}
+
+int barista_snapshot_matches(const BaristaSnapshot *snapshot, const void *text, size_t length) {
+  return snapshot->header && snapshot->header->source_bytes == length &&
+         snapshot->header->source_hash == barista_snapshot_hash(text, length);
+}
+
+uint32_t barista_snapshot_find(const BaristaSnapshot *snapshot,
+                               uint32_t object,
+                               const char *key,
+                               size_t key_length) {
+  if (object >= snapshot->header->node_count) return 0;
+  const BaristaSnapshotNode *node = &snapshot->nodes[object];
+  if (node->type != BARISTA_SNAPSHOT_OBJECT) return 0;
+  uint32_t low = 0;
+  uint32_t high = node->count;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    const BaristaSnapshotMember *member = barista_snapshot_member(snapshot, node, middle);
+    size_t shorter = member->key_length < key_length ? member->key_length : key_length;
+    int order = memcmp(snapshot->strings + member->key, key, shorter);
+    if (order == 0) order = (member->key_length > key_length) - (member->key_length < key_length);
+    if (order == 0) return member->node;
+    if (order < 0) low = middle + 1;
+    else high = middle;
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+/*
+ * Barista snapshot
+ *
+ * A binary copy of a JSON document that can be mapped and read in place,
+ * so Lua can load state.json without running the pure-Lua decoder over it.
+ * state_manager writes one next to state.json whenever it saves; the JSON
+ * stays the source of truth, and a reader that finds the snapshot missing,
+ * damaged or describing other JSON falls back to decoding the text.
+ *
+ * The file is one allocation: a header, a table of nodes, a table of
+ * members and a string arena, in that order, in host byte order. Node 0 is
+ * the document root and every other node appears after the container that
+ * holds it. A container's members are `count` consecutive entries of the
+ * member table from `first`; object members are sorted by key (bytes, then
+ * length) with duplicates resolved to the last one written, so keys can be
+ * binary-searched, and array members keep document order with no key.
+ * Strings are NUL-terminated in the arena; offset 0 is the empty string.
+ *
+ * The header records the FNV-1a hash and byte length of the JSON text the
+ * snapshot was built from; readers compare both against the current file
+ * before trusting it. Numbers written without a fraction or exponent that
+ * fit a double exactly are stored as INTEGER, everything else as NUMBER,
+ * matching what Lua's tonumber gives for the same text. Documents holding
+ * "\u0000" are not represented.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BARISTA_SNAPSHOT_MAGIC 0x504E5342u /* "BSNP" */
+#define BARISTA_SNAPSHOT_VERSION 1
+
+typedef enum {
+  BARISTA_SNAPSHOT_NULL = 1,
+  BARISTA_SNAPSHOT_BOOL,    /* count: 0 or 1 */
+  BARISTA_SNAPSHOT_INTEGER, /* integer */
+  BARISTA_SNAPSHOT_NUMBER,  /* number */
+  BARISTA_SNAPSHOT_STRING,  /* first: arena offset, count: length */
+  BARISTA_SNAPSHOT_OBJECT,  /* first, count: members */
+  BARISTA_SNAPSHOT_ARRAY,   /* first, count: members */
+} BaristaSnapshotType;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t source_hash;  /* of the JSON text */
+  uint64_t source_bytes;
+  uint32_t node_count;
+  uint32_t member_count;
+  uint32_t nodes;        /* byte offsets from the start of the file */
+  uint32_t members;
+  uint32_t strings;
+  uint32_t string_bytes;
+} BaristaSnapshotHeader;
+
+typedef struct {
+  uint32_t type;
+  uint32_t count;
+  uint32_t first;
+  uint32_t reserved;
+  union {
+    double number;
+    int64_t integer;
+  } value;
+} BaristaSnapshotNode;
+
+typedef struct {
+  uint32_t key;          /* arena offset; 0 in arrays */
+  uint32_t key_length;
+  uint32_t node;
+} BaristaSnapshotMember;
+
+typedef struct {
+  const unsigned char *data;
+  size_t size;
+  const BaristaSnapshotHeader *header;
+  const BaristaSnapshotNode *nodes;
+  const BaristaSnapshotMember *members;
+  const char *strings;
+} BaristaSnapshot;
+
+/* FNV-1a, 64-bit. */
+uint64_t barista_snapshot_hash(const void *data, size_t length);
+
+/* Builds a snapshot of the JSON in `text` into a malloc'd buffer. Returns 1
+ * on success, 0 when the text is not valid JSON and -1 when it cannot be
+ * represented or memory ran out. */
+int barista_snapshot_build(const char *text, size_t length, void **out, size_t *out_size);
+
+/* Builds a snapshot of `text` and writes it to `path` through a temporary
+ * file and a rename. Returns 1 on success, 0 when the text was not valid
+ * JSON and -1 on other failures. */
+int barista_snapshot_write_file(const char *path, const char *text, size_t length);
+
+/* Checks that `data` (8-byte aligned) holds a well-formed snapshot and
+ * fills `snapshot` with views into it. Every index and offset reachable
+ * through the accessors below is bounds-checked here, once. Returns 1 when
+ * it does and 0 otherwise. */
+int barista_snapshot_open(BaristaSnapshot *snapshot, const void *data, size_t size);
+
+/* Whether the snapshot was built from exactly these bytes. */
+int barista_snapshot_matches(const BaristaSnapshot *snapshot, const void *text, size_t length);
+
+/* Member `index` of the container `node`. */
+static inline const BaristaSnapshotMember *barista_snapshot_member(const BaristaSnapshot *snapshot,
+                                                                   const BaristaSnapshotNode *node,
+                                                                   uint32_t index) {
+  return &snapshot->members[node->first + index];
+}
+
+/* The node index of `key` in the object `object`, or 0 when it has none. */
+uint32_t barista_snapshot_find(const BaristaSnapshot *snapshot,
+                               uint32_t object,
+                               const char *key,
+                               size_t key_length);
+
+#ifdef __cplusplus
+}
+#endif
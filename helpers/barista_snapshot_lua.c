@@ -0,0 +1,238 @@
+/*
+ * barista_snapshot.so: maps state.json.snapshot for modules/state.lua.
+ *
+ *   local snapshot = package.loadlib(bin .. "/barista_snapshot.so", "luaopen_barista_snapshot")()
+ *   local handle, err = snapshot.open(state_file .. ".snapshot", state_file)
+ *   local appearance = handle:get("appearance")   -- one subtree
+ *   local data = handle:get()                     -- the whole document
+ *   handle:close()
+ *   local data, err = snapshot.load(state_file .. ".snapshot", state_file)
+ *
+ * `open` reads the JSON only to hash it, maps the snapshot and checks it was
+ * built from exactly that text; anything else returns nil and a reason, and
+ * the caller decodes the JSON instead. `get` builds tables for the subtree
+ * at a dotted path and nothing else, the same tables helpers/lib/json.lua
+ * would decode: nulls are left out, integers stay integers.
+ */
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE 1
+#endif
+
+#include "barista_json.h"
+#include "barista_snapshot.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <lauxlib.h>
+#include <lua.h>
+
+#define HANDLE_METATABLE "barista.snapshot"
+
+#if LUA_VERSION_NUM < 504
+#define lua_newuserdatauv(L, size, values) lua_newuserdata(L, size)
+#endif
+
+typedef struct {
+  void *map;
+  size_t size;
+  BaristaSnapshot snapshot;
+} Handle;
+
+static char *read_whole(const char *path, size_t *length) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return NULL;
+  struct stat info;
+  char *bytes = NULL;
+  size_t used = 0;
+  if (fstat(fd, &info) == 0 && (bytes = malloc((size_t)info.st_size + 1)) != NULL) {
+    while (used < (size_t)info.st_size) {
+      ssize_t count = read(fd, bytes + used, (size_t)info.st_size - used);
+      if (count <= 0) break;
+      used += (size_t)count;
+    }
+  }
+  close(fd);
+  if (bytes && used != (size_t)info.st_size) {
+    free(bytes);
+    return NULL;
+  }
+  *length = used;
+  return bytes;
+}
+
+static void handle_unmap(Handle *handle) {
+  if (handle->map) munmap(handle->map, handle->size);
+  handle->map = NULL;
+  handle->size = 0;
+  memset(&handle->snapshot, 0, sizeof(handle->snapshot));
+}
+
+/* Maps `snapshot_path` into `handle` when it describes `json_path` as it is
+ * now. Returns NULL, or why not. */
+static const char *handle_open(Handle *handle, const char *snapshot_path, const char *json_path) {
+  size_t length = 0;
+  char *text = read_whole(json_path, &length);
+  if (!text) return "cannot read state";
+
+  const char *error = NULL;
+  int fd = open(snapshot_path, O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0 || info.st_size <= 0) {
+    error = "no snapshot";
+  } else {
+    void *map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      error = "cannot map snapshot";
+    } else {
+      handle->map = map;
+      handle->size = (size_t)info.st_size;
+      if (!barista_snapshot_open(&handle->snapshot, map, handle->size)) error = "damaged snapshot";
+      else if (!barista_snapshot_matches(&handle->snapshot, text, length)) error = "stale snapshot";
+    }
+  }
+  if (fd >= 0) close(fd);
+  free(text);
+  if (error) handle_unmap(handle);
+  return error;
+}
+
+static void push_node(lua_State *L, const BaristaSnapshot *snapshot, uint32_t index, int depth) {
+  if (depth > BARISTA_JSON_MAX_DEPTH) luaL_error(L, "snapshot nested too deeply");
+  luaL_checkstack(L, 3, "snapshot nested too deeply");
+  const BaristaSnapshotNode *node = &snapshot->nodes[index];
+  switch (node->type) {
+    case BARISTA_SNAPSHOT_BOOL:
+      lua_pushboolean(L, node->count != 0);
+      return;
+    case BARISTA_SNAPSHOT_INTEGER:
+      lua_pushinteger(L, (lua_Integer)node->value.integer);
+      return;
+    case BARISTA_SNAPSHOT_NUMBER:
+      lua_pushnumber(L, (lua_Number)node->value.number);
+      return;
+    case BARISTA_SNAPSHOT_STRING:
+      lua_pushlstring(L, snapshot->strings + node->first, node->count);
+      return;
+    case BARISTA_SNAPSHOT_OBJECT:
+      lua_createtable(L, 0, (int)node->count);
+      for (uint32_t i = 0; i < node->count; i++) {
+        const BaristaSnapshotMember *member = barista_snapshot_member(snapshot, node, i);
+        if (snapshot->nodes[member->node].type == BARISTA_SNAPSHOT_NULL) continue;
+        lua_pushlstring(L, snapshot->strings + member->key, member->key_length);
+        push_node(L, snapshot, member->node, depth + 1);
+        lua_rawset(L, -3);
+      }
+      return;
+    case BARISTA_SNAPSHOT_ARRAY:
+      lua_createtable(L, (int)node->count, 0);
+      for (uint32_t i = 0; i < node->count; i++) {
+        const BaristaSnapshotMember *member = barista_snapshot_member(snapshot, node, i);
+        if (snapshot->nodes[member->node].type == BARISTA_SNAPSHOT_NULL) continue;
+        push_node(L, snapshot, member->node, depth + 1);
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+      }
+      return;
+    default:
+      lua_pushnil(L);
+      return;
+  }
+}
+
+/* Pushes the value at `path` ("appearance.bar_height"; NULL or "" for the
+ * root), or nil when there is none. */
+static void push_path(lua_State *L, const BaristaSnapshot *snapshot, const char *path) {
+  uint32_t index = 0;
+  while (path && *path) {
+    const char *dot = strchr(path, '.');
+    size_t length = dot ? (size_t)(dot - path) : strlen(path);
+    index = barista_snapshot_find(snapshot, index, path, length);
+    if (index == 0) {
+      lua_pushnil(L);
+      return;
+    }
+    path = dot ? dot + 1 : NULL;
+  }
+  push_node(L, snapshot, index, 0);
+}
+
+static int snapshot_open(lua_State *L) {
+  const char *snapshot_path = luaL_checkstring(L, 1);
+  const char *json_path = luaL_checkstring(L, 2);
+  Handle *handle = lua_newuserdatauv(L, sizeof(Handle), 0);
+  memset(handle, 0, sizeof(*handle));
+  luaL_setmetatable(L, HANDLE_METATABLE);
+  const char *error = handle_open(handle, snapshot_path, json_path);
+  if (error) {
+    lua_pushnil(L);
+    lua_pushstring(L, error);
+    return 2;
+  }
+  return 1;
+}
+
+static int snapshot_load(lua_State *L) {
+  const char *snapshot_path = luaL_checkstring(L, 1);
+  const char *json_path = luaL_checkstring(L, 2);
+  Handle handle;
+  memset(&handle, 0, sizeof(handle));
+  const char *error = handle_open(&handle, snapshot_path, json_path);
+  if (error) {
+    lua_pushnil(L);
+    lua_pushstring(L, error);
+    return 2;
+  }
+  /* Owned by a userdata, so an error while building still unmaps it. */
+  Handle *owner = lua_newuserdatauv(L, sizeof(Handle), 0);
+  *owner = handle;
+  luaL_setmetatable(L, HANDLE_METATABLE);
+  push_node(L, &owner->snapshot, 0, 0);
+  handle_unmap(owner);
+  return 1;
+}
+
+static Handle *check_open(lua_State *L) {
+  Handle *handle = luaL_checkudata(L, 1, HANDLE_METATABLE);
+  if (!handle->map) luaL_error(L, "snapshot is closed");
+  return handle;
+}
+
+static int handle_get(lua_State *L) {
+  Handle *handle = check_open(L);
+  push_path(L, &handle->snapshot, luaL_optstring(L, 2, NULL));
+  return 1;
+}
+
+static int handle_close(lua_State *L) {
+  handle_unmap(luaL_checkudata(L, 1, HANDLE_METATABLE));
+  return 0;
+}
+
+static const luaL_Reg kHandleMethods[] = {
+  {"get", handle_get},
+  {"close", handle_close},
+  {NULL, NULL},
+};
+
+static const luaL_Reg kFunctions[] = {
+  {"open", snapshot_open},
+  {"load", snapshot_load},
+  {NULL, NULL},
+};
+
+int luaopen_barista_snapshot(lua_State *L) {
+  if (luaL_newmetatable(L, HANDLE_METATABLE)) {
+    luaL_newlib(L, kHandleMethods);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, handle_close);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_pop(L, 1);
+  luaL_newlib(L, kFunctions);
+  return 1;
+}
@@ -0,0 +1,474 @@
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE 1
+#endif
+
+#include "barista_top.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <libproc.h>
+#include <mach/mach_time.h>
+#include <sys/proc_info.h>
+#endif
+
+#define TOP_STATE_MAGIC 0x42544f50u
+#define TOP_STATE_VERSION 1u
+#define TOP_MIN_TABLE 256u
+#define TOP_MAX_PROCESSES (1u << 20)
+#define MAX_BAR_NAME_BYTES 128
+
+/* One process in a scan. Also the on-disk record of a saved scan. */
+typedef struct {
+  uint64_t start;
+  uint64_t cpu_ns;
+  int32_t pid;
+  uint32_t used;
+} TopSlot;
+
+/* Open-addressed with linear probing, at most half full. Entries are never
+ * removed: each scan fills a cleared table, so there are no tombstones. */
+typedef struct {
+  TopSlot *slots;
+  uint32_t mask;
+  uint32_t count;
+} TopTable;
+
+typedef struct {
+  uint64_t delta_ns;
+  int32_t pid;
+  char name[BARISTA_TOP_NAME_BYTES];
+} TopCandidate;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;
+  uint32_t reserved;
+  uint64_t timestamp_ns;
+} TopStateHeader;
+
+struct BaristaTop {
+  TopTable current;
+  TopTable previous;
+  uint64_t current_ns;
+  uint64_t previous_ns;
+  int has_current;
+  int has_previous;
+  int hidden;
+  TopCandidate *candidates;
+  size_t candidate_count;
+  size_t candidate_capacity;
+  char proc_root[512];
+  uint64_t tick_ns;
+#ifdef __APPLE__
+  pid_t *pids;
+  size_t pid_capacity;
+  mach_timebase_info_data_t timebase;
+#endif
+};
+
+static uint32_t pid_hash(int32_t pid) {
+  uint32_t hash = (uint32_t)pid * 2654435761u;
+  return hash ^ (hash >> 16);
+}
+
+static int table_init(TopTable *table, uint32_t capacity) {
+  table->slots = calloc(capacity, sizeof(*table->slots));
+  table->mask = capacity - 1;
+  table->count = 0;
+  return table->slots != NULL;
+}
+
+static void table_clear(TopTable *table) {
+  memset(table->slots, 0, ((size_t)table->mask + 1) * sizeof(*table->slots));
+  table->count = 0;
+}
+
+static const TopSlot *table_find(const TopTable *table, int32_t pid) {
+  for (uint32_t index = pid_hash(pid) & table->mask;; index = (index + 1) & table->mask) {
+    const TopSlot *slot = &table->slots[index];
+    if (!slot->used) return NULL;
+    if (slot->pid == pid) return slot;
+  }
+}
+
+static void table_place(TopTable *table, const TopSlot *entry) {
+  uint32_t index = pid_hash(entry->pid) & table->mask;
+  while (table->slots[index].used && table->slots[index].pid != entry->pid) {
+    index = (index + 1) & table->mask;
+  }
+  if (!table->slots[index].used) table->count++;
+  table->slots[index] = *entry;
+  table->slots[index].used = 1;
+}
+
+static int table_insert(TopTable *table, const TopSlot *entry) {
+  if ((size_t)(table->count + 1) * 2 > (size_t)table->mask + 1) {
+    TopTable grown;
+    uint32_t capacity = (table->mask + 1) * 2;
+    if (capacity > TOP_MAX_PROCESSES * 2 || !table_init(&grown, capacity)) return 0;
+    for (uint32_t i = 0; i <= table->mask; i++) {
+      if (table->slots[i].used) table_place(&grown, &table->slots[i]);
+    }
+    free(table->slots);
+    *table = grown;
+  }
+  table_place(table, entry);
+  return 1;
+}
+
+BaristaTop *barista_top_create(const char *proc_root) {
+  BaristaTop *top = calloc(1, sizeof(*top));
+  if (!top) return NULL;
+  if (!table_init(&top->current, TOP_MIN_TABLE) || !table_init(&top->previous, TOP_MIN_TABLE)) {
+    barista_top_destroy(top);
+    return NULL;
+  }
+  snprintf(top->proc_root, sizeof(top->proc_root), "%s", proc_root ? proc_root : "/proc");
+  long hz = sysconf(_SC_CLK_TCK);
+  top->tick_ns = hz > 0 ? 1000000000ull / (uint64_t)hz : 10000000ull;
+#ifdef __APPLE__
+  if (mach_timebase_info(&top->timebase) != KERN_SUCCESS || top->timebase.denom == 0) {
+    top->timebase.numer = 1;
+    top->timebase.denom = 1;
+  }
+#endif
+  return top;
+}
+
+void barista_top_destroy(BaristaTop *top) {
+  if (!top) return;
+  free(top->current.slots);
+  free(top->previous.slots);
+  free(top->candidates);
+#ifdef __APPLE__
+  free(top->pids);
+#endif
+  free(top);
+}
+
+void barista_top_begin(BaristaTop *top, uint64_t now_ns) {
+  if (!top) return;
+  TopTable swap = top->previous;
+  top->previous = top->current;
+  top->current = swap;
+  table_clear(&top->current);
+  top->has_previous = top->has_current;
+  top->previous_ns = top->current_ns;
+  top->current_ns = now_ns;
+  top->has_current = 1;
+  top->hidden = 0;
+  top->candidate_count = 0;
+}
+
+int barista_top_observe(BaristaTop *top, int32_t pid, uint64_t start, uint64_t cpu_ns,
+                        const char *name) {
+  if (!top || pid < 0) return 0;
+  if (top->candidate_count == top->candidate_capacity) {
+    size_t capacity = top->candidate_capacity ? top->candidate_capacity * 2 : TOP_MIN_TABLE;
+    TopCandidate *grown = realloc(top->candidates, capacity * sizeof(*grown));
+    if (!grown) return 0;
+    top->candidates = grown;
+    top->candidate_capacity = capacity;
+  }
+  TopSlot entry = {.start = start, .cpu_ns = cpu_ns, .pid = pid, .used = 1};
+  if (!table_insert(&top->current, &entry)) return 0;
+
+  /* A pid missing from the previous scan, or reused since, started during
+   * the interval, so everything it has used counts. */
+  const TopSlot *before = top->has_previous ? table_find(&top->previous, pid) : NULL;
+  uint64_t delta = cpu_ns;
+  if (before && before->start == start) {
+    delta = cpu_ns > before->cpu_ns ? cpu_ns - before->cpu_ns : 0;
+  }
+  TopCandidate *candidate = &top->candidates[top->candidate_count++];
+  candidate->delta_ns = delta;
+  candidate->pid = pid;
+  snprintf(candidate->name, sizeof(candidate->name), "%s", name ? name : "");
+  return 1;
+}
+
+#ifdef __APPLE__
+static int scan_processes(BaristaTop *top) {
+  int bytes = proc_listpids(PROC_ALL_PIDS, 0, NULL, 0);
+  if (bytes <= 0) return -1;
+  /* Room for processes started between the two calls. */
+  size_t wanted = (size_t)bytes / sizeof(pid_t) + 64;
+  if (wanted > top->pid_capacity) {
+    pid_t *grown = realloc(top->pids, wanted * sizeof(*grown));
+    if (!grown) return -1;
+    top->pids = grown;
+    top->pid_capacity = wanted;
+  }
+  bytes = proc_listpids(PROC_ALL_PIDS, 0, top->pids, (int)(top->pid_capacity * sizeof(pid_t)));
+  if (bytes <= 0) return -1;
+
+  int seen = 0;
+  size_t count = (size_t)bytes / sizeof(pid_t);
+  uint64_t numer = top->timebase.numer;
+  uint64_t denom = top->timebase.denom;
+  for (size_t i = 0; i < count; i++) {
+    struct proc_taskallinfo info;
+    if (top->pids[i] < 0) continue;
+    if (proc_pidinfo(top->pids[i], PROC_PIDTASKALLINFO, 0, &info, sizeof(info))
+        != (int)sizeof(info)) {
+      /* Another user's process; one that exited fails with ESRCH. */
+      if (errno == EPERM || errno == EACCES) top->hidden++;
+      continue;
+    }
+    uint64_t ticks = info.ptinfo.pti_total_user + info.ptinfo.pti_total_system;
+    uint64_t cpu_ns = ticks / denom * numer + ticks % denom * numer / denom;
+    uint64_t start = (uint64_t)info.pbsd.pbi_start_tvsec * 1000000ull
+                     + (uint64_t)info.pbsd.pbi_start_tvusec;
+    const char *name = info.pbsd.pbi_name[0] ? info.pbsd.pbi_name : info.pbsd.pbi_comm;
+    if (barista_top_observe(top, top->pids[i], start, cpu_ns, name)) seen++;
+  }
+  return seen;
+}
+#else
+/* Parses one /proc/[pid]/stat line. The command name sits in parentheses
+ * and may itself contain spaces and ')', so fields resume after the last
+ * ')'. Returns 0 for anything malformed. */
+static int parse_proc_stat(const char *line, char *name, size_t name_size, uint64_t *ticks,
+                           uint64_t *start) {
+  const char *open = strchr(line, '(');
+  const char *close = strrchr(line, ')');
+  if (!open || !close || close < open || close[1] != ' ') return 0;
+  size_t length = (size_t)(close - open - 1);
+  if (length >= name_size) length = name_size - 1;
+  memcpy(name, open + 1, length);
+  name[length] = '\0';
+
+  /* Field 3 (state) is index 0 here; utime, stime and starttime are fields
+   * 14, 15 and 22. */
+  const char *cursor = close + 2;
+  uint64_t utime = 0;
+  uint64_t stime = 0;
+  for (int field = 0; field <= 19; field++) {
+    while (*cursor == ' ') cursor++;
+    if (*cursor == '\0' || *cursor == '\n') return 0;
+    if (field == 11 || field == 12 || field == 19) {
+      char *end = NULL;
+      unsigned long long value = strtoull(cursor, &end, 10);
+      if (end == cursor) return 0;
+      if (field == 11) utime = value;
+      else if (field == 12) stime = value;
+      else *start = value;
+      cursor = end;
+    } else {
+      while (*cursor && *cursor != ' ' && *cursor != '\n') cursor++;
+    }
+  }
+  *ticks = utime + stime;
+  return 1;
+}
+
+static int scan_processes(BaristaTop *top) {
+  DIR *directory = opendir(top->proc_root);
+  if (!directory) return -1;
+  int directory_fd = dirfd(directory);
+  int seen = 0;
+  struct dirent *entry;
+  while ((entry = readdir(directory)) != NULL) {
+    if (entry->d_name[0] < '1' || entry->d_name[0] > '9') continue;
+    char *end = NULL;
+    long pid = strtol(entry->d_name, &end, 10);
+    if (*end != '\0' || pid <= 0 || pid > INT32_MAX) continue;
+
+    char path[32];
+    snprintf(path, sizeof(path), "%ld/stat", pid);
+    /* The process may have exited since readdir; skip it. */
+    int fd = openat(directory_fd, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      /* hidepid=1 lists other users' processes but refuses their stat. */
+      if (errno == EACCES || errno == EPERM) top->hidden++;
+      continue;
+    }
+    char line[1024];
+    ssize_t length = read(fd, line, sizeof(line) - 1);
+    close(fd);
+    if (length <= 0) continue;
+    line[length] = '\0';
+
+    char name[BARISTA_TOP_NAME_BYTES];
+    uint64_t ticks = 0;
+    uint64_t start = 0;
+    if (!parse_proc_stat(line, name, sizeof(name), &ticks, &start)) continue;
+    if (barista_top_observe(top, (int32_t)pid, start, ticks * top->tick_ns, name)) seen++;
+  }
+  closedir(directory);
+  return seen;
+}
+#endif
+
+int barista_top_scan(BaristaTop *top, uint64_t now_ns) {
+  if (!top) return -1;
+  barista_top_begin(top, now_ns);
+  int seen = scan_processes(top);
+  /* A failed walk is no baseline for the next scan. */
+  if (seen < 0) top->has_current = 0;
+  return seen;
+}
+
+int barista_top_hidden(const BaristaTop *top) {
+  return top ? top->hidden : 0;
+}
+
+uint64_t barista_top_interval_ns(const BaristaTop *top) {
+  if (!top || !top->has_previous || !top->has_current || top->current_ns <= top->previous_ns) {
+    return 0;
+  }
+  return top->current_ns - top->previous_ns;
+}
+
+/* Strict total order, so equal loads still select deterministically. */
+static int busier(const TopCandidate *a, const TopCandidate *b) {
+  if (a->delta_ns != b->delta_ns) return a->delta_ns > b->delta_ns;
+  return a->pid < b->pid;
+}
+
+static void swap_candidates(TopCandidate *a, TopCandidate *b) {
+  TopCandidate swap = *a;
+  *a = *b;
+  *b = swap;
+}
+
+/* Quickselect: leaves the `k` busiest candidates in front, unordered. Each
+ * round partitions around a median-of-three pivot and keeps only the side
+ * holding position k - 1, so the expected cost is linear. */
+static void select_busiest(TopCandidate *candidates, size_t count, size_t k) {
+  size_t target = k - 1;
+  size_t left = 0;
+  size_t right = count - 1;
+  while (left < right) {
+    TopCandidate *first = &candidates[left];
+    TopCandidate *middle = &candidates[left + (right - left) / 2];
+    TopCandidate *last = &candidates[right];
+    if (busier(middle, first)) swap_candidates(middle, first);
+    if (busier(last, first)) swap_candidates(last, first);
+    if (busier(middle, last)) swap_candidates(middle, last);
+    /* `last` now holds the median of the three; partition around it. */
+    size_t store = left;
+    for (size_t i = left; i < right; i++) {
+      if (busier(&candidates[i], last)) swap_candidates(&candidates[i], &candidates[store++]);
+    }
+    swap_candidates(&candidates[store], last);
+    if (store == target) return;
+    if (store > target) right = store - 1;
+    else left = store + 1;
+  }
+}
+
+size_t barista_top_select(BaristaTop *top, BaristaTopProcess *processes, size_t max) {
+  uint64_t interval = barista_top_interval_ns(top);
+  if (interval == 0 || !processes || max == 0 || top->candidate_count == 0) return 0;
+  size_t k = max < top->candidate_count ? max : top->candidate_count;
+  select_busiest(top->candidates, top->candidate_count, k);
+  for (size_t i = 1; i < k; i++) {
+    for (size_t j = i; j > 0 && busier(&top->candidates[j], &top->candidates[j - 1]); j--) {
+      swap_candidates(&top->candidates[j], &top->candidates[j - 1]);
+    }
+  }
+  for (size_t i = 0; i < k; i++) {
+    processes[i].pid = top->candidates[i].pid;
+    processes[i].cpu_percent = (double)top->candidates[i].delta_ns * 100.0 / (double)interval;
+    memcpy(processes[i].name, top->candidates[i].name, sizeof(processes[i].name));
+  }
+  return k;
+}
+
+int barista_top_state_path(char *buffer, size_t capacity) {
+  if (!buffer || capacity == 0) return 0;
+  buffer[0] = '\0';
+  const char *directory = getenv("TMPDIR");
+  if (!directory || directory[0] == '\0') directory = "/tmp";
+  const char *bar_name = getenv("BAR_NAME");
+  if (!bar_name || bar_name[0] == '\0') bar_name = "sketchybar";
+  if (strlen(bar_name) > MAX_BAR_NAME_BYTES || strchr(bar_name, '/')) return 0;
+  size_t directory_length = strlen(directory);
+  while (directory_length > 1 && directory[directory_length - 1] == '/') directory_length--;
+  int written = snprintf(buffer, capacity, "%.*s/barista_top.%s", (int)directory_length,
+                         directory, bar_name);
+  if (written <= 0 || (size_t)written >= capacity) {
+    buffer[0] = '\0';
+    return 0;
+  }
+  return 1;
+}
+
+int barista_top_load(BaristaTop *top, const char *path) {
+  if (!top || !path) return 0;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return 0;
+  struct stat status;
+  TopStateHeader header;
+  if (fstat(fd, &status) != 0
+      || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+      || header.magic != TOP_STATE_MAGIC || header.version != TOP_STATE_VERSION
+      || header.count > TOP_MAX_PROCESSES
+      || status.st_size != (off_t)(sizeof(header) + (size_t)header.count * sizeof(TopSlot))) {
+    close(fd);
+    return 0;
+  }
+  TopSlot *entries = header.count ? malloc((size_t)header.count * sizeof(*entries)) : NULL;
+  size_t bytes = (size_t)header.count * sizeof(TopSlot);
+  if ((header.count && !entries)
+      || (bytes && pread(fd, entries, bytes, sizeof(header)) != (ssize_t)bytes)) {
+    free(entries);
+    close(fd);
+    return 0;
+  }
+  close(fd);
+
+  table_clear(&top->current);
+  int loaded = 1;
+  for (uint32_t i = 0; i < header.count && loaded; i++) {
+    loaded = entries[i].pid >= 0 && table_insert(&top->current, &entries[i]);
+  }
+  free(entries);
+  top->current_ns = header.timestamp_ns;
+  top->has_current = loaded;
+  top->has_previous = 0;
+  top->candidate_count = 0;
+  return loaded;
+}
+
+int barista_top_save(const BaristaTop *top, const char *path) {
+  if (!top || !path || !top->has_current) return 0;
+  char temporary[1040];
+  if (snprintf(temporary, sizeof(temporary), "%s.XXXXXX", path) >= (int)sizeof(temporary)) {
+    return 0;
+  }
+  size_t bytes = (size_t)top->current.count * sizeof(TopSlot);
+  TopSlot *entries = bytes ? malloc(bytes) : NULL;
+  if (bytes && !entries) return 0;
+  size_t count = 0;
+  for (uint32_t i = 0; i <= top->current.mask; i++) {
+    if (top->current.slots[i].used) entries[count++] = top->current.slots[i];
+  }
+  TopStateHeader header = {.magic = TOP_STATE_MAGIC, .version = TOP_STATE_VERSION,
+                           .count = (uint32_t)count, .reserved = 0,
+                           .timestamp_ns = top->current_ns};
+
+  int fd = mkstemp(temporary);
+  if (fd < 0) {
+    free(entries);
+    return 0;
+  }
+  int written = write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header)
+                && (bytes == 0 || write(fd, entries, bytes) == (ssize_t)bytes);
+  free(entries);
+  if (close(fd) != 0 || !written || rename(temporary, path) != 0) {
+    unlink(temporary);
+    return 0;
+  }
+  return 1;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+/*
+ * Barista Top
+ *
+ * In-process top-N CPU sampler. A scan walks the process table directly
+ * (/proc/[pid]/stat on Linux, proc_listpids/proc_pidinfo on macOS) and
+ * records each process's cumulative CPU time in an open-addressed hash keyed
+ * by pid. The next scan looks every process up in that table, so CPU% is the
+ * real share of one core over the interval between scans rather than the
+ * decayed average `ps` reports. The top N come out of a partial selection,
+ * O(n) in the number of processes, with only the N winners sorted.
+ *
+ * Processes keep their identity by pid and start time, so a reused pid is
+ * treated as a new process. A process absent from the previous scan started
+ * during the interval; all of its CPU time counts. On macOS only processes
+ * the caller may inspect are seen; barista_top_hidden() counts the rest.
+ *
+ * Short-lived callers (a popup refresh runs once and exits) carry the table
+ * from one run to the next with barista_top_save()/barista_top_load():
+ *
+ *   BaristaTop *top = barista_top_create(NULL);
+ *   barista_top_load(top, path);
+ *   barista_top_scan(top, now_ns);
+ *   size_t count = barista_top_select(top, processes, 5);
+ *   barista_top_save(top, path);
+ *   barista_top_destroy(top);
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BARISTA_TOP_NAME_BYTES 32
+
+typedef struct BaristaTop BaristaTop;
+
+typedef struct {
+  int32_t pid;
+  double cpu_percent; /* of one core over the interval; may exceed 100 */
+  char name[BARISTA_TOP_NAME_BYTES];
+} BaristaTopProcess;
+
+/* `proc_root` replaces /proc on Linux (tests point it at a fixture tree);
+ * NULL uses the live table. Ignored on macOS. Returns NULL on failure. */
+BaristaTop *barista_top_create(const char *proc_root);
+void barista_top_destroy(BaristaTop *top);
+
+/* Walks the process table at `now_ns` (any clock, as long as every scan and
+ * saved table use the same one). Returns the number of processes seen, or
+ * -1 when the table could not be read. */
+int barista_top_scan(BaristaTop *top, uint64_t now_ns);
+
+/* The same scan fed by hand: begin, one observe per process, then select.
+ * `cpu_ns` is the process's cumulative user + system time; `start` is any
+ * value that changes when the pid is reused. */
+void barista_top_begin(BaristaTop *top, uint64_t now_ns);
+int barista_top_observe(BaristaTop *top, int32_t pid, uint64_t start, uint64_t cpu_ns,
+                        const char *name);
+
+/* Processes the last scan listed but was not allowed to read (other users'
+ * on macOS without root, or /proc mounted with hidepid). The ranking leaves
+ * them out, so a caller that wants the whole system should use another
+ * source when this is not 0. */
+int barista_top_hidden(const BaristaTop *top);
+
+/* Copies the `max` busiest processes of the last scan, busiest first, and
+ * returns how many were copied; 0 until there are two scans to compare. */
+size_t barista_top_select(BaristaTop *top, BaristaTopProcess *processes, size_t max);
+
+/* Nanoseconds between the last two scans; 0 when there is no earlier scan
+ * or the clock went backwards. */
+uint64_t barista_top_interval_ns(const BaristaTop *top);
+
+/* $TMPDIR/barista_top.<BAR_NAME>; 0 when it cannot be formed. */
+int barista_top_state_path(char *buffer, size_t capacity);
+
+/* Replaces the table with the last scan saved at `path`, which the next
+ * scan then compares against. 0 when the file is missing or malformed. */
+int barista_top_load(BaristaTop *top, const char *path);
+
+/* Writes the last scan to `path` through a temporary file and rename. */
+int barista_top_save(const BaristaTop *top, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
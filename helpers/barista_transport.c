@@ -0,0 +1,579 @@
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE 1
+#endif
+
+#include "barista_transport.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <bootstrap.h>
+#include <mach/mach.h>
+#include <mach/message.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define MAX_BAR_NAME_BYTES 128
+
+#ifdef __APPLE__
+struct barista_mach_message {
+  mach_msg_header_t header;
+  mach_msg_size_t descriptor_count;
+  mach_msg_ool_descriptor_t descriptor;
+};
+
+struct barista_mach_buffer {
+  struct barista_mach_message message;
+  mach_msg_trailer_t trailer;
+};
+
+static mach_port_t g_service_port = MACH_PORT_NULL;
+static mach_port_t g_reply_port = MACH_PORT_NULL;
+static char g_service_name[160] = "";
+#endif
+
+/* How long a process skips the bus after failing to reach barista_busd. */
+#define BUS_RETRY_MILLISECONDS 1000
+
+typedef struct {
+  int fd;
+  int64_t retry_after;
+  char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+} SocketLink;
+
+static SocketLink g_direct = {.fd = -1, .retry_after = 0, .path = ""};
+static SocketLink g_bus = {.fd = -1, .retry_after = 0, .path = ""};
+
+/* Session file for BARISTA_RECORD_PATH; path is kept after a failed open so
+ * an unwritable file costs one attempt rather than one per send. */
+static struct {
+  int fd;
+  char path[1024];
+} g_record = {.fd = -1, .path = ""};
+
+static int64_t monotonic_milliseconds(void) {
+  struct timespec value = {0};
+  if (clock_gettime(CLOCK_MONOTONIC, &value) != 0) return 0;
+  return (int64_t)value.tv_sec * 1000 + (int64_t)value.tv_nsec / 1000000;
+}
+
+static int64_t deadline_after(int timeout_ms) {
+  return timeout_ms < 0 ? -1 : monotonic_milliseconds() + timeout_ms;
+}
+
+/* Waits for events before the deadline; -1 waits indefinitely. */
+static int wait_descriptor(int fd, short events, int64_t deadline) {
+  for (;;) {
+    int remaining = -1;
+    if (deadline >= 0) {
+      int64_t now = monotonic_milliseconds();
+      if (now >= deadline) return 0;
+      remaining = (int)(deadline - now);
+    }
+    struct pollfd descriptor = {.fd = fd, .events = events, .revents = 0};
+    int result = poll(&descriptor, 1, remaining);
+    if (result < 0 && errno == EINTR) continue;
+    if (result < 0) return -1;
+    if (result == 0) return 0;
+    return 1;
+  }
+}
+
+static int write_all(int fd, const uint8_t *bytes, size_t length, int64_t deadline) {
+  size_t written = 0;
+  while (written < length) {
+    ssize_t count = send(fd, bytes + written, length - written, MSG_NOSIGNAL);
+    if (count > 0) {
+      written += (size_t)count;
+      continue;
+    }
+    if (count < 0 && errno == EINTR) continue;
+    if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (wait_descriptor(fd, POLLOUT, deadline) <= 0) return -1;
+      continue;
+    }
+    return -1;
+  }
+  return 0;
+}
+
+static int read_all(int fd, uint8_t *bytes, size_t length, int64_t deadline) {
+  size_t used = 0;
+  while (used < length) {
+    ssize_t count = recv(fd, bytes + used, length - used, 0);
+    if (count > 0) {
+      used += (size_t)count;
+      continue;
+    }
+    if (count == 0) return -1;
+    if (errno == EINTR) continue;
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      if (wait_descriptor(fd, POLLIN, deadline) <= 0) return -1;
+      continue;
+    }
+    return -1;
+  }
+  return 0;
+}
+
+static void store_u32(uint8_t *bytes, uint32_t value) {
+  bytes[0] = (uint8_t)(value >> 24);
+  bytes[1] = (uint8_t)(value >> 16);
+  bytes[2] = (uint8_t)(value >> 8);
+  bytes[3] = (uint8_t)value;
+}
+
+static uint32_t load_u32(const uint8_t *bytes) {
+  return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16)
+    | ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+}
+
+int barista_record_decode(const void *bytes, BaristaRecordHeader *header) {
+  if (!bytes || !header) return -1;
+  const uint8_t *raw = bytes;
+  if (load_u32(raw) != BARISTA_RECORD_MAGIC) return -1;
+  header->length = load_u32(raw + 4);
+  header->timestamp_ns = ((uint64_t)load_u32(raw + 8) << 32) | load_u32(raw + 12);
+  header->pid = load_u32(raw + 16);
+  header->timeout_ms = (int32_t)load_u32(raw + 20);
+  return header->length > BARISTA_TRANSPORT_MAX_PAYLOAD_BYTES ? -1 : 0;
+}
+
+/* Appends the payload to the BARISTA_RECORD_PATH session, if one is set. */
+static void record_payload(const void *payload, size_t length, int timeout_ms) {
+  const char *path = getenv("BARISTA_RECORD_PATH");
+  if (!path || path[0] == '\0') return;
+  if (strcmp(path, g_record.path) != 0) {
+    if (g_record.fd >= 0) close(g_record.fd);
+    g_record.fd = -1;
+    snprintf(g_record.path, sizeof(g_record.path), "%s", path);
+    g_record.fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  }
+  if (g_record.fd < 0) return;
+
+  struct timespec now = {0};
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t timestamp = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+  uint8_t header[BARISTA_RECORD_HEADER_BYTES];
+  store_u32(header, BARISTA_RECORD_MAGIC);
+  store_u32(header + 4, (uint32_t)length);
+  store_u32(header + 8, (uint32_t)(timestamp >> 32));
+  store_u32(header + 12, (uint32_t)timestamp);
+  store_u32(header + 16, (uint32_t)getpid());
+  store_u32(header + 20, (uint32_t)timeout_ms);
+  struct iovec parts[2] = {
+    {.iov_base = header, .iov_len = sizeof(header)},
+    {.iov_base = (void *)payload, .iov_len = length},
+  };
+  ssize_t ignored = writev(g_record.fd, parts, 2);
+  (void)ignored;
+}
+
+int barista_frame_write(int fd, const void *bytes, size_t length, uint32_t flags,
+                        int timeout_ms) {
+  if (fd < 0 || (!bytes && length > 0) || length > UINT32_MAX) return -1;
+  int64_t deadline = deadline_after(timeout_ms);
+  uint8_t header[BARISTA_FRAME_HEADER_BYTES];
+  store_u32(header, (uint32_t)length);
+  store_u32(header + 4, flags);
+  if (write_all(fd, header, sizeof(header), deadline) != 0) return -1;
+  return length == 0 ? 0 : write_all(fd, bytes, length, deadline);
+}
+
+int barista_frame_read(int fd, void *buffer, size_t capacity, size_t *length,
+                       uint32_t *flags, int timeout_ms) {
+  if (fd < 0 || !buffer || !length) return -1;
+  int64_t deadline = deadline_after(timeout_ms);
+  uint8_t header[BARISTA_FRAME_HEADER_BYTES];
+  if (read_all(fd, header, sizeof(header), deadline) != 0) return -1;
+  uint32_t frame_length = load_u32(header);
+  if (frame_length > capacity) return -1;
+  if (read_all(fd, buffer, frame_length, deadline) != 0) return -1;
+  *length = frame_length;
+  if (flags) *flags = load_u32(header + 4);
+  return 0;
+}
+
+int barista_socket_listen(const char *path) {
+  struct sockaddr_un address;
+  if (!path || path[0] == '\0' || strlen(path) >= sizeof(address.sun_path)) return -1;
+
+  /* A server already answering there keeps its socket. */
+  int live = barista_socket_connect(path);
+  if (live >= 0) {
+    close(live);
+    errno = EADDRINUSE;
+    return -1;
+  }
+
+  /* Bound and listening under a private name first, then renamed over the
+   * path, so a client never finds the path missing or refusing. */
+  char staged[sizeof(address.sun_path)];
+  int written = snprintf(staged, sizeof(staged), "%s.%ld", path, (long)getpid());
+  if (written <= 0 || (size_t)written >= sizeof(staged)) return -1;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  memcpy(address.sun_path, staged, (size_t)written + 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  unlink(staged);
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0
+      || listen(fd, 16) != 0 || rename(staged, path) != 0) {
+    int saved = errno;
+    close(fd);
+    unlink(staged);
+    errno = saved;
+    return -1;
+  }
+  return fd;
+}
+
+int barista_response_status(const void *bytes, size_t size) {
+  if (!bytes || size == 0 || size > BARISTA_TRANSPORT_MAX_RESPONSE_BYTES) return -1;
+  const char *response = bytes;
+  if (memchr(response, '\0', size) == NULL) return -1;
+  return strstr(response, "[!]") == NULL ? 1 : 0;
+}
+
+int barista_payload_valid(const void *payload, size_t length) {
+  const uint8_t *bytes = payload;
+  return bytes != NULL && length >= 2 && length <= BARISTA_TRANSPORT_MAX_PAYLOAD_BYTES
+    && bytes[0] != 0 && bytes[length - 1] == 0 && bytes[length - 2] == 0;
+}
+
+static const char *configured_socket_path(void) {
+  const char *path = getenv("BARISTA_TRANSPORT_SOCKET");
+  return path && path[0] != '\0' ? path : NULL;
+}
+
+int barista_bus_socket_path(char *buffer, size_t capacity) {
+  if (!buffer || capacity == 0) return 0;
+  buffer[0] = '\0';
+  const char *disabled = getenv("BARISTA_BUSD_DISABLE");
+  if (disabled && strcmp(disabled, "1") == 0) return 0;
+
+  int written = 0;
+  const char *path = getenv("BARISTA_BUSD_SOCKET");
+  if (path && path[0] != '\0') {
+    written = snprintf(buffer, capacity, "%s", path);
+  } else {
+    const char *tmpdir = getenv("TMPDIR");
+    const char *bar_name = getenv("BAR_NAME");
+    if (!tmpdir || tmpdir[0] == '\0') tmpdir = "/tmp";
+    if (!bar_name || bar_name[0] == '\0') bar_name = "sketchybar";
+    if (strlen(bar_name) > MAX_BAR_NAME_BYTES || strchr(bar_name, '/')) return 0;
+    size_t tmpdir_length = strlen(tmpdir);
+    while (tmpdir_length > 1 && tmpdir[tmpdir_length - 1] == '/') tmpdir_length--;
+    written = snprintf(buffer, capacity, "%.*s/barista_busd.%s.sock",
+                       (int)tmpdir_length, tmpdir, bar_name);
+  }
+  if (written <= 0 || (size_t)written >= capacity
+      || (size_t)written >= sizeof(((struct sockaddr_un *)0)->sun_path)) {
+    buffer[0] = '\0';
+    return 0;
+  }
+  return 1;
+}
+
+BaristaTransportBackend barista_transport_backend(void) {
+  if (configured_socket_path()) return BARISTA_TRANSPORT_SOCKET;
+#ifdef __APPLE__
+  return BARISTA_TRANSPORT_MACH;
+#else
+  return BARISTA_TRANSPORT_NONE;
+#endif
+}
+
+static void socket_release(SocketLink *link) {
+  if (link->fd >= 0) close(link->fd);
+  link->fd = -1;
+  link->path[0] = '\0';
+}
+
+int barista_socket_connect(const char *path) {
+  struct sockaddr_un address;
+  if (!path || path[0] == '\0' || strlen(path) >= sizeof(address.sun_path)) return -1;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  memcpy(address.sun_path, path, strlen(path) + 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+  int enabled = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+#endif
+  if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int socket_connection(SocketLink *link, const char *path) {
+  if (link->fd >= 0 && strcmp(link->path, path) == 0) return link->fd;
+  socket_release(link);
+  if (strlen(path) >= sizeof(link->path)) return -1;
+  int fd = barista_socket_connect(path);
+  if (fd < 0) return -1;
+  link->fd = fd;
+  memcpy(link->path, path, strlen(path) + 1);
+  return fd;
+}
+
+static BaristaSendResult socket_send(SocketLink *link,
+                                     const char *path,
+                                     const void *payload,
+                                     size_t length,
+                                     int timeout_ms) {
+  uint32_t flags = timeout_ms > 0 ? 0 : BARISTA_FRAME_NO_REPLY;
+  for (int attempt = 0; attempt < 2; attempt++) {
+    int fd = socket_connection(link, path);
+    if (fd < 0) continue;
+    /* A failed or partial write leaves no complete frame on the server, so
+     * a fresh connection can safely carry the retry. */
+    if (barista_frame_write(fd, payload, length, flags,
+                            BARISTA_TRANSPORT_SEND_TIMEOUT_MS) != 0) {
+      socket_release(link);
+      continue;
+    }
+    if (flags & BARISTA_FRAME_NO_REPLY) return BARISTA_SEND_SENT_UNCONFIRMED;
+
+    static uint8_t response[BARISTA_TRANSPORT_MAX_RESPONSE_BYTES];
+    size_t response_length = 0;
+    uint32_t response_flags = 0;
+    if (barista_frame_read(fd, response, sizeof(response), &response_length,
+                           &response_flags, timeout_ms) != 0) {
+      /* A late reply must not answer the next request on this connection. */
+      socket_release(link);
+      return BARISTA_SEND_SENT_UNCONFIRMED;
+    }
+    if (response_flags & BARISTA_FRAME_NOT_DELIVERED) return BARISTA_SEND_NOT_SENT;
+    int status = barista_response_status(response, response_length);
+    if (status > 0) return BARISTA_SEND_CONFIRMED_SUCCESS;
+    if (status == 0) return BARISTA_SEND_CONFIRMED_ERROR;
+    return BARISTA_SEND_SENT_UNCONFIRMED;
+  }
+  return BARISTA_SEND_NOT_SENT;
+}
+
+/* Hands the payload to barista_busd when one is listening. NOT_SENT means the
+ * bus never applied it, so the caller may still use the direct backend. */
+static BaristaSendResult bus_send(const void *payload, size_t length, int timeout_ms) {
+  char path[sizeof(g_bus.path)];
+  if (!barista_bus_socket_path(path, sizeof(path))) return BARISTA_SEND_NOT_SENT;
+  if (g_bus.fd < 0 && g_bus.retry_after > monotonic_milliseconds()) {
+    return BARISTA_SEND_NOT_SENT;
+  }
+  BaristaSendResult result = socket_send(&g_bus, path, payload, length, timeout_ms);
+  if (result == BARISTA_SEND_NOT_SENT && g_bus.fd < 0) {
+    g_bus.retry_after = monotonic_milliseconds() + BUS_RETRY_MILLISECONDS;
+  }
+  return result;
+}
+
+#ifdef __APPLE__
+static void mach_release_service_port(void) {
+  if (g_service_port != MACH_PORT_NULL) {
+    mach_port_deallocate(mach_task_self(), g_service_port);
+  }
+  g_service_port = MACH_PORT_NULL;
+  g_service_name[0] = '\0';
+}
+
+static void mach_release_reply_port(void) {
+  if (g_reply_port != MACH_PORT_NULL) {
+    mach_port_name_t task = mach_task_self();
+    mach_port_mod_refs(task, g_reply_port, MACH_PORT_RIGHT_RECEIVE, -1);
+    mach_port_deallocate(task, g_reply_port);
+  }
+  g_reply_port = MACH_PORT_NULL;
+}
+
+static mach_port_t mach_service_port(void) {
+  const char *bar_name = getenv("BAR_NAME");
+  if (!bar_name || bar_name[0] == '\0') bar_name = "sketchybar";
+  if (strlen(bar_name) > MAX_BAR_NAME_BYTES) return MACH_PORT_NULL;
+
+  char service_name[sizeof(g_service_name)];
+  int written = snprintf(service_name, sizeof(service_name), "git.felix.%s", bar_name);
+  if (written < 0 || (size_t)written >= sizeof(service_name)) return MACH_PORT_NULL;
+  if (g_service_port != MACH_PORT_NULL && strcmp(service_name, g_service_name) == 0) {
+    return g_service_port;
+  }
+  mach_release_service_port();
+
+  mach_port_t bootstrap_port = MACH_PORT_NULL;
+  if (task_get_special_port(mach_task_self(), TASK_BOOTSTRAP_PORT, &bootstrap_port)
+      != KERN_SUCCESS) {
+    return MACH_PORT_NULL;
+  }
+  mach_port_t port = MACH_PORT_NULL;
+  kern_return_t result = bootstrap_look_up(bootstrap_port, service_name, &port);
+  mach_port_deallocate(mach_task_self(), bootstrap_port);
+  if (result != KERN_SUCCESS) return MACH_PORT_NULL;
+
+  g_service_port = port;
+  memcpy(g_service_name, service_name, (size_t)written + 1);
+  return port;
+}
+
+static mach_port_t mach_reply_port(void) {
+  if (g_reply_port != MACH_PORT_NULL) return g_reply_port;
+  mach_port_name_t task = mach_task_self();
+  mach_port_t port = MACH_PORT_NULL;
+  if (mach_port_allocate(task, MACH_PORT_RIGHT_RECEIVE, &port) != KERN_SUCCESS) {
+    return MACH_PORT_NULL;
+  }
+  if (mach_port_insert_right(task, port, port, MACH_MSG_TYPE_MAKE_SEND) != KERN_SUCCESS) {
+    mach_port_mod_refs(task, port, MACH_PORT_RIGHT_RECEIVE, -1);
+    return MACH_PORT_NULL;
+  }
+  g_reply_port = port;
+  return port;
+}
+
+static BaristaSendResult mach_send(const void *payload, size_t length, int timeout_ms) {
+  mach_msg_timeout_t send_timeout = BARISTA_TRANSPORT_SEND_TIMEOUT_MS;
+  if (timeout_ms > 0 && (mach_msg_timeout_t)timeout_ms < send_timeout) {
+    send_timeout = (mach_msg_timeout_t)timeout_ms;
+  }
+
+  for (int attempt = 0; attempt < 2; attempt++) {
+    mach_port_t port = mach_service_port();
+    if (port == MACH_PORT_NULL) continue;
+    mach_port_t response_port = MACH_PORT_NULL;
+    if (timeout_ms > 0) {
+      response_port = mach_reply_port();
+      if (response_port == MACH_PORT_NULL) return BARISTA_SEND_NOT_SENT;
+    }
+
+    struct barista_mach_message message = {0};
+    message.header.msgh_remote_port = port;
+    message.header.msgh_local_port = response_port;
+    message.header.msgh_id = response_port;
+    message.header.msgh_bits = MACH_MSGH_BITS_SET(
+      MACH_MSG_TYPE_COPY_SEND,
+      response_port != MACH_PORT_NULL ? MACH_MSG_TYPE_MAKE_SEND : 0,
+      0,
+      MACH_MSGH_BITS_COMPLEX);
+    message.header.msgh_size = sizeof(message);
+    message.descriptor_count = 1;
+    message.descriptor.address = (void *)payload;
+    message.descriptor.size = (mach_msg_size_t)length;
+    message.descriptor.copy = MACH_MSG_VIRTUAL_COPY;
+    message.descriptor.deallocate = false;
+    message.descriptor.type = MACH_MSG_OOL_DESCRIPTOR;
+
+    mach_msg_return_t result = mach_msg(&message.header,
+                                        MACH_SEND_MSG | MACH_SEND_TIMEOUT,
+                                        sizeof(message),
+                                        0,
+                                        MACH_PORT_NULL,
+                                        send_timeout,
+                                        MACH_PORT_NULL);
+    if (result != MACH_MSG_SUCCESS) {
+      /* The bar may have restarted under a new port; look it up again. */
+      mach_release_service_port();
+      mach_release_reply_port();
+      continue;
+    }
+    if (response_port == MACH_PORT_NULL) return BARISTA_SEND_SENT_UNCONFIRMED;
+
+    struct barista_mach_buffer buffer = {0};
+    result = mach_msg(&buffer.message.header,
+                      MACH_RCV_MSG | MACH_RCV_TIMEOUT,
+                      0,
+                      sizeof(buffer),
+                      response_port,
+                      (mach_msg_timeout_t)timeout_ms,
+                      MACH_PORT_NULL);
+    if (result != MACH_MSG_SUCCESS) {
+      /* A late reply must not answer the next request on a reused port. */
+      mach_release_reply_port();
+      return BARISTA_SEND_SENT_UNCONFIRMED;
+    }
+
+    BaristaSendResult dispatch_result = BARISTA_SEND_SENT_UNCONFIRMED;
+    mach_msg_ool_descriptor_t descriptor = buffer.message.descriptor;
+    if (buffer.message.descriptor_count == 1
+        && descriptor.type == MACH_MSG_OOL_DESCRIPTOR
+        && descriptor.address != NULL
+        && descriptor.size > 0
+        && descriptor.size <= BARISTA_TRANSPORT_MAX_RESPONSE_BYTES) {
+      int status = barista_response_status(descriptor.address, descriptor.size);
+      if (status > 0) dispatch_result = BARISTA_SEND_CONFIRMED_SUCCESS;
+      else if (status == 0) dispatch_result = BARISTA_SEND_CONFIRMED_ERROR;
+    }
+    mach_msg_destroy(&buffer.message.header);
+    return dispatch_result;
+  }
+  return BARISTA_SEND_NOT_SENT;
+}
+#endif
+
+BaristaSendResult barista_send(const void *payload, size_t length, int timeout_ms) {
+  if (!barista_payload_valid(payload, length)) return BARISTA_SEND_NOT_SENT;
+  if (timeout_ms < 0) timeout_ms = BARISTA_TRANSPORT_DEFAULT_TIMEOUT_MS;
+  record_payload(payload, length, timeout_ms);
+
+  BaristaSendResult result = bus_send(payload, length, timeout_ms);
+  if (result != BARISTA_SEND_NOT_SENT) return result;
+  return barista_send_direct(payload, length, timeout_ms);
+}
+
+BaristaSendResult barista_send_direct(const void *payload, size_t length, int timeout_ms) {
+  if (!barista_payload_valid(payload, length)) return BARISTA_SEND_NOT_SENT;
+  if (timeout_ms < 0) timeout_ms = BARISTA_TRANSPORT_DEFAULT_TIMEOUT_MS;
+
+  const char *path = configured_socket_path();
+  if (path) return socket_send(&g_direct, path, payload, length, timeout_ms);
+#ifdef __APPLE__
+  return mach_send(payload, length, timeout_ms);
+#else
+  return BARISTA_SEND_NOT_SENT;
+#endif
+}
+
+void barista_transport_reset(void) {
+  socket_release(&g_direct);
+  socket_release(&g_bus);
+  g_bus.retry_after = 0;
+#ifdef __APPLE__
+  mach_release_service_port();
+  mach_release_reply_port();
+#endif
+}
+
+int barista_transport_probe(void) {
+  barista_transport_reset();
+  const char *path = configured_socket_path();
+  if (path) return socket_connection(&g_direct, path) >= 0;
+#ifdef __APPLE__
+  return mach_service_port() != MACH_PORT_NULL;
+#else
+  return 0;
+#endif
+}
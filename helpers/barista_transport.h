@@ -0,0 +1,130 @@
+#pragma once
+
+/*
+ * Barista Transport
+ *
+ * One SketchyBar request path shared by every native helper. A request is the
+ * NUL-separated token payload SketchyBar's own CLI builds: each argument ends
+ * in one NUL byte and the payload ends with an extra NUL.
+ *
+ * Backends:
+ *   mach   - the git.felix.<BAR_NAME> bootstrap service (macOS default).
+ *   socket - a Unix-domain stream socket named by BARISTA_TRANSPORT_SOCKET.
+ *            This lets the same send path run against a local stand-in
+ *            server on Linux for tests and benchmarks.
+ *
+ * The service port (or socket connection) and the reply port are cached for
+ * the lifetime of the process, so repeated sends skip the bootstrap lookup
+ * and the reply-port allocation.
+ *
+ * When barista_busd is listening, barista_send() hands the payload to it
+ * instead so updates from every helper coalesce into one request per frame.
+ * The bus socket defaults to $TMPDIR/barista_busd.<BAR_NAME>.sock, can be
+ * moved with BARISTA_BUSD_SOCKET, and is skipped with BARISTA_BUSD_DISABLE=1.
+ *
+ * Record mode: when BARISTA_RECORD_PATH names a file, barista_send() appends
+ * every valid payload to it before sending, stamped with CLOCK_MONOTONIC, the
+ * process id and the timeout. Each record is one O_APPEND write, so helpers
+ * running at the same time can share one session file. barista_replay plays
+ * a session back.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BARISTA_TRANSPORT_MAX_PAYLOAD_BYTES (64 * 1024)
+#define BARISTA_TRANSPORT_MAX_RESPONSE_BYTES (64 * 1024)
+#define BARISTA_TRANSPORT_SEND_TIMEOUT_MS 50
+#define BARISTA_TRANSPORT_DEFAULT_TIMEOUT_MS 150
+
+/* Socket frames: a 4-byte big-endian length, 4-byte big-endian flags, then
+ * the payload. Replies use the same header with the response bytes. */
+#define BARISTA_FRAME_HEADER_BYTES 8
+#define BARISTA_FRAME_NO_REPLY 0x1u
+/* Reply flag: the request was not applied, so the client may still fall back. */
+#define BARISTA_FRAME_NOT_DELIVERED 0x2u
+
+typedef enum {
+  BARISTA_SEND_NOT_SENT,
+  BARISTA_SEND_CONFIRMED_SUCCESS,
+  BARISTA_SEND_SENT_UNCONFIRMED,
+  BARISTA_SEND_CONFIRMED_ERROR,
+} BaristaSendResult;
+
+typedef enum {
+  BARISTA_TRANSPORT_NONE,
+  BARISTA_TRANSPORT_MACH,
+  BARISTA_TRANSPORT_SOCKET,
+} BaristaTransportBackend;
+
+/* Backend the next barista_send() would use for the current environment. */
+BaristaTransportBackend barista_transport_backend(void);
+
+/*
+ * Send one finished payload. timeout_ms bounds the wait for SketchyBar's
+ * reply; 0 sends without waiting and reports BARISTA_SEND_SENT_UNCONFIRMED,
+ * and a negative value uses BARISTA_TRANSPORT_DEFAULT_TIMEOUT_MS.
+ * A request that reached the bar is never resent, so callers can safely
+ * fall back to the CLI only on BARISTA_SEND_NOT_SENT.
+ */
+BaristaSendResult barista_send(const void *payload, size_t length, int timeout_ms);
+
+/* barista_send() without the bus hop; barista_busd uses it to reach the bar. */
+BaristaSendResult barista_send_direct(const void *payload, size_t length, int timeout_ms);
+
+/* Writes the barista_busd socket path; 0 when the bus is disabled or the path
+ * does not fit a Unix socket address. */
+int barista_bus_socket_path(char *buffer, size_t capacity);
+
+/* Drop the cached service port, reply port and socket connections. */
+void barista_transport_reset(void);
+
+/* Reset, then report whether a fresh lookup or connect reaches the bar
+ * directly, bypassing the bus.
+ * Lets long-running providers tell a busy bar from one that has exited. */
+int barista_transport_probe(void);
+
+/* 1 when the reply is a NUL-terminated success, 0 for "[!]" errors, -1 when
+ * the reply is malformed. */
+int barista_response_status(const void *bytes, size_t size);
+
+/* 1 when the bytes are a non-empty, double-NUL terminated token payload. */
+int barista_payload_valid(const void *payload, size_t length);
+
+/* Frame helpers shared by the socket client and local servers. Both return 0
+ * on success and -1 on I/O failure, timeout or an oversized frame. A negative
+ * timeout waits indefinitely. */
+int barista_frame_write(int fd, const void *bytes, size_t length, uint32_t flags,
+                        int timeout_ms);
+int barista_frame_read(int fd, void *buffer, size_t capacity, size_t *length,
+                       uint32_t *flags, int timeout_ms);
+
+/* Session records: a 4-byte magic, then big-endian payload length, 8-byte
+ * timestamp in nanoseconds, process id and timeout_ms, then the payload. */
+#define BARISTA_RECORD_MAGIC 0x42525231u /* "BRR1" */
+#define BARISTA_RECORD_HEADER_BYTES 24
+
+typedef struct {
+  uint64_t timestamp_ns;
+  uint32_t length;
+  uint32_t pid;
+  int32_t timeout_ms;
+} BaristaRecordHeader;
+
+/* Decodes one record header; -1 on a bad magic or an oversized payload. */
+int barista_record_decode(const void *bytes, BaristaRecordHeader *header);
+
+/* Listening socket for local servers. A stale path is replaced atomically;
+ * -1 with errno EADDRINUSE when another server still answers on it. */
+int barista_socket_listen(const char *path);
+
+/* Non-blocking client connection to a local server, or -1. */
+int barista_socket_connect(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
@@ -7,6 +7,9 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "barista_cli.h"
+#include "barista_payload.h"
+
 #define BUFFER_SIZE 128
 
 // Format: "Day MM/DD HH:MM AM/PM"
@@ -32,9 +35,20 @@ void get_formatted_time(char *buffer, size_t size) {
              am_pm);
 }
 
-int main(int argc, char *argv[]) {
+// --set <name> <property>=<value>, sent natively with a CLI exec fallback
+static void set_property(const char *name, const char *property, const char *value) {
+    uint8_t arena[BUFFER_SIZE * 2];
+    BaristaPayload payload;
+    barista_payload_init(&payload, arena, sizeof(arena));
+    barista_payload_verb(&payload, BARISTA_VERB_SET);
+    barista_payload_token(&payload, name);
+    barista_payload_property(&payload, property, value);
+    size_t length = barista_payload_finish(&payload);
+    if (length > 0) barista_sketchybar(arena, length, 0);
+}
+
+int main(void) {
     char time_str[BUFFER_SIZE];
-    char command[BUFFER_SIZE * 2];
     const char *sender = getenv("SENDER");
     const char *name = getenv("NAME");
 
@@ -44,9 +58,7 @@ int main(int argc, char *argv[]) {
 
     // Handle mouse.exited.global event
     if (sender && strcmp(sender, "mouse.exited.global") == 0) {
-        snprintf(command, sizeof(command),
-                 "sketchybar --set %s popup.drawing=off", name);
-        system(command);
+        set_property(name, "popup.drawing", "off");
         return 0;
     }
 
@@ -54,9 +66,7 @@ int main(int argc, char *argv[]) {
     get_formatted_time(time_str, sizeof(time_str));
 
     // Update sketchybar
-    snprintf(command, sizeof(command),
-             "sketchybar --set %s label=\"%s\"", name, time_str);
-    system(command);
+    set_property(name, "label", time_str);
 
     return 0;
 }
@@ -1,58 +1,219 @@
-#include <mach/mach.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <string.h>
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#else
+#include "../proc_scan.h"
+#endif
+
+// Loads for the whole machine and for each core, from tick deltas between
+// two samples. Backends fill cpu->ticks: row 0 is the aggregate, row 1 + n
+// is core n.
+//   macOS - host_statistics(HOST_CPU_LOAD_INFO) and
+//           host_processor_info(PROCESSOR_CPU_LOAD_INFO); no iowait.
+//   Linux - /proc/stat through a persistent descriptor (see proc_scan.h).
+// Nice time counts as user time on both.
+
+#define CPU_MAX_CORES 256
+
+struct cpu_ticks {
+  uint64_t user;
+  uint64_t sys;
+  uint64_t iowait;
+  uint64_t idle;
+  uint64_t other;
+};
+
+struct cpu_load {
+  int user;
+  int sys;
+  int iowait;
+  int total;
+};
 
 struct cpu {
+#ifdef __APPLE__
   host_t host;
-  mach_msg_type_number_t count;
-  host_cpu_load_info_data_t load;
-  host_cpu_load_info_data_t prev_load;
+#else
+  struct proc_file stat;
+#endif
+  int core_count;
+  struct cpu_ticks ticks[CPU_MAX_CORES + 1];
+  struct cpu_ticks prev_ticks[CPU_MAX_CORES + 1];
   bool has_prev_load;
 
   int user_load;
   int sys_load;
+  int iowait_load;
   int total_load;
+  struct cpu_load cores[CPU_MAX_CORES];
 };
 
+#ifdef __APPLE__
+// Mach tick counters are 32 bits wide and wrap.
+static inline uint64_t cpu_tick_delta(uint64_t now, uint64_t prev) {
+  return (uint32_t)(now - prev);
+}
+
+static inline void cpu_store_ticks(struct cpu_ticks* ticks, const natural_t* state) {
+  ticks->user = state[CPU_STATE_USER] + (uint64_t)state[CPU_STATE_NICE];
+  ticks->sys = state[CPU_STATE_SYSTEM];
+  ticks->iowait = 0;
+  ticks->idle = state[CPU_STATE_IDLE];
+  ticks->other = 0;
+}
+
 static inline void cpu_init(struct cpu* cpu) {
   cpu->host = mach_host_self();
-  cpu->count = HOST_CPU_LOAD_INFO_COUNT;
+  cpu->core_count = 0;
   cpu->has_prev_load = false;
+  cpu->user_load = cpu->sys_load = cpu->iowait_load = cpu->total_load = 0;
 }
 
-static inline void cpu_update(struct cpu* cpu) {
-  kern_return_t error = host_statistics(cpu->host,
-                                        HOST_CPU_LOAD_INFO,
-                                        (host_info_t)&cpu->load,
-                                        &cpu->count                );
+static inline bool cpu_read_ticks(struct cpu* cpu) {
+  host_cpu_load_info_data_t load;
+  mach_msg_type_number_t count = HOST_CPU_LOAD_INFO_COUNT;
+  if (host_statistics(cpu->host, HOST_CPU_LOAD_INFO, (host_info_t)&load, &count)
+      != KERN_SUCCESS) {
+    return false;
+  }
+  cpu_store_ticks(&cpu->ticks[0], load.cpu_ticks);
 
-  if (error != KERN_SUCCESS) {
-    printf("Error: Could not read cpu host statistics.\n");
-    return;
+  natural_t processor_count = 0;
+  processor_info_array_t info = NULL;
+  mach_msg_type_number_t info_count = 0;
+  cpu->core_count = 0;
+  if (host_processor_info(cpu->host, PROCESSOR_CPU_LOAD_INFO, &processor_count,
+                          &info, &info_count) == KERN_SUCCESS) {
+    processor_cpu_load_info_t cores = (processor_cpu_load_info_t)info;
+    for (natural_t i = 0; i < processor_count && i < CPU_MAX_CORES; i++) {
+      cpu_store_ticks(&cpu->ticks[1 + i], cores[i].cpu_ticks);
+    }
+    cpu->core_count = processor_count < CPU_MAX_CORES ? (int)processor_count : CPU_MAX_CORES;
+    vm_deallocate(mach_task_self(), (vm_address_t)info, info_count * sizeof(integer_t));
   }
+  return true;
+}
+#else
+// The kernel's counters are 64 bits; one that went backwards belongs to a
+// core that went offline and came back.
+static inline uint64_t cpu_tick_delta(uint64_t now, uint64_t prev) {
+  return now >= prev ? now - prev : 0;
+}
 
-  if (cpu->has_prev_load) {
-    uint32_t delta_user = cpu->load.cpu_ticks[CPU_STATE_USER]
-                          - cpu->prev_load.cpu_ticks[CPU_STATE_USER];
+static inline bool cpu_init_path(struct cpu* cpu, const char* path) {
+  cpu->core_count = 0;
+  cpu->has_prev_load = false;
+  cpu->user_load = cpu->sys_load = cpu->iowait_load = cpu->total_load = 0;
+  return proc_file_open(&cpu->stat, path) == 0;
+}
 
-    uint32_t delta_system = cpu->load.cpu_ticks[CPU_STATE_SYSTEM]
-                            - cpu->prev_load.cpu_ticks[CPU_STATE_SYSTEM];
+static inline void cpu_init(struct cpu* cpu) {
+  cpu_init_path(cpu, "/proc/stat");
+}
 
-    uint32_t delta_idle = cpu->load.cpu_ticks[CPU_STATE_IDLE]
-                          - cpu->prev_load.cpu_ticks[CPU_STATE_IDLE];
+// "cpu  user nice system idle iowait irq softirq steal guest guest_nice",
+// then one "cpuN" row per online core. Guest time is already in user.
+static inline bool cpu_read_ticks(struct cpu* cpu) {
+  if (proc_file_read(&cpu->stat) != 0) return false;
+  struct proc_scanner scanner = proc_scan_begin(&cpu->stat);
+  bool found = false;
+  int core_count = 0;
+  do {
+    const char* word = NULL;
+    size_t length = proc_scan_word(&scanner, &word);
+    if (length < 3 || memcmp(word, "cpu", 3) != 0) break;
 
-    cpu->user_load = (double)delta_user / (double)(delta_system
-                                                     + delta_user
-                                                     + delta_idle) * 100.0;
+    int row = 0;
+    if (length > 3) {
+      uint64_t core = 0;
+      for (size_t i = 3; i < length; i++) {
+        if (word[i] < '0' || word[i] > '9') return false;
+        core = core * 10 + (uint64_t)(word[i] - '0');
+      }
+      if (core >= CPU_MAX_CORES) continue;
+      row = 1 + (int)core;
+      if ((int)core + 1 > core_count) core_count = (int)core + 1;
+    }
 
-    cpu->sys_load = (double)delta_system / (double)(delta_system
-                                                      + delta_user
-                                                      + delta_idle) * 100.0;
+    uint64_t field[8] = { 0 };
+    int fields = 0;
+    while (fields < 8 && proc_scan_u64(&scanner, &field[fields])) fields++;
+    if (fields < 4) return false;
+    struct cpu_ticks* ticks = &cpu->ticks[row];
+    ticks->user = field[0] + field[1];
+    ticks->sys = field[2] + field[5] + field[6];
+    ticks->idle = field[3];
+    ticks->iowait = field[4];
+    ticks->other = field[7];
+    if (row == 0) found = true;
+  } while (proc_scan_next_line(&scanner));
 
-    cpu->total_load = cpu->user_load + cpu->sys_load;
+  // Cores that are offline now have no row; forget their old ticks.
+  for (int i = core_count; i < cpu->core_count; i++) {
+    memset(&cpu->ticks[1 + i], 0, sizeof(cpu->ticks[0]));
+    memset(&cpu->prev_ticks[1 + i], 0, sizeof(cpu->prev_ticks[0]));
   }
+  cpu->core_count = core_count;
+  return found;
+}
+#endif
+
+static inline struct cpu_load cpu_load_between(const struct cpu_ticks* prev,
+                                               const struct cpu_ticks* now) {
+  struct cpu_load load = { 0, 0, 0, 0 };
+  uint64_t user = cpu_tick_delta(now->user, prev->user);
+  uint64_t sys = cpu_tick_delta(now->sys, prev->sys);
+  uint64_t iowait = cpu_tick_delta(now->iowait, prev->iowait);
+  uint64_t total = user + sys + iowait
+                   + cpu_tick_delta(now->idle, prev->idle)
+                   + cpu_tick_delta(now->other, prev->other);
+  if (total == 0) return load;
 
-  cpu->prev_load = cpu->load;
+  load.user = (int)((double)user / (double)total * 100.0);
+  load.sys = (int)((double)sys / (double)total * 100.0);
+  load.iowait = (int)((double)iowait / (double)total * 100.0);
+  load.total = load.user + load.sys;
+  return load;
+}
+
+static inline void cpu_update(struct cpu* cpu) {
+  if (!cpu_read_ticks(cpu)) {
+    printf("Error: Could not read cpu statistics.\n");
+    return;
+  }
+
+  if (cpu->has_prev_load) {
+    struct cpu_load load = cpu_load_between(&cpu->prev_ticks[0], &cpu->ticks[0]);
+    cpu->user_load = load.user;
+    cpu->sys_load = load.sys;
+    cpu->iowait_load = load.iowait;
+    cpu->total_load = load.total;
+    for (int i = 0; i < cpu->core_count; i++) {
+      cpu->cores[i] = cpu_load_between(&cpu->prev_ticks[1 + i], &cpu->ticks[1 + i]);
+    }
+  }
+
+  memcpy(cpu->prev_ticks, cpu->ticks, sizeof(cpu->ticks[0]) * (size_t)(cpu->core_count + 1));
   cpu->has_prev_load = true;
 }
+
+// Comma-separated total load per core, e.g. "12,3,87,5". Stops at the last
+// core that fits.
+static inline void cpu_format_core_loads(const struct cpu* cpu, char* buffer, size_t size) {
+  if (size == 0) return;
+  size_t used = 0;
+  buffer[0] = '\0';
+  for (int i = 0; i < cpu->core_count; i++) {
+    int written = snprintf(buffer + used, size - used, i ? ",%d" : "%d", cpu->cores[i].total);
+    if (written < 0 || (size_t)written >= size - used) {
+      buffer[used] = '\0';
+      break;
+    }
+    used += (size_t)written;
+  }
+}
@@ -1,10 +1,20 @@
+#define _DEFAULT_SOURCE 1
+
 #include "cpu.h"
 #include "../sketchybar.h"
 
 int main (int argc, char** argv) {
   float update_freq;
-  if (argc < 3 || (sscanf(argv[2], "%f", &update_freq) != 1)) {
-    printf("Usage: %s \"<event-name>\" \"<event_freq>\"\n", argv[0]);
+  struct sketchybar_schedule schedule;
+  int valid = argc >= 3 && sscanf(argv[2], "%f", &update_freq) == 1;
+  if (valid) {
+    // Tick on wall-clock multiples of the frequency
+    sketchybar_schedule_init(&schedule, update_freq);
+    valid = sketchybar_schedule_parse(&schedule, argc, argv, 3);
+  }
+  if (!valid) {
+    printf("Usage: %s \"<event-name>\" \"<event_freq>\" "
+           "[--adaptive DELTA_PERCENT] [--max-interval SECONDS]\n", argv[0]);
     exit(1);
   }
 
@@ -13,29 +23,39 @@ int main (int argc, char** argv) {
   cpu_init(&cpu);
 
   // Setup the event in sketchybar
-  char event_message[512];
-  snprintf(event_message, 512, "--add event '%s'", argv[1]);
-  sketchybar(event_message);
+  sketchybar_add_event(argv[1]);
+
+  // Sample on our own schedule even when the bar falls behind
+  sketchybar_async_start((int)(update_freq * 1000));
+
+  // Loads in the order of the local `loads` array below
+  const char* history_names[] = { "user_load", "sys_load", "iowait_load", "total_load" };
+  BaristaHistory* history = sketchybar_history_create(argv[1], 4, history_names);
 
-  char trigger_message[512];
+  const char* names[6] = { "user_load", "sys_load", "total_load", "iowait_load", "core_loads" };
+  char user_load[16], sys_load[16], total_load[16], iowait_load[16], core_loads[512];
+  const char* values[6] = { user_load, sys_load, total_load, iowait_load, core_loads };
   for (;;) {
     // Acquire new info
+    bool primed = cpu.has_prev_load;
     cpu_update(&cpu);
+    double loads[] = { cpu.user_load, cpu.sys_load, cpu.iowait_load, cpu.total_load };
+    sketchybar_schedule_adapt(&schedule, loads, 4);
+    if (primed) sketchybar_history_append(history, loads);
 
-    // Prepare the event message
-    snprintf(trigger_message,
-             512,
-             "--trigger '%s' user_load='%d' sys_load='%02d' total_load='%02d'",
-             argv[1],
-             cpu.user_load,
-             cpu.sys_load,
-             cpu.total_load                                        );
+    // Prepare the event variables
+    snprintf(user_load, sizeof(user_load), "%d", cpu.user_load);
+    snprintf(sys_load, sizeof(sys_load), "%02d", cpu.sys_load);
+    snprintf(total_load, sizeof(total_load), "%02d", cpu.total_load);
+    snprintf(iowait_load, sizeof(iowait_load), "%02d", cpu.iowait_load);
+    cpu_format_core_loads(&cpu, core_loads, sizeof(core_loads));
 
-    // Trigger the event
-    sketchybar(trigger_message);
+    // Trigger the event unless nothing changed since the last tick
+    int count = sketchybar_schedule_variable(&schedule, 5, names, values);
+    sketchybar_trigger(argv[1], count, names, values);
 
-    // Wait
-    usleep(update_freq * 1000000);
+    // Wait for the next tick
+    sketchybar_schedule_wait(&schedule);
   }
   return 0;
 }
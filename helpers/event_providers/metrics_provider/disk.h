@@ -0,0 +1,34 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/statvfs.h>
+
+struct disk {
+  char path[256];
+
+  uint64_t free_bytes;
+  int used_percent;
+};
+
+static inline void disk_init(struct disk* disk, const char* path) {
+  snprintf(disk->path, sizeof(disk->path), "%s", path);
+  disk->free_bytes = 0;
+  disk->used_percent = 0;
+}
+
+// Matches df: "used" is blocks in use, measured against what unprivileged
+// users can reach (used + available), not the raw volume size.
+static inline void disk_update(struct disk* disk) {
+  struct statvfs fs;
+  if (statvfs(disk->path, &fs) != 0) {
+    printf("Error: Could not stat %s.\n", disk->path);
+    return;
+  }
+
+  uint64_t block = fs.f_frsize ? fs.f_frsize : fs.f_bsize;
+  uint64_t used = (uint64_t)(fs.f_blocks - fs.f_bfree) * block;
+  uint64_t available = (uint64_t)fs.f_bavail * block;
+  disk->free_bytes = available;
+  disk->used_percent = used + available > 0
+                       ? (int)((double)used / (double)(used + available) * 100.0 + 0.5)
+                       : 0;
+}
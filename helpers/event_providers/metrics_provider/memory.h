@@ -0,0 +1,105 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#include <sys/sysctl.h>
+#else
+#include "../proc_scan.h"
+#endif
+
+// Memory in use and its share of physical memory.
+//   macOS - host_statistics64(HOST_VM_INFO64), counted the way Activity
+//           Monitor's "Memory Used" does: app (active minus purgeable),
+//           wired and compressed pages.
+//   Linux - MemTotal minus MemAvailable from /proc/meminfo through a
+//           persistent descriptor (see proc_scan.h).
+
+struct memory {
+#ifdef __APPLE__
+  host_t host;
+  vm_size_t page_size;
+#else
+  struct proc_file meminfo;
+#endif
+  uint64_t total_bytes;
+
+  uint64_t used_bytes;
+  int used_percent;
+};
+
+#ifdef __APPLE__
+static inline void memory_init(struct memory* mem) {
+  mem->host = mach_host_self();
+  mem->used_bytes = 0;
+  mem->used_percent = 0;
+
+  size_t size = sizeof(mem->total_bytes);
+  if (sysctlbyname("hw.memsize", &mem->total_bytes, &size, NULL, 0) != 0) {
+    mem->total_bytes = 0;
+  }
+  if (host_page_size(mem->host, &mem->page_size) != KERN_SUCCESS) {
+    mem->page_size = 4096;
+  }
+}
+
+static inline int memory_read(struct memory* mem) {
+  vm_statistics64_data_t vm;
+  mach_msg_type_number_t count = HOST_VM_INFO64_COUNT;
+  kern_return_t error = host_statistics64(mem->host,
+                                          HOST_VM_INFO64,
+                                          (host_info64_t)&vm,
+                                          &count);
+  if (error != KERN_SUCCESS || mem->total_bytes == 0) return 0;
+
+  uint64_t app_pages = vm.active_count > vm.purgeable_count
+                       ? vm.active_count - vm.purgeable_count : 0;
+  uint64_t used_pages = app_pages + vm.wire_count + vm.compressor_page_count;
+  mem->used_bytes = used_pages * (uint64_t)mem->page_size;
+  return 1;
+}
+#else
+static inline void memory_init_path(struct memory* mem, const char* path) {
+  mem->total_bytes = 0;
+  mem->used_bytes = 0;
+  mem->used_percent = 0;
+  proc_file_open(&mem->meminfo, path);
+}
+
+static inline void memory_init(struct memory* mem) {
+  memory_init_path(mem, "/proc/meminfo");
+}
+
+// "MemTotal:  16318480 kB" rows; MemAvailable is the third.
+static inline int memory_read(struct memory* mem) {
+  if (proc_file_read(&mem->meminfo) != 0) return 0;
+  struct proc_scanner scanner = proc_scan_begin(&mem->meminfo);
+  uint64_t total_kb = 0;
+  uint64_t available_kb = 0;
+  int found = 0;
+  do {
+    const char* key = NULL;
+    size_t length = proc_scan_word(&scanner, &key);
+    uint64_t* target = NULL;
+    if (length == 8 && memcmp(key, "MemTotal", 8) == 0) target = &total_kb;
+    else if (length == 12 && memcmp(key, "MemAvailable", 12) == 0) target = &available_kb;
+    if (!target || !proc_scan_char(&scanner, ':')) continue;
+    if (!proc_scan_u64(&scanner, target)) return 0;
+    if (++found == 2) break;
+  } while (proc_scan_next_line(&scanner));
+  if (found < 2 || total_kb == 0 || available_kb > total_kb) return 0;
+
+  mem->total_bytes = total_kb * 1024;
+  mem->used_bytes = (total_kb - available_kb) * 1024;
+  return 1;
+}
+#endif
+
+static inline void memory_update(struct memory* mem) {
+  if (!memory_read(mem)) {
+    printf("Error: Could not read memory statistics.\n");
+    return;
+  }
+  mem->used_percent = (int)((double)mem->used_bytes / (double)mem->total_bytes * 100.0);
+}
@@ -0,0 +1,211 @@
+#define _DEFAULT_SOURCE 1
+
+#include <unistd.h>
+#include "../cpu_load/cpu.h"
+#include "../network_load/network.h"
+#include "memory.h"
+#include "disk.h"
+#include "../sketchybar.h"
+
+// One process samples every metric on a shared base tick and sends a single
+// combined trigger, instead of one process, one wakeup and one message per
+// metric. Each metric runs every N base ticks (0 turns it off). A tick that
+// sampled anything sends the latest value of every metric, so a queued
+// trigger the next one supersedes never takes another metric's value with it.
+//
+// Trigger variables keep the names cpu_load and network_load use, so their
+// subscribers can move to the combined event unchanged:
+//   user_load sys_load total_load   cpu
+//   iowait_load core_loads         cpu (core_loads: "12,3,87,5")
+//   upload download                 network (needs --interface; "default"
+//                                   follows the default route, "all" sums
+//                                   every up interface)
+//   mem_used_percent mem_used       memory
+//   disk_used_percent disk_free     disk (--disk-path, default /)
+//
+// Each metric also keeps a history ring named <event>.cpu, <event>.network,
+// <event>.memory and <event>.disk (see barista_history.h).
+
+struct metric_intervals {
+  int cpu;
+  int network;
+  int memory;
+  int disk;
+};
+
+static int parse_interval(const char* value, int* interval) {
+  char* end = NULL;
+  long parsed = strtol(value, &end, 10);
+  if (!end || *end != '\0' || parsed < 0 || parsed > 3600) return 0;
+  *interval = (int)parsed;
+  return 1;
+}
+
+static int due(int interval, uint64_t tick) {
+  return interval > 0 && tick % (uint64_t)interval == 0;
+}
+
+static void format_bytes(char* buffer, size_t size, uint64_t bytes) {
+  double gigabytes = (double)bytes / 1e9;
+  if (gigabytes >= 100.0) snprintf(buffer, size, "%.0fG", gigabytes);
+  else snprintf(buffer, size, "%.1fG", gigabytes);
+}
+
+static BaristaHistory* history_create(const char* event, const char* metric, int interval,
+                                      uint32_t field_count, const char* const names[]) {
+  if (interval == 0) return NULL;
+  char series[128];
+  snprintf(series, sizeof(series), "%s.%s", event, metric);
+  return sketchybar_history_create(series, field_count, names);
+}
+
+static void usage(const char* program) {
+  printf("Usage: %s \"<event-name>\" \"<tick_freq>\" [--cpu N] [--memory N] "
+         "[--disk N] [--disk-path PATH] [--interface IFACE] [--network N]\n"
+         "N counts base ticks between samples; 0 disables the metric.\n",
+         program);
+}
+
+int main (int argc, char** argv) {
+  float update_freq;
+  if (argc < 3 || (sscanf(argv[2], "%f", &update_freq) != 1) || update_freq <= 0) {
+    usage(argv[0]);
+    exit(1);
+  }
+  const char* event = argv[1];
+
+  struct metric_intervals every = { .cpu = 1, .network = 1, .memory = 1, .disk = 10 };
+  const char* interface = NULL;
+  const char* disk_path = "/";
+  for (int i = 3; i < argc; i++) {
+    int ok = i + 1 < argc;
+    if (ok && strcmp(argv[i], "--cpu") == 0) ok = parse_interval(argv[++i], &every.cpu);
+    else if (ok && strcmp(argv[i], "--network") == 0) ok = parse_interval(argv[++i], &every.network);
+    else if (ok && strcmp(argv[i], "--memory") == 0) ok = parse_interval(argv[++i], &every.memory);
+    else if (ok && strcmp(argv[i], "--disk") == 0) ok = parse_interval(argv[++i], &every.disk);
+    else if (ok && strcmp(argv[i], "--disk-path") == 0) disk_path = argv[++i];
+    else if (ok && strcmp(argv[i], "--interface") == 0) interface = argv[++i];
+    else ok = 0;
+    if (!ok) {
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+  if (!interface) every.network = 0;
+
+  alarm(0);
+  struct cpu cpu;
+  cpu_init(&cpu);
+  struct network network;
+  if (every.network) network_init(&network, interface);
+  struct memory memory;
+  memory_init(&memory);
+  struct disk disk;
+  disk_init(&disk, disk_path);
+
+  // Setup the event in sketchybar
+  sketchybar_add_event(event);
+
+  // Sample on our own schedule even when the bar falls behind
+  sketchybar_async_start((int)(update_freq * 1000));
+
+  // Base ticks land on wall-clock multiples of the frequency
+  struct sketchybar_schedule schedule;
+  sketchybar_schedule_init(&schedule, update_freq);
+
+  const char* cpu_fields[] = { "user_load", "sys_load", "iowait_load", "total_load" };
+  const char* network_fields[] = { "upload", "download" };
+  const char* memory_fields[] = { "used_percent", "used_bytes" };
+  const char* disk_fields[] = { "used_percent", "free_bytes" };
+  BaristaHistory* cpu_history = history_create(event, "cpu", every.cpu, 4, cpu_fields);
+  BaristaHistory* network_history = history_create(event, "network", every.network, 2,
+                                                   network_fields);
+  BaristaHistory* memory_history = history_create(event, "memory", every.memory, 2,
+                                                  memory_fields);
+  BaristaHistory* disk_history = history_create(event, "disk", every.disk, 2, disk_fields);
+
+  char user_load[16], sys_load[16], total_load[16], iowait_load[16], core_loads[512];
+  char upload[32], download[32];
+  char mem_used_percent[16], mem_used[16];
+  char disk_used_percent[16], disk_free[16];
+  const char* names[SKETCHYBAR_TRIGGER_MAX_VARIABLES];
+  const char* values[SKETCHYBAR_TRIGGER_MAX_VARIABLES];
+  bool have_cpu = false, have_network = false, have_memory = false, have_disk = false;
+  for (uint64_t tick = 0;; tick++) {
+    bool sampled = false;
+
+    // The first CPU and network samples only set the baseline for the
+    // deltas, so they have nothing to report yet.
+    if (due(every.cpu, tick)) {
+      bool primed = cpu.has_prev_load;
+      cpu_update(&cpu);
+      if (primed) {
+        snprintf(user_load, sizeof(user_load), "%d", cpu.user_load);
+        snprintf(sys_load, sizeof(sys_load), "%02d", cpu.sys_load);
+        snprintf(total_load, sizeof(total_load), "%02d", cpu.total_load);
+        snprintf(iowait_load, sizeof(iowait_load), "%02d", cpu.iowait_load);
+        cpu_format_core_loads(&cpu, core_loads, sizeof(core_loads));
+        double loads[] = { cpu.user_load, cpu.sys_load, cpu.iowait_load, cpu.total_load };
+        sketchybar_history_append(cpu_history, loads);
+        have_cpu = sampled = true;
+      }
+    }
+
+    if (due(every.network, tick) && network_update(&network)) {
+      snprintf(upload, sizeof(upload), "%03d%s", network.up, unit_str[network.up_unit]);
+      snprintf(download, sizeof(download), "%03d%s", network.down, unit_str[network.down_unit]);
+      double rates[] = { network.up_rate, network.down_rate };
+      sketchybar_history_append(network_history, rates);
+      have_network = sampled = true;
+    }
+
+    if (due(every.memory, tick)) {
+      memory_update(&memory);
+      snprintf(mem_used_percent, sizeof(mem_used_percent), "%02d", memory.used_percent);
+      format_bytes(mem_used, sizeof(mem_used), memory.used_bytes);
+      double used[] = { memory.used_percent, (double)memory.used_bytes };
+      sketchybar_history_append(memory_history, used);
+      have_memory = sampled = true;
+    }
+
+    if (due(every.disk, tick)) {
+      disk_update(&disk);
+      snprintf(disk_used_percent, sizeof(disk_used_percent), "%02d", disk.used_percent);
+      format_bytes(disk_free, sizeof(disk_free), disk.free_bytes);
+      double space[] = { disk.used_percent, (double)disk.free_bytes };
+      sketchybar_history_append(disk_history, space);
+      have_disk = sampled = true;
+    }
+
+    // One trigger with every metric's latest value, skipped when nothing
+    // changed since the last one
+    if (sampled) {
+      int count = 0;
+      if (have_cpu) {
+        names[count] = "user_load"; values[count++] = user_load;
+        names[count] = "sys_load"; values[count++] = sys_load;
+        names[count] = "total_load"; values[count++] = total_load;
+        names[count] = "iowait_load"; values[count++] = iowait_load;
+        names[count] = "core_loads"; values[count++] = core_loads;
+      }
+      if (have_network) {
+        names[count] = "upload"; values[count++] = upload;
+        names[count] = "download"; values[count++] = download;
+      }
+      if (have_memory) {
+        names[count] = "mem_used_percent"; values[count++] = mem_used_percent;
+        names[count] = "mem_used"; values[count++] = mem_used;
+      }
+      if (have_disk) {
+        names[count] = "disk_used_percent"; values[count++] = disk_used_percent;
+        names[count] = "disk_free"; values[count++] = disk_free;
+      }
+      count = sketchybar_schedule_variable(&schedule, count, names, values);
+      sketchybar_trigger(event, count, names, values);
+    }
+
+    // Wait for the next base tick
+    sketchybar_schedule_wait(&schedule);
+  }
+  return 0;
+}
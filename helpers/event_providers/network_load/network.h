@@ -1,10 +1,45 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <ifaddrs.h>
 #include <math.h>
+#include <net/if.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
-#include <net/if.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
 #include <net/if_mib.h>
+#include <net/route.h>
+#include <netinet/in.h>
 #include <sys/select.h>
 #include <sys/sysctl.h>
+#else
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include "../proc_scan.h"
+#endif
+
+#include "../../barista_route.h"
+
+// Upload and download rates of one interface from its byte counters.
+//   macOS - sysctl IFMIB_IFDATA for the interface's row.
+//   Linux - its /proc/net/dev row through a persistent descriptor (see
+//           proc_scan.h).
+//
+// The interface may also be given as
+//   default - whichever interface carries the IPv4 default route
+//   all     - the sum of every interface that is up, running and not
+//             loopback
+// Membership follows the kernel's route and link notifications (an
+// rtnetlink socket on Linux, the routing socket on macOS) instead of
+// polling: each sample drains the socket without blocking and resolves the
+// interfaces again only when something changed. A change of interfaces
+// restarts the rate baseline, so the switch never reads as a traffic burst.
+
+#define NETWORK_MAX_INTERFACES 16
 
 static char unit_str[3][6] = { { " Bps" }, { "KBps" }, { "MBps" }, };
 
@@ -13,16 +48,64 @@ enum unit {
   UNIT_KBPS,
   UNIT_MBPS
 };
+
+enum network_mode {
+  NETWORK_FIXED,
+  NETWORK_DEFAULT_ROUTE,
+  NETWORK_ALL
+};
+
 struct network {
-  uint32_t row;
+  enum network_mode mode;
+  char members[NETWORK_MAX_INTERFACES][IFNAMSIZ];
+  int member_count;
+  int route_fd;
+  int resolve_pending;
+  uint64_t resolves;
+  int (*default_route)(char* buffer, size_t capacity);
+#ifdef __APPLE__
+  uint32_t rows[NETWORK_MAX_INTERFACES];
   struct ifmibdata data;
-  struct timeval tv_nm1, tv_n, tv_delta;
+#else
+  struct proc_file dev;
+#endif
+  uint64_t ibytes, obytes;
+  uint64_t sampled_ns;
+  double up_rate, down_rate;
 
   int up;
   int down;
   enum unit up_unit, down_unit;
 };
 
+static inline int network_is_member(const struct network* net, const char* name, size_t length) {
+  for (int i = 0; i < net->member_count; i++) {
+    if (strlen(net->members[i]) == length && memcmp(net->members[i], name, length) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Every interface that is up, running and not loopback, in getifaddrs order.
+static inline int network_list_up(char members[][IFNAMSIZ]) {
+  struct ifaddrs* addresses = NULL;
+  if (getifaddrs(&addresses) != 0) return 0;
+  int count = 0;
+  for (struct ifaddrs* entry = addresses; entry && count < NETWORK_MAX_INTERFACES;
+       entry = entry->ifa_next) {
+    unsigned int flags = entry->ifa_flags;
+    if (!(flags & IFF_UP) || !(flags & IFF_RUNNING) || (flags & IFF_LOOPBACK)) continue;
+    int seen = 0;
+    for (int i = 0; i < count && !seen; i++) seen = strcmp(members[i], entry->ifa_name) == 0;
+    if (seen) continue;
+    snprintf(members[count++], IFNAMSIZ, "%s", entry->ifa_name);
+  }
+  freeifaddrs(addresses);
+  return count;
+}
+
+#ifdef __APPLE__
 static inline void ifdata(uint32_t net_row, struct ifmibdata* data) {
 	static size_t size = sizeof(struct ifmibdata);
   static int32_t data_option[] = { CTL_NET, PF_LINK, NETLINK_GENERIC, IFMIB_IFDATA, 0, IFDATA_GENERAL };
@@ -30,61 +113,272 @@ static inline void ifdata(uint32_t net_row, struct ifmibdata* data) {
   sysctl(data_option, 6, data, &size, NULL, 0);
 }
 
-static inline void network_init(struct network* net, char* ifname) {
-  memset(net, 0, sizeof(struct network));
+static inline int network_watch_open(void) {
+  int fd = socket(PF_ROUTE, SOCK_RAW, AF_UNSPEC);
+  if (fd < 0) return -1;
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
 
-  static int count_option[] = { CTL_NET, PF_LINK, NETLINK_GENERIC, IFMIB_SYSTEM, IFMIB_IFCOUNT };
-  uint32_t interface_count = 0;
-  size_t size = sizeof(uint32_t);
-  sysctl(count_option, 5, &interface_count, &size, NULL, 0);
+// Route and link changes; RTM_GET replies (ours included) are echoed to
+// every routing socket and do not count.
+static inline int network_watch_drain(int fd) {
+  char buffer[2048];
+  int changed = 0;
+  for (;;) {
+    ssize_t length = read(fd, buffer, sizeof(buffer));
+    if (length < 0 && errno == EINTR) continue;
+    if (length < (ssize_t)sizeof(struct rt_msghdr)) return changed;
+    const struct rt_msghdr* header = (const struct rt_msghdr*)buffer;
+    switch (header->rtm_type) {
+      case RTM_ADD: case RTM_DELETE: case RTM_CHANGE:
+      case RTM_IFINFO: case RTM_NEWADDR: case RTM_DELADDR:
+        changed = 1;
+        break;
+      default:
+        break;
+    }
+  }
+}
 
-  for (int i = 0; i < interface_count; i++) {
-    ifdata(i, &net->data);
-    if (strcmp(net->data.ifmd_name, ifname) == 0) {
-      net->row = i;
-      break;
+// The MIB row of an interface is its index.
+static inline void network_resolve_rows(struct network* net) {
+  for (int i = 0; i < net->member_count; i++) net->rows[i] = if_nametoindex(net->members[i]);
+}
+
+static inline void network_read_bytes(struct network* net) {
+  uint64_t ibytes = 0, obytes = 0;
+  int found = 0;
+  for (int i = 0; i < net->member_count; i++) {
+    if (net->rows[i] == 0) continue;
+    ifdata(net->rows[i], &net->data);
+    ibytes += net->data.ifmd_data.ifi_ibytes;
+    obytes += net->data.ifmd_data.ifi_obytes;
+    found = 1;
+  }
+  if (!found) return;
+  net->ibytes = ibytes;
+  net->obytes = obytes;
+}
+#else
+static inline int network_watch_open(void) {
+  int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+  if (fd < 0) return -1;
+  struct sockaddr_nl address;
+  memset(&address, 0, sizeof(address));
+  address.nl_family = AF_NETLINK;
+  address.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Any link or route message counts; so does an overrun (ENOBUFS), since
+// the lost messages may have been changes.
+static inline int network_watch_drain(int fd) {
+  char buffer[8192];
+  int changed = 0;
+  for (;;) {
+    ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+    if (length < 0 && errno == EINTR) continue;
+    if (length < 0 && errno == ENOBUFS) {
+      changed = 1;
+      continue;
     }
+    if (length <= 0) return changed;
+    changed = 1;
   }
 }
 
-static inline void network_update(struct network* net) {
-  gettimeofday(&net->tv_n, NULL);
-  timersub(&net->tv_n, &net->tv_nm1, &net->tv_delta);
-  net->tv_nm1 = net->tv_n;
-
-  uint64_t ibytes_nm1 = net->data.ifmd_data.ifi_ibytes;
-  uint64_t obytes_nm1 = net->data.ifmd_data.ifi_obytes;
-  ifdata(net->row, &net->data);
-
-  double time_scale = (net->tv_delta.tv_sec + 1e-6*net->tv_delta.tv_usec);
-  if (time_scale < 1e-6 || time_scale > 1e2) return;
-  double delta_ibytes = (double)(net->data.ifmd_data.ifi_ibytes - ibytes_nm1)
-                        / time_scale;
-  double delta_obytes = (double)(net->data.ifmd_data.ifi_obytes - obytes_nm1)
-                        / time_scale;
-
-  double exponent_ibytes = log10(delta_ibytes);
-  double exponent_obytes = log10(delta_obytes);
-
-  if (exponent_ibytes < 3) {
-    net->down_unit = UNIT_BPS;
-    net->down = delta_ibytes;
-  } else if (exponent_ibytes < 6) {
-    net->down_unit = UNIT_KBPS;
-    net->down = delta_ibytes / 1000.0;
-  } else if (exponent_ibytes < 9) {
-    net->down_unit = UNIT_MBPS;
-    net->down = delta_ibytes / 1000000.0;
+// Two header rows, then "  name: rx_bytes rx_packets ... (8 receive
+// fields) tx_bytes ...", summed over the member rows. Leaves the counters
+// alone if no member row is present.
+static inline void network_read_bytes(struct network* net) {
+  if (proc_file_read(&net->dev) != 0) return;
+  struct proc_scanner scanner = proc_scan_begin(&net->dev);
+  uint64_t ibytes = 0, obytes = 0;
+  int found = 0;
+  while (proc_scan_next_line(&scanner)) {
+    const char* name = NULL;
+    size_t length = proc_scan_word(&scanner, &name);
+    if (!network_is_member(net, name, length)) continue;
+    if (!proc_scan_char(&scanner, ':')) continue;
+
+    uint64_t field[9] = { 0 };
+    int fields = 0;
+    while (fields < 9 && proc_scan_u64(&scanner, &field[fields])) fields++;
+    if (fields < 9) continue;
+    ibytes += field[0];
+    obytes += field[8];
+    found++;
   }
+  if (!found) return;
+  net->ibytes = ibytes;
+  net->obytes = obytes;
+}
+#endif
 
-  if (exponent_obytes < 3) {
-    net->up_unit = UNIT_BPS;
-    net->up = delta_obytes;
-  } else if (exponent_obytes < 6) {
-    net->up_unit = UNIT_KBPS;
-    net->up = delta_obytes / 1000.0;
-  } else if (exponent_obytes < 9) {
-    net->up_unit = UNIT_MBPS;
-    net->up = delta_obytes / 1000000.0;
+// The interface the IPv4 default route leaves through (barista_route.h).
+// No route and a failed lookup both keep the current members.
+static inline int network_default_interface(struct network* net, char* name) {
+  return net->default_route(name, IFNAMSIZ) == 1;
+}
+
+// Works out the member interfaces for the mode. Keeps the current ones when
+// there is no default route (offline) or nothing is up; restarts the rate
+// baseline when they changed.
+static inline void network_resolve(struct network* net) {
+  net->resolve_pending = 0;
+  net->resolves++;
+  char members[NETWORK_MAX_INTERFACES][IFNAMSIZ];
+  int count = 0;
+  if (net->mode == NETWORK_DEFAULT_ROUTE) {
+    count = network_default_interface(net, members[0]) ? 1 : 0;
+  } else if (net->mode == NETWORK_ALL) {
+    count = network_list_up(members);
   }
+  if (count > 0) {
+    int changed = count != net->member_count;
+    for (int i = 0; i < count && !changed; i++) {
+      changed = strcmp(members[i], net->members[i]) != 0;
+    }
+    if (changed) {
+      memcpy(net->members, members, (size_t)count * sizeof(members[0]));
+      net->member_count = count;
+      net->sampled_ns = 0;
+    }
+  }
+#ifdef __APPLE__
+  // Rows move when an interface is recreated, even under the same name.
+  network_resolve_rows(net);
+#endif
+}
+
+// Treats the next sample as if a route or link notification had arrived.
+static inline void network_request_resolve(struct network* net) {
+  net->resolve_pending = 1;
+}
+
+static inline void network_track(struct network* net) {
+  if (net->route_fd >= 0 && network_watch_drain(net->route_fd)) net->resolve_pending = 1;
+  if (net->resolve_pending) network_resolve(net);
+}
+
+static inline void network_set_mode(struct network* net, const char* ifname) {
+  net->route_fd = -1;
+  if (strcmp(ifname, "default") == 0) {
+    net->mode = NETWORK_DEFAULT_ROUTE;
+  } else if (strcmp(ifname, "all") == 0) {
+    net->mode = NETWORK_ALL;
+  } else {
+    net->mode = NETWORK_FIXED;
+    snprintf(net->members[0], IFNAMSIZ, "%s", ifname);
+    net->member_count = 1;
+  }
+#ifndef __APPLE__
+  // Linux reads rows by name, so a fixed interface needs no tracking.
+  if (net->mode == NETWORK_FIXED) return;
+#endif
+  net->route_fd = network_watch_open();
+  net->resolve_pending = 1;
+}
+
+#ifdef __APPLE__
+static inline void network_init(struct network* net, const char* ifname) {
+  memset(net, 0, sizeof(struct network));
+  net->default_route = barista_default_route_interface;
+  network_set_mode(net, ifname);
+  network_resolve(net);
+}
+#else
+// Tests read a fixture for /proc/net/dev and answer the route lookup.
+static inline void network_init_paths(struct network* net, const char* ifname,
+                                      const char* dev_path,
+                                      int (*default_route)(char* buffer, size_t capacity)) {
+  memset(net, 0, sizeof(struct network));
+  net->default_route = default_route;
+  proc_file_open(&net->dev, dev_path);
+  network_set_mode(net, ifname);
+  if (net->resolve_pending) network_resolve(net);
+}
+
+static inline void network_init_path(struct network* net, const char* ifname,
+                                     const char* path) {
+  network_init_paths(net, ifname, path, barista_default_route_interface);
+}
+
+static inline void network_init(struct network* net, const char* ifname) {
+  network_init_path(net, ifname, "/proc/net/dev");
+}
+#endif
+
+// Comma-separated member interfaces, e.g. for a trigger variable.
+static inline void network_format_interfaces(const struct network* net, char* buffer,
+                                             size_t size) {
+  size_t used = 0;
+  buffer[0] = '\0';
+  for (int i = 0; i < net->member_count; i++) {
+    int written = snprintf(buffer + used, size - used, i ? ",%s" : "%s", net->members[i]);
+    if (written < 0 || (size_t)written >= size - used) {
+      buffer[used] = '\0';
+      return;
+    }
+    used += (size_t)written;
+  }
+}
+
+static inline uint64_t network_monotonic_ns(void) {
+  struct timespec now = { 0, 0 };
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static inline void network_select_unit(double rate, int* value, enum unit* unit) {
+  double exponent = log10(rate);
+  if (exponent < 3) {
+    *unit = UNIT_BPS;
+    *value = (int)rate;
+  } else if (exponent < 6) {
+    *unit = UNIT_KBPS;
+    *value = (int)(rate / 1000.0);
+  } else {
+    *unit = UNIT_MBPS;
+    *value = (int)(rate / 1000000.0);
+  }
+}
+
+// Rates over the time since the previous sample; returns 1 when they were
+// measured. The first sample, one after a stall of more than 100s, or the
+// first after the interfaces changed only resets the baseline and returns 0,
+// leaving the previous rates. A counter that went backwards (the interface
+// was reset) reads as no traffic.
+static inline int network_update_at(struct network* net, uint64_t now_ns) {
+  network_track(net);
+  uint64_t previous_ns = net->sampled_ns;
+  net->sampled_ns = now_ns;
+
+  uint64_t ibytes_nm1 = net->ibytes;
+  uint64_t obytes_nm1 = net->obytes;
+  network_read_bytes(net);
+  if (previous_ns == 0) return 0;
+
+  double time_scale = (double)(now_ns - previous_ns) / 1e9;
+  if (time_scale < 1e-6 || time_scale > 1e2) return 0;
+  double delta_ibytes = net->ibytes >= ibytes_nm1
+                        ? (double)(net->ibytes - ibytes_nm1) / time_scale : 0.0;
+  double delta_obytes = net->obytes >= obytes_nm1
+                        ? (double)(net->obytes - obytes_nm1) / time_scale : 0.0;
+
+  net->down_rate = delta_ibytes;
+  net->up_rate = delta_obytes;
+  network_select_unit(delta_ibytes, &net->down, &net->down_unit);
+  network_select_unit(delta_obytes, &net->up, &net->up_unit);
+  return 1;
+}
+
+static inline int network_update(struct network* net) {
+  return network_update_at(net, network_monotonic_ns());
 }
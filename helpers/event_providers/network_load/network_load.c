@@ -1,42 +1,64 @@
+#define _DEFAULT_SOURCE 1
+
 #include <unistd.h>
 #include "network.h"
 #include "../sketchybar.h"
 
 int main (int argc, char** argv) {
   float update_freq;
-  if (argc < 4 || (sscanf(argv[3], "%f", &update_freq) != 1)) {
-    printf("Usage: %s \"<interface>\" \"<event-name>\" \"<event_freq>\"\n", argv[0]);
+  struct sketchybar_schedule schedule;
+  int valid = argc >= 4 && sscanf(argv[3], "%f", &update_freq) == 1;
+  if (valid) {
+    // Tick on wall-clock multiples of the frequency
+    sketchybar_schedule_init(&schedule, update_freq);
+    valid = sketchybar_schedule_parse(&schedule, argc, argv, 4);
+  }
+  if (!valid) {
+    printf("Usage: %s \"<interface|default|all>\" \"<event-name>\" \"<event_freq>\" "
+           "[--adaptive DELTA_BYTES_PER_S] [--max-interval SECONDS]\n", argv[0]);
     exit(1);
   }
 
   alarm(0);
   // Setup the event in sketchybar
-  char event_message[512];
-  snprintf(event_message, 512, "--add event '%s'", argv[2]);
-  sketchybar(event_message);
+  sketchybar_add_event(argv[2]);
+
+  // Sample on our own schedule even when the bar falls behind
+  sketchybar_async_start((int)(update_freq * 1000));
 
   struct network network;
   network_init(&network, argv[1]);
-  char trigger_message[512];
+  // Rates in bytes per second
+  const char* history_names[] = { "upload", "download" };
+  BaristaHistory* history = sketchybar_history_create(argv[2], 2, history_names);
+
+  // "default" and "all" also report which interfaces were measured
+  const char* names[4] = { "upload", "download", "interface" };
+  char upload[32], download[32], interfaces[128];
+  const char* values[4] = { upload, download, interfaces };
+  int base_count = network.mode == NETWORK_FIXED ? 2 : 3;
   for (;;) {
-    // Acquire new info
-    network_update(&network);
-
-    // Prepare the event message
-    snprintf(trigger_message,
-             512,
-             "--trigger '%s' upload='%03d%s' download='%03d%s'",
-             argv[2],
-             network.up,
-             unit_str[network.up_unit],
-             network.down,
-             unit_str[network.down_unit]);
-
-    // Trigger the event
-    sketchybar(trigger_message);
-
-    // Wait
-    usleep(update_freq * 1000000);
+    // Acquire new info. A sample that only reset the baseline (the first,
+    // or the first after the interfaces changed) has no rates to report.
+    if (!network_update(&network)) {
+      sketchybar_schedule_wait(&schedule);
+      continue;
+    }
+    double rates[] = { network.up_rate, network.down_rate };
+    sketchybar_schedule_adapt(&schedule, rates, 2);
+    sketchybar_history_append(history, rates);
+
+    // Prepare the event variables
+    snprintf(upload, sizeof(upload), "%03d%s", network.up, unit_str[network.up_unit]);
+    snprintf(download, sizeof(download), "%03d%s", network.down, unit_str[network.down_unit]);
+    network_format_interfaces(&network, interfaces, sizeof(interfaces));
+
+    // Trigger the event unless nothing changed since the last tick
+    int count = sketchybar_schedule_variable(&schedule, base_count, names, values);
+    sketchybar_trigger(argv[2], count, names, values);
+
+    // Wait for the next tick
+    sketchybar_schedule_wait(&schedule);
   }
   return 0;
 }
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+// Reads /proc text files through one descriptor kept open for the life of
+// the provider: each sample is a pread from offset 0, which makes the kernel
+// regenerate the file without another open/close. Only the first
+// PROC_FILE_BYTES are kept; every provider stops at the rows it needs, which
+// come first (the cpu rows of /proc/stat precede the long intr row).
+//
+// The scanner walks the buffer by hand. sscanf would rescan its format
+// string and take the locale path for every field of every row on each tick.
+
+#define PROC_FILE_BYTES (32 * 1024)
+
+struct proc_file {
+  int fd;
+  size_t length;
+  char data[PROC_FILE_BYTES];
+};
+
+struct proc_scanner {
+  const char* cursor;
+  const char* end;
+};
+
+static inline int proc_file_open(struct proc_file* file, const char* path) {
+  file->length = 0;
+  file->data[0] = '\0';
+  file->fd = open(path, O_RDONLY | O_CLOEXEC);
+  return file->fd >= 0 ? 0 : -1;
+}
+
+static inline void proc_file_close(struct proc_file* file) {
+  if (file->fd >= 0) close(file->fd);
+  file->fd = -1;
+}
+
+// Refreshes the buffer with the file from `offset` on, for the rare row that
+// lies past the first PROC_FILE_BYTES; -1 when the descriptor is gone or the
+// read fails.
+static inline int proc_file_read_from(struct proc_file* file, off_t offset) {
+  if (file->fd < 0) return -1;
+  size_t used = 0;
+  while (used < sizeof(file->data) - 1) {
+    ssize_t count = pread(file->fd, file->data + used, sizeof(file->data) - 1 - used,
+                          offset + (off_t)used);
+    if (count < 0 && errno == EINTR) continue;
+    if (count < 0) return -1;
+    if (count == 0) break;
+    used += (size_t)count;
+  }
+  file->length = used;
+  file->data[used] = '\0';
+  return 0;
+}
+
+// Refreshes the buffer; -1 when the descriptor is gone or the read fails.
+static inline int proc_file_read(struct proc_file* file) {
+  return proc_file_read_from(file, 0);
+}
+
+// Whether the last read stopped at the buffer's end rather than the file's.
+static inline int proc_file_truncated(const struct proc_file* file) {
+  return file->length == sizeof(file->data) - 1;
+}
+
+static inline struct proc_scanner proc_scan_begin(const struct proc_file* file) {
+  struct proc_scanner scanner = { file->data, file->data + file->length };
+  return scanner;
+}
+
+static inline void proc_scan_spaces(struct proc_scanner* scanner) {
+  while (scanner->cursor < scanner->end
+         && (*scanner->cursor == ' ' || *scanner->cursor == '\t')) {
+    scanner->cursor++;
+  }
+}
+
+// Leading spaces, then a run of characters up to a space, ':' or newline.
+static inline size_t proc_scan_word(struct proc_scanner* scanner, const char** word) {
+  proc_scan_spaces(scanner);
+  *word = scanner->cursor;
+  while (scanner->cursor < scanner->end && *scanner->cursor != ' '
+         && *scanner->cursor != '\t' && *scanner->cursor != ':'
+         && *scanner->cursor != '\n') {
+    scanner->cursor++;
+  }
+  return (size_t)(scanner->cursor - *word);
+}
+
+// Consumes `c` if it is next after spaces.
+static inline int proc_scan_char(struct proc_scanner* scanner, char c) {
+  proc_scan_spaces(scanner);
+  if (scanner->cursor >= scanner->end || *scanner->cursor != c) return 0;
+  scanner->cursor++;
+  return 1;
+}
+
+// Leading spaces, then an unsigned decimal; 0 when no digit follows.
+static inline int proc_scan_u64(struct proc_scanner* scanner, uint64_t* value) {
+  proc_scan_spaces(scanner);
+  const char* start = scanner->cursor;
+  uint64_t result = 0;
+  while (scanner->cursor < scanner->end
+         && *scanner->cursor >= '0' && *scanner->cursor <= '9') {
+    result = result * 10 + (uint64_t)(*scanner->cursor - '0');
+    scanner->cursor++;
+  }
+  *value = result;
+  return scanner->cursor != start;
+}
+
+// Moves past the next newline; 0 at the end of the buffer.
+static inline int proc_scan_next_line(struct proc_scanner* scanner) {
+  const char* newline = memchr(scanner->cursor, '\n',
+                               (size_t)(scanner->end - scanner->cursor));
+  if (!newline) {
+    scanner->cursor = scanner->end;
+    return 0;
+  }
+  scanner->cursor = newline + 1;
+  return scanner->cursor < scanner->end;
+}
@@ -1,122 +1,352 @@
 #pragma once
 
-#include <mach/arm/kern_return.h>
-#include <mach/mach.h>
-#include <mach/mach_port.h>
-#include <mach/message.h>
-#include <bootstrap.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdlib.h>
-#include <pthread.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
-typedef char* env;
+#include "../barista_history.h"
+#include "../barista_payload.h"
+#include "../barista_send_queue.h"
+#include "../barista_sent_cache.h"
+#include "../barista_transport.h"
 
-#define MACH_HANDLER(name) void name(env env)
-typedef MACH_HANDLER(mach_handler);
+#define SKETCHYBAR_TRIGGER_MAX_VARIABLES 12
+#define SKETCHYBAR_QUEUE_CAPACITY 8
+#define SKETCHYBAR_PAYLOAD_BYTES 2048
+#define SKETCHYBAR_ADAPT_VALUES 8
+#define SKETCHYBAR_ADAPT_CALM_SAMPLES 3
+#define SKETCHYBAR_HISTORY_CAPACITY 256
 
-struct mach_message {
-  mach_msg_header_t header;
-  mach_msg_size_t msgh_descriptor_count;
-  mach_msg_ool_descriptor_t descriptor;
-};
+// Ticks land on wall-clock multiples of the period (plus an optional shared
+// phase), so every provider with the same period wakes in the same
+// millisecond and the bar redraws once. Each tick's deadline is derived from
+// the clock again rather than from the previous sleep, so sampling and IPC
+// time never accumulate as drift; ticks that are already past are skipped
+// and counted as missed. The sleep itself is an absolute CLOCK_MONOTONIC
+// deadline, so a wall-clock step shifts at most one tick.
+//
+// BARISTA_PROVIDER_PHASE_MS offsets every tick within the period.
+// BARISTA_PROVIDER_JITTER=1 adds `tick_jitter_us` (wake-up lateness) to each
+// trigger; it is off by default because a value that changes every tick
+// would defeat the unchanged-trigger suppression.
+//
+// In adaptive mode (--adaptive DELTA) a provider that keeps sampling values
+// within DELTA of the sample that started the quiet run stretches its tick:
+// after SKETCHYBAR_ADAPT_CALM_SAMPLES quiet samples every further one
+// doubles the stride, up to --max-interval. The first sample outside DELTA
+// drops back to the base tick. Measuring against the start of the run rather
+// than the previous sample means a slow creep still snaps back once it adds
+// up to DELTA.
+struct sketchybar_schedule {
+  uint64_t period_ns;
+  uint64_t phase_ns;
+  uint64_t target_ns;
+  uint64_t ticks;
+  uint64_t missed;
+  uint64_t jitter_ns;
+  uint64_t jitter_max_ns;
+  uint64_t jitter_total_ns;
+  int report_jitter;
+  char jitter_value[24];
 
-struct mach_buffer {
-  struct mach_message message;
-  mach_msg_trailer_t trailer;
+  double adapt_delta;
+  uint32_t stride;
+  uint32_t max_stride;
+  uint32_t calm;
+  int reference_count;
+  double reference[SKETCHYBAR_ADAPT_VALUES];
 };
 
-static mach_port_t g_mach_port = 0;
+static volatile sig_atomic_t sketchybar_stats_requested = 0;
+static uint64_t sketchybar_seen_failures = 0;
+static uint64_t sketchybar_triggers_sent = 0;
+static uint64_t sketchybar_triggers_suppressed = 0;
+static const struct sketchybar_schedule* sketchybar_active_schedule = NULL;
 
-static inline mach_port_t mach_get_bs_port() {
-  mach_port_name_t task = mach_task_self();
+static inline uint64_t sketchybar_clock_ns(clockid_t clock) {
+  struct timespec now = { 0, 0 };
+  clock_gettime(clock, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
 
-  mach_port_t bs_port;
-  if (task_get_special_port(task,
-                            TASK_BOOTSTRAP_PORT,
-                            &bs_port            ) != KERN_SUCCESS) {
-    return 0;
+static inline void sketchybar_sleep_until(uint64_t deadline_ns) {
+#if defined(__linux__)
+  struct timespec deadline = { (time_t)(deadline_ns / 1000000000ull),
+                               (long)(deadline_ns % 1000000000ull) };
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {}
+#else
+  // No clock_nanosleep on macOS: sleep the remainder until the deadline.
+  for (;;) {
+    uint64_t now = sketchybar_clock_ns(CLOCK_MONOTONIC);
+    if (now >= deadline_ns) return;
+    uint64_t remaining = deadline_ns - now;
+    struct timespec interval = { (time_t)(remaining / 1000000000ull),
+                                 (long)(remaining % 1000000000ull) };
+    nanosleep(&interval, NULL);
   }
+#endif
+}
 
-  char* name = getenv("BAR_NAME");
-  if (!name) name = "sketchybar";
-  uint32_t lookup_len = 16 + strlen(name);
+static inline void sketchybar_schedule_init(struct sketchybar_schedule* schedule,
+                                            double period_seconds) {
+  memset(schedule, 0, sizeof(*schedule));
+  schedule->period_ns = period_seconds > 0.001 ? (uint64_t)(period_seconds * 1e9) : 1000000;
+  const char* phase = getenv("BARISTA_PROVIDER_PHASE_MS");
+  if (phase && phase[0] != '\0') {
+    schedule->phase_ns = (uint64_t)strtoull(phase, NULL, 10) * 1000000ull % schedule->period_ns;
+  }
+  const char* jitter = getenv("BARISTA_PROVIDER_JITTER");
+  schedule->report_jitter = jitter && strcmp(jitter, "1") == 0;
+  schedule->adapt_delta = -1.0;
+  schedule->stride = 1;
+  schedule->max_stride = 1;
+  sketchybar_active_schedule = schedule;
+}
 
-  char buffer[lookup_len];
-  snprintf(buffer, lookup_len, "git.felix.%s", name);
+// Parses the optional `--adaptive DELTA [--max-interval SECONDS]` arguments
+// from argv[first] on; returns 0 on anything else. The longest interval
+// defaults to 8 base ticks.
+static inline int sketchybar_schedule_parse(struct sketchybar_schedule* schedule,
+                                            int argc,
+                                            char** argv,
+                                            int first) {
+  double max_interval = 0.0;
+  for (int i = first; i < argc; i++) {
+    char* end = NULL;
+    if (i + 1 >= argc) return 0;
+    if (strcmp(argv[i], "--adaptive") == 0) {
+      schedule->adapt_delta = strtod(argv[++i], &end);
+      if (!end || *end != '\0' || schedule->adapt_delta < 0) return 0;
+    } else if (strcmp(argv[i], "--max-interval") == 0) {
+      max_interval = strtod(argv[++i], &end);
+      if (!end || *end != '\0' || max_interval <= 0) return 0;
+    } else {
+      return 0;
+    }
+  }
+  if (schedule->adapt_delta < 0) return 1;
+  double base = (double)schedule->period_ns / 1e9;
+  double strides = max_interval > 0 ? max_interval / base : 8.0;
+  schedule->max_stride = strides < 1.0 ? 1 : strides > 3600.0 ? 3600 : (uint32_t)strides;
+  return 1;
+}
 
-  mach_port_t port;
-  if (bootstrap_look_up(bs_port, buffer, &port) != KERN_SUCCESS) return 0;
-  return port;
+// Feeds one sample's values to adaptive mode and sets the stride for the
+// next wait. Returns 1 when the sample moved past DELTA (or is the first).
+static inline int sketchybar_schedule_adapt(struct sketchybar_schedule* schedule,
+                                            const double* values,
+                                            int count) {
+  if (schedule->adapt_delta < 0) return 1;
+  if (count > SKETCHYBAR_ADAPT_VALUES) count = SKETCHYBAR_ADAPT_VALUES;
+  int changed = count != schedule->reference_count;
+  for (int i = 0; i < count && !changed; i++) {
+    changed = fabs(values[i] - schedule->reference[i]) > schedule->adapt_delta;
+  }
+  if (changed) {
+    memcpy(schedule->reference, values, (size_t)count * sizeof(double));
+    schedule->reference_count = count;
+    schedule->calm = 0;
+    schedule->stride = 1;
+    return 1;
+  }
+  if (++schedule->calm >= SKETCHYBAR_ADAPT_CALM_SAMPLES && schedule->stride < schedule->max_stride) {
+    schedule->stride = schedule->stride * 2 > schedule->max_stride
+                       ? schedule->max_stride : schedule->stride * 2;
+  }
+  return 0;
 }
 
-static inline bool mach_send_message(mach_port_t port, char* message, uint32_t len) {
-  if (!message || !port) {
-    return false;
+// Sleeps until the next aligned tick after now, a multiple of the base
+// period times the adaptive stride. The half-period floor keeps a wake-up
+// that lands a hair early on the wall clock from running the same tick
+// twice.
+static inline void sketchybar_schedule_wait(struct sketchybar_schedule* schedule) {
+  uint64_t period = schedule->period_ns * (schedule->stride ? schedule->stride : 1);
+  uint64_t now_wall = sketchybar_clock_ns(CLOCK_REALTIME);
+  uint64_t now = sketchybar_clock_ns(CLOCK_MONOTONIC);
+  uint64_t floor_wall = now_wall;
+  if (schedule->target_ns && schedule->target_ns + period / 2 > floor_wall) {
+    floor_wall = schedule->target_ns + period / 2;
+  }
+  uint64_t target = floor_wall < schedule->phase_ns
+                    ? schedule->phase_ns
+                    : ((floor_wall - schedule->phase_ns) / period + 1) * period
+                      + schedule->phase_ns;
+  if (schedule->target_ns && target > schedule->target_ns + period) {
+    schedule->missed += (target - schedule->target_ns) / period - 1;
   }
+  schedule->target_ns = target;
+
+  uint64_t deadline = now + (target - now_wall);
+  sketchybar_sleep_until(deadline);
+  uint64_t woke = sketchybar_clock_ns(CLOCK_MONOTONIC);
+  schedule->jitter_ns = woke > deadline ? woke - deadline : 0;
+  if (schedule->jitter_ns > schedule->jitter_max_ns) schedule->jitter_max_ns = schedule->jitter_ns;
+  schedule->jitter_total_ns += schedule->jitter_ns;
+  schedule->ticks++;
+}
+
+// Appends tick_jitter_us when BARISTA_PROVIDER_JITTER=1; returns the new
+// variable count.
+static inline int sketchybar_schedule_variable(struct sketchybar_schedule* schedule,
+                                               int count,
+                                               const char* names[],
+                                               const char* values[]) {
+  if (!schedule->report_jitter || schedule->ticks == 0) return count;
+  snprintf(schedule->jitter_value, sizeof(schedule->jitter_value), "%llu",
+           (unsigned long long)(schedule->jitter_ns / 1000));
+  names[count] = "tick_jitter_us";
+  values[count] = schedule->jitter_value;
+  return count + 1;
+}
+
+// Publishes samples of `series` to a shared-memory history ring (see
+// barista_history.h) for graphs and sparklines. BARISTA_PROVIDER_HISTORY
+// sets the capacity in samples; 0 turns it off. Returns NULL when off or
+// unavailable, which sketchybar_history_append ignores.
+static inline BaristaHistory* sketchybar_history_create(const char* series,
+                                                        uint32_t field_count,
+                                                        const char* const names[]) {
+  uint32_t capacity = SKETCHYBAR_HISTORY_CAPACITY;
+  const char* configured = getenv("BARISTA_PROVIDER_HISTORY");
+  if (configured && configured[0] != '\0') capacity = (uint32_t)strtoul(configured, NULL, 10);
+  if (capacity == 0) return NULL;
+  return barista_history_create(series, capacity, field_count, names);
+}
+
+static inline void sketchybar_history_append(BaristaHistory* history, const double* values) {
+  barista_history_append(history, sketchybar_clock_ns(CLOCK_REALTIME), values);
+}
+
+static inline void sketchybar_request_stats(int signal_number) {
+  (void)signal_number;
+  sketchybar_stats_requested = 1;
+}
 
-  struct mach_message msg = { 0 };
-  msg.header.msgh_remote_port = port;
-  msg.header.msgh_local_port = 0;
-  msg.header.msgh_id = 0;
-  msg.header.msgh_bits = MACH_MSGH_BITS_SET(MACH_MSG_TYPE_COPY_SEND,
-                                            MACH_MSG_TYPE_MAKE_SEND,
-                                            0,
-                                            MACH_MSGH_BITS_COMPLEX       );
-
-  msg.header.msgh_size = sizeof(struct mach_message);
-  msg.msgh_descriptor_count = 1;
-  msg.descriptor.address = message;
-  msg.descriptor.size = len * sizeof(char);
-  msg.descriptor.copy = MACH_MSG_VIRTUAL_COPY;
-  msg.descriptor.deallocate = false;
-  msg.descriptor.type = MACH_MSG_OOL_DESCRIPTOR;
-
-  kern_return_t err = mach_msg(&msg.header,
-                               MACH_SEND_MSG,
-                               sizeof(struct mach_message),
-                               0,
-                               MACH_PORT_NULL,
-                               MACH_MSG_TIMEOUT_NONE,
-                               MACH_PORT_NULL              );
-
-  return err == KERN_SUCCESS;
+// Hands every later send to a sender thread, so a stalled bar delays
+// delivery instead of the next sample. A trigger still queued when the next
+// one for the same event arrives is dropped. Deliveries more than period_ms
+// after their sample count as late; SIGUSR1 prints the queue counters to
+// stderr. BARISTA_PROVIDER_SYNC=1 keeps the blocking sends.
+static inline int sketchybar_async_start(int period_ms) {
+  const char* sync = getenv("BARISTA_PROVIDER_SYNC");
+  if (sync && strcmp(sync, "1") == 0) return 0;
+  // Sends stay unconfirmed so barista_busd can still coalesce them.
+  if (barista_send_queue_start(SKETCHYBAR_QUEUE_CAPACITY, 0, period_ms) != 0) return 0;
+  signal(SIGUSR1, sketchybar_request_stats);
+  return 1;
 }
 
-static inline uint32_t format_message(char* message, char* formatted_message) {
-  // This is not actually robust, switch to stack based messaging.
-  char outer_quote = 0;
-  uint32_t caret = 0;
-  uint32_t message_length = strlen(message) + 1;
-  for (int i = 0; i < message_length; ++i) {
-    if (message[i] == '"' || message[i] == '\'') {
-      if (outer_quote && outer_quote == message[i]) outer_quote = 0;
-      else if (!outer_quote) outer_quote = message[i];
-      continue;
+static inline void sketchybar_report_stats(const char* event) {
+  if (!sketchybar_stats_requested) return;
+  sketchybar_stats_requested = 0;
+  BaristaSendQueueStats stats;
+  barista_send_queue_stats(&stats);
+  fprintf(stderr,
+          "%s: queued=%llu sent=%llu failed=%llu dropped=%llu late=%llu "
+          "max_delay_ms=%llu depth=%u\n",
+          event,
+          (unsigned long long)stats.queued,
+          (unsigned long long)stats.sent,
+          (unsigned long long)stats.failed,
+          (unsigned long long)stats.dropped,
+          (unsigned long long)stats.late,
+          (unsigned long long)stats.max_delay_ms,
+          stats.depth);
+  const struct sketchybar_schedule* schedule = sketchybar_active_schedule;
+  if (!schedule) return;
+  fprintf(stderr,
+          "%s: ticks=%llu triggers=%llu suppressed=%llu stride=%u missed=%llu "
+          "jitter_us=%llu max_jitter_us=%llu mean_jitter_us=%llu\n",
+          event,
+          (unsigned long long)schedule->ticks,
+          (unsigned long long)sketchybar_triggers_sent,
+          (unsigned long long)sketchybar_triggers_suppressed,
+          schedule->stride,
+          (unsigned long long)schedule->missed,
+          (unsigned long long)(schedule->jitter_ns / 1000),
+          (unsigned long long)(schedule->jitter_max_ns / 1000),
+          (unsigned long long)(schedule->ticks
+                               ? schedule->jitter_total_ns / schedule->ticks / 1000 : 0));
+}
+
+// `key` names the event a queued payload may supersede; NULL never does.
+static inline BaristaSendResult sketchybar_send(const char* key,
+                                                const void* payload,
+                                                size_t length) {
+  if (barista_send_queue_running()) {
+    // No sketchybar instance running, exit.
+    if (barista_send_queue_bar_gone()) exit(0);
+    if (barista_send_queue_push(key, payload, length) == BARISTA_QUEUE_REFUSED) {
+      return BARISTA_SEND_NOT_SENT;
     }
-    formatted_message[caret] = message[i];
-    if (message[i] == ' ' && !outer_quote) formatted_message[caret] = '\0';
-    caret++;
+    return BARISTA_SEND_SENT_UNCONFIRMED;
   }
 
-  if (caret > 0 && formatted_message[caret] == '\0'
-      && formatted_message[caret - 1] == '\0') {
-    caret--;
+  // Providers never wait for the bar's reply; the transport keeps the
+  // service port cached and retries a fresh lookup once on failure.
+  BaristaSendResult result = barista_send(payload, length, 0);
+  if (result == BARISTA_SEND_NOT_SENT && !barista_transport_probe()) {
+    // No sketchybar instance running, exit.
+    exit(0);
   }
-  formatted_message[caret] = '\0';
-  return caret + 1;
+  return result;
 }
 
-static inline void sketchybar(char* message) {
-  char formatted_message[strlen(message) + 2];
-  uint32_t length = format_message(message, formatted_message);
-  if (!length) return;
-
-  if (!g_mach_port) g_mach_port = mach_get_bs_port();
-  if (!mach_send_message(g_mach_port, formatted_message, length)) {
-    g_mach_port = mach_get_bs_port();
-    if (!mach_send_message(g_mach_port, formatted_message, length)) {
-      // No sketchybar instance running, exit.
-      exit(0);
-    }
+// Registers `event` so items can subscribe to it.
+static inline BaristaSendResult sketchybar_add_event(const char* event) {
+  uint8_t arena[SKETCHYBAR_PAYLOAD_BYTES];
+  BaristaPayload payload;
+  barista_payload_init(&payload, arena, sizeof(arena));
+  barista_payload_verb(&payload, BARISTA_VERB_ADD);
+  barista_payload_verb(&payload, BARISTA_VERB_EVENT);
+  barista_payload_token(&payload, event);
+  size_t length = barista_payload_finish(&payload);
+  if (!length) return BARISTA_SEND_NOT_SENT;
+  return sketchybar_send(NULL, arena, length);
+}
+
+// Triggers `event` with name=value variables, skipping the send when every
+// value matches the last trigger sent for this event. An identical tick
+// would still wake SketchyBar and each subscriber script for nothing.
+static inline void sketchybar_trigger(const char* event,
+                                      int count,
+                                      const char* const names[],
+                                      const char* const values[]) {
+  if (count < 0 || count > SKETCHYBAR_TRIGGER_MAX_VARIABLES) return;
+  // Values recorded for a queued trigger the transport later refused were
+  // never shown, so the first trigger after a failure always goes out.
+  int resend = 0;
+  if (barista_send_queue_running()) {
+    sketchybar_report_stats(event);
+    BaristaSendQueueStats stats;
+    barista_send_queue_stats(&stats);
+    resend = stats.failed != sketchybar_seen_failures;
+    sketchybar_seen_failures = stats.failed;
   }
+  BaristaSentEntry entries[SKETCHYBAR_TRIGGER_MAX_VARIABLES];
+  int unchanged = !resend;
+  for (int i = 0; i < count; i++) {
+    if (!barista_sent_cache_check(event, names[i], values[i], &entries[i])) unchanged = 0;
+  }
+  if (unchanged && count > 0) {
+    sketchybar_triggers_suppressed++;
+    return;
+  }
+
+  uint8_t arena[SKETCHYBAR_PAYLOAD_BYTES];
+  BaristaPayload payload;
+  barista_payload_init(&payload, arena, sizeof(arena));
+  barista_payload_verb(&payload, BARISTA_VERB_TRIGGER);
+  barista_payload_token(&payload, event);
+  for (int i = 0; i < count; i++) barista_payload_property(&payload, names[i], values[i]);
+  size_t length = barista_payload_finish(&payload);
+  if (!length || sketchybar_send(event, arena, length) == BARISTA_SEND_NOT_SENT) return;
+  sketchybar_triggers_sent++;
+  for (int i = 0; i < count; i++) barista_sent_cache_record(&entries[i]);
 }
@@ -1,10 +1,15 @@
 // Icon Manager - Centralized C-based icon management with SketchyBar API
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
 
+#include "barista_cli.h"
+#include "barista_json.h"
+#include "barista_payload.h"
+
 #define MAX_ICONS 500
 #define MAX_CATEGORIES 30
 #define MAX_NAME_LEN 64
@@ -164,68 +169,40 @@ void init_library() {
     library->icon_count = num_builtins;
 }
 
-// Load custom icons from JSON state file
-void load_custom_icons() {
-    char state_path[512];
-    snprintf(state_path, sizeof(state_path), "%s/.config/sketchybar/state.json", getenv("HOME"));
+// Keys of "icons" are icon names; a custom glyph replaces a built-in one
+static void decode_custom_icon(void* object, const char* key, const BaristaJsonValue* value) {
+    IconLibrary* icons = object;
+    if (!key || value->type != BARISTA_JSON_VALUE_STRING) return;
+    if (strlen(key) >= MAX_NAME_LEN || value->length >= MAX_GLYPH_LEN) return;
 
-    FILE* f = fopen(state_path, "r");
-    if (!f) return;
-
-    fseek(f, 0, SEEK_END);
-    long size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-
-    char* buffer = malloc(size + 1);
-    fread(buffer, 1, size, f);
-    buffer[size] = '\0';
-    fclose(f);
-
-    // Simple JSON parsing for icons section
-    char* icons_start = strstr(buffer, "\"icons\"");
-    if (icons_start) {
-        char* brace = strchr(icons_start, '{');
-        if (brace) {
-            char* end = strchr(brace, '}');
-            if (end) {
-                char* ptr = brace + 1;
-                while (ptr < end) {
-                    // Parse "name": "glyph" pairs
-                    char* quote1 = strchr(ptr, '\"');
-                    if (!quote1 || quote1 >= end) break;
-                    char* quote2 = strchr(quote1 + 1, '\"');
-                    if (!quote2 || quote2 >= end) break;
-
-                    char name[MAX_NAME_LEN] = {0};
-                    strncpy(name, quote1 + 1, quote2 - quote1 - 1);
-
-                    char* colon = strchr(quote2, ':');
-                    if (!colon || colon >= end) break;
-
-                    char* quote3 = strchr(colon, '\"');
-                    if (!quote3 || quote3 >= end) break;
-                    char* quote4 = strchr(quote3 + 1, '\"');
-                    if (!quote4 || quote4 >= end) break;
-
-                    char glyph[MAX_GLYPH_LEN] = {0};
-                    strncpy(glyph, quote3 + 1, quote4 - quote3 - 1);
-
-                    // Add or update icon
-                    if (library->icon_count < MAX_ICONS) {
-                        strcpy(library->icons[library->icon_count].name, name);
-                        strcpy(library->icons[library->icon_count].glyph, glyph);
-                        strcpy(library->icons[library->icon_count].category, "custom");
-                        library->icons[library->icon_count].hash = hash_string(name);
-                        library->icon_count++;
-                    }
-
-                    ptr = quote4 + 1;
-                }
-            }
+    uint32_t hash = hash_string(key);
+    for (int i = 0; i < icons->icon_count; i++) {
+        if (icons->icons[i].hash == hash && strcmp(icons->icons[i].name, key) == 0) {
+            strcpy(icons->icons[i].glyph, value->string);
+            return;
         }
     }
+    if (icons->icon_count < MAX_ICONS) {
+        Icon* icon = &icons->icons[icons->icon_count++];
+        strcpy(icon->name, key);
+        strcpy(icon->glyph, value->string);
+        strcpy(icon->category, "custom");
+        icon->hash = hash;
+    }
+}
+
+static const BaristaJsonField kStateFields[] = {
+    {.key = "icons", .type = BARISTA_JSON_ENTRIES, .offset = 0, .entry = decode_custom_icon},
+    {.key = NULL},
+};
+
+static const BaristaJsonField kStateRoot = {.type = BARISTA_JSON_OBJECT, .offset = 0, .fields = kStateFields};
 
-    free(buffer);
+// Load custom icons from JSON state file
+void load_custom_icons() {
+    char state_path[512];
+    snprintf(state_path, sizeof(state_path), "%s/.config/sketchybar/state.json", getenv("HOME"));
+    barista_json_decode_file(state_path, &kStateRoot, library, NULL);
 }
 
 // Get icon by name
@@ -252,9 +229,14 @@ const char* get_icon(const char* name, const char* fallback) {
 void update_item_icon(const char* item_name, const char* icon_name, const char* fallback) {
     const char* glyph = get_icon(icon_name, fallback);
 
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd), "sketchybar --set %s icon='%s'", item_name, glyph);
-    system(cmd);
+    uint8_t arena[512];
+    BaristaPayload payload;
+    barista_payload_init(&payload, arena, sizeof(arena));
+    barista_payload_verb(&payload, BARISTA_VERB_SET);
+    barista_payload_token(&payload, item_name);
+    barista_payload_property(&payload, "icon", glyph);
+    size_t length = barista_payload_finish(&payload);
+    if (length > 0) barista_sketchybar(arena, length, 0);
 }
 
 // List icons by category
@@ -2,20 +2,35 @@
 #include <cstdlib>
 #include <cstring>
 #include <unistd.h>
-#include <stdarg.h>
+
+#include "barista_cli.h"
+#include "barista_payload.h"
 
 static double RESET_DELAY = 0.04;
 static const char *DEFAULT_HILITE = "0x60cba6f7";
 
-static void run_cmd(const char *fmt, ...) {
-  char buffer[1024];
-  va_list args;
-  va_start(args, fmt);
-  vsnprintf(buffer, sizeof(buffer), fmt, args);
-  va_end(args);
-  system(buffer);
-}
+struct SetRequest {
+  uint8_t arena[512];
+  BaristaPayload payload;
+
+  explicit SetRequest(const char *item) {
+    barista_payload_init(&payload, arena, sizeof(arena));
+    barista_payload_verb(&payload, BARISTA_VERB_SET);
+    barista_payload_token(&payload, item);
+  }
+
+  SetRequest &property(const char *name, const char *value) {
+    barista_payload_property(&payload, name, value);
+    return *this;
+  }
+
+  void send() {
+    size_t length = barista_payload_finish(&payload);
+    if (length > 0) barista_sketchybar(arena, length, 0);
+  }
+};
 
+// The action itself is a user-supplied shell command, so it alone keeps the shell.
 static void run_async(const char *command) {
   if (!command || command[0] == '\0') return;
   pid_t pid = fork();
@@ -29,10 +44,11 @@ static void reset_background_async(const char *item) {
   if (!item || item[0] == '\0') return;
   pid_t pid = fork();
   if (pid == 0) {
+    barista_transport_reset();
     if (RESET_DELAY > 0.0) {
       usleep((useconds_t)(RESET_DELAY * 1000000.0));
     }
-    run_cmd("sketchybar --set %s background.drawing=off", item);
+    SetRequest(item).property("background.drawing", "off").send();
     _exit(0);
   }
 }
@@ -56,13 +72,16 @@ int main(int argc, char *argv[]) {
   }
 
   if (item && item[0] != '\0') {
-    run_cmd("sketchybar --set %s background.drawing=on background.color=%s", item, highlight);
+    SetRequest(item)
+        .property("background.drawing", "on")
+        .property("background.color", highlight)
+        .send();
   }
 
   run_async(command ? command : "");
 
   if (popup && popup[0] != '\0') {
-    run_cmd("sketchybar -m --set %s popup.drawing=off", popup);
+    SetRequest(popup).property("popup.drawing", "off").send();
   }
   reset_background_async(item);
 
@@ -6,6 +6,10 @@
 #include <sys/stat.h>
 #include <time.h>
 
+#include "barista_cli.h"
+#include "barista_json.h"
+#include "barista_payload.h"
+
 #define MAX_MENU_ITEMS 100
 #define MAX_DEPTH 5
 #define MAX_NAME_LEN 128
@@ -35,183 +39,115 @@ typedef struct {
     char popup_name[MAX_NAME_LEN];
 } Menu;
 
+// Indexed by MenuItemType
+static const char* const kMenuItemTypes[] = {"item", "header", "separator", "submenu", NULL};
+
+static const BaristaJsonField kMenuItemFields[] = {
+    {.key = "type", .type = BARISTA_JSON_ENUM, BARISTA_JSON_MEMBER(MenuItem, type), .choices = kMenuItemTypes},
+    {.key = "name", .type = BARISTA_JSON_STRING, BARISTA_JSON_MEMBER(MenuItem, name)},
+    {.key = "label", .type = BARISTA_JSON_STRING, BARISTA_JSON_MEMBER(MenuItem, label)},
+    {.key = "icon", .type = BARISTA_JSON_STRING, BARISTA_JSON_MEMBER(MenuItem, icon)},
+    {.key = "action", .type = BARISTA_JSON_STRING, BARISTA_JSON_MEMBER(MenuItem, action)},
+    {.key = "shortcut", .type = BARISTA_JSON_STRING, BARISTA_JSON_MEMBER(MenuItem, shortcut)},
+    {.key = NULL},
+};
+
+// The file is an array of item objects
+static const BaristaJsonField kMenuRoot = {
+    .type = BARISTA_JSON_ARRAY,
+    .offset = offsetof(Menu, items),
+    .size = sizeof(MenuItem),
+    .fields = kMenuItemFields,
+    .capacity = MAX_MENU_ITEMS,
+    .count_offset = offsetof(Menu, count),
+};
+
 // Load menu from JSON file
 Menu* load_menu_json(const char* filename) {
     char path[512];
     snprintf(path, sizeof(path), "%s/.config/sketchybar/data/%s.json",
              getenv("HOME"), filename);
 
-    FILE* f = fopen(path, "r");
-    if (!f) return NULL;
-
-    fseek(f, 0, SEEK_END);
-    long size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-
-    char* buffer = malloc(size + 1);
-    fread(buffer, 1, size, f);
-    buffer[size] = '\0';
-    fclose(f);
-
     Menu* menu = (Menu*)calloc(1, sizeof(Menu));
+    if (!menu) return NULL;
+    if (barista_json_decode_file(path, &kMenuRoot, menu, NULL) < 0) {
+        free(menu);
+        return NULL;
+    }
+    return menu;
+}
 
-    // Simple JSON parsing
-    char* ptr = buffer;
-    while (*ptr && menu->count < MAX_MENU_ITEMS) {
-        // Find next menu item
-        char* item_start = strstr(ptr, "{");
-        if (!item_start) break;
-
-        char* item_end = strchr(item_start, '}');
-        if (!item_end) break;
-
-        MenuItem* item = &menu->items[menu->count];
-
-        // Parse type
-        char* type_ptr = strstr(item_start, "\"type\"");
-        if (type_ptr && type_ptr < item_end) {
-            char* val = strchr(type_ptr, ':');
-            if (val) {
-                if (strstr(val, "header")) item->type = MENU_HEADER;
-                else if (strstr(val, "separator")) item->type = MENU_SEPARATOR;
-                else if (strstr(val, "submenu")) item->type = MENU_SUBMENU;
-                else item->type = MENU_ITEM;
-            }
-        }
-
-        // Parse name
-        char* name_ptr = strstr(item_start, "\"name\"");
-        if (name_ptr && name_ptr < item_end) {
-            char* quote1 = strchr(name_ptr + 6, '\"');
-            if (quote1) {
-                char* quote2 = strchr(quote1 + 1, '\"');
-                if (quote2) {
-                    int len = quote2 - quote1 - 1;
-                    if (len > 0 && len < MAX_NAME_LEN) {
-                        strncpy(item->name, quote1 + 1, len);
-                        item->name[len] = '\0';
-                    }
-                }
-            }
-        }
-
-        // Parse label
-        char* label_ptr = strstr(item_start, "\"label\"");
-        if (label_ptr && label_ptr < item_end) {
-            char* quote1 = strchr(label_ptr + 7, '\"');
-            if (quote1) {
-                char* quote2 = strchr(quote1 + 1, '\"');
-                if (quote2) {
-                    int len = quote2 - quote1 - 1;
-                    if (len > 0 && len < MAX_NAME_LEN) {
-                        strncpy(item->label, quote1 + 1, len);
-                        item->label[len] = '\0';
-                    }
-                }
-            }
-        }
-
-        // Parse icon
-        char* icon_ptr = strstr(item_start, "\"icon\"");
-        if (icon_ptr && icon_ptr < item_end) {
-            char* quote1 = strchr(icon_ptr + 6, '\"');
-            if (quote1) {
-                char* quote2 = strchr(quote1 + 1, '\"');
-                if (quote2) {
-                    int len = quote2 - quote1 - 1;
-                    if (len > 0 && len < 16) {
-                        strncpy(item->icon, quote1 + 1, len);
-                        item->icon[len] = '\0';
-                    }
-                }
-            }
-        }
-
-        // Parse action
-        char* action_ptr = strstr(item_start, "\"action\"");
-        if (action_ptr && action_ptr < item_end) {
-            char* quote1 = strchr(action_ptr + 8, '\"');
-            if (quote1) {
-                char* quote2 = strchr(quote1 + 1, '\"');
-                if (quote2) {
-                    int len = quote2 - quote1 - 1;
-                    if (len > 0 && len < MAX_CMD_LEN) {
-                        strncpy(item->action, quote1 + 1, len);
-                        item->action[len] = '\0';
-                    }
-                }
-            }
-        }
-
-        // Parse shortcut
-        char* shortcut_ptr = strstr(item_start, "\"shortcut\"");
-        if (shortcut_ptr && shortcut_ptr < item_end) {
-            char* quote1 = strchr(shortcut_ptr + 10, '\"');
-            if (quote1) {
-                char* quote2 = strchr(quote1 + 1, '\"');
-                if (quote2) {
-                    int len = quote2 - quote1 - 1;
-                    if (len > 0 && len < 32) {
-                        strncpy(item->shortcut, quote1 + 1, len);
-                        item->shortcut[len] = '\0';
-                    }
-                }
-            }
-        }
+// Send a finished payload natively, exec'ing the CLI only if that fails
+static void send_payload(BaristaPayload* payload) {
+    size_t length = barista_payload_finish(payload);
+    if (length > 0) barista_sketchybar(payload->bytes, length, 0);
+}
 
-        menu->count++;
-        ptr = item_end + 1;
-    }
+// --add item <item> popup.<popup> --set <item>
+static void begin_popup_item(BaristaPayload* payload, const char* item_name,
+                             const char* popup_name) {
+    char position[MAX_NAME_LEN + 8];
+    snprintf(position, sizeof(position), "popup.%s", popup_name);
+    barista_payload_verb(payload, BARISTA_VERB_ADD);
+    barista_payload_token(payload, "item");
+    barista_payload_token(payload, item_name);
+    barista_payload_token(payload, position);
+    barista_payload_verb(payload, BARISTA_VERB_SET);
+    barista_payload_token(payload, item_name);
+}
 
-    free(buffer);
-    return menu;
+// Shared padding and background for clickable rows
+static void add_row_style(BaristaPayload* payload) {
+    barista_payload_property(payload, "icon.padding_left", "4");
+    barista_payload_property(payload, "icon.padding_right", "6");
+    barista_payload_property(payload, "label.padding_left", "6");
+    barista_payload_property(payload, "label.padding_right", "6");
+    barista_payload_property(payload, "background.corner_radius", "4");
+    barista_payload_property(payload, "background.height", "20");
+    barista_payload_property(payload, "background.drawing", "off");
 }
 
 // Render menu item to SketchyBar
 void render_menu_item(MenuItem* item, const char* popup_name, int index) {
-    char cmd[2048];
+    uint8_t arena[2048];
+    BaristaPayload payload;
     char item_name[256];
+    char script[MAX_CMD_LEN];
 
     snprintf(item_name, sizeof(item_name), "%s.item%d", popup_name, index);
+    barista_payload_init(&payload, arena, sizeof(arena));
+    begin_popup_item(&payload, item_name, popup_name);
 
     switch (item->type) {
         case MENU_HEADER:
-            snprintf(cmd, sizeof(cmd),
-                    "sketchybar --add item %s popup.%s "
-                    "--set %s icon='' label='%s' "
-                    "label.font='SF Pro:Bold:11.0' "
-                    "label.color=0xFF999999 "
-                    "background.drawing=off "
-                    "icon.drawing=off",
-                    item_name, popup_name,
-                    item_name, item->label);
+            barista_payload_property(&payload, "icon", "");
+            barista_payload_property(&payload, "label", item->label);
+            barista_payload_property(&payload, "label.font", "SF Pro:Bold:11.0");
+            barista_payload_property(&payload, "label.color", "0xFF999999");
+            barista_payload_property(&payload, "background.drawing", "off");
+            barista_payload_property(&payload, "icon.drawing", "off");
             break;
 
         case MENU_SEPARATOR:
-            snprintf(cmd, sizeof(cmd),
-                    "sketchybar --add item %s popup.%s "
-                    "--set %s icon='' label='───────────────' "
-                    "label.font='SF Pro:Regular:10.0' "
-                    "label.color=0xFF666666 "
-                    "background.drawing=off "
-                    "icon.drawing=off",
-                    item_name, popup_name,
-                    item_name);
+            barista_payload_property(&payload, "icon", "");
+            barista_payload_property(&payload, "label", "───────────────");
+            barista_payload_property(&payload, "label.font", "SF Pro:Regular:10.0");
+            barista_payload_property(&payload, "label.color", "0xFF666666");
+            barista_payload_property(&payload, "background.drawing", "off");
+            barista_payload_property(&payload, "icon.drawing", "off");
             break;
 
-        case MENU_SUBMENU:
-            snprintf(cmd, sizeof(cmd),
-                    "sketchybar --add item %s popup.%s "
-                    "--set %s icon='%s' label='%s  󰅂' "
-                    "icon.padding_left=4 icon.padding_right=6 "
-                    "label.padding_left=6 label.padding_right=6 "
-                    "background.corner_radius=4 background.height=20 "
-                    "background.drawing=off "
-                    "script='%s/.config/sketchybar/bin/submenu_hover'",
-                    item_name, popup_name,
-                    item_name, item->icon, item->label,
+        case MENU_SUBMENU: {
+            char label[MAX_NAME_LEN + 16];
+            snprintf(label, sizeof(label), "%s  󰅂", item->label);
+            snprintf(script, sizeof(script), "%s/.config/sketchybar/bin/submenu_hover",
                     getenv("HOME"));
+            barista_payload_property(&payload, "icon", item->icon);
+            barista_payload_property(&payload, "label", label);
+            add_row_style(&payload);
+            barista_payload_property(&payload, "script", script);
             break;
+        }
 
         case MENU_ITEM:
         default: {
@@ -223,34 +159,31 @@ void render_menu_item(MenuItem* item, const char* popup_name, int index) {
                 strcpy(label_with_shortcut, item->label);
             }
 
-            // Wrap action with menu_action helper
-            char wrapped_action[MAX_CMD_LEN];
+            // Wrap action with menu_action helper; a truncated command
+            // would run something else, so one that does not fit is dropped
+            char wrapped_action[MAX_CMD_LEN * 4];
+            int wrapped_length = 0;
             if (strlen(item->action) > 0) {
-                snprintf(wrapped_action, sizeof(wrapped_action),
+                wrapped_length = snprintf(wrapped_action, sizeof(wrapped_action),
                         "MENU_ACTION_CMD='%s' %s/.config/sketchybar/bin/menu_action '%s' '%s'",
                         item->action, getenv("HOME"), item_name, popup_name);
-            } else {
+            }
+            if (wrapped_length <= 0 || (size_t)wrapped_length >= sizeof(wrapped_action)) {
                 wrapped_action[0] = '\0';
             }
 
-            snprintf(cmd, sizeof(cmd),
-                    "sketchybar --add item %s popup.%s "
-                    "--set %s icon='%s' label='%s' "
-                    "icon.padding_left=4 icon.padding_right=6 "
-                    "label.padding_left=6 label.padding_right=6 "
-                    "background.corner_radius=4 background.height=20 "
-                    "background.drawing=off "
-                    "click_script='%s' "
-                    "script='%s/.config/sketchybar/bin/popup_hover'",
-                    item_name, popup_name,
-                    item_name, item->icon, label_with_shortcut,
-                    wrapped_action,
+            snprintf(script, sizeof(script), "%s/.config/sketchybar/bin/popup_hover",
                     getenv("HOME"));
+            barista_payload_property(&payload, "icon", item->icon);
+            barista_payload_property(&payload, "label", label_with_shortcut);
+            add_row_style(&payload);
+            barista_payload_property(&payload, "click_script", wrapped_action);
+            barista_payload_property(&payload, "script", script);
             break;
         }
     }
 
-    system(cmd);
+    send_payload(&payload);
 }
 
 // Render submenu
@@ -261,14 +194,24 @@ void render_submenu(MenuItem* parent, const char* parent_popup) {
     snprintf(submenu_name, sizeof(submenu_name), "%s.%s", parent_popup, parent->name);
 
     // Create submenu bracket
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd),
-            "sketchybar --add bracket %s_bracket %s.* "
-            "--set %s_bracket background.drawing=on "
-            "background.color=0xE021162F "
-            "background.corner_radius=8",
-            submenu_name, submenu_name, submenu_name);
-    system(cmd);
+    char bracket[sizeof(submenu_name) + 8];
+    char members[sizeof(submenu_name) + 2];
+    snprintf(bracket, sizeof(bracket), "%s_bracket", submenu_name);
+    snprintf(members, sizeof(members), "%s.*", submenu_name);
+
+    uint8_t arena[1024];
+    BaristaPayload payload;
+    barista_payload_init(&payload, arena, sizeof(arena));
+    barista_payload_verb(&payload, BARISTA_VERB_ADD);
+    barista_payload_token(&payload, "bracket");
+    barista_payload_token(&payload, bracket);
+    barista_payload_token(&payload, members);
+    barista_payload_verb(&payload, BARISTA_VERB_SET);
+    barista_payload_token(&payload, bracket);
+    barista_payload_property(&payload, "background.drawing", "on");
+    barista_payload_property(&payload, "background.color", "0xE021162F");
+    barista_payload_property(&payload, "background.corner_radius", "8");
+    send_payload(&payload);
 
     // Render submenu items
     for (int i = 0; i < parent->submenu_count; i++) {
@@ -276,6 +219,19 @@ void render_submenu(MenuItem* parent, const char* parent_popup) {
     }
 }
 
+// --remove every item whose name matches /popup.<popup_name>\..*/
+static void clear_popup_items(const char* popup_name) {
+    char pattern[MAX_NAME_LEN * 2];
+    snprintf(pattern, sizeof(pattern), "/popup.%s\\..*/", popup_name);
+
+    uint8_t arena[512];
+    BaristaPayload payload;
+    barista_payload_init(&payload, arena, sizeof(arena));
+    barista_payload_verb(&payload, BARISTA_VERB_REMOVE);
+    barista_payload_token(&payload, pattern);
+    send_payload(&payload);
+}
+
 // Render entire menu
 void render_menu(Menu* menu, const char* popup_name) {
     if (!menu) return;
@@ -283,9 +239,7 @@ void render_menu(Menu* menu, const char* popup_name) {
     strcpy(menu->popup_name, popup_name);
 
     // Clear existing popup items
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "sketchybar --remove '/popup.%s\\..*/'", popup_name);
-    system(cmd);
+    clear_popup_items(popup_name);
 
     // Render all menu items
     for (int i = 0; i < menu->count; i++) {
@@ -300,7 +254,9 @@ void render_menu(Menu* menu, const char* popup_name) {
 
 // Batch render multiple menus
 void batch_render_menus(const char* menu_names[], int count) {
-    char batch_cmd[8192] = "sketchybar";
+    static uint8_t arena[8192];
+    BaristaPayload payload;
+    barista_payload_init(&payload, arena, sizeof(arena));
 
     for (int m = 0; m < count; m++) {
         Menu* menu = load_menu_json(menu_names[m]);
@@ -309,23 +265,20 @@ void batch_render_menus(const char* menu_names[], int count) {
         char popup_name[128];
         snprintf(popup_name, sizeof(popup_name), "%s_popup", menu_names[m]);
 
-        for (int i = 0; i < menu->count && strlen(batch_cmd) < 7000; i++) {
+        for (int i = 0; i < menu->count && payload.length < 7000; i++) {
             MenuItem* item = &menu->items[i];
             char item_name[256];
             snprintf(item_name, sizeof(item_name), "%s.item%d", popup_name, i);
 
-            char item_cmd[512];
-            snprintf(item_cmd, sizeof(item_cmd),
-                    " --add item %s popup.%s --set %s icon='%s' label='%s'",
-                    item_name, popup_name, item_name, item->icon, item->label);
-
-            strcat(batch_cmd, item_cmd);
+            begin_popup_item(&payload, item_name, popup_name);
+            barista_payload_property(&payload, "icon", item->icon);
+            barista_payload_property(&payload, "label", item->label);
         }
 
         free(menu);
     }
 
-    system(batch_cmd);
+    send_payload(&payload);
 }
 
 // Cache rendered menus
@@ -403,9 +356,7 @@ int main(int argc, char* argv[]) {
         }
     }
     else if (strcmp(argv[1], "clear") == 0 && argc >= 3) {
-        char cmd[256];
-        snprintf(cmd, sizeof(cmd), "sketchybar --remove '/popup.%s\\..*/'", argv[2]);
-        system(cmd);
+        clear_popup_items(argv[2]);
     }
 
     return 0;
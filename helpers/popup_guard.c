@@ -4,6 +4,9 @@
 #include <unistd.h>
 #include <limits.h>
 
+#include "barista_cli.h"
+#include "barista_payload.h"
+
 // Popup Guard - Prevents main popup from closing when submenus are open
 // Usage: sketchybar --set apple_menu script=popup_guard --subscribe apple_menu mouse.exited mouse.exited.global
 
@@ -36,9 +39,14 @@ int main(void) {
     }
     // Only close if no submenu is open
     if (!is_submenu_open()) {
-      char cmd[256];
-      snprintf(cmd, sizeof(cmd), "sketchybar --set %s popup.drawing=off", name);
-      system(cmd);
+      uint8_t arena[256];
+      BaristaPayload payload;
+      barista_payload_init(&payload, arena, sizeof(arena));
+      barista_payload_verb(&payload, BARISTA_VERB_SET);
+      barista_payload_token(&payload, name);
+      barista_payload_property(&payload, "popup.drawing", "off");
+      size_t length = barista_payload_finish(&payload);
+      if (length > 0) barista_sketchybar(arena, length, 0);
     }
     // If submenu is open, do nothing - let submenu control dismissal
   }
@@ -5,19 +5,49 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+#include "barista_cli.h"
+#include "barista_payload.h"
 
 #define MAX_CMD 512
+#define MAX_YABAI_ARGS 16
 
-// Execute yabai command and trigger sketchybar update
+// Execute `yabai -m <cmd>` directly, with stderr discarded
 static void yabai_exec(const char *cmd) {
-    char full_cmd[MAX_CMD];
-    snprintf(full_cmd, sizeof(full_cmd), "yabai -m %s 2>/dev/null", cmd);
-    system(full_cmd);
+    char words[MAX_CMD];
+    char *argv[MAX_YABAI_ARGS + 3] = {"yabai", "-m"};
+    int argc = 2;
+    snprintf(words, sizeof(words), "%s", cmd);
+    for (char *word = strtok(words, " "); word && argc < MAX_YABAI_ARGS + 2;
+         word = strtok(NULL, " ")) {
+        argv[argc++] = word;
+    }
+    argv[argc] = NULL;
+
+    pid_t pid = fork();
+    if (pid < 0) return;
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) dup2(null_fd, STDERR_FILENO);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {
+    }
 }
 
-// Trigger sketchybar refresh
+// Trigger sketchybar refresh; the native send does not wait for the bar
 static void trigger_refresh() {
-    system("sketchybar --trigger space_change 2>/dev/null &");
+    uint8_t arena[64];
+    BaristaPayload payload;
+    barista_payload_init(&payload, arena, sizeof(arena));
+    barista_payload_verb(&payload, BARISTA_VERB_TRIGGER);
+    barista_payload_token(&payload, "space_change");
+    size_t length = barista_payload_finish(&payload);
+    if (length > 0) barista_sketchybar(arena, length, 0);
 }
 
 // Create new space
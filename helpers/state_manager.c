@@ -1,7 +1,32 @@
 // State Manager - High-performance C-based state management with SketchyBar API
+//
+// The state lives in a shared memory segment. Any number of processes read
+// it without locking through a seqlock; writers take a robust lock, edit a
+// private copy and publish it in one commit.
+//
+// `state_manager serve` keeps the state resident: it watches state.json for
+// outside edits (inotify on Linux, kqueue on macOS), answers the CLI's
+// commands over $TMPDIR/barista_state.<BAR_NAME>.sock, and after every
+// change pushes only the widget, space and appearance fields the bar shows
+// that changed, as one payload. CLI invocations hand their command to a
+// listening daemon and fall back to running it here.
+//
+// Next to state.json it keeps state.json.snapshot, a binary copy the Lua
+// side maps at startup instead of decoding the JSON.
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE 1
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -9,19 +34,61 @@
 #include <pthread.h>
 #include <time.h>
 #include <signal.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#ifdef __APPLE__
+#include <sys/event.h>
+#else
+#include <sys/inotify.h>
+#endif
+
+#include "barista_cli.h"
+#include "barista_json.h"
+#include "barista_payload.h"
+#include "barista_snapshot.h"
 
 #define STATE_FILE_PATH "/tmp/sketchybar_state.mmap"
+#define STATE_STRINGIFY_(x) #x
+#define STATE_STRINGIFY(x) STATE_STRINGIFY_(x)
+#define STATE_MAGIC 0x42535432u  // "BST2"
+#define STATE_LAYOUT_VERSION 3
+#define STATE_LEGACY_LAYOUT_VERSION 2
+// Named after the layout, so builds with different layouts never share (or
+// unlink) each other's segment.
+#define STATE_SHM_NAME "/sketchybar_state.v" STATE_STRINGIFY(STATE_LAYOUT_VERSION)
+#define STATE_LEGACY_SHM_NAME "/sketchybar_state.v" STATE_STRINGIFY(STATE_LEGACY_LAYOUT_VERSION)
+#define STATE_SHM_NAME_MAX 30
+#ifdef __APPLE__
+// macOS sizes a shared memory object only once, so it starts with room for
+// far more than a bar holds; pages the image never reaches are never touched.
+#define STATE_SEGMENT_INITIAL_BYTES (1024u * 1024u)
+#else
+#define STATE_SEGMENT_INITIAL_BYTES 4096u
+#endif
+#define STATE_LOCK_WAIT_ROUNDS 2000  // 1 ms each
+#define STATE_READ_SPINS 4096
 #define CONFIG_PATH_FMT "%s/.config/sketchybar/state.json"
-#define MAX_WIDGETS 20
-#define MAX_SPACES 16
 #define MAX_STRING_LEN 256
-#define MAX_ICON_LEN 16
+#define MAX_RECENT_ROMS 5
+#define MAX_BAR_NAME_BYTES 128
+#define STATE_MAX_CLIENTS 32
+#define STATE_MAX_ARGS 8
+#define STATE_REPLY_BYTES 4096
+#define STATE_READ_TIMEOUT_MS 50
+#define STATE_REPLY_TIMEOUT_MS 2000
+#define STATE_RELOAD_SETTLE_MS 30  // editors write in several steps
+#define STATE_SAVE_QUIET_MS 500    // state.json is written once changes settle
+#define STATE_SAVE_MAX_DELAY_MS 5000
+#define STATE_SAVE_MAX_QUIET_MS 60000
+// Reply flag understood only by the CLI: the daemon did not know the command.
+#define STATE_FRAME_USAGE 0x100u
 
 // Widget configuration
 typedef struct {
     char name[64];
     int enabled;
-    char icon[MAX_ICON_LEN];
+    char* icon;  // owned; NULL when unset
     uint32_t color;
     float scale;
     int update_interval;
@@ -29,7 +96,7 @@ typedef struct {
 
 // Space configuration
 typedef struct {
-    char icon[MAX_ICON_LEN];
+    char* icon;    // owned; NULL when unset
     char mode[16]; // bsp, stack, float
     int active;
 } SpaceConfig;
@@ -51,21 +118,30 @@ typedef struct {
     int yaze_enabled;
     int emacs_enabled;
     int halext_enabled;
-    char yaze_recent_roms[5][MAX_STRING_LEN];
+    char yaze_recent_roms[MAX_RECENT_ROMS][MAX_STRING_LEN];
     char emacs_workspace[64];
 } Integrations;
 
-// Shared state structure (memory-mapped)
+// The state as each process works on it. The segment holds it encoded as a
+// StateImage, sized to what is in use. Widgets, spaces and icons are kept on
+// the heap at the size they need, so nothing but memory bounds them; a name
+// or mode longer than its field is refused with an error when set and
+// reported when state.json is loaded, never silently cut short.
+//
+// A StateData starts zeroed and hands its storage back with state_free();
+// read_state(), begin_write() and state_copy() replace what it held.
 typedef struct {
-    pthread_mutex_t lock;
     time_t last_update;
 
     // Widgets
-    WidgetConfig widgets[MAX_WIDGETS];
+    WidgetConfig* widgets;
     int widget_count;
+    int widget_capacity;
 
-    // Spaces
-    SpaceConfig spaces[MAX_SPACES];
+    // Spaces 1..space_count; later ones are empty
+    SpaceConfig* spaces;
+    int space_count;
+    int space_capacity;
 
     // Appearance
     Appearance appearance;
@@ -81,415 +157,2445 @@ typedef struct {
     // Change tracking
     uint32_t version;
     int dirty;
+} StateData;
+
+// Segment image, layout 3: this fixed part, then tables of widgets, spaces
+// and recent ROMs, then an arena of NUL-terminated strings filled front to
+// back. Tables and arena are found through the byte offsets below, strings
+// through offsets into the arena, with 0 for the empty string. Counts and
+// strings take only the room they need.
+typedef struct {
+    uint32_t widget_count;
+    uint32_t space_count;   // spaces 1..space_count; later ones are empty
+    uint32_t rom_count;
+    uint32_t widget_table;  // byte offsets from the start of the image
+    uint32_t space_table;
+    uint32_t rom_table;
+    uint32_t arena;
+    uint32_t arena_bytes;
+    int64_t last_update;
+    uint64_t icon_lookups;
+    uint64_t state_updates;
+    uint64_t cache_hits;
+    uint32_t version;
+    int32_t dirty;
+    int32_t bar_height;
+    int32_t corner_radius;
+    uint32_t bar_color;
+    int32_t blur_radius;
+    float widget_scale;
+    float font_size;
+    uint32_t font_family;   // arena offsets
+    uint32_t font_style;
+    int32_t yaze_enabled;
+    int32_t emacs_enabled;
+    int32_t halext_enabled;
+    uint32_t emacs_workspace;
+} StateImage;
+
+typedef struct {
+    uint32_t name;  // arena offsets
+    uint32_t icon;
+    int32_t enabled;
+    uint32_t color;
+    float scale;
+    int32_t update_interval;
+} StateImageWidget;
+
+typedef struct {
+    uint32_t icon;  // arena offsets
+    uint32_t mode;
+    int32_t active;
+} StateImageSpace;
+
+// Segment header. `magic` is stored last, once the writer lock is usable, so
+// a segment without it is either brand new or was abandoned mid-setup by
+// `init_owner`. Writers serialise on the lock and publish through
+// `sequence`, which is odd while a commit is being copied in; readers never
+// take the lock and retry a copy that overlapped a commit.
+typedef struct {
+    uint32_t magic;
+    uint32_t layout_version;
+    uint64_t segment_bytes;  // grows, never shrinks
+    uint32_t init_owner;  // pid setting the header up, 0 otherwise
+    uint32_t writer_pid;  // macOS writer lock: owner's pid, 0 when free
+    uint64_t sequence;    // twice the generation; odd mid-commit
+#ifndef __APPLE__
+    pthread_mutex_t write_lock;  // robust, process-shared
+#endif
+} StateHeader;
+
+typedef struct {
+    StateHeader header;
+    uint64_t image_bytes;  // length of the image in `words`; set mid-commit
+    uint64_t words[];      // the image, then room for it to grow
 } SharedState;
 
+#define STATE_FIELD_BYTES(type, field) sizeof(((type*)0)->field)
+
+// Layout 2 kept a fixed-capacity StateData behind the same header. It is only
+// read, to carry its state over into a layout 3 segment.
+#define LEGACY_MAX_WIDGETS 20
+#define LEGACY_MAX_SPACES 16
+#define LEGACY_MAX_ICON_LEN 16
+
+typedef struct {
+    char name[64];
+    int enabled;
+    char icon[LEGACY_MAX_ICON_LEN];
+    uint32_t color;
+    float scale;
+    int update_interval;
+} LegacyWidgetConfig;
+
+typedef struct {
+    char icon[LEGACY_MAX_ICON_LEN];
+    char mode[16];
+    int active;
+} LegacySpaceConfig;
+
+typedef struct {
+    time_t last_update;
+    LegacyWidgetConfig widgets[LEGACY_MAX_WIDGETS];
+    int widget_count;
+    LegacySpaceConfig spaces[LEGACY_MAX_SPACES];
+    Appearance appearance;
+    Integrations integrations;
+    uint64_t icon_lookups;
+    uint64_t state_updates;
+    uint64_t cache_hits;
+    uint32_t version;
+    int dirty;
+} LegacyStateData;
+
+#define LEGACY_WORDS ((sizeof(LegacyStateData) + sizeof(uint64_t) - 1) / sizeof(uint64_t))
+
+typedef struct {
+    StateHeader header;
+    union {
+        LegacyStateData data;
+        uint64_t words[LEGACY_WORDS];
+    } body;
+} LegacySharedState;
+
 static SharedState* state = NULL;
+static size_t state_mapped = 0;  // bytes of the segment mapped here
 static int state_fd = -1;
 
+// Images are built here by writers and copied here by readers, grown to the
+// largest seen
+static uint64_t* g_image = NULL;
+static size_t g_image_bytes = 0;
+
+static void sleep_milliseconds(long milliseconds) {
+    struct timespec delay = {milliseconds / 1000, (milliseconds % 1000) * 1000000L};
+    nanosleep(&delay, NULL);
+}
+
+static int process_gone(uint32_t pid) {
+    return pid != 0 && kill((pid_t)pid, 0) != 0 && errno == ESRCH;
+}
+
+// BARISTA_STATE_SHM names a private segment (tests, side-by-side bars).
+static const char* state_segment_name(void) {
+    const char* name = getenv("BARISTA_STATE_SHM");
+    if (name && name[0] == '/' && strchr(name + 1, '/') == NULL
+        && strlen(name) > 1 && strlen(name) <= STATE_SHM_NAME_MAX) {
+        return name;
+    }
+    return STATE_SHM_NAME;
+}
+
+// Takes the writer lock, or with `wait` false only tries to. Returns 0 when
+// taken, 1 when taken from a writer that died holding it (its commit may be
+// half copied in), and -1 when the lock is busy or broken.
+static int writer_lock(StateHeader* header, int wait) {
+#ifdef __APPLE__
+    // No robust pthread mutexes on macOS: a dead owner's pid is taken over.
+    uint32_t self = (uint32_t)getpid();
+    for (int round = 0; ; round++) {
+        uint32_t owner = 0;
+        if (__atomic_compare_exchange_n(&header->writer_pid, &owner, self, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return 0;
+        }
+        if (process_gone(owner)
+            && __atomic_compare_exchange_n(&header->writer_pid, &owner, self, 0,
+                                           __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return 1;
+        }
+        if (!wait || round >= STATE_LOCK_WAIT_ROUNDS) return -1;
+        sleep_milliseconds(1);
+    }
+#else
+    int result = wait ? pthread_mutex_lock(&header->write_lock)
+                      : pthread_mutex_trylock(&header->write_lock);
+    if (result == 0) return 0;
+    if (result == EOWNERDEAD) {
+        pthread_mutex_consistent(&header->write_lock);
+        return 1;
+    }
+    return -1;
+#endif
+}
+
+static void writer_unlock(StateHeader* header) {
+#ifdef __APPLE__
+    __atomic_store_n(&header->writer_pid, 0, __ATOMIC_RELEASE);
+#else
+    pthread_mutex_unlock(&header->write_lock);
+#endif
+}
+
+static void init_header(StateHeader* header, size_t size) {
+#ifndef __APPLE__
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&header->write_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+#endif
+    header->writer_pid = 0;
+    header->layout_version = STATE_LAYOUT_VERSION;
+    header->segment_bytes = size;
+    __atomic_store_n(&header->sequence, 0, __ATOMIC_RELAXED);
+}
+
+// Sets the header up exactly once per segment. Returns 0 when the segment is
+// usable, 1 when it was laid out by an incompatible build, -1 on timeout.
+static int attach_state(SharedState* shared, size_t size) {
+    StateHeader* header = &shared->header;
+    uint32_t self = (uint32_t)getpid();
+    for (int round = 0; ; round++) {
+        if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) == STATE_MAGIC) {
+            uint64_t bytes = __atomic_load_n(&header->segment_bytes, __ATOMIC_ACQUIRE);
+            return header->layout_version == STATE_LAYOUT_VERSION
+                && bytes >= sizeof(SharedState) ? 0 : 1;
+        }
+        uint32_t owner = 0;
+        if (__atomic_compare_exchange_n(&header->init_owner, &owner, self, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) == STATE_MAGIC) {
+                // Set up by someone else between the two checks.
+                __atomic_store_n(&header->init_owner, 0, __ATOMIC_RELEASE);
+                continue;
+            }
+            // Zero-filled when new; emptied again if a setup died half way.
+            // Nothing past image_bytes is ever read.
+            memset((char*)shared + sizeof(StateHeader), 0, sizeof(SharedState) - sizeof(StateHeader));
+            init_header(header, size);
+            __atomic_store_n(&header->magic, STATE_MAGIC, __ATOMIC_RELEASE);
+            __atomic_store_n(&header->init_owner, 0, __ATOMIC_RELEASE);
+            return 0;
+        }
+        if (process_gone(owner)) {
+            __atomic_compare_exchange_n(&header->init_owner, &owner, 0, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (round >= STATE_LOCK_WAIT_ROUNDS) return -1;
+        sleep_milliseconds(1);
+    }
+}
+
+// Maps the segment again once another process has grown it. The object only
+// ever grows, so the old mapping stays valid for what it covers until then.
+static int remap_state(void) {
+    size_t size = (size_t)__atomic_load_n(&state->header.segment_bytes, __ATOMIC_ACQUIRE);
+    if (size <= state_mapped) return 0;
+    void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, state_fd, 0);
+    if (mapping == MAP_FAILED) return -1;
+    munmap(state, state_mapped);
+    state = mapping;
+    state_mapped = size;
+    return 0;
+}
+
+// Grows the segment until an image of `bytes` fits. On macOS it keeps the
+// size it was created at. The writer lock is held.
+static int reserve_state(size_t bytes) {
+    if (remap_state() != 0) return -1;
+    size_t needed = sizeof(SharedState) + bytes;
+    size_t size = (size_t)state->header.segment_bytes;
+    if (needed <= size) return 0;
+#ifdef __APPLE__
+    return -1;
+#else
+    while (size < needed) size = size > SIZE_MAX / 2 ? needed : size * 2;
+    if (ftruncate(state_fd, (off_t)size) != 0) return -1;
+    __atomic_store_n(&state->header.segment_bytes, (uint64_t)size, __ATOMIC_RELEASE);
+    return remap_state();
+#endif
+}
+
+// Grows g_image to hold `bytes`
+static int reserve_image(size_t bytes) {
+    if (bytes <= g_image_bytes) return 0;
+    size_t capacity = g_image_bytes > 0 ? g_image_bytes : 4096;
+    while (capacity < bytes) capacity = capacity > SIZE_MAX / 2 ? bytes : capacity * 2;
+    capacity = (capacity + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+    uint64_t* grown = realloc(g_image, capacity);
+    if (!grown) return -1;
+    g_image = grown;
+    g_image_bytes = capacity;
+    return 0;
+}
+
+// An unset text field reads as empty
+static const char* text_or_empty(const char* text) {
+    return text ? text : "";
+}
+
+// Replaces an owned text field with a copy of `value`, or NULL for an empty
+// one; 0, leaving it alone, when out of memory
+static int set_text(char** field, const char* value) {
+    char* copy = NULL;
+    if (value && value[0] != '\0' && !(copy = strdup(value))) return 0;
+    free(*field);
+    *field = copy;
+    return 1;
+}
+
+// Grows an array of `size`-byte entries to hold `count`, zeroing the new
+// ones; NULL, leaving it alone, when out of memory
+static void* grow_array(void* array, int* capacity, int count, size_t size) {
+    if (count <= *capacity) return array;
+    int wanted = *capacity > 0 ? *capacity : 8;
+    while (wanted < count) wanted = wanted > INT_MAX / 2 ? count : wanted * 2;
+    if ((size_t)wanted > SIZE_MAX / size) return NULL;
+    char* grown = realloc(array, (size_t)wanted * size);
+    if (!grown) return NULL;
+    memset(grown + (size_t)*capacity * size, 0, (size_t)(wanted - *capacity) * size);
+    *capacity = wanted;
+    return grown;
+}
+
+// Appends an empty widget; NULL when out of memory
+static WidgetConfig* add_widget(StateData* data) {
+    WidgetConfig* widgets = grow_array(data->widgets, &data->widget_capacity,
+                                       data->widget_count + 1, sizeof(*widgets));
+    if (!widgets) return NULL;
+    data->widgets = widgets;
+    WidgetConfig* widget = &widgets[data->widget_count++];
+    free(widget->icon);  // left by a widget that was dropped
+    memset(widget, 0, sizeof(*widget));
+    return widget;
+}
+
+// Space `number`, from 1, adding empty spaces up to it; NULL when out of
+// memory
+static SpaceConfig* space_at(StateData* data, int number) {
+    if (number < 1) return NULL;
+    if (number > data->space_count) {
+        SpaceConfig* spaces = grow_array(data->spaces, &data->space_capacity, number, sizeof(*spaces));
+        if (!spaces) return NULL;
+        data->spaces = spaces;
+        data->space_count = number;
+    }
+    return &data->spaces[number - 1];
+}
+
+// Space `index`, from 0, for reading; one past space_count is empty
+static const SpaceConfig* space_or_empty(const StateData* data, int index) {
+    static const SpaceConfig empty;
+    return index >= 0 && index < data->space_count ? &data->spaces[index] : &empty;
+}
+
+static void state_free(StateData* data) {
+    for (int i = 0; i < data->widget_capacity; i++) free(data->widgets[i].icon);
+    for (int i = 0; i < data->space_count; i++) free(data->spaces[i].icon);
+    free(data->widgets);
+    free(data->spaces);
+    memset(data, 0, sizeof(*data));
+}
+
+// Makes *to a copy of *from, widgets, spaces and icons included; -1, leaving
+// it empty, when out of memory
+static int state_copy(StateData* to, const StateData* from) {
+    if (to == from) return 0;
+    state_free(to);
+    *to = *from;
+    to->widgets = NULL;
+    to->widget_count = to->widget_capacity = 0;
+    to->spaces = NULL;
+    to->space_count = to->space_capacity = 0;
+    for (int i = 0; i < from->widget_count; i++) {
+        WidgetConfig* widget = add_widget(to);
+        if (!widget) goto failed;
+        *widget = from->widgets[i];
+        widget->icon = NULL;
+        if (!set_text(&widget->icon, from->widgets[i].icon)) goto failed;
+    }
+    if (from->space_count > 0 && !space_at(to, from->space_count)) goto failed;
+    for (int i = 0; i < from->space_count; i++) {
+        to->spaces[i] = from->spaces[i];
+        to->spaces[i].icon = NULL;
+        if (!set_text(&to->spaces[i].icon, from->spaces[i].icon)) goto failed;
+    }
+    return 0;
+failed:
+    state_free(to);
+    return -1;
+}
+
+// Whether *a and *b hold the same state; spaces past the last one set count
+// as empty either way
+static int state_equal(const StateData* a, const StateData* b) {
+    if (a->widget_count != b->widget_count || a->last_update != b->last_update
+        || a->icon_lookups != b->icon_lookups || a->state_updates != b->state_updates
+        || a->cache_hits != b->cache_hits || a->version != b->version || a->dirty != b->dirty
+        || memcmp(&a->appearance, &b->appearance, sizeof(a->appearance)) != 0
+        || memcmp(&a->integrations, &b->integrations, sizeof(a->integrations)) != 0) {
+        return 0;
+    }
+    for (int i = 0; i < a->widget_count; i++) {
+        const WidgetConfig* x = &a->widgets[i];
+        const WidgetConfig* y = &b->widgets[i];
+        if (strcmp(x->name, y->name) != 0 || x->enabled != y->enabled
+            || strcmp(text_or_empty(x->icon), text_or_empty(y->icon)) != 0 || x->color != y->color
+            || x->scale != y->scale || x->update_interval != y->update_interval) {
+            return 0;
+        }
+    }
+    int spaces = a->space_count > b->space_count ? a->space_count : b->space_count;
+    for (int i = 0; i < spaces; i++) {
+        const SpaceConfig* x = space_or_empty(a, i);
+        const SpaceConfig* y = space_or_empty(b, i);
+        if (strcmp(text_or_empty(x->icon), text_or_empty(y->icon)) != 0
+            || strcmp(x->mode, y->mode) != 0 || x->active != y->active) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+typedef struct {
+    uint8_t* bytes;
+    size_t capacity;
+    size_t used;
+    int failed;
+} ImageArena;
+
+static uint32_t arena_put(ImageArena* arena, const char* text) {
+    size_t length = strlen(text);
+    if (length == 0) return 0;
+    if (arena->used + length + 1 > arena->capacity) {
+        arena->failed = 1;
+        return 0;
+    }
+    uint32_t offset = (uint32_t)arena->used;
+    memcpy(arena->bytes + arena->used, text, length + 1);
+    arena->used += length + 1;
+    return offset;
+}
+
+static int space_empty(const SpaceConfig* space) {
+    return !space->icon && space->mode[0] == '\0' && !space->active;
+}
+
+// Spaces up to the last one that is set; the image stores no more
+static int spaces_in_use(const StateData* data) {
+    int count = data->space_count;
+    while (count > 0 && space_empty(&data->spaces[count - 1])) count--;
+    return count;
+}
+
+// The most bytes encode_image() needs for *data
+static size_t image_bound(const StateData* data) {
+    int space_count = spaces_in_use(data);
+    size_t bytes = sizeof(StateImage) + (size_t)data->widget_count * sizeof(StateImageWidget)
+        + (size_t)space_count * sizeof(StateImageSpace) + MAX_RECENT_ROMS * sizeof(uint32_t)
+        + sizeof(uint64_t) + 1;
+    for (int i = 0; i < data->widget_count; i++) {
+        bytes += strlen(data->widgets[i].name) + strlen(text_or_empty(data->widgets[i].icon)) + 2;
+    }
+    for (int i = 0; i < space_count; i++) {
+        bytes += strlen(text_or_empty(data->spaces[i].icon)) + strlen(data->spaces[i].mode) + 2;
+    }
+    for (int i = 0; i < MAX_RECENT_ROMS; i++) bytes += strlen(data->integrations.yaze_recent_roms[i]) + 1;
+    return bytes + strlen(data->appearance.font_family) + strlen(data->appearance.font_style)
+        + strlen(data->integrations.emacs_workspace) + 3;
+}
+
+// Lays *data out as an image in `words`; returns its length, a multiple of
+// 8, or 0 when it does not fit in `capacity` bytes
+static size_t encode_image(const StateData* data, uint64_t* words, size_t capacity) {
+    int widget_count = data->widget_count > 0 ? data->widget_count : 0;
+    int space_count = spaces_in_use(data);
+    int rom_count = MAX_RECENT_ROMS;
+    while (rom_count > 0 && data->integrations.yaze_recent_roms[rom_count - 1][0] == '\0') rom_count--;
+    // Offsets in the image are 32-bit.
+    if (capacity > UINT32_MAX) capacity = UINT32_MAX & ~(sizeof(uint64_t) - 1);
+    if (sizeof(StateImage) + (size_t)widget_count * sizeof(StateImageWidget)
+        + (size_t)space_count * sizeof(StateImageSpace) >= capacity) {
+        return 0;
+    }
+
+    StateImage image;
+    memset(&image, 0, sizeof(image));
+    image.widget_count = (uint32_t)widget_count;
+    image.space_count = (uint32_t)space_count;
+    image.rom_count = (uint32_t)rom_count;
+    image.widget_table = sizeof(StateImage);
+    image.space_table = image.widget_table + (uint32_t)(widget_count * sizeof(StateImageWidget));
+    image.rom_table = image.space_table + (uint32_t)(space_count * sizeof(StateImageSpace));
+    image.arena = image.rom_table + (uint32_t)(rom_count * sizeof(uint32_t));
+    if (image.arena + 1 > capacity) return 0;
+
+    uint8_t* base = (uint8_t*)words;
+    ImageArena arena = {base + image.arena, capacity - image.arena, 1, 0};
+    arena.bytes[0] = '\0';
+    for (int i = 0; i < widget_count; i++) {
+        const WidgetConfig* widget = &data->widgets[i];
+        StateImageWidget entry = {
+            arena_put(&arena, widget->name), arena_put(&arena, text_or_empty(widget->icon)),
+            widget->enabled, widget->color, widget->scale, widget->update_interval,
+        };
+        memcpy(base + image.widget_table + i * sizeof(entry), &entry, sizeof(entry));
+    }
+    for (int i = 0; i < space_count; i++) {
+        const SpaceConfig* space = &data->spaces[i];
+        StateImageSpace entry = {
+            arena_put(&arena, text_or_empty(space->icon)), arena_put(&arena, space->mode), space->active,
+        };
+        memcpy(base + image.space_table + i * sizeof(entry), &entry, sizeof(entry));
+    }
+    for (int i = 0; i < rom_count; i++) {
+        uint32_t offset = arena_put(&arena, data->integrations.yaze_recent_roms[i]);
+        memcpy(base + image.rom_table + i * sizeof(offset), &offset, sizeof(offset));
+    }
+
+    const Appearance* appearance = &data->appearance;
+    image.last_update = (int64_t)data->last_update;
+    image.icon_lookups = data->icon_lookups;
+    image.state_updates = data->state_updates;
+    image.cache_hits = data->cache_hits;
+    image.version = data->version;
+    image.dirty = data->dirty;
+    image.bar_height = appearance->bar_height;
+    image.corner_radius = appearance->corner_radius;
+    image.bar_color = appearance->bar_color;
+    image.blur_radius = appearance->blur_radius;
+    image.widget_scale = appearance->widget_scale;
+    image.font_size = appearance->font_size;
+    image.font_family = arena_put(&arena, appearance->font_family);
+    image.font_style = arena_put(&arena, appearance->font_style);
+    image.yaze_enabled = data->integrations.yaze_enabled;
+    image.emacs_enabled = data->integrations.emacs_enabled;
+    image.halext_enabled = data->integrations.halext_enabled;
+    image.emacs_workspace = arena_put(&arena, data->integrations.emacs_workspace);
+    if (arena.failed) return 0;
+    image.arena_bytes = (uint32_t)arena.used;
+    memcpy(base, &image, sizeof(image));
+
+    size_t length = image.arena + arena.used;
+    size_t padded = (length + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+    if (padded > capacity) return 0;
+    memset(base + length, 0, padded - length);
+    return padded;
+}
+
+// Copies arena string `offset` into out. One that runs off the arena, as in
+// an image left torn by a writer that died, or that does not fit reads as
+// empty.
+static void image_text(const uint8_t* arena, size_t arena_bytes, uint32_t offset,
+                       char* out, size_t capacity) {
+    out[0] = '\0';
+    if (offset >= arena_bytes) return;
+    const uint8_t* end = memchr(arena + offset, '\0', arena_bytes - offset);
+    if (!end || (size_t)(end - (arena + offset)) >= capacity) return;
+    memcpy(out, arena + offset, (size_t)(end - (arena + offset)) + 1);
+}
+
+// Arena string `offset` as an owned copy, or NULL when empty or torn
+static char* image_copy(const uint8_t* arena, size_t arena_bytes, uint32_t offset) {
+    if (offset >= arena_bytes || arena[offset] == '\0'
+        || !memchr(arena + offset, '\0', arena_bytes - offset)) {
+        return NULL;
+    }
+    return strdup((const char*)arena + offset);
+}
+
+static uint32_t table_count(uint32_t offset, uint32_t count, size_t entry, size_t bytes) {
+    if (offset > bytes || count > (bytes - offset) / entry) return 0;
+    return count;
+}
+
+// Replaces *data with the image; -1 when out of memory, with what fitted
+static int decode_image(const uint64_t* words, size_t bytes, StateData* data) {
+    state_free(data);
+    StateImage image;
+    if (bytes < sizeof(image)) return 0;
+    memcpy(&image, words, sizeof(image));
+    const uint8_t* base = (const uint8_t*)words;
+    if (image.arena > bytes || image.arena_bytes > bytes - image.arena) image.arena_bytes = 0;
+    const uint8_t* arena = base + (image.arena <= bytes ? image.arena : 0);
+    size_t arena_bytes = image.arena_bytes;
+
+    int status = 0;
+    uint32_t count = table_count(image.widget_table, image.widget_count, sizeof(StateImageWidget), bytes);
+    for (uint32_t i = 0; i < count; i++) {
+        StateImageWidget entry;
+        memcpy(&entry, base + image.widget_table + i * sizeof(entry), sizeof(entry));
+        WidgetConfig* widget = add_widget(data);
+        if (!widget) {
+            status = -1;
+            break;
+        }
+        image_text(arena, arena_bytes, entry.name, widget->name, sizeof(widget->name));
+        widget->icon = image_copy(arena, arena_bytes, entry.icon);
+        widget->enabled = entry.enabled;
+        widget->color = entry.color;
+        widget->scale = entry.scale;
+        widget->update_interval = entry.update_interval;
+    }
+    count = table_count(image.space_table, image.space_count, sizeof(StateImageSpace), bytes);
+    if (count > INT_MAX || (count > 0 && !space_at(data, (int)count))) {
+        count = 0;
+        status = -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        StateImageSpace entry;
+        memcpy(&entry, base + image.space_table + i * sizeof(entry), sizeof(entry));
+        SpaceConfig* space = &data->spaces[i];
+        space->icon = image_copy(arena, arena_bytes, entry.icon);
+        image_text(arena, arena_bytes, entry.mode, space->mode, sizeof(space->mode));
+        space->active = entry.active;
+    }
+    count = table_count(image.rom_table, image.rom_count, sizeof(uint32_t), bytes);
+    for (uint32_t i = 0; i < count && i < MAX_RECENT_ROMS; i++) {
+        uint32_t offset;
+        memcpy(&offset, base + image.rom_table + i * sizeof(offset), sizeof(offset));
+        image_text(arena, arena_bytes, offset, data->integrations.yaze_recent_roms[i],
+                   sizeof(data->integrations.yaze_recent_roms[i]));
+    }
+
+    Appearance* appearance = &data->appearance;
+    data->last_update = (time_t)image.last_update;
+    data->icon_lookups = image.icon_lookups;
+    data->state_updates = image.state_updates;
+    data->cache_hits = image.cache_hits;
+    data->version = image.version;
+    data->dirty = image.dirty;
+    appearance->bar_height = image.bar_height;
+    appearance->corner_radius = image.corner_radius;
+    appearance->bar_color = image.bar_color;
+    appearance->blur_radius = image.blur_radius;
+    appearance->widget_scale = image.widget_scale;
+    appearance->font_size = image.font_size;
+    image_text(arena, arena_bytes, image.font_family, appearance->font_family,
+               sizeof(appearance->font_family));
+    image_text(arena, arena_bytes, image.font_style, appearance->font_style,
+               sizeof(appearance->font_style));
+    data->integrations.yaze_enabled = image.yaze_enabled;
+    data->integrations.emacs_enabled = image.emacs_enabled;
+    data->integrations.halext_enabled = image.halext_enabled;
+    image_text(arena, arena_bytes, image.emacs_workspace, data->integrations.emacs_workspace,
+               sizeof(data->integrations.emacs_workspace));
+    return status;
+}
+
+// Bytes of image this process can copy out of its mapping
+static size_t image_room(void) {
+    return state_mapped - sizeof(SharedState);
+}
+
+// Copies up to `bytes` of the image into g_image; returns how many it did
+static size_t copy_image(size_t bytes) {
+    if (bytes > image_room()) bytes = image_room();
+    if (reserve_image(bytes) != 0) bytes = g_image_bytes;
+    size_t count = (bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    for (size_t i = 0; i < count; i++) {
+        g_image[i] = __atomic_load_n(&state->words[i], __ATOMIC_RELAXED);
+    }
+    return bytes;
+}
+
+// Snapshot of the shared state, returning its generation. Never takes the
+// writer lock; a copy that overlapped a commit is retried. A sequence left
+// odd by a writer that died mid-commit is repaired once the lock can be
+// taken over.
+static uint64_t read_state(StateData* out) {
+    uint64_t seen = 0;
+    size_t bytes = 0;
+    for (unsigned attempt = 1; ; attempt++) {
+        // Re-read each time: remapping moves the segment.
+        StateHeader* header = &state->header;
+        seen = __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+        if ((seen & 1) == 0) {
+            bytes = (size_t)__atomic_load_n(&state->image_bytes, __ATOMIC_RELAXED);
+            if (bytes > image_room()) remap_state();
+            bytes = copy_image(bytes);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&state->header.sequence, __ATOMIC_RELAXED) == seen) break;
+            header = &state->header;
+        }
+        if (attempt % STATE_READ_SPINS == 0 && writer_lock(header, 0) >= 0) {
+            uint64_t sequence = __atomic_load_n(&header->sequence, __ATOMIC_RELAXED);
+            if (sequence & 1) __atomic_store_n(&header->sequence, sequence + 1, __ATOMIC_RELEASE);
+            writer_unlock(header);
+        }
+        sched_yield();
+    }
+    decode_image(g_image, bytes, out);
+    return seen / 2;
+}
+
+// Takes the writer lock and copies the current state into *draft for the
+// caller to edit; publish it with commit_state() or drop it with
+// abandon_state(), then state_free() it.
+static int begin_write(StateData* draft) {
+    if (writer_lock(&state->header, 1) < 0) return -1;
+    remap_state();
+    size_t bytes = copy_image((size_t)__atomic_load_n(&state->image_bytes, __ATOMIC_RELAXED));
+    if (decode_image(g_image, bytes, draft) != 0) {
+        writer_unlock(&state->header);
+        return -1;
+    }
+    return 0;
+}
+
+static void abandon_state(void) {
+    writer_unlock(&state->header);
+}
+
+static void commit_state(StateData* draft) {
+    draft->state_updates++;
+    draft->last_update = time(NULL);
+    size_t bytes = reserve_image(image_bound(draft)) == 0 ? encode_image(draft, g_image, g_image_bytes) : 0;
+    if (bytes == 0 || reserve_state(bytes) != 0) {
+        fprintf(stderr, "state_manager: state does not fit in the segment\n");
+        abandon_state();
+        return;
+    }
+
+    // `| 1` also repairs a sequence left odd by a writer that died.
+    StateHeader* header = &state->header;
+    uint64_t sequence = __atomic_load_n(&header->sequence, __ATOMIC_RELAXED) | 1;
+    __atomic_store_n(&header->sequence, sequence, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&state->image_bytes, (uint64_t)bytes, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < bytes / sizeof(uint64_t); i++) {
+        __atomic_store_n(&state->words[i], g_image[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&header->sequence, sequence + 1, __ATOMIC_RELEASE);
+    writer_unlock(header);
+}
+
+static uint64_t state_generation(void) {
+    return __atomic_load_n(&state->header.sequence, __ATOMIC_ACQUIRE) / 2;
+}
+
+static void detach_state(void) {
+    if (state && state != MAP_FAILED) munmap(state, state_mapped);
+    if (state_fd >= 0) close(state_fd);
+    state = NULL;
+    state_mapped = 0;
+    state_fd = -1;
+}
+
+// Copies the state out of a layout 2 segment of `size` bytes, replacing
+// *out. Returns 1 when there was a consistent one to copy.
+static int read_legacy_state(const void* mapping, size_t size, StateData* out) {
+    const LegacySharedState* legacy = mapping;
+    if (size < sizeof(*legacy)
+        || __atomic_load_n(&legacy->header.magic, __ATOMIC_ACQUIRE) != STATE_MAGIC
+        || legacy->header.layout_version != STATE_LEGACY_LAYOUT_VERSION
+        || legacy->header.segment_bytes != sizeof(*legacy)) {
+        return 0;
+    }
+    static LegacyStateData data;
+    uint64_t* words = (uint64_t*)&data;
+    for (unsigned attempt = 0; ; attempt++) {
+        if (attempt == STATE_READ_SPINS) return 0;
+        uint64_t seen = __atomic_load_n(&legacy->header.sequence, __ATOMIC_ACQUIRE);
+        if (seen & 1) {
+            sched_yield();
+            continue;
+        }
+        for (size_t i = 0; i < LEGACY_WORDS; i++) {
+            words[i] = __atomic_load_n(&legacy->body.words[i], __ATOMIC_RELAXED);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&legacy->header.sequence, __ATOMIC_RELAXED) == seen) break;
+    }
+
+    state_free(out);
+    out->last_update = data.last_update;
+    int widget_count = data.widget_count < 0 ? 0
+                       : data.widget_count > LEGACY_MAX_WIDGETS ? LEGACY_MAX_WIDGETS
+                       : data.widget_count;
+    char icon[LEGACY_MAX_ICON_LEN];
+    for (int i = 0; i < widget_count; i++) {
+        const LegacyWidgetConfig* from = &data.widgets[i];
+        WidgetConfig* widget = add_widget(out);
+        if (!widget) return 0;
+        snprintf(widget->name, sizeof(widget->name), "%.*s", (int)sizeof(from->name) - 1, from->name);
+        snprintf(icon, sizeof(icon), "%.*s", (int)sizeof(from->icon) - 1, from->icon);
+        if (!set_text(&widget->icon, icon)) return 0;
+        widget->enabled = from->enabled;
+        widget->color = from->color;
+        widget->scale = from->scale;
+        widget->update_interval = from->update_interval;
+    }
+    if (!space_at(out, LEGACY_MAX_SPACES)) return 0;
+    for (int i = 0; i < LEGACY_MAX_SPACES; i++) {
+        const LegacySpaceConfig* from = &data.spaces[i];
+        snprintf(icon, sizeof(icon), "%.*s", (int)sizeof(from->icon) - 1, from->icon);
+        if (!set_text(&out->spaces[i].icon, icon)) return 0;
+        snprintf(out->spaces[i].mode, sizeof(out->spaces[i].mode), "%.*s",
+                 (int)sizeof(from->mode) - 1, from->mode);
+        out->spaces[i].active = from->active;
+    }
+    out->appearance = data.appearance;
+    out->appearance.font_family[sizeof(out->appearance.font_family) - 1] = '\0';
+    out->appearance.font_style[sizeof(out->appearance.font_style) - 1] = '\0';
+    out->integrations = data.integrations;
+    for (int i = 0; i < MAX_RECENT_ROMS; i++) {
+        out->integrations.yaze_recent_roms[i][MAX_STRING_LEN - 1] = '\0';
+    }
+    out->integrations.emacs_workspace[sizeof(out->integrations.emacs_workspace) - 1] = '\0';
+    out->icon_lookups = data.icon_lookups;
+    out->state_updates = data.state_updates;
+    out->cache_hits = data.cache_hits;
+    out->version = data.version;
+    out->dirty = data.dirty;
+    return 1;
+}
+
+// Copies the state out of the layout 2 segment earlier builds kept under
+// STATE_LEGACY_SHM_NAME, for a default segment that is still empty. The old
+// segment stays, for any old build still running on it.
+static int read_legacy_segment(const char* name, StateData* out) {
+    if (strcmp(name, STATE_SHM_NAME) != 0) return 0;
+    int fd = shm_open(STATE_LEGACY_SHM_NAME, O_RDONLY, 0);
+    if (fd < 0) return 0;
+    struct stat info;
+    int carried = 0;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void* mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping != MAP_FAILED) {
+            carried = read_legacy_state(mapping, (size_t)info.st_size, out);
+            munmap(mapping, (size_t)info.st_size);
+        }
+    }
+    close(fd);
+    return carried;
+}
+
 // Initialize shared memory state
 int init_state() {
-    // Try to open existing shared state
-    state_fd = shm_open("/sketchybar_state", O_RDWR, 0666);
-
-    if (state_fd == -1) {
-        // Create new shared state
-        state_fd = shm_open("/sketchybar_state", O_CREAT | O_RDWR, 0666);
+    const char* name = state_segment_name();
+    static StateData carried;
+    int carry = 0;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        state_fd = shm_open(name, O_CREAT | O_RDWR, 0666);
         if (state_fd == -1) {
             perror("shm_open");
             return -1;
         }
 
-        // Set size
-        if (ftruncate(state_fd, sizeof(SharedState)) == -1) {
+        // A new segment is sized here; losing that race to another process
+        // is harmless. An existing one is mapped whole.
+        struct stat info;
+        if (fstat(state_fd, &info) == 0 && info.st_size == 0) {
+            if (ftruncate(state_fd, STATE_SEGMENT_INITIAL_BYTES) == -1 && errno != EINVAL) {
+                perror("ftruncate");
+                detach_state();
+                return -1;
+            }
+        }
+        if (fstat(state_fd, &info) == -1 || info.st_size == 0) {
             perror("ftruncate");
+            detach_state();
+            return -1;
+        }
+        size_t size = (size_t)info.st_size;
+
+        // Map to memory
+        state = (SharedState*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, state_fd, 0);
+        if (state == MAP_FAILED) {
+            perror("mmap");
+            state = NULL;
+            detach_state();
+            return -1;
+        }
+        state_mapped = size;
+
+        int attached = size >= sizeof(SharedState) ? attach_state(state, size) : 1;
+        if (attached == 0) {
+            if (remap_state() != 0) {
+                perror("mmap");
+                detach_state();
+                return -1;
+            }
+            // Carried over only into a segment nobody has written yet.
+            StateData draft = {0};
+            if (state_generation() == 0 && (carry || (carry = read_legacy_segment(name, &carried)))
+                && begin_write(&draft) == 0) {
+                commit_state(&carried);
+            }
+            state_free(&draft);
+            state_free(&carried);
+            return 0;
+        }
+        if (attached == 1 && !carry) carry = read_legacy_state(state, size, &carried);
+        detach_state();
+        if (attached < 0) {
+            fprintf(stderr, "state segment %s is stuck initialising\n", name);
             return -1;
         }
+        // Another build's layout: leave it to its users and start afresh,
+        // keeping the state of a layout 2 segment.
+        shm_unlink(name);
     }
+    fprintf(stderr, "state segment %s has an incompatible layout\n", name);
+    return -1;
+}
 
-    // Map to memory
-    state = (SharedState*)mmap(NULL, sizeof(SharedState),
-                               PROT_READ | PROT_WRITE, MAP_SHARED, state_fd, 0);
-    if (state == MAP_FAILED) {
-        perror("mmap");
-        return -1;
+// An entry of state.json the state has no room for
+static void report_dropped(const char* object, const char* key, const char* reason) {
+    fprintf(stderr, "state_manager: not loading %s.%s: %s\n", object, key, reason);
+}
+
+// Parse state.json into *data, or fill in defaults without one
+// Keys of "widgets" are widget names: {"clock": true, ...}
+static void decode_widget(void* object, const char* key, const BaristaJsonValue* value) {
+    StateData* data = object;
+    if (!key) {
+        data->widget_count = 0;
+        return;
+    }
+    if (strlen(key) >= sizeof(data->widgets[0].name)) {
+        report_dropped("widgets", key, "name too long");
+        return;
     }
+    int index = 0;
+    while (index < data->widget_count && strcmp(data->widgets[index].name, key) != 0) index++;
+    WidgetConfig* widget = index < data->widget_count ? &data->widgets[index] : add_widget(data);
+    if (!widget) {
+        report_dropped("widgets", key, "out of memory");
+        return;
+    }
+    free(widget->icon);
+    memset(widget, 0, sizeof(*widget));
+    strcpy(widget->name, key);
+    widget->enabled = value->type == BARISTA_JSON_VALUE_BOOL && value->boolean;
+}
 
-    // Initialize mutex if needed
-    pthread_mutexattr_t attr;
-    pthread_mutexattr_init(&attr);
-    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
-    pthread_mutex_init(&state->lock, &attr);
+// Keys of "space_icons" and "space_modes" are space numbers, from 1. Values
+// are kept only whole: one longer than `capacity`, when there is one, is
+// reported and skipped.
+static SpaceConfig* space_for_key(StateData* data, const char* object, const char* key,
+                                  const BaristaJsonValue* value, size_t capacity) {
+    if (!key || value->type != BARISTA_JSON_VALUE_STRING) return NULL;
+    char* end = NULL;
+    long number = strtol(key, &end, 10);
+    if (end == key || *end != '\0' || number < 1) return NULL;
+    if (capacity > 0 && value->length >= capacity) {
+        report_dropped(object, key, "value too long");
+        return NULL;
+    }
+    SpaceConfig* space = number <= INT_MAX ? space_at(data, (int)number) : NULL;
+    if (!space) report_dropped(object, key, "out of memory");
+    return space;
+}
 
-    return 0;
+// Both objects list every space that has a value, so they replace the old set
+static void decode_space_icon(void* object, const char* key, const BaristaJsonValue* value) {
+    StateData* data = object;
+    if (!key) {
+        for (int i = 0; i < data->space_count; i++) set_text(&data->spaces[i].icon, NULL);
+        return;
+    }
+    SpaceConfig* space = space_for_key(data, "space_icons", key, value, 0);
+    if (space && !set_text(&space->icon, value->string)) {
+        report_dropped("space_icons", key, "out of memory");
+    }
 }
 
-// Load state from JSON file
-void load_json_state() {
+static void decode_space_mode(void* object, const char* key, const BaristaJsonValue* value) {
+    StateData* data = object;
+    if (!key) {
+        for (int i = 0; i < data->space_count; i++) data->spaces[i].mode[0] = '\0';
+        return;
+    }
+    SpaceConfig* space = space_for_key(data, "space_modes", key, value,
+                                       STATE_FIELD_BYTES(SpaceConfig, mode));
+    if (space) strcpy(space->mode, value->string);
+}
+
+static const BaristaJsonField kAppearanceFields[] = {
+    {.key = "bar_height", .type = BARISTA_JSON_INT, BARISTA_JSON_MEMBER(Appearance, bar_height)},
+    {.key = "corner_radius", .type = BARISTA_JSON_INT, BARISTA_JSON_MEMBER(Appearance, corner_radius)},
+    {.key = "bar_color", .type = BARISTA_JSON_COLOR, BARISTA_JSON_MEMBER(Appearance, bar_color)},
+    {.key = "blur_radius", .type = BARISTA_JSON_INT, BARISTA_JSON_MEMBER(Appearance, blur_radius)},
+    {.key = "widget_scale", .type = BARISTA_JSON_FLOAT, BARISTA_JSON_MEMBER(Appearance, widget_scale)},
+    {.key = "font_family", .type = BARISTA_JSON_STRING, BARISTA_JSON_MEMBER(Appearance, font_family)},
+    {.key = "font_style", .type = BARISTA_JSON_STRING, BARISTA_JSON_MEMBER(Appearance, font_style)},
+    {.key = "font_size", .type = BARISTA_JSON_FLOAT, BARISTA_JSON_MEMBER(Appearance, font_size)},
+    {.key = NULL},
+};
+
+static const BaristaJsonField kYazeFields[] = {
+    {.key = "enabled", .type = BARISTA_JSON_BOOL, BARISTA_JSON_MEMBER(Integrations, yaze_enabled)},
+    {.key = NULL},
+};
+
+static const BaristaJsonField kEmacsFields[] = {
+    {.key = "enabled", .type = BARISTA_JSON_BOOL, BARISTA_JSON_MEMBER(Integrations, emacs_enabled)},
+    {.key = NULL},
+};
+
+// Each integration is its own object in the file but flat in Integrations
+static const BaristaJsonField kIntegrationFields[] = {
+    {.key = "yaze", .type = BARISTA_JSON_OBJECT, .offset = 0, .fields = kYazeFields},
+    {.key = "emacs", .type = BARISTA_JSON_OBJECT, .offset = 0, .fields = kEmacsFields},
+    {.key = NULL},
+};
+
+static const BaristaJsonField kStateFields[] = {
+    {.key = "widgets", .type = BARISTA_JSON_ENTRIES, .offset = 0, .entry = decode_widget},
+    {.key = "appearance", .type = BARISTA_JSON_OBJECT, BARISTA_JSON_MEMBER(StateData, appearance),
+     .fields = kAppearanceFields},
+    {.key = "space_icons", .type = BARISTA_JSON_ENTRIES, .offset = 0, .entry = decode_space_icon},
+    {.key = "space_modes", .type = BARISTA_JSON_ENTRIES, .offset = 0, .entry = decode_space_mode},
+    {.key = "integrations", .type = BARISTA_JSON_OBJECT, BARISTA_JSON_MEMBER(StateData, integrations),
+     .fields = kIntegrationFields},
+    {.key = NULL},
+};
+
+static const BaristaJsonField kStateRoot = {.type = BARISTA_JSON_OBJECT, .offset = 0, .fields = kStateFields};
+
+static void state_config_path(char* path, size_t capacity) {
+    snprintf(path, capacity, CONFIG_PATH_FMT, getenv("HOME"));
+}
+
+// Decodes state.json over *data: 1 when it was read whole, 0 when it is not
+// valid JSON (fields before the error are kept), -1 when it is unreadable
+static int decode_state_file(StateData* data) {
     char path[512];
-    snprintf(path, sizeof(path), CONFIG_PATH_FMT, getenv("HOME"));
-
-    FILE* f = fopen(path, "r");
-    if (!f) {
-        // Set defaults
-        state->appearance.bar_height = 28;
-        state->appearance.corner_radius = 0;
-        state->appearance.bar_color = 0xC021162F;
-        state->appearance.blur_radius = 30;
-        state->appearance.widget_scale = 1.0;
-        strcpy(state->appearance.font_family, "SF Pro");
-        strcpy(state->appearance.font_style, "Semibold");
-        state->appearance.font_size = 12.0;
-
-        // Default widgets
-        state->widget_count = 5;
-        strcpy(state->widgets[0].name, "system_info");
-        state->widgets[0].enabled = 1;
-        strcpy(state->widgets[1].name, "network");
-        state->widgets[1].enabled = 1;
-        strcpy(state->widgets[2].name, "clock");
-        state->widgets[2].enabled = 1;
-        strcpy(state->widgets[3].name, "volume");
-        state->widgets[3].enabled = 1;
-        strcpy(state->widgets[4].name, "battery");
-        state->widgets[4].enabled = 1;
+    state_config_path(path, sizeof(path));
 
-        return;
+    size_t error_offset = 0;
+    int decoded = barista_json_decode_file(path, &kStateRoot, data, &error_offset);
+    if (decoded == 0) {
+        fprintf(stderr, "state_manager: %s: invalid JSON at byte %zu\n", path, error_offset);
     }
+    return decoded;
+}
 
-    fseek(f, 0, SEEK_END);
-    long size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-
-    char* buffer = malloc(size + 1);
-    fread(buffer, 1, size, f);
-    buffer[size] = '\0';
-    fclose(f);
-
-    // Parse JSON (simplified parsing)
-    // Parse appearance
-    char* app_start = strstr(buffer, "\"appearance\"");
-    if (app_start) {
-        char* height = strstr(app_start, "\"bar_height\"");
-        if (height) {
-            sscanf(height + 12, ": %d", &state->appearance.bar_height);
-        }
-        char* radius = strstr(app_start, "\"corner_radius\"");
-        if (radius) {
-            sscanf(radius + 15, ": %d", &state->appearance.corner_radius);
-        }
-        char* scale = strstr(app_start, "\"widget_scale\"");
-        if (scale) {
-            sscanf(scale + 14, ": %f", &state->appearance.widget_scale);
-        }
-    }
-
-    // Parse widgets
-    char* widgets_start = strstr(buffer, "\"widgets\"");
-    if (widgets_start) {
-        state->widget_count = 0;
-        char* ptr = widgets_start;
-        while ((ptr = strchr(ptr, '\"')) && state->widget_count < MAX_WIDGETS) {
-            ptr++;
-            char* end = strchr(ptr, '\"');
-            if (!end) break;
-
-            char name[64] = {0};
-            strncpy(name, ptr, end - ptr);
-
-            // Skip to value
-            char* colon = strchr(end, ':');
-            if (!colon) break;
-
-            int enabled = 0;
-            if (strstr(colon, "true")) enabled = 1;
-
-            strcpy(state->widgets[state->widget_count].name, name);
-            state->widgets[state->widget_count].enabled = enabled;
-            state->widget_count++;
-
-            ptr = colon + 1;
-        }
-    }
-
-    // Parse space_icons
-    char* icons_start = strstr(buffer, "\"space_icons\"");
-    if (icons_start) {
-        char* ptr = icons_start;
-        // Find opening brace
-        ptr = strchr(ptr, '{');
-        if (ptr) {
-            ptr++;
-            while ((ptr = strchr(ptr, '\"'))) {
-                ptr++;
-                char* end = strchr(ptr, '\"');
-                if (!end) break;
-                
-                char key[16] = {0};
-                strncpy(key, ptr, end - ptr);
-                int idx = atoi(key);
-                
-                // Skip to value
-                char* val_start = strchr(end, ':');
-                if (!val_start) break;
-                val_start = strchr(val_start, '\"');
-                if (!val_start) break;
-                val_start++;
-                
-                char* val_end = strchr(val_start, '\"');
-                if (!val_end) break;
-                
-                if (idx >= 1 && idx <= MAX_SPACES) {
-                    char icon[MAX_ICON_LEN] = {0};
-                    strncpy(icon, val_start, val_end - val_start);
-                    strcpy(state->spaces[idx - 1].icon, icon);
-                }
-                
-                ptr = val_end + 1;
-                // Check for end of object or next item
-                char* next = strpbrk(ptr, ",}");
-                if (!next || *next == '}') break;
-            }
+static void parse_json_state(StateData* data) {
+    if (decode_state_file(data) >= 0) return;
+
+    // Set defaults
+    data->appearance.bar_height = 28;
+    data->appearance.corner_radius = 0;
+    data->appearance.bar_color = 0xC021162F;
+    data->appearance.blur_radius = 30;
+    data->appearance.widget_scale = 1.0;
+    strcpy(data->appearance.font_family, "SF Pro");
+    strcpy(data->appearance.font_style, "Semibold");
+    data->appearance.font_size = 12.0;
+
+    // Default widgets
+    static const char* const kDefaultWidgets[] = {"system_info", "network", "clock", "volume", "battery"};
+    data->widget_count = 0;
+    for (size_t i = 0; i < sizeof(kDefaultWidgets) / sizeof(kDefaultWidgets[0]); i++) {
+        WidgetConfig* widget = add_widget(data);
+        if (!widget) break;
+        strcpy(widget->name, kDefaultWidgets[i]);
+        widget->enabled = 1;
+    }
+}
+
+// State keys, shared by get/set and the journal: widget.NAME,
+// appearance.FIELD, space.N.icon and space.N.mode
+static const char* const kAppearanceKeys[] = {
+    "bar_height", "corner_radius", "bar_color", "blur_radius",
+    "widget_scale", "font_family", "font_style", "font_size", NULL,
+};
+
+// "space.N.FIELD": returns N and points *field at FIELD, or 0
+static int parse_space_key(const char* key, const char** field) {
+    if (strncmp(key, "space.", 6) != 0) return 0;
+    char* end = NULL;
+    long number = strtol(key + 6, &end, 10);
+    if (end == key + 6 || *end != '.' || number < 1 || number > INT_MAX) return 0;
+    *field = end + 1;
+    return (int)number;
+}
+
+static int find_widget(const StateData* data, const char* name) {
+    for (int i = 0; i < data->widget_count; i++) {
+        if (strcmp(data->widgets[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+// The value of `key` in *data as text; 0 for an unknown key
+static int format_value(const StateData* data, const char* key, char* out, size_t capacity) {
+    const char* field = NULL;
+    int space = parse_space_key(key, &field);
+    if (strncmp(key, "widget.", 7) == 0) {
+        int index = find_widget(data, key + 7);
+        if (index < 0) return 0;
+        snprintf(out, capacity, "%s", data->widgets[index].enabled ? "on" : "off");
+    } else if (strncmp(key, "appearance.", 11) == 0) {
+        const Appearance* appearance = &data->appearance;
+        field = key + 11;
+        if (strcmp(field, "bar_height") == 0) {
+            snprintf(out, capacity, "%d", appearance->bar_height);
+        } else if (strcmp(field, "corner_radius") == 0) {
+            snprintf(out, capacity, "%d", appearance->corner_radius);
+        } else if (strcmp(field, "bar_color") == 0) {
+            snprintf(out, capacity, "0x%08X", appearance->bar_color);
+        } else if (strcmp(field, "blur_radius") == 0) {
+            snprintf(out, capacity, "%d", appearance->blur_radius);
+        } else if (strcmp(field, "widget_scale") == 0) {
+            snprintf(out, capacity, "%.2f", appearance->widget_scale);
+        } else if (strcmp(field, "font_family") == 0) {
+            snprintf(out, capacity, "%s", appearance->font_family);
+        } else if (strcmp(field, "font_style") == 0) {
+            snprintf(out, capacity, "%s", appearance->font_style);
+        } else if (strcmp(field, "font_size") == 0) {
+            snprintf(out, capacity, "%.1f", appearance->font_size);
+        } else {
+            return 0;
         }
+    } else if (space && strcmp(field, "icon") == 0) {
+        snprintf(out, capacity, "%s", text_or_empty(space_or_empty(data, space - 1)->icon));
+    } else if (space && strcmp(field, "mode") == 0) {
+        snprintf(out, capacity, "%s", space_or_empty(data, space - 1)->mode);
+    } else {
+        return 0;
     }
+    return 1;
+}
 
-    free(buffer);
+// Copies `value` into a field of `capacity` bytes; 0, leaving it alone, when
+// it does not fit
+static int store_text(char* field, size_t capacity, const char* value) {
+    if (strlen(value) >= capacity) return 0;
+    memcpy(field, value, strlen(value) + 1);
+    return 1;
 }
 
-// Save state to JSON file
-void save_json_state() {
-    pthread_mutex_lock(&state->lock);
+// Stores `value` under `key` in *data; 0 for an unknown key, a widget that
+// does not exist, a widget value other than on and off, text longer than its
+// field, or no memory for a new space or icon
+static int apply_value(StateData* data, const char* key, const char* value) {
+    const char* field = NULL;
+    int space = parse_space_key(key, &field);
+    if (strncmp(key, "widget.", 7) == 0) {
+        int index = find_widget(data, key + 7);
+        if (index < 0 || (strcmp(value, "on") != 0 && strcmp(value, "off") != 0)) return 0;
+        data->widgets[index].enabled = strcmp(value, "on") == 0;
+    } else if (strncmp(key, "appearance.", 11) == 0) {
+        Appearance* appearance = &data->appearance;
+        field = key + 11;
+        if (strcmp(field, "bar_height") == 0) {
+            appearance->bar_height = atoi(value);
+        } else if (strcmp(field, "corner_radius") == 0) {
+            appearance->corner_radius = atoi(value);
+        } else if (strcmp(field, "widget_scale") == 0) {
+            appearance->widget_scale = atof(value);
+        } else if (strcmp(field, "blur_radius") == 0) {
+            appearance->blur_radius = atoi(value);
+        } else if (strcmp(field, "bar_color") == 0) {
+            sscanf(value, "0x%X", &appearance->bar_color);
+        } else if (strcmp(field, "font_family") == 0) {
+            return store_text(appearance->font_family, sizeof(appearance->font_family), value);
+        } else if (strcmp(field, "font_style") == 0) {
+            return store_text(appearance->font_style, sizeof(appearance->font_style), value);
+        } else if (strcmp(field, "font_size") == 0) {
+            appearance->font_size = atof(value);
+        } else {
+            return 0;
+        }
+    } else if (space && strcmp(field, "icon") == 0) {
+        SpaceConfig* config = space_at(data, space);
+        return config && set_text(&config->icon, value);
+    } else if (space && strcmp(field, "mode") == 0) {
+        SpaceConfig* config = strlen(value) < STATE_FIELD_BYTES(SpaceConfig, mode) ? space_at(data, space) : NULL;
+        return config && store_text(config->mode, sizeof(config->mode), value);
+    } else {
+        return 0;
+    }
+    return 1;
+}
 
-    char path[512];
-    snprintf(path, sizeof(path), CONFIG_PATH_FMT, getenv("HOME"));
+// set KEY VALUE, with the keys of get; widgets take on or off
+static int set_value(const char* key, const char* value) {
+    StateData draft = {0};
+    if (begin_write(&draft) != 0) return 0;
+    int applied = apply_value(&draft, key, value);
+    if (applied) {
+        draft.dirty = 1;
+        commit_state(&draft);
+    } else {
+        abandon_state();
+    }
+    state_free(&draft);
+    return applied;
+}
 
-    FILE* f = fopen(path, "w");
-    if (!f) {
-        pthread_mutex_unlock(&state->lock);
-        return;
+// Output text on the heap, grown as it is written; starts zeroed, is freed
+// with free(text.bytes), and is `failed` once it could not grow
+typedef struct {
+    char* bytes;
+    size_t capacity;
+    size_t length;
+    int failed;
+} TextBuffer;
+
+static void text_printf(TextBuffer* text, const char* format, ...) {
+    if (text->failed) return;
+    for (;;) {
+        size_t room = text->capacity - text->length;
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(room > 0 ? text->bytes + text->length : NULL, room, format, args);
+        va_end(args);
+        if (written < 0) break;
+        if ((size_t)written < room) {
+            text->length += (size_t)written;
+            return;
+        }
+        size_t capacity = text->capacity > 0 ? text->capacity : 4096;
+        while (capacity - text->length <= (size_t)written) capacity *= 2;
+        char* grown = realloc(text->bytes, capacity);
+        if (!grown) break;
+        text->bytes = grown;
+        text->capacity = capacity;
+    }
+    text->failed = 1;
+}
+
+// As a JSON string body, or with `json` false as one journal field, where
+// only the tab, newline and backslash that delimit records are escaped
+static void text_escape(TextBuffer* text, const char* value, int json) {
+    for (const unsigned char* c = (const unsigned char*)value; *c; c++) {
+        if (*c == '\\') text_printf(text, "\\\\");
+        else if (*c == '\t') text_printf(text, "\\t");
+        else if (*c == '\n') text_printf(text, "\\n");
+        else if (json && *c == '"') text_printf(text, "\\\"");
+        else if (json && *c < 0x20) text_printf(text, "\\u%04x", *c);
+        else text_printf(text, "%c", *c);
     }
+}
 
-    fprintf(f, "{\n");
+// state.json as save_json_state() writes it
+static void render_state(const StateData* data, TextBuffer* text) {
+    text_printf(text, "{\n");
 
     // Write widgets
-    fprintf(f, "  \"widgets\": {\n");
-    for (int i = 0; i < state->widget_count; i++) {
-        fprintf(f, "    \"%s\": %s%s\n",
-                state->widgets[i].name,
-                state->widgets[i].enabled ? "true" : "false",
-                i < state->widget_count - 1 ? "," : "");
+    text_printf(text, "  \"widgets\": {\n");
+    for (int i = 0; i < data->widget_count; i++) {
+        text_printf(text, "    \"");
+        text_escape(text, data->widgets[i].name, 1);
+        text_printf(text, "\": %s%s\n",
+                    data->widgets[i].enabled ? "true" : "false",
+                    i < data->widget_count - 1 ? "," : "");
     }
-    fprintf(f, "  },\n");
+    text_printf(text, "  },\n");
 
     // Write appearance
-    fprintf(f, "  \"appearance\": {\n");
-    fprintf(f, "    \"bar_height\": %d,\n", state->appearance.bar_height);
-    fprintf(f, "    \"corner_radius\": %d,\n", state->appearance.corner_radius);
-    fprintf(f, "    \"bar_color\": \"0x%08X\",\n", state->appearance.bar_color);
-    fprintf(f, "    \"blur_radius\": %d,\n", state->appearance.blur_radius);
-    fprintf(f, "    \"widget_scale\": %.2f,\n", state->appearance.widget_scale);
-    fprintf(f, "    \"font_family\": \"%s\",\n", state->appearance.font_family);
-    fprintf(f, "    \"font_style\": \"%s\",\n", state->appearance.font_style);
-    fprintf(f, "    \"font_size\": %.1f\n", state->appearance.font_size);
-    fprintf(f, "  },\n");
+    const Appearance* appearance = &data->appearance;
+    text_printf(text, "  \"appearance\": {\n");
+    text_printf(text, "    \"bar_height\": %d,\n", appearance->bar_height);
+    text_printf(text, "    \"corner_radius\": %d,\n", appearance->corner_radius);
+    text_printf(text, "    \"bar_color\": \"0x%08X\",\n", appearance->bar_color);
+    text_printf(text, "    \"blur_radius\": %d,\n", appearance->blur_radius);
+    text_printf(text, "    \"widget_scale\": %.2f,\n", appearance->widget_scale);
+    text_printf(text, "    \"font_family\": \"");
+    text_escape(text, appearance->font_family, 1);
+    text_printf(text, "\",\n    \"font_style\": \"");
+    text_escape(text, appearance->font_style, 1);
+    text_printf(text, "\",\n    \"font_size\": %.1f\n", appearance->font_size);
+    text_printf(text, "  },\n");
 
     // Write space icons
-    fprintf(f, "  \"space_icons\": {\n");
+    text_printf(text, "  \"space_icons\": {\n");
     int first = 1;
-    for (int i = 0; i < MAX_SPACES; i++) {
-        if (strlen(state->spaces[i].icon) > 0) {
-            if (!first) fprintf(f, ",\n");
-            fprintf(f, "    \"%d\": \"%s\"", i + 1, state->spaces[i].icon);
+    for (int i = 0; i < data->space_count; i++) {
+        if (data->spaces[i].icon) {
+            text_printf(text, "%s    \"%d\": \"", first ? "" : ",\n", i + 1);
+            text_escape(text, data->spaces[i].icon, 1);
+            text_printf(text, "\"");
             first = 0;
         }
     }
-    fprintf(f, "\n  },\n");
+    text_printf(text, "\n  },\n");
 
     // Write space modes
-    fprintf(f, "  \"space_modes\": {\n");
+    text_printf(text, "  \"space_modes\": {\n");
     first = 1;
-    for (int i = 0; i < MAX_SPACES; i++) {
-        if (strlen(state->spaces[i].mode) > 0 && strcmp(state->spaces[i].mode, "float") != 0) {
-            if (!first) fprintf(f, ",\n");
-            fprintf(f, "    \"%d\": \"%s\"", i + 1, state->spaces[i].mode);
+    for (int i = 0; i < data->space_count; i++) {
+        if (data->spaces[i].mode[0] != '\0' && strcmp(data->spaces[i].mode, "float") != 0) {
+            text_printf(text, "%s    \"%d\": \"", first ? "" : ",\n", i + 1);
+            text_escape(text, data->spaces[i].mode, 1);
+            text_printf(text, "\"");
             first = 0;
         }
     }
-    fprintf(f, "\n  },\n");
+    text_printf(text, "\n  },\n");
 
     // Write integrations
-    fprintf(f, "  \"integrations\": {\n");
-    fprintf(f, "    \"yaze\": { \"enabled\": %s },\n",
-            state->integrations.yaze_enabled ? "true" : "false");
-    fprintf(f, "    \"emacs\": { \"enabled\": %s }\n",
-            state->integrations.emacs_enabled ? "true" : "false");
-    fprintf(f, "  }\n");
+    text_printf(text, "  \"integrations\": {\n");
+    text_printf(text, "    \"yaze\": { \"enabled\": %s },\n",
+                data->integrations.yaze_enabled ? "true" : "false");
+    text_printf(text, "    \"emacs\": { \"enabled\": %s }\n",
+                data->integrations.emacs_enabled ? "true" : "false");
+    text_printf(text, "  }\n");
 
-    fprintf(f, "}\n");
-    fclose(f);
+    text_printf(text, "}\n");
+}
 
-    state->dirty = 0;
-    state->version++;
-    pthread_mutex_unlock(&state->lock);
+// F_FULLFSYNC reaches the disk itself on macOS, where fsync() stops at the
+// drive's cache
+static int flush_file(int fd) {
+#ifdef F_FULLFSYNC
+    if (fcntl(fd, F_FULLFSYNC) == 0) return 0;
+#endif
+    return fsync(fd);
 }
 
-// Get widget configuration
-WidgetConfig* get_widget(const char* name) {
-    pthread_mutex_lock(&state->lock);
-    for (int i = 0; i < state->widget_count; i++) {
-        if (strcmp(state->widgets[i].name, name) == 0) {
-            pthread_mutex_unlock(&state->lock);
-            return &state->widgets[i];
+// Writes the bytes beside `path`, syncs them and renames them over it, so a
+// reader sees the old file or the new one and never a partial write
+static int write_file_atomically(const char* path, const char* bytes, size_t length) {
+    char temporary[600];
+    snprintf(temporary, sizeof(temporary), "%s.tmp.%d", path, (int)getpid());
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    size_t written = 0;
+    while (written < length) {
+        ssize_t count = write(fd, bytes + written, length - written);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) break;
+        written += (size_t)count;
+    }
+    int ok = written == length && flush_file(fd) == 0;
+    if (close(fd) != 0) ok = 0;
+    if (!ok || rename(temporary, path) != 0) {
+        int saved = errno;
+        unlink(temporary);
+        errno = saved;
+        return -1;
+    }
+
+    // The rename lasts once the directory entry is on disk too
+    char directory[512];
+    snprintf(directory, sizeof(directory), "%s", path);
+    char* slash = strrchr(directory, '/');
+    if (slash) {
+        *slash = '\0';
+        int directory_fd = open(directory[0] ? directory : "/", O_RDONLY | O_CLOEXEC);
+        if (directory_fd >= 0) {
+            fsync(directory_fd);
+            close(directory_fd);
         }
     }
-    pthread_mutex_unlock(&state->lock);
-    return NULL;
+    return 0;
 }
 
-// Toggle widget
-void toggle_widget(const char* name) {
-    pthread_mutex_lock(&state->lock);
-    for (int i = 0; i < state->widget_count; i++) {
-        if (strcmp(state->widgets[i].name, name) == 0) {
-            state->widgets[i].enabled = !state->widgets[i].enabled;
-            state->dirty = 1;
-
-            // Update SketchyBar immediately
-            char cmd[256];
-            snprintf(cmd, sizeof(cmd), "sketchybar --set %s drawing=%s",
-                    name, state->widgets[i].enabled ? "on" : "off");
-            system(cmd);
-            break;
+// state.json as it is on disk, NUL-terminated, for the caller to free; NULL
+// when it cannot be read
+static char* read_state_file(size_t* length) {
+    char path[512];
+    state_config_path(path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat info;
+    char* bytes = NULL;
+    size_t used = 0;
+    if (fstat(fd, &info) == 0 && (bytes = malloc((size_t)info.st_size + 1)) != NULL) {
+        while (used < (size_t)info.st_size) {
+            ssize_t count = read(fd, bytes + used, (size_t)info.st_size - used);
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) break;
+            used += (size_t)count;
         }
     }
-    pthread_mutex_unlock(&state->lock);
+    close(fd);
+    if (!bytes || used != (size_t)info.st_size) {
+        free(bytes);
+        return NULL;
+    }
+    bytes[used] = '\0';
+    *length = used;
+    return bytes;
 }
 
-// Update appearance
-void update_appearance(const char* key, const char* value) {
-    pthread_mutex_lock(&state->lock);
+// The journal holds the changes made since state.json was last written, one
+// `KEY<TAB>VALUE` line each with the state keys above, so a burst of changes
+// costs an append apiece and state.json is rewritten once they settle.
+// Loading replays it over state.json; writing state.json removes it.
+//
+// Its first line, `#base<TAB>HASH<TAB>BYTES`, names the state.json it
+// continues by FNV-1a hash (16 hex digits) and length; a missing file counts
+// as empty. A journal whose base is not the file on disk (state.json was
+// written since, by the Lua side or an editor) is stale and is dropped.
+#define JOURNAL_BASE_FORMAT "#base\t%016llx\t%zu\n"
+
+static void journal_path(char* path, size_t capacity) {
+    snprintf(path, capacity, CONFIG_PATH_FMT ".journal", getenv("HOME"));
+}
+
+static void journal_record(TextBuffer* text, const char* key, const char* value) {
+    text_escape(text, key, 0);
+    text_printf(text, "\t");
+    text_escape(text, value, 0);
+    text_printf(text, "\n");
+}
 
-    if (strcmp(key, "bar_height") == 0) {
-        state->appearance.bar_height = atoi(value);
-    } else if (strcmp(key, "corner_radius") == 0) {
-        state->appearance.corner_radius = atoi(value);
-    } else if (strcmp(key, "widget_scale") == 0) {
-        state->appearance.widget_scale = atof(value);
-    } else if (strcmp(key, "blur_radius") == 0) {
-        state->appearance.blur_radius = atoi(value);
-    } else if (strcmp(key, "bar_color") == 0) {
-        sscanf(value, "0x%X", &state->appearance.bar_color);
+// Records every persisted field that differs. Returns how many, or -1 when a
+// change has no record (widgets added, removed or renamed, integrations) and
+// state.json has to be written instead.
+static int journal_changes(const StateData* before, const StateData* after, TextBuffer* text) {
+    if (before->widget_count != after->widget_count
+        || memcmp(&before->integrations, &after->integrations, sizeof(before->integrations)) != 0) {
+        return -1;
+    }
+    int records = 0;
+    char key[96];
+    char was[MAX_STRING_LEN];
+    char now[MAX_STRING_LEN];
+    for (int i = 0; i < after->widget_count; i++) {
+        if (strcmp(before->widgets[i].name, after->widgets[i].name) != 0) return -1;
+        if (before->widgets[i].enabled == after->widgets[i].enabled) continue;
+        snprintf(key, sizeof(key), "widget.%s", after->widgets[i].name);
+        journal_record(text, key, after->widgets[i].enabled ? "on" : "off");
+        records++;
+    }
+    for (int i = 0; kAppearanceKeys[i]; i++) {
+        snprintf(key, sizeof(key), "appearance.%s", kAppearanceKeys[i]);
+        format_value(before, key, was, sizeof(was));
+        format_value(after, key, now, sizeof(now));
+        if (strcmp(was, now) == 0) continue;
+        journal_record(text, key, now);
+        records++;
+    }
+    int spaces = before->space_count > after->space_count ? before->space_count : after->space_count;
+    for (int i = 0; i < spaces; i++) {
+        const SpaceConfig* old_space = space_or_empty(before, i);
+        const SpaceConfig* new_space = space_or_empty(after, i);
+        const char* icon = text_or_empty(new_space->icon);
+        if (strcmp(text_or_empty(old_space->icon), icon) != 0) {
+            snprintf(key, sizeof(key), "space.%d.icon", i + 1);
+            journal_record(text, key, icon);
+            records++;
+        }
+        if (strcmp(old_space->mode, new_space->mode) != 0) {
+            snprintf(key, sizeof(key), "space.%d.mode", i + 1);
+            journal_record(text, key, new_space->mode);
+            records++;
+        }
     }
+    return text->failed ? -1 : records;
+}
 
-    state->dirty = 1;
-    pthread_mutex_unlock(&state->lock);
+// The journal header naming the state.json text in `bytes`
+static int journal_header(char* out, size_t capacity, const char* bytes, size_t length) {
+    int written = snprintf(out, capacity, JOURNAL_BASE_FORMAT,
+                           (unsigned long long)barista_snapshot_hash(bytes ? bytes : "", length),
+                           length);
+    return written > 0 && (size_t)written < capacity ? written : -1;
 }
 
-// Set space icon
-void set_space_icon(int space_num, const char* icon) {
-    if (space_num < 1 || space_num > MAX_SPACES) return;
+// The journal header naming state.json as it is now
+static int journal_base(char* out, size_t capacity) {
+    size_t length = 0;
+    char* bytes = read_state_file(&length);
+    int written = journal_header(out, capacity, bytes, length);
+    free(bytes);
+    return written;
+}
 
-    pthread_mutex_lock(&state->lock);
-    strcpy(state->spaces[space_num - 1].icon, icon);
-    state->dirty = 1;
+// One write(), so records from a single batch land together. A new journal
+// starts with its base.
+static int journal_append(const char* bytes, size_t length) {
+    char path[512];
+    journal_path(path, sizeof(path));
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    struct stat info;
+    char header[64];
+    int header_length = 0;
+    if (fstat(fd, &info) != 0 || (info.st_size == 0
+                                  && (header_length = journal_base(header, sizeof(header))) < 0)) {
+        close(fd);
+        return -1;
+    }
+    struct iovec parts[2] = {
+        {.iov_base = header, .iov_len = (size_t)header_length},
+        {.iov_base = (void*)bytes, .iov_len = length},
+    };
+    ssize_t written = writev(fd, parts, 2);
+    close(fd);
+    return written == (ssize_t)(header_length + length) ? 0 : -1;
+}
 
-    // Update SketchyBar immediately
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "sketchybar --set space.%d icon='%s'",
-            space_num, icon);
-    system(cmd);
+static void journal_reset(void) {
+    char path[512];
+    journal_path(path, sizeof(path));
+    unlink(path);
+}
 
-    pthread_mutex_unlock(&state->lock);
+// Replaces the journal with one based on the state.json text in `file`,
+// holding what `now` changed since `saved`, the state that text was
+// rendered from. Without records it is removed; changes with no record
+// leave the state dirty, so state.json is written again.
+static void journal_rebase(const StateData* saved, const StateData* now,
+                           const char* file, size_t length) {
+    char header[64];
+    TextBuffer text = {0};
+    if (journal_header(header, sizeof(header), file, length) > 0) text_printf(&text, "%s", header);
+    char path[512];
+    journal_path(path, sizeof(path));
+    if (text.length == 0 || journal_changes(saved, now, &text) <= 0
+        || write_file_atomically(path, text.bytes, text.length) != 0) {
+        journal_reset();
+    }
+    free(text.bytes);
 }
 
-// Set space mode
-void set_space_mode(int space_num, const char* mode) {
-    if (space_num < 1 || space_num > MAX_SPACES) return;
+// Undoes text_escape() in place; 0 on a malformed escape
+static int journal_unescape(char* text) {
+    char* out = text;
+    for (char* c = text; *c; c++) {
+        if (*c != '\\') {
+            *out++ = *c;
+            continue;
+        }
+        c++;
+        if (*c == '\\') *out++ = '\\';
+        else if (*c == 't') *out++ = '\t';
+        else if (*c == 'n') *out++ = '\n';
+        else return 0;
+    }
+    *out = '\0';
+    return 1;
+}
 
-    pthread_mutex_lock(&state->lock);
-    strcpy(state->spaces[space_num - 1].mode, mode);
-    state->dirty = 1;
-    pthread_mutex_unlock(&state->lock);
+// Applies the journal to *data; returns the number of records applied. A
+// last line cut short by a crash is ignored, and a stale journal is removed
+// without being applied.
+static int journal_replay(StateData* data) {
+    char path[512];
+    journal_path(path, sizeof(path));
+    FILE* file = fopen(path, "r");
+    if (!file) return 0;
+    int applied = 0;
+    char* line = NULL;
+    size_t capacity = 0;
+    ssize_t length = getline(&line, &capacity, file);
+    char base[64];
+    if (length > 0 && journal_base(base, sizeof(base)) > 0 && strcmp(line, base) != 0) {
+        fprintf(stderr, "state_manager: dropping %s: state.json was written after it\n", path);
+        free(line);
+        fclose(file);
+        journal_reset();
+        return 0;
+    }
+    while (length > 0 && (length = getline(&line, &capacity, file)) > 0) {
+        if (line[length - 1] != '\n') break;
+        line[length - 1] = '\0';
+        char* tab = strchr(line, '\t');
+        if (!tab) continue;
+        *tab = '\0';
+        if (journal_unescape(line) && journal_unescape(tab + 1)
+            && apply_value(data, line, tab + 1)) {
+            applied++;
+        }
+    }
+    free(line);
+    fclose(file);
+    return applied;
 }
 
-// Print all space icons
-void print_space_icons() {
-    pthread_mutex_lock(&state->lock);
-    for (int i = 0; i < MAX_SPACES; i++) {
-        if (strlen(state->spaces[i].icon) > 0) {
-            printf("%d\t%s\n", i + 1, state->spaces[i].icon);
+// Load state from JSON file, then the changes journaled since it was written
+void load_json_state() {
+    StateData draft = {0};
+    if (begin_write(&draft) != 0) return;
+    parse_json_state(&draft);
+    if (journal_replay(&draft) > 0) draft.dirty = 1;
+    commit_state(&draft);
+    state_free(&draft);
+}
+
+// Re-read state.json after an outside edit. A file that is gone or only half
+// written leaves the state as it was; an unchanged one is not committed. An
+// edited file is the new base, so the journal is dropped.
+static void reload_json_state(void) {
+    StateData draft = {0};
+    StateData decoded = {0};
+    if (begin_write(&draft) != 0) return;
+    if (state_copy(&decoded, &draft) != 0 || decode_state_file(&decoded) != 1) {
+        abandon_state();
+    } else {
+        journal_reset();
+        if (!state_equal(&decoded, &draft)) {
+            commit_state(&decoded);
+        } else {
+            abandon_state();
         }
     }
-    pthread_mutex_unlock(&state->lock);
+    state_free(&decoded);
+    state_free(&draft);
 }
 
-// Main function for CLI usage
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        printf("Usage: %s <command> [args]\n", argv[0]);
-        printf("Commands:\n");
-        printf("  init                        - Initialize state\n");
-        printf("  save                        - Save state to disk\n");
-        printf("  widget <name> [on|off|toggle] - Control widget\n");
-        printf("  appearance <key> <value>    - Update appearance\n");
-        printf("  space-icon <num> <icon>     - Set space icon\n");
-        printf("  get-space-icons             - Get all space icons\n");
-        printf("  space-mode <num> <mode>     - Set space mode\n");
-        printf("  stats                       - Show performance stats\n");
-        return 1;
+// state.json.snapshot (barista_snapshot.h) records the hash of the text it
+// was built from, so readers ignore one that has fallen behind the JSON.
+static void snapshot_path(char* path, size_t capacity) {
+    snprintf(path, capacity, CONFIG_PATH_FMT ".snapshot", getenv("HOME"));
+}
+
+static int write_snapshot(const char* bytes, size_t length) {
+    char path[520];
+    snapshot_path(path, sizeof(path));
+    int written = barista_snapshot_write_file(path, bytes, length);
+    if (written < 0) fprintf(stderr, "state_manager: cannot write %s\n", path);
+    return written == 1 ? 0 : -1;
+}
+
+// Rebuilds the snapshot when it does not describe state.json as it is now,
+// as after the Lua side saved the file itself. Returns 1 when it was
+// rebuilt, 0 when it was current and -1 when state.json cannot be read or
+// is not valid JSON.
+static int refresh_snapshot(void) {
+    size_t length = 0;
+    char* bytes = read_state_file(&length);
+    if (!bytes) return -1;
+
+    char existing[520];
+    snapshot_path(existing, sizeof(existing));
+    BaristaSnapshotHeader header;
+    FILE* file = fopen(existing, "rb");
+    int current = file && fread(&header, sizeof(header), 1, file) == 1
+        && header.magic == BARISTA_SNAPSHOT_MAGIC && header.version == BARISTA_SNAPSHOT_VERSION
+        && header.source_bytes == length && header.source_hash == barista_snapshot_hash(bytes, length);
+    if (file) fclose(file);
+    int result = current ? 0 : write_snapshot(bytes, length) == 0 ? 1 : -1;
+    free(bytes);
+    return result;
+}
+
+// Successful writes of state.json by this process
+static unsigned g_saves = 0;
+
+// Save state to JSON file. It is rendered from a snapshot without holding
+// the writer lock, and the state is marked clean only if nothing was
+// committed meanwhile. The journal is settled under the lock too: dropped
+// when the file holds everything, otherwise rebased onto the new file with
+// the changes committed since the snapshot.
+void save_json_state() {
+    StateData snapshot = {0};
+    StateData draft = {0};
+    uint64_t generation = read_state(&snapshot);
+    TextBuffer text = {0};
+    render_state(&snapshot, &text);
+
+    char path[512];
+    state_config_path(path, sizeof(path));
+    if (text.failed || write_file_atomically(path, text.bytes, text.length) != 0) {
+        fprintf(stderr, "state_manager: cannot write %s\n", path);
+    } else {
+        g_saves++;
+        write_snapshot(text.bytes, text.length);
+        if (begin_write(&draft) != 0) {
+            // The state stays dirty, so the file is written again later.
+        } else if (state_generation() != generation) {
+            journal_rebase(&snapshot, &draft, text.bytes, text.length);
+            abandon_state();
+        } else {
+            journal_reset();
+            draft.dirty = 0;
+            draft.version++;
+            commit_state(&draft);
+        }
     }
+    free(text.bytes);
+    state_free(&draft);
+    state_free(&snapshot);
+}
 
-    if (init_state() != 0) {
-        fprintf(stderr, "Failed to initialize state\n");
-        return 1;
+// Get widget configuration; copies it out, since the segment may change
+// under a pointer into it. The caller frees out->icon.
+int get_widget(const char* name, WidgetConfig* out) {
+    StateData snapshot = {0};
+    read_state(&snapshot);
+    int index = find_widget(&snapshot, name);
+    if (index >= 0) {
+        *out = snapshot.widgets[index];
+        snapshot.widgets[index].icon = NULL;  // now the caller's
+    }
+    state_free(&snapshot);
+    return index >= 0;
+}
+
+// Switch a widget on (1), off (0) or over (-1); 0 when there is no such widget
+int set_widget(const char* name, int enabled) {
+    StateData draft = {0};
+    if (begin_write(&draft) != 0) return 0;
+    int index = find_widget(&draft, name);
+    if (index < 0) {
+        abandon_state();
+    } else {
+        draft.widgets[index].enabled = enabled < 0 ? !draft.widgets[index].enabled : enabled;
+        draft.dirty = 1;
+        commit_state(&draft);
+    }
+    state_free(&draft);
+    return index >= 0;
+}
+
+// Toggle widget
+void toggle_widget(const char* name) {
+    set_widget(name, -1);
+}
+
+// Update appearance; 0 for an unknown key
+int update_appearance(const char* key, const char* value) {
+    char name[64];
+    snprintf(name, sizeof(name), "appearance.%s", key);
+    return set_value(name, value);
+}
+
+// Set space icon; 0 for a space number below 1
+int set_space_icon(int space_num, const char* icon) {
+    char key[32];
+    snprintf(key, sizeof(key), "space.%d.icon", space_num);
+    return set_value(key, icon);
+}
+
+// Set space mode; 0 as for set_space_icon()
+int set_space_mode(int space_num, const char* mode) {
+    char key[32];
+    snprintf(key, sizeof(key), "space.%d.mode", space_num);
+    return set_value(key, mode);
+}
+
+// What the bar shows of `after` that differs from `before`, as one payload:
+// `--set NAME drawing=on|off` per widget, `--set space.N icon=...` per space
+// and a single `--bar` for the appearance. Returns its length, 0 when
+// nothing the bar shows changed.
+static size_t diff_payload(const StateData* before, const StateData* after,
+                           uint8_t* arena, size_t capacity) {
+    BaristaPayload payload;
+    barista_payload_init(&payload, arena, capacity);
+
+    for (int i = 0; i < after->widget_count; i++) {
+        const WidgetConfig* widget = &after->widgets[i];
+        const WidgetConfig* previous = NULL;
+        for (int j = 0; j < before->widget_count; j++) {
+            if (strcmp(before->widgets[j].name, widget->name) == 0) {
+                previous = &before->widgets[j];
+                break;
+            }
+        }
+        if (widget->name[0] == '\0' || (previous && previous->enabled == widget->enabled)) continue;
+        barista_payload_verb(&payload, BARISTA_VERB_SET);
+        barista_payload_token(&payload, widget->name);
+        barista_payload_property(&payload, "drawing", widget->enabled ? "on" : "off");
+    }
+
+    for (int i = 0; i < after->space_count; i++) {
+        const char* icon = after->spaces[i].icon;
+        if (!icon || strcmp(icon, text_or_empty(space_or_empty(before, i)->icon)) == 0) continue;
+        char item[32];
+        snprintf(item, sizeof(item), "space.%d", i + 1);
+        barista_payload_verb(&payload, BARISTA_VERB_SET);
+        barista_payload_token(&payload, item);
+        barista_payload_property(&payload, "icon", icon);
+    }
+
+    const Appearance* was = &before->appearance;
+    const Appearance* now = &after->appearance;
+    if (was->bar_height != now->bar_height || was->corner_radius != now->corner_radius
+        || was->blur_radius != now->blur_radius || was->bar_color != now->bar_color) {
+        barista_payload_verb(&payload, BARISTA_VERB_BAR);
+        if (was->bar_height != now->bar_height) {
+            barista_payload_property_int(&payload, "height", now->bar_height, 0);
+        }
+        if (was->corner_radius != now->corner_radius) {
+            barista_payload_property_int(&payload, "corner_radius", now->corner_radius, 0);
+        }
+        if (was->blur_radius != now->blur_radius) {
+            barista_payload_property_int(&payload, "blur_radius", now->blur_radius, 0);
+        }
+        if (was->bar_color != now->bar_color) {
+            char color[16];
+            snprintf(color, sizeof(color), "0x%08X", now->bar_color);
+            barista_payload_property(&payload, "color", color);
+        }
     }
+    return barista_payload_finish(&payload);
+}
+
+// Sent without waiting for the bar, like every state_manager update
+static void push_changes(const StateData* before, const StateData* after) {
+    static uint8_t arena[BARISTA_TRANSPORT_MAX_PAYLOAD_BYTES];
+    size_t length = diff_payload(before, after, arena, sizeof(arena));
+    if (length > 0) barista_sketchybar(arena, length, 0);
+}
 
-    if (strcmp(argv[1], "init") == 0) {
+// Command output, collected so the daemon can send it back to the CLI
+typedef struct {
+    char text[STATE_REPLY_BYTES];
+    size_t length;
+} Reply;
+
+static void reply_printf(Reply* reply, const char* format, ...) {
+    size_t room = sizeof(reply->text) - reply->length;
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(reply->text + reply->length, room, format, args);
+    va_end(args);
+    if (written > 0) reply->length += (size_t)written < room ? (size_t)written : room - 1;
+}
+
+// Print all space icons
+void print_space_icons(Reply* reply) {
+    StateData snapshot = {0};
+    read_state(&snapshot);
+    for (int i = 0; i < snapshot.space_count; i++) {
+        if (snapshot.spaces[i].icon) {
+            reply_printf(reply, "%d\t%s\n", i + 1, snapshot.spaces[i].icon);
+        }
+    }
+    state_free(&snapshot);
+}
+
+// get KEY: widget.NAME, appearance.FIELD, space.N.icon or space.N.mode
+static int get_value(const char* key, Reply* reply) {
+    StateData snapshot = {0};
+    read_state(&snapshot);
+    char value[STATE_REPLY_BYTES];
+    int found = format_value(&snapshot, key, value, sizeof(value));
+    if (found) reply_printf(reply, "%s\n", value);
+    state_free(&snapshot);
+    return found;
+}
+
+// Set while `serve` keeps the segment in step with state.json
+static int g_watching = 0;
+
+// Runs one command (argv[0]) against the segment. Returns 0, 1 when it
+// failed, with the reason in the reply, and 2 for an unknown command.
+static int run_command(int argc, char** argv, Reply* reply) {
+    const char* command = argv[0];
+    if (strcmp(command, "init") == 0) {
         load_json_state();
-        printf("State initialized\n");
+        reply_printf(reply, "State initialized\n");
     }
-    else if (strcmp(argv[1], "save") == 0) {
+    else if (strcmp(command, "save") == 0) {
         save_json_state();
-        printf("State saved\n");
+        reply_printf(reply, "State saved\n");
     }
-    else if (strcmp(argv[1], "get-space-icons") == 0) {
-        load_json_state(); // Ensure we have the latest state
-        print_space_icons();
+    else if (strcmp(command, "snapshot") == 0) {
+        int refreshed = refresh_snapshot();
+        if (refreshed < 0) {
+            reply_printf(reply, "Cannot snapshot state.json\n");
+            return 1;
+        }
+        reply_printf(reply, refreshed ? "Snapshot written\n" : "Snapshot current\n");
+    }
+    else if (strcmp(command, "get-space-icons") == 0) {
+        if (!g_watching) load_json_state(); // Ensure we have the latest state
+        print_space_icons(reply);
     }
-    else if (strcmp(argv[1], "widget") == 0 && argc >= 3) {
-        if (argc == 3) {
-            WidgetConfig* w = get_widget(argv[2]);
-            if (w) {
-                printf("%s: %s\n", w->name, w->enabled ? "on" : "off");
+    else if (strcmp(command, "widget") == 0 && argc >= 2) {
+        if (argc == 2) {
+            WidgetConfig w;
+            if (get_widget(argv[1], &w)) {
+                reply_printf(reply, "%s: %s\n", w.name, w.enabled ? "on" : "off");
+                free(w.icon);
             }
-        } else if (strcmp(argv[3], "toggle") == 0) {
-            toggle_widget(argv[2]);
-            printf("Toggled %s\n", argv[2]);
+        } else if (strcmp(argv[2], "toggle") == 0) {
+            toggle_widget(argv[1]);
+            reply_printf(reply, "Toggled %s\n", argv[1]);
+        } else if (strcmp(argv[2], "on") == 0 || strcmp(argv[2], "off") == 0) {
+            set_widget(argv[1], strcmp(argv[2], "on") == 0);
+            reply_printf(reply, "Turned %s %s\n", argv[1], argv[2]);
+        } else {
+            return 2;
         }
     }
-    else if (strcmp(argv[1], "appearance") == 0 && argc >= 4) {
-        update_appearance(argv[2], argv[3]);
-        printf("Updated %s to %s\n", argv[2], argv[3]);
+    else if (strcmp(command, "appearance") == 0 && argc >= 3) {
+        if (!update_appearance(argv[1], argv[2])) {
+            reply_printf(reply, "Unknown appearance key %s\n", argv[1]);
+            return 1;
+        }
+        reply_printf(reply, "Updated %s to %s\n", argv[1], argv[2]);
     }
-    else if (strcmp(argv[1], "space-icon") == 0 && argc >= 4) {
-        set_space_icon(atoi(argv[2]), argv[3]);
-        printf("Set space %s icon to %s\n", argv[2], argv[3]);
+    else if (strcmp(command, "space-icon") == 0 && argc >= 3) {
+        if (!set_space_icon(atoi(argv[1]), argv[2])) {
+            reply_printf(reply, "Cannot set space %s icon to %s\n", argv[1], argv[2]);
+            return 1;
+        }
+        reply_printf(reply, "Set space %s icon to %s\n", argv[1], argv[2]);
+    }
+    else if (strcmp(command, "space-mode") == 0 && argc >= 3) {
+        if (!set_space_mode(atoi(argv[1]), argv[2])) {
+            reply_printf(reply, "Cannot set space %s mode to %s\n", argv[1], argv[2]);
+            return 1;
+        }
+        reply_printf(reply, "Set space %s mode to %s\n", argv[1], argv[2]);
+    }
+    else if (strcmp(command, "get") == 0 && argc >= 2) {
+        if (!get_value(argv[1], reply)) {
+            reply_printf(reply, "No value for %s\n", argv[1]);
+            return 1;
+        }
+    }
+    else if (strcmp(command, "set") == 0 && argc >= 3) {
+        if (!set_value(argv[1], argv[2])) {
+            reply_printf(reply, "Cannot set %s to %s\n", argv[1], argv[2]);
+            return 1;
+        }
+    }
+    else if (strcmp(command, "stats") == 0) {
+        StateData snapshot = {0};
+        read_state(&snapshot);
+        reply_printf(reply, "Performance Stats:\n");
+        reply_printf(reply, "  Icon lookups: %llu\n", (unsigned long long)snapshot.icon_lookups);
+        reply_printf(reply, "  State updates: %llu\n", (unsigned long long)snapshot.state_updates);
+        reply_printf(reply, "  Cache hits: %llu\n", (unsigned long long)snapshot.cache_hits);
+        reply_printf(reply, "  Version: %u\n", snapshot.version);
+        reply_printf(reply, "  Generation: %llu\n", (unsigned long long)state_generation());
+        reply_printf(reply, "  Segment: %llu bytes, %llu in use\n",
+                     (unsigned long long)__atomic_load_n(&state->header.segment_bytes, __ATOMIC_ACQUIRE),
+                     (unsigned long long)__atomic_load_n(&state->image_bytes, __ATOMIC_ACQUIRE));
+        state_free(&snapshot);
     }
-    else if (strcmp(argv[1], "space-mode") == 0 && argc >= 4) {
-        set_space_mode(atoi(argv[2]), argv[3]);
-        printf("Set space %s mode to %s\n", argv[2], argv[3]);
+    else {
+        return 2;
     }
-    else if (strcmp(argv[1], "stats") == 0) {
-        printf("Performance Stats:\n");
-        printf("  Icon lookups: %llu\n", state->icon_lookups);
-        printf("  State updates: %llu\n", state->state_updates);
-        printf("  Cache hits: %llu\n", state->cache_hits);
-        printf("  Version: %u\n", state->version);
+    return 0;
+}
+
+// BARISTA_STATE_SOCKET, else $TMPDIR/barista_state.<BAR_NAME>.sock; 0 when
+// the path does not fit a Unix socket address
+static int state_socket_path(char* buffer, size_t capacity) {
+    int written = 0;
+    const char* path = getenv("BARISTA_STATE_SOCKET");
+    if (path && path[0] != '\0') {
+        written = snprintf(buffer, capacity, "%s", path);
+    } else {
+        const char* tmpdir = getenv("TMPDIR");
+        const char* bar_name = getenv("BAR_NAME");
+        if (!tmpdir || tmpdir[0] == '\0') tmpdir = "/tmp";
+        if (!bar_name || bar_name[0] == '\0') bar_name = "sketchybar";
+        if (strlen(bar_name) > MAX_BAR_NAME_BYTES || strchr(bar_name, '/')) return 0;
+        size_t tmpdir_length = strlen(tmpdir);
+        while (tmpdir_length > 1 && tmpdir[tmpdir_length - 1] == '/') tmpdir_length--;
+        written = snprintf(buffer, capacity, "%.*s/barista_state.%s.sock",
+                           (int)tmpdir_length, tmpdir, bar_name);
+    }
+    if (written <= 0 || (size_t)written >= capacity
+        || (size_t)written >= sizeof(((struct sockaddr_un*)0)->sun_path)) {
+        buffer[0] = '\0';
+        return 0;
     }
+    return 1;
+}
 
-    // Auto-save if dirty
-    if (state->dirty) {
-        save_json_state();
+static int64_t monotonic_milliseconds(void) {
+    struct timespec value = {0};
+    if (clock_gettime(CLOCK_MONOTONIC, &value) != 0) return 0;
+    return (int64_t)value.tv_sec * 1000 + (int64_t)value.tv_nsec / 1000000;
+}
+
+// Identity of state.json as last seen, so the daemon can tell its own saves
+// from outside edits
+typedef struct {
+    int64_t mtime_ns;
+    int64_t size;
+    uint64_t inode;
+    int exists;
+} FileStamp;
+
+static void file_stamp(const char* path, FileStamp* stamp) {
+    struct stat info;
+    memset(stamp, 0, sizeof(*stamp));
+    if (stat(path, &info) != 0) return;
+#ifdef __APPLE__
+    stamp->mtime_ns = (int64_t)info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    stamp->mtime_ns = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+    stamp->size = (int64_t)info.st_size;
+    stamp->inode = (uint64_t)info.st_ino;
+    stamp->exists = 1;
+}
+
+// Change notifications for state.json. The directory is watched as well, so
+// a file replaced by rename (how most editors save) is still seen. `fd` is
+// what the serve loop polls.
+typedef struct {
+    int fd;
+    char directory[512];
+    const char* name;
+#ifdef __APPLE__
+    int directory_fd;
+    int file_fd;
+    char path[512];
+#endif
+} StateWatch;
+
+#ifdef __APPLE__
+// (Re)opens the watch on the file itself, which a rename leaves behind
+static void watch_file(StateWatch* watch) {
+    if (watch->file_fd >= 0) close(watch->file_fd);
+    watch->file_fd = open(watch->path, O_EVTONLY | O_CLOEXEC);
+    if (watch->file_fd < 0) return;
+    struct kevent change;
+    EV_SET(&change, watch->file_fd, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+           NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_DELETE | NOTE_RENAME, 0, NULL);
+    kevent(watch->fd, &change, 1, NULL, 0, NULL);
+}
+#endif
+
+static int watch_open(StateWatch* watch, const char* path) {
+    memset(watch, 0, sizeof(*watch));
+    watch->fd = -1;
+#ifdef __APPLE__
+    watch->directory_fd = -1;
+    watch->file_fd = -1;
+#endif
+    const char* slash = strrchr(path, '/');
+    if (!slash || (size_t)(slash - path) >= sizeof(watch->directory)) return -1;
+    memcpy(watch->directory, path, (size_t)(slash - path));
+    watch->directory[slash - path] = '\0';
+    watch->name = slash + 1;
+#ifdef __APPLE__
+    snprintf(watch->path, sizeof(watch->path), "%s", path);
+    watch->fd = kqueue();
+    if (watch->fd < 0) return -1;
+    fcntl(watch->fd, F_SETFD, FD_CLOEXEC);
+    watch->directory_fd = open(watch->directory, O_EVTONLY | O_CLOEXEC);
+    struct kevent change;
+    EV_SET(&change, watch->directory_fd, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE, 0, NULL);
+    if (watch->directory_fd < 0 || kevent(watch->fd, &change, 1, NULL, 0, NULL) != 0) {
+        if (watch->directory_fd >= 0) close(watch->directory_fd);
+        close(watch->fd);
+        watch->fd = -1;
+        return -1;
+    }
+    watch_file(watch);
+#else
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->fd < 0) return -1;
+    if (inotify_add_watch(watch->fd, watch->directory,
+                          IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE
+                          | IN_MOVED_FROM | IN_MOVED_TO) < 0) {
+        close(watch->fd);
+        watch->fd = -1;
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+// Reads every pending notification; 1 when state.json may have changed
+static int watch_drain(StateWatch* watch) {
+    int changed = 0;
+#ifdef __APPLE__
+    struct kevent events[8];
+    struct timespec immediately = {0, 0};
+    int rewatch = 0;
+    int count;
+    while ((count = kevent(watch->fd, NULL, 0, events, 8, &immediately)) > 0) {
+        changed = 1;
+        for (int i = 0; i < count; i++) {
+            if ((int)events[i].ident == watch->directory_fd
+                || (events[i].fflags & (NOTE_DELETE | NOTE_RENAME))) {
+                rewatch = 1;
+            }
+        }
+    }
+    if (rewatch) watch_file(watch);
+#else
+    union {
+        struct inotify_event event;
+        char bytes[4096];
+    } buffer;
+    ssize_t count;
+    while ((count = read(watch->fd, buffer.bytes, sizeof(buffer.bytes))) > 0) {
+        for (ssize_t offset = 0; offset < count; ) {
+            const struct inotify_event* event = (const struct inotify_event*)(buffer.bytes + offset);
+            if ((event->mask & IN_Q_OVERFLOW)
+                || (event->len > 0 && strcmp(event->name, watch->name) == 0)) {
+                changed = 1;
+            }
+            offset += (ssize_t)(sizeof(*event) + event->len);
+        }
+    }
+#endif
+    return changed;
+}
+
+static void watch_close(StateWatch* watch) {
+#ifdef __APPLE__
+    if (watch->file_fd >= 0) close(watch->file_fd);
+    if (watch->directory_fd >= 0) close(watch->directory_fd);
+#endif
+    if (watch->fd >= 0) close(watch->fd);
+    watch->fd = -1;
+}
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void handle_stop(int signal_number) {
+    (void)signal_number;
+    g_stop = 1;
+}
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Runs one framed request (the CLI's argv as NUL-separated tokens) and sends
+// back what the command printed
+static void serve_request(int fd, char* request, size_t length) {
+    Reply reply;
+    reply.length = 0;
+    reply.text[0] = '\0';
+    uint32_t flags = BARISTA_FRAME_NOT_DELIVERED | STATE_FRAME_USAGE;
+    if (barista_payload_valid(request, length)) {
+        char* argv[STATE_MAX_ARGS];
+        int argc = 0;
+        for (size_t offset = 0; request[offset] != '\0' && argc < STATE_MAX_ARGS; ) {
+            argv[argc++] = request + offset;
+            offset += strlen(request + offset) + 1;
+        }
+        int status = run_command(argc, argv, &reply);
+        flags = status == 0 ? 0 : status == 1 ? BARISTA_FRAME_NOT_DELIVERED : flags;
+    }
+    barista_frame_write(fd, reply.text, reply.length + 1, flags, STATE_READ_TIMEOUT_MS);
+}
+
+// What the daemon has shown the bar and written down
+typedef struct {
+    StateData shown;     // last pushed to the bar
+    StateData recorded;  // in state.json and the journal
+    FileStamp stamp;     // state.json as last written or read here
+    unsigned saves;      // g_saves when `stamp` was taken
+    int save_ms;         // quiet period before state.json is written
+    int64_t dirty_since;
+    int64_t save_at;
+    char config[512];
+} ServeState;
+
+// Journals what changed since the last call and schedules the write of
+// state.json, then pushes everything the bar has not seen yet as one
+// payload. After a reload the edited file already holds the changes.
+static void publish_changes(ServeState* daemon, int reloaded) {
+    StateData now = {0};
+    read_state(&now);
+    int records = 0;
+    if (!reloaded) {
+        TextBuffer text = {0};
+        records = journal_changes(&daemon->recorded, &now, &text);
+        if (records > 0 && journal_append(text.bytes, text.length) != 0) records = -1;
+        free(text.bytes);
+    }
+    if (state_copy(&daemon->recorded, &now) != 0) records = -1;
+
+    int64_t current = monotonic_milliseconds();
+    if (records < 0) {
+        daemon->save_at = current;
+    } else if (now.dirty && (records > 0 || daemon->save_at < 0)) {
+        // Each change restarts the quiet period, up to a limit.
+        int limit = daemon->save_ms > STATE_SAVE_MAX_DELAY_MS ? daemon->save_ms
+                                                               : STATE_SAVE_MAX_DELAY_MS;
+        if (daemon->dirty_since < 0) daemon->dirty_since = current;
+        daemon->save_at = current + daemon->save_ms;
+        if (daemon->save_at > daemon->dirty_since + limit) daemon->save_at = daemon->dirty_since + limit;
+    }
+
+    push_changes(&daemon->shown, &now);
+    state_free(&daemon->shown);
+    daemon->shown = now;  // handed over
+}
+
+static void save_if_dirty(ServeState* daemon) {
+    StateData now = {0};
+    read_state(&now);
+    if (now.dirty) save_json_state();
+    state_free(&now);
+    daemon->save_at = -1;
+    daemon->dirty_since = -1;
+}
+
+static int serve(const char* path, int save_ms) {
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+
+    // Listening comes first: a second daemon stops here before touching the
+    // segment or the journal, and commands sent while the state loads wait
+    // in the backlog rather than running without us.
+    int listener = barista_socket_listen(path);
+    if (listener < 0 || set_nonblocking(listener) != 0) {
+        fprintf(stderr, "state_manager: cannot listen on %s: %s\n", path,
+                errno == EADDRINUSE ? "a daemon is already serving it" : strerror(errno));
+        if (listener >= 0) {
+            close(listener);
+            unlink(path);
+        }
+        return 1;
+    }
+    if (init_state() != 0) {
+        fprintf(stderr, "Failed to initialize state\n");
+        close(listener);
+        unlink(path);
+        return 1;
     }
+    static ServeState daemon;
+    daemon.save_ms = save_ms;
+    daemon.dirty_since = -1;
+    daemon.save_at = -1;
+    state_config_path(daemon.config, sizeof(daemon.config));
+    StateWatch watch;
+    g_watching = watch_open(&watch, daemon.config) == 0;
+    if (!g_watching) {
+        fprintf(stderr, "state_manager: not watching %s: %s\n", daemon.config, strerror(errno));
+    }
+
+    // The bar was built from this file, so loading it pushes nothing. The
+    // journal replayed over it is still on disk, so the result counts as
+    // recorded; it is written into state.json after the quiet period.
+    load_json_state();
+    read_state(&daemon.shown);
+    state_copy(&daemon.recorded, &daemon.shown);
+    file_stamp(daemon.config, &daemon.stamp);
+    daemon.saves = g_saves;
+    if (daemon.shown.dirty) daemon.save_at = monotonic_milliseconds() + save_ms;
+    refresh_snapshot();
 
+    static char request[BARISTA_TRANSPORT_MAX_PAYLOAD_BYTES];
+    struct pollfd descriptors[2 + STATE_MAX_CLIENTS];
+    int client_count = 0;
+    int64_t reload_at = -1;
+    descriptors[0].fd = listener;
+    descriptors[0].events = POLLIN;
+    descriptors[1].fd = watch.fd;  // poll() skips it when negative
+    descriptors[1].events = POLLIN;
+
+    while (!g_stop) {
+        int64_t wake = reload_at;
+        if (daemon.save_at >= 0 && (wake < 0 || daemon.save_at < wake)) wake = daemon.save_at;
+        int timeout = -1;
+        if (wake >= 0) {
+            int64_t now = monotonic_milliseconds();
+            timeout = wake > now ? (int)(wake - now) : 0;
+        }
+        int ready = poll(descriptors, (nfds_t)(2 + client_count), timeout);
+        if (ready < 0 && errno != EINTR) break;
+        int handled = 0;
+        int reloaded = 0;
+
+        if (ready > 0 && (descriptors[0].revents & POLLIN)) {
+            for (;;) {
+                int client = accept(listener, NULL, NULL);
+                if (client < 0) break;
+                if (client_count >= STATE_MAX_CLIENTS || set_nonblocking(client) != 0) {
+                    close(client);
+                    continue;
+                }
+                descriptors[2 + client_count].fd = client;
+                descriptors[2 + client_count].events = POLLIN;
+                descriptors[2 + client_count].revents = 0;
+                client_count++;
+            }
+        }
+
+        if (ready > 0 && (descriptors[1].revents & POLLIN) && watch_drain(&watch)) {
+            reload_at = monotonic_milliseconds() + STATE_RELOAD_SETTLE_MS;
+        }
+
+        for (int i = 1 + client_count; ready > 0 && i >= 2; i--) {
+            if (!(descriptors[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            size_t length = 0;
+            int fd = descriptors[i].fd;
+            if (barista_frame_read(fd, request, sizeof(request), &length, NULL,
+                                   STATE_READ_TIMEOUT_MS) != 0) {
+                close(fd);
+                descriptors[i] = descriptors[1 + client_count];
+                client_count--;
+                continue;
+            }
+            serve_request(fd, request, length);
+            handled = 1;
+        }
+
+        if (reload_at >= 0 && monotonic_milliseconds() >= reload_at) {
+            reload_at = -1;
+            FileStamp current;
+            file_stamp(daemon.config, &current);
+            if (memcmp(&current, &daemon.stamp, sizeof(current)) != 0) {
+                daemon.stamp = current;
+                reload_json_state();
+                refresh_snapshot();
+                handled = reloaded = 1;
+            }
+        }
+
+        if (handled) publish_changes(&daemon, reloaded);
+        if (daemon.save_at >= 0 && monotonic_milliseconds() >= daemon.save_at) save_if_dirty(&daemon);
+        if (daemon.saves != g_saves) {
+            // Our own write, not an edit to reload.
+            file_stamp(daemon.config, &daemon.stamp);
+            daemon.saves = g_saves;
+        }
+    }
+
+    save_if_dirty(&daemon);
+    state_free(&daemon.shown);
+    state_free(&daemon.recorded);
+    for (int i = 2; i < 2 + client_count; i++) close(descriptors[i].fd);
+    close(listener);
+    unlink(path);
+    watch_close(&watch);
     return 0;
-}
\ No newline at end of file
+}
+
+// Hands the command to a listening `serve`. Returns its exit status, or -1
+// when there is no daemon and the command should run here. A command that
+// reached the daemon is never run twice.
+static int forward_command(int argc, char** argv) {
+    // BARISTA_STATE_DAEMON=0 (or off, false, disabled) always runs it here.
+    const char* mode = getenv("BARISTA_STATE_DAEMON");
+    if (mode && (strcmp(mode, "0") == 0 || strcasecmp(mode, "off") == 0
+                 || strcasecmp(mode, "false") == 0 || strcasecmp(mode, "disabled") == 0)) {
+        return -1;
+    }
+    // BARISTA_STATE_DAEMON=required fails instead, for callers that must
+    // know the daemon saw the command.
+    int required = mode && strcasecmp(mode, "required") == 0;
+    char path[256];
+    if (!state_socket_path(path, sizeof(path))) return required ? 1 : -1;
+    int fd = barista_socket_connect(path);
+    if (fd < 0) {
+        if (!required) return -1;
+        fprintf(stderr, "state_manager: no daemon on %s\n", path);
+        return 1;
+    }
+
+    uint8_t arena[4096];
+    BaristaPayload payload;
+    barista_payload_init(&payload, arena, sizeof(arena));
+    for (int i = 0; i < argc; i++) barista_payload_token(&payload, argv[i]);
+    size_t length = barista_payload_finish(&payload);
+    if (length == 0 || barista_frame_write(fd, arena, length, 0, STATE_REPLY_TIMEOUT_MS) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    static char text[STATE_REPLY_BYTES + 1];
+    size_t received = 0;
+    uint32_t flags = 0;
+    int status = barista_frame_read(fd, text, sizeof(text) - 1, &received, &flags,
+                                    STATE_REPLY_TIMEOUT_MS);
+    close(fd);
+    if (status != 0) {
+        fprintf(stderr, "state_manager: no reply from %s\n", path);
+        return 1;
+    }
+    text[received] = '\0';
+    if (flags & STATE_FRAME_USAGE) return 2;
+    fputs(text, (flags & BARISTA_FRAME_NOT_DELIVERED) ? stderr : stdout);
+    return (flags & BARISTA_FRAME_NOT_DELIVERED) ? 1 : 0;
+}
+
+static void print_usage(const char* program) {
+    printf("Usage: %s <command> [args]\n", program);
+    printf("Commands:\n");
+    printf("  init                        - Initialize state\n");
+    printf("  save                        - Save state to disk\n");
+    printf("  widget <name> [on|off|toggle] - Control widget\n");
+    printf("  appearance <key> <value>    - Update appearance\n");
+    printf("  space-icon <num> <icon>     - Set space icon\n");
+    printf("  get-space-icons             - Get all space icons\n");
+    printf("  space-mode <num> <mode>     - Set space mode\n");
+    printf("  get <key>                   - Print widget.NAME, appearance.KEY,\n");
+    printf("                                space.N.icon or space.N.mode\n");
+    printf("  set <key> <value>           - Change one of those\n");
+    printf("  snapshot                    - Rebuild state.json.snapshot if it is stale\n");
+    printf("  stats                       - Show performance stats\n");
+    printf("  serve [--socket PATH] [--save-ms N]\n");
+    printf("                              - Keep the state resident and watch state.json\n");
+}
+
+// Main function for CLI usage
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "serve") == 0) {
+        char path[256] = "";
+        int save_ms = STATE_SAVE_QUIET_MS;
+        for (int index = 2; index < argc; index++) {
+            if (strcmp(argv[index], "--socket") == 0 && index + 1 < argc) {
+                snprintf(path, sizeof(path), "%s", argv[++index]);
+            } else if (strcmp(argv[index], "--save-ms") == 0 && index + 1 < argc) {
+                save_ms = atoi(argv[++index]);
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        if (path[0] == '\0' && !state_socket_path(path, sizeof(path))) {
+            fprintf(stderr, "state_manager: no usable socket path\n");
+            return 1;
+        }
+        if (save_ms < 0) save_ms = 0;
+        if (save_ms > STATE_SAVE_MAX_QUIET_MS) save_ms = STATE_SAVE_MAX_QUIET_MS;
+        return serve(path, save_ms);
+    }
+
+    int status = forward_command(argc - 1, argv + 1);
+    if (status < 0) {
+        if (init_state() != 0) {
+            fprintf(stderr, "Failed to initialize state\n");
+            return 1;
+        }
+
+        StateData before = {0};
+        read_state(&before);
+        static Reply reply;
+        status = run_command(argc - 1, argv + 1, &reply);
+        fwrite(reply.text, 1, reply.length, status == 1 ? stderr : stdout);
+
+        // Auto-save if dirty
+        StateData after = {0};
+        read_state(&after);
+        if (after.dirty) {
+            save_json_state();
+        }
+        // Loading state.json only catches the segment up with the file the
+        // bar was built from; everything else shows up on the bar at once.
+        if (status == 0 && strcmp(argv[1], "init") != 0 && strcmp(argv[1], "get-space-icons") != 0) {
+            push_changes(&before, &after);
+        }
+        state_free(&before);
+        state_free(&after);
+    }
+    if (status == 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    return status;
+}
@@ -7,10 +7,12 @@
 #include <sys/file.h>
 #include <fcntl.h>
 #include <limits.h>
-#include <stdarg.h>
 #include <signal.h>
 #include <errno.h>
 
+#include "barista_cli.h"
+#include "barista_payload.h"
+
 static const char *HOVER_BG = "0x80cba6f7";
 static const char *IDLE_BG = "0x00000000";
 
@@ -38,7 +40,7 @@ static void load_submenu_list(const char *tmpdir) {
     while (SUBMENU_COUNT < MAX_DYNAMIC_SUBMENUS && fgets(line, sizeof(line), fp)) {
       line[strcspn(line, "\n\r")] = '\0';
       if (line[0] == '\0') continue;
-      strncpy(dynamic_names[SUBMENU_COUNT], line, sizeof(dynamic_names[0]) - 1);
+      snprintf(dynamic_names[SUBMENU_COUNT], sizeof(dynamic_names[0]), "%s", line);
       SUBMENUS[SUBMENU_COUNT] = dynamic_names[SUBMENU_COUNT];
       SUBMENU_COUNT++;
     }
@@ -62,13 +64,24 @@ static int HOVER_CORNER_RADIUS = 6;
 static int HOVER_PADDING_LEFT = 4;
 static int HOVER_PADDING_RIGHT = 4;
 
-static void run_cmd(const char *fmt, ...) {
-  char buffer[1024];
-  va_list args;
-  va_start(args, fmt);
-  vsnprintf(buffer, sizeof(buffer), fmt, args);
-  va_end(args);
-  system(buffer);
+/* Room for a --set of every submenu in one request */
+static uint8_t payload_arena[MAX_DYNAMIC_SUBMENUS * 384];
+
+static void begin_payload(BaristaPayload *payload) {
+  barista_payload_init(payload, payload_arena, sizeof(payload_arena));
+}
+
+static void send_payload(BaristaPayload *payload) {
+  size_t length = barista_payload_finish(payload);
+  if (length > 0) barista_sketchybar(payload->bytes, length, 0);
+}
+
+static void append_submenu_off(BaristaPayload *payload, const char *name) {
+  barista_payload_verb(payload, BARISTA_VERB_SET);
+  barista_payload_token(payload, name);
+  barista_payload_property(payload, "popup.drawing", "off");
+  barista_payload_property(payload, "background.drawing", "off");
+  barista_payload_property(payload, "background.color", IDLE_BG);
 }
 
 static void record_active(const char *name) {
@@ -125,17 +138,16 @@ static void record_parent_open() {
   close(fd);
 }
 
-static int is_parent_open() {
-  int fd = open(parent_state_file, O_RDONLY);
-  if (fd < 0) return 0;
-  close(fd);
-  return 1;
+// The pid file of a pending close for this submenu; 0 when it does not fit
+static int pending_close_path(char *path, size_t capacity, const char *name) {
+  int length = snprintf(path, capacity, "%s.%s", pid_file, name);
+  return length > 0 && (size_t)length < capacity;
 }
 
 // Kill any pending close process for this submenu
 static void cancel_pending_close(const char *name) {
   char submenu_pid_file[PATH_MAX];
-  snprintf(submenu_pid_file, sizeof(submenu_pid_file), "%s.%s", pid_file, name);
+  if (!pending_close_path(submenu_pid_file, sizeof(submenu_pid_file), name)) return;
 
   int fd = open(submenu_pid_file, O_RDONLY);
   if (fd < 0) return;
@@ -157,7 +169,7 @@ static void cancel_pending_close(const char *name) {
 // Record the PID of a pending close
 static void record_pending_close(const char *name, pid_t pid) {
   char submenu_pid_file[PATH_MAX];
-  snprintf(submenu_pid_file, sizeof(submenu_pid_file), "%s.%s", pid_file, name);
+  if (!pending_close_path(submenu_pid_file, sizeof(submenu_pid_file), name)) return;
 
   int fd = open(submenu_pid_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
   if (fd < 0) return;
@@ -169,21 +181,17 @@ static void record_pending_close(const char *name, pid_t pid) {
 }
 
 static void close_other_submenus(const char *current) {
-  // Build a single batched command for efficiency
-  char cmd[4096] = "sketchybar";
+  // Build a single batched request for efficiency
+  BaristaPayload payload;
+  begin_payload(&payload);
 
   for (size_t i = 0; i < SUBMENU_COUNT; i++) {
     const char *submenu = SUBMENUS[i];
     if (strcmp(submenu, current) == 0) continue;
-
-    char part[256];
-    snprintf(part, sizeof(part),
-             " --set %s popup.drawing=off background.drawing=off background.color=%s",
-             submenu, IDLE_BG);
-    strncat(cmd, part, sizeof(cmd) - strlen(cmd) - 1);
+    append_submenu_off(&payload, submenu);
   }
 
-  system(cmd);
+  send_payload(&payload);
 }
 
 static void schedule_close(const char *name) {
@@ -201,6 +209,9 @@ static void schedule_close(const char *name) {
     return;
   }
 
+  // The parent's cached bar connection is not ours to share
+  barista_transport_reset();
+
   // Wait for delay
   usleep((useconds_t)(CLOSE_DELAY * 1000000.0));
 
@@ -208,14 +219,15 @@ static void schedule_close(const char *name) {
   char current[256];
   if (!read_active(current, sizeof(current)) || strcmp(current, name) != 0) {
     // Close submenu and reset background
-    run_cmd("sketchybar --set %s popup.drawing=off background.drawing=off background.color=%s",
-            name, IDLE_BG);
+    BaristaPayload payload;
+    begin_payload(&payload);
+    append_submenu_off(&payload, name);
+    send_payload(&payload);
   }
 
   // Clean up our PID file
   char submenu_pid_file[PATH_MAX];
-  snprintf(submenu_pid_file, sizeof(submenu_pid_file), "%s.%s", pid_file, name);
-  unlink(submenu_pid_file);
+  if (pending_close_path(submenu_pid_file, sizeof(submenu_pid_file), name)) unlink(submenu_pid_file);
 
   _exit(0);
 }
@@ -274,10 +286,17 @@ int main(void) {
     close_other_submenus(name);
     record_active(name);
     record_parent_open();  // Lock parent popup from closing
-    run_cmd("sketchybar --set %s popup.drawing=on background.drawing=on "
-            "background.color=%s background.corner_radius=%d "
-            "background.padding_left=%d background.padding_right=%d",
-            name, HOVER_BG, HOVER_CORNER_RADIUS, HOVER_PADDING_LEFT, HOVER_PADDING_RIGHT);
+    BaristaPayload payload;
+    begin_payload(&payload);
+    barista_payload_verb(&payload, BARISTA_VERB_SET);
+    barista_payload_token(&payload, name);
+    barista_payload_property(&payload, "popup.drawing", "on");
+    barista_payload_property(&payload, "background.drawing", "on");
+    barista_payload_property(&payload, "background.color", HOVER_BG);
+    barista_payload_property_int(&payload, "background.corner_radius", HOVER_CORNER_RADIUS, 0);
+    barista_payload_property_int(&payload, "background.padding_left", HOVER_PADDING_LEFT, 0);
+    barista_payload_property_int(&payload, "background.padding_right", HOVER_PADDING_RIGHT, 0);
+    send_payload(&payload);
     return 0;
   }
 
@@ -290,10 +309,14 @@ int main(void) {
     // Global exit: close everything
     clear_active();
     close_other_submenus(name);  // Close all submenus
-    run_cmd("sketchybar --set %s popup.drawing=off background.drawing=off background.color=%s",
-            name, IDLE_BG);
+    BaristaPayload payload;
+    begin_payload(&payload);
+    append_submenu_off(&payload, name);
     // Also close parent popup
-    run_cmd("sketchybar --set %s popup.drawing=off", PARENT_POPUP);
+    barista_payload_verb(&payload, BARISTA_VERB_SET);
+    barista_payload_token(&payload, PARENT_POPUP);
+    barista_payload_property(&payload, "popup.drawing", "off");
+    send_payload(&payload);
     return 0;
   }
 
@@ -3,9 +3,10 @@
 // No arguments updates the compact bar item. `popup_refresh` updates only the
 // enabled detail rows. Both paths send one bounded SketchyBar Mach request;
 // the shell wrapper remains the portable fallback when native transport fails.
+// `--daemon` stays resident and answers both paths from a per-row cache over
+// a local socket; without a daemon each run probes the system itself.
 
 #include <arpa/inet.h>
-#include <bootstrap.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <ifaddrs.h>
@@ -13,7 +14,6 @@
 #include <math.h>
 #include <mach/mach.h>
 #include <mach/mach_host.h>
-#include <mach/message.h>
 #include <net/if.h>
 #include <poll.h>
 #include <pthread.h>
@@ -26,14 +26,24 @@
 #include <string.h>
 #include <strings.h>
 #include <sys/mount.h>
+#include <sys/socket.h>
 #include <sys/sysctl.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 #include <SystemConfiguration/SystemConfiguration.h>
 
+#include "barista_cpu_sample.h"
+#include "barista_executor.h"
+#include "barista_payload.h"
+#include "barista_probe.h"
+#include "barista_sent_cache.h"
+#include "barista_top.h"
+#include "barista_transport.h"
+
 extern char **environ;
 
 #define MAX_ARGUMENTS 64
@@ -42,9 +52,25 @@ extern char **environ;
 #define DEFAULT_PROBE_TIMEOUT_MS 500
 #define LABEL_BYTES 512
 #define SMALL_VALUE_BYTES 128
-
-static const mach_msg_timeout_t kMachSendTimeoutMilliseconds = 50;
-static const mach_msg_timeout_t kMachReceiveTimeoutMilliseconds = 150;
+/* The top-process row compares CPU time against the previous refresh's
+ * scan; without one this recent it scans twice, this far apart. */
+#define PROCESS_BASELINE_MAX_AGE_NS (30ULL * 1000000000ULL)
+#define PROCESS_SETTLE_MICROSECONDS 200000
+#define MAX_BAR_NAME_BYTES 128
+/* Resident-mode wire format: one request frame, one or two reply frames. */
+#define DAEMON_MAGIC 0x42534931u /* "BSI1" */
+#define DAEMON_FRAME_FOLLOW_UP 0x1u     /* request: wait for revalidated rows */
+#define DAEMON_FRAME_REVALIDATING 0x2u  /* reply: fresher rows follow */
+#define DAEMON_REPLY_TIMEOUT_MS 250
+#define DAEMON_REVALIDATE_TIMEOUT_MS 3000
+#define DAEMON_READ_TIMEOUT_MS 50
+#define DAEMON_POLL_MILLISECONDS 1000
+#define DAEMON_MAX_WAITERS 16
+#define DAEMON_INLINE_DEADLINE_MS 150
+#define DAEMON_REFRESH_DEADLINE_MS 2000
+#define DEFAULT_GATHER_DEADLINE_MS 400
+
+static const int kMachReceiveTimeoutMilliseconds = 150;
 
 #ifdef BARISTA_SYSTEM_INFO_TESTING
 static void (*capture_test_hook)(const char *stage, const char *path) = NULL;
@@ -62,6 +88,7 @@ typedef enum {
 
 #define DEFAULT_POPUP_ROWS (ROW_MEM | ROW_DISK | ROW_NET | ROW_SWAP | ROW_UPTIME | ROW_PROCS)
 #define ALL_POPUP_ROWS (ROW_CPU | DEFAULT_POPUP_ROWS)
+#define POPUP_ROW_COUNT 7
 
 typedef struct {
     uint32_t mask;
@@ -95,6 +122,10 @@ typedef struct {
     bool process_available;
     double process_cpu;
     char process_name[256];
+
+    /* Rows whose probe missed the deadline, and how long each probe took. */
+    uint32_t missed_rows;
+    uint32_t probe_microseconds[POPUP_ROW_COUNT];
 } SystemInfo;
 
 typedef struct {
@@ -104,23 +135,19 @@ typedef struct {
 } ProcessSample;
 
 typedef struct {
-    uint8_t bytes[MAX_PAYLOAD_BYTES];
-    size_t length;
-    size_t arguments;
-    bool failed;
+    uint8_t arena[MAX_PAYLOAD_BYTES];
+    BaristaPayload wire;
+    /* `--set item` is written with the item's first unsuppressed property. */
+    char item[MAX_TOKEN_BYTES + 1];
+    bool item_pending;
+    /* Properties checked against the shared sent cache; recorded after a
+     * confirmed send and forgotten after a failed one. */
+    bool use_sent_cache;
+    BaristaSentEntry sent[MAX_ARGUMENTS];
+    size_t sent_count;
+    size_t suppressed;
 } Payload;
 
-struct barista_mach_message {
-    mach_msg_header_t header;
-    mach_msg_size_t descriptor_count;
-    mach_msg_ool_descriptor_t descriptor;
-};
-
-struct barista_mach_buffer {
-    struct barista_mach_message message;
-    mach_msg_trailer_t trailer;
-};
-
 static uint64_t monotonic_milliseconds(void) {
     struct timespec value = {0};
     if (clock_gettime(CLOCK_MONOTONIC, &value) != 0) {
@@ -129,6 +156,14 @@ static uint64_t monotonic_milliseconds(void) {
     return (uint64_t)value.tv_sec * 1000ULL + (uint64_t)value.tv_nsec / 1000000ULL;
 }
 
+static uint64_t realtime_nanoseconds(void) {
+    struct timespec value = {0};
+    if (clock_gettime(CLOCK_REALTIME, &value) != 0) {
+        return 0;
+    }
+    return (uint64_t)value.tv_sec * 1000000000ULL + (uint64_t)value.tv_nsec;
+}
+
 static int clamp_percent(int value) {
     if (value < 0) return 0;
     if (value > 100) return 100;
@@ -155,6 +190,59 @@ static bool native_disabled(void) {
     return parse_bool(getenv("BARISTA_SYSTEM_INFO_NATIVE_DISABLE"), &disabled) && disabled;
 }
 
+typedef enum {
+    TOP_SOURCE_PS,
+    TOP_SOURCE_NATIVE,
+    TOP_SOURCE_AUTO,
+} TopSource;
+
+/* BARISTA_SYSTEM_INFO_TOP=ps always ranks with the setuid ps, and `native`
+ * always with the in-process sampler, which then ranks only the processes
+ * this user may inspect. By default the sampler ranks, and hands over to ps
+ * when it cannot start or a scan was refused any process. */
+static TopSource top_source(void) {
+    const char *value = getenv("BARISTA_SYSTEM_INFO_TOP");
+    if (value && strcmp(value, "ps") == 0) return TOP_SOURCE_PS;
+    if (value && strcmp(value, "native") == 0) return TOP_SOURCE_NATIVE;
+    return TOP_SOURCE_AUTO;
+}
+
+/* BARISTA_SYSTEM_INFO_DAEMON=0 (or `disabled`) makes every run probe the
+ * system itself even when a daemon is listening. */
+static bool daemon_client_disabled(void) {
+    const char *value = getenv("BARISTA_SYSTEM_INFO_DAEMON");
+    bool enabled = true;
+    if (value && strcasecmp(value, "disabled") == 0) return true;
+    return parse_bool(value, &enabled) && !enabled;
+}
+
+/* BARISTA_SYSTEM_INFO_SOCKET, else $TMPDIR/barista_system_info.<BAR_NAME>.sock. */
+static bool daemon_socket_path(char *buffer, size_t capacity) {
+    if (!buffer || capacity == 0) return false;
+    buffer[0] = '\0';
+    int written = 0;
+    const char *path = getenv("BARISTA_SYSTEM_INFO_SOCKET");
+    if (path && path[0] != '\0') {
+        written = snprintf(buffer, capacity, "%s", path);
+    } else {
+        const char *tmpdir = getenv("TMPDIR");
+        const char *bar_name = getenv("BAR_NAME");
+        if (!tmpdir || tmpdir[0] == '\0') tmpdir = "/tmp";
+        if (!bar_name || bar_name[0] == '\0') bar_name = "sketchybar";
+        if (strlen(bar_name) > MAX_BAR_NAME_BYTES || strchr(bar_name, '/')) return false;
+        size_t tmpdir_length = strlen(tmpdir);
+        while (tmpdir_length > 1 && tmpdir[tmpdir_length - 1] == '/') tmpdir_length--;
+        written = snprintf(buffer, capacity, "%.*s/barista_system_info.%s.sock",
+                           (int)tmpdir_length, tmpdir, bar_name);
+    }
+    if (written <= 0 || (size_t)written >= capacity
+        || (size_t)written >= sizeof(((struct sockaddr_un *)0)->sun_path)) {
+        buffer[0] = '\0';
+        return false;
+    }
+    return true;
+}
+
 static uint32_t row_for_name(const char *name) {
     if (strcmp(name, "cpu") == 0) return ROW_CPU;
     if (strcmp(name, "mem") == 0) return ROW_MEM;
@@ -253,7 +341,12 @@ static bool capture_process_internal(const char *path,
         close(pipe_fds[1]);
         return false;
     }
-    if (posix_spawnattr_setflags(&attributes, POSIX_SPAWN_CLOEXEC_DEFAULT) != 0) {
+    /* Probe threads block signals; the tool must still see the SIGTERM below. */
+    sigset_t no_signals;
+    sigemptyset(&no_signals);
+    if (posix_spawnattr_setsigmask(&attributes, &no_signals) != 0
+        || posix_spawnattr_setflags(&attributes,
+                                    POSIX_SPAWN_CLOEXEC_DEFAULT | POSIX_SPAWN_SETSIGMASK) != 0) {
         posix_spawnattr_destroy(&attributes);
         posix_spawn_file_actions_destroy(&actions);
         close(pipe_fds[0]);
@@ -392,6 +485,17 @@ static bool capture_first_line(const char *path,
     return capture_process_internal(path, argv, output, output_size, timeout_ms, true);
 }
 
+/* Busy share of the CPU ticks since the previous run of either entrypoint,
+ * from the sample record it left under $TMPDIR. False on the first run of a
+ * boot. */
+static bool cpu_tick_percent(double *percent) {
+    char path[1024];
+    BaristaCpuTicks ticks;
+    return barista_cpu_sample_path(path, sizeof(path))
+        && barista_cpu_ticks_read(&ticks)
+        && barista_cpu_sample_update(path, &ticks, percent);
+}
+
 static void get_cpu_info(SystemInfo *info) {
     if (!info) return;
     double load_average[3] = {0};
@@ -405,7 +509,12 @@ static void get_cpu_info(SystemInfo *info) {
         }
     }
     info->load_avg = load_average[0];
-    info->cpu_percent = clamp_percent((int)((load_average[0] / (double)cores) * 100.0 + 0.5));
+    double busy = 0.0;
+    if (cpu_tick_percent(&busy)) {
+        info->cpu_percent = clamp_percent((int)(busy + 0.5));
+    } else {
+        info->cpu_percent = clamp_percent((int)((load_average[0] / (double)cores) * 100.0 + 0.5));
+    }
     info->cpu_available = true;
 }
 
@@ -482,9 +591,23 @@ static bool parse_disk_output(char *output, SystemInfo *info) {
     return true;
 }
 
+static bool disk_info_from_usage(const BaristaDiskUsage *usage, SystemInfo *info) {
+    if (!usage || !info) return false;
+    if (!barista_format_size(usage->total_bytes, info->disk_total, sizeof(info->disk_total))
+        || !barista_format_size(usage->used_bytes, info->disk_used, sizeof(info->disk_used))) {
+        return false;
+    }
+    info->disk_percent = clamp_percent(usage->percent);
+    info->disk_available = true;
+    return true;
+}
+
 static void get_disk_info(SystemInfo *info) {
     if (!info) return;
     const char *mount_path = disk_mount_path();
+    BaristaDiskUsage usage;
+    if (barista_disk_usage(mount_path, &usage) && disk_info_from_usage(&usage, info)) return;
+
     char *const arguments[] = {"/bin/df", "-h", (char *)mount_path, NULL};
     char output[4096];
     if (!capture_process("/bin/df", arguments, output, sizeof(output), DEFAULT_PROBE_TIMEOUT_MS)) {
@@ -546,6 +669,15 @@ static bool parse_route_interface(const char *command_output,
 
 static bool default_route_interface(char *output, size_t output_size) {
     if (!output || output_size == 0) return false;
+    char candidate[IFNAMSIZ] = "";
+    int native = barista_default_route_interface(candidate, sizeof(candidate));
+    if (native == 0) return false;
+    if (native > 0) {
+        if (!valid_interface_name(candidate)) return false;
+        snprintf(output, output_size, "%s", candidate);
+        return true;
+    }
+
     char *const arguments[] = {"/sbin/route", "-n", "get", "default", NULL};
     char command_output[4096];
     if (!capture_process("/sbin/route", arguments, command_output,
@@ -630,6 +762,10 @@ static bool wifi_interface(char *output, size_t output_size) {
 
 static void wifi_network_name(const char *interface, char *output, size_t output_size) {
     if (!valid_interface_name(interface) || !output || output_size == 0) return;
+    /* networksetup is only asked when the dynamic store cannot be read. */
+    if (barista_wifi_ssid(interface, output, output_size) >= 0) return;
+    output[0] = '\0';
+
     char *const arguments[] = {
         "/usr/sbin/networksetup", "-getairportnetwork", (char *)interface, NULL,
     };
@@ -768,15 +904,124 @@ static bool process_info_from_sample(const ProcessSample *sample,
     return true;
 }
 
-static void get_process_info(SystemInfo *info) {
-    if (!info) return;
+/* Set by default once the sampler could not start or was refused a
+ * process; which processes a user may inspect does not change while it
+ * runs, so from then on ps ranks without another scan first. */
+static bool g_top_use_ps = false;
+
+static bool top_refused(BaristaTop *top, TopSource source) {
+    if (source != TOP_SOURCE_AUTO || barista_top_hidden(top) == 0) return false;
+    g_top_use_ps = true;
+    return true;
+}
+
+/* The busiest process of the last scan. By default a scan that was refused
+ * any process has no answer, and the caller asks ps instead. */
+static bool busiest_process(BaristaTop *top, TopSource source, ProcessSample *sample) {
+    if (top_refused(top, source)) return false;
+    BaristaTopProcess busiest = {0};
+    if (barista_top_select(top, &busiest, 1) != 1 || busiest.name[0] == '\0') return false;
+    sample->pid = (pid_t)busiest.pid;
+    sample->cpu = busiest.cpu_percent;
+    snprintf(sample->fallback_name, sizeof(sample->fallback_name), "%s", busiest.name);
+    return true;
+}
+
+/* The daemon keeps one table for its lifetime, so each refresh compares
+ * against the previous scan in memory; its accept loop rescans an idle table
+ * before that baseline ages out. A one-shot run carries the table from run
+ * to run in barista_top_state_path() instead. */
+static BaristaTop *g_resident_top = NULL;
+static uint64_t g_resident_top_scanned_ns = 0;
+static pthread_mutex_t g_resident_top_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Caller holds g_resident_top_lock. */
+static bool resident_top_scan(uint64_t now) {
+    if (barista_top_scan(g_resident_top, now) <= 0) return false;
+    g_resident_top_scanned_ns = now;
+    return true;
+}
+
+/* Called once by the daemon before it reads its rows; the only settle wait
+ * it ever makes is this one. */
+static void resident_top_start(void) {
+    TopSource source = top_source();
+    if (source == TOP_SOURCE_PS) return;
+    g_resident_top = barista_top_create(NULL);
+    if (!g_resident_top) {
+        g_top_use_ps = source == TOP_SOURCE_AUTO;
+        return;
+    }
+    pthread_mutex_lock(&g_resident_top_lock);
+    if (resident_top_scan(realtime_nanoseconds()) && !top_refused(g_resident_top, source)) {
+        usleep(PROCESS_SETTLE_MICROSECONDS);
+        resident_top_scan(realtime_nanoseconds());
+    }
+    if (g_top_use_ps) {
+        barista_top_destroy(g_resident_top);
+        g_resident_top = NULL;
+    }
+    pthread_mutex_unlock(&g_resident_top_lock);
+}
+
+/* Called from the accept loop about once a second. A probe holding the lock
+ * is scanning already. */
+static void resident_top_keep_fresh(void) {
+    if (!g_resident_top || pthread_mutex_trylock(&g_resident_top_lock) != 0) return;
+    uint64_t now = realtime_nanoseconds();
+    if (now - g_resident_top_scanned_ns >= PROCESS_BASELINE_MAX_AGE_NS / 2) resident_top_scan(now);
+    pthread_mutex_unlock(&g_resident_top_lock);
+}
+
+/* A refresh right after another scan answers from that scan rather than
+ * comparing two scans a few milliseconds apart. */
+static bool resident_top_process(TopSource source, ProcessSample *sample) {
+    pthread_mutex_lock(&g_resident_top_lock);
+    uint64_t now = realtime_nanoseconds();
+    bool scanned = now - g_resident_top_scanned_ns < PROCESS_SETTLE_MICROSECONDS * 1000ULL
+        || resident_top_scan(now);
+    bool found = scanned && busiest_process(g_resident_top, source, sample);
+    pthread_mutex_unlock(&g_resident_top_lock);
+    return found;
+}
+
+static bool sample_top_process(ProcessSample *sample) {
+    TopSource source = top_source();
+    if (!sample || source == TOP_SOURCE_PS || (source == TOP_SOURCE_AUTO && g_top_use_ps)) {
+        return false;
+    }
+    if (g_resident_top) return resident_top_process(source, sample);
+    BaristaTop *top = barista_top_create(NULL);
+    if (!top) return false;
+    char state_path[1024];
+    bool persist = barista_top_state_path(state_path, sizeof(state_path));
+    if (persist) barista_top_load(top, state_path);
+
+    bool scanned = barista_top_scan(top, realtime_nanoseconds()) > 0;
+    uint64_t interval = barista_top_interval_ns(top);
+    if (scanned && !top_refused(top, source)
+        && (interval == 0 || interval > PROCESS_BASELINE_MAX_AGE_NS)) {
+        usleep(PROCESS_SETTLE_MICROSECONDS);
+        scanned = barista_top_scan(top, realtime_nanoseconds()) > 0;
+    }
+    bool found = scanned && busiest_process(top, source, sample);
+    if (scanned && persist) barista_top_save(top, state_path);
+    barista_top_destroy(top);
+    return found;
+}
+
+static bool ps_top_process(ProcessSample *sample) {
     char *const arguments[] = {"/bin/ps", "-Ar", "-o", "pcpu=,pid=,ucomm=", NULL};
     char output[4096];
     if (!capture_first_line("/bin/ps", arguments, output,
-                            sizeof(output), DEFAULT_PROBE_TIMEOUT_MS)) return;
+                            sizeof(output), DEFAULT_PROBE_TIMEOUT_MS)) return false;
+    return parse_process_line(output, sample);
+}
 
+static void get_process_info(SystemInfo *info) {
+    if (!info) return;
     ProcessSample sample = {0};
-    if (!parse_process_line(output, &sample)) return;
+    if (!sample_top_process(&sample) && !ps_top_process(&sample)) return;
 
     char process_path[PROC_PIDPATHINFO_MAXSIZE] = "";
     char process_name[PROC_PIDPATHINFO_MAXSIZE] = "";
@@ -887,49 +1132,80 @@ static const char *environment_or_default(const char *name, const char *fallback
 }
 
 static void payload_init(Payload *payload) {
-    if (payload) memset(payload, 0, sizeof(*payload));
+    if (!payload) return;
+    memset(payload, 0, sizeof(*payload));
+    barista_payload_init(&payload->wire, payload->arena, sizeof(payload->arena));
+}
+
+/* Caps the token count and token size the bar will see; the builder itself
+ * only bounds the arena. */
+static bool payload_reserve_token(Payload *payload, size_t length) {
+    if (!payload || payload->wire.failed) return false;
+    if (length > MAX_TOKEN_BYTES || payload->wire.arguments >= MAX_ARGUMENTS) {
+        payload->wire.failed = true;
+        return false;
+    }
+    return true;
 }
 
 static bool payload_add_token(Payload *payload, const char *token) {
-    if (!payload || payload->failed || !token) return false;
-    size_t length = strnlen(token, MAX_TOKEN_BYTES + 1);
-    if (length > MAX_TOKEN_BYTES || payload->arguments >= MAX_ARGUMENTS
-        || payload->length + length + 2 > MAX_PAYLOAD_BYTES) {
-        payload->failed = true;
+    if (!payload || !token) return false;
+    return payload_reserve_token(payload, strnlen(token, MAX_TOKEN_BYTES + 1))
+        && barista_payload_token(&payload->wire, token);
+}
+
+static bool payload_open_set(Payload *payload) {
+    if (!payload->item_pending) return true;
+    if (!payload_reserve_token(payload, 0)
+        || !barista_payload_verb(&payload->wire, BARISTA_VERB_SET)
+        || !payload_add_token(payload, payload->item)) {
         return false;
     }
-    memcpy(payload->bytes + payload->length, token, length);
-    payload->length += length;
-    payload->bytes[payload->length++] = 0;
-    payload->arguments++;
+    payload->item_pending = false;
     return true;
 }
 
 static bool payload_add_property(Payload *payload, const char *name, const char *value) {
+    if (!payload || !name) return false;
     char clean[LABEL_BYTES];
-    char token[MAX_TOKEN_BYTES + 1];
     sanitize_text(value, clean, sizeof(clean));
-    int written = snprintf(token, sizeof(token), "%s=%s", name, clean);
-    if (written < 0 || (size_t)written >= sizeof(token)) {
-        if (payload) payload->failed = true;
-        return false;
+    size_t length = strlen(name) + 1 + strlen(clean);
+    if (!payload_reserve_token(payload, length)) return false;
+    if (payload->use_sent_cache && payload->sent_count < MAX_ARGUMENTS) {
+        BaristaSentEntry *entry = &payload->sent[payload->sent_count++];
+        if (barista_sent_cache_check(payload->item, name, clean, entry)) {
+            payload->suppressed++;
+            return true;
+        }
     }
-    return payload_add_token(payload, token);
+    return payload_open_set(payload)
+        && payload_reserve_token(payload, length)
+        && barista_payload_property(&payload->wire, name, clean);
 }
 
 static bool payload_begin_set(Payload *payload, const char *item) {
-    return payload_add_token(payload, "--set") && payload_add_token(payload, item);
+    if (!payload || payload->wire.failed || !item) return false;
+    size_t length = strnlen(item, MAX_TOKEN_BYTES + 1);
+    if (length == 0 || length > MAX_TOKEN_BYTES) {
+        payload->wire.failed = true;
+        return false;
+    }
+    memcpy(payload->item, item, length + 1);
+    payload->item_pending = true;
+    return true;
 }
 
-static bool payload_finish(Payload *payload) {
-    if (!payload || payload->failed || payload->arguments == 0
-        || payload->length + 1 > MAX_PAYLOAD_BYTES) {
-        return false;
+/* Records or forgets every property the payload checked against the cache. */
+static void payload_settle_sent_cache(const Payload *payload, bool delivered) {
+    if (!payload || !payload->use_sent_cache) return;
+    for (size_t index = 0; index < payload->sent_count; index++) {
+        if (delivered) barista_sent_cache_record(&payload->sent[index]);
+        else barista_sent_cache_forget(&payload->sent[index]);
     }
-    payload->bytes[payload->length++] = 0;
-    return payload->length >= 2
-        && payload->bytes[payload->length - 1] == 0
-        && payload->bytes[payload->length - 2] == 0;
+}
+
+static bool payload_finish(Payload *payload) {
+    return payload && barista_payload_finish(&payload->wire) > 0;
 }
 
 static uint64_t floor_gibibytes(uint64_t bytes) {
@@ -1044,6 +1320,10 @@ static bool build_popup_payload(const PopupRows *rows,
             snprintf(label, sizeof(label), "Network: %s", info->network_ip);
             network_icon = environment_or_default("BARISTA_ICON_WIFI", "󰖩");
             network_color = environment_or_default("BARISTA_SYSTEM_INFO_GREEN", "0xffa6e3a1");
+        } else if (info->missed_rows & ROW_NET) {
+            /* Unknown is not the same as disconnected. */
+            snprintf(label, sizeof(label), "Network: --");
+            network_color = environment_or_default("BARISTA_SYSTEM_INFO_YELLOW", "0xfff9e2af");
         } else {
             snprintf(label, sizeof(label), "Wi-Fi: Disconnected");
         }
@@ -1111,158 +1391,603 @@ static bool build_popup_payload(const PopupRows *rows,
             || !payload_add_property(payload, "icon.color", cpu_color(info))) return false;
     }
 
-    return !payload->failed;
+    return !payload->wire.failed;
+}
+
+static bool send_payload(const Payload *payload) {
+    if (!payload || payload->wire.length > MAX_PAYLOAD_BYTES) return false;
+    return barista_send(payload->wire.bytes, payload->wire.length, kMachReceiveTimeoutMilliseconds)
+        == BARISTA_SEND_CONFIRMED_SUCCESS;
 }
 
-static mach_port_t sketchybar_port(void) {
-    const char *bar_name = getenv("BAR_NAME");
-    if (!bar_name || bar_name[0] == '\0' || strlen(bar_name) > 128) bar_name = "sketchybar";
-    char service_name[160];
-    int written = snprintf(service_name, sizeof(service_name), "git.felix.%s", bar_name);
-    if (written < 0 || (size_t)written >= sizeof(service_name)) return MACH_PORT_NULL;
+// Probes.
+//
+// Every requested row is read on a shared pool of probe threads under one
+// deadline for the whole refresh, so a probe stuck on a slow tool costs its
+// own row (painted as `--`, or served from the daemon's cache) rather than
+// the popup. A late probe finishes in the background and is discarded.
+
+typedef struct {
+    RowMask row;
+    const char *name;
+    void (*probe)(SystemInfo *info);
+} RowProbe;
+
+/* In RowMask bit order; probe_microseconds is indexed the same way. */
+static const RowProbe kRowProbes[POPUP_ROW_COUNT] = {
+    {ROW_CPU, "cpu", get_cpu_info},
+    {ROW_MEM, "mem", get_memory_info},
+    {ROW_DISK, "disk", get_disk_info},
+    {ROW_NET, "net", get_network_info},
+    {ROW_SWAP, "swap", get_swap_info},
+    {ROW_UPTIME, "uptime", get_uptime_info},
+    {ROW_PROCS, "procs", get_process_info},
+};
+
+static size_t row_index(RowMask row) {
+    size_t index = 0;
+    while (index + 1 < POPUP_ROW_COUNT && kRowProbes[index].row != row) index++;
+    return index;
+}
 
-    mach_port_t bootstrap_port = MACH_PORT_NULL;
-    if (task_get_special_port(mach_task_self(), TASK_BOOTSTRAP_PORT, &bootstrap_port)
-        != KERN_SUCCESS) {
-        return MACH_PORT_NULL;
+static void copy_row(SystemInfo *target, const SystemInfo *source, RowMask row) {
+    switch (row) {
+    case ROW_CPU:
+        target->cpu_available = source->cpu_available;
+        target->cpu_percent = source->cpu_percent;
+        target->load_avg = source->load_avg;
+        break;
+    case ROW_MEM:
+        target->memory_available = source->memory_available;
+        target->memory_used_bytes = source->memory_used_bytes;
+        target->memory_total_bytes = source->memory_total_bytes;
+        break;
+    case ROW_DISK:
+        target->disk_available = source->disk_available;
+        target->disk_percent = source->disk_percent;
+        memcpy(target->disk_used, source->disk_used, sizeof(target->disk_used));
+        memcpy(target->disk_total, source->disk_total, sizeof(target->disk_total));
+        break;
+    case ROW_NET:
+        target->network_online = source->network_online;
+        memcpy(target->network_ip, source->network_ip, sizeof(target->network_ip));
+        memcpy(target->network_name, source->network_name, sizeof(target->network_name));
+        break;
+    case ROW_SWAP:
+        target->swap_available = source->swap_available;
+        target->swap_used_bytes = source->swap_used_bytes;
+        target->swap_total_bytes = source->swap_total_bytes;
+        break;
+    case ROW_UPTIME:
+        target->uptime_available = source->uptime_available;
+        target->uptime_seconds = source->uptime_seconds;
+        break;
+    case ROW_PROCS:
+        target->process_available = source->process_available;
+        target->process_cpu = source->process_cpu;
+        memcpy(target->process_name, source->process_name, sizeof(target->process_name));
+        break;
     }
-    mach_port_t port = MACH_PORT_NULL;
-    kern_return_t result = bootstrap_look_up(bootstrap_port, service_name, &port);
-    mach_port_deallocate(mach_task_self(), bootstrap_port);
-    return result == KERN_SUCCESS ? port : MACH_PORT_NULL;
+    size_t index = row_index(row);
+    target->probe_microseconds[index] = source->probe_microseconds[index];
 }
 
-static bool response_is_success(const void *bytes, size_t size) {
-    if (!bytes || size == 0 || size > MAX_PAYLOAD_BYTES) return false;
-    const char *response = bytes;
-    if (memchr(response, '\0', size) == NULL) return false;
-    return strstr(response, "[!]") == NULL;
+static int gather_deadline_ms(void) {
+    const char *value = getenv("BARISTA_SYSTEM_INFO_DEADLINE_MS");
+    if (!value || value[0] == '\0') return DEFAULT_GATHER_DEADLINE_MS;
+    char *end = NULL;
+    long parsed = strtol(value, &end, 10);
+    if (!end || *end != '\0' || parsed <= 0) return DEFAULT_GATHER_DEADLINE_MS;
+    return parsed > 10000 ? 10000 : (int)parsed;
 }
 
-static bool send_payload(const Payload *payload) {
-    if (!payload || payload->length < 2 || payload->length > MAX_PAYLOAD_BYTES
-        || payload->bytes[payload->length - 1] != 0
-        || payload->bytes[payload->length - 2] != 0) {
-        return false;
-    }
+static BaristaExecutor *g_probe_executor = NULL;
+static pthread_mutex_t g_probe_executor_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Started by the first refresh with one worker per row it reads, so a
+ * one-shot run starts no more threads than it has probes. */
+static BaristaExecutor *probe_executor(size_t rows) {
+    pthread_mutex_lock(&g_probe_executor_lock);
+    if (!g_probe_executor) g_probe_executor = barista_executor_create(rows);
+    BaristaExecutor *executor = g_probe_executor;
+    pthread_mutex_unlock(&g_probe_executor_lock);
+    return executor;
+}
 
-    for (int attempt = 0; attempt < 2; attempt++) {
-        mach_port_t port = sketchybar_port();
-        if (port == MACH_PORT_NULL) continue;
+static void run_row_probe(const void *argument, void *result) {
+    ((const RowProbe *)argument)->probe((SystemInfo *)result);
+}
 
-        mach_port_t response_port = MACH_PORT_NULL;
-        mach_port_name_t task = mach_task_self();
-        if (mach_port_allocate(task, MACH_PORT_RIGHT_RECEIVE, &response_port) != KERN_SUCCESS) {
-            mach_port_deallocate(task, port);
-            continue;
+/* Reads `rows` concurrently, waiting at most `timeout_ms`. Returns the rows
+ * that were read; the others are flagged in info->missed_rows. */
+static uint32_t gather_rows(const PopupRows *rows, int timeout_ms, SystemInfo *info) {
+    BaristaProbeTask tasks[POPUP_ROW_COUNT];
+    SystemInfo results[POPUP_ROW_COUNT];
+    size_t indices[POPUP_ROW_COUNT];
+    size_t count = 0;
+    for (size_t index = 0; index < POPUP_ROW_COUNT; index++) {
+        if (!row_enabled(rows, kRowProbes[index].row)) continue;
+        memset(&tasks[count], 0, sizeof(tasks[count]));
+        tasks[count].run = run_row_probe;
+        tasks[count].argument = &kRowProbes[index];
+        tasks[count].result = &results[count];
+        tasks[count].result_bytes = sizeof(results[count]);
+        indices[count++] = index;
+    }
+    if (count == 0) return 0;
+
+    barista_executor_run(probe_executor(count), tasks, count, timeout_ms);
+    uint32_t read = 0;
+    for (size_t task = 0; task < count; task++) {
+        const RowProbe *probe = &kRowProbes[indices[task]];
+        uint64_t elapsed = tasks[task].elapsed_us;
+        uint32_t microseconds = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+        if (tasks[task].finished) {
+            results[task].probe_microseconds[indices[task]] = microseconds;
+            copy_row(info, &results[task], probe->row);
+            info->missed_rows &= ~(uint32_t)probe->row;
+            read |= probe->row;
+        } else {
+            info->probe_microseconds[indices[task]] = microseconds;
+            info->missed_rows |= probe->row;
         }
-        if (mach_port_insert_right(task, response_port, response_port, MACH_MSG_TYPE_MAKE_SEND)
-            != KERN_SUCCESS) {
-            mach_port_mod_refs(task, response_port, MACH_PORT_RIGHT_RECEIVE, -1);
-            mach_port_deallocate(task, port);
-            continue;
+    }
+    return read;
+}
+
+/* The top-process row takes its icon colour from the CPU load. */
+static uint32_t rows_with_dependencies(uint32_t rows) {
+    return (rows & ROW_PROCS) ? rows | ROW_CPU : rows;
+}
+
+static void gather_popup_info(const PopupRows *rows, SystemInfo *info) {
+    PopupRows gathered = {.mask = rows ? rows_with_dependencies(rows->mask) : 0};
+    gather_rows(&gathered, gather_deadline_ms(), info);
+}
+
+// Resident mode.
+//
+// The daemon keeps one value per row with the time it was read. A row past
+// its TTL is handled by cost: cheap rows (sysctl and host statistics) are
+// re-read before answering, while rows that spawn or scan (network, disk,
+// top process) are answered from the cache and queued for a background
+// refresher. A client that asks for a follow-up keeps its connection open;
+// once the queued rows are fresh it receives them again and repaints, so a
+// popup opens on the IPC round trip and settles on current values.
+
+typedef struct {
+    RowMask row;
+    uint64_t ttl_ms;
+    bool background;
+} RowPolicy;
+
+static const RowPolicy kRowPolicies[] = {
+    {ROW_CPU, 1000, false},
+    {ROW_MEM, 2000, false},
+    {ROW_SWAP, 5000, false},
+    {ROW_UPTIME, 10000, false},
+    {ROW_DISK, 30000, true},
+    {ROW_NET, 10000, true},
+    {ROW_PROCS, 2000, true},
+};
+
+#define ROW_POLICY_COUNT (sizeof(kRowPolicies) / sizeof(kRowPolicies[0]))
+
+typedef uint32_t (*RowGatherFunction)(const PopupRows *rows, int timeout_ms, SystemInfo *info);
+
+typedef struct {
+    int fd;
+    uint32_t rows;
+} RowWaiter;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    RowGatherFunction gather;
+    SystemInfo info;
+    uint64_t fetched_at[ROW_POLICY_COUNT];
+    uint32_t fetched;     /* rows read at least once */
+    uint32_t queued;      /* background rows waiting for the refresher */
+    uint32_t refreshing;  /* background rows the refresher is reading */
+    RowWaiter waiters[DAEMON_MAX_WAITERS];
+    size_t waiter_count;
+} RowCache;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t rows;
+    uint32_t info_bytes;
+} DaemonRequest;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t rows;
+    uint32_t info_bytes;
+    SystemInfo info;
+} DaemonReply;
+
+static void copy_rows(SystemInfo *target, const SystemInfo *source, uint32_t rows) {
+    for (size_t index = 0; index < ROW_POLICY_COUNT; index++) {
+        if (rows & kRowPolicies[index].row) copy_row(target, source, kRowPolicies[index].row);
+    }
+}
+
+/* Strings from another process are terminated before anything formats them. */
+static void terminate_strings(SystemInfo *info) {
+    info->disk_used[sizeof(info->disk_used) - 1] = '\0';
+    info->disk_total[sizeof(info->disk_total) - 1] = '\0';
+    info->network_ip[sizeof(info->network_ip) - 1] = '\0';
+    info->network_name[sizeof(info->network_name) - 1] = '\0';
+    info->process_name[sizeof(info->process_name) - 1] = '\0';
+}
+
+static void row_cache_init(RowCache *cache, RowGatherFunction gather) {
+    memset(cache, 0, sizeof(*cache));
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->wake, NULL);
+    cache->gather = gather;
+}
+
+/* Caller holds the lock. */
+static void row_cache_store(RowCache *cache, const SystemInfo *fresh, uint32_t rows, uint64_t now) {
+    copy_rows(&cache->info, fresh, rows);
+    for (size_t index = 0; index < ROW_POLICY_COUNT; index++) {
+        if (rows & kRowPolicies[index].row) cache->fetched_at[index] = now;
+    }
+    cache->fetched |= rows;
+}
+
+/* Caller holds the lock. */
+static bool row_cache_stale(const RowCache *cache, size_t index, uint64_t now) {
+    const RowPolicy *policy = &kRowPolicies[index];
+    /* The refresher stamps rows after the serving thread read its clock. */
+    return (cache->fetched & policy->row) == 0
+        || (now > cache->fetched_at[index] && now - cache->fetched_at[index] >= policy->ttl_ms);
+}
+
+/* Reads every row once so later requests never wait on a slow probe. */
+static void row_cache_prime(RowCache *cache, uint64_t (*clock)(void)) {
+    SystemInfo fresh = {0};
+    PopupRows rows = {.mask = ALL_POPUP_ROWS};
+    uint32_t read = cache->gather(&rows, DAEMON_REFRESH_DEADLINE_MS, &fresh);
+    pthread_mutex_lock(&cache->lock);
+    row_cache_store(cache, &fresh, read, clock());
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/* Copies `rows` into *answer. Returns the requested background rows that are
+ * queued or being read, i.e. the ones a follow-up would bring fresher. */
+static uint32_t row_cache_snapshot(RowCache *cache, uint32_t rows, SystemInfo *answer) {
+    rows = rows_with_dependencies(rows);
+    memset(answer, 0, sizeof(*answer));
+    pthread_mutex_lock(&cache->lock);
+    copy_rows(answer, &cache->info, rows);
+    answer->missed_rows = rows & ~cache->fetched;
+    uint32_t revalidating = rows & (cache->queued | cache->refreshing);
+    pthread_mutex_unlock(&cache->lock);
+    return revalidating;
+}
+
+/* Answers a request at `now`: stale cheap rows are re-read first, stale
+ * background rows are served as they are and queued for the refresher. A
+ * background row that was never read is read inline once. Inline reads get
+ * DAEMON_INLINE_DEADLINE_MS; a row that misses it keeps its cached value and
+ * stays stale. Only the serving thread calls this. */
+static uint32_t row_cache_answer(RowCache *cache, uint32_t rows, uint64_t now, SystemInfo *answer) {
+    rows = rows_with_dependencies(rows);
+    uint32_t inline_rows = 0;
+    pthread_mutex_lock(&cache->lock);
+    uint32_t queued_before = cache->queued;
+    for (size_t index = 0; index < ROW_POLICY_COUNT; index++) {
+        const RowPolicy *policy = &kRowPolicies[index];
+        if ((rows & policy->row) == 0 || !row_cache_stale(cache, index, now)) continue;
+        if (policy->background && (cache->fetched & policy->row) != 0) {
+            if ((cache->refreshing & policy->row) == 0) cache->queued |= policy->row;
+        } else {
+            inline_rows |= policy->row;
         }
+    }
+    if (cache->queued != queued_before) pthread_cond_signal(&cache->wake);
+    pthread_mutex_unlock(&cache->lock);
 
-        struct barista_mach_message message = {0};
-        message.header.msgh_remote_port = port;
-        message.header.msgh_local_port = response_port;
-        message.header.msgh_id = response_port;
-        message.header.msgh_bits = MACH_MSGH_BITS_SET(
-            MACH_MSG_TYPE_COPY_SEND,
-            MACH_MSG_TYPE_MAKE_SEND,
-            0,
-            MACH_MSGH_BITS_COMPLEX);
-        message.header.msgh_size = sizeof(message);
-        message.descriptor_count = 1;
-        message.descriptor.address = (void *)payload->bytes;
-        message.descriptor.size = (mach_msg_size_t)payload->length;
-        message.descriptor.copy = MACH_MSG_VIRTUAL_COPY;
-        message.descriptor.deallocate = false;
-        message.descriptor.type = MACH_MSG_OOL_DESCRIPTOR;
-
-        mach_msg_return_t result = mach_msg(&message.header,
-                                            MACH_SEND_MSG | MACH_SEND_TIMEOUT,
-                                            sizeof(message),
-                                            0,
-                                            MACH_PORT_NULL,
-                                            kMachSendTimeoutMilliseconds,
-                                            MACH_PORT_NULL);
-        mach_port_deallocate(task, port);
-
-        bool success = false;
-        if (result == MACH_MSG_SUCCESS) {
-            struct barista_mach_buffer buffer = {0};
-            result = mach_msg(&buffer.message.header,
-                              MACH_RCV_MSG | MACH_RCV_TIMEOUT,
-                              0,
-                              sizeof(buffer),
-                              response_port,
-                              kMachReceiveTimeoutMilliseconds,
-                              MACH_PORT_NULL);
-            if (result == MACH_MSG_SUCCESS) {
-                mach_msg_ool_descriptor_t descriptor = buffer.message.descriptor;
-                if (buffer.message.descriptor_count == 1
-                    && descriptor.type == MACH_MSG_OOL_DESCRIPTOR
-                    && descriptor.address != NULL
-                    && descriptor.size > 0
-                    && descriptor.size <= MAX_PAYLOAD_BYTES) {
-                    success = response_is_success(descriptor.address, descriptor.size);
-                }
-                mach_msg_destroy(&buffer.message.header);
-            }
+    if (inline_rows != 0) {
+        SystemInfo fresh = {0};
+        PopupRows gathered = {.mask = inline_rows};
+        uint32_t read = cache->gather(&gathered, DAEMON_INLINE_DEADLINE_MS, &fresh);
+        pthread_mutex_lock(&cache->lock);
+        row_cache_store(cache, &fresh, read, now);
+        pthread_mutex_unlock(&cache->lock);
+    }
+    return row_cache_snapshot(cache, rows, answer);
+}
+
+/* Moves the queued rows to `refreshing` and returns them. */
+static uint32_t row_cache_begin_refresh(RowCache *cache) {
+    pthread_mutex_lock(&cache->lock);
+    uint32_t rows = cache->queued;
+    cache->queued = 0;
+    cache->refreshing = rows;
+    pthread_mutex_unlock(&cache->lock);
+    return rows;
+}
+
+/* Stores the refreshed rows and hands back the waiters with nothing left in
+ * flight; the caller answers and closes them. */
+static size_t row_cache_finish_refresh(RowCache *cache,
+                                       const SystemInfo *fresh,
+                                       uint32_t rows,
+                                       uint64_t now,
+                                       RowWaiter *ready) {
+    size_t ready_count = 0;
+    pthread_mutex_lock(&cache->lock);
+    row_cache_store(cache, fresh, rows, now);
+    cache->refreshing = 0;
+    size_t kept = 0;
+    for (size_t index = 0; index < cache->waiter_count; index++) {
+        if (cache->waiters[index].rows & cache->queued) {
+            cache->waiters[kept++] = cache->waiters[index];
+        } else {
+            ready[ready_count++] = cache->waiters[index];
         }
-        mach_port_mod_refs(task, response_port, MACH_PORT_RIGHT_RECEIVE, -1);
-        mach_port_deallocate(task, response_port);
-        if (success) return true;
     }
-    return false;
+    cache->waiter_count = kept;
+    pthread_mutex_unlock(&cache->lock);
+    return ready_count;
 }
 
-static void gather_routine_info(SystemInfo *info) {
-    get_cpu_info(info);
-    get_memory_info(info);
+/* Parks a connection until its background rows are fresh. False when they
+ * already are, or when every slot is taken; the caller answers it now. */
+static bool row_cache_add_waiter(RowCache *cache, int fd, uint32_t rows) {
+    rows = rows_with_dependencies(rows);
+    bool added = false;
+    pthread_mutex_lock(&cache->lock);
+    if ((rows & (cache->queued | cache->refreshing)) != 0
+        && cache->waiter_count < DAEMON_MAX_WAITERS) {
+        cache->waiters[cache->waiter_count].fd = fd;
+        cache->waiters[cache->waiter_count].rows = rows;
+        cache->waiter_count++;
+        added = true;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return added;
 }
 
-static void *gather_network_thread(void *context) {
-    get_network_info((SystemInfo *)context);
-    return NULL;
+static bool daemon_write_reply(int fd, uint32_t rows, const SystemInfo *info, bool revalidating) {
+    DaemonReply reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.magic = DAEMON_MAGIC;
+    reply.rows = rows;
+    reply.info_bytes = sizeof(SystemInfo);
+    reply.info = *info;
+    return barista_frame_write(fd, &reply, sizeof(reply),
+                               revalidating ? DAEMON_FRAME_REVALIDATING : 0,
+                               DAEMON_REPLY_TIMEOUT_MS) == 0;
+}
+
+static void daemon_answer_final(RowCache *cache, int fd, uint32_t rows) {
+    SystemInfo info;
+    row_cache_snapshot(cache, rows, &info);
+    daemon_write_reply(fd, rows, &info, false);
+    close(fd);
 }
 
-static void *gather_process_thread(void *context) {
-    get_process_info((SystemInfo *)context);
+static void *row_cache_refresher(void *context) {
+    RowCache *cache = context;
+    for (;;) {
+        pthread_mutex_lock(&cache->lock);
+        while (cache->queued == 0) pthread_cond_wait(&cache->wake, &cache->lock);
+        pthread_mutex_unlock(&cache->lock);
+
+        uint32_t rows = row_cache_begin_refresh(cache);
+        SystemInfo fresh = {0};
+        PopupRows gathered = {.mask = rows};
+        uint32_t read = cache->gather(&gathered, DAEMON_REFRESH_DEADLINE_MS, &fresh);
+        RowWaiter ready[DAEMON_MAX_WAITERS];
+        size_t ready_count = row_cache_finish_refresh(cache, &fresh, read,
+                                                      monotonic_milliseconds(), ready);
+        for (size_t index = 0; index < ready_count; index++) {
+            daemon_answer_final(cache, ready[index].fd, ready[index].rows);
+        }
+    }
     return NULL;
 }
 
-static void gather_popup_info(const PopupRows *rows, SystemInfo *info) {
-    pthread_t network_thread;
-    pthread_t process_thread;
-    bool network_started = false;
-    bool process_started = false;
+/* One request per connection. With DAEMON_FRAME_FOLLOW_UP and rows still
+ * being refreshed, the connection stays open for a second, final reply. */
+static void daemon_handle(RowCache *cache, int fd) {
+    DaemonRequest request;
+    size_t length = 0;
+    uint32_t flags = 0;
+    if (barista_frame_read(fd, &request, sizeof(request), &length, &flags,
+                           DAEMON_READ_TIMEOUT_MS) != 0
+        || length != sizeof(request)
+        || request.magic != DAEMON_MAGIC
+        || request.info_bytes != sizeof(SystemInfo)
+        || (request.rows & ~(uint32_t)ALL_POPUP_ROWS) != 0) {
+        close(fd);
+        return;
+    }
 
-    if (row_enabled(rows, ROW_NET)) {
-        network_started = pthread_create(&network_thread, NULL, gather_network_thread, info) == 0;
-        if (!network_started) get_network_info(info);
+    SystemInfo info;
+    uint32_t revalidating = row_cache_answer(cache, request.rows, monotonic_milliseconds(), &info);
+    bool follow_up = (flags & DAEMON_FRAME_FOLLOW_UP) != 0 && revalidating != 0;
+    if (!daemon_write_reply(fd, request.rows, &info, follow_up)) {
+        close(fd);
+        return;
     }
-    if (row_enabled(rows, ROW_PROCS)) {
-        process_started = pthread_create(&process_thread, NULL, gather_process_thread, info) == 0;
-        if (!process_started) get_process_info(info);
+    if (!follow_up) {
+        close(fd);
+        return;
+    }
+    /* The refresh may have finished while the first reply was written. */
+    if (!row_cache_add_waiter(cache, fd, request.rows)) daemon_answer_final(cache, fd, request.rows);
+}
+
+static bool daemon_read_reply(int fd, int timeout_ms, SystemInfo *info, bool *revalidating) {
+    DaemonReply reply;
+    size_t length = 0;
+    uint32_t flags = 0;
+    if (barista_frame_read(fd, &reply, sizeof(reply), &length, &flags, timeout_ms) != 0
+        || length != sizeof(reply)
+        || reply.magic != DAEMON_MAGIC
+        || reply.info_bytes != sizeof(SystemInfo)) {
+        return false;
+    }
+    *info = reply.info;
+    terminate_strings(info);
+    if (revalidating) *revalidating = (flags & DAEMON_FRAME_REVALIDATING) != 0;
+    return true;
+}
+
+/* Asks a running daemon for `rows`. Returns the connection with *info filled
+ * in, or -1 when no daemon answered in time. */
+static int daemon_request(uint32_t rows, bool follow_up, SystemInfo *info, bool *revalidating) {
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    if (daemon_client_disabled() || !daemon_socket_path(path, sizeof(path))) return -1;
+    int fd = barista_socket_connect(path);
+    if (fd < 0) return -1;
+    DaemonRequest request = {
+        .magic = DAEMON_MAGIC,
+        .rows = rows,
+        .info_bytes = sizeof(SystemInfo),
+    };
+    if (barista_frame_write(fd, &request, sizeof(request),
+                            follow_up ? DAEMON_FRAME_FOLLOW_UP : 0,
+                            DAEMON_REPLY_TIMEOUT_MS) != 0
+        || !daemon_read_reply(fd, DAEMON_REPLY_TIMEOUT_MS, info, revalidating)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static volatile sig_atomic_t g_daemon_stop = 0;
+
+static void handle_daemon_stop(int signal_number) {
+    (void)signal_number;
+    g_daemon_stop = 1;
+}
+
+static int run_daemon(void) {
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    if (!daemon_socket_path(path, sizeof(path))) {
+        fprintf(stderr, "system_info_widget: no usable socket path\n");
+        return 1;
+    }
+    int existing = barista_socket_connect(path);
+    if (existing >= 0) {
+        close(existing);
+        fprintf(stderr, "system_info_widget: daemon already listening on %s\n", path);
+        return 0;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_daemon_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+
+    static RowCache cache;
+    resident_top_start();
+    row_cache_init(&cache, gather_rows);
+    row_cache_prime(&cache, monotonic_milliseconds);
+
+    int listener = barista_socket_listen(path);
+    int listener_flags = listener >= 0 ? fcntl(listener, F_GETFL, 0) : -1;
+    if (listener_flags < 0 || fcntl(listener, F_SETFL, listener_flags | O_NONBLOCK) != 0) {
+        fprintf(stderr, "system_info_widget: cannot listen on %s: %s\n", path, strerror(errno));
+        if (listener >= 0) close(listener);
+        return 1;
+    }
+
+    /* Stop signals belong to the accept loop, not the refresher. */
+    sigset_t stop_signals;
+    sigset_t previous_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGTERM);
+    sigaddset(&stop_signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &previous_signals);
+    pthread_t refresher;
+    bool started = pthread_create(&refresher, NULL, row_cache_refresher, &cache) == 0;
+    pthread_sigmask(SIG_SETMASK, &previous_signals, NULL);
+    if (!started) {
+        close(listener);
+        unlink(path);
+        return 1;
+    }
+    pthread_detach(refresher);
+
+    struct pollfd descriptor = {.fd = listener, .events = POLLIN};
+    while (!g_daemon_stop) {
+        resident_top_keep_fresh();
+        int ready = poll(&descriptor, 1, DAEMON_POLL_MILLISECONDS);
+        if (ready < 0 && errno != EINTR) break;
+        if (ready <= 0) continue;
+        for (;;) {
+            int client = accept(listener, NULL, NULL);
+            if (client < 0) break;
+            int client_flags = fcntl(client, F_GETFL, 0);
+            fcntl(client, F_SETFD, FD_CLOEXEC);
+            if (client_flags < 0 || fcntl(client, F_SETFL, client_flags | O_NONBLOCK) != 0) {
+                close(client);
+                continue;
+            }
+            daemon_handle(&cache, client);
+        }
+    }
+    close(listener);
+    unlink(path);
+    return 0;
+}
+
+/* Builds and sends one update; 0 when the bar has it or already showed it. */
+static int deliver_info(bool popup_refresh,
+                        const PopupRows *rows,
+                        const SystemInfo *info,
+                        bool dump_payload) {
+    static Payload payload;
+    payload_init(&payload);
+    payload.use_sent_cache = !dump_payload;
+    bool built = popup_refresh
+        ? build_popup_payload(rows, info, &payload)
+        : build_routine_payload(info, &payload);
+    /* Every property matched what SketchyBar already shows. */
+    if (built && !payload.wire.failed && payload.wire.arguments == 0 && payload.suppressed > 0) return 0;
+    if (!built || !payload_finish(&payload)) return 3;
+
+    if (dump_payload) {
+        return fwrite(payload.wire.bytes, 1, payload.wire.length, stdout) == payload.wire.length ? 0 : 4;
+    }
+    bool delivered = send_payload(&payload);
+    payload_settle_sent_cache(&payload, delivered);
+    return delivered ? 0 : 4;
+}
+
+/* One line per probe on stderr: row, milliseconds, and whether the value
+ * came from this refresh. With a daemon the time is that of the probe that
+ * produced the cached value. */
+static void report_timings(uint32_t rows, const SystemInfo *info) {
+    for (size_t index = 0; index < POPUP_ROW_COUNT; index++) {
+        const RowProbe *probe = &kRowProbes[index];
+        if ((rows & probe->row) == 0) continue;
+        fprintf(stderr, "%s\t%.3f\t%s\n", probe->name,
+                (double)info->probe_microseconds[index] / 1000.0,
+                (info->missed_rows & probe->row) ? "missed" : "ok");
     }
-    if (row_enabled(rows, ROW_CPU) || row_enabled(rows, ROW_PROCS)) get_cpu_info(info);
-    if (row_enabled(rows, ROW_MEM)) get_memory_info(info);
-    if (row_enabled(rows, ROW_DISK)) get_disk_info(info);
-    if (row_enabled(rows, ROW_SWAP)) get_swap_info(info);
-    if (row_enabled(rows, ROW_UPTIME)) get_uptime_info(info);
-    if (network_started) pthread_join(network_thread, NULL);
-    if (process_started) pthread_join(process_thread, NULL);
 }
 
 static void usage(const char *program) {
-    fprintf(stderr, "Usage: %s [popup_refresh] [--dump0]\n", program);
+    fprintf(stderr, "Usage: %s [popup_refresh] [--dump0] [--timings]\n       %s --daemon\n",
+            program, program);
 }
 
 int main(int argc, char *argv[]) {
     bool popup_refresh = false;
     bool dump_payload = false;
+    bool daemon_mode = false;
+    bool timings = false;
     for (int index = 1; index < argc; index++) {
         if (strcmp(argv[index], "popup_refresh") == 0 && !popup_refresh) {
             popup_refresh = true;
@@ -1272,10 +1997,23 @@ int main(int argc, char *argv[]) {
             dump_payload = true;
             continue;
         }
+        if (strcmp(argv[index], "--daemon") == 0 && !daemon_mode) {
+            daemon_mode = true;
+            continue;
+        }
+        if (strcmp(argv[index], "--timings") == 0 && !timings) {
+            timings = true;
+            continue;
+        }
+        usage(argv[0]);
+        return 2;
+    }
+    if (daemon_mode && (popup_refresh || dump_payload || timings)) {
         usage(argv[0]);
         return 2;
     }
     if (native_disabled()) return 3;
+    if (daemon_mode) return run_daemon();
 
     PopupRows rows = {.mask = DEFAULT_POPUP_ROWS};
     if (popup_refresh && !parse_popup_rows(getenv("BARISTA_SYSTEM_INFO_ROWS"), &rows)) {
@@ -1285,20 +2023,30 @@ int main(int argc, char *argv[]) {
     if (popup_refresh && rows.mask == 0) return 0;
 
     SystemInfo info = {0};
-    Payload payload;
-    payload_init(&payload);
-    bool built = false;
-    if (popup_refresh) {
-        gather_popup_info(&rows, &info);
-        built = build_popup_payload(&rows, &info, &payload);
-    } else {
-        gather_routine_info(&info);
-        built = build_routine_payload(&info, &payload);
+    bool revalidating = false;
+    uint32_t wanted = popup_refresh ? rows.mask : (ROW_CPU | ROW_MEM);
+    /* A dump is a single payload, so it never waits for a follow-up. */
+    int daemon = daemon_request(wanted, !dump_payload, &info, &revalidating);
+    if (daemon < 0) {
+        if (popup_refresh) {
+            gather_popup_info(&rows, &info);
+        } else {
+            PopupRows routine = {.mask = wanted};
+            gather_rows(&routine, gather_deadline_ms(), &info);
+        }
     }
-    if (!built || !payload_finish(&payload)) return 3;
+    int status = deliver_info(popup_refresh, &rows, &info, dump_payload);
+    if (timings) report_timings(rows_with_dependencies(wanted), &info);
 
-    if (dump_payload) {
-        return fwrite(payload.bytes, 1, payload.length, stdout) == payload.length ? 0 : 4;
+    /* The first paint used cached slow rows; repaint once they are fresh.
+     * The sent cache drops whatever did not change. */
+    if (daemon >= 0 && revalidating && status == 0) {
+        SystemInfo fresh = {0};
+        if (daemon_read_reply(daemon, DAEMON_REVALIDATE_TIMEOUT_MS, &fresh, NULL)) {
+            status = deliver_info(popup_refresh, &rows, &fresh, dump_payload);
+            if (timings) report_timings(rows_with_dependencies(wanted), &fresh);
+        }
     }
-    return send_payload(&payload) ? 0 : 4;
+    if (daemon >= 0) close(daemon);
+    return status;
 }
@@ -2,12 +2,9 @@
 #import <CoreAudio/CoreAudio.h>
 #import <Foundation/Foundation.h>
 
-#include <bootstrap.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <math.h>
-#include <mach/mach.h>
-#include <mach/message.h>
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -16,13 +13,14 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "barista_transport.h"
+
 static const NSUInteger kMaxCacheBytes = 64 * 1024;
 static const NSUInteger kMaxCacheLineBytes = 4 * 1024;
 static const NSUInteger kMaxPayloadBytes = 16 * 1024;
 static const NSUInteger kMaxTokenBytes = 1024;
 static const NSUInteger kMaxArguments = 64;
-static const mach_msg_timeout_t kMachSendTimeoutMilliseconds = 50;
-static const mach_msg_timeout_t kMachReceiveTimeoutMilliseconds = 150;
+static const int kMachReceiveTimeoutMilliseconds = 150;
 
 enum { kMaxAudioChannels = 32 };
 
@@ -32,17 +30,6 @@ typedef NS_ENUM(NSInteger, AudioControlStatus) {
   AudioControlStatusError,
 };
 
-struct barista_mach_message {
-  mach_msg_header_t header;
-  mach_msg_size_t descriptorCount;
-  mach_msg_ool_descriptor_t descriptor;
-};
-
-struct barista_mach_buffer {
-  struct barista_mach_message message;
-  mach_msg_trailer_t trailer;
-};
-
 static NSString *environment_value(NSString *name) {
   NSString *value = NSProcessInfo.processInfo.environment[name];
   return value.length > 0 ? value : nil;
@@ -1048,125 +1035,12 @@ static NSData *payload_for_tokens(NSArray<NSString *> *tokens) {
   return payload;
 }
 
-static mach_port_t sketchybar_port(void) {
-  const char *barName = getenv("BAR_NAME");
-  if (!barName || barName[0] == '\0' || strlen(barName) > 128) {
-    barName = "sketchybar";
-  }
-  char serviceName[160];
-  int written = snprintf(serviceName, sizeof(serviceName), "git.felix.%s", barName);
-  if (written < 0 || (size_t)written >= sizeof(serviceName)) {
-    return MACH_PORT_NULL;
-  }
-
-  mach_port_t bootstrapPort = MACH_PORT_NULL;
-  if (task_get_special_port(mach_task_self(), TASK_BOOTSTRAP_PORT, &bootstrapPort)
-      != KERN_SUCCESS) {
-    return MACH_PORT_NULL;
-  }
-  mach_port_t port = MACH_PORT_NULL;
-  kern_return_t result = bootstrap_look_up(bootstrapPort, serviceName, &port);
-  mach_port_deallocate(mach_task_self(), bootstrapPort);
-  if (result != KERN_SUCCESS) {
-    return MACH_PORT_NULL;
-  }
-  return port;
-}
-
-static BOOL response_is_success(const void *bytes, size_t size) {
-  if (!bytes || size == 0 || size > kMaxPayloadBytes) {
-    return NO;
-  }
-  const char *response = bytes;
-  if (memchr(response, '\0', size) == NULL) {
-    return NO;
-  }
-  return strstr(response, "[!]") == NULL;
-}
-
 static BOOL send_payload(NSData *payload) {
-  if (payload.length < 2 || payload.length > kMaxPayloadBytes) {
+  if (payload.length > kMaxPayloadBytes) {
     return NO;
   }
-  const uint8_t *bytes = payload.bytes;
-  if (bytes[payload.length - 1] != 0 || bytes[payload.length - 2] != 0) {
-    return NO;
-  }
-
-  for (NSUInteger attempt = 0; attempt < 2; attempt++) {
-    mach_port_t port = sketchybar_port();
-    if (port == MACH_PORT_NULL) {
-      continue;
-    }
-
-    mach_port_t responsePort = MACH_PORT_NULL;
-    mach_port_name_t task = mach_task_self();
-    if (mach_port_allocate(task, MACH_PORT_RIGHT_RECEIVE, &responsePort) != KERN_SUCCESS) {
-      mach_port_deallocate(task, port);
-      continue;
-    }
-    if (mach_port_insert_right(task,
-                               responsePort,
-                               responsePort,
-                               MACH_MSG_TYPE_MAKE_SEND) != KERN_SUCCESS) {
-      mach_port_mod_refs(task, responsePort, MACH_PORT_RIGHT_RECEIVE, -1);
-      mach_port_deallocate(task, port);
-      continue;
-    }
-
-    struct barista_mach_message message = {0};
-    message.header.msgh_remote_port = port;
-    message.header.msgh_local_port = responsePort;
-    message.header.msgh_id = responsePort;
-    message.header.msgh_bits = MACH_MSGH_BITS_SET(
-      MACH_MSG_TYPE_COPY_SEND,
-      MACH_MSG_TYPE_MAKE_SEND,
-      0,
-      MACH_MSGH_BITS_COMPLEX);
-    message.header.msgh_size = sizeof(message);
-    message.descriptorCount = 1;
-    message.descriptor.address = (void *)payload.bytes;
-    message.descriptor.size = (mach_msg_size_t)payload.length;
-    message.descriptor.copy = MACH_MSG_VIRTUAL_COPY;
-    message.descriptor.deallocate = false;
-    message.descriptor.type = MACH_MSG_OOL_DESCRIPTOR;
-
-    mach_msg_return_t result = mach_msg(&message.header,
-                                        MACH_SEND_MSG | MACH_SEND_TIMEOUT,
-                                        sizeof(message),
-                                        0,
-                                        MACH_PORT_NULL,
-                                        kMachSendTimeoutMilliseconds,
-                                        MACH_PORT_NULL);
-    mach_port_deallocate(task, port);
-
-    BOOL success = NO;
-    if (result == MACH_MSG_SUCCESS) {
-      struct barista_mach_buffer buffer = {0};
-      result = mach_msg(&buffer.message.header,
-                        MACH_RCV_MSG | MACH_RCV_TIMEOUT,
-                        0,
-                        sizeof(buffer),
-                        responsePort,
-                        kMachReceiveTimeoutMilliseconds,
-                        MACH_PORT_NULL);
-      if (result == MACH_MSG_SUCCESS) {
-        mach_msg_ool_descriptor_t descriptor = buffer.message.descriptor;
-        if (buffer.message.descriptorCount == 1
-            && descriptor.type == MACH_MSG_OOL_DESCRIPTOR
-            && descriptor.address != NULL
-            && descriptor.size > 0
-            && descriptor.size <= kMaxPayloadBytes) {
-          success = response_is_success(descriptor.address, descriptor.size);
-        }
-        mach_msg_destroy(&buffer.message.header);
-      }
-    }
-    mach_port_mod_refs(task, responsePort, MACH_PORT_RIGHT_RECEIVE, -1);
-    mach_port_deallocate(task, responsePort);
-    if (success) return YES;
-  }
-  return NO;
+  return barista_send(payload.bytes, payload.length, kMachReceiveTimeoutMilliseconds)
+    == BARISTA_SEND_CONFIRMED_SUCCESS;
 }
 
 static BOOL native_disabled(void) {
@@ -15,6 +15,9 @@
 #include <IOKit/ps/IOPowerSources.h>
 #include <pthread.h>
 
+#include "barista_cli.h"
+#include "barista_payload.h"
+
 // Widget types
 typedef enum {
     WIDGET_CLOCK,
@@ -207,18 +210,28 @@ static void format_clock_label(char *buffer, size_t size) {
     strftime(buffer, size, "%a %m/%d %I:%M %p", tm);
 }
 
-// Update clock widget
-void update_clock(const char* widget_name) {
+// Payload arena big enough for a batch of every widget
+#define WIDGET_PAYLOAD_BYTES 2048
+
+// Send natively, exec'ing the CLI only when the bar could not be reached
+static void send_payload(BaristaPayload* payload) {
+    size_t length = barista_payload_finish(payload);
+    if (length > 0) barista_sketchybar(payload->bytes, length, 0);
+}
+
+static void append_label(BaristaPayload* payload, const char* widget_name, const char* label) {
+    barista_payload_verb(payload, BARISTA_VERB_SET);
+    barista_payload_token(payload, widget_name);
+    barista_payload_property(payload, "label", label);
+}
+
+static void append_clock(BaristaPayload* payload, const char* widget_name) {
     char time_str[32];
     format_clock_label(time_str, sizeof(time_str));
-
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "sketchybar --set %s label='%s'", widget_name, time_str);
-    system(cmd);
+    append_label(payload, widget_name, time_str);
 }
 
-// Update battery widget
-void update_battery(const char* widget_name) {
+static void append_battery(BaristaPayload* payload, const char* widget_name) {
     int percentage, charging;
     get_battery_status(&percentage, &charging);
 
@@ -249,11 +262,41 @@ void update_battery(const char* widget_name) {
         color = "0xfff38ba8";
     }
 
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd),
-             "sketchybar --set %s icon='%s' label='%d%%' icon.color='%s' label.color='%s'",
-             widget_name, icon, percentage, color, color);
-    system(cmd);
+    char label[16];
+    snprintf(label, sizeof(label), "%d%%", percentage);
+    barista_payload_verb(payload, BARISTA_VERB_SET);
+    barista_payload_token(payload, widget_name);
+    barista_payload_property(payload, "icon", icon);
+    barista_payload_property(payload, "label", label);
+    barista_payload_property(payload, "icon.color", color);
+    barista_payload_property(payload, "label.color", color);
+}
+
+// Caller holds cache_lock
+static void append_system_info(BaristaPayload* payload, const char* widget_name) {
+    char label[128];
+    snprintf(label, sizeof(label),
+             "%.0f%% %llu/%lluG",
+             cache.cpu_usage, cache.memory_used_gb, cache.memory_total_gb);
+    append_label(payload, widget_name, label);
+}
+
+// Update clock widget
+void update_clock(const char* widget_name) {
+    uint8_t arena[WIDGET_PAYLOAD_BYTES];
+    BaristaPayload payload;
+    barista_payload_init(&payload, arena, sizeof(arena));
+    append_clock(&payload, widget_name);
+    send_payload(&payload);
+}
+
+// Update battery widget
+void update_battery(const char* widget_name) {
+    uint8_t arena[WIDGET_PAYLOAD_BYTES];
+    BaristaPayload payload;
+    barista_payload_init(&payload, arena, sizeof(arena));
+    append_battery(&payload, widget_name);
+    send_payload(&payload);
 }
 
 // Update CPU widget
@@ -266,13 +309,16 @@ void update_cpu(const char* widget_name) {
         cache.last_cpu_update = now;
     }
 
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd),
-             "sketchybar --set %s label='CPU: %.1f%%'",
-             widget_name, cache.cpu_usage);
-    system(cmd);
+    char label[32];
+    snprintf(label, sizeof(label), "CPU: %.1f%%", cache.cpu_usage);
 
     pthread_mutex_unlock(&cache_lock);
+
+    uint8_t arena[WIDGET_PAYLOAD_BYTES];
+    BaristaPayload payload;
+    barista_payload_init(&payload, arena, sizeof(arena));
+    append_label(&payload, widget_name, label);
+    send_payload(&payload);
 }
 
 // Update memory widget
@@ -286,17 +332,24 @@ void update_memory(const char* widget_name) {
         cache.last_mem_update = now;
     }
 
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd),
-             "sketchybar --set %s label='MEM: %.1f%%'",
-             widget_name, cache.memory_usage);
-    system(cmd);
+    char label[32];
+    snprintf(label, sizeof(label), "MEM: %.1f%%", cache.memory_usage);
 
     pthread_mutex_unlock(&cache_lock);
+
+    uint8_t arena[WIDGET_PAYLOAD_BYTES];
+    BaristaPayload payload;
+    barista_payload_init(&payload, arena, sizeof(arena));
+    append_label(&payload, widget_name, label);
+    send_payload(&payload);
 }
 
 // Update system info widget (combined)
 void update_system_info(const char* widget_name) {
+    uint8_t arena[WIDGET_PAYLOAD_BYTES];
+    BaristaPayload payload;
+    barista_payload_init(&payload, arena, sizeof(arena));
+
     pthread_mutex_lock(&cache_lock);
 
     time_t now = time(NULL);
@@ -314,79 +367,37 @@ void update_system_info(const char* widget_name) {
         cache.last_disk_update = now;
     }
 
-    char label[128];
-    snprintf(label, sizeof(label),
-             "%.0f%% %llu/%lluG",
-             cache.cpu_usage, cache.memory_used_gb, cache.memory_total_gb);
-
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd),
-             "sketchybar --set %s label='%s'", widget_name, label);
-    system(cmd);
+    append_system_info(&payload, widget_name);
 
     pthread_mutex_unlock(&cache_lock);
+
+    send_payload(&payload);
 }
 
-// Batch update multiple widgets
+// Batch update multiple widgets in one request
 void batch_update(const char* widgets[], int count) {
-    char cmd[2048] = "sketchybar";
+    uint8_t arena[WIDGET_PAYLOAD_BYTES];
+    BaristaPayload payload;
+    barista_payload_init(&payload, arena, sizeof(arena));
 
     for (int i = 0; i < count; i++) {
         if (strcmp(widgets[i], "clock") == 0) {
-            char time_str[32];
-            format_clock_label(time_str, sizeof(time_str));
-            char buf[256];
-            snprintf(buf, sizeof(buf), " --set clock label='%s'", time_str);
-            strcat(cmd, buf);
+            append_clock(&payload, "clock");
         }
         else if (strcmp(widgets[i], "battery") == 0) {
-            int percentage, charging;
-            get_battery_status(&percentage, &charging);
-            char buf[256];
-            const char* icon = "";
-            const char* color = "0xffa6e3a1";
-            if (charging) {
-                icon = "";
-                color = "0xff89b4fa";
-            } else if (percentage >= 90) {
-                icon = "";
-            } else if (percentage >= 60) {
-                icon = "";
-            } else if (percentage >= 30) {
-                icon = "";
-            } else if (percentage >= 10) {
-                icon = "";
-                color = "0xfff9e2af";
-            } else {
-                icon = "";
-                color = "0xfff38ba8";
-            }
-            if (!charging && percentage < 50 && percentage >= 20) {
-                color = "0xfff9e2af";
-            }
-            if (!charging && percentage < 20) {
-                color = "0xfff38ba8";
-            }
-            snprintf(buf, sizeof(buf),
-                     " --set battery icon='%s' label='%d%%' icon.color='%s' label.color='%s'",
-                     icon, percentage, color, color);
-            strcat(cmd, buf);
+            append_battery(&payload, "battery");
         }
         else if (strcmp(widgets[i], "system_info") == 0) {
             pthread_mutex_lock(&cache_lock);
             cache.cpu_usage = get_cpu_usage();
             cache.memory_usage = get_memory_usage();
             get_memory_gb(&cache.memory_used_gb, &cache.memory_total_gb);
-            char buf[512];
-            snprintf(buf, sizeof(buf),
-                    " --set system_info label='%.0f%% %llu/%lluG'",
-                    cache.cpu_usage, cache.memory_used_gb, cache.memory_total_gb);
-            strcat(cmd, buf);
+            append_system_info(&payload, "system_info");
             pthread_mutex_unlock(&cache_lock);
         }
     }
 
-    system(cmd);
+    send_payload(&payload);
 }
 
 // Widget daemon mode - continuously update widgets
@@ -215,6 +215,9 @@ local POPUP_MANAGER_SCRIPT_CMD = shell_utils.env_prefix({
 }) .. POPUP_MANAGER_SCRIPT
 local POPUP_GUARD_SCRIPT   = compiled_script("popup_guard",    PLUGIN_DIR .. "/popup_guard.sh")
 local WIDGET_MANAGER_BIN   = compiled_script("widget_manager", "")
+local BUSD_BIN             = compiled_script("barista_busd", "")
+local SYSTEM_INFO_BIN      = compiled_script("system_info_widget", "")
+local STATE_MANAGER_BIN    = compiled_script("state_manager", "")
 local SPACE_VISUALS_SCRIPT = PLUGIN_DIR .. "/space_visuals.sh"
 local STATS_BIN            = CONFIG_DIR .. "/bin/barista-stats.sh"
 local RUNTIME_CONTEXT_SCRIPT = SCRIPTS_DIR .. "/runtime_context.sh"
@@ -232,6 +235,11 @@ os.remove(SPACE_VISUAL_AUTHORITATIVE_MARKER)
 os.remove(SPACE_VISUAL_SELECTED_CONTEXT)
 os.remove(SPACE_VISUAL_LEGACY_SELECTION)
 
+-- Items are recreated from their defaults on every load, so helpers must not
+-- keep suppressing values the previous bar generation had already shown.
+os.remove(string.format("%s/barista_sent_cache.%s",
+  (os.getenv("TMPDIR") or "/tmp"):gsub("/+$", ""), os.getenv("BAR_NAME") or "sketchybar"))
+
 -- Yabai availability (cached)
 local yabai_available_cache = nil
 local function yabai_available()
@@ -308,6 +316,18 @@ local widget_daemon_enabled = runtime_daemon.should_enable_widget_daemon(state,
   binary_path = WIDGET_MANAGER_BIN,
   lua_only = LUA_ONLY,
 })
+local bus_daemon_enabled = runtime_daemon.should_enable_bus_daemon(state, {
+  binary_path = BUSD_BIN,
+  lua_only = LUA_ONLY,
+})
+local system_info_daemon_enabled = runtime_daemon.should_enable_system_info_daemon(state, {
+  binary_path = SYSTEM_INFO_BIN,
+  lua_only = LUA_ONLY,
+})
+local state_daemon_enabled = runtime_daemon.should_enable_state_daemon(state, {
+  binary_path = STATE_MANAGER_BIN,
+  lua_only = LUA_ONLY,
+})
 
 local function direct_popup_toggle(item_name, opts)
   return ui_builder.toggle(item_name, {
@@ -519,6 +539,9 @@ local reload_prep_end_wall_ms = runtime_startup.wall_time_ms()
 local daemon_stop_start_wall_ms = reload_prep_end_wall_ms
 runtime_daemon.stop_widget_daemon({ trace = trace_startup })
 runtime_daemon.stop_runtime_context_daemon({ trace = trace_startup })
+runtime_daemon.stop_bus_daemon({ trace = trace_startup })
+runtime_daemon.stop_system_info_daemon({ trace = trace_startup })
+runtime_daemon.stop_state_daemon({ trace = trace_startup })
 local daemon_stop_duration_ms = runtime_startup.wall_time_ms() - daemon_stop_start_wall_ms
 
 local config_build_start_ms = runtime_startup.current_time_ms()
@@ -738,6 +761,33 @@ runtime_startup.record_duration_event(STATS_BIN, "reload_stats_flush_time", stat
 })
 runtime_startup.record_reload_metrics(STATS_BIN, RELOAD_START_MS, { trace = trace_startup })
 
+-- Helpers fall back to direct requests until the bus socket appears, so the
+-- bus starts ahead of the widget daemon but nothing waits on it.
+if bus_daemon_enabled then
+  runtime_daemon.ensure_bus_daemon(BUSD_BIN, {
+    trace = trace_startup,
+    force_restart = true,
+  })
+end
+
+-- Like the bus, the system info cache is optional: the widget probes on its
+-- own until the daemon's socket appears.
+if system_info_daemon_enabled then
+  runtime_daemon.ensure_system_info_daemon(SYSTEM_INFO_BIN, {
+    trace = trace_startup,
+    force_restart = true,
+  })
+end
+
+-- The bar is built from state.json above; the state daemon only follows
+-- later edits, and state_manager runs commands itself until it is up.
+if state_daemon_enabled then
+  runtime_daemon.ensure_state_daemon(STATE_MANAGER_BIN, {
+    trace = trace_startup,
+    force_restart = true,
+  })
+end
+
 if widget_daemon_enabled then
   runtime_daemon.ensure_widget_daemon(WIDGET_MANAGER_BIN, {
     trace = trace_startup,
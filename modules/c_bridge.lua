@@ -123,8 +123,10 @@ function c_bridge.state.appearance(key, value)
     if value then
         exec_c_async("state_manager", "appearance", key, value)
     else
-        -- For getting, we'd need to parse the state file
-        -- This is a limitation - we should enhance state_manager to support getters
+        local result = exec_c("state_manager", "get", "appearance." .. key)
+        if result and result ~= "" then
+            return (result:gsub("%s+$", ""))
+        end
         return nil
     end
 end
@@ -208,6 +208,81 @@ function runtime_daemon.resolve_widget_daemon_mode(state, env_get)
   return "auto"
 end
 
+function runtime_daemon.resolve_bus_daemon_mode(state, env_get)
+  local getenv = env_get or os.getenv
+  local env_mode = getenv("BARISTA_BUS_DAEMON")
+  if env_mode and env_mode ~= "" then
+    return runtime_daemon.normalize_mode(env_mode)
+  end
+  if type(state) == "table" and type(state.modes) == "table" then
+    return runtime_daemon.normalize_mode(state.modes.bus_daemon)
+  end
+  return "auto"
+end
+
+function runtime_daemon.should_enable_bus_daemon(state, opts)
+  opts = type(opts) == "table" and opts or {}
+  if runtime_daemon.resolve_bus_daemon_mode(state, opts.getenv) == "disabled" then
+    return false
+  end
+  if opts.lua_only then
+    return false
+  end
+  local binary_path = opts.binary_path
+  return binary_path ~= nil and binary_path ~= ""
+end
+
+function runtime_daemon.resolve_system_info_daemon_mode(state, env_get)
+  local getenv = env_get or os.getenv
+  local env_mode = getenv("BARISTA_SYSTEM_INFO_DAEMON")
+  if env_mode and env_mode ~= "" then
+    return runtime_daemon.normalize_mode(env_mode)
+  end
+  if type(state) == "table" and type(state.modes) == "table" then
+    return runtime_daemon.normalize_mode(state.modes.system_info_daemon)
+  end
+  return "auto"
+end
+
+function runtime_daemon.should_enable_system_info_daemon(state, opts)
+  opts = type(opts) == "table" and opts or {}
+  if runtime_daemon.resolve_system_info_daemon_mode(state, opts.getenv) == "disabled" then
+    return false
+  end
+  if opts.lua_only then
+    return false
+  end
+  if type(state) == "table" and type(state.widgets) == "table" and state.widgets.system_info == false then
+    return false
+  end
+  local binary_path = opts.binary_path
+  return binary_path ~= nil and binary_path ~= ""
+end
+
+function runtime_daemon.resolve_state_daemon_mode(state, env_get)
+  local getenv = env_get or os.getenv
+  local env_mode = getenv("BARISTA_STATE_DAEMON")
+  if env_mode and env_mode ~= "" then
+    return runtime_daemon.normalize_mode(env_mode)
+  end
+  if type(state) == "table" and type(state.modes) == "table" then
+    return runtime_daemon.normalize_mode(state.modes.state_daemon)
+  end
+  return "auto"
+end
+
+function runtime_daemon.should_enable_state_daemon(state, opts)
+  opts = type(opts) == "table" and opts or {}
+  if runtime_daemon.resolve_state_daemon_mode(state, opts.getenv) == "disabled" then
+    return false
+  end
+  if opts.lua_only then
+    return false
+  end
+  local binary_path = opts.binary_path
+  return binary_path ~= nil and binary_path ~= ""
+end
+
 function runtime_daemon.should_enable_widget_daemon(state, opts)
   opts = type(opts) == "table" and opts or {}
   local mode = runtime_daemon.resolve_widget_daemon_mode(state, opts.getenv)
@@ -359,6 +434,45 @@ function runtime_daemon.stop_widget_daemon(opts)
   return stop_named_daemon("widget-manager", "widget_manager daemon", opts)
 end
 
+function runtime_daemon.ensure_bus_daemon(binary_path, opts)
+  if not binary_path or binary_path == "" then
+    return false, "missing_binary"
+  end
+  local expected_fragment = tostring(binary_path) .. " serve"
+  local command = string.format("%s serve", shell_quote(binary_path))
+  return ensure_named_daemon("busd", command, expected_fragment, opts)
+end
+
+function runtime_daemon.stop_bus_daemon(opts)
+  return stop_named_daemon("busd", "barista_busd serve", opts)
+end
+
+function runtime_daemon.ensure_system_info_daemon(binary_path, opts)
+  if not binary_path or binary_path == "" then
+    return false, "missing_binary"
+  end
+  local expected_fragment = tostring(binary_path) .. " --daemon"
+  local command = string.format("%s --daemon", shell_quote(binary_path))
+  return ensure_named_daemon("system-info", command, expected_fragment, opts)
+end
+
+function runtime_daemon.stop_system_info_daemon(opts)
+  return stop_named_daemon("system-info", "system_info_widget --daemon", opts)
+end
+
+function runtime_daemon.ensure_state_daemon(binary_path, opts)
+  if not binary_path or binary_path == "" then
+    return false, "missing_binary"
+  end
+  local expected_fragment = tostring(binary_path) .. " serve"
+  local command = string.format("%s serve", shell_quote(binary_path))
+  return ensure_named_daemon("state", command, expected_fragment, opts)
+end
+
+function runtime_daemon.stop_state_daemon(opts)
+  return stop_named_daemon("state", "state_manager serve", opts)
+end
+
 function runtime_daemon.ensure_runtime_context_daemon(script_path, opts)
   if not script_path or script_path == "" then
     return false, "missing_script"
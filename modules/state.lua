@@ -9,6 +9,19 @@ local HOME = os.getenv("HOME")
 local CONFIG_DIR = os.getenv("BARISTA_CONFIG_DIR") or (HOME .. "/.config/sketchybar")
 local STATE_FILE = CONFIG_DIR .. "/state.json"
 
+-- state_manager keeps a binary snapshot of state.json beside it, which
+-- barista_snapshot.so maps so startup skips decoding the JSON. The JSON
+-- stays the source of truth: a missing or stale snapshot falls back to it.
+local SNAPSHOT_FILE = STATE_FILE .. ".snapshot"
+local SNAPSHOT_MODULE = CONFIG_DIR .. "/bin/barista_snapshot.so"
+local STATE_MANAGER = CONFIG_DIR .. "/bin/state_manager"
+
+-- The state daemon appends each change to state.json.journal and writes
+-- state.json once changes settle, so a load in between replays the journal
+-- as state_manager's own load does. Its first line names the state.json it
+-- continues; a journal older than the file on disk is ignored.
+local JOURNAL_FILE = STATE_FILE .. ".journal"
+
 -- State version for migrations
 local STATE_VERSION = 2
 
@@ -132,6 +145,9 @@ local default_state = {
     window_manager = "auto",
     runtime_backend = "auto",
     widget_daemon = "auto",
+    bus_daemon = "auto",
+    system_info_daemon = "auto",
+    state_daemon = "auto",
   },
   toggles = {
     yabai_shortcuts = true,
@@ -360,15 +376,169 @@ local function migrate_state(data, from_version, to_version)
 end
 
 -- Load state from disk
+-- BARISTA_STATE_SNAPSHOT=0 (or off, false, disabled) always decodes the JSON.
+local function snapshot_module()
+  local mode = (os.getenv("BARISTA_STATE_SNAPSHOT") or ""):lower()
+  if mode == "0" or mode == "off" or mode == "false" or mode == "disabled" then
+    return nil
+  end
+  local open = package.loadlib(SNAPSHOT_MODULE, "luaopen_barista_snapshot")
+  if not open then
+    return nil
+  end
+  local ok, module = pcall(open)
+  return ok and module or nil
+end
+
+local function shell_quote(value)
+  return "'" .. tostring(value):gsub("'", "'\\''") .. "'"
+end
+
+-- state_manager writes its snapshot under $HOME, so only that state.json
+-- can be caught up; it runs in the background for the next start.
+local function request_snapshot()
+  if STATE_FILE ~= HOME .. "/.config/sketchybar/state.json" then
+    return
+  end
+  local manager = io.open(STATE_MANAGER, "r")
+  if manager then
+    manager:close()
+    os.execute(shell_quote(STATE_MANAGER) .. " snapshot >/dev/null 2>&1 &")
+  end
+end
+
+local function read_file(path)
+  local file = io.open(path, "rb")
+  if not file then
+    return nil
+  end
+  local contents = file:read("*a")
+  file:close()
+  return contents
+end
+
+-- FNV-1a, 64-bit, as state_manager hashes state.json
+local function fnv1a(text)
+  local hash = 0xcbf29ce484222325
+  for i = 1, #text do
+    hash = (hash ~ string.byte(text, i)) * 0x100000001b3
+  end
+  return hash
+end
+
+local JOURNAL_ESCAPES = { ["\\"] = "\\", t = "\t", n = "\n" }
+
+local function journal_unescape(text)
+  local malformed = false
+  local result = text:gsub("\\(.?)", function(escape)
+    local plain = JOURNAL_ESCAPES[escape]
+    if not plain then
+      malformed = true
+      return ""
+    end
+    return plain
+  end)
+  return not malformed and result or nil
+end
+
+local JOURNAL_APPEARANCE = {
+  bar_height = tonumber, corner_radius = tonumber, blur_radius = tonumber,
+  widget_scale = tonumber, font_size = tonumber,
+  bar_color = tostring, font_family = tostring, font_style = tostring,
+}
+
+-- One record, with the values state_manager would have written to state.json
+local function apply_journal_record(data, key, value)
+  -- The daemon journals only widgets it knows, which may be defaults that
+  -- state.json does not list yet.
+  local name = key:match("^widget%.(.+)$")
+  if name then
+    if value ~= "on" and value ~= "off" then
+      return false
+    end
+    if type(data.widgets) ~= "table" then
+      data.widgets = {}
+    end
+    local widgets = data.widgets
+    if type(widgets[name]) == "table" then
+      widgets[name].enabled = value == "on"
+    else
+      widgets[name] = value == "on"
+    end
+    return true
+  end
+
+  local field = key:match("^appearance%.(.+)$")
+  if field then
+    local convert = JOURNAL_APPEARANCE[field]
+    local converted = convert and convert(value)
+    if converted == nil then
+      return false
+    end
+    if type(data.appearance) ~= "table" then
+      data.appearance = {}
+    end
+    data.appearance[field] = converted
+    return true
+  end
+
+  local number, kind = key:match("^space%.(%d+)%.(%a+)$")
+  number = tonumber(number)
+  if not number or number < 1 or (kind ~= "icon" and kind ~= "mode") then
+    return false
+  end
+  local map = kind == "icon" and "space_icons" or "space_modes"
+  if type(data[map]) ~= "table" then
+    data[map] = {}
+  end
+  local omitted = value == "" or (kind == "mode" and value == "float")
+  data[map][tostring(number)] = not omitted and value or nil
+  return true
+end
+
+-- Applies `journal` (state.json.journal) to data decoded from `contents`
+-- (state.json). Returns the number of records applied, or nil when the
+-- journal continues some other state.json. A last line cut short is ignored.
+function state.apply_journal(data, journal, contents)
+  contents = contents or ""
+  local base = journal:match("^([^\n]*)\n")
+  if base ~= string.format("#base\t%016x\t%d", fnv1a(contents), #contents) then
+    return nil
+  end
+  local applied = 0
+  for line in journal:sub(#base + 2):gmatch("([^\n]*)\n") do
+    local key, value = line:match("^([^\t]*)\t(.*)$")
+    key = key and journal_unescape(key)
+    value = value and journal_unescape(value)
+    if key and value and apply_journal_record(data, key, value) then
+      applied = applied + 1
+    end
+  end
+  return applied
+end
+
 function state.load()
   local data
-  local file = io.open(STATE_FILE, "r")
-  if file then
-    local contents = file:read("*a")
-    file:close()
-    local ok, decoded = pcall(json.decode, contents)
-    if ok and type(decoded) == "table" then
-      data = decoded
+  local snapshot = snapshot_module()
+  if snapshot then
+    local ok, loaded = pcall(snapshot.load, SNAPSHOT_FILE, STATE_FILE)
+    if ok and type(loaded) == "table" then
+      data = loaded
+    end
+  end
+
+  if not data then
+    local file = io.open(STATE_FILE, "r")
+    if file then
+      local contents = file:read("*a")
+      file:close()
+      local ok, decoded = pcall(json.decode, contents)
+      if ok and type(decoded) == "table" then
+        data = decoded
+        if snapshot then
+          request_snapshot()
+        end
+      end
     end
   end
 
@@ -376,6 +546,11 @@ function state.load()
     data = {}
   end
 
+  local journal = read_file(JOURNAL_FILE)
+  if journal then
+    state.apply_journal(data, journal, read_file(STATE_FILE))
+  end
+
   -- Check version and migrate if needed
   local loaded_version = data._version or 0
   if loaded_version < STATE_VERSION then
@@ -0,0 +1,102 @@
+#!/usr/bin/env lua
+-- Compare loading state.json through helpers/lib/json.lua with mapping
+-- state.json.snapshot through bin/barista_snapshot.so (see docs/BUILD.md).
+-- Usage: lua scripts/bench_state_load.lua [rounds] [state.json]
+--   The first round of each includes loading the decoder or the module, as
+--   a bar start does; the mean covers the rounds after it. Both results are
+--   compared so a snapshot that differs from the JSON is reported.
+--   CONFIG_DIR: BARISTA_CONFIG_DIR or the repo this script sits in.
+
+local function get_config_dir()
+  local env = os.getenv("BARISTA_CONFIG_DIR")
+  if env and env ~= "" then return env end
+  local script = arg[0] or ""
+  if script:match("^/") then
+    return script:gsub("/scripts/bench_state_load.lua$", ""):gsub("/scripts/.*", "")
+  end
+  return (io.popen("pwd"):read("*a") or ""):gsub("%s+$", "")
+end
+local CONFIG_DIR = get_config_dir()
+package.path = package.path .. ";" .. CONFIG_DIR .. "/helpers/lib/?.lua"
+
+local rounds = tonumber(arg[1]) or 50
+local state_file = arg[2] or (os.getenv("HOME") .. "/.config/sketchybar/state.json")
+local snapshot_file = state_file .. ".snapshot"
+local module_path = CONFIG_DIR .. "/bin/barista_snapshot.so"
+
+local function time(fn)
+  local start = os.clock()
+  local result = fn()
+  return (os.clock() - start) * 1000, result
+end
+
+local function bench(name, setup, load)
+  local first, result = time(function()
+    setup()
+    return load()
+  end)
+  local total = 0
+  for _ = 1, rounds do
+    local elapsed = time(load)
+    total = total + elapsed
+  end
+  print(string.format("%-9s first %.3f ms, mean %.3f ms over %d rounds", name, first, total / rounds, rounds))
+  return result
+end
+
+local function same(a, b, path)
+  if type(a) ~= type(b) or math.type(a) ~= math.type(b) then
+    return false, path
+  end
+  if type(a) ~= "table" then
+    return a == b, path
+  end
+  for key, value in pairs(a) do
+    local ok, where = same(value, b[key], path .. "." .. tostring(key))
+    if not ok then return false, where end
+  end
+  for key in pairs(b) do
+    if a[key] == nil then return false, path .. "." .. tostring(key) end
+  end
+  return true
+end
+
+local file = io.open(state_file, "r")
+if not file then
+  io.stderr:write("bench_state_load: cannot read " .. state_file .. "\n")
+  os.exit(1)
+end
+file:close()
+
+local json
+local decoded = bench("json", function()
+  json = require("json")
+end, function()
+  local handle = io.open(state_file, "r")
+  local contents = handle:read("*a")
+  handle:close()
+  return json.decode(contents)
+end)
+
+local open = package.loadlib(module_path, "luaopen_barista_snapshot")
+if not open then
+  io.stderr:write("bench_state_load: no module at " .. module_path .. "; build it with cmake\n")
+  os.exit(1)
+end
+local snapshot
+local loaded = bench("snapshot", function()
+  snapshot = open()
+end, function()
+  local data, err = snapshot.load(snapshot_file, state_file)
+  if not data then
+    io.stderr:write("bench_state_load: " .. err .. "; run bin/state_manager snapshot\n")
+    os.exit(1)
+  end
+  return data
+end)
+
+local ok, where = same(decoded, loaded, "state")
+if not ok then
+  io.stderr:write("bench_state_load: snapshot differs from the JSON at " .. where .. "\n")
+  os.exit(1)
+end
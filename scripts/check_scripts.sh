@@ -158,6 +158,24 @@ bash tests/test_popup_anchor.sh >/dev/null
 bash tests/test_popup_hover.sh >/dev/null
 bash tests/test_popup_click.sh >/dev/null
 bash tests/test_popup_manager.sh >/dev/null
+bash tests/test_barista_transport.sh >/dev/null
+bash tests/test_barista_payload.sh >/dev/null
+bash tests/test_barista_busd.sh >/dev/null
+bash tests/test_barista_mock_bar.sh >/dev/null
+bash tests/test_barista_replay.sh >/dev/null
+bash tests/test_barista_history.sh >/dev/null
+bash tests/test_barista_top.sh >/dev/null
+bash tests/test_barista_cpu_sample.sh >/dev/null
+bash tests/test_barista_probe.sh >/dev/null
+bash tests/test_barista_route.sh >/dev/null
+bash tests/test_barista_executor.sh >/dev/null
+bash tests/test_barista_json.sh >/dev/null
+bash tests/test_barista_snapshot.sh >/dev/null
+bash tests/test_state_manager.sh >/dev/null
+bash tests/test_event_providers.sh >/dev/null
+bash tests/test_barista_sent_cache.sh >/dev/null
+bash tests/test_barista_send_queue.sh >/dev/null
+bash tests/test_helper_spawns.sh >/dev/null
 bash tests/test_perf_clock.sh >/dev/null
 bash tests/test_file_lock.sh >/dev/null
 bash tests/test_runtime_backend_marker.sh >/dev/null
@@ -0,0 +1,121 @@
+/*
+ * LD_PRELOAD shim for test_helper_spawns.sh (Linux only).
+ *
+ * Logs one "<call>\t<program>" line to $BARISTA_SPAWN_LOG for every process a
+ * helper starts through the exec family, posix_spawn, system() or popen(),
+ * then forwards to the real call. system() and popen() are logged as
+ * /bin/sh because that is what they run. A fork() that never execs is the
+ * helper deferring its own work and is not counted.
+ */
+#define _GNU_SOURCE 1
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_LIST_ARGS 64
+
+static void record(const char *call, const char *program) {
+  const char *path = getenv("BARISTA_SPAWN_LOG");
+  if (!path || path[0] == '\0') return;
+  int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) return;
+  char line[512];
+  int length = snprintf(line, sizeof(line), "%s\t%s\n", call, program ? program : "");
+  if (length > 0) {
+    if ((size_t)length >= sizeof(line)) length = (int)sizeof(line) - 1;
+    ssize_t ignored = write(fd, line, (size_t)length);
+    (void)ignored;
+  }
+  close(fd);
+}
+
+#define REAL(name) ((__typeof__(&name))dlsym(RTLD_NEXT, #name))
+
+int execve(const char *path, char *const argv[], char *const envp[]) {
+  record("execve", path);
+  return REAL(execve)(path, argv, envp);
+}
+
+int execv(const char *path, char *const argv[]) {
+  record("execv", path);
+  return REAL(execv)(path, argv);
+}
+
+int execvp(const char *file, char *const argv[]) {
+  record("execvp", file);
+  return REAL(execvp)(file, argv);
+}
+
+int execvpe(const char *file, char *const argv[], char *const envp[]) {
+  record("execvpe", file);
+  return REAL(execvpe)(file, argv, envp);
+}
+
+/* The list forms are collected into an argv and handed to the vector forms
+ * of the real libc, so they are logged once under their own name. */
+static int collect(const char *first, va_list args, char **argv) {
+  int count = 0;
+  argv[count++] = (char *)first;
+  while (count < MAX_LIST_ARGS - 1 && (argv[count] = va_arg(args, char *)) != NULL) count++;
+  argv[count] = NULL;
+  return count;
+}
+
+int execl(const char *path, const char *arg, ...) {
+  char *argv[MAX_LIST_ARGS];
+  va_list args;
+  va_start(args, arg);
+  collect(arg, args, argv);
+  va_end(args);
+  record("execl", path);
+  return REAL(execv)(path, argv);
+}
+
+int execlp(const char *file, const char *arg, ...) {
+  char *argv[MAX_LIST_ARGS];
+  va_list args;
+  va_start(args, arg);
+  collect(arg, args, argv);
+  va_end(args);
+  record("execlp", file);
+  return REAL(execvp)(file, argv);
+}
+
+int execle(const char *path, const char *arg, ...) {
+  char *argv[MAX_LIST_ARGS];
+  va_list args;
+  va_start(args, arg);
+  collect(arg, args, argv);
+  char *const *envp = va_arg(args, char *const *);
+  va_end(args);
+  record("execle", path);
+  return REAL(execve)(path, argv, envp);
+}
+
+int posix_spawn(pid_t *pid, const char *path, const posix_spawn_file_actions_t *actions,
+                const posix_spawnattr_t *attributes, char *const argv[], char *const envp[]) {
+  record("posix_spawn", path);
+  return REAL(posix_spawn)(pid, path, actions, attributes, argv, envp);
+}
+
+int posix_spawnp(pid_t *pid, const char *file, const posix_spawn_file_actions_t *actions,
+                 const posix_spawnattr_t *attributes, char *const argv[], char *const envp[]) {
+  record("posix_spawnp", file);
+  return REAL(posix_spawnp)(pid, file, actions, attributes, argv, envp);
+}
+
+int system(const char *command) {
+  record("system", "/bin/sh");
+  return REAL(system)(command);
+}
+
+FILE *popen(const char *command, const char *mode) {
+  record("popen", "/bin/sh");
+  return REAL(popen)(command, mode);
+}
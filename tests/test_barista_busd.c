@@ -0,0 +1,311 @@
+#define main barista_busd_main
+#include "../helpers/barista_busd.c"
+#undef main
+
+#include <assert.h>
+#include <sys/wait.h>
+
+static char upstream_path[256];
+static char bus_path[256];
+static char record_path[256];
+
+static int contains(const uint8_t *bytes, size_t length, const char *needle) {
+  size_t needle_length = strlen(needle);
+  for (size_t i = 0; i + needle_length <= length; i++) {
+    if (memcmp(bytes + i, needle, needle_length) == 0) return 1;
+  }
+  return 0;
+}
+
+static size_t build_payload(uint8_t *buffer, size_t capacity, const char *const *tokens) {
+  size_t length = 0;
+  for (size_t i = 0; tokens[i]; i++) {
+    size_t token_length = strlen(tokens[i]) + 1;
+    assert(length + token_length < capacity);
+    memcpy(buffer + length, tokens[i], token_length);
+    length += token_length;
+  }
+  buffer[length++] = '\0';
+  return length;
+}
+
+static void merge_tokens(BusFrame *frame, BusStats *stats, const char *const *tokens) {
+  uint8_t payload[1024];
+  size_t length = build_payload(payload, sizeof(payload), tokens);
+  size_t bound = 0;
+  assert(scan_message(payload, length, &bound) == 0);
+  assert(frame_fits(frame, bound));
+  merge_message(frame, stats, payload, length);
+}
+
+static void assert_frame(BusFrame *frame, BusStats *stats, const char *const *expected) {
+  uint8_t payload[1024];
+  size_t length = build_payload(payload, sizeof(payload), expected);
+  frame_close_table(frame, stats);
+  frame->out[frame->out_length++] = '\0';
+  if (frame->out_length != length || memcmp(frame->out, payload, length) != 0) {
+    fprintf(stderr, "unexpected frame:");
+    for (size_t i = 0; i < frame->out_length; i++) {
+      fputc(frame->out[i] ? frame->out[i] : ' ', stderr);
+    }
+    fputc('\n', stderr);
+    assert(0);
+  }
+  frame_reset(frame);
+}
+
+static void test_latest_value_wins(void) {
+  static BusFrame frame;
+  BusStats stats;
+  memset(&stats, 0, sizeof(stats));
+  frame_reset(&frame);
+
+  merge_tokens(&frame, &stats, (const char *[]){"--set", "cpu", "label=10%", "icon.color=0xff", NULL});
+  merge_tokens(&frame, &stats, (const char *[]){"--set", "network", "label=1K", NULL});
+  merge_tokens(&frame, &stats, (const char *[]){"--set", "cpu", "label=12%", NULL});
+  merge_tokens(&frame, &stats, (const char *[]){"--set", "cpu", "label=14%", "--set", "network", "label=2K", NULL});
+  assert(frame.message_count == 4);
+  assert_frame(&frame, &stats, (const char *[]){
+    "--set", "cpu", "label=14%", "icon.color=0xff", "--set", "network", "label=2K", NULL});
+  assert(stats.props_in == 6);
+  assert(stats.props_out == 3);
+}
+
+static void test_barriers_keep_order(void) {
+  static BusFrame frame;
+  BusStats stats;
+  memset(&stats, 0, sizeof(stats));
+  frame_reset(&frame);
+
+  merge_tokens(&frame, &stats, (const char *[]){"--set", "cpu", "label=1", NULL});
+  merge_tokens(&frame, &stats, (const char *[]){"--trigger", "space_change", "INFO=2", NULL});
+  merge_tokens(&frame, &stats, (const char *[]){"--set", "cpu", "label=2", NULL});
+  merge_tokens(&frame, &stats, (const char *[]){"--set", "/space\\..*/", "drawing=on", NULL});
+  merge_tokens(&frame, &stats, (const char *[]){"--set", "cpu", "label=3", NULL});
+  assert_frame(&frame, &stats, (const char *[]){
+    "--set", "cpu", "label=1",
+    "--trigger", "space_change", "INFO=2",
+    "--set", "cpu", "label=2",
+    "--set", "/space\\..*/", "drawing=on",
+    "--set", "cpu", "label=3", NULL});
+  assert(stats.barriers == 2);
+}
+
+static void test_toggles_are_not_merged(void) {
+  static BusFrame frame;
+  BusStats stats;
+  memset(&stats, 0, sizeof(stats));
+  frame_reset(&frame);
+
+  merge_tokens(&frame, &stats, (const char *[]){"--set", "menu", "label=a", "popup.drawing=toggle", "label=b", NULL});
+  merge_tokens(&frame, &stats, (const char *[]){"--set", "menu", "popup.drawing=toggle", NULL});
+  assert_frame(&frame, &stats, (const char *[]){
+    "--set", "menu", "label=a",
+    "--set", "menu", "popup.drawing=toggle",
+    "--set", "menu", "label=b",
+    "--set", "menu", "popup.drawing=toggle", NULL});
+}
+
+static void test_isolated_commands(void) {
+  uint8_t payload[256];
+  size_t bound = 0;
+  size_t length = build_payload(payload, sizeof(payload),
+                                (const char *[]){"--animate", "tanh", "20", "--set", "cpu", "y_offset=2", NULL});
+  assert(scan_message(payload, length, &bound) == 1);
+  length = build_payload(payload, sizeof(payload), (const char *[]){"--query", "cpu", NULL});
+  assert(scan_message(payload, length, &bound) == 1);
+  length = build_payload(payload, sizeof(payload), (const char *[]){"--set", "cpu", "x", "y", NULL});
+  assert(scan_message(payload, length, &bound) == 0);
+  /* Each bare token may need its own `--set cpu` header. */
+  assert(bound >= 3 * (sizeof(SET_COMMAND) + 4));
+}
+
+static void test_table_capacity(void) {
+  static BusFrame frame;
+  BusStats stats;
+  memset(&stats, 0, sizeof(stats));
+  frame_reset(&frame);
+
+  char name[32];
+  char token[32];
+  for (int i = 0; i < BUSD_MAX_PROPS + 10; i++) {
+    snprintf(name, sizeof(name), "item.%d", i % 300);
+    snprintf(token, sizeof(token), "key%d=%d", i / 300, i);
+    merge_tokens(&frame, &stats, (const char *[]){"--set", name, token, NULL});
+  }
+  frame_close_table(&frame, &stats);
+  assert(stats.props_out == BUSD_MAX_PROPS + 10);
+  assert(frame.out_length < sizeof(frame.out));
+}
+
+/* Stand-in bar: records each payload as a length-prefixed record and answers
+ * "[!]" for requests naming the item "missing". */
+static void run_upstream(int listener) {
+  static uint8_t request[BARISTA_TRANSPORT_MAX_PAYLOAD_BYTES];
+  for (;;) {
+    int client = accept(listener, NULL, NULL);
+    if (client < 0) continue;
+    size_t length = 0;
+    uint32_t flags = 0;
+    while (barista_frame_read(client, request, sizeof(request), &length, &flags, -1) == 0) {
+      FILE *record = fopen(record_path, "ab");
+      assert(record);
+      uint32_t record_length = (uint32_t)length;
+      fwrite(&record_length, sizeof(record_length), 1, record);
+      fwrite(request, 1, length, record);
+      fclose(record);
+      if (flags & BARISTA_FRAME_NO_REPLY) continue;
+      int missing = contains(request, length, "missing");
+      const char *response = missing ? "[!] Set: Item not found 'missing'" : "";
+      barista_frame_write(client, response, strlen(response) + 1, 0, -1);
+    }
+    close(client);
+  }
+}
+
+static pid_t start_child(int listener, int upstream) {
+  pid_t pid = fork();
+  assert(pid >= 0);
+  if (pid == 0) {
+    signal(SIGPIPE, SIG_IGN);
+    if (upstream) run_upstream(listener);
+    _exit(serve(bus_path, 30));
+  }
+  return pid;
+}
+
+static void stop_child(pid_t pid) {
+  kill(pid, SIGTERM);
+  for (int i = 0; i < 100; i++) {
+    if (waitpid(pid, NULL, WNOHANG) == pid) return;
+    usleep(10 * 1000);
+  }
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+}
+
+static size_t read_records(uint8_t *buffer, size_t capacity, size_t *record_count) {
+  FILE *record = fopen(record_path, "rb");
+  *record_count = 0;
+  if (!record) return 0;
+  size_t used = 0;
+  uint32_t length = 0;
+  while (fread(&length, sizeof(length), 1, record) == 1) {
+    assert(used + length <= capacity);
+    assert(fread(buffer + used, 1, length, record) == length);
+    used += length;
+    (*record_count)++;
+  }
+  fclose(record);
+  return used;
+}
+
+static void query_stats(char *text, size_t capacity) {
+  int fd = barista_socket_connect(bus_path);
+  assert(fd >= 0);
+  static const uint8_t probe[] = {0};
+  size_t length = 0;
+  assert(barista_frame_write(fd, probe, sizeof(probe), BUSD_FRAME_STATS, 500) == 0);
+  assert(barista_frame_read(fd, text, capacity - 1, &length, NULL, 500) == 0);
+  text[length] = '\0';
+  close(fd);
+}
+
+static unsigned long long stat_value(const char *text, const char *name) {
+  const char *line = strstr(text, name);
+  assert(line);
+  return strtoull(line + strlen(name) + 1, NULL, 10);
+}
+
+static BaristaSendResult send_update(const char *item, const char *token, int timeout_ms) {
+  uint8_t payload[256];
+  size_t length = build_payload(payload, sizeof(payload), (const char *[]){"--set", item, token, NULL});
+  return barista_send(payload, length, timeout_ms);
+}
+
+static void test_daemon_coalesces(void) {
+  int upstream_listener = barista_socket_listen(upstream_path);
+  assert(upstream_listener >= 0);
+  pid_t upstream = start_child(upstream_listener, 1);
+  close(upstream_listener);
+  pid_t daemon = start_child(-1, 0);
+  for (int i = 0; i < 200; i++) {
+    int fd = barista_socket_connect(bus_path);
+    if (fd >= 0) {
+      close(fd);
+      break;
+    }
+    usleep(5 * 1000);
+  }
+
+  char token[64];
+  for (int i = 0; i < 100; i++) {
+    snprintf(token, sizeof(token), "label=%d", i);
+    assert(send_update(i % 2 ? "cpu" : "network", token, 0) == BARISTA_SEND_SENT_UNCONFIRMED);
+  }
+  usleep(150 * 1000);
+
+  static uint8_t records[BARISTA_TRANSPORT_MAX_PAYLOAD_BYTES];
+  size_t record_count = 0;
+  size_t used = read_records(records, sizeof(records), &record_count);
+  assert(record_count >= 1 && record_count < 10);
+  assert(contains(records, used, "label=99"));
+  assert(contains(records, used, "label=98"));
+
+  /* A confirmed request flushes immediately and carries the bar's verdict. */
+  assert(send_update("cpu", "label=done", 1000) == BARISTA_SEND_CONFIRMED_SUCCESS);
+  assert(send_update("missing", "label=x", 1000) == BARISTA_SEND_CONFIRMED_ERROR);
+
+  char text[1024];
+  query_stats(text, sizeof(text));
+  assert(stat_value(text, "messages_in") == 102);
+  assert(stat_value(text, "replies_requested") == 2);
+  assert(stat_value(text, "props_in") == 102);
+  assert(stat_value(text, "payloads_out") == record_count + 2);
+  assert(stat_value(text, "props_out") < 102);
+
+  /* With the upstream gone, confirmed requests report NOT_SENT so callers
+   * may still fall back; the bus itself stays up. */
+  stop_child(upstream);
+  unlink(upstream_path);
+  assert(send_update("cpu", "label=late", 1000) == BARISTA_SEND_NOT_SENT);
+  query_stats(text, sizeof(text));
+  assert(stat_value(text, "upstream_failures") >= 1);
+
+  stop_child(daemon);
+  assert(access(bus_path, F_OK) != 0);
+}
+
+static void test_missing_daemon_falls_back(void) {
+  barista_transport_reset();
+  int upstream_listener = barista_socket_listen(upstream_path);
+  assert(upstream_listener >= 0);
+  pid_t upstream = start_child(upstream_listener, 1);
+  close(upstream_listener);
+  assert(send_update("cpu", "label=direct", 1000) == BARISTA_SEND_CONFIRMED_SUCCESS);
+  stop_child(upstream);
+}
+
+int main(void) {
+  signal(SIGPIPE, SIG_IGN);
+  const char *tmpdir = getenv("TMPDIR");
+  if (!tmpdir || tmpdir[0] == '\0') tmpdir = "/tmp";
+  snprintf(upstream_path, sizeof(upstream_path), "%s/upstream.%ld.sock", tmpdir, (long)getpid());
+  snprintf(bus_path, sizeof(bus_path), "%s/busd.%ld.sock", tmpdir, (long)getpid());
+  snprintf(record_path, sizeof(record_path), "%s/upstream.%ld.records", tmpdir, (long)getpid());
+  setenv("BARISTA_TRANSPORT_SOCKET", upstream_path, 1);
+  setenv("BARISTA_BUSD_SOCKET", bus_path, 1);
+  unsetenv("BARISTA_BUSD_DISABLE");
+
+  test_latest_value_wins();
+  test_barriers_keep_order();
+  test_toggles_are_not_merged();
+  test_isolated_commands();
+  test_table_capacity();
+  test_daemon_coalesces();
+  test_missing_daemon_falls_back();
+
+  unlink(record_path);
+  puts("test_barista_busd.c: ok");
+  return 0;
+}
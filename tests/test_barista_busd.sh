@@ -0,0 +1,21 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "$TMP_DIR"' EXIT
+
+"${CC:-cc}" -std=c99 -Wall -Wextra -Werror -I"$ROOT_DIR/helpers" \
+  "$ROOT_DIR/tests/test_barista_busd.c" "$ROOT_DIR/helpers/barista_transport.c" \
+  -o "$TMP_DIR/test_barista_busd"
+TMPDIR="$TMP_DIR" "$TMP_DIR/test_barista_busd"
+
+"${CC:-cc}" -std=c99 -Wall -Wextra -Werror \
+  "$ROOT_DIR/helpers/barista_busd.c" "$ROOT_DIR/helpers/barista_transport.c" \
+  -o "$TMP_DIR/barista_busd"
+if "$TMP_DIR/barista_busd" stats --socket "$TMP_DIR/absent.sock" 2>/dev/null; then
+  echo "FAIL: stats must fail without a running daemon" >&2
+  exit 1
+fi
+
+printf '%s\n' "barista_busd tests passed"
@@ -0,0 +1,254 @@
+#define _DEFAULT_SOURCE 1
+
+#include "../helpers/barista_cpu_sample.c"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static char sample_path[600];
+
+static int near(double value, double expected) {
+  return fabs(value - expected) < 1e-9;
+}
+
+static BaristaCpuTicks make_ticks(uint64_t user, uint64_t nice, uint64_t system, uint64_t idle,
+                                  uint32_t bits, uint64_t boot_time) {
+  BaristaCpuTicks ticks = {{user, nice, system, idle}, bits, boot_time};
+  return ticks;
+}
+
+static void test_busy_percent(void) {
+  double percent = -1.0;
+  BaristaCpuTicks before = make_ticks(1000, 0, 500, 8500, 64, 1700000000);
+  BaristaCpuTicks after = make_ticks(1300, 0, 600, 8600, 64, 1700000000);
+  assert(barista_cpu_ticks_busy_percent(&before, &after, 1, &percent));
+  assert(near(percent, 80.0));
+
+  /* Fewer ticks than asked for, or none at all. */
+  assert(!barista_cpu_ticks_busy_percent(&before, &after, 501, &percent));
+  assert(!barista_cpu_ticks_busy_percent(&before, &before, 0, &percent));
+
+  /* Another boot, another width, or 64-bit counters going backwards. */
+  BaristaCpuTicks rebooted = after;
+  rebooted.boot_time++;
+  assert(!barista_cpu_ticks_busy_percent(&before, &rebooted, 1, &percent));
+  BaristaCpuTicks narrow = after;
+  narrow.counter_bits = 32;
+  assert(!barista_cpu_ticks_busy_percent(&before, &narrow, 1, &percent));
+  assert(!barista_cpu_ticks_busy_percent(&after, &before, 1, &percent));
+}
+
+/* macOS counters are 32 bits summed over every core; a wrap between runs
+ * must still give the right delta. */
+static void test_wraparound(void) {
+  double percent = -1.0;
+  BaristaCpuTicks before = make_ticks(0xffffff00u, 10, 0xfffffff0u, 0xffffffffu, 32, 42);
+  BaristaCpuTicks after = make_ticks(0x100u, 10, 0x10u, 0x3ffu, 32, 42);
+  /* user +512, system +32, idle +1024 */
+  assert(barista_cpu_ticks_busy_percent(&before, &after, 1, &percent));
+  assert(near(percent, 544.0 * 100.0 / 1568.0));
+
+  /* Only the state that wrapped wraps. */
+  before = make_ticks(100, 0, 100, 0xfffffffeu, 32, 42);
+  after = make_ticks(150, 0, 150, 98, 32, 42);
+  assert(barista_cpu_ticks_busy_percent(&before, &after, 1, &percent));
+  assert(near(percent, 50.0));
+
+  /* The same subtraction on 64-bit counters is a reset, not a wrap. */
+  before.counter_bits = after.counter_bits = 64;
+  assert(!barista_cpu_ticks_busy_percent(&before, &after, 1, &percent));
+  before = make_ticks(UINT64_MAX - 5, 0, 0, UINT64_MAX - 5, 64, 42);
+  after = make_ticks(UINT64_MAX, 0, 0, UINT64_MAX, 64, 42);
+  assert(barista_cpu_ticks_busy_percent(&before, &after, 1, &percent) && near(percent, 50.0));
+}
+
+static void test_update(void) {
+  double percent = -1.0;
+  unlink(sample_path);
+  BaristaCpuTicks first = make_ticks(1000, 0, 0, 1000, 32, 7);
+  /* First run of a boot: nothing to compare with. */
+  assert(!barista_cpu_sample_update(sample_path, &first, &percent));
+
+  BaristaCpuTicks second = make_ticks(1150, 0, 0, 1050, 32, 7);
+  assert(barista_cpu_sample_update(sample_path, &second, &percent) && near(percent, 75.0));
+
+  /* Too close to the baseline: repeat the last value, keep the baseline. */
+  BaristaCpuTicks close = make_ticks(1160, 0, 0, 1080, 32, 7);
+  assert(barista_cpu_sample_update(sample_path, &close, &percent) && near(percent, 75.0));
+  BaristaCpuTicks third = make_ticks(1175, 0, 0, 1125, 32, 7);
+  assert(barista_cpu_sample_update(sample_path, &third, &percent) && near(percent, 25.0));
+
+  /* Counters that wrapped since the last run. */
+  BaristaCpuTicks high = make_ticks(0xffffffc0u, 0, 0, 0xffffffc0u, 32, 7);
+  assert(barista_cpu_sample_update(sample_path, &high, &percent));
+  BaristaCpuTicks wrapped = make_ticks(0x40u, 0, 0, 0x80u, 32, 7);
+  assert(barista_cpu_sample_update(sample_path, &wrapped, &percent));
+  assert(near(percent, 128.0 * 100.0 / 320.0));
+
+  /* A reboot starts over instead of diffing unrelated counters. */
+  BaristaCpuTicks rebooted = make_ticks(500, 0, 0, 500, 32, 8);
+  assert(!barista_cpu_sample_update(sample_path, &rebooted, &percent));
+  BaristaCpuTicks later = make_ticks(600, 0, 0, 600, 32, 8);
+  assert(barista_cpu_sample_update(sample_path, &later, &percent) && near(percent, 50.0));
+
+  /* A record stuck mid-write by a run that died is taken over. */
+  CpuSampleFile *file = cpu_sample_map(sample_path);
+  assert(file);
+  file->sequence |= 1;
+  BaristaCpuTicks recovered = make_ticks(700, 0, 0, 700, 32, 8);
+  assert(!barista_cpu_sample_update(sample_path, &recovered, &percent));
+  assert((file->sequence & 1) == 0);
+  munmap(file, sizeof(*file));
+  BaristaCpuTicks after_recovery = make_ticks(800, 0, 0, 900, 32, 8);
+  assert(barista_cpu_sample_update(sample_path, &after_recovery, &percent));
+  assert(near(percent, 100.0 / 3.0));
+
+  /* A file that is not a sample record is left alone. */
+  FILE *foreign = fopen(sample_path, "w");
+  assert(foreign && fputs("not a sample record, but long enough to map", foreign) >= 0);
+  fclose(foreign);
+  assert(!barista_cpu_sample_update(sample_path, &later, &percent));
+  unlink(sample_path);
+}
+
+/* Runs racing on one record must never see a mix of two samples: every
+ * writer stores counters whose busy share is exactly 25%. */
+static void test_concurrent_runs(void) {
+  enum { WRITERS = 4, ROUNDS = 20000 };
+  unlink(sample_path);
+  pid_t children[WRITERS];
+  for (int w = 0; w < WRITERS; w++) {
+    children[w] = fork();
+    assert(children[w] >= 0);
+    if (children[w] == 0) {
+      alarm(30);
+      for (uint64_t round = 1; round <= ROUNDS; round++) {
+        uint64_t base = round * 1000 + (uint64_t)w * 400;
+        BaristaCpuTicks ticks = make_ticks(base, 0, 0, base * 3, 64, 9);
+        double percent = 0.0;
+        if (barista_cpu_sample_update(sample_path, &ticks, &percent) && !near(percent, 25.0)) {
+          _exit(2);
+        }
+      }
+      _exit(0);
+    }
+  }
+  for (int w = 0; w < WRITERS; w++) {
+    int status = 0;
+    assert(waitpid(children[w], &status, 0) == children[w]);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+  unlink(sample_path);
+}
+
+#ifndef __APPLE__
+/* Scans `text` as /proc/stat, through a file like the real one. */
+static int scan_text(const char *text, size_t length, BaristaCpuTicks *ticks) {
+  char path[640];
+  snprintf(path, sizeof(path), "%s.stat", sample_path);
+  FILE *file = fopen(path, "wb");
+  assert(file && fwrite(text, 1, length, file) == length);
+  fclose(file);
+  struct proc_file *stat_file = malloc(sizeof(*stat_file));
+  assert(stat_file && proc_file_open(stat_file, path) == 0);
+  int scanned = scan_proc_stat(stat_file, ticks);
+  proc_file_close(stat_file);
+  free(stat_file);
+  unlink(path);
+  return scanned;
+}
+
+static int scan_string(const char *text, BaristaCpuTicks *ticks) {
+  return scan_text(text, strlen(text), ticks);
+}
+
+static void test_scan_proc_stat(void) {
+  BaristaCpuTicks ticks;
+  const char *text =
+      "cpu  100 5 50 800 20 3 2 1 0 0\n"
+      "cpu0 50 2 25 400 10 1 1 0 0 0\n"
+      "intr 12345 0 0 0\n"
+      "ctxt 999\n"
+      "btime 1700000123\n"
+      "processes 42\n";
+  assert(scan_string(text, &ticks));
+  assert(ticks.ticks[BARISTA_CPU_USER] == 100 && ticks.ticks[BARISTA_CPU_NICE] == 5);
+  assert(ticks.ticks[BARISTA_CPU_SYSTEM] == 56 && ticks.ticks[BARISTA_CPU_IDLE] == 820);
+  assert(ticks.counter_bits == 64 && ticks.boot_time == 1700000123);
+  /* Old kernels report only four columns. */
+  assert(scan_string("cpu 1 2 3 4\nbtime 5\n", &ticks) && ticks.ticks[BARISTA_CPU_IDLE] == 4);
+  assert(scan_string("cpu 1 2 3 4\nbtime 5", &ticks) && ticks.boot_time == 5);
+  assert(!scan_string("cpu 1 2 3 4\n", &ticks));
+  assert(!scan_string("btime 5\ncpu0 1 2 3 4\n", &ticks));
+  assert(!scan_string("cpu 1 2 3\nbtime 5\n", &ticks));
+
+  /* `btime` past the scanner's buffer, behind an interrupt row longer than
+   * it, and with a window edge falling inside a later row. */
+  for (size_t padding = 0; padding < 64; padding += 7) {
+    size_t capacity = PROC_FILE_BYTES * 4;
+    char *large = malloc(capacity);
+    assert(large);
+    size_t used = (size_t)snprintf(large, capacity, "cpu  7 1 2 90 0 0 0 0\nintr 1");
+    while (used < PROC_FILE_BYTES * 2 + padding) used += (size_t)snprintf(large + used, capacity - used, " 0");
+    used += (size_t)snprintf(large + used, capacity - used, "\nctxt 1\n");
+    while (used < PROC_FILE_BYTES * 3 - 8 + padding) {
+      used += (size_t)snprintf(large + used, capacity - used, "softirq 1 2 3\n");
+    }
+    used += (size_t)snprintf(large + used, capacity - used, "btime 1700000456\nprocesses 1\n");
+    assert(scan_text(large, used, &ticks));
+    assert(ticks.boot_time == 1700000456 && ticks.ticks[BARISTA_CPU_IDLE] == 90);
+    free(large);
+  }
+}
+#endif
+
+static void test_live(void) {
+  BaristaCpuTicks before;
+  BaristaCpuTicks after;
+  assert(barista_cpu_ticks_read(&before));
+  assert(before.boot_time > 0);
+  usleep(50000);
+  assert(barista_cpu_ticks_read(&after));
+  assert(after.boot_time == before.boot_time);
+  double percent = -1.0;
+  if (barista_cpu_ticks_busy_percent(&before, &after, 1, &percent)) {
+    assert(percent >= 0.0 && percent <= 100.0);
+  }
+}
+
+static void test_path(void) {
+  char buffer[1024];
+  assert(barista_cpu_sample_path(buffer, sizeof(buffer)));
+  assert(strstr(buffer, "/barista_cpu_sample.sketchybar") != NULL);
+  setenv("BAR_NAME", "work", 1);
+  assert(barista_cpu_sample_path(buffer, sizeof(buffer)));
+  assert(strstr(buffer, "/barista_cpu_sample.work") != NULL);
+  setenv("BAR_NAME", "a/b", 1);
+  assert(!barista_cpu_sample_path(buffer, sizeof(buffer)));
+  unsetenv("BAR_NAME");
+  assert(!barista_cpu_sample_path(buffer, 8));
+}
+
+int main(void) {
+  const char *tmpdir = getenv("TMPDIR");
+  snprintf(sample_path, sizeof(sample_path), "%s/barista_cpu_sample.test",
+           tmpdir ? tmpdir : "/tmp");
+
+  test_busy_percent();
+  test_wraparound();
+  test_update();
+  test_concurrent_runs();
+#ifndef __APPLE__
+  test_scan_proc_stat();
+#endif
+  test_live();
+  test_path();
+
+  puts("test_barista_cpu_sample.c: ok");
+  return 0;
+}
@@ -0,0 +1,200 @@
+#define _DEFAULT_SOURCE 1
+
+#include "../helpers/barista_executor.c"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+  int value;
+  useconds_t sleep_us;
+} ProbeArgument;
+
+typedef struct {
+  int value;
+  int seen_zeroed;
+} ProbeResult;
+
+static pthread_mutex_t g_count_lock = PTHREAD_MUTEX_INITIALIZER;
+static int g_started = 0;
+static int g_completed = 0;
+
+static void sleepy_probe(const void *argument, void *result) {
+  const ProbeArgument *input = argument;
+  ProbeResult *output = result;
+  pthread_mutex_lock(&g_count_lock);
+  g_started++;
+  pthread_mutex_unlock(&g_count_lock);
+  output->seen_zeroed = output->value == 0;
+  if (input->sleep_us) usleep(input->sleep_us);
+  output->value = input->value;
+  pthread_mutex_lock(&g_count_lock);
+  g_completed++;
+  pthread_mutex_unlock(&g_count_lock);
+}
+
+static void reset_counts(void) {
+  pthread_mutex_lock(&g_count_lock);
+  g_started = 0;
+  g_completed = 0;
+  pthread_mutex_unlock(&g_count_lock);
+}
+
+static int completed(void) {
+  pthread_mutex_lock(&g_count_lock);
+  int value = g_completed;
+  pthread_mutex_unlock(&g_count_lock);
+  return value;
+}
+
+static void set_task(BaristaProbeTask *task, const ProbeArgument *argument, ProbeResult *result) {
+  memset(task, 0, sizeof(*task));
+  task->run = sleepy_probe;
+  task->argument = argument;
+  task->result = result;
+  task->result_bytes = sizeof(*result);
+}
+
+static int64_t elapsed_ms_since(int64_t start_us) {
+  return (monotonic_microseconds() - start_us) / 1000;
+}
+
+/* Probes run side by side: four 100 ms probes take about 100 ms. */
+static void test_concurrent(void) {
+  static const ProbeArgument arguments[4] = {{1, 100000}, {2, 100000}, {3, 100000}, {4, 100000}};
+  BaristaExecutor *executor = barista_executor_create(4);
+  assert(executor);
+  BaristaProbeTask tasks[4];
+  ProbeResult results[4];
+  for (int index = 0; index < 4; index++) {
+    results[index].value = -1;
+    set_task(&tasks[index], &arguments[index], &results[index]);
+  }
+  int64_t start = monotonic_microseconds();
+  assert(barista_executor_run(executor, tasks, 4, 2000) == 4);
+  assert(elapsed_ms_since(start) < 350);
+  for (int index = 0; index < 4; index++) {
+    assert(tasks[index].finished && results[index].value == index + 1);
+    assert(results[index].seen_zeroed);
+    assert(tasks[index].elapsed_us >= 90000);
+  }
+  barista_executor_destroy(executor);
+}
+
+/* One hung probe costs its own result, not the batch. */
+static void test_deadline(void) {
+  static const ProbeArgument fast = {7, 0};
+  static const ProbeArgument hung = {8, 400000};
+  reset_counts();
+  BaristaExecutor *executor = barista_executor_create(2);
+  assert(executor);
+  BaristaProbeTask tasks[2];
+  ProbeResult results[2] = {{-1, 0}, {-1, 0}};
+  set_task(&tasks[0], &fast, &results[0]);
+  set_task(&tasks[1], &hung, &results[1]);
+  int64_t start = monotonic_microseconds();
+  assert(barista_executor_run(executor, tasks, 2, 50) == 1);
+  int64_t waited = elapsed_ms_since(start);
+  assert(waited >= 45 && waited < 250);
+  assert(tasks[0].finished && results[0].value == 7);
+  assert(!tasks[1].finished && results[1].value == -1);
+  assert(tasks[1].elapsed_us >= 40000 && tasks[1].elapsed_us < 400000);
+
+  /* The late probe still owns its worker, and its scratch outlives the
+   * batch: the next batch shares the other worker and the late one lands
+   * in memory nobody reads. */
+  BaristaProbeTask next;
+  ProbeResult next_result = {-1, 0};
+  set_task(&next, &fast, &next_result);
+  assert(barista_executor_run(executor, &next, 1, 200) == 1 && next_result.value == 7);
+  barista_executor_destroy(executor);
+  assert(completed() == 3);
+  assert(results[1].value == -1);
+}
+
+/* A batch that gave up skips whatever never started. */
+static void test_abandoned_queue(void) {
+  static const ProbeArgument slow = {1, 150000};
+  static const ProbeArgument queued = {2, 0};
+  reset_counts();
+  BaristaExecutor *executor = barista_executor_create(1);
+  assert(executor);
+  BaristaProbeTask tasks[3];
+  ProbeResult results[3];
+  set_task(&tasks[0], &slow, &results[0]);
+  set_task(&tasks[1], &queued, &results[1]);
+  set_task(&tasks[2], &queued, &results[2]);
+  assert(barista_executor_run(executor, tasks, 3, 20) == 0);
+  assert(tasks[0].elapsed_us > 0 && tasks[1].elapsed_us == 0 && tasks[2].elapsed_us == 0);
+  barista_executor_destroy(executor);
+  assert(g_started == 1 && completed() == 1);
+}
+
+/* Batches from several threads share the workers. */
+typedef struct {
+  BaristaExecutor *executor;
+  int failures;
+} SharedRun;
+
+static void *run_batches(void *context) {
+  static const ProbeArgument arguments[3] = {{10, 0}, {20, 1000}, {30, 0}};
+  SharedRun *run = context;
+  for (int round = 0; round < 200; round++) {
+    BaristaProbeTask tasks[3];
+    ProbeResult results[3];
+    for (int index = 0; index < 3; index++) set_task(&tasks[index], &arguments[index], &results[index]);
+    if (barista_executor_run(run->executor, tasks, 3, -1) != 3
+        || results[0].value != 10 || results[1].value != 20 || results[2].value != 30) {
+      run->failures++;
+    }
+  }
+  return NULL;
+}
+
+static void test_shared(void) {
+  BaristaExecutor *executor = barista_executor_create(3);
+  assert(executor);
+  SharedRun runs[4];
+  pthread_t threads[4];
+  for (int index = 0; index < 4; index++) {
+    runs[index].executor = executor;
+    runs[index].failures = 0;
+    assert(pthread_create(&threads[index], NULL, run_batches, &runs[index]) == 0);
+  }
+  for (int index = 0; index < 4; index++) {
+    assert(pthread_join(threads[index], NULL) == 0);
+    assert(runs[index].failures == 0);
+  }
+  barista_executor_destroy(executor);
+}
+
+/* Without an executor the probes run inline, with no deadline. */
+static void test_inline(void) {
+  static const ProbeArgument argument = {5, 20000};
+  BaristaProbeTask task;
+  ProbeResult result = {-1, 0};
+  set_task(&task, &argument, &result);
+  assert(barista_executor_run(NULL, &task, 1, 1) == 1);
+  assert(task.finished && result.value == 5 && result.seen_zeroed);
+  assert(task.elapsed_us >= 15000);
+  assert(barista_executor_run(NULL, NULL, 1, 1) == 0);
+
+  BaristaExecutor *clamped = barista_executor_create(BARISTA_EXECUTOR_MAX_THREADS + 10);
+  assert(clamped && clamped->thread_count == BARISTA_EXECUTOR_MAX_THREADS);
+  barista_executor_destroy(clamped);
+  barista_executor_destroy(NULL);
+}
+
+int main(void) {
+  test_concurrent();
+  test_deadline();
+  test_abandoned_queue();
+  test_shared();
+  test_inline();
+
+  puts("test_barista_executor.c: ok");
+  return 0;
+}
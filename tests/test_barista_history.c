@@ -0,0 +1,172 @@
+#define _DEFAULT_SOURCE 1
+
+#include "../helpers/barista_history.c"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const char *const field_names[] = {"first", "second", "third"};
+
+/* Every value is derived from the sample's sequence, so a torn read shows up
+ * as a mismatch. */
+static void fill(double *values, uint64_t sequence) {
+  values[0] = (double)sequence;
+  values[1] = (double)sequence * 2.0;
+  values[2] = (double)sequence * 3.0 + 0.5;
+}
+
+static void assert_sample(const BaristaHistorySample *sample) {
+  double expected[3];
+  fill(expected, sample->sequence);
+  assert(memcmp(sample->values, expected, sizeof(expected)) == 0);
+  assert(sample->timestamp_ns == sample->sequence * 1000);
+}
+
+static void test_path(void) {
+  char buffer[512];
+  assert(barista_history_path("cpu_update", buffer, sizeof(buffer)));
+  assert(strstr(buffer, "/barista_history.sketchybar.cpu_update") != NULL);
+  assert(!barista_history_path("cpu_update", buffer, 8));
+  assert(!barista_history_path("../escape", buffer, sizeof(buffer)));
+  assert(!barista_history_path("a/b", buffer, sizeof(buffer)));
+  assert(!barista_history_path("", buffer, sizeof(buffer)));
+  setenv("BAR_NAME", "work", 1);
+  assert(barista_history_path("metrics.cpu", buffer, sizeof(buffer)));
+  assert(strstr(buffer, "/barista_history.work.metrics.cpu") != NULL);
+  unsetenv("BAR_NAME");
+}
+
+static void test_append_and_wrap(void) {
+  assert(!barista_history_create("ring", 0, 3, field_names));
+  assert(!barista_history_create("ring", 8, BARISTA_HISTORY_MAX_FIELDS + 1, field_names));
+  assert(!barista_history_open("missing"));
+
+  BaristaHistory *writer = barista_history_create("ring", 5, 3, field_names);
+  assert(writer);
+  assert(barista_history_capacity(writer) == 8);
+  BaristaHistory *reader = barista_history_open("ring");
+  assert(reader && barista_history_field_count(reader) == 3);
+  assert(strcmp(barista_history_field_name(reader, 2), "third") == 0);
+  assert(!barista_history_field_name(reader, 3));
+  assert(barista_history_field_index(reader, "second") == 1);
+  assert(barista_history_field_index(reader, "fourth") == -1);
+
+  BaristaHistorySample samples[16];
+  assert(barista_history_read(reader, 0, samples, 16) == 0);
+  double values[3];
+  for (uint64_t i = 0; i < 5; i++) {
+    fill(values, i);
+    barista_history_append(writer, i * 1000, values);
+  }
+  assert(barista_history_read(reader, 0, samples, 16) == 5);
+  for (int i = 0; i < 5; i++) {
+    assert(samples[i].sequence == (uint64_t)i);
+    assert_sample(&samples[i]);
+  }
+  /* Unused fields read as zero. */
+  assert(samples[0].values[3] == 0.0);
+
+  /* Once full, only the newest `capacity` samples remain. */
+  for (uint64_t i = 5; i < 21; i++) {
+    fill(values, i);
+    barista_history_append(writer, i * 1000, values);
+  }
+  assert(barista_history_count(reader) == 21);
+  assert(barista_history_read(reader, 0, samples, 16) == 8);
+  assert(samples[0].sequence == 13 && samples[7].sequence == 20);
+  for (int i = 0; i < 8; i++) assert_sample(&samples[i]);
+
+  /* `since` polls incrementally; `max` keeps the newest. */
+  assert(barista_history_read(reader, 19, samples, 16) == 2 && samples[0].sequence == 19);
+  assert(barista_history_read(reader, 21, samples, 16) == 0);
+  assert(barista_history_read(reader, 0, samples, 3) == 3 && samples[0].sequence == 18);
+
+  /* A restarted writer replaces the file; the old reader notices. */
+  assert(!barista_history_stale(reader));
+  BaristaHistory *restarted = barista_history_create("ring", 8, 3, field_names);
+  assert(restarted && barista_history_stale(reader));
+  barista_history_close(reader);
+  reader = barista_history_open("ring");
+  assert(reader && barista_history_count(reader) == 0);
+
+  barista_history_append(NULL, 0, values);
+  barista_history_close(reader);
+  barista_history_close(restarted);
+  barista_history_close(writer);
+}
+
+/* One writer laps a small ring as fast as it can while forked readers poll
+ * it; no reader may ever return a torn or out-of-order sample. */
+static void test_concurrent_readers(void) {
+  enum { READERS = 4, SAMPLES = 400000 };
+  BaristaHistory *writer = barista_history_create("race", 16, 3, field_names);
+  assert(writer);
+  int ready[2];
+  assert(pipe(ready) == 0);
+  pid_t readers[READERS];
+  for (int r = 0; r < READERS; r++) {
+    readers[r] = fork();
+    assert(readers[r] >= 0);
+    if (readers[r] == 0) {
+      alarm(30);
+      BaristaHistory *reader = barista_history_open("race");
+      if (!reader || write(ready[1], "r", 1) != 1) _exit(1);
+      BaristaHistorySample samples[16];
+      uint64_t reads = 0;
+      uint64_t head = 0;
+      while (head < SAMPLES) {
+        head = barista_history_count(reader);
+        size_t count = barista_history_read(reader, 0, samples, 16);
+        for (size_t i = 0; i < count; i++) {
+          double expected[3];
+          fill(expected, samples[i].sequence);
+          if (memcmp(samples[i].values, expected, sizeof(expected)) != 0) _exit(2);
+          if (samples[i].timestamp_ns != samples[i].sequence * 1000) _exit(2);
+          if (i > 0 && samples[i].sequence <= samples[i - 1].sequence) _exit(3);
+        }
+        reads += count;
+      }
+      barista_history_close(reader);
+      _exit(reads > 0 ? 0 : 4);
+    }
+  }
+
+  char byte;
+  for (int r = 0; r < READERS; r++) assert(read(ready[0], &byte, 1) == 1);
+  close(ready[0]);
+  close(ready[1]);
+  double values[3];
+  for (uint64_t i = 0; i < SAMPLES; i++) {
+    fill(values, i);
+    barista_history_append(writer, i * 1000, values);
+  }
+  for (int r = 0; r < READERS; r++) {
+    int status = 0;
+    assert(waitpid(readers[r], &status, 0) == readers[r]);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+  barista_history_close(writer);
+}
+
+/* Leaves a small ring behind for the CLI checks in the shell test. */
+static void write_fixture(void) {
+  const char *names[] = {"total_load", "upload"};
+  BaristaHistory *writer = barista_history_create("fixture", 8, 2, names);
+  assert(writer);
+  double values[][2] = {{0, 100}, {25, 200}, {50, 300}, {100, 400}};
+  for (uint64_t i = 0; i < 4; i++) barista_history_append(writer, (i + 1) * 1000000, values[i]);
+  barista_history_close(writer);
+}
+
+int main(void) {
+  test_path();
+  test_append_and_wrap();
+  test_concurrent_readers();
+  write_fixture();
+  puts("test_barista_history.c: ok");
+  return 0;
+}
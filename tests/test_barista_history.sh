@@ -0,0 +1,53 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "$TMP_DIR"' EXIT
+
+CC_BIN="${CC:-cc}"
+"$CC_BIN" -std=c99 -Wall -Wextra -Werror \
+  "$ROOT_DIR/tests/test_barista_history.c" -o "$TMP_DIR/test_barista_history"
+"$CC_BIN" -std=c99 -Wall -Wextra -Werror \
+  "$ROOT_DIR/helpers/barista_history_dump.c" "$ROOT_DIR/helpers/barista_history.c" \
+  -o "$TMP_DIR/barista_history_dump"
+
+export BARISTA_HISTORY_DIR="$TMP_DIR"
+TMPDIR="$TMP_DIR" "$TMP_DIR/test_barista_history" >/dev/null
+DUMP="$TMP_DIR/barista_history_dump"
+
+expect_output() {
+  local expected="$1"
+  shift
+  local actual
+  actual="$("$@")"
+  if [[ "$actual" != "$expected" ]]; then
+    printf 'FAIL: %s\nexpected: %s\nactual:   %s\n' "$*" "$expected" "$actual" >&2
+    exit 1
+  fi
+}
+
+expect_output $'sequence\ttimestamp_ms\ttotal_load\tupload\n2\t3\t50\t300\n3\t4\t100\t400' \
+  "$DUMP" fixture --last 2
+expect_output "0.000 0.250 0.500 1.000" "$DUMP" fixture --format push --field total_load
+expect_output "0.250 0.500 0.750 1.000" "$DUMP" fixture --format push --field upload
+expect_output "0.125 0.250 0.500" "$DUMP" fixture --format push --max 200 --last 3
+expect_output "▁▃▅█" "$DUMP" fixture --format spark
+# The fixture's timestamps are in 1970, so a time window keeps nothing.
+expect_output "" "$DUMP" fixture --format push --seconds 60
+
+if "$DUMP" fixture --field missing >/dev/null 2>&1; then
+  echo "FAIL: unknown field accepted" >&2
+  exit 1
+fi
+if "$DUMP" absent >/dev/null 2>&1; then
+  echo "FAIL: missing series accepted" >&2
+  exit 1
+fi
+set +e
+"$DUMP" fixture --format csv >/dev/null 2>&1
+status=$?
+set -e
+[[ "$status" -eq 2 ]] || { echo "FAIL: bad format exit $status" >&2; exit 1; }
+
+printf '%s\n' "barista_history tests passed"
@@ -0,0 +1,590 @@
+#define _DEFAULT_SOURCE 1
+
+#include "../helpers/barista_json.c"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef enum { SHAPE_ROUND, SHAPE_SQUARE } Shape;
+
+typedef struct {
+  char name[8];
+  int size;
+} Part;
+
+typedef struct {
+  char label[16];
+  int count;
+  float scale;
+  int enabled;
+  uint32_t color;
+  Shape shape;
+  struct {
+    int depth;
+    char note[8];
+  } inner;
+  Part parts[3];
+  int part_count;
+  char canary[8];
+  /* filled by record_entry */
+  int entry_resets;
+  int entry_count;
+  char entry_keys[4][16];
+  BaristaJsonValueType entry_types[4];
+  int entry_flags[4];
+} Sample;
+
+static const char *const kShapes[] = {"round", "square", NULL};
+
+static const BaristaJsonField kInnerFields[] = {
+  {.key = "depth", .type = BARISTA_JSON_INT, .offset = 0, .size = sizeof(int)},
+  {.key = "note", .type = BARISTA_JSON_STRING, .offset = sizeof(int), .size = 8},
+  {.key = NULL},
+};
+
+static const BaristaJsonField kPartFields[] = {
+  {.key = "name", .type = BARISTA_JSON_STRING, BARISTA_JSON_MEMBER(Part, name)},
+  {.key = "size", .type = BARISTA_JSON_INT, BARISTA_JSON_MEMBER(Part, size)},
+  {.key = NULL},
+};
+
+static void record_entry(void *object, const char *key, const BaristaJsonValue *value) {
+  Sample *sample = object;
+  if (!key) {
+    sample->entry_resets++;
+    sample->entry_count = 0;
+    return;
+  }
+  if (sample->entry_count >= 4) return;
+  int index = sample->entry_count++;
+  snprintf(sample->entry_keys[index], sizeof(sample->entry_keys[index]), "%s", key);
+  sample->entry_types[index] = value->type;
+  sample->entry_flags[index] = value->type == BARISTA_JSON_VALUE_BOOL ? value->boolean
+                               : value->type == BARISTA_JSON_VALUE_NUMBER ? (int)value->number
+                               : value->type == BARISTA_JSON_VALUE_STRING ? (int)value->length
+                               : -1;
+}
+
+static const BaristaJsonField kSampleFields[] = {
+  {.key = "label", .type = BARISTA_JSON_STRING, BARISTA_JSON_MEMBER(Sample, label)},
+  {.key = "count", .type = BARISTA_JSON_INT, BARISTA_JSON_MEMBER(Sample, count)},
+  {.key = "scale", .type = BARISTA_JSON_FLOAT, BARISTA_JSON_MEMBER(Sample, scale)},
+  {.key = "enabled", .type = BARISTA_JSON_BOOL, BARISTA_JSON_MEMBER(Sample, enabled)},
+  {.key = "color", .type = BARISTA_JSON_COLOR, BARISTA_JSON_MEMBER(Sample, color)},
+  {.key = "shape", .type = BARISTA_JSON_ENUM, BARISTA_JSON_MEMBER(Sample, shape), .choices = kShapes},
+  {.key = "inner", .type = BARISTA_JSON_OBJECT, BARISTA_JSON_MEMBER(Sample, inner), .fields = kInnerFields},
+  {.key = "parts", .type = BARISTA_JSON_ARRAY, .offset = offsetof(Sample, parts), .size = sizeof(Part),
+   .fields = kPartFields, .capacity = 3, .count_offset = offsetof(Sample, part_count)},
+  {.key = "entries", .type = BARISTA_JSON_ENTRIES, .offset = 0, .entry = record_entry},
+  {.key = NULL},
+};
+
+static const BaristaJsonField kSampleRoot = {.type = BARISTA_JSON_OBJECT, .offset = 0, .fields = kSampleFields};
+
+static int decode(const char *text, Sample *sample, size_t *error_offset) {
+  return barista_json_decode(text, strlen(text), &kSampleRoot, sample, error_offset);
+}
+
+static void test_fields(void) {
+  Sample sample;
+  memset(&sample, 0, sizeof(sample));
+  const char *text =
+    "\xEF\xBB\xBF{\n"
+    "  \"label\": \"caf\\u00e9 \\ud83d\\ude00\\/\\\"\\t\",\n"
+    "  \"count\": -42.9, \"scale\": 1.5e1, \"enabled\": true,\n"
+    "  \"color\": \"0xC021162F\", \"shape\": \"square\",\n"
+    "  \"inner\": {\"depth\": 3, \"note\": \"hi\", \"extra\": [1, {\"depth\": 9}]},\n"
+    "  \"parts\": [{\"name\": \"a\", \"size\": 1}, 7, {\"size\": 2, \"more\": {}}, {\"name\": \"c\"}, {\"name\": \"d\"}]\n"
+    "}\n";
+  assert(decode(text, &sample, NULL) == 1);
+  assert(strcmp(sample.label, "caf\xC3\xA9 \xF0\x9F\x98\x80/\"\t") == 0);
+  assert(sample.count == -42 && sample.scale == 15.0f && sample.enabled == 1);
+  assert(sample.color == 0xC021162Fu && sample.shape == SHAPE_SQUARE);
+  assert(sample.inner.depth == 3 && strcmp(sample.inner.note, "hi") == 0);
+  /* Non-objects are skipped; elements past capacity are dropped. */
+  assert(sample.part_count == 3);
+  assert(strcmp(sample.parts[0].name, "a") == 0 && sample.parts[0].size == 1);
+  assert(sample.parts[1].name[0] == '\0' && sample.parts[1].size == 2);
+  assert(strcmp(sample.parts[2].name, "c") == 0 && sample.parts[2].size == 0);
+
+  memset(&sample, 0, sizeof(sample));
+  assert(decode("{\"color\": 4278190080, \"label\": \"\\ud800x\"}", &sample, NULL) == 1);
+  assert(sample.color == 0xFF000000u);
+  assert(strcmp(sample.label, "\xEF\xBF\xBDx") == 0);
+}
+
+/* Keys only match at their own level, and only as keys. */
+static void test_scoping(void) {
+  Sample sample;
+  memset(&sample, 0, sizeof(sample));
+  const char *text =
+    "{\"other\": {\"count\": 1, \"label\": \"nested\"},"
+    " \"list\": [{\"count\": 2}, \"count\", [\"label\"]],"
+    " \"note\": \"\\\"count\\\": 3\","
+    " \"inner\": {\"count\": 4}}";
+  assert(decode(text, &sample, NULL) == 1);
+  assert(sample.count == 0 && sample.label[0] == '\0' && sample.inner.depth == 0);
+}
+
+/* Values that do not fit, or have the wrong type, leave the field alone. */
+static void test_dropped_values(void) {
+  Sample sample;
+  memset(&sample, 0, sizeof(sample));
+  strcpy(sample.label, "keep");
+  strcpy(sample.canary, "canary");
+  sample.count = 5;
+  sample.scale = 2.0f;
+  sample.color = 7;
+  sample.shape = SHAPE_SQUARE;
+  const char *text =
+    "{\"label\": \"this label is far too long\", \"count\": \"5\","
+    " \"count\": 1e300, \"scale\": 1e39, \"enabled\": 1, \"color\": \"0x123456789\","
+    " \"color\": \"blue\", \"color\": -1, \"color\": 1.5, \"shape\": \"oval\", \"inner\": 3,"
+    " \"parts\": {\"name\": \"x\"}}";
+  assert(decode(text, &sample, NULL) == 1);
+  assert(strcmp(sample.label, "keep") == 0 && strcmp(sample.canary, "canary") == 0);
+  assert(sample.count == 5 && sample.scale == 2.0f && sample.enabled == 0);
+  assert(sample.color == 7 && sample.shape == SHAPE_SQUARE && sample.part_count == 0);
+
+  /* Exactly full fits; an embedded NUL never does. */
+  assert(decode("{\"label\": \"123456789012345\"}", &sample, NULL) == 1);
+  assert(strcmp(sample.label, "123456789012345") == 0);
+  assert(decode("{\"label\": \"a\\u0000b\"}", &sample, NULL) == 1);
+  assert(strcmp(sample.label, "123456789012345") == 0);
+
+  /* Duplicate keys: the last one wins. */
+  assert(decode("{\"count\": 1, \"count\": 2}", &sample, NULL) == 1 && sample.count == 2);
+}
+
+static void test_entries(void) {
+  Sample sample;
+  memset(&sample, 0, sizeof(sample));
+  const char *text =
+    "{\"entries\": {\"clock\": true, \"battery\": false, \"nested\": {\"clock\": true}, \"n\": 12},"
+    " \"entries\": {\"late\": [1, 2], \"text\": \"abc\"}}";
+  assert(decode(text, &sample, NULL) == 1);
+  assert(sample.entry_resets == 2 && sample.entry_count == 2);
+  assert(strcmp(sample.entry_keys[0], "late") == 0);
+  assert(sample.entry_types[0] == BARISTA_JSON_VALUE_ARRAY);
+  assert(strcmp(sample.entry_keys[1], "text") == 0);
+  assert(sample.entry_types[1] == BARISTA_JSON_VALUE_STRING && sample.entry_flags[1] == 3);
+
+  memset(&sample, 0, sizeof(sample));
+  assert(decode("{\"entries\": {\"clock\": true, \"battery\": false, \"nested\": {\"clock\": 1}, \"n\": 12}}",
+                &sample, NULL) == 1);
+  assert(sample.entry_count == 4);
+  assert(sample.entry_types[0] == BARISTA_JSON_VALUE_BOOL && sample.entry_flags[0] == 1);
+  assert(sample.entry_types[1] == BARISTA_JSON_VALUE_BOOL && sample.entry_flags[1] == 0);
+  assert(sample.entry_types[2] == BARISTA_JSON_VALUE_OBJECT);
+  assert(sample.entry_types[3] == BARISTA_JSON_VALUE_NUMBER && sample.entry_flags[3] == 12);
+
+  /* A key too long for the scratch buffer is skipped, not cut short. */
+  char text_long[BARISTA_JSON_MAX_KEY + 64];
+  char key[BARISTA_JSON_MAX_KEY + 1];
+  memset(key, 'k', sizeof(key) - 1);
+  key[sizeof(key) - 1] = '\0';
+  snprintf(text_long, sizeof(text_long), "{\"entries\": {\"%s\": true}}", key);
+  memset(&sample, 0, sizeof(sample));
+  assert(decode(text_long, &sample, NULL) == 1 && sample.entry_resets == 1 && sample.entry_count == 0);
+}
+
+static void test_syntax_errors(void) {
+  static const struct {
+    const char *text;
+    size_t offset;
+  } cases[] = {
+    {"", 0},
+    {"   ", 3},
+    {"{", 1},
+    {"{\"count\": 1,}", 12},
+    {"{\"count\" 1}", 9},
+    {"{count: 1}", 1},
+    {"[1, 2", 5},
+    {"[1 2]", 3},
+    {"01", 1},
+    {"1.", 2},
+    {"-", 1},
+    {"1e+", 3},
+    {"tru", 0},
+    {"nul", 0},
+    {"\"open", 5},
+    {"\"tab\there\"", 4},
+    {"\"bad \\q\"", 5},
+    {"\"bad \\u12g4\"", 5},
+    {"{} {}", 3},
+    {"{\"a\": [}", 7},
+  };
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    Sample sample;
+    memset(&sample, 0, sizeof(sample));
+    size_t offset = 999;
+    assert(decode(cases[i].text, &sample, &offset) == 0);
+    if (offset != cases[i].offset) {
+      fprintf(stderr, "case %zu (%s): offset %zu, expected %zu\n", i, cases[i].text, offset, cases[i].offset);
+      assert(0);
+    }
+  }
+
+  /* What came before the error stays decoded. */
+  Sample sample;
+  memset(&sample, 0, sizeof(sample));
+  assert(decode("{\"count\": 3, \"parts\": [{\"name\": \"a\"}, {\"name\": ", &sample, NULL) == 0);
+  assert(sample.count == 3 && sample.part_count == 1 && strcmp(sample.parts[0].name, "a") == 0);
+
+  /* Scalars, and NULL schemas, are fine at the root. */
+  assert(barista_json_decode("  null ", 7, NULL, NULL, NULL) == 1);
+  assert(barista_json_decode("[\"x\", {\"y\": [true]}]", 20, NULL, NULL, NULL) == 1);
+  assert(barista_json_decode(NULL, 0, NULL, NULL, NULL) == 0);
+  /* Length bounds the text, not a terminator. */
+  assert(barista_json_decode("12345", 2, NULL, NULL, NULL) == 1);
+  assert(barista_json_decode("\"ab\"", 3, NULL, NULL, NULL) == 0);
+}
+
+static void test_depth(void) {
+  char text[2 * (BARISTA_JSON_MAX_DEPTH + 1) + 1];
+  for (int depth = BARISTA_JSON_MAX_DEPTH; depth <= BARISTA_JSON_MAX_DEPTH + 1; depth++) {
+    memset(text, '[', (size_t)depth);
+    memset(text + depth, ']', (size_t)depth);
+    text[2 * depth] = '\0';
+    int expected = depth <= BARISTA_JSON_MAX_DEPTH;
+    assert(barista_json_decode(text, strlen(text), NULL, NULL, NULL) == expected);
+  }
+}
+
+/* The walk reports every value in order, strings whole and numbers with
+ * their form; syntax errors match decoding and callbacks can stop it. */
+typedef struct {
+  char log[4096];
+  size_t used;
+  int stop_after;
+} WalkLog;
+
+static void walk_append(WalkLog *log, const char *text) {
+  size_t length = strlen(text);
+  assert(log->used + length < sizeof(log->log));
+  memcpy(log->log + log->used, text, length + 1);
+  log->used += length;
+}
+
+static int walk_value_event(void *context, const char *key, size_t key_length, const BaristaJsonValue *value) {
+  WalkLog *log = context;
+  char event[128];
+  if (key) {
+    assert(strlen(key) == key_length);
+    snprintf(event, sizeof(event), "%.*s=", key_length > 20 ? 20 : (int)key_length, key);
+    walk_append(log, event);
+  }
+  switch (value->type) {
+    case BARISTA_JSON_VALUE_STRING:
+      if (value->string) assert(strlen(value->string) == value->length);
+      snprintf(event, sizeof(event), "s%zu:%.8s ", value->length, value->string ? value->string : "(nul)");
+      break;
+    case BARISTA_JSON_VALUE_NUMBER:
+      snprintf(event, sizeof(event), "%c%g ", value->integer ? 'i' : 'f', value->number);
+      break;
+    case BARISTA_JSON_VALUE_BOOL: snprintf(event, sizeof(event), "%s ", value->boolean ? "true" : "false"); break;
+    case BARISTA_JSON_VALUE_NULL: snprintf(event, sizeof(event), "null "); break;
+    case BARISTA_JSON_VALUE_OBJECT: snprintf(event, sizeof(event), "{ "); break;
+    case BARISTA_JSON_VALUE_ARRAY: snprintf(event, sizeof(event), "[ "); break;
+  }
+  walk_append(log, event);
+  return --log->stop_after != 0;
+}
+
+static int walk_close_event(void *context) {
+  walk_append(context, "} ");
+  return 1;
+}
+
+static const BaristaJsonVisitor kWalkLog = {walk_value_event, walk_close_event};
+
+static int walk_count_event(void *context, const char *key, size_t key_length, const BaristaJsonValue *value) {
+  (void)key;
+  (void)key_length;
+  (void)value;
+  return --((WalkLog *)context)->stop_after != 0;
+}
+
+static const BaristaJsonVisitor kWalkCount = {walk_count_event, NULL};
+
+static int walk(const char *text, WalkLog *log, size_t *error_offset) {
+  memset(log, 0, sizeof(*log));
+  log->stop_after = -1;
+  return barista_json_walk(text, strlen(text), &kWalkLog, log, error_offset);
+}
+
+static void test_walk(void) {
+  WalkLog log;
+  assert(walk("{\"a\": 1, \"b\": [2.5, -3e2, true, null, \"x\\ty\"], \"c\": {}, \"d\": false}", &log, NULL) == 1);
+  assert(strcmp(log.log, "{ a=i1 b=[ f2.5 f-300 true null s3:x\ty } c={ } d=false } ") == 0);
+  assert(walk("\"\\u0041\\u00e9\"", &log, NULL) == 1 && strcmp(log.log, "s3:A\xC3\xA9 ") == 0);
+  assert(walk("[\"a\\u0000b\"]", &log, NULL) == 1 && strcmp(log.log, "[ s3:(nul) } ") == 0);
+  assert(walk("{\"a\\u0000\": 1}", &log, NULL) == -1);
+
+  /* Keys and strings past the scratch buffers arrive whole. */
+  size_t long_length = BARISTA_JSON_MAX_TEXT * 3;
+  char *text = malloc(long_length * 2 + 64);
+  assert(text);
+  size_t used = 0;
+  text[used++] = '{';
+  text[used++] = '"';
+  memset(text + used, 'k', BARISTA_JSON_MAX_KEY * 2);
+  used += BARISTA_JSON_MAX_KEY * 2;
+  used += (size_t)sprintf(text + used, "\": \"");
+  memset(text + used, 'v', long_length);
+  used += long_length;
+  used += (size_t)sprintf(text + used, "\\n\"}");
+  WalkLog *big = malloc(sizeof(*big));
+  assert(big);
+  memset(big, 0, sizeof(*big));
+  big->stop_after = -1;
+  assert(barista_json_walk(text, used, &kWalkLog, big, NULL) == 1);
+  char expected[128];
+  snprintf(expected, sizeof(expected), "{ kkkkkkkkkkkkkkkkkkkk=s%zu:vvvvvvvv } ", long_length + 1);
+  assert(strcmp(big->log, expected) == 0);
+  free(big);
+  free(text);
+
+  /* Syntax errors land where decoding puts them. */
+  size_t offset = 0;
+  assert(walk("{\"a\": [1, 2}", &log, &offset) == 0 && offset == 11);
+  assert(walk("[1] x", &log, &offset) == 0 && offset == 4);
+  assert(walk("", &log, NULL) == 0);
+
+  memset(&log, 0, sizeof(log));
+  log.stop_after = 2;
+  assert(barista_json_walk("[1, 2, 3]", 9, &kWalkLog, &log, NULL) == -1);
+  assert(strcmp(log.log, "[ i1 ") == 0);
+}
+
+static void test_file(void) {
+  char path[] = "/tmp/barista_json_test.XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  const char *text = "{\"count\": 11, \"label\": \"file\"}";
+  assert(write(fd, text, strlen(text)) == (ssize_t)strlen(text));
+  close(fd);
+  Sample sample;
+  memset(&sample, 0, sizeof(sample));
+  assert(barista_json_decode_file(path, &kSampleRoot, &sample, NULL) == 1);
+  assert(sample.count == 11 && strcmp(sample.label, "file") == 0);
+  unlink(path);
+  assert(barista_json_decode_file(path, &kSampleRoot, &sample, NULL) == -1);
+  assert(barista_json_decode_file(NULL, &kSampleRoot, &sample, NULL) == -1);
+}
+
+/* Mutation fuzzing: whatever the input, the decoder stays inside its
+ * buffers, leaves every string terminated and every count in range, and
+ * agrees with a schema-less pass on whether the text is valid. */
+static uint64_t g_rng = 0x9E3779B97F4A7C15ull;
+
+static uint32_t next_random(void) {
+  g_rng ^= g_rng << 13;
+  g_rng ^= g_rng >> 7;
+  g_rng ^= g_rng << 17;
+  return (uint32_t)(g_rng >> 16);
+}
+
+static const char *const kSeeds[] = {
+  "{\"label\": \"caf\\u00e9\", \"count\": 12, \"scale\": 0.5, \"enabled\": false,"
+  " \"color\": \"#FF00FF\", \"shape\": \"round\", \"inner\": {\"depth\": -1, \"note\": \"\\ud83d\\ude00\"},"
+  " \"parts\": [{\"name\": \"p\", \"size\": 3}, {\"name\": \"q\"}], \"entries\": {\"a\": true, \"b\": [null]}}",
+  "[{\"type\": \"header\", \"label\": \"x\"}, {\"name\": \"y\", \"action\": \"echo \\\"hi\\\"\"}, []]",
+  "{\"widgets\": {\"clock\": true}, \"space_icons\": {\"1\": \"\\u2318\"}, \"n\": [1e5, -0.25, 0]}",
+};
+
+static const char kTokens[] = "{}[]\",:\\ \n0123456789-+.eEtrufalsn\x80\xC3\xFF\x01u";
+
+static size_t mutate(char *buffer, size_t length, size_t capacity) {
+  int edits = 1 + (int)(next_random() % 6);
+  for (int edit = 0; edit < edits; edit++) {
+    size_t at = length ? next_random() % (length + 1) : 0;
+    switch (next_random() % 5) {
+      case 0: /* overwrite */
+        if (at < length) buffer[at] = kTokens[next_random() % (sizeof(kTokens) - 1)];
+        break;
+      case 1: /* insert */
+        if (length + 1 < capacity) {
+          memmove(buffer + at + 1, buffer + at, length - at);
+          buffer[at] = kTokens[next_random() % (sizeof(kTokens) - 1)];
+          length++;
+        }
+        break;
+      case 2: /* delete a run */
+        if (at < length) {
+          size_t count = 1 + next_random() % 8;
+          if (count > length - at) count = length - at;
+          memmove(buffer + at, buffer + at + count, length - at - count);
+          length -= count;
+        }
+        break;
+      case 3: /* truncate */
+        length = at;
+        break;
+      default: /* duplicate a run, which nests and repeats structure */
+        if (at < length) {
+          size_t count = 1 + next_random() % 32;
+          if (count > length - at) count = length - at;
+          if (length + count < capacity) {
+            memmove(buffer + at + count, buffer + at, length - at);
+            length += count;
+          }
+        }
+        break;
+    }
+  }
+  return length;
+}
+
+static int terminated(const char *text, size_t capacity) {
+  return memchr(text, '\0', capacity) != NULL;
+}
+
+static void fuzz(int iterations) {
+  char buffer[1024];
+  for (int iteration = 0; iteration < iterations; iteration++) {
+    const char *seed = kSeeds[next_random() % (sizeof(kSeeds) / sizeof(kSeeds[0]))];
+    size_t length = strlen(seed);
+    memcpy(buffer, seed, length);
+    length = mutate(buffer, length, sizeof(buffer));
+
+    /* Exact-size copy so ASan sees any read past the end. */
+    char *text = malloc(length ? length : 1);
+    assert(text);
+    memcpy(text, buffer, length);
+    Sample sample;
+    memset(&sample, 0, sizeof(sample));
+    strcpy(sample.canary, "canary");
+    int decoded = barista_json_decode(text, length, &kSampleRoot, &sample, NULL);
+    int validated = barista_json_decode(text, length, NULL, NULL, NULL);
+    WalkLog *log = malloc(sizeof(*log));
+    assert(log);
+    memset(log, 0, sizeof(*log));
+    log->stop_after = 200;
+    int walked = barista_json_walk(text, length, &kWalkCount, log, NULL);
+    free(log);
+    free(text);
+
+    assert(decoded == validated);
+    assert(walked == validated || walked == -1);
+    assert(strcmp(sample.canary, "canary") == 0);
+    assert(terminated(sample.label, sizeof(sample.label)));
+    assert(terminated(sample.inner.note, sizeof(sample.inner.note)));
+    assert(sample.part_count >= 0 && sample.part_count <= 3);
+    for (int i = 0; i < 3; i++) assert(terminated(sample.parts[i].name, sizeof(sample.parts[i].name)));
+    assert(sample.shape == SHAPE_ROUND || sample.shape == SHAPE_SQUARE);
+    assert(sample.enabled == 0 || sample.enabled == 1);
+  }
+}
+
+/* BARISTA_JSON_BENCH=N: decode a 1 MB state.json shaped like the one the
+ * Lua side writes, mostly keys the schema skips, N times. */
+typedef struct {
+  int widgets;
+  int bar_height;
+  uint32_t bar_color;
+  float widget_scale;
+  int icons;
+  int space_icons;
+} StateSummary;
+
+static void count_widget(void *object, const char *key, const BaristaJsonValue *value) {
+  (void)value;
+  if (key) ((StateSummary *)object)->widgets++;
+}
+
+static void count_icon(void *object, const char *key, const BaristaJsonValue *value) {
+  if (key && value->type == BARISTA_JSON_VALUE_STRING) ((StateSummary *)object)->icons++;
+}
+
+static void count_space_icon(void *object, const char *key, const BaristaJsonValue *value) {
+  if (key && value->type == BARISTA_JSON_VALUE_STRING) ((StateSummary *)object)->space_icons++;
+}
+
+static const BaristaJsonField kBenchAppearance[] = {
+  {.key = "bar_height", .type = BARISTA_JSON_INT, BARISTA_JSON_MEMBER(StateSummary, bar_height)},
+  {.key = "bar_color", .type = BARISTA_JSON_COLOR, BARISTA_JSON_MEMBER(StateSummary, bar_color)},
+  {.key = "widget_scale", .type = BARISTA_JSON_FLOAT, BARISTA_JSON_MEMBER(StateSummary, widget_scale)},
+  {.key = NULL},
+};
+
+static const BaristaJsonField kBenchFields[] = {
+  {.key = "widgets", .type = BARISTA_JSON_ENTRIES, .offset = 0, .entry = count_widget},
+  {.key = "appearance", .type = BARISTA_JSON_OBJECT, .offset = 0, .fields = kBenchAppearance},
+  {.key = "icons", .type = BARISTA_JSON_ENTRIES, .offset = 0, .entry = count_icon},
+  {.key = "space_icons", .type = BARISTA_JSON_ENTRIES, .offset = 0, .entry = count_space_icon},
+  {.key = NULL},
+};
+
+static char *build_state(size_t target, size_t *length) {
+  size_t capacity = target + 4096;
+  char *text = malloc(capacity);
+  assert(text);
+  size_t used = (size_t)snprintf(text, capacity,
+    "{\n  \"_version\": 3,\n  \"widgets\": {\"system_info\": true, \"network\": true, \"clock\": true},\n"
+    "  \"appearance\": {\"theme\": \"default\", \"bar_height\": 28, \"bar_color\": \"0xC021162F\","
+    " \"widget_scale\": 1.0, \"hover_color\": \"0x40f5c2e7\"},\n"
+    "  \"icons\": {\"apple\": \"\\uf179\", \"clock\": \"\\uf017\"},\n"
+    "  \"space_icons\": {\"1\": \"\\uf120\", \"2\": \"\\uf268\"},\n"
+    "  \"window_defaults\": {\"apps\": {");
+  for (int app = 0; used < target; app++) {
+    used += (size_t)snprintf(text + used, capacity - used,
+      "%s\n    \"com.example.app%d\": {\"space\": %d, \"display\": 1, \"floating\": %s,"
+      " \"title\": \"Window \\\"%d\\\" \\u2014 caf\\u00e9\", \"frame\": [%d, %d, 1280.5, 800.25],"
+      " \"tags\": [\"work\", \"focus\", null]}",
+      app ? "," : "", app, app % 9, app % 2 ? "true" : "false", app, app * 3, app * 7);
+  }
+  used += (size_t)snprintf(text + used, capacity - used, "\n  }},\n  \"debug\": {\"verbose_logging\": false}\n}\n");
+  *length = used;
+  return text;
+}
+
+static double now_milliseconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec * 1000.0 + (double)now.tv_nsec / 1000000.0;
+}
+
+static void bench(int rounds) {
+  size_t length = 0;
+  char *text = build_state(1 << 20, &length);
+  static const BaristaJsonField root = {.type = BARISTA_JSON_OBJECT, .offset = 0, .fields = kBenchFields};
+  StateSummary summary;
+  double start = now_milliseconds();
+  for (int round = 0; round < rounds; round++) {
+    memset(&summary, 0, sizeof(summary));
+    assert(barista_json_decode(text, length, &root, &summary, NULL) == 1);
+  }
+  double decoded = (now_milliseconds() - start) / rounds;
+  assert(summary.widgets == 3 && summary.bar_height == 28 && summary.bar_color == 0xC021162Fu);
+  assert(summary.icons == 2 && summary.space_icons == 2);
+  fprintf(stderr, "json bench: %.2f MB state.json decoded in %.3f ms (%.0f MB/s, %d rounds)\n",
+          (double)length / (1 << 20), decoded, (double)length / (1 << 20) / (decoded / 1000.0), rounds);
+  free(text);
+}
+
+int main(void) {
+  const char *bench_rounds = getenv("BARISTA_JSON_BENCH");
+  if (bench_rounds && atoi(bench_rounds) > 0) {
+    bench(atoi(bench_rounds));
+    return 0;
+  }
+
+  test_fields();
+  test_scoping();
+  test_dropped_values();
+  test_entries();
+  test_syntax_errors();
+  test_depth();
+  test_walk();
+  test_file();
+  const char *fuzz_iterations = getenv("BARISTA_JSON_FUZZ");
+  fuzz(fuzz_iterations && atoi(fuzz_iterations) > 0 ? atoi(fuzz_iterations) : 20000);
+
+  puts("test_barista_json.c: ok");
+  return 0;
+}
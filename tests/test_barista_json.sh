@@ -0,0 +1,44 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+HELPERS="$ROOT_DIR/helpers"
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "$TMP_DIR"' EXIT
+
+CC_BIN="${CC:-cc}"
+"$CC_BIN" -std=c99 -Wall -Wextra -Werror -O2 \
+  "$ROOT_DIR/tests/test_barista_json.c" -o "$TMP_DIR/test_barista_json"
+"$TMP_DIR/test_barista_json" >/dev/null
+
+# The fuzz pass again under ASan/UBSan, where the toolchain has them.
+if "$CC_BIN" -std=c99 -O1 -g -fsanitize=address,undefined -fno-sanitize-recover=all \
+    "$ROOT_DIR/tests/test_barista_json.c" -o "$TMP_DIR/test_barista_json_asan" 2>/dev/null \
+    && "$TMP_DIR/test_barista_json_asan" >/dev/null 2>&1 </dev/null; then
+  BARISTA_JSON_FUZZ=100000 "$TMP_DIR/test_barista_json_asan" >/dev/null
+fi
+
+# icon_manager reads custom glyphs from state.json through the decoder.
+SHARED=("$HELPERS/barista_transport.c" "$HELPERS/barista_payload.c" "$HELPERS/barista_cli.c")
+"$CC_BIN" -std=c99 -D_DEFAULT_SOURCE -Wall -Wextra -Werror -O2 \
+  "$HELPERS/icon_manager.c" "$HELPERS/barista_json.c" "${SHARED[@]}" -o "$TMP_DIR/icon_manager"
+mkdir -p "$TMP_DIR/home/.config/sketchybar"
+cat >"$TMP_DIR/home/.config/sketchybar/state.json" <<'JSON'
+{
+  "appearance": {"icons": {"decoy": "x"}},
+  "icons": {
+    "clock": "⏰",
+    "quest": "Q\"",
+    "nested": {"deep": "y"}
+  }
+}
+JSON
+run_icons() {
+  HOME="$TMP_DIR/home" "$TMP_DIR/icon_manager" "$@"
+}
+[[ "$(run_icons get clock)" == $'⏰' ]]
+[[ "$(run_icons get quest)" == 'Q"' ]]
+[[ "$(run_icons get decoy fallback)" == "fallback" ]]
+[[ "$(run_icons get nested fallback)" == "fallback" ]]
+
+printf '%s\n' "barista_json tests passed"
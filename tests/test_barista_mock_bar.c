@@ -0,0 +1,212 @@
+#define main barista_mock_bar_main
+#include "../helpers/barista_mock_bar.c"
+#undef main
+
+#include <assert.h>
+#include <sys/wait.h>
+
+static char socket_path[256];
+
+static size_t build_payload(uint8_t *buffer, size_t capacity, const char *const *tokens) {
+  size_t length = 0;
+  for (size_t i = 0; tokens[i]; i++) {
+    size_t token_length = strlen(tokens[i]) + 1;
+    assert(length + token_length < capacity);
+    memcpy(buffer + length, tokens[i], token_length);
+    length += token_length;
+  }
+  buffer[length++] = '\0';
+  return length;
+}
+
+static MockReply *apply(MockBar *bar, const char *const *tokens) {
+  static MockReply reply;
+  uint8_t payload[1024];
+  size_t length = build_payload(payload, sizeof(payload), tokens);
+  apply_request(bar, payload, length, &reply);
+  return &reply;
+}
+
+static const char *property(MockBar *bar, const char *name, const char *key) {
+  MockItem *item = find_item(bar, name);
+  if (!item) return NULL;
+  for (int i = 0; i < item->property_count; i++) {
+    if (strcmp(item->properties[i].key, key) == 0) return item->properties[i].value;
+  }
+  return NULL;
+}
+
+static void test_table_follows_requests(void) {
+  static MockBar bar;
+  MockReply *reply = apply(&bar, (const char *[]){
+    "--add", "item", "clock", "right", "--set", "clock", "label=12:00", "icon=", NULL});
+  assert(!reply->failed && reply->length == 0);
+  assert(strcmp(property(&bar, "clock", "position"), "right") == 0);
+  assert(strcmp(property(&bar, "clock", "label"), "12:00") == 0);
+  assert(strcmp(property(&bar, "clock", "icon"), "") == 0);
+
+  reply = apply(&bar, (const char *[]){"-m", "--set", "clock", "label=12:01", NULL});
+  assert(!reply->failed);
+  assert(strcmp(property(&bar, "clock", "label"), "12:01") == 0);
+
+  reply = apply(&bar, (const char *[]){
+    "--set", "clock", "popup.drawing=toggle", "--set", "clock", "popup.drawing=toggle",
+    "--set", "clock", "popup.drawing=toggle", NULL});
+  assert(strcmp(property(&bar, "clock", "popup.drawing"), "on") == 0);
+
+  reply = apply(&bar, (const char *[]){"--query", "clock", NULL});
+  assert(!reply->failed);
+  assert(strstr(reply->text, "\"name\":\"clock\"") != NULL);
+  assert(strstr(reply->text, "\"label\":\"12:01\"") != NULL);
+  assert(bar.stats.queries == 1);
+  clear_items(&bar);
+}
+
+static void test_errors_do_not_stop_the_request(void) {
+  static MockBar bar;
+  MockReply *reply = apply(&bar, (const char *[]){
+    "--set", "missing", "label=x", "--add", "item", "cpu", "left", "--set", "cpu", "bogus",
+    "label=5%", "--frobnicate", NULL});
+  assert(reply->failed);
+  assert(strstr(reply->text, "[!] Set: Item not found 'missing'") != NULL);
+  assert(strstr(reply->text, "[!] Set: Invalid property 'bogus'") != NULL);
+  assert(strstr(reply->text, "[!] Parse: Unknown command '--frobnicate'") != NULL);
+  assert(strcmp(property(&bar, "cpu", "label"), "5%") == 0);
+  assert(bar.stats.errors == 1);
+
+  reply = apply(&bar, (const char *[]){"--add", "item", "cpu", "left", NULL});
+  assert(reply->failed && strstr(reply->text, "already exists") != NULL);
+  clear_items(&bar);
+}
+
+static void test_regex_targets(void) {
+  static MockBar bar;
+  apply(&bar, (const char *[]){
+    "--add", "item", "popup.menu.item0", "popup.menu", "--add", "item", "popup.menu.item1",
+    "popup.menu", "--add", "item", "clock", "right", NULL});
+  MockReply *reply = apply(&bar, (const char *[]){
+    "--set", "/popup\\.menu\\..*/", "background.drawing=off", NULL});
+  assert(!reply->failed);
+  assert(strcmp(property(&bar, "popup.menu.item1", "background.drawing"), "off") == 0);
+  assert(property(&bar, "clock", "background.drawing") == NULL);
+
+  reply = apply(&bar, (const char *[]){"--remove", "/popup\\.menu\\..*/", NULL});
+  assert(!reply->failed);
+  assert(bar.item_count == 1 && find_item(&bar, "clock") != NULL);
+  assert(find_item(&bar, "popup.menu.item0") == NULL);
+
+  reply = apply(&bar, (const char *[]){"--remove", "clock", "--remove", "clock", NULL});
+  assert(reply->failed && bar.item_count == 0);
+}
+
+static void test_auto_add(void) {
+  static MockBar bar;
+  bar.auto_add = 1;
+  MockReply *reply = apply(&bar, (const char *[]){"--set", "battery", "label=80%", NULL});
+  assert(!reply->failed);
+  assert(strcmp(property(&bar, "battery", "label"), "80%") == 0);
+  reply = apply(&bar, (const char *[]){"--bar", "height=32", "--default", "icon.font=x", NULL});
+  assert(!reply->failed);
+  assert(strcmp(property(&bar, "bar", "height"), "32") == 0);
+  clear_items(&bar);
+}
+
+static void test_histogram_buckets(void) {
+  for (uint64_t value = 0; value < 100000; value = value * 3 / 2 + 1) {
+    int bucket = histogram_bucket(value);
+    assert(bucket < MOCK_HISTOGRAM_BUCKETS);
+    assert(histogram_upper(bucket) >= value);
+    assert(bucket == 0 || histogram_upper(bucket - 1) < value);
+    assert(histogram_upper(bucket) - value <= value / 8);
+  }
+  assert(histogram_bucket(UINT64_MAX) < MOCK_HISTOGRAM_BUCKETS);
+
+  MockStats stats;
+  memset(&stats, 0, sizeof(stats));
+  for (int i = 0; i < 98; i++) histogram_record(&stats, 1000);
+  histogram_record(&stats, 50000);
+  histogram_record(&stats, 90000);
+  assert(histogram_percentile(&stats, 50.0) >= 1000);
+  assert(histogram_percentile(&stats, 50.0) <= 1125);
+  assert(histogram_percentile(&stats, 99.0) >= 50000);
+  assert(histogram_percentile(&stats, 99.0) < 90000);
+  assert(histogram_percentile(&stats, 100.0) == 90000);
+}
+
+static uint64_t stat_value(const char *text, const char *key) {
+  char needle[64];
+  snprintf(needle, sizeof(needle), "%s=", key);
+  const char *found = strstr(text, needle);
+  assert(found && (found == text || found[-1] == '\n'));
+  return strtoull(found + strlen(needle), NULL, 10);
+}
+
+static void read_stats(char *text, size_t capacity) {
+  int fd = barista_socket_connect(socket_path);
+  assert(fd >= 0);
+  static const uint8_t probe[] = {0};
+  size_t length = 0;
+  assert(barista_frame_write(fd, probe, sizeof(probe), MOCK_FRAME_STATS, 500) == 0);
+  assert(barista_frame_read(fd, text, capacity - 1, &length, NULL, 500) == 0);
+  text[length] = '\0';
+  close(fd);
+}
+
+/* The real transport against a served mock: replies map onto send results
+ * and every request lands in the latency histogram. */
+static void test_transport_round_trip(void) {
+  pid_t server = fork();
+  assert(server >= 0);
+  if (server == 0) {
+    alarm(10);
+    MockOptions options = {0, 0, NULL};
+    _exit(serve(socket_path, &options));
+  }
+  for (int i = 0; i < 100 && access(socket_path, F_OK) != 0; i++) usleep(10000);
+  setenv("BARISTA_TRANSPORT_SOCKET", socket_path, 1);
+  setenv("BARISTA_BUSD_DISABLE", "1", 1);
+
+  uint8_t payload[256];
+  size_t length = build_payload(payload, sizeof(payload),
+                                (const char *[]){"--add", "item", "cpu", "left", NULL});
+  assert(barista_send(payload, length, 500) == BARISTA_SEND_CONFIRMED_SUCCESS);
+  length = build_payload(payload, sizeof(payload),
+                         (const char *[]){"--set", "gpu", "label=1", NULL});
+  assert(barista_send(payload, length, 500) == BARISTA_SEND_CONFIRMED_ERROR);
+  for (int i = 0; i < 20; i++) {
+    length = build_payload(payload, sizeof(payload),
+                           (const char *[]){"--set", "cpu", "label=2", NULL});
+    assert(barista_send(payload, length, 0) == BARISTA_SEND_SENT_UNCONFIRMED);
+  }
+  assert(barista_send(payload, length, 500) == BARISTA_SEND_CONFIRMED_SUCCESS);
+
+  char text[BARISTA_TRANSPORT_MAX_RESPONSE_BYTES];
+  read_stats(text, sizeof(text));
+  assert(stat_value(text, "messages") == 23);
+  assert(stat_value(text, "replies") == 3);
+  assert(stat_value(text, "errors") == 1);
+  assert(stat_value(text, "items") == 1);
+  assert(stat_value(text, "latency_p99_ns") > 0);
+  assert(stat_value(text, "latency_p50_ns") <= stat_value(text, "latency_max_ns"));
+
+  kill(server, SIGTERM);
+  int status = 0;
+  assert(waitpid(server, &status, 0) == server);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  assert(access(socket_path, F_OK) != 0);
+  barista_transport_reset();
+}
+
+int main(void) {
+  const char *tmpdir = getenv("TMPDIR");
+  snprintf(socket_path, sizeof(socket_path), "%s/mock_bar.sock", tmpdir ? tmpdir : "/tmp");
+
+  test_table_follows_requests();
+  test_errors_do_not_stop_the_request();
+  test_regex_targets();
+  test_auto_add();
+  test_histogram_buckets();
+  test_transport_round_trip();
+  printf("barista_mock_bar: ok\n");
+  return 0;
+}
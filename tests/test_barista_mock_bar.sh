@@ -0,0 +1,75 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+TMP_DIR="$(mktemp -d)"
+SOCKET_PATH="$TMP_DIR/bar.sock"
+MOCK_PID=""
+
+cleanup() {
+  if [[ -n "$MOCK_PID" ]]; then kill "$MOCK_PID" 2>/dev/null || true; fi
+  rm -rf "$TMP_DIR"
+}
+trap cleanup EXIT
+
+"${CC:-cc}" -std=c99 -Wall -Wextra -Werror -I"$ROOT_DIR/helpers" \
+  "$ROOT_DIR/tests/test_barista_mock_bar.c" "$ROOT_DIR/helpers/barista_transport.c" \
+  -o "$TMP_DIR/test_barista_mock_bar"
+TMPDIR="$TMP_DIR" "$TMP_DIR/test_barista_mock_bar"
+
+"${CC:-cc}" -std=c99 -Wall -Wextra -Werror \
+  "$ROOT_DIR/helpers/barista_mock_bar.c" "$ROOT_DIR/helpers/barista_transport.c" \
+  -o "$TMP_DIR/barista_mock_bar"
+"${CC:-cc}" -std=c99 -Wall -Wextra -Werror \
+  "$ROOT_DIR/helpers/popup_manager.c" "$ROOT_DIR/helpers/barista_transport.c" \
+  "$ROOT_DIR/helpers/barista_payload.c" \
+  -o "$TMP_DIR/popup_manager"
+
+# popup_manager end to end over the socket transport: the switch must reach
+# the mock bar natively and never fall back to the CLI.
+"$TMP_DIR/barista_mock_bar" --socket "$SOCKET_PATH" --auto-add --log "$TMP_DIR/requests.log" &
+MOCK_PID=$!
+for _ in $(seq 100); do [[ -S "$SOCKET_PATH" ]] && break; sleep 0.02; done
+
+mkdir -p "$TMP_DIR/registry" "$TMP_DIR/fakebin"
+printf 'version\t1\nroot\tfront_app\nroot\tcontrol_center\n' \
+  > "$TMP_DIR/registry/sketchybar_popup_topology"
+cat > "$TMP_DIR/fakebin/sketchybar" <<'SH'
+#!/bin/sh
+echo "unexpected CLI fallback: $*" >&2
+exit 1
+SH
+chmod +x "$TMP_DIR/fakebin/sketchybar"
+
+PATH="$TMP_DIR/fakebin:$PATH" \
+  TMPDIR="$TMP_DIR/registry" \
+  BARISTA_BUSD_DISABLE=1 \
+  BARISTA_TRANSPORT_SOCKET="$SOCKET_PATH" \
+  "$TMP_DIR/popup_manager" switch control_center
+
+"$TMP_DIR/barista_mock_bar" query control_center --socket "$SOCKET_PATH" \
+  | grep -Fq '"popup.drawing":"on"'
+"$TMP_DIR/barista_mock_bar" query front_app --socket "$SOCKET_PATH" \
+  | grep -Fq '"popup.drawing":"off"'
+grep -Fqx -- "--set front_app popup.drawing=off --set control_center popup.drawing=toggle" \
+  "$TMP_DIR/requests.log"
+
+stats="$("$TMP_DIR/barista_mock_bar" stats --socket "$SOCKET_PATH")"
+grep -Fqx "messages=3" <<<"$stats"
+grep -Fqx "queries=2" <<<"$stats"
+grep -Fqx "errors=0" <<<"$stats"
+grep -q '^latency_le_ns\.[0-9]*=1$' <<<"$stats"
+
+"$TMP_DIR/barista_mock_bar" reset --socket "$SOCKET_PATH" >/dev/null
+grep -Fqx "items=0" <<<"$("$TMP_DIR/barista_mock_bar" stats --socket "$SOCKET_PATH")"
+if "$TMP_DIR/barista_mock_bar" query control_center --socket "$SOCKET_PATH" >/dev/null; then
+  echo "FAIL: query must fail for an unknown item" >&2
+  exit 1
+fi
+
+kill "$MOCK_PID"
+wait "$MOCK_PID"
+MOCK_PID=""
+[[ ! -e "$SOCKET_PATH" ]]
+
+printf '%s\n' "barista_mock_bar tests passed"
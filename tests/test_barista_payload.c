@@ -0,0 +1,108 @@
+#include "../helpers/barista_payload.h"
+#include "../helpers/barista_transport.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Written to build as both C and C++ so the header is checked for each. */
+
+static int payload_equals(const BaristaPayload *payload, const char *expected, size_t length) {
+  return payload->length == length && memcmp(payload->bytes, expected, length) == 0;
+}
+
+static void test_trigger_tokens(void) {
+  uint8_t arena[256];
+  BaristaPayload payload;
+  barista_payload_init(&payload, arena, sizeof(arena));
+  assert(barista_payload_verb(&payload, BARISTA_VERB_TRIGGER));
+  assert(barista_payload_token(&payload, "cpu_update"));
+  assert(barista_payload_property_int(&payload, "user_load", 7, 0));
+  assert(barista_payload_property_int(&payload, "sys_load", 3, 2));
+  assert(barista_payload_property_int(&payload, "delta", -42, 3));
+  /* Quotes and spaces are plain bytes, not shell syntax. */
+  assert(barista_payload_property(&payload, "label", "it's \"quoted\" text"));
+  assert(barista_payload_property(&payload, "icon", ""));
+  size_t length = barista_payload_finish(&payload);
+
+  const char expected[] = "--trigger\0cpu_update\0user_load=7\0sys_load=03\0delta=-042\0"
+                          "label=it's \"quoted\" text\0icon=\0";
+  assert(length == sizeof(expected));
+  assert(payload_equals(&payload, expected, sizeof(expected)));
+  assert(payload.arguments == 7);
+  assert(barista_payload_valid(arena, length));
+}
+
+static void test_verbs(void) {
+  uint8_t arena[128];
+  BaristaPayload payload;
+  barista_payload_init(&payload, arena, sizeof(arena));
+  assert(barista_payload_verb(&payload, BARISTA_VERB_ADD));
+  assert(barista_payload_verb(&payload, BARISTA_VERB_EVENT));
+  assert(barista_payload_token(&payload, "network_update"));
+  assert(barista_payload_verb(&payload, BARISTA_VERB_SET));
+  size_t length = barista_payload_finish(&payload);
+  const char expected[] = "--add\0event\0network_update\0--set\0";
+  assert(length == sizeof(expected));
+  assert(payload_equals(&payload, expected, sizeof(expected)));
+
+  barista_payload_init(&payload, arena, sizeof(arena));
+  assert(!barista_payload_verb(&payload, BARISTA_VERB_COUNT));
+  assert(payload.failed);
+}
+
+static void test_extreme_integers(void) {
+  uint8_t arena[128];
+  BaristaPayload payload;
+  barista_payload_init(&payload, arena, sizeof(arena));
+  assert(barista_payload_property_int(&payload, "min", -9223372036854775807LL - 1, 0));
+  assert(barista_payload_property_int(&payload, "zero", 0, 0));
+  assert(barista_payload_property_int(&payload, "wide", 5, 99));
+  assert(barista_payload_finish(&payload) > 0);
+  const char expected[] = "min=-9223372036854775808\0zero=0\0wide=00000000000000000005\0";
+  assert(payload_equals(&payload, expected, sizeof(expected)));
+}
+
+static void test_failures_stick(void) {
+  uint8_t arena[16];
+  BaristaPayload payload;
+
+  /* Exactly full: eight token bytes, their NUL and the closing NUL. */
+  barista_payload_init(&payload, arena, 10);
+  assert(barista_payload_token(&payload, "12345678"));
+  assert(barista_payload_finish(&payload) == 10);
+
+  barista_payload_init(&payload, arena, 10);
+  assert(!barista_payload_token(&payload, "123456789"));
+  assert(payload.failed && payload.length == 0);
+  assert(!barista_payload_token(&payload, "x"));
+  assert(barista_payload_finish(&payload) == 0);
+
+  barista_payload_init(&payload, arena, sizeof(arena));
+  assert(barista_payload_token(&payload, "ok"));
+  assert(!barista_payload_property(&payload, "", "value"));
+  assert(barista_payload_finish(&payload) == 0);
+
+  barista_payload_init(&payload, arena, sizeof(arena));
+  assert(!barista_payload_token_bytes(&payload, "a\0b", 3));
+  assert(barista_payload_finish(&payload) == 0);
+
+  barista_payload_init(&payload, arena, sizeof(arena));
+  assert(!barista_payload_property(&payload, "label", NULL));
+  assert(!barista_payload_token(&payload, NULL));
+
+  barista_payload_init(&payload, arena, sizeof(arena));
+  assert(barista_payload_finish(&payload) == 0);
+
+  barista_payload_init(&payload, NULL, 64);
+  assert(!barista_payload_token(&payload, "x"));
+}
+
+int main(void) {
+  test_trigger_tokens();
+  test_verbs();
+  test_extreme_integers();
+  test_failures_stick();
+  puts("test_barista_payload.c: ok");
+  return 0;
+}
@@ -0,0 +1,27 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "$TMP_DIR"' EXIT
+
+"${CC:-cc}" -std=c99 -Wall -Wextra -Werror \
+  "$ROOT_DIR/tests/test_barista_payload.c" "$ROOT_DIR/helpers/barista_payload.c" \
+  "$ROOT_DIR/helpers/barista_transport.c" \
+  -o "$TMP_DIR/test_barista_payload"
+"$TMP_DIR/test_barista_payload"
+
+# The builder is shared with the C++ helpers.
+if command -v "${CXX:-c++}" >/dev/null 2>&1; then
+  "${CC:-cc}" -std=c99 -Wall -Wextra -Werror -c "$ROOT_DIR/helpers/barista_payload.c" \
+    -o "$TMP_DIR/barista_payload.o"
+  "${CC:-cc}" -std=c99 -Wall -Wextra -Werror -c "$ROOT_DIR/helpers/barista_transport.c" \
+    -o "$TMP_DIR/barista_transport.o"
+  "${CXX:-c++}" -std=c++17 -Wall -Wextra -Werror -x c++ \
+    "$ROOT_DIR/tests/test_barista_payload.c" -x none \
+    "$TMP_DIR/barista_payload.o" "$TMP_DIR/barista_transport.o" \
+    -o "$TMP_DIR/test_barista_payload_cxx"
+  "$TMP_DIR/test_barista_payload_cxx"
+fi
+
+printf '%s\n' "barista_payload tests passed"
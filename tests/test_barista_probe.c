@@ -0,0 +1,113 @@
+#define _DEFAULT_SOURCE 1
+
+#include "../helpers/barista_probe.c"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static void test_format_size(void) {
+  char buffer[16];
+  assert(barista_format_size(0, buffer, sizeof(buffer)) && strcmp(buffer, "0B") == 0);
+  assert(barista_format_size(512, buffer, sizeof(buffer)) && strcmp(buffer, "512B") == 0);
+  assert(barista_format_size(1536, buffer, sizeof(buffer)) && strcmp(buffer, "1.5Ki") == 0);
+  assert(barista_format_size(9.5 * 1073741824.0, buffer, sizeof(buffer)));
+  assert(strcmp(buffer, "9.5Gi") == 0);
+  assert(barista_format_size(120ULL << 30, buffer, sizeof(buffer)) && strcmp(buffer, "120Gi") == 0);
+  /* df moves to the next unit rather than print four digits. */
+  assert(barista_format_size(1000ULL << 30, buffer, sizeof(buffer)) && strcmp(buffer, "1.0Ti") == 0);
+  assert(barista_format_size(UINT64_MAX, buffer, sizeof(buffer)) && strcmp(buffer, "16Ei") == 0);
+  assert(!barista_format_size(120ULL << 30, buffer, 5));
+  assert(!barista_format_size(1, NULL, 4));
+}
+
+static void test_disk_usage(void) {
+  BaristaDiskUsage usage;
+  assert(barista_disk_usage("/", &usage));
+  assert(usage.total_bytes > 0);
+  assert(usage.used_bytes <= usage.total_bytes);
+  assert(usage.available_bytes <= usage.total_bytes);
+  assert(usage.percent >= 0 && usage.percent <= 100);
+  assert(!barista_disk_usage("/nonexistent/barista/probe", &usage));
+  assert(!barista_disk_usage(NULL, &usage));
+}
+
+static void test_live_network(void) {
+  char name[64];
+  int route = barista_default_route_interface(name, sizeof(name));
+  assert(route >= -1 && route <= 1);
+  if (route == 1) assert(name[0] != '\0' && strlen(name) < IFNAMSIZ);
+  if (route == 1) {
+    char ssid[64];
+    int wifi = barista_wifi_ssid(name, ssid, sizeof(ssid));
+    assert(wifi >= -1 && wifi <= 1);
+    if (wifi == 1) assert(ssid[0] != '\0');
+  }
+  char ssid[8];
+  assert(barista_wifi_ssid("no-such-if0", ssid, sizeof(ssid)) <= 0);
+  assert(barista_wifi_ssid("an-interface-name-too-long", ssid, sizeof(ssid)) == -1);
+  assert(barista_default_route_interface(name, 0) == -1);
+}
+
+static double now_milliseconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec * 1000.0 + (double)now.tv_nsec / 1000000.0;
+}
+
+static int spawn_df(void) {
+  char *const arguments[] = {"df", "-h", "/", NULL};
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+  pid_t pid = 0;
+  int spawned = posix_spawnp(&pid, "df", &actions, NULL, arguments, environ);
+  posix_spawn_file_actions_destroy(&actions);
+  int status = 0;
+  return spawned == 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status);
+}
+
+/* BARISTA_PROBE_BENCH=N: one popup's worth of probes, native against one
+ * df spawn (the cheapest of the three tools they replace). */
+static void bench(int rounds) {
+  char text[64];
+  char ssid[64];
+  BaristaDiskUsage usage;
+  double start = now_milliseconds();
+  for (int i = 0; i < rounds; i++) {
+    assert(barista_disk_usage("/", &usage));
+    barista_format_size(usage.used_bytes, text, sizeof(text));
+    if (barista_default_route_interface(text, sizeof(text)) == 1) {
+      barista_wifi_ssid(text, ssid, sizeof(ssid));
+    }
+  }
+  double native = (now_milliseconds() - start) / rounds;
+  start = now_milliseconds();
+  for (int i = 0; i < rounds; i++) assert(spawn_df());
+  double spawned = (now_milliseconds() - start) / rounds;
+  fprintf(stderr, "probe bench: native disk+route+ssid %.3f ms, spawned df %.3f ms (%d rounds)\n",
+          native, spawned, rounds);
+}
+
+int main(void) {
+  const char *bench_rounds = getenv("BARISTA_PROBE_BENCH");
+  if (bench_rounds && atoi(bench_rounds) > 0) {
+    bench(atoi(bench_rounds));
+    return 0;
+  }
+
+  test_format_size();
+  test_disk_usage();
+  test_live_network();
+
+  puts("test_barista_probe.c: ok");
+  return 0;
+}
@@ -0,0 +1,32 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "$TMP_DIR"' EXIT
+
+CC_BIN="${CC:-cc}"
+LIBS=()
+if [[ "$(uname -s)" == "Darwin" ]]; then
+  LIBS=(-framework SystemConfiguration -framework CoreFoundation)
+fi
+"$CC_BIN" -std=c99 -Wall -Wextra -Werror -O2 \
+  "$ROOT_DIR/tests/test_barista_probe.c" "$ROOT_DIR/helpers/barista_route.c" \
+  "${LIBS[@]+"${LIBS[@]}"}" -o "$TMP_DIR/test_barista_probe"
+"$TMP_DIR/test_barista_probe" >/dev/null
+
+# The probes exist so a popup refresh starts no processes: count them.
+if [[ "$(uname -s)" == "Linux" ]]; then
+  "$CC_BIN" -std=c99 -Wall -Wextra -Werror -shared -fPIC \
+    -o "$TMP_DIR/spawn_counter.so" "$ROOT_DIR/tests/spawn_counter.c" -ldl
+  : > "$TMP_DIR/spawns.log"
+  BARISTA_SPAWN_LOG="$TMP_DIR/spawns.log" LD_PRELOAD="$TMP_DIR/spawn_counter.so" \
+    "$TMP_DIR/test_barista_probe" >/dev/null
+  if [[ -s "$TMP_DIR/spawns.log" ]]; then
+    echo "FAIL: native probes started processes:" >&2
+    cat "$TMP_DIR/spawns.log" >&2
+    exit 1
+  fi
+fi
+
+printf '%s\n' "barista_probe tests passed"
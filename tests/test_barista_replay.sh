@@ -0,0 +1,113 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+HELPERS="$ROOT_DIR/helpers"
+TMP_DIR="$(mktemp -d)"
+SOCKET_PATH="$TMP_DIR/bar.sock"
+SESSION="$TMP_DIR/session.bin"
+MOCK_PID=""
+
+cleanup() {
+  if [[ -n "$MOCK_PID" ]]; then kill "$MOCK_PID" 2>/dev/null || true; fi
+  rm -rf "$TMP_DIR"
+}
+trap cleanup EXIT
+
+CC_BIN="${CC:-cc}"
+"$CC_BIN" -std=c99 -Wall -Wextra -Werror \
+  "$HELPERS/barista_replay.c" "$HELPERS/barista_transport.c" -o "$TMP_DIR/barista_replay"
+"$CC_BIN" -std=c99 -Wall -Wextra -Werror \
+  "$HELPERS/barista_mock_bar.c" "$HELPERS/barista_transport.c" -o "$TMP_DIR/barista_mock_bar"
+"$CC_BIN" -std=c99 -Wall -Wextra -Werror \
+  "$HELPERS/popup_manager.c" "$HELPERS/barista_transport.c" "$HELPERS/barista_payload.c" \
+  -o "$TMP_DIR/popup_manager"
+
+start_mock() {
+  rm -f "$1"
+  "$TMP_DIR/barista_mock_bar" --socket "$SOCKET_PATH" --auto-add --log "$1" &
+  MOCK_PID=$!
+  for _ in $(seq 100); do [[ -S "$SOCKET_PATH" ]] && break; sleep 0.02; done
+}
+
+stop_mock() {
+  kill "$MOCK_PID"
+  wait "$MOCK_PID" || true
+  MOCK_PID=""
+}
+
+report_value() {
+  grep -E "^$2=" <<<"$1" | cut -d= -f2
+}
+
+# Record a hover sweep from the real helper while it talks to the mock bar.
+mkdir -p "$TMP_DIR/registry"
+printf 'version\t1\nroot\tfront_app\nroot\tcontrol_center\nroot\tclock\n' \
+  > "$TMP_DIR/registry/sketchybar_popup_topology"
+start_mock "$TMP_DIR/recorded.log"
+for item in control_center clock front_app control_center; do
+  TMPDIR="$TMP_DIR/registry" \
+    BARISTA_BUSD_DISABLE=1 \
+    BARISTA_TRANSPORT_SOCKET="$SOCKET_PATH" \
+    BARISTA_RECORD_PATH="$SESSION" \
+    "$TMP_DIR/popup_manager" switch "$item"
+  sleep 0.1
+done
+stop_mock
+
+printed="$("$TMP_DIR/barista_replay" print "$SESSION")"
+[[ "$(wc -l <<<"$printed")" -eq 4 ]]
+sed 's/^+[0-9.]*ms pid=[0-9]* timeout=-\{0,1\}[0-9]* //' <<<"$printed" > "$TMP_DIR/printed.log"
+cmp -s "$TMP_DIR/printed.log" "$TMP_DIR/recorded.log" || {
+  echo "FAIL: recorded session does not match what the bar received" >&2
+  diff "$TMP_DIR/printed.log" "$TMP_DIR/recorded.log" >&2 || true
+  exit 1
+}
+
+# Replay at full speed: the bar sees the same requests in the same order.
+start_mock "$TMP_DIR/replayed.log"
+report="$(BARISTA_BUSD_DISABLE=1 BARISTA_TRANSPORT_SOCKET="$SOCKET_PATH" \
+  "$TMP_DIR/barista_replay" run "$SESSION" --max-rate --timeout-ms 500)"
+[[ "$(report_value "$report" records)" -eq 4 ]]
+[[ "$(report_value "$report" confirmed)" -eq 4 ]]
+[[ "$(report_value "$report" errors)" -eq 0 ]]
+[[ "$(report_value "$report" bytes)" -eq "$(($(wc -c < "$SESSION") - 4 * 24))" ]]
+grep -q '^latency_p99_ns=[1-9]' <<<"$report"
+grep -q '^bytes_per_s=[1-9]' <<<"$report"
+if grep -q '^schedule_lag_max_ns=' <<<"$report"; then
+  echo "FAIL: max-rate replay has no schedule" >&2
+  exit 1
+fi
+cmp -s "$TMP_DIR/replayed.log" "$TMP_DIR/recorded.log"
+
+# Recorded pace keeps the ~0.3s between the first and last switch; --speed
+# compresses it.
+report="$(BARISTA_BUSD_DISABLE=1 BARISTA_TRANSPORT_SOCKET="$SOCKET_PATH" \
+  "$TMP_DIR/barista_replay" "$SESSION" --repeat 2)"
+[[ "$(report_value "$report" records)" -eq 8 ]]
+elapsed="$(report_value "$report" elapsed_ms)"
+[[ "${elapsed%.*}" -ge 600 ]]
+grep -q '^schedule_lag_max_ns=' <<<"$report"
+report="$(BARISTA_BUSD_DISABLE=1 BARISTA_TRANSPORT_SOCKET="$SOCKET_PATH" \
+  "$TMP_DIR/barista_replay" "$SESSION" --speed 10)"
+elapsed="$(report_value "$report" elapsed_ms)"
+[[ "${elapsed%.*}" -lt 200 ]]
+stop_mock
+
+# No backend: every send fails, so the replay fails.
+if BARISTA_BUSD_DISABLE=1 BARISTA_TRANSPORT_SOCKET="$SOCKET_PATH" \
+  "$TMP_DIR/barista_replay" "$SESSION" --max-rate >/dev/null; then
+  echo "FAIL: replay must fail when nothing was delivered" >&2
+  exit 1
+fi
+
+# A short tail from a killed writer is skipped; a corrupt record is refused.
+head -c "$(($(wc -c < "$SESSION") - 3))" "$SESSION" > "$TMP_DIR/truncated.bin"
+[[ "$("$TMP_DIR/barista_replay" print "$TMP_DIR/truncated.bin" 2>/dev/null | wc -l)" -eq 3 ]]
+printf 'XXXX' | cat - "$SESSION" > "$TMP_DIR/corrupt.bin"
+if "$TMP_DIR/barista_replay" print "$TMP_DIR/corrupt.bin" 2>/dev/null; then
+  echo "FAIL: corrupt session must be refused" >&2
+  exit 1
+fi
+
+printf '%s\n' "barista_replay tests passed"
@@ -0,0 +1,103 @@
+#define _DEFAULT_SOURCE 1
+
+#include "../helpers/barista_route.c"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef __APPLE__
+typedef struct {
+  uint8_t bytes[1024];
+  size_t length;
+} Dump;
+
+static void dump_attribute(Dump *dump, struct nlmsghdr *header, unsigned short type, uint32_t value) {
+  struct rtattr *attribute = (struct rtattr *)(dump->bytes + dump->length);
+  attribute->rta_type = type;
+  attribute->rta_len = RTA_LENGTH(sizeof(value));
+  memcpy(RTA_DATA(attribute), &value, sizeof(value));
+  dump->length += RTA_ALIGN(attribute->rta_len);
+  header->nlmsg_len += RTA_ALIGN(attribute->rta_len);
+}
+
+static void dump_route(Dump *dump, uint32_t sequence, uint8_t dst_len, uint8_t table,
+                       uint32_t interface_index, uint32_t priority) {
+  struct nlmsghdr *header = (struct nlmsghdr *)(dump->bytes + dump->length);
+  memset(header, 0, NLMSG_SPACE(sizeof(struct rtmsg)));
+  header->nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+  header->nlmsg_type = RTM_NEWROUTE;
+  header->nlmsg_seq = sequence;
+  struct rtmsg *route = NLMSG_DATA(header);
+  route->rtm_family = AF_INET;
+  route->rtm_dst_len = dst_len;
+  route->rtm_table = table;
+  route->rtm_type = RTN_UNICAST;
+  dump->length += NLMSG_SPACE(sizeof(struct rtmsg));
+  header->nlmsg_len = NLMSG_ALIGN(header->nlmsg_len);
+  dump_attribute(dump, header, RTA_OIF, interface_index);
+  if (priority) dump_attribute(dump, header, RTA_PRIORITY, priority);
+}
+
+static void dump_end(Dump *dump, uint32_t sequence, unsigned short type) {
+  struct nlmsghdr *header = (struct nlmsghdr *)(dump->bytes + dump->length);
+  memset(header, 0, NLMSG_SPACE(sizeof(int)));
+  header->nlmsg_len = NLMSG_LENGTH(sizeof(int));
+  header->nlmsg_type = type;
+  header->nlmsg_seq = sequence;
+  dump->length += NLMSG_SPACE(sizeof(int));
+}
+
+static void test_scan_route_dump(void) {
+  Dump dump = {{0}, 0};
+  DefaultRoute best = {0, 0, 0};
+  dump_route(&dump, 7, 24, RT_TABLE_MAIN, 2, 0);     /* not a default */
+  dump_route(&dump, 7, 0, RT_TABLE_MAIN, 3, 600);
+  dump_route(&dump, 7, 0, RT_TABLE_LOCAL, 4, 1);     /* another table */
+  dump_route(&dump, 8, 0, RT_TABLE_MAIN, 5, 1);      /* another request */
+  dump_route(&dump, 7, 0, RT_TABLE_MAIN, 6, 100);
+  assert(scan_route_dump(dump.bytes, dump.length, 7, &best) == 0);
+  assert(best.found && best.interface_index == 6 && best.priority == 100);
+
+  /* The dump goes on in a second buffer; a later, worse route loses. */
+  Dump more = {{0}, 0};
+  dump_route(&more, 7, 0, RT_TABLE_MAIN, 9, 200);
+  dump_end(&more, 7, NLMSG_DONE);
+  assert(scan_route_dump(more.bytes, more.length, 7, &best) == 1);
+  assert(best.interface_index == 6);
+
+  Dump failed = {{0}, 0};
+  DefaultRoute none = {0, 0, 0};
+  dump_end(&failed, 7, NLMSG_ERROR);
+  assert(scan_route_dump(failed.bytes, failed.length, 7, &none) == -1 && !none.found);
+
+  /* A header claiming more than was received is rejected. */
+  Dump truncated = {{0}, 0};
+  dump_route(&truncated, 7, 0, RT_TABLE_MAIN, 3, 0);
+  assert(scan_route_dump(truncated.bytes, truncated.length - 4, 7, &none) == -1);
+}
+#endif
+
+static void test_live_route(void) {
+  char name[IFNAMSIZ];
+  int route = barista_default_route_interface(name, sizeof(name));
+  assert(route >= -1 && route <= 1);
+  if (route == 1) {
+    assert(name[0] != '\0' && if_nametoindex(name) != 0);
+    /* A name that does not fit is a failed lookup, not "no route". */
+    char tiny[1];
+    assert(barista_default_route_interface(tiny, sizeof(tiny)) == -1);
+  }
+  assert(barista_default_route_interface(name, 0) == -1);
+  assert(barista_default_route_interface(NULL, sizeof(name)) == -1);
+}
+
+int main(void) {
+#ifndef __APPLE__
+  test_scan_route_dump();
+#endif
+  test_live_route();
+
+  puts("test_barista_route.c: ok");
+  return 0;
+}
@@ -0,0 +1,13 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "$TMP_DIR"' EXIT
+
+CC_BIN="${CC:-cc}"
+"$CC_BIN" -std=c99 -Wall -Wextra -Werror -O2 \
+  "$ROOT_DIR/tests/test_barista_route.c" -o "$TMP_DIR/test_barista_route"
+"$TMP_DIR/test_barista_route" >/dev/null
+
+printf '%s\n' "barista_route tests passed"
@@ -0,0 +1,238 @@
+#define _DEFAULT_SOURCE 1
+
+#include "../helpers/event_providers/sketchybar.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static char socket_path[256];
+static char cache_path[256];
+static int record_pipe[2] = {-1, -1};
+
+/* Stand-in bar that answers confirmed requests only after reply_delay_ms,
+ * and writes every request it receives to the record pipe as one line. */
+static void serve(int listener, int reply_delay_ms, pid_t parent) {
+  static uint8_t frame[BARISTA_TRANSPORT_MAX_PAYLOAD_BYTES];
+  for (;;) {
+    /* Exit with a failed test run instead of holding its output open. */
+    struct pollfd descriptor = {.fd = listener, .events = POLLIN};
+    if (poll(&descriptor, 1, 100) <= 0) {
+      if (getppid() != parent) _exit(0);
+      continue;
+    }
+    int client = accept(listener, NULL, NULL);
+    if (client < 0) continue;
+    size_t length = 0;
+    uint32_t flags = 0;
+    while (barista_frame_read(client, frame, sizeof(frame), &length, &flags, -1) == 0) {
+      char line[512];
+      size_t used = 0;
+      for (size_t i = 0; i + 2 < length && used + 1 < sizeof(line); i++) {
+        line[used++] = frame[i] == '\0' ? ' ' : (char)frame[i];
+      }
+      line[used++] = '\n';
+      if (write(record_pipe[1], line, used) != (ssize_t)used) _exit(1);
+      if (flags & BARISTA_FRAME_NO_REPLY) continue;
+      usleep((useconds_t)reply_delay_ms * 1000);
+      if (barista_frame_write(client, "", 1, 0, -1) != 0) break;
+    }
+    close(client);
+  }
+}
+
+static pid_t start_server(int reply_delay_ms) {
+  int listener = barista_socket_listen(socket_path);
+  assert(listener >= 0);
+  pid_t parent = getpid();
+  pid_t pid = fork();
+  assert(pid >= 0);
+  if (pid == 0) {
+    signal(SIGPIPE, SIG_IGN);
+    serve(listener, reply_delay_ms, parent);
+    _exit(0);
+  }
+  close(listener);
+  return pid;
+}
+
+static void stop_server(pid_t pid) {
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+}
+
+static int64_t now_ms(void) {
+  struct timespec value = {0};
+  clock_gettime(CLOCK_MONOTONIC, &value);
+  return (int64_t)value.tv_sec * 1000 + value.tv_nsec / 1000000;
+}
+
+/* Reads recorded request lines until `expected` arrived or 1s passed. */
+static int read_requests(char *buffer, size_t capacity, int expected) {
+  size_t used = 0;
+  int lines = 0;
+  int64_t deadline = now_ms() + 1000;
+  while (lines < expected && now_ms() < deadline) {
+    struct pollfd descriptor = {.fd = record_pipe[0], .events = POLLIN};
+    if (poll(&descriptor, 1, 50) <= 0) continue;
+    ssize_t received = read(record_pipe[0], buffer + used, capacity - used - 1);
+    if (received <= 0) continue;
+    for (ssize_t i = 0; i < received; i++) lines += buffer[used + (size_t)i] == '\n';
+    used += (size_t)received;
+  }
+  /* Anything beyond the expected lines is an unexpected extra request. */
+  struct pollfd descriptor = {.fd = record_pipe[0], .events = POLLIN};
+  while (poll(&descriptor, 1, 50) > 0 && used + 1 < capacity) {
+    ssize_t received = read(record_pipe[0], buffer + used, capacity - used - 1);
+    if (received <= 0) break;
+    for (ssize_t i = 0; i < received; i++) lines += buffer[used + (size_t)i] == '\n';
+    used += (size_t)received;
+  }
+  buffer[used] = '\0';
+  return lines;
+}
+
+static size_t trigger_payload(uint8_t *payload, const char *event, int value) {
+  int written = snprintf((char *)payload, 64, "--trigger%c%s%cvalue=%d%c",
+                         '\0', event, '\0', value, '\0');
+  payload[written] = '\0';
+  return (size_t)written + 1;
+}
+
+/* A stalled bar must not stall the pusher, and only the newest sample of an
+ * event survives while an older one is still waiting. */
+static void test_stalled_bar_keeps_newest_trigger(void) {
+  pid_t server = start_server(80);
+  assert(barista_send_queue_start(4, 1000, 30) == 0);
+  assert(barista_send_queue_start(4, 1000, 30) == -1);
+
+  uint8_t payload[64];
+  int64_t started = now_ms();
+  for (int value = 0; value < 10; value++) {
+    size_t length = trigger_payload(payload, "cpu_update", value);
+    assert(barista_send_queue_push("cpu_update", payload, length) != BARISTA_QUEUE_REFUSED);
+  }
+  assert(now_ms() - started < 40);
+  assert(barista_send_queue_drain(2000));
+
+  BaristaSendQueueStats stats;
+  barista_send_queue_stats(&stats);
+  assert(stats.queued == 10);
+  assert(stats.failed == 0);
+  assert(stats.sent >= 1 && stats.sent <= 2);
+  assert(stats.sent + stats.dropped == 10);
+  assert(stats.depth == 0);
+  /* The second delivery waited in the queue for the first reply. */
+  if (stats.sent == 2) assert(stats.late == 1 && stats.max_delay_ms >= 30);
+
+  char requests[4096];
+  assert(read_requests(requests, sizeof(requests), (int)stats.sent) == (int)stats.sent);
+  assert(strstr(requests, "--trigger cpu_update value=9\n") != NULL);
+  assert(strstr(requests, "value=5") == NULL);
+
+  barista_send_queue_stop();
+  stop_server(server);
+}
+
+/* Unkeyed payloads never replace each other; a full queue refuses them. */
+static void test_full_queue_refuses_unkeyed(void) {
+  pid_t server = start_server(80);
+  assert(barista_send_queue_start(2, 1000, 0) == 0);
+  uint8_t payload[64];
+  int refused = 0;
+  for (int value = 0; value < 6; value++) {
+    size_t length = trigger_payload(payload, "network_update", value);
+    BaristaQueuePush outcome = barista_send_queue_push(NULL, payload, length);
+    assert(outcome != BARISTA_QUEUE_REPLACED);
+    refused += outcome == BARISTA_QUEUE_REFUSED;
+  }
+  assert(refused >= 3);
+  const uint8_t invalid[] = {'x', 0};
+  assert(barista_send_queue_push(NULL, invalid, sizeof(invalid)) == BARISTA_QUEUE_REFUSED);
+
+  /* Stop delivers what was accepted before the thread exits. */
+  barista_send_queue_stop();
+  BaristaSendQueueStats stats;
+  barista_send_queue_stats(&stats);
+  assert(stats.sent == 6 - (uint64_t)refused);
+  assert(stats.dropped == (uint64_t)refused);
+  assert(stats.late == 0);
+  char requests[4096];
+  assert(read_requests(requests, sizeof(requests), (int)stats.sent) == (int)stats.sent);
+  assert(barista_send_queue_push(NULL, payload, 5) == BARISTA_QUEUE_REFUSED);
+  stop_server(server);
+}
+
+/* The provider path: unchanged triggers are skipped before they reach the
+ * queue, changed ones go out through the sender thread. */
+static void test_provider_triggers(void) {
+  pid_t server = start_server(0);
+  setenv("BARISTA_PROVIDER_SYNC", "1", 1);
+  assert(!sketchybar_async_start(1000));
+  unsetenv("BARISTA_PROVIDER_SYNC");
+  assert(sketchybar_async_start(1000));
+
+  const char *names[] = {"user_load", "total_load"};
+  const char *first[] = {"7", "12"};
+  const char *second[] = {"7", "13"};
+  sketchybar_trigger("cpu_update", 2, names, first);
+  assert(barista_send_queue_drain(1000));
+  sketchybar_trigger("cpu_update", 2, names, first);
+  assert(barista_send_queue_drain(1000));
+  sketchybar_trigger("cpu_update", 2, names, second);
+  assert(barista_send_queue_drain(1000));
+
+  char requests[4096];
+  assert(read_requests(requests, sizeof(requests), 2) == 2);
+  assert(strcmp(requests,
+                "--trigger cpu_update user_load=7 total_load=12\n"
+                "--trigger cpu_update user_load=7 total_load=13\n") == 0);
+
+  BaristaSendQueueStats stats;
+  barista_send_queue_stats(&stats);
+  assert(stats.queued == 2 && stats.sent == 2 && stats.failed == 0);
+  barista_send_queue_stop();
+  stop_server(server);
+}
+
+/* Once the bar is gone, deliveries fail and the probe reports it. */
+static void test_bar_gone(void) {
+  assert(barista_send_queue_start(4, 0, 0) == 0);
+  uint8_t payload[64];
+  size_t length = trigger_payload(payload, "cpu_update", 1);
+  assert(barista_send_queue_push("cpu_update", payload, length) == BARISTA_QUEUE_ACCEPTED);
+  assert(barista_send_queue_drain(2000));
+  BaristaSendQueueStats stats;
+  barista_send_queue_stats(&stats);
+  assert(stats.failed == 1 && stats.sent == 0);
+  assert(barista_send_queue_bar_gone());
+  barista_send_queue_stop();
+}
+
+int main(void) {
+  signal(SIGPIPE, SIG_IGN);
+  const char *tmpdir = getenv("TMPDIR");
+  if (!tmpdir || tmpdir[0] == '\0') tmpdir = "/tmp";
+  snprintf(socket_path, sizeof(socket_path), "%s/barista-send-queue-test.%ld.sock",
+           tmpdir, (long)getpid());
+  snprintf(cache_path, sizeof(cache_path), "%s/barista-send-queue-cache.%ld",
+           tmpdir, (long)getpid());
+  setenv("BARISTA_TRANSPORT_SOCKET", socket_path, 1);
+  setenv("BARISTA_SENT_CACHE_PATH", cache_path, 1);
+  setenv("BARISTA_BUSD_DISABLE", "1", 1);
+  assert(pipe(record_pipe) == 0);
+
+  test_stalled_bar_keeps_newest_trigger();
+  test_full_queue_refuses_unkeyed();
+  test_provider_triggers();
+  test_bar_gone();
+
+  unlink(socket_path);
+  unlink(cache_path);
+  puts("test_barista_send_queue.c: ok");
+  return 0;
+}
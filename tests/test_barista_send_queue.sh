@@ -0,0 +1,15 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "$TMP_DIR"' EXIT
+
+"${CC:-cc}" -std=c99 -Wall -Wextra -Werror \
+  "$ROOT_DIR/tests/test_barista_send_queue.c" "$ROOT_DIR/helpers/barista_transport.c" \
+  "$ROOT_DIR/helpers/barista_sent_cache.c" "$ROOT_DIR/helpers/barista_send_queue.c" \
+  "$ROOT_DIR/helpers/barista_payload.c" \
+  -lpthread -o "$TMP_DIR/test_barista_send_queue"
+TMPDIR="$TMP_DIR" "$TMP_DIR/test_barista_send_queue"
+
+printf '%s\n' "barista_send_queue tests passed"
@@ -0,0 +1,152 @@
+#define _DEFAULT_SOURCE 1
+
+#include "../helpers/barista_sent_cache.c"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static char cache_path[256];
+
+static int check(const char *scope, const char *name, const char *value) {
+  BaristaSentEntry entry;
+  return barista_sent_cache_check(scope, name, value, &entry);
+}
+
+static void record(const char *scope, const char *name, const char *value) {
+  BaristaSentEntry entry;
+  barista_sent_cache_check(scope, name, value, &entry);
+  barista_sent_cache_record(&entry);
+}
+
+static void test_path(void) {
+  char buffer[256];
+  assert(barista_sent_cache_path(buffer, sizeof(buffer)));
+  assert(strcmp(buffer, cache_path) == 0);
+  assert(!barista_sent_cache_path(buffer, 4));
+
+  unsetenv("BARISTA_SENT_CACHE_PATH");
+  setenv("BAR_NAME", "../escape", 1);
+  assert(!barista_sent_cache_path(buffer, sizeof(buffer)));
+  setenv("BAR_NAME", "work", 1);
+  assert(barista_sent_cache_path(buffer, sizeof(buffer)));
+  assert(strstr(buffer, "/barista_sent_cache.work") != NULL);
+  unsetenv("BAR_NAME");
+  setenv("BARISTA_SENT_CACHE_PATH", cache_path, 1);
+}
+
+static void test_check_record_forget(void) {
+  assert(!check("cpu", "label", "42%"));
+  record("cpu", "label", "42%");
+  assert(check("cpu", "label", "42%"));
+  assert(!check("cpu", "label", "43%"));
+  assert(!check("memory", "label", "42%"));
+  assert(!check("cpu", "icon", "42%"));
+
+  /* The scope separator keeps "ab"+"c" apart from "a"+"bc". */
+  record("ab", "c", "v");
+  assert(!check("a", "bc", "v"));
+
+  BaristaSentEntry entry;
+  assert(check("cpu", "label", "42%"));
+  barista_sent_cache_check("cpu", "label", "42%", &entry);
+  barista_sent_cache_forget(&entry);
+  assert(!check("cpu", "label", "42%"));
+
+  assert(!barista_sent_cache_check(NULL, "label", "x", &entry));
+  assert(entry.key == 0);
+  barista_sent_cache_record(&entry);
+  barista_sent_cache_record(NULL);
+}
+
+static void test_resync(void) {
+  record("network", "upload", "12 KB/s");
+  record("network", "download", "4 MB/s");
+  assert(check("network", "upload", "12 KB/s"));
+  barista_sent_cache_resync();
+  assert(!check("network", "upload", "12 KB/s"));
+  assert(!check("network", "download", "4 MB/s"));
+  record("network", "upload", "12 KB/s");
+  assert(check("network", "upload", "12 KB/s"));
+}
+
+/* Providers are separate processes; a value recorded by one suppresses the
+ * same value from another, and the environment override resyncs once. */
+static int run_child(const char *resync, const char *value) {
+  pid_t pid = fork();
+  assert(pid >= 0);
+  if (pid == 0) {
+    if (resync) setenv("BARISTA_SENT_CACHE_RESYNC", resync, 1);
+    g_resynced = 0;
+    _exit(check("shared", "label", value) ? 1 : 0);
+  }
+  int status = 0;
+  assert(waitpid(pid, &status, 0) == pid);
+  assert(WIFEXITED(status));
+  return WEXITSTATUS(status);
+}
+
+static void test_shared_between_processes(void) {
+  pid_t pid = fork();
+  assert(pid >= 0);
+  if (pid == 0) {
+    record("shared", "label", "on");
+    _exit(0);
+  }
+  assert(waitpid(pid, NULL, 0) == pid);
+  assert(check("shared", "label", "on"));
+  assert(run_child(NULL, "on") == 1);
+  assert(run_child(NULL, "off") == 0);
+  assert(run_child("1", "on") == 0);
+  assert(!check("shared", "label", "on"));
+}
+
+static void test_disable(void) {
+  pid_t pid = fork();
+  assert(pid >= 0);
+  if (pid == 0) {
+    setenv("BARISTA_SENT_CACHE_DISABLE", "1", 1);
+    g_disabled = -1;
+    record("disabled", "label", "x");
+    _exit(check("disabled", "label", "x") ? 1 : 0);
+  }
+  int status = 0;
+  assert(waitpid(pid, &status, 0) == pid);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  assert(!check("disabled", "label", "x"));
+}
+
+/* Removing the file (a bar reload) drops every entry; a long-lived process
+ * notices once the mapping is revalidated. */
+static void test_file_removal(void) {
+  record("reload", "label", "x");
+  assert(check("reload", "label", "x"));
+  assert(unlink(cache_path) == 0);
+  usleep(1100 * 1000);
+  assert(!check("reload", "label", "x"));
+  assert(access(cache_path, F_OK) == 0);
+}
+
+int main(void) {
+  const char *tmpdir = getenv("TMPDIR");
+  if (!tmpdir || tmpdir[0] == '\0') tmpdir = "/tmp";
+  snprintf(cache_path, sizeof(cache_path), "%s/barista-sent-cache-test.%ld",
+           tmpdir, (long)getpid());
+  setenv("BARISTA_SENT_CACHE_PATH", cache_path, 1);
+  unsetenv("BARISTA_SENT_CACHE_RESYNC");
+  unsetenv("BARISTA_SENT_CACHE_DISABLE");
+
+  test_path();
+  test_check_record_forget();
+  test_resync();
+  test_shared_between_processes();
+  test_disable();
+  test_file_removal();
+
+  unlink(cache_path);
+  puts("test_barista_sent_cache.c: ok");
+  return 0;
+}
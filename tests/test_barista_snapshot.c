@@ -0,0 +1,374 @@
+#define _DEFAULT_SOURCE 1
+
+#include "../helpers/barista_json.c"
+#include "../helpers/barista_snapshot.c"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+  BaristaSnapshot snapshot;
+  void *data;
+  size_t size;
+} Built;
+
+static void build(const char *text, Built *built) {
+  assert(barista_snapshot_build(text, strlen(text), &built->data, &built->size) == 1);
+  assert(barista_snapshot_open(&built->snapshot, built->data, built->size) == 1);
+  assert(barista_snapshot_matches(&built->snapshot, text, strlen(text)));
+}
+
+static const BaristaSnapshotNode *node_at(const Built *built, uint32_t index) {
+  assert(index < built->snapshot.header->node_count);
+  return &built->snapshot.nodes[index];
+}
+
+static const BaristaSnapshotNode *lookup(const Built *built, uint32_t object, const char *key) {
+  uint32_t index = barista_snapshot_find(&built->snapshot, object, key, strlen(key));
+  return index ? node_at(built, index) : NULL;
+}
+
+static const char *string_of(const Built *built, const BaristaSnapshotNode *node) {
+  assert(node && node->type == BARISTA_SNAPSHOT_STRING);
+  return built->snapshot.strings + node->first;
+}
+
+static void test_values(void) {
+  Built built;
+  build("{\"name\": \"bar\\t\\u00e9\", \"empty\": \"\", \"on\": true, \"off\": false, \"none\": null,"
+        " \"count\": 28, \"negative\": -3, \"scale\": 1.0, \"exp\": 1e2, \"big\": 1152921504606846976,"
+        " \"nested\": {\"deep\": {\"x\": 1}}, \"list\": [1, null, \"two\", []]}", &built);
+  assert(node_at(&built, 0)->type == BARISTA_SNAPSHOT_OBJECT);
+  assert(node_at(&built, 0)->count == 12);
+
+  assert(strcmp(string_of(&built, lookup(&built, 0, "name")), "bar\t\xC3\xA9") == 0);
+  assert(lookup(&built, 0, "name")->count == 6);
+  assert(lookup(&built, 0, "empty")->first == 0 && lookup(&built, 0, "empty")->count == 0);
+  assert(lookup(&built, 0, "on")->type == BARISTA_SNAPSHOT_BOOL && lookup(&built, 0, "on")->count == 1);
+  assert(lookup(&built, 0, "off")->type == BARISTA_SNAPSHOT_BOOL && lookup(&built, 0, "off")->count == 0);
+  assert(lookup(&built, 0, "none")->type == BARISTA_SNAPSHOT_NULL);
+  assert(lookup(&built, 0, "missing") == NULL);
+  assert(barista_snapshot_find(&built.snapshot, 0, "nam", 3) == 0);
+
+  /* What tonumber makes of the same text. */
+  assert(lookup(&built, 0, "count")->type == BARISTA_SNAPSHOT_INTEGER);
+  assert(lookup(&built, 0, "count")->value.integer == 28);
+  assert(lookup(&built, 0, "negative")->value.integer == -3);
+  assert(lookup(&built, 0, "scale")->type == BARISTA_SNAPSHOT_NUMBER);
+  assert(lookup(&built, 0, "scale")->value.number == 1.0);
+  assert(lookup(&built, 0, "exp")->type == BARISTA_SNAPSHOT_NUMBER);
+  assert(lookup(&built, 0, "big")->type == BARISTA_SNAPSHOT_NUMBER);
+
+  uint32_t nested = barista_snapshot_find(&built.snapshot, 0, "nested", 6);
+  uint32_t deep = barista_snapshot_find(&built.snapshot, nested, "deep", 4);
+  assert(deep > nested && lookup(&built, deep, "x")->value.integer == 1);
+  assert(barista_snapshot_find(&built.snapshot, deep + 1, "x", 1) == 0);
+
+  /* Arrays keep nulls in place, so the Lua side can leave the same holes. */
+  const BaristaSnapshotNode *list = lookup(&built, 0, "list");
+  assert(list->type == BARISTA_SNAPSHOT_ARRAY && list->count == 4);
+  const BaristaSnapshotMember *second = barista_snapshot_member(&built.snapshot, list, 1);
+  assert(second->key == 0 && second->key_length == 0);
+  assert(node_at(&built, second->node)->type == BARISTA_SNAPSHOT_NULL);
+  assert(strcmp(string_of(&built, node_at(&built, barista_snapshot_member(&built.snapshot, list, 2)->node)), "two") == 0);
+  assert(node_at(&built, barista_snapshot_member(&built.snapshot, list, 3)->node)->count == 0);
+  free(built.data);
+
+  build("\"just a string\"", &built);
+  assert(built.snapshot.header->node_count == 1);
+  assert(strcmp(string_of(&built, node_at(&built, 0)), "just a string") == 0);
+  free(built.data);
+}
+
+static void test_keys(void) {
+  Built built;
+  build("{\"b\": 1, \"a\": 2, \"ab\": 3, \"b\": 4, \"\": 5, \"a\": {\"z\": 0}, \"b\": 6}", &built);
+  const BaristaSnapshotNode *root = node_at(&built, 0);
+  assert(root->count == 4);
+
+  /* Sorted by bytes then length; the last of each duplicate wins. */
+  static const char *const kOrder[] = {"", "a", "ab", "b"};
+  for (uint32_t i = 0; i < root->count; i++) {
+    const BaristaSnapshotMember *member = barista_snapshot_member(&built.snapshot, root, i);
+    assert(member->key_length == strlen(kOrder[i]));
+    assert(strcmp(built.snapshot.strings + member->key, kOrder[i]) == 0);
+  }
+  assert(lookup(&built, 0, "b")->value.integer == 6);
+  assert(lookup(&built, 0, "a")->type == BARISTA_SNAPSHOT_OBJECT);
+  assert(lookup(&built, 0, "")->value.integer == 5);
+  free(built.data);
+
+  /* Enough keys that the merge runs several passes. */
+  char text[8192];
+  size_t used = (size_t)snprintf(text, sizeof(text), "{");
+  for (int i = 99; i >= 0; i--) {
+    used += (size_t)snprintf(text + used, sizeof(text) - used, "%s\"key%d\": %d", i == 99 ? "" : ", ", i * 7 % 100, i);
+  }
+  snprintf(text + used, sizeof(text) - used, "}");
+  build(text, &built);
+  root = node_at(&built, 0);
+  assert(root->count == 100);
+  for (uint32_t i = 1; i < root->count; i++) {
+    const BaristaSnapshotMember *before = barista_snapshot_member(&built.snapshot, root, i - 1);
+    const BaristaSnapshotMember *after = barista_snapshot_member(&built.snapshot, root, i);
+    assert(strcmp(built.snapshot.strings + before->key, built.snapshot.strings + after->key) < 0);
+  }
+  for (int i = 0; i < 100; i++) {
+    char key[16];
+    snprintf(key, sizeof(key), "key%d", i * 7 % 100);
+    assert(lookup(&built, 0, key)->value.integer == i);
+  }
+  free(built.data);
+}
+
+static void test_unrepresented(void) {
+  void *data = NULL;
+  size_t size = 0;
+  assert(barista_snapshot_build("{\"a\": ", 6, &data, &size) == 0);
+  assert(barista_snapshot_build("", 0, &data, &size) == 0);
+  assert(barista_snapshot_build("[\"a\\u0000\"]", 11, &data, &size) == -1);
+  assert(data == NULL);
+}
+
+static void test_matches(void) {
+  const char *text = "{\"a\": 1}";
+  Built built;
+  build(text, &built);
+  assert(built.snapshot.header->source_bytes == strlen(text));
+  assert(built.snapshot.header->source_hash == barista_snapshot_hash(text, strlen(text)));
+  assert(!barista_snapshot_matches(&built.snapshot, "{\"a\": 2}", 8));
+  assert(!barista_snapshot_matches(&built.snapshot, "{\"a\": 1} ", 9));
+  /* Known FNV-1a 64 vectors. */
+  assert(barista_snapshot_hash("", 0) == 0xcbf29ce484222325ull);
+  assert(barista_snapshot_hash("a", 1) == 0xaf63dc4c8601ec8cull);
+  free(built.data);
+}
+
+static void test_rejected(void) {
+  Built built;
+  build("{\"list\": [1, {\"k\": \"v\"}], \"s\": \"text\"}", &built);
+  unsigned char *copy = malloc(built.size);
+  assert(copy);
+  BaristaSnapshot snapshot;
+  BaristaSnapshotHeader *header = (BaristaSnapshotHeader *)copy;
+
+#define RESET() memcpy(copy, built.data, built.size)
+  RESET();
+  assert(barista_snapshot_open(&snapshot, copy, built.size) == 1);
+  for (size_t size = 0; size < built.size; size++) {
+    if (size >= header->strings + header->string_bytes) break;
+    assert(barista_snapshot_open(&snapshot, copy, size) == 0);
+  }
+  assert(barista_snapshot_open(&snapshot, NULL, built.size) == 0);
+
+  header->magic ^= 1;
+  assert(barista_snapshot_open(&snapshot, copy, built.size) == 0);
+  RESET();
+  header->version++;
+  assert(barista_snapshot_open(&snapshot, copy, built.size) == 0);
+  RESET();
+  header->node_count = UINT32_MAX;
+  assert(barista_snapshot_open(&snapshot, copy, built.size) == 0);
+  RESET();
+  header->nodes += 4;
+  assert(barista_snapshot_open(&snapshot, copy, built.size) == 0);
+
+  RESET();
+  BaristaSnapshotNode *nodes = (BaristaSnapshotNode *)(copy + header->nodes);
+  BaristaSnapshotMember *members = (BaristaSnapshotMember *)(copy + header->members);
+  RESET();
+  nodes[0].type = 99;
+  assert(barista_snapshot_open(&snapshot, copy, built.size) == 0);
+  RESET();
+  nodes[0].count = header->member_count + 1;
+  assert(barista_snapshot_open(&snapshot, copy, built.size) == 0);
+
+  /* A member pointing back up the tree would make a cycle. */
+  RESET();
+  members[0].node = 0;
+  assert(barista_snapshot_open(&snapshot, copy, built.size) == 0);
+  RESET();
+  members[0].node = header->node_count;
+  assert(barista_snapshot_open(&snapshot, copy, built.size) == 0);
+
+  /* Strings have to end inside the arena, on a NUL. */
+  uint32_t text = barista_snapshot_find(&built.snapshot, 0, "s", 1);
+  RESET();
+  nodes[text].count--;
+  assert(barista_snapshot_open(&snapshot, copy, built.size) == 0);
+  RESET();
+  nodes[text].first = header->string_bytes;
+  assert(barista_snapshot_open(&snapshot, copy, built.size) == 0);
+  RESET();
+  members[0].key_length = UINT32_MAX;
+  assert(barista_snapshot_open(&snapshot, copy, built.size) == 0);
+#undef RESET
+
+  free(copy);
+  free(built.data);
+}
+
+static void test_write_file(void) {
+  char directory[] = "/tmp/barista_snapshot_XXXXXX";
+  assert(mkdtemp(directory));
+  char path[256];
+  snprintf(path, sizeof(path), "%s/state.json.snapshot", directory);
+
+  const char *text = "{\"widgets\": {\"clock\": true}}";
+  assert(barista_snapshot_write_file(path, text, strlen(text)) == 1);
+  assert(barista_snapshot_write_file(path, "{", 1) == 0);
+
+  FILE *file = fopen(path, "rb");
+  assert(file);
+  static uint64_t buffer[512];
+  size_t size = fread(buffer, 1, sizeof(buffer), file);
+  fclose(file);
+  BaristaSnapshot snapshot;
+  assert(barista_snapshot_open(&snapshot, buffer, size) == 1);
+  assert(barista_snapshot_matches(&snapshot, text, strlen(text)));
+
+  char leftover[300];
+  snprintf(leftover, sizeof(leftover), "%s.tmp.%d", path, (int)getpid());
+  assert(access(leftover, F_OK) != 0);
+
+  snprintf(path, sizeof(path), "%s/missing/state.json.snapshot", directory);
+  assert(barista_snapshot_write_file(path, text, strlen(text)) == -1);
+
+  snprintf(path, sizeof(path), "%s/state.json.snapshot", directory);
+  unlink(path);
+  rmdir(directory);
+}
+
+/* Reads every node reachable from `index`, as a loader would. */
+static size_t visit(const BaristaSnapshot *snapshot, uint32_t index) {
+  const BaristaSnapshotNode *node = &snapshot->nodes[index];
+  size_t visited = 1;
+  if (node->type == BARISTA_SNAPSHOT_OBJECT || node->type == BARISTA_SNAPSHOT_ARRAY) {
+    for (uint32_t i = 0; i < node->count; i++) {
+      visited += visit(snapshot, barista_snapshot_member(snapshot, node, i)->node);
+    }
+  }
+  return visited;
+}
+
+/* Flips bytes in valid snapshots: opening never reads out of bounds, and
+ * whatever opens can be walked. */
+static void fuzz(int iterations) {
+  static const char *const kSeeds[] = {
+    "{\"a\": [1, 2.5, \"x\", null, true], \"b\": {\"c\": {\"d\": []}}, \"e\": \"\"}",
+    "[[[[\"deep\"]]], {\"k\": {}}, -1e-3]",
+  };
+  unsigned int seed = 0x5eedu;
+  for (int iteration = 0; iteration < iterations; iteration++) {
+    const char *text = kSeeds[iteration % 2];
+    void *data = NULL;
+    size_t size = 0;
+    assert(barista_snapshot_build(text, strlen(text), &data, &size) == 1);
+    unsigned char *bytes = data;
+    int flips = 1 + (int)(rand_r(&seed) % 4);
+    for (int flip = 0; flip < flips; flip++) bytes[rand_r(&seed) % size] ^= (unsigned char)(1u << (rand_r(&seed) % 8));
+    size_t cut = rand_r(&seed) % 8 == 0 ? rand_r(&seed) % size : size;
+    BaristaSnapshot snapshot;
+    if (barista_snapshot_open(&snapshot, data, cut)) {
+      assert(visit(&snapshot, 0) >= 1);
+      barista_snapshot_find(&snapshot, 0, "a", 1);
+    }
+    free(data);
+  }
+}
+
+/* BARISTA_SNAPSHOT_BENCH=N: load a 1 MB state.json N times, walking the
+ * whole JSON text against checking and walking a snapshot of it. The
+ * snapshot side includes hashing the JSON to prove it is current. */
+static char *build_state(size_t target, size_t *length) {
+  size_t capacity = target + 4096;
+  char *text = malloc(capacity);
+  assert(text);
+  size_t used = (size_t)snprintf(text, capacity,
+    "{\n  \"_version\": 3,\n  \"widgets\": {\"system_info\": true, \"network\": true, \"clock\": true},\n"
+    "  \"appearance\": {\"theme\": \"default\", \"bar_height\": 28, \"bar_color\": \"0xC021162F\","
+    " \"widget_scale\": 1.0, \"hover_color\": \"0x40f5c2e7\"},\n"
+    "  \"window_defaults\": {\"apps\": {");
+  for (int app = 0; used < target; app++) {
+    used += (size_t)snprintf(text + used, capacity - used,
+      "%s\n    \"com.example.app%d\": {\"space\": %d, \"display\": 1, \"floating\": %s,"
+      " \"title\": \"Window \\\"%d\\\" \\u2014 caf\\u00e9\", \"frame\": [%d, %d, 1280.5, 800.25],"
+      " \"tags\": [\"work\", \"focus\", null]}",
+      app ? "," : "", app, app % 9, app % 2 ? "true" : "false", app, app * 3, app * 7);
+  }
+  used += (size_t)snprintf(text + used, capacity - used, "\n  }}\n}\n");
+  *length = used;
+  return text;
+}
+
+static int count_value(void *context, const char *key, size_t key_length, const BaristaJsonValue *value) {
+  (void)key;
+  (void)key_length;
+  (void)value;
+  (*(size_t *)context)++;
+  return 1;
+}
+
+static double now_milliseconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec * 1000.0 + (double)now.tv_nsec / 1000000.0;
+}
+
+static void bench(int rounds) {
+  size_t length = 0;
+  char *text = build_state(1 << 20, &length);
+  static const BaristaJsonVisitor counter = {count_value, NULL};
+  void *data = NULL;
+  size_t size = 0;
+  assert(barista_snapshot_build(text, length, &data, &size) == 1);
+
+  size_t walked = 0;
+  double start = now_milliseconds();
+  for (int round = 0; round < rounds; round++) {
+    walked = 0;
+    assert(barista_json_walk(text, length, &counter, &walked, NULL) == 1);
+  }
+  double walking = (now_milliseconds() - start) / rounds;
+
+  size_t visited = 0;
+  start = now_milliseconds();
+  for (int round = 0; round < rounds; round++) {
+    BaristaSnapshot snapshot;
+    assert(barista_snapshot_open(&snapshot, data, size) == 1);
+    assert(barista_snapshot_matches(&snapshot, text, length));
+    visited = visit(&snapshot, 0);
+  }
+  double loading = (now_milliseconds() - start) / rounds;
+  assert(visited == walked);
+
+  fprintf(stderr, "snapshot bench: %.2f MB state.json, %zu values: json walk %.3f ms, snapshot %.3f ms"
+          " (%.2f MB file, %d rounds)\n",
+          (double)length / (1 << 20), walked, walking, loading, (double)size / (1 << 20), rounds);
+  free(data);
+  free(text);
+}
+
+int main(void) {
+  const char *bench_rounds = getenv("BARISTA_SNAPSHOT_BENCH");
+  if (bench_rounds && atoi(bench_rounds) > 0) {
+    bench(atoi(bench_rounds));
+    return 0;
+  }
+
+  test_values();
+  test_keys();
+  test_unrepresented();
+  test_matches();
+  test_rejected();
+  test_write_file();
+  const char *fuzz_iterations = getenv("BARISTA_SNAPSHOT_FUZZ");
+  fuzz(fuzz_iterations && atoi(fuzz_iterations) > 0 ? atoi(fuzz_iterations) : 20000);
+
+  puts("test_barista_snapshot.c: ok");
+  return 0;
+}
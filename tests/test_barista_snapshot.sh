@@ -0,0 +1,37 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "$TMP_DIR"' EXIT
+
+CC_BIN="${CC:-cc}"
+"$CC_BIN" -std=c99 -Wall -Wextra -Werror -O2 \
+  "$ROOT_DIR/tests/test_barista_snapshot.c" -o "$TMP_DIR/test_barista_snapshot"
+"$TMP_DIR/test_barista_snapshot" >/dev/null
+
+# The fuzz pass again under ASan/UBSan, where the toolchain has them.
+if "$CC_BIN" -std=c99 -O1 -g -fsanitize=address,undefined -fno-sanitize-recover=all \
+    "$ROOT_DIR/tests/test_barista_snapshot.c" -o "$TMP_DIR/test_barista_snapshot_asan" 2>/dev/null \
+    && "$TMP_DIR/test_barista_snapshot_asan" >/dev/null 2>&1 </dev/null; then
+  BARISTA_SNAPSHOT_FUZZ=100000 "$TMP_DIR/test_barista_snapshot_asan" >/dev/null
+fi
+
+# The Lua module CMake built, loaded by a real interpreter: it must give the
+# same tables json.lua decodes from the state.json the snapshot was made from.
+MODULE="$ROOT_DIR/bin/barista_snapshot.so"
+if command -v lua >/dev/null 2>&1 && [ -f "$MODULE" ] && [ -x "$ROOT_DIR/bin/state_manager" ]; then
+  STATE_DIR="$TMP_DIR/.config/sketchybar"
+  mkdir -p "$STATE_DIR"
+  cat > "$STATE_DIR/state.json" <<'JSON'
+{"_version": 2, "profile": "work", "widgets": {"clock": true, "battery": false},
+ "appearance": {"bar_height": 28, "corner_radius": 0, "widget_scale": 1.25, "bar_color": "0xC021162F"},
+ "space_icons": {"1": "\u2318", "2": "term"}, "space_modes": {"3": "bsp"},
+ "menus": {"calendar": {"task_sources": ["~/tasks.md"], "meeting_cache_file": ""}},
+ "integrations": {"yaze": {"enabled": false, "recent": [[1, 2.5], {"a": "b"}]}}}
+JSON
+  HOME="$TMP_DIR" "$ROOT_DIR/bin/state_manager" snapshot >/dev/null
+  BARISTA_CONFIG_DIR="$ROOT_DIR" lua "$ROOT_DIR/scripts/bench_state_load.lua" 3 "$STATE_DIR/state.json" >/dev/null
+fi
+
+printf '%s\n' "barista_snapshot tests passed"
@@ -0,0 +1,305 @@
+#define _DEFAULT_SOURCE 1
+
+#include "../helpers/barista_top.c"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SECOND 1000000000ull
+
+static char work_dir[512];
+
+static int near(double value, double expected) {
+  return fabs(value - expected) < 1e-6;
+}
+
+static void test_observe(void) {
+  BaristaTop *top = barista_top_create(NULL);
+  assert(top);
+  BaristaTopProcess processes[8];
+
+  barista_top_begin(top, 10 * SECOND);
+  assert(barista_top_observe(top, 1, 100, 2 * SECOND, "steady"));
+  assert(barista_top_observe(top, 2, 100, 5 * SECOND, "idle"));
+  assert(barista_top_observe(top, 3, 100, 9 * SECOND, "reused"));
+  assert(barista_top_observe(top, 7, 100, 4 * SECOND, "backwards"));
+  assert(barista_top_observe(top, 9, 100, 1 * SECOND, "gone"));
+  assert(!barista_top_observe(top, -1, 0, 0, "invalid"));
+  /* One scan has nothing to compare against. */
+  assert(barista_top_interval_ns(top) == 0);
+  assert(barista_top_select(top, processes, 8) == 0);
+
+  barista_top_begin(top, 12 * SECOND);
+  barista_top_observe(top, 1, 100, 3 * SECOND, "steady");
+  barista_top_observe(top, 2, 100, 5 * SECOND, "idle");
+  barista_top_observe(top, 3, 200, SECOND / 5, "reused");
+  barista_top_observe(top, 4, 100, SECOND / 2, "new");
+  barista_top_observe(top, 7, 100, 3 * SECOND, "backwards");
+  assert(barista_top_interval_ns(top) == 2 * SECOND);
+  assert(barista_top_select(top, processes, 3) == 3);
+  assert(processes[0].pid == 1 && near(processes[0].cpu_percent, 50.0));
+  assert(strcmp(processes[0].name, "steady") == 0);
+  /* New and reused pids count everything they used. */
+  assert(processes[1].pid == 4 && near(processes[1].cpu_percent, 25.0));
+  assert(processes[2].pid == 3 && near(processes[2].cpu_percent, 10.0));
+  /* Equal loads order by pid; a counter going backwards reads as idle. */
+  assert(barista_top_select(top, processes, 8) == 5);
+  assert(processes[3].pid == 2 && processes[4].pid == 7 && processes[4].cpu_percent == 0.0);
+
+  /* A clock that went backwards gives no interval. */
+  barista_top_begin(top, 11 * SECOND);
+  barista_top_observe(top, 1, 100, 4 * SECOND, "steady");
+  assert(barista_top_select(top, processes, 8) == 0);
+  assert(barista_top_select(NULL, processes, 8) == 0);
+  barista_top_destroy(top);
+}
+
+static uint32_t next_random(uint32_t *state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 8;
+}
+
+static int compare_busier(const void *left, const void *right) {
+  const TopCandidate *a = left;
+  const TopCandidate *b = right;
+  return busier(a, b) ? -1 : busier(b, a) ? 1 : 0;
+}
+
+/* The partial selection must agree with a full sort, including with many
+ * equal loads and sparse pids that collide in the hash. */
+static void test_selection_matches_sort(void) {
+  enum { COUNT = 5000 };
+  static TopCandidate expected[COUNT];
+  static BaristaTopProcess processes[COUNT];
+  uint32_t seed = 12345;
+  BaristaTop *top = barista_top_create(NULL);
+  assert(top);
+  barista_top_begin(top, 0);
+  for (int i = 0; i < COUNT; i++) barista_top_observe(top, i * 4096 + 1, 1, 0, "p");
+  barista_top_begin(top, SECOND);
+  for (int i = 0; i < COUNT; i++) {
+    uint64_t delta = (uint64_t)(next_random(&seed) % 64) * 1000000ull;
+    expected[i].pid = i * 4096 + 1;
+    expected[i].delta_ns = delta;
+    barista_top_observe(top, expected[i].pid, 1, delta, "p");
+  }
+  qsort(expected, COUNT, sizeof(expected[0]), compare_busier);
+  const size_t wanted[] = {1, 5, 50, COUNT, COUNT + 10};
+  for (size_t w = 0; w < sizeof(wanted) / sizeof(wanted[0]); w++) {
+    size_t count = barista_top_select(top, processes, wanted[w]);
+    assert(count == (wanted[w] < COUNT ? wanted[w] : COUNT));
+    for (size_t i = 0; i < count; i++) {
+      assert(processes[i].pid == expected[i].pid);
+      assert(near(processes[i].cpu_percent, (double)expected[i].delta_ns * 100.0 / SECOND));
+    }
+  }
+  barista_top_destroy(top);
+}
+
+#ifndef __APPLE__
+static void test_parse_stat(void) {
+  char name[BARISTA_TOP_NAME_BYTES];
+  uint64_t ticks = 0;
+  uint64_t start = 0;
+  assert(parse_proc_stat("42 (bash) S 1 42 42 34816 42 4194304 100 0 0 0 17 4 0 0 20 0 1 0 "
+                         "5555 1000 200\n",
+                         name, sizeof(name), &ticks, &start));
+  assert(strcmp(name, "bash") == 0 && ticks == 21 && start == 5555);
+  /* Command names may contain spaces and parentheses. */
+  assert(parse_proc_stat("7 (Web (x) Content) R 1 7 7 0 -1 0 0 0 0 0 3 2 0 0 20 0 1 0 9\n",
+                         name, sizeof(name), &ticks, &start));
+  assert(strcmp(name, "Web (x) Content") == 0 && ticks == 5 && start == 9);
+  assert(parse_proc_stat("8 (an-unusually-long-process-name-here) S 1 1 1 0 -1 0 0 0 0 0 1 1 "
+                         "0 0 20 0 1 0 3\n",
+                         name, sizeof(name), &ticks, &start));
+  assert(strlen(name) == BARISTA_TOP_NAME_BYTES - 1);
+  assert(!parse_proc_stat("9 (short) S 1 1 1 0 -1 0 0 0 0 0 1 1\n", name, sizeof(name), &ticks,
+                          &start));
+  assert(!parse_proc_stat("9 short S 1 1 1\n", name, sizeof(name), &ticks, &start));
+  assert(!parse_proc_stat("9 (x) S 1 1 1 0 -1 0 0 0 0 0 a b 0 0 20 0 1 0 3\n", name,
+                          sizeof(name), &ticks, &start));
+}
+
+static uint64_t fixture_ticks(int index, int round) {
+  return (uint64_t)index * 7 + (uint64_t)round * (uint64_t)(index % 97);
+}
+
+/* Writes a fake /proc with `count` processes; each one's tick counter grows
+ * by index % 97 per round. */
+static void write_proc_fixture(const char *root, int count, int round) {
+  char path[1024];
+  mkdir(root, 0700);
+  for (int i = 0; i < count; i++) {
+    snprintf(path, sizeof(path), "%s/%d", root, 1000 + i);
+    mkdir(path, 0700);
+    snprintf(path, sizeof(path), "%s/%d/stat", root, 1000 + i);
+    FILE *file = fopen(path, "w");
+    assert(file);
+    unsigned long long ticks = fixture_ticks(i, round);
+    fprintf(file,
+            "%d (worker %d) S 1 1 1 0 -1 4194304 0 0 0 0 %llu %llu 0 0 20 0 1 0 %d 1000 200\n",
+            1000 + i, i, ticks / 2, ticks - ticks / 2, 100 + i);
+    fclose(file);
+  }
+  /* Entries the walk must skip. */
+  snprintf(path, sizeof(path), "%s/self", root);
+  mkdir(path, 0700);
+  snprintf(path, sizeof(path), "%s/99999", root);
+  mkdir(path, 0700);
+  snprintf(path, sizeof(path), "%s/123abc", root);
+  mkdir(path, 0700);
+}
+
+static void test_proc_fixture(void) {
+  enum { COUNT = 2500 };
+  char root[600];
+  char state[600];
+  snprintf(root, sizeof(root), "%s/proc", work_dir);
+  snprintf(state, sizeof(state), "%s/barista_top.state", work_dir);
+  write_proc_fixture(root, COUNT, 0);
+
+  BaristaTop *top = barista_top_create(root);
+  assert(top);
+  assert(barista_top_scan(top, 100 * SECOND) == COUNT);
+  assert(barista_top_save(top, state));
+  write_proc_fixture(root, COUNT, 1);
+  assert(barista_top_scan(top, 101 * SECOND) == COUNT);
+  /* 99999 has no stat: it exited, which is not hiding. */
+  assert(barista_top_hidden(top) == 0);
+
+  /* Busiest: the largest index % 97, lowest pid first among equals. */
+  uint64_t tick_ns = top->tick_ns;
+  BaristaTopProcess processes[4];
+  assert(barista_top_select(top, processes, 4) == 4);
+  assert(processes[0].pid == 1096 && strcmp(processes[0].name, "worker 96") == 0);
+  assert(near(processes[0].cpu_percent, 96.0 * (double)tick_ns * 100.0 / SECOND));
+  assert(processes[1].pid == 1193 && processes[2].pid == 1290 && processes[3].pid == 1387);
+  barista_top_destroy(top);
+
+  /* A later run picks up from the saved scan. */
+  top = barista_top_create(root);
+  assert(barista_top_load(top, state));
+  assert(barista_top_scan(top, 101 * SECOND) == COUNT);
+  assert(barista_top_interval_ns(top) == SECOND);
+  assert(barista_top_select(top, processes, 1) == 1 && processes[0].pid == 1096);
+  barista_top_destroy(top);
+
+  /* A stat this user may not read is counted as hidden; root reads it. */
+  char refused[700];
+  snprintf(refused, sizeof(refused), "%s/1000/stat", root);
+  assert(chmod(refused, 0) == 0);
+  top = barista_top_create(root);
+  int seen = barista_top_scan(top, 102 * SECOND);
+  if (geteuid() == 0) assert(seen == COUNT && barista_top_hidden(top) == 0);
+  else assert(seen == COUNT - 1 && barista_top_hidden(top) == 1);
+  assert(chmod(refused, 0600) == 0);
+  barista_top_destroy(top);
+
+  /* A missing tree is a failed scan and no baseline. */
+  top = barista_top_create("/nonexistent/proc");
+  assert(barista_top_scan(top, SECOND) == -1);
+  assert(!barista_top_save(top, state));
+  barista_top_destroy(top);
+}
+
+static void benchmark(long iterations) {
+  char root[600];
+  snprintf(root, sizeof(root), "%s/bench_proc", work_dir);
+  write_proc_fixture(root, 2000, 0);
+  BaristaTop *top = barista_top_create(root);
+  BaristaTopProcess processes[5];
+  struct timespec start;
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (long i = 0; i < iterations; i++) {
+    barista_top_scan(top, (uint64_t)(i + 1) * SECOND);
+    barista_top_select(top, processes, 5);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("scan+select, 2000 /proc entries: %.1f us\n", seconds * 1e6 / (double)iterations);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (long i = 0; i < iterations; i++) {
+    barista_top_begin(top, (uint64_t)(i + 1) * SECOND);
+    for (int pid = 1; pid <= 2000; pid++) {
+      barista_top_observe(top, pid, 1, (uint64_t)i * (uint64_t)(pid % 89), "bench");
+    }
+    barista_top_select(top, processes, 5);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("observe+select, 2000 processes: %.1f us\n", seconds * 1e6 / (double)iterations);
+  barista_top_destroy(top);
+}
+#endif
+
+static void test_state_file(void) {
+  char path[600];
+  char buffer[1024];
+  snprintf(path, sizeof(path), "%s/barista_top.bad", work_dir);
+  unlink(path);
+  BaristaTop *top = barista_top_create(NULL);
+  assert(!barista_top_load(top, path));
+  FILE *file = fopen(path, "w");
+  assert(file && fputs("not a scan", file) >= 0);
+  fclose(file);
+  assert(!barista_top_load(top, path));
+
+  /* A saved empty scan still round-trips. */
+  barista_top_begin(top, 5);
+  assert(barista_top_save(top, path));
+  assert(barista_top_load(top, path));
+  barista_top_destroy(top);
+
+  assert(barista_top_state_path(buffer, sizeof(buffer)));
+  assert(strstr(buffer, "/barista_top.sketchybar") != NULL);
+  setenv("BAR_NAME", "work", 1);
+  assert(barista_top_state_path(buffer, sizeof(buffer)));
+  assert(strstr(buffer, "/barista_top.work") != NULL);
+  setenv("BAR_NAME", "../escape", 1);
+  assert(!barista_top_state_path(buffer, sizeof(buffer)));
+  unsetenv("BAR_NAME");
+  assert(!barista_top_state_path(buffer, 8));
+}
+
+static void test_live_scan(void) {
+  BaristaTop *top = barista_top_create(NULL);
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t start = (uint64_t)now.tv_sec * SECOND + (uint64_t)now.tv_nsec;
+  assert(barista_top_scan(top, start) > 0);
+  volatile uint64_t spin = 0;
+  for (long i = 0; i < 20000000; i++) spin += (uint64_t)i;
+  assert(barista_top_scan(top, start + SECOND / 10) > 0);
+  BaristaTopProcess processes[5];
+  size_t count = barista_top_select(top, processes, 5);
+  assert(count > 0);
+  for (size_t i = 1; i < count; i++) assert(processes[i].cpu_percent <= processes[i - 1].cpu_percent);
+  barista_top_destroy(top);
+}
+
+int main(void) {
+  const char *tmpdir = getenv("TMPDIR");
+  snprintf(work_dir, sizeof(work_dir), "%s", tmpdir ? tmpdir : "/tmp");
+
+  test_observe();
+  test_selection_matches_sort();
+  test_state_file();
+  test_live_scan();
+#ifndef __APPLE__
+  test_parse_stat();
+  test_proc_fixture();
+  const char *iterations = getenv("BARISTA_TOP_BENCH");
+  if (iterations && atol(iterations) > 0) benchmark(atol(iterations));
+#endif
+
+  puts("test_barista_top.c: ok");
+  return 0;
+}
@@ -0,0 +1,243 @@
+#define _DEFAULT_SOURCE 1
+
+#include "../helpers/barista_transport.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static char socket_path[256];
+
+/* Stand-in bar: answers "[!]" for a leading --fail token, stalls on --hang,
+ * answers --reused with success only while every request so far arrived on
+ * one connection, and otherwise replies with an empty success string. */
+static void serve(int listener) {
+  static uint8_t frame[BARISTA_TRANSPORT_MAX_PAYLOAD_BYTES];
+  int accepts = 0;
+  for (;;) {
+    int client = accept(listener, NULL, NULL);
+    if (client < 0) continue;
+    accepts++;
+    size_t length = 0;
+    uint32_t flags = 0;
+    while (barista_frame_read(client, frame, sizeof(frame), &length, &flags, -1) == 0) {
+      if (flags & BARISTA_FRAME_NO_REPLY) continue;
+      char response[64] = "";
+      if (strcmp((const char *)frame, "--fail") == 0) {
+        snprintf(response, sizeof(response), "[!] Set: Item not found 'x'");
+      } else if (strcmp((const char *)frame, "--hang") == 0) {
+        usleep(200 * 1000);
+        snprintf(response, sizeof(response), "late");
+      } else if (strcmp((const char *)frame, "--reused") == 0 && accepts != 1) {
+        snprintf(response, sizeof(response), "[!] accepted %d connections", accepts);
+      }
+      if (barista_frame_write(client, response, strlen(response) + 1, 0, -1) != 0) break;
+    }
+    close(client);
+  }
+}
+
+static pid_t start_server(void) {
+  int listener = barista_socket_listen(socket_path);
+  assert(listener >= 0);
+  pid_t pid = fork();
+  assert(pid >= 0);
+  if (pid == 0) {
+    signal(SIGPIPE, SIG_IGN);
+    serve(listener);
+    _exit(0);
+  }
+  close(listener);
+  return pid;
+}
+
+static void stop_server(pid_t pid) {
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+}
+
+static BaristaSendResult send_tokens(const char *first, int timeout_ms) {
+  uint8_t payload[128];
+  size_t length = strlen(first) + 1;
+  memcpy(payload, first, length);
+  memcpy(payload + length, "item\0", 5);
+  length += 5;
+  payload[length++] = 0;
+  return barista_send(payload, length, timeout_ms);
+}
+
+static void test_response_status(void) {
+  const char success[] = "";
+  const char notice[] = "[?] informational response";
+  const char failure[] = "[!] Item not found";
+  const char unterminated[] = {'o', 'k'};
+  const char embedded[] = {'o', 'k', '\0', '[', '!', ']', '\0'};
+  assert(barista_response_status(success, sizeof(success)) == 1);
+  assert(barista_response_status(notice, sizeof(notice)) == 1);
+  assert(barista_response_status(failure, sizeof(failure)) == 0);
+  assert(barista_response_status(unterminated, sizeof(unterminated)) < 0);
+  assert(barista_response_status(embedded, sizeof(embedded)) == 1);
+  assert(barista_response_status(NULL, 1) < 0);
+  assert(barista_response_status(success, BARISTA_TRANSPORT_MAX_RESPONSE_BYTES + 1) < 0);
+}
+
+static void test_payload_validation(void) {
+  const uint8_t valid[] = {'-', '-', 's', 'e', 't', 0, 0};
+  const uint8_t unterminated[] = {'-', '-', 's', 'e', 't', 0};
+  const uint8_t empty[] = {0, 0};
+  assert(barista_payload_valid(valid, sizeof(valid)));
+  assert(!barista_payload_valid(unterminated, sizeof(unterminated)));
+  assert(!barista_payload_valid(empty, sizeof(empty)));
+  assert(!barista_payload_valid(valid, BARISTA_TRANSPORT_MAX_PAYLOAD_BYTES + 1));
+  assert(barista_send(unterminated, sizeof(unterminated), 100) == BARISTA_SEND_NOT_SENT);
+}
+
+static void test_missing_backend(void) {
+  unsetenv("BARISTA_TRANSPORT_SOCKET");
+#ifndef __APPLE__
+  assert(barista_transport_backend() == BARISTA_TRANSPORT_NONE);
+  assert(send_tokens("--set", 100) == BARISTA_SEND_NOT_SENT);
+#endif
+  setenv("BARISTA_TRANSPORT_SOCKET", socket_path, 1);
+  assert(barista_transport_backend() == BARISTA_TRANSPORT_SOCKET);
+  assert(send_tokens("--set", 100) == BARISTA_SEND_NOT_SENT);
+  assert(!barista_transport_probe());
+}
+
+static void test_socket_round_trips(void) {
+  pid_t server = start_server();
+  assert(barista_transport_probe());
+  for (int i = 0; i < 64; i++) {
+    assert(send_tokens("--set", 500) == BARISTA_SEND_CONFIRMED_SUCCESS);
+  }
+  assert(send_tokens("--fail", 500) == BARISTA_SEND_CONFIRMED_ERROR);
+  assert(send_tokens("--set", 0) == BARISTA_SEND_SENT_UNCONFIRMED);
+  assert(send_tokens("--set", 500) == BARISTA_SEND_CONFIRMED_SUCCESS);
+  assert(send_tokens("--reused", 500) == BARISTA_SEND_CONFIRMED_SUCCESS);
+
+  /* A stalled reply is reported as unconfirmed and must not be mistaken for
+   * the answer to the next request. */
+  assert(send_tokens("--hang", 20) == BARISTA_SEND_SENT_UNCONFIRMED);
+  assert(send_tokens("--fail", 1000) == BARISTA_SEND_CONFIRMED_ERROR);
+  assert(send_tokens("--set", 1000) == BARISTA_SEND_CONFIRMED_SUCCESS);
+
+  /* A restarted bar breaks the cached connection; the retry reconnects. */
+  stop_server(server);
+  server = start_server();
+  assert(send_tokens("--set", 1000) == BARISTA_SEND_CONFIRMED_SUCCESS);
+  stop_server(server);
+  assert(send_tokens("--set", 100) == BARISTA_SEND_NOT_SENT);
+}
+
+/* Record mode: concurrent processes append whole records to one session,
+ * including payloads no backend accepted. */
+static void test_record_mode(void) {
+  char record_path[300];
+  snprintf(record_path, sizeof(record_path), "%s.record", socket_path);
+  unlink(record_path);
+  setenv("BARISTA_RECORD_PATH", record_path, 1);
+  assert(send_tokens("--set", -1) == BARISTA_SEND_NOT_SENT);
+  assert(send_tokens("--fail", 0) == BARISTA_SEND_NOT_SENT);
+
+  enum { WRITERS = 4, SENDS = 200 };
+  for (int writer = 0; writer < WRITERS; writer++) {
+    pid_t child = fork();
+    assert(child >= 0);
+    if (child == 0) {
+      for (int i = 0; i < SENDS; i++) send_tokens("--trigger", 0);
+      _exit(0);
+    }
+  }
+  for (int writer = 0; writer < WRITERS; writer++) assert(wait(NULL) > 0);
+  unsetenv("BARISTA_RECORD_PATH");
+  assert(send_tokens("--set", 0) == BARISTA_SEND_NOT_SENT);
+
+  static uint8_t session[64 * 1024];
+  int fd = open(record_path, O_RDONLY);
+  assert(fd >= 0);
+  ssize_t size = read(fd, session, sizeof(session));
+  close(fd);
+  assert(size > 0 && (size_t)size < sizeof(session));
+
+  size_t offset = 0;
+  int records = 0;
+  uint64_t last_ns[WRITERS + 1] = {0};
+  uint32_t pids[WRITERS + 1] = {0};
+  while (offset < (size_t)size) {
+    BaristaRecordHeader header;
+    assert(barista_record_decode(session + offset, &header) == 0);
+    const uint8_t *payload = session + offset + BARISTA_RECORD_HEADER_BYTES;
+    assert(barista_payload_valid(payload, header.length));
+    if (records == 0) {
+      assert(strcmp((const char *)payload, "--set") == 0);
+      assert(header.timeout_ms == BARISTA_TRANSPORT_DEFAULT_TIMEOUT_MS);
+      assert(header.pid == (uint32_t)getpid());
+    } else if (records == 1) {
+      assert(strcmp((const char *)payload, "--fail") == 0 && header.timeout_ms == 0);
+    } else {
+      assert(strcmp((const char *)payload, "--trigger") == 0);
+    }
+    /* Each process's records stay in order. */
+    int slot = 0;
+    while (slot <= WRITERS && pids[slot] != 0 && pids[slot] != header.pid) slot++;
+    assert(slot <= WRITERS);
+    pids[slot] = header.pid;
+    assert(header.timestamp_ns >= last_ns[slot]);
+    last_ns[slot] = header.timestamp_ns;
+    offset += BARISTA_RECORD_HEADER_BYTES + header.length;
+    records++;
+  }
+  assert(offset == (size_t)size);
+  assert(records == 2 + WRITERS * SENDS);
+
+  uint8_t bad[BARISTA_RECORD_HEADER_BYTES];
+  memcpy(bad, session, sizeof(bad));
+  bad[0] ^= 0xff;
+  BaristaRecordHeader header;
+  assert(barista_record_decode(bad, &header) == -1);
+  unlink(record_path);
+}
+
+static void benchmark(long iterations) {
+  pid_t server = start_server();
+  struct timespec start = {0};
+  struct timespec end = {0};
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (long i = 0; i < iterations; i++) {
+    assert(send_tokens("--set", 500) == BARISTA_SEND_CONFIRMED_SUCCESS);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  stop_server(server);
+  double seconds = (double)(end.tv_sec - start.tv_sec)
+    + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("barista_send: %ld confirmed sends in %.3fs (%.1f us/send)\n",
+         iterations, seconds, seconds * 1e6 / (double)iterations);
+}
+
+int main(void) {
+  signal(SIGPIPE, SIG_IGN);
+  const char *tmpdir = getenv("TMPDIR");
+  if (!tmpdir || tmpdir[0] == '\0') tmpdir = "/tmp";
+  snprintf(socket_path, sizeof(socket_path), "%s/barista-transport-test.%ld.sock",
+           tmpdir, (long)getpid());
+
+  test_response_status();
+  test_payload_validation();
+  test_missing_backend();
+  test_socket_round_trips();
+  test_record_mode();
+
+  const char *iterations = getenv("BARISTA_TRANSPORT_BENCH");
+  if (iterations && atol(iterations) > 0) benchmark(atol(iterations));
+
+  unlink(socket_path);
+  puts("test_barista_transport.c: ok");
+  return 0;
+}
@@ -0,0 +1,411 @@
+#define _DEFAULT_SOURCE 1
+
+#include "../helpers/event_providers/cpu_load/cpu.h"
+#include "../helpers/event_providers/network_load/network.h"
+#include "../helpers/event_providers/metrics_provider/memory.h"
+#include "../helpers/event_providers/sketchybar.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <time.h>
+
+static char fixture_dir[256];
+
+static const char *fixture(const char *name) {
+  static char path[320];
+  snprintf(path, sizeof(path), "%s/%s", fixture_dir, name);
+  return path;
+}
+
+/* Rewrites in place, so a provider's open descriptor sees the new text. */
+static void write_fixture(const char *name, const char *text) {
+  FILE *file = fopen(fixture(name), "w");
+  assert(file);
+  fputs(text, file);
+  fclose(file);
+}
+
+static void test_scanner(void) {
+  static struct proc_file file;
+  write_fixture("scan", "alpha:  12 x\n\n  beta 18446744073709551615\n");
+  assert(proc_file_open(&file, fixture("scan")) == 0);
+  assert(proc_file_read(&file) == 0);
+
+  struct proc_scanner scanner = proc_scan_begin(&file);
+  const char *word = NULL;
+  uint64_t value = 0;
+  assert(proc_scan_word(&scanner, &word) == 5 && memcmp(word, "alpha", 5) == 0);
+  assert(proc_scan_char(&scanner, ':'));
+  assert(proc_scan_u64(&scanner, &value) && value == 12);
+  assert(!proc_scan_u64(&scanner, &value));
+  assert(proc_scan_next_line(&scanner));
+  assert(proc_scan_word(&scanner, &word) == 0);
+  assert(proc_scan_next_line(&scanner));
+  assert(proc_scan_word(&scanner, &word) == 4 && memcmp(word, "beta", 4) == 0);
+  assert(!proc_scan_char(&scanner, ':'));
+  assert(proc_scan_u64(&scanner, &value) && value == UINT64_MAX);
+  assert(!proc_scan_next_line(&scanner));
+  proc_file_close(&file);
+}
+
+static void test_cpu_loads(void) {
+  static struct cpu cpu;
+  write_fixture("stat",
+                "cpu  100 0 100 800 0 0 0 0 0 0\n"
+                "cpu0 50 0 50 400 0 0 0 0 0 0\n"
+                "cpu1 50 0 50 400 0 0 0 0 0 0\n"
+                "intr 12345 1 2 3\n"
+                "ctxt 99\n");
+  assert(cpu_init_path(&cpu, fixture("stat")));
+  int fd = cpu.stat.fd;
+  cpu_update(&cpu);
+  assert(cpu.has_prev_load && cpu.core_count == 2);
+  assert(cpu.total_load == 0);
+
+  /* cpu0 is busy (user + nice, system + irq + softirq), cpu1 waits on I/O;
+   * steal counts toward the total only. */
+  write_fixture("stat",
+                "cpu  170 10 120 840 40 5 5 10 0 0\n"
+                "cpu0 110 10 70 400 0 5 5 0 0 0\n"
+                "cpu1 60 0 50 440 40 0 0 10 0 0\n"
+                "intr 12399 1 2 3\n");
+  cpu_update(&cpu);
+  assert(cpu.stat.fd == fd);
+  assert(cpu.user_load == 40 && cpu.sys_load == 15);
+  assert(cpu.iowait_load == 20 && cpu.total_load == 55);
+  assert(cpu.cores[0].user == 70 && cpu.cores[0].sys == 30 && cpu.cores[0].total == 100);
+  assert(cpu.cores[1].user == 10 && cpu.cores[1].iowait == 40 && cpu.cores[1].total == 10);
+
+  char loads[64];
+  cpu_format_core_loads(&cpu, loads, sizeof(loads));
+  assert(strcmp(loads, "100,10") == 0);
+  cpu_format_core_loads(&cpu, loads, 6);
+  assert(strcmp(loads, "100") == 0);
+
+  /* cpu1 went offline and its counters restarted lower when it returned. */
+  write_fixture("stat", "cpu  180 10 130 940 40 5 5 10 0 0\ncpu0 120 10 80 480 0 5 5 0 0 0\n");
+  cpu_update(&cpu);
+  assert(cpu.core_count == 1 && cpu.cores[0].total == 20);
+  write_fixture("stat",
+                "cpu  190 10 150 1060 40 5 5 10 0 0\n"
+                "cpu0 125 10 95 580 0 5 5 0 0 0\n"
+                "cpu1 5 0 5 10 0 0 0 0 0 0\n");
+  cpu_update(&cpu);
+  assert(cpu.core_count == 2 && cpu.cores[1].total == 50);
+
+  /* A garbled core row fails the sample without touching the loads. */
+  write_fixture("stat", "cpu  1 2 3\n");
+  cpu_update(&cpu);
+  assert(cpu.core_count == 2 && cpu.cores[1].total == 50);
+  proc_file_close(&cpu.stat);
+}
+
+static void test_network_rates(void) {
+  static struct network network;
+  const char *header =
+    "Inter-|   Receive                            |  Transmit\n"
+    " face |bytes    packets errs drop fifo frame compressed multicast|bytes ...\n";
+  char text[512];
+  snprintf(text, sizeof(text),
+           "%s    lo: 5000 10 0 0 0 0 0 0 5000 10 0 0 0 0 0 0\n"
+           "  eth0: 1000 1 0 0 0 0 0 0 2000 2 0 0 0 0 0 0\n", header);
+  write_fixture("net_dev", text);
+  network_init_path(&network, "eth0", fixture("net_dev"));
+  uint64_t now = 5000000000ull;
+  assert(!network_update_at(&network, now));
+  assert(network.ibytes == 1000 && network.obytes == 2000);
+  assert(network.down == 0 && network.up == 0);
+
+  /* Two seconds: 3000 B/s down, 999 B/s up. */
+  snprintf(text, sizeof(text),
+           "%s    lo: 9000 10 0 0 0 0 0 0 9000 10 0 0 0 0 0 0\n"
+           "  eth0:7000 1 0 0 0 0 0 0 3998 2 0 0 0 0 0 0\n", header);
+  write_fixture("net_dev", text);
+  now += 2000000000ull;
+  assert(network_update_at(&network, now));
+  assert(network.down == 3 && strcmp(unit_str[network.down_unit], "KBps") == 0);
+  assert(network.up == 999 && network.up_unit == UNIT_BPS);
+  assert(network.down_rate == 3000.0 && network.up_rate == 999.0);
+
+  /* 2.5 GB/s stays in MBps rather than keeping the previous reading. */
+  snprintf(text, sizeof(text),
+           "%s  eth0: 2500007000 1 0 0 0 0 0 0 3998 2 0 0 0 0 0 0\n", header);
+  write_fixture("net_dev", text);
+  now += 1000000000ull;
+  network_update_at(&network, now);
+  assert(network.down == 2500 && network.down_unit == UNIT_MBPS);
+  assert(network.up == 0 && network.up_unit == UNIT_BPS);
+
+  /* A reset interface reads as idle. */
+  snprintf(text, sizeof(text), "%s  eth0: 10 1 0 0 0 0 0 0 20 2 0 0 0 0 0 0\n", header);
+  write_fixture("net_dev", text);
+  now += 1000000000ull;
+  network_update_at(&network, now);
+  assert(network.down == 0 && network.up == 0);
+  proc_file_close(&network.dev);
+}
+
+/* Stands in for barista_default_route_interface(): "" answers no route. */
+static char fake_route[IFNAMSIZ];
+
+static int fake_default_route(char *buffer, size_t capacity) {
+  if (fake_route[0] == '\0') return 0;
+  snprintf(buffer, capacity, "%s", fake_route);
+  return 1;
+}
+
+static void test_network_tracking(void) {
+  static struct network network;
+  const char *header =
+    "Inter-|   Receive                            |  Transmit\n"
+    " face |bytes    packets errs drop fifo frame compressed multicast|bytes ...\n";
+  char text[1024];
+  snprintf(text, sizeof(text),
+           "%s    lo: 5000 1 0 0 0 0 0 0 5000 1 0 0 0 0 0 0\n"
+           "  eth0: 1000 1 0 0 0 0 0 0 2000 2 0 0 0 0 0 0\n"
+           " wlan0: 90000 1 0 0 0 0 0 0 80000 2 0 0 0 0 0 0\n", header);
+  write_fixture("net_dev", text);
+  char dev_path[320];
+  snprintf(dev_path, sizeof(dev_path), "%s", fixture("net_dev"));
+  snprintf(fake_route, sizeof(fake_route), "eth0");
+  network_init_paths(&network, "default", dev_path, fake_default_route);
+  assert(network.mode == NETWORK_DEFAULT_ROUTE && network.route_fd >= 0);
+  assert(network.member_count == 1 && strcmp(network.members[0], "eth0") == 0);
+
+  uint64_t now = 1000000000ull;
+  network_update_at(&network, now);
+  assert(network.ibytes == 1000);
+
+  /* The default route moves to Wi-Fi. The change restarts the baseline
+   * instead of reading wlan0's total as a burst. */
+  snprintf(fake_route, sizeof(fake_route), "wlan0");
+  network_request_resolve(&network);
+  now += 1000000000ull;
+  assert(!network_update_at(&network, now));
+  assert(strcmp(network.members[0], "wlan0") == 0);
+  assert(network.ibytes == 90000 && network.down == 0);
+  snprintf(text, sizeof(text),
+           "%s  eth0: 1000 1 0 0 0 0 0 0 2000 2 0 0 0 0 0 0\n"
+           " wlan0: 92000 1 0 0 0 0 0 0 80500 2 0 0 0 0 0 0\n", header);
+  write_fixture("net_dev", text);
+  now += 1000000000ull;
+  assert(network_update_at(&network, now));
+  assert(network.down == 2 && network.down_unit == UNIT_KBPS);
+  assert(network.up == 500 && network.up_unit == UNIT_BPS);
+
+  /* Offline: no default route keeps measuring the last interface. */
+  fake_route[0] = '\0';
+  network_request_resolve(&network);
+  now += 1000000000ull;
+  network_update_at(&network, now);
+  assert(network.member_count == 1 && strcmp(network.members[0], "wlan0") == 0);
+  assert(network.down == 0 && network.up == 0);
+
+  char interfaces[64];
+  network_format_interfaces(&network, interfaces, sizeof(interfaces));
+  assert(strcmp(interfaces, "wlan0") == 0);
+  close(network.route_fd);
+  proc_file_close(&network.dev);
+
+  /* The real lookup: whatever it answers, "default" stays well formed. */
+  network_init(&network, "default");
+  assert(network.mode == NETWORK_DEFAULT_ROUTE && network.resolves == 1);
+  assert(network.member_count <= 1);
+  if (network.member_count == 1) assert(if_nametoindex(network.members[0]) != 0);
+  if (network.route_fd >= 0) close(network.route_fd);
+  proc_file_close(&network.dev);
+
+  /* "all" sums every running interface except loopback. */
+  network_init_paths(&network, "all", "/proc/net/dev", fake_default_route);
+  assert(network.mode == NETWORK_ALL && network.resolves == 1);
+  for (int i = 0; i < network.member_count; i++) assert(strcmp(network.members[i], "lo") != 0);
+  close(network.route_fd);
+  proc_file_close(&network.dev);
+
+  /* A fixed interface is read by name and needs no notifications. */
+  network_init_paths(&network, "eth0", dev_path, fake_default_route);
+  assert(network.mode == NETWORK_FIXED && network.route_fd < 0 && network.resolves == 0);
+  proc_file_close(&network.dev);
+}
+
+static void test_memory(void) {
+  static struct memory memory;
+  write_fixture("meminfo",
+                "MemTotal:       16000000 kB\n"
+                "MemFree:         1000000 kB\n"
+                "MemAvailable:   12000000 kB\n"
+                "Buffers:          100000 kB\n");
+  memory_init_path(&memory, fixture("meminfo"));
+  memory_update(&memory);
+  assert(memory.total_bytes == 16000000ull * 1024);
+  assert(memory.used_bytes == 4000000ull * 1024);
+  assert(memory.used_percent == 25);
+  proc_file_close(&memory.meminfo);
+}
+
+/* The real files parse, whatever the machine. */
+static void test_live_proc(void) {
+  static struct cpu cpu;
+  static struct memory memory;
+  assert(cpu_init_path(&cpu, "/proc/stat"));
+  cpu_update(&cpu);
+  usleep(20000);
+  cpu_update(&cpu);
+  assert(cpu.core_count >= 1);
+  assert(cpu.total_load >= 0 && cpu.total_load <= 100);
+  for (int i = 0; i < cpu.core_count; i++) assert(cpu.cores[i].total <= 100);
+  proc_file_close(&cpu.stat);
+
+  memory_init(&memory);
+  memory_update(&memory);
+  assert(memory.used_percent > 0 && memory.used_percent <= 100);
+  proc_file_close(&memory.meminfo);
+}
+
+/* Nanoseconds past the last multiple of the period on the wall clock. */
+static uint64_t wall_offset(uint64_t period_ns) {
+  return sketchybar_clock_ns(CLOCK_REALTIME) % period_ns;
+}
+
+static int near_boundary(uint64_t offset, uint64_t phase, uint64_t period, uint64_t slack) {
+  uint64_t distance = (offset + period - phase) % period;
+  return distance <= slack || period - distance <= slack;
+}
+
+static void test_schedule_alignment(void) {
+  static struct sketchybar_schedule schedule;
+  const uint64_t period = 50000000ull;
+  const uint64_t slack = 15000000ull;
+  unsetenv("BARISTA_PROVIDER_PHASE_MS");
+  setenv("BARISTA_PROVIDER_JITTER", "1", 1);
+  sketchybar_schedule_init(&schedule, 0.05);
+  assert(schedule.period_ns == period && schedule.phase_ns == 0 && schedule.report_jitter);
+
+  /* Per-tick work does not push later ticks off the boundaries. */
+  uint64_t first = 0;
+  for (int i = 0; i < 10; i++) {
+    sketchybar_schedule_wait(&schedule);
+    assert(near_boundary(wall_offset(period), 0, period, slack));
+    if (i == 0) first = schedule.target_ns;
+    usleep(10000);
+  }
+  assert(schedule.target_ns - first == 9 * period);
+  assert(schedule.ticks == 10 && schedule.missed == 0);
+  assert(schedule.jitter_max_ns >= schedule.jitter_ns);
+
+  const char *names[2] = { "load" };
+  const char *values[2] = { "1" };
+  assert(sketchybar_schedule_variable(&schedule, 1, names, values) == 2);
+  assert(strcmp(names[1], "tick_jitter_us") == 0 && values[1] == schedule.jitter_value);
+
+  /* A stall longer than a period skips the lost ticks, counts them and
+   * lands back on a boundary. */
+  usleep(130000);
+  uint64_t before = schedule.target_ns;
+  sketchybar_schedule_wait(&schedule);
+  assert(schedule.missed >= 2);
+  assert((schedule.target_ns - before) % period == 0);
+  assert(near_boundary(wall_offset(period), 0, period, slack));
+
+  /* Without BARISTA_PROVIDER_JITTER the trigger carries no extra variable. */
+  unsetenv("BARISTA_PROVIDER_JITTER");
+  sketchybar_schedule_init(&schedule, 0.05);
+  sketchybar_schedule_wait(&schedule);
+  assert(sketchybar_schedule_variable(&schedule, 1, names, values) == 1);
+}
+
+static void test_schedule_phase(void) {
+  static struct sketchybar_schedule schedule;
+  const uint64_t period = 100000000ull;
+  setenv("BARISTA_PROVIDER_PHASE_MS", "1030", 1);
+  sketchybar_schedule_init(&schedule, 0.1);
+  assert(schedule.phase_ns == 30000000ull);
+  for (int i = 0; i < 3; i++) {
+    sketchybar_schedule_wait(&schedule);
+    assert(schedule.target_ns % period == schedule.phase_ns);
+    assert(near_boundary(wall_offset(period), schedule.phase_ns, period, 15000000ull));
+  }
+  unsetenv("BARISTA_PROVIDER_PHASE_MS");
+}
+
+static void test_schedule_adaptive(void) {
+  static struct sketchybar_schedule schedule;
+  sketchybar_schedule_init(&schedule, 0.02);
+  char *off[] = { "cpu_load", "cpu_update", "0.02" };
+  assert(sketchybar_schedule_parse(&schedule, 3, off, 3));
+  double values[2] = { 10, 0 };
+  assert(sketchybar_schedule_adapt(&schedule, values, 2) && schedule.stride == 1);
+
+  char *bad[] = { "cpu_load", "cpu_update", "0.02", "--adaptive" };
+  assert(!sketchybar_schedule_parse(&schedule, 4, bad, 3));
+  char *args[] = { "cpu_load", "cpu_update", "0.02", "--adaptive", "2", "--max-interval", "0.08" };
+  assert(sketchybar_schedule_parse(&schedule, 7, args, 3));
+  assert(schedule.max_stride == 4);
+
+  /* Quiet samples back off 1, 1, 2, 4 and stay capped at --max-interval. */
+  uint32_t expected[] = { 1, 1, 1, 2, 4, 4 };
+  for (int i = 0; i < 6; i++) {
+    values[0] = 10 + (i % 2);
+    assert(sketchybar_schedule_adapt(&schedule, values, 2) == (i == 0));
+    assert(schedule.stride == expected[i]);
+  }
+
+  /* Creep is measured from the start of the quiet run, so it snaps back
+   * once it adds up to more than DELTA. */
+  values[0] = 12;
+  assert(!sketchybar_schedule_adapt(&schedule, values, 2));
+  values[0] = 12.5;
+  assert(sketchybar_schedule_adapt(&schedule, values, 2) && schedule.stride == 1);
+
+  /* A stretched tick still lands on a multiple of the longer interval. */
+  schedule.stride = 4;
+  sketchybar_schedule_wait(&schedule);
+  uint64_t first = schedule.target_ns;
+  sketchybar_schedule_wait(&schedule);
+  assert(first % 80000000ull == 0 && schedule.target_ns - first == 80000000ull);
+  assert(schedule.missed == 0);
+}
+
+static double seconds_since(const struct timespec *start) {
+  struct timespec end = {0, 0};
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (double)(end.tv_sec - start->tv_sec) + (double)(end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void benchmark(long iterations) {
+  static struct cpu cpu;
+  static struct network network;
+  cpu_init(&cpu);
+  network_init(&network, "lo");
+  struct timespec start = {0, 0};
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (long i = 0; i < iterations; i++) cpu_update(&cpu);
+  double cpu_seconds = seconds_since(&start);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (long i = 0; i < iterations; i++) network_update(&network);
+  double network_seconds = seconds_since(&start);
+  printf("cpu_update: %.2f us/sample (%d cores)\n",
+         cpu_seconds * 1e6 / (double)iterations, cpu.core_count);
+  printf("network_update: %.2f us/sample\n", network_seconds * 1e6 / (double)iterations);
+}
+
+int main(void) {
+  const char *tmpdir = getenv("TMPDIR");
+  snprintf(fixture_dir, sizeof(fixture_dir), "%s", tmpdir ? tmpdir : "/tmp");
+
+  test_scanner();
+  test_cpu_loads();
+  test_network_rates();
+  test_network_tracking();
+  test_memory();
+  test_live_proc();
+  test_schedule_alignment();
+  test_schedule_phase();
+  test_schedule_adaptive();
+
+  const char *iterations = getenv("BARISTA_PROVIDER_BENCH");
+  if (iterations && atol(iterations) > 0) benchmark(atol(iterations));
+
+  puts("test_event_providers.c: ok");
+  return 0;
+}
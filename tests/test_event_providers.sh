@@ -0,0 +1,132 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+HELPERS="$ROOT_DIR/helpers"
+PROVIDERS="$HELPERS/event_providers"
+TMP_DIR="$(mktemp -d)"
+SOCKET_PATH="$TMP_DIR/bar.sock"
+MOCK_PID=""
+
+cleanup() {
+  if [[ -n "$MOCK_PID" ]]; then kill "$MOCK_PID" 2>/dev/null || true; fi
+  rm -rf "$TMP_DIR"
+}
+trap cleanup EXIT
+
+if [[ "$(uname -s)" != "Linux" ]]; then
+  printf 'test_event_providers.sh: skipped (fixtures use the /proc backends)\n'
+  exit 0
+fi
+
+CC_BIN="${CC:-cc}"
+SHARED=("$HELPERS/barista_transport.c" "$HELPERS/barista_sent_cache.c"
+  "$HELPERS/barista_send_queue.c" "$HELPERS/barista_payload.c" "$HELPERS/barista_history.c"
+  "$HELPERS/barista_route.c")
+"$CC_BIN" -std=c99 -Wall -Wextra -Werror "$ROOT_DIR/tests/test_event_providers.c" "${SHARED[@]}" \
+  -lpthread -lm -o "$TMP_DIR/test_event_providers"
+TMPDIR="$TMP_DIR" "$TMP_DIR/test_event_providers" >/dev/null
+
+for provider in cpu_load/cpu_load network_load/network_load metrics_provider/metrics_provider; do
+  "$CC_BIN" -std=c99 -O2 -Wall -Wextra -Werror "$PROVIDERS/$provider.c" "${SHARED[@]}" \
+    -lpthread -lm -o "$TMP_DIR/$(basename "$provider")"
+done
+"$CC_BIN" -std=c99 -Wall -Wextra -Werror \
+  "$HELPERS/barista_history_dump.c" "$HELPERS/barista_history.c" -o "$TMP_DIR/barista_history_dump"
+"$CC_BIN" -std=c99 -Wall -Wextra -Werror \
+  "$HELPERS/barista_mock_bar.c" "$HELPERS/barista_transport.c" -o "$TMP_DIR/barista_mock_bar"
+
+"$TMP_DIR/barista_mock_bar" --socket "$SOCKET_PATH" --log "$TMP_DIR/requests.log" &
+MOCK_PID=$!
+for _ in $(seq 100); do [[ -S "$SOCKET_PATH" ]] && break; sleep 0.02; done
+
+# expect_request <regex> <binary> [args...]: runs a provider against the mock
+# bar until the bar has received a matching request.
+expect_request() {
+  local pattern="$1"
+  shift
+  TMPDIR="$TMP_DIR" BARISTA_BUSD_DISABLE=1 BARISTA_TRANSPORT_SOCKET="$SOCKET_PATH" \
+    "$@" >/dev/null &
+  local provider_pid=$!
+  local found=0
+  for _ in $(seq 250); do
+    if grep -Eq -- "$pattern" "$TMP_DIR/requests.log" 2>/dev/null; then
+      found=1
+      break
+    fi
+    sleep 0.02
+  done
+  kill "$provider_pid"
+  wait "$provider_pid" 2>/dev/null || true
+  if [[ "$found" -ne 1 ]]; then
+    echo "FAIL: $(basename "$1") never sent a request matching $pattern" >&2
+    cat "$TMP_DIR/requests.log" >&2
+    exit 1
+  fi
+}
+
+expect_request '^--add event cpu_update$' "$TMP_DIR/cpu_load" cpu_update 0.05
+expect_request '^--trigger cpu_update user_load=[0-9]+ sys_load=[0-9]+ total_load=[0-9]+ iowait_load=[0-9]+ core_loads=[0-9]+(,[0-9]+)*$' \
+  "$TMP_DIR/cpu_load" cpu_update 0.05
+expect_request '^--trigger network_update upload=[0-9]{3}( Bps|KBps|MBps) download=' \
+  "$TMP_DIR/network_load" lo network_update 0.05
+expect_request '^--trigger network_default upload=[0-9]{3}.* download=.* interface=[^ ]*$' \
+  "$TMP_DIR/network_load" default network_default 0.05
+BARISTA_PROVIDER_JITTER=1 expect_request '^--trigger network_update upload=.* download=.* tick_jitter_us=[0-9]+$' \
+  "$TMP_DIR/network_load" lo network_update 0.05
+expect_request '^--trigger metrics_update user_load=.* core_loads=.* upload=.* download=.* mem_used_percent=[0-9]+ mem_used=[0-9.]+G disk_used_percent=[0-9]+ disk_free=[0-9.]+G$' \
+  "$TMP_DIR/metrics_provider" metrics_update 0.05 --interface lo --disk 3
+# Ticks that skip the disk still carry its latest value, so a trigger that
+# supersedes a queued one never loses it.
+if grep -E '^--trigger metrics_update ' "$TMP_DIR/requests.log" | grep -qv ' disk_free='; then
+  echo "FAIL: a metrics_update trigger dropped the disk variables" >&2
+  grep -E '^--trigger metrics_update ' "$TMP_DIR/requests.log" >&2
+  exit 1
+fi
+
+# Each provider published its samples to a history ring.
+TMPDIR="$TMP_DIR" BARISTA_BUSD_DISABLE=1 BARISTA_TRANSPORT_SOCKET="$SOCKET_PATH" \
+  "$TMP_DIR/cpu_load" cpu_history 0.02 >/dev/null &
+provider_pid=$!
+for _ in $(seq 100); do
+  TMPDIR="$TMP_DIR" "$TMP_DIR/barista_history_dump" cpu_history --last 1 >"$TMP_DIR/history.tsv" \
+    2>/dev/null || true
+  [[ "$(wc -l <"$TMP_DIR/history.tsv")" -eq 2 ]] && break
+  sleep 0.02
+done
+kill "$provider_pid"
+wait "$provider_pid" 2>/dev/null || true
+grep -Eq $'^[0-9]+\t[0-9]+\t[0-9]+\t[0-9]+\t[0-9]+\t[0-9]+$' "$TMP_DIR/history.tsv" || {
+  echo "FAIL: cpu_load history missing" >&2
+  cat "$TMP_DIR/history.tsv" >&2
+  exit 1
+}
+head -n 1 "$TMP_DIR/history.tsv" | grep -q $'total_load$'
+for series in network_update metrics_update.cpu metrics_update.network metrics_update.memory \
+    metrics_update.disk; do
+  TMPDIR="$TMP_DIR" "$TMP_DIR/barista_history_dump" "$series" >/dev/null
+done
+
+# An idle interface backs off to --max-interval, and the USR1 report counts
+# ticks against triggers.
+TMPDIR="$TMP_DIR" BARISTA_BUSD_DISABLE=1 BARISTA_TRANSPORT_SOCKET="$SOCKET_PATH" \
+  "$TMP_DIR/network_load" barista_test_missing network_idle 0.02 --adaptive 1 --max-interval 0.08 \
+  >/dev/null 2>"$TMP_DIR/adaptive.err" &
+provider_pid=$!
+sleep 0.6
+kill -USR1 "$provider_pid"
+for _ in $(seq 50); do grep -q 'ticks=' "$TMP_DIR/adaptive.err" && break; sleep 0.02; done
+kill "$provider_pid"
+wait "$provider_pid" 2>/dev/null || true
+if ! grep -Eq '^network_idle: ticks=[0-9]+ triggers=1 suppressed=[0-9]+ stride=4 ' "$TMP_DIR/adaptive.err"; then
+  echo "FAIL: idle network_load did not back off" >&2
+  cat "$TMP_DIR/adaptive.err" >&2
+  exit 1
+fi
+ticks="$(sed -n 's/.* ticks=\([0-9]*\) .*/\1/p' "$TMP_DIR/adaptive.err" | head -n 1)"
+if (( ticks >= 20 )); then
+  echo "FAIL: adaptive network_load woke $ticks times in 0.6s" >&2
+  exit 1
+fi
+
+printf '%s\n' "event provider tests passed"
@@ -0,0 +1,156 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Counts the processes each helper starts per invocation. With the socket
+# transport reaching a stand-in bar no helper may start anything but the
+# external tool it wraps; with no transport each request costs exactly one
+# sketchybar exec. No helper may ever start a shell.
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+HELPERS="$ROOT_DIR/helpers"
+
+# Shell-string call sites fail on every platform, including the macOS-only
+# helpers the runtime check below cannot build.
+if grep -nE '\b(system|popen)\(' "$HELPERS"/*.c "$HELPERS"/*.cpp; then
+  echo "FAIL: helpers must not run SketchyBar through a shell" >&2
+  exit 1
+fi
+
+if [[ "$(uname -s)" != "Linux" ]]; then
+  printf 'test_helper_spawns.sh: skipped (LD_PRELOAD spawn counting needs Linux)\n'
+  exit 0
+fi
+
+TMP_DIR="$(mktemp -d)"
+BIN_DIR="$TMP_DIR/bin"
+SPAWN_LOG="$TMP_DIR/spawns.log"
+REQUEST_LOG="$TMP_DIR/requests.log"
+SOCKET_PATH="$TMP_DIR/bar.sock"
+SERVER_PID=""
+
+cleanup() {
+  if [[ -n "$SERVER_PID" ]]; then kill "$SERVER_PID" 2>/dev/null || true; fi
+  rm -rf "$TMP_DIR"
+}
+trap cleanup EXIT
+
+mkdir -p "$BIN_DIR" "$TMP_DIR/home"
+
+# Builtins only: anything the fakes ran would be counted against the helper.
+cat > "$BIN_DIR/sketchybar" <<'SH'
+#!/bin/bash
+printf '%s\n' "$*" >> "${BARISTA_REQUEST_LOG:?}"
+SH
+cat > "$BIN_DIR/yabai" <<'SH'
+#!/bin/bash
+exit 0
+SH
+chmod +x "$BIN_DIR/sketchybar" "$BIN_DIR/yabai"
+
+CC_BIN="${CC:-cc}"
+CXX_BIN="${CXX:-c++}"
+"$CC_BIN" -std=c99 -Wall -Wextra -Werror -shared -fPIC \
+  -o "$TMP_DIR/spawn_counter.so" "$ROOT_DIR/tests/spawn_counter.c" -ldl
+
+SHARED=("$HELPERS/barista_transport.c" "$HELPERS/barista_payload.c" "$HELPERS/barista_cli.c" "$HELPERS/barista_json.c")
+for helper in clock_widget popup_guard submenu_hover icon_manager menu_renderer space_manager; do
+  "$CC_BIN" -std=c99 -D_DEFAULT_SOURCE -O2 -Wall -Wextra -Werror -I"$HELPERS" \
+    -o "$TMP_DIR/$helper" "$HELPERS/$helper.c" "${SHARED[@]}"
+done
+for source in "${SHARED[@]}"; do
+  "$CC_BIN" -std=c99 -O2 -Wall -Wextra -Werror -I"$HELPERS" -c \
+    -o "$TMP_DIR/$(basename "${source%.c}").o" "$source"
+done
+"$CXX_BIN" -std=c++17 -O2 -Wall -Wextra -Werror -I"$HELPERS" \
+  -o "$TMP_DIR/menu_action" "$HELPERS/menu_action.cpp" "$TMP_DIR"/barista_*.o
+
+# The mock bar logs each request's tokens as one line, like the fake CLI.
+"$CC_BIN" -std=c99 -O2 -Wall -Wextra -Werror \
+  -o "$TMP_DIR/barista_mock_bar" "$HELPERS/barista_mock_bar.c" "$HELPERS/barista_transport.c"
+"$TMP_DIR/barista_mock_bar" --socket "$SOCKET_PATH" --auto-add --log "$REQUEST_LOG" &
+SERVER_PID=$!
+for _ in $(seq 50); do [[ -S "$SOCKET_PATH" ]] && break; sleep 0.05; done
+
+line_count() {
+  if [[ -f "$1" ]]; then wc -l < "$1" | tr -d ' '; else echo 0; fi
+}
+
+# run_case <transport> <requests> <tool spawns> <helper> [args...] -- [env...]
+run_case() {
+  local transport="$1" requests="$2" tools="$3" helper="$4"
+  shift 4
+  local args=()
+  while [[ $# -gt 0 && "$1" != "--" ]]; do args+=("$1"); shift; done
+  [[ $# -gt 0 ]] && shift
+
+  : > "$SPAWN_LOG"
+  : > "$REQUEST_LOG"
+  local transport_env=()
+  [[ "$transport" == "socket" ]] && transport_env=(BARISTA_TRANSPORT_SOCKET="$SOCKET_PATH")
+
+  env -i \
+    PATH="$BIN_DIR:/usr/bin:/bin" \
+    HOME="$TMP_DIR/home" \
+    TMPDIR="$TMP_DIR" \
+    BARISTA_BUSD_DISABLE=1 \
+    BARISTA_SPAWN_LOG="$SPAWN_LOG" \
+    BARISTA_REQUEST_LOG="$REQUEST_LOG" \
+    LD_PRELOAD="$TMP_DIR/spawn_counter.so" \
+    "${transport_env[@]}" "$@" \
+    "$TMP_DIR/$helper" "${args[@]}" >/dev/null
+
+  # Deferred closes finish after the helper itself has exited.
+  for _ in $(seq 100); do
+    [[ "$(line_count "$REQUEST_LOG")" -ge "$requests" ]] && break
+    sleep 0.02
+  done
+  sleep 0.1
+
+  local label="$helper ${args[*]} ($transport)"
+  if grep -E $'^(system|popen)\t|\t(/[^\t]*/)?(sh|bash|dash|zsh)$' "$SPAWN_LOG"; then
+    echo "FAIL: $label started a shell" >&2
+    exit 1
+  fi
+  local expected_spawns="$tools"
+  [[ "$transport" == "exec" ]] && expected_spawns=$((tools + requests))
+  local spawns
+  spawns="$(line_count "$SPAWN_LOG")"
+  if [[ "$spawns" -ne "$expected_spawns" ]]; then
+    echo "FAIL: $label started $spawns processes, expected $expected_spawns" >&2
+    cat "$SPAWN_LOG" >&2
+    exit 1
+  fi
+  local received
+  received="$(line_count "$REQUEST_LOG")"
+  if [[ "$received" -ne "$requests" ]]; then
+    echo "FAIL: $label made $received requests, expected $requests" >&2
+    cat "$REQUEST_LOG" >&2
+    exit 1
+  fi
+}
+
+for transport in socket exec; do
+  run_case "$transport" 1 0 clock_widget -- NAME=clock
+  run_case "$transport" 1 0 clock_widget -- NAME=clock SENDER=mouse.exited.global
+  grep -Fqx -- "--set clock popup.drawing=off" "$REQUEST_LOG" || {
+    echo "FAIL: clock_widget popup close was not sent as tokens" >&2
+    cat "$REQUEST_LOG" >&2
+    exit 1
+  }
+  run_case "$transport" 1 0 popup_guard -- NAME=apple_menu SENDER=mouse.exited
+  run_case "$transport" 2 0 submenu_hover -- NAME=menu.sub SENDER=mouse.entered
+  run_case "$transport" 2 0 submenu_hover -- NAME=menu.sub SENDER=mouse.exited.global
+  run_case "$transport" 1 0 submenu_hover -- NAME=menu.sub SENDER=mouse.exited \
+    SUBMENU_CLOSE_DELAY=0.01
+  run_case "$transport" 3 0 menu_action menu.row apple_menu
+  run_case "$transport" 1 0 icon_manager set row missing_icon "a 'quoted' glyph"
+  grep -Fqx -- "--set row icon=a 'quoted' glyph" "$REQUEST_LOG" || {
+    echo "FAIL: icon_manager value was not passed through verbatim" >&2
+    cat "$REQUEST_LOG" >&2
+    exit 1
+  }
+  run_case "$transport" 1 0 menu_renderer clear apple_menu
+  run_case "$transport" 1 1 space_manager focus 2
+done
+
+printf '%s\n' "helper spawn tests passed"
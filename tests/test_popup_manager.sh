@@ -29,9 +29,13 @@ EOF
 chmod +x "${FAKE_SKETCHYBAR}"
 
 "${CC:-cc}" -std=c99 -Wall -Wextra -Werror \
-  "${ROOT_DIR}/helpers/popup_manager.c" -o "${NATIVE_MANAGER}"
+  "${ROOT_DIR}/helpers/popup_manager.c" "${ROOT_DIR}/helpers/barista_transport.c" \
+  "${ROOT_DIR}/helpers/barista_payload.c" \
+  -o "${NATIVE_MANAGER}"
 "${CC:-cc}" -std=c99 -Wall -Wextra -Werror \
-  "${ROOT_DIR}/tests/test_popup_manager_dispatch.c" -o "${DISPATCH_TEST}"
+  "${ROOT_DIR}/tests/test_popup_manager_dispatch.c" "${ROOT_DIR}/helpers/barista_transport.c" \
+  "${ROOT_DIR}/helpers/barista_payload.c" \
+  -o "${DISPATCH_TEST}"
 "${DISPATCH_TEST}"
 test "$("${NATIVE_MANAGER}" protocol)" = "barista-popup-switch-v1"
 test "$("${ROOT_DIR}/plugins/popup_manager.sh" protocol)" = "barista-popup-switch-v1"
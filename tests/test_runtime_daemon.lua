@@ -31,6 +31,75 @@ run_test("runtime_daemon.should_enable_widget_daemon: requires compiled runtime"
   assert_true(not disabled, "daemon should stay disabled without binary")
 end)
 
+run_test("runtime_daemon.should_enable_bus_daemon: mode and runtime gates", function()
+  local state = { modes = { bus_daemon = "auto" } }
+  assert_true(runtime_daemon.should_enable_bus_daemon(state, { binary_path = "/tmp/barista_busd" }),
+    "bus should enable when binary is present")
+  assert_true(not runtime_daemon.should_enable_bus_daemon(state, { binary_path = "/tmp/barista_busd", lua_only = true }),
+    "bus should stay disabled in Lua-only mode")
+  assert_true(not runtime_daemon.should_enable_bus_daemon(state, {
+    binary_path = "/tmp/barista_busd",
+    getenv = function(key)
+      if key == "BARISTA_BUS_DAEMON" then
+        return "off"
+      end
+      return nil
+    end,
+  }), "env override disables the bus")
+  local ok, reason = runtime_daemon.ensure_bus_daemon("", {})
+  assert_true(not ok, "bus daemon should reject an empty binary path")
+  assert_equal(reason, "missing_binary", "missing binary reason")
+end)
+
+run_test("runtime_daemon.should_enable_system_info_daemon: mode, widget and runtime gates", function()
+  local state = { modes = { system_info_daemon = "auto" }, widgets = { system_info = true } }
+  local binary = "/tmp/system_info_widget"
+  assert_true(runtime_daemon.should_enable_system_info_daemon(state, { binary_path = binary }),
+    "system info daemon should enable when binary is present")
+  assert_true(not runtime_daemon.should_enable_system_info_daemon(state, { binary_path = binary, lua_only = true }),
+    "system info daemon should stay disabled in Lua-only mode")
+  assert_true(not runtime_daemon.should_enable_system_info_daemon(
+    { modes = {}, widgets = { system_info = false } },
+    { binary_path = binary }
+  ), "system info daemon should stay disabled when the widget is off")
+  assert_true(not runtime_daemon.should_enable_system_info_daemon(state, {
+    binary_path = binary,
+    getenv = function(key)
+      if key == "BARISTA_SYSTEM_INFO_DAEMON" then
+        return "0"
+      end
+      return nil
+    end,
+  }), "env override disables the system info daemon")
+  local ok, reason = runtime_daemon.ensure_system_info_daemon("", {})
+  assert_true(not ok, "system info daemon should reject an empty binary path")
+  assert_equal(reason, "missing_binary", "missing binary reason")
+end)
+
+run_test("runtime_daemon.should_enable_state_daemon: mode and runtime gates", function()
+  local state = { modes = { state_daemon = "auto" } }
+  local binary = "/tmp/state_manager"
+  assert_true(runtime_daemon.should_enable_state_daemon(state, { binary_path = binary }),
+    "state daemon should enable when binary is present")
+  assert_true(not runtime_daemon.should_enable_state_daemon(state, { binary_path = binary, lua_only = true }),
+    "state daemon should stay disabled in Lua-only mode")
+  assert_true(not runtime_daemon.should_enable_state_daemon({ modes = { state_daemon = "disabled" } }, {
+    binary_path = binary,
+  }), "state daemon should honour modes.state_daemon")
+  assert_true(not runtime_daemon.should_enable_state_daemon(state, {
+    binary_path = binary,
+    getenv = function(key)
+      if key == "BARISTA_STATE_DAEMON" then
+        return "0"
+      end
+      return nil
+    end,
+  }), "env override disables the state daemon")
+  local ok, reason = runtime_daemon.ensure_state_daemon("", {})
+  assert_true(not ok, "state daemon should reject an empty binary path")
+  assert_equal(reason, "missing_binary", "missing binary reason")
+end)
+
 run_test("runtime_daemon.ensure_runtime_context_daemon: missing script is rejected", function()
   local ok, reason = runtime_daemon.ensure_runtime_context_daemon("", {})
   assert_true(not ok, "runtime context daemon should reject an empty script path")
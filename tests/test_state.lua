@@ -146,6 +146,43 @@ if ok and state_module then
     assert_equal(normalized.menus.calendar.meeting_cache_max_age_seconds, 7200, "explicit meeting cache freshness preserved")
     assert_equal(normalized.menus.calendar.custom_option, "keep", "unrelated calendar setting preserved")
   end)
+
+  -- state_manager's journal over the state.json it continues
+  local base_json = '{"widgets": {"clock": true}}'
+  local base = "#base\t0fcea4807c69d1e6\t28\n"
+
+  run_test("state.apply_journal: replays daemon changes over state.json", function()
+    local data = { widgets = { clock = true, volume = { enabled = true } } }
+    local journal = base
+      .. "widget.clock\toff\n"
+      .. "widget.volume\toff\n"
+      .. "widget.battery\tmaybe\n"
+      .. "appearance.bar_height\t36\n"
+      .. "appearance.bar_color\t0xFF101010\n"
+      .. "space.3.icon\tx\\ty\n"
+      .. "space.2.mode\tfloat\n"
+      .. "space.65.icon\tz\n"
+      .. "space.4.icon\tlost"
+    local applied = state_module.apply_journal(data, journal, base_json)
+    assert_equal(applied, 7, "records applied")
+    assert_equal(data.widgets.clock, false, "widget switched off")
+    assert_equal(data.widgets.volume.enabled, false, "table widget switched off")
+    assert_nil(data.widgets.battery, "malformed value left out")
+    assert_equal(data.appearance.bar_height, 36, "appearance number")
+    assert_equal(data.appearance.bar_color, "0xFF101010", "appearance color")
+    assert_equal(data.space_icons["3"], "x\ty", "escaped icon")
+    assert_nil(data.space_modes["2"], "float mode is the default")
+    assert_equal(data.space_icons["65"], "z", "spaces past 64")
+    assert_nil(data.space_icons["4"], "torn last line ignored")
+  end)
+
+  run_test("state.apply_journal: ignores a journal older than state.json", function()
+    local data = { widgets = { clock = true } }
+    local journal = base .. "widget.clock\toff\n"
+    assert_nil(state_module.apply_journal(data, journal, '{"widgets": {"clock": false}}'), "stale journal")
+    assert_nil(state_module.apply_journal(data, "widget.clock\toff\n", base_json), "journal without a base")
+    assert_equal(data.widgets.clock, true, "state untouched")
+  end)
 else
   run_test("state module: load check (skipped - module not available in test env)", function()
     -- This is expected when running outside the full barista environment
@@ -0,0 +1,774 @@
+#define _DEFAULT_SOURCE 1
+
+#include <assert.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define main state_manager_entry
+#include "../helpers/state_manager.c"
+#undef main
+
+static char segment[64];
+
+static pid_t dead_pid(void) {
+  pid_t child = fork();
+  assert(child >= 0);
+  if (child == 0) _exit(0);
+  assert(waitpid(child, NULL, 0) == child);
+  return child;
+}
+
+static int child_status(pid_t child) {
+  int status = 0;
+  assert(waitpid(child, &status, 0) == child);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+static void fresh_segment(void) {
+  detach_state();
+  shm_unlink(segment);
+  assert(init_state() == 0);
+}
+
+/* Attaching never touches a set-up header, even with the lock held. */
+static void test_init_once(void) {
+  fresh_segment();
+  assert(state->header.magic == STATE_MAGIC && state->header.init_owner == 0);
+  assert(state_generation() == 0);
+
+  StateData draft = {0};
+  assert(begin_write(&draft) == 0);
+  WidgetConfig *clock = add_widget(&draft);
+  assert(clock);
+  snprintf(clock->name, sizeof(clock->name), "clock");
+  clock->enabled = 1;
+  commit_state(&draft);
+  assert(state_generation() == 1);
+
+  assert(begin_write(&draft) == 0);
+  pid_t child = fork();
+  assert(child >= 0);
+  if (child == 0) {
+    alarm(10);
+    detach_state();
+    WidgetConfig widget;
+    if (init_state() != 0 || !get_widget("clock", &widget) || !widget.enabled) _exit(1);
+    free(widget.icon);
+    /* The parent still holds the writer lock. */
+    _exit(writer_lock(&state->header, 0) < 0 ? 0 : 2);
+  }
+  assert(child_status(child) == 0);
+  draft.widgets[0].enabled = 0;
+  commit_state(&draft);
+
+  WidgetConfig widget;
+  assert(get_widget("clock", &widget) && !widget.enabled);
+  free(widget.icon);
+  assert(!get_widget("missing", &widget));
+  StateData snapshot = {0};
+  read_state(&snapshot);
+  assert(snapshot.state_updates == 2 && state_generation() == 2);
+  state_free(&snapshot);
+  state_free(&draft);
+}
+
+/* A process that died setting the header up is taken over. */
+static void test_abandoned_setup(void) {
+  detach_state();
+  shm_unlink(segment);
+  int fd = shm_open(segment, O_CREAT | O_RDWR, 0600);
+  assert(fd >= 0 && ftruncate(fd, STATE_SEGMENT_INITIAL_BYTES) == 0);
+  SharedState *raw = mmap(NULL, STATE_SEGMENT_INITIAL_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  assert(raw != MAP_FAILED);
+  raw->header.init_owner = (uint32_t)dead_pid();
+  raw->image_bytes = sizeof(StateImage); /* whatever it left behind */
+  ((StateImage *)raw->words)->widget_count = 7;
+  munmap(raw, STATE_SEGMENT_INITIAL_BYTES);
+  close(fd);
+
+  assert(init_state() == 0);
+  assert(state->header.magic == STATE_MAGIC && state->header.init_owner == 0);
+  StateData snapshot = {0};
+  read_state(&snapshot);
+  assert(snapshot.widget_count == 0);
+}
+
+/* A segment from another layout is left to its users, not reused. */
+static void test_incompatible_layout(void) {
+  fresh_segment();
+  StateData draft = {0};
+  assert(begin_write(&draft) == 0);
+  for (int i = 0; i < 3; i++) assert(add_widget(&draft));
+  commit_state(&draft);
+  state_free(&draft);
+  SharedState *old = state;
+  size_t old_size = state_mapped;
+  state = NULL;
+  close(state_fd);
+  state_fd = -1;
+  old->header.layout_version = STATE_LAYOUT_VERSION + 1;
+
+  assert(init_state() == 0);
+  assert(state != old && state->header.layout_version == STATE_LAYOUT_VERSION);
+  StateData snapshot = {0};
+  read_state(&snapshot);
+  assert(snapshot.widget_count == 0);
+  assert(((StateImage *)old->words)->widget_count == 3);
+  munmap(old, old_size);
+}
+
+/* A layout 2 segment hands its state over to the segment replacing it. */
+static void test_legacy_layout(void) {
+  detach_state();
+  shm_unlink(segment);
+  int fd = shm_open(segment, O_CREAT | O_RDWR, 0600);
+  assert(fd >= 0 && ftruncate(fd, sizeof(LegacySharedState)) == 0);
+  LegacySharedState *legacy = mmap(NULL, sizeof(LegacySharedState), PROT_READ | PROT_WRITE,
+                                   MAP_SHARED, fd, 0);
+  assert(legacy != MAP_FAILED);
+  legacy->header.layout_version = STATE_LEGACY_LAYOUT_VERSION;
+  legacy->header.segment_bytes = sizeof(LegacySharedState);
+  legacy->header.sequence = 4;
+  legacy->body.data.widget_count = 2;
+  snprintf(legacy->body.data.widgets[0].name, 64, "clock");
+  legacy->body.data.widgets[0].enabled = 1;
+  snprintf(legacy->body.data.widgets[1].name, 64, "battery");
+  snprintf(legacy->body.data.spaces[15].icon, LEGACY_MAX_ICON_LEN, "Z");
+  snprintf(legacy->body.data.spaces[15].mode, 16, "stack");
+  legacy->body.data.appearance.bar_height = 31;
+  snprintf(legacy->body.data.appearance.font_family, 64, "Menlo");
+  snprintf(legacy->body.data.integrations.yaze_recent_roms[1], MAX_STRING_LEN, "/roms/b.sfc");
+  legacy->body.data.dirty = 1;
+  legacy->header.magic = STATE_MAGIC;
+  munmap(legacy, sizeof(LegacySharedState));
+  close(fd);
+
+  assert(init_state() == 0);
+  assert(state->header.layout_version == STATE_LAYOUT_VERSION);
+  StateData snapshot = {0};
+  read_state(&snapshot);
+  assert(snapshot.widget_count == 2 && snapshot.widgets[0].enabled && !snapshot.widgets[1].enabled);
+  assert(strcmp(snapshot.widgets[1].name, "battery") == 0);
+  assert(strcmp(snapshot.spaces[15].icon, "Z") == 0 && strcmp(snapshot.spaces[15].mode, "stack") == 0);
+  assert(snapshot.appearance.bar_height == 31);
+  assert(strcmp(snapshot.appearance.font_family, "Menlo") == 0);
+  assert(snapshot.integrations.yaze_recent_roms[0][0] == '\0');
+  assert(strcmp(snapshot.integrations.yaze_recent_roms[1], "/roms/b.sfc") == 0);
+  assert(snapshot.dirty && state_generation() == 1);
+  state_free(&snapshot);
+}
+
+/* The image holds only what is set, and the segment grows by remapping when
+ * it no longer fits, including under a reader that mapped it earlier. */
+enum { GROWTH_WIDGETS = 200, GROWTH_SPACES = 300, GROWTH_ICON = 100 };
+
+static void test_layout_growth(void) {
+  fresh_segment();
+  StateData draft = {0};
+  assert(begin_write(&draft) == 0);
+  WidgetConfig *clock = add_widget(&draft);
+  assert(clock);
+  snprintf(clock->name, sizeof(clock->name), "clock");
+  assert(set_text(&space_at(&draft, 3)->icon, "C"));
+  commit_state(&draft);
+  StateImage *image = (StateImage *)state->words;
+  assert(image->widget_count == 1 && image->space_count == 3 && image->rom_count == 0);
+  assert(state->image_bytes < 512);
+  uint64_t small = state->header.segment_bytes;
+
+  int ready[2], go[2];
+  assert(pipe(ready) == 0 && pipe(go) == 0);
+  pid_t child = fork();
+  assert(child >= 0);
+  if (child == 0) {
+    alarm(10);
+    char byte = 0;
+    StateData seen = {0};
+    read_state(&seen);
+    if (write(ready[1], &byte, 1) != 1 || read(go[0], &byte, 1) != 1) _exit(1);
+    read_state(&seen);
+    if (seen.widget_count != GROWTH_WIDGETS || seen.space_count != GROWTH_SPACES) _exit(2);
+    if (strcmp(seen.spaces[GROWTH_SPACES - 1].icon, "299") != 0) _exit(2);
+    if (state_mapped < state->header.segment_bytes) _exit(3);
+    _exit(0);
+  }
+  char byte = 0;
+  assert(read(ready[0], &byte, 1) == 1);
+
+  /* More widgets and spaces than a bar has, with names as long as their
+   * field allows and icons longer than any glyph. */
+  assert(begin_write(&draft) == 0);
+  char icon[GROWTH_ICON + 1];
+  memset(icon, 'i', GROWTH_ICON);
+  icon[GROWTH_ICON] = '\0';
+  for (int i = 1; i < GROWTH_WIDGETS; i++) assert(add_widget(&draft));
+  for (int i = 0; i < GROWTH_WIDGETS; i++) {
+    memset(draft.widgets[i].name, 'a' + i % 26, sizeof(draft.widgets[i].name) - 5);
+    snprintf(draft.widgets[i].name + sizeof(draft.widgets[i].name) - 5, 5, "%03d", i);
+    assert(set_text(&draft.widgets[i].icon, icon));
+  }
+  for (int i = 0; i < GROWTH_SPACES; i++) {
+    char number[16];
+    snprintf(number, sizeof(number), "%d", i);
+    assert(set_text(&space_at(&draft, i + 1)->icon, number));
+  }
+  commit_state(&draft);
+  assert(state->image_bytes > GROWTH_WIDGETS * GROWTH_ICON);
+  assert(state->image_bytes <= state->header.segment_bytes);
+#ifndef __APPLE__
+  assert(state->header.segment_bytes > small);
+#else
+  (void)small;
+#endif
+  assert(write(go[1], &byte, 1) == 1);
+  assert(child_status(child) == 0);
+
+  StateData snapshot = {0};
+  read_state(&snapshot);
+  assert(state_equal(&snapshot, &draft));
+  state_free(&snapshot);
+  state_free(&draft);
+  close(ready[0]);
+  close(ready[1]);
+  close(go[0]);
+  close(go[1]);
+}
+
+/* A writer that dies mid-commit neither wedges readers nor the next writer. */
+static void test_dead_writer(void) {
+  fresh_segment();
+  StateData draft = {0};
+  assert(begin_write(&draft) == 0);
+  draft.appearance.bar_height = 28;
+  commit_state(&draft);
+  pid_t child = fork();
+  assert(child >= 0);
+  if (child == 0) {
+    if (begin_write(&draft) != 0) _exit(1);
+    __atomic_store_n(&state->header.sequence, 3, __ATOMIC_RELEASE);
+    ((StateImage *)state->words)->bar_height = 99;
+    _exit(0);
+  }
+  assert(child_status(child) == 0);
+  assert(state->header.sequence == 3);
+
+  alarm(10);
+  StateData snapshot = {0};
+  read_state(&snapshot);
+  assert(snapshot.appearance.bar_height == 99);
+  assert((state->header.sequence & 1) == 0);
+
+  assert(begin_write(&draft) == 0);
+  draft.appearance.bar_height = 28;
+  commit_state(&draft);
+  read_state(&snapshot);
+  assert(snapshot.appearance.bar_height == 28);
+  alarm(0);
+  state_free(&snapshot);
+  state_free(&draft);
+}
+
+/* Writers store one value in fields spread over the whole struct; a reader
+ * that ever sees two values saw a torn commit. */
+enum { STRESS_WRITERS = 3, STRESS_READERS = 4, STRESS_COMMITS = 4000 };
+enum { STRESS_WIDGETS = 64, STRESS_SPACES = 64 };
+
+typedef struct {
+  int done;
+  uint64_t reads[STRESS_READERS];
+} StressBoard;
+
+static void stress_fill(StateData *draft, int value) {
+  draft->appearance.bar_height = value;
+  while (draft->widget_count < STRESS_WIDGETS) assert(add_widget(draft));
+  for (int i = 0; i < STRESS_WIDGETS; i++) draft->widgets[i].update_interval = value;
+  char icon[16];
+  snprintf(icon, sizeof(icon), "%d", value);
+  for (int i = 0; i < STRESS_SPACES; i++) assert(set_text(&space_at(draft, i + 1)->icon, icon));
+  snprintf(draft->integrations.emacs_workspace, sizeof(draft->integrations.emacs_workspace), "%d", value);
+  draft->integrations.yaze_enabled = value;
+}
+
+static int stress_consistent(const StateData *snapshot) {
+  int value = snapshot->appearance.bar_height;
+  if (snapshot->integrations.yaze_enabled != value) return 0;
+  if (snapshot->widget_count != STRESS_WIDGETS || snapshot->space_count != STRESS_SPACES) return 0;
+  for (int i = 0; i < STRESS_WIDGETS; i++) {
+    if (snapshot->widgets[i].update_interval != value) return 0;
+  }
+  for (int i = 0; i < STRESS_SPACES; i++) {
+    if (atoi(text_or_empty(snapshot->spaces[i].icon)) != value) return 0;
+  }
+  return atoi(snapshot->integrations.emacs_workspace) == value;
+}
+
+static void test_stress(void) {
+  fresh_segment();
+  StateData draft = {0};
+  assert(begin_write(&draft) == 0);
+  stress_fill(&draft, 0);
+  commit_state(&draft);
+  uint64_t start_generation = state_generation();
+
+  StressBoard *board = mmap(NULL, sizeof(StressBoard), PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  assert(board != MAP_FAILED);
+  memset(board, 0, sizeof(*board));
+
+  pid_t readers[STRESS_READERS];
+  for (int r = 0; r < STRESS_READERS; r++) {
+    readers[r] = fork();
+    assert(readers[r] >= 0);
+    if (readers[r] == 0) {
+      alarm(60);
+      uint64_t last = 0;
+      uint64_t reads = 0;
+      StateData snapshot = {0};
+      while (!__atomic_load_n(&board->done, __ATOMIC_ACQUIRE)) {
+        read_state(&snapshot);
+        uint64_t generation = state_generation();
+        if (!stress_consistent(&snapshot) || generation < last) _exit(2);
+        last = generation;
+        reads++;
+      }
+      board->reads[r] = reads;
+      _exit(0);
+    }
+  }
+
+  pid_t writers[STRESS_WRITERS];
+  for (int w = 0; w < STRESS_WRITERS; w++) {
+    writers[w] = fork();
+    assert(writers[w] >= 0);
+    if (writers[w] == 0) {
+      alarm(60);
+      StateData writing = {0};
+      for (int round = 1; round <= STRESS_COMMITS; round++) {
+        if (begin_write(&writing) != 0 || !stress_consistent(&writing)) _exit(3);
+        stress_fill(&writing, (w + 1) * 100000 + round);
+        commit_state(&writing);
+      }
+      _exit(0);
+    }
+  }
+  for (int w = 0; w < STRESS_WRITERS; w++) assert(child_status(writers[w]) == 0);
+  __atomic_store_n(&board->done, 1, __ATOMIC_RELEASE);
+  uint64_t total_reads = 0;
+  for (int r = 0; r < STRESS_READERS; r++) {
+    assert(child_status(readers[r]) == 0);
+    assert(board->reads[r] > 0);
+    total_reads += board->reads[r];
+  }
+
+  /* Every commit landed exactly once. */
+  assert(state_generation() == start_generation + STRESS_WRITERS * STRESS_COMMITS);
+  StateData snapshot = {0};
+  read_state(&snapshot);
+  assert(stress_consistent(&snapshot));
+  assert(snapshot.state_updates == 1 + (uint64_t)STRESS_WRITERS * STRESS_COMMITS);
+  printf("stress: %d commits, %llu consistent reads\n", STRESS_WRITERS * STRESS_COMMITS,
+         (unsigned long long)total_reads);
+  munmap(board, sizeof(*board));
+  state_free(&snapshot);
+  state_free(&draft);
+}
+
+static void test_segment_name(void) {
+  char saved[64];
+  snprintf(saved, sizeof(saved), "%s", getenv("BARISTA_STATE_SHM"));
+  assert(strcmp(state_segment_name(), saved) == 0);
+  assert(strcmp(STATE_SHM_NAME, "/sketchybar_state.v3") == 0);
+  assert(strcmp(STATE_LEGACY_SHM_NAME, "/sketchybar_state.v2") == 0);
+  setenv("BARISTA_STATE_SHM", "/nested/name", 1);
+  assert(strcmp(state_segment_name(), STATE_SHM_NAME) == 0);
+  setenv("BARISTA_STATE_SHM", "no-slash", 1);
+  assert(strcmp(state_segment_name(), STATE_SHM_NAME) == 0);
+  setenv("BARISTA_STATE_SHM", "/a-name-that-is-far-too-long-for-macos", 1);
+  assert(strcmp(state_segment_name(), STATE_SHM_NAME) == 0);
+  setenv("BARISTA_STATE_SHM", saved, 1);
+}
+
+/* Joins a finished payload's tokens with spaces. */
+static const char *payload_text(const uint8_t *arena, size_t length) {
+  static char text[4096];
+  assert(length > 0 && length <= sizeof(text));
+  for (size_t i = 0; i + 1 < length; i++) text[i] = arena[i] == '\0' ? ' ' : (char)arena[i];
+  text[length - 2] = '\0';
+  return text;
+}
+
+/* Only what the bar shows and what changed, in one payload. */
+static void test_diff_payload(void) {
+  StateData before = {0}, after = {0};
+  for (int i = 0; i < 3; i++) assert(add_widget(&before));
+  snprintf(before.widgets[0].name, sizeof(before.widgets[0].name), "clock");
+  before.widgets[0].enabled = 1;
+  snprintf(before.widgets[1].name, sizeof(before.widgets[1].name), "battery");
+  before.widgets[1].enabled = 1;
+  snprintf(before.widgets[2].name, sizeof(before.widgets[2].name), "volume");
+  assert(set_text(&space_at(&before, 1)->icon, "A"));
+  before.appearance.bar_height = 28;
+  before.appearance.bar_color = 0xC021162F;
+  assert(state_copy(&after, &before) == 0);
+
+  uint8_t arena[4096];
+  assert(diff_payload(&before, &after, arena, sizeof(arena)) == 0);
+
+  /* Reordered widgets are matched by name; modes and scale are not shown. */
+  WidgetConfig first = after.widgets[0];
+  after.widgets[0] = after.widgets[2];
+  after.widgets[2] = first;
+  SpaceConfig *fifth = space_at(&after, 5);
+  assert(fifth);
+  snprintf(fifth->mode, sizeof(fifth->mode), "stack");
+  after.appearance.widget_scale = 2.0f;
+  assert(diff_payload(&before, &after, arena, sizeof(arena)) == 0);
+
+  after.widgets[1].enabled = 0;
+  WidgetConfig *network = add_widget(&after);
+  assert(network);
+  snprintf(network->name, sizeof(network->name), "network");
+  network->enabled = 1;
+  assert(set_text(&space_at(&after, 1)->icon, "B"));
+  assert(set_text(&space_at(&after, 3)->icon, "C"));
+  after.appearance.bar_height = 32;
+  after.appearance.bar_color = 0xFF000000;
+  size_t length = diff_payload(&before, &after, arena, sizeof(arena));
+  assert(strcmp(payload_text(arena, length),
+                "--set battery drawing=off --set network drawing=on"
+                " --set space.1 icon=B --set space.3 icon=C"
+                " --bar height=32 color=0xFF000000") == 0);
+
+  /* A cleared icon leaves the bar's own default alone. */
+  assert(state_copy(&before, &after) == 0);
+  assert(set_text(&after.spaces[2].icon, NULL));
+  assert(diff_payload(&before, &after, arena, sizeof(arena)) == 0);
+  state_free(&before);
+  state_free(&after);
+}
+
+static const char *command_output(int expected, const char *command, const char *key,
+                                  const char *value) {
+  static Reply reply;
+  char *argv[] = {(char *)command, (char *)key, (char *)value};
+  reply.length = 0;
+  reply.text[0] = '\0';
+  assert(run_command(value ? 3 : 2, argv, &reply) == expected);
+  return reply.text;
+}
+
+static void test_get_set(void) {
+  fresh_segment();
+  StateData draft = {0};
+  assert(begin_write(&draft) == 0);
+  WidgetConfig *clock = add_widget(&draft);
+  assert(clock);
+  snprintf(clock->name, sizeof(clock->name), "clock");
+  commit_state(&draft);
+  state_free(&draft);
+
+  assert(strcmp(command_output(0, "set", "widget.clock", "on"), "") == 0);
+  assert(strcmp(command_output(0, "get", "widget.clock", NULL), "on\n") == 0);
+  command_output(1, "set", "widget.clock", "maybe");
+  command_output(1, "set", "widget.missing", "on");
+  command_output(0, "set", "appearance.bar_color", "0x80FF0000");
+  assert(strcmp(command_output(0, "get", "appearance.bar_color", NULL), "0x80FF0000\n") == 0);
+  command_output(0, "set", "appearance.font_family", "Iosevka");
+  assert(strcmp(command_output(0, "get", "appearance.font_family", NULL), "Iosevka\n") == 0);
+  command_output(1, "set", "appearance.unknown", "1");
+  command_output(0, "set", "space.24.icon", "X");
+  command_output(0, "set", "space.2.mode", "bsp");
+  assert(strcmp(command_output(0, "get", "space.24.icon", NULL), "X\n") == 0);
+  assert(strcmp(command_output(0, "get", "space.2.mode", NULL), "bsp\n") == 0);
+  /* Spaces and icons are as many and as long as the bar has. */
+  assert(strcmp(command_output(0, "get", "space.65.icon", NULL), "\n") == 0);
+  command_output(0, "set", "space.65.icon", "Y");
+  assert(strcmp(command_output(0, "space-icon", "300", "Z"), "Set space 300 icon to Z\n") == 0);
+  assert(strcmp(command_output(0, "get", "space.65.icon", NULL), "Y\n") == 0);
+  command_output(0, "space-icon", "24", "an icon far longer than thirty-two bytes");
+  assert(strcmp(command_output(0, "get", "space.24.icon", NULL),
+                "an icon far longer than thirty-two bytes\n") == 0);
+  command_output(0, "space-icon", "24", "X");
+  /* A mode longer than its field is refused, not cut short. */
+  command_output(1, "set", "space.2.mode", "a-mode-too-long-to-fit");
+  command_output(1, "get", "space.0.icon", NULL);
+  assert(strcmp(command_output(0, "get", "space.24.icon", NULL), "X\n") == 0);
+  assert(strcmp(command_output(0, "get", "space.2.mode", NULL), "bsp\n") == 0);
+  command_output(1, "get", "space.1.colour", NULL);
+  command_output(1, "get", "space.1x.icon", NULL);
+  command_output(2, "frobnicate", "x", NULL);
+  assert(strcmp(command_output(0, "widget", "clock", "off"), "Turned clock off\n") == 0);
+  assert(strcmp(command_output(0, "widget", "clock", NULL), "clock: off\n") == 0);
+
+  StateData snapshot = {0};
+  read_state(&snapshot);
+  assert(snapshot.dirty && snapshot.space_count == 300 && strcmp(snapshot.spaces[23].icon, "X") == 0);
+  state_free(&snapshot);
+}
+
+static void test_socket_path(void) {
+  char path[256];
+  setenv("TMPDIR", "/var/tmp//", 1);
+  setenv("BAR_NAME", "side", 1);
+  assert(state_socket_path(path, sizeof(path)) && strcmp(path, "/var/tmp/barista_state.side.sock") == 0);
+  setenv("BAR_NAME", "a/b", 1);
+  assert(!state_socket_path(path, sizeof(path)));
+  setenv("BARISTA_STATE_SOCKET", "/tmp/explicit.sock", 1);
+  assert(state_socket_path(path, sizeof(path)) && strcmp(path, "/tmp/explicit.sock") == 0);
+  unsetenv("BARISTA_STATE_SOCKET");
+  unsetenv("BAR_NAME");
+  unsetenv("TMPDIR");
+}
+
+static int watch_fired(StateWatch *watch) {
+  struct pollfd descriptor = {watch->fd, POLLIN, 0};
+  if (poll(&descriptor, 1, 200) <= 0) return 0;
+  return watch_drain(watch);
+}
+
+static void write_file(const char *path, const char *text) {
+  FILE *file = fopen(path, "w");
+  assert(file);
+  fputs(text, file);
+  fclose(file);
+}
+
+/* Writes and renames onto state.json wake the watch; its neighbours don't. */
+static void test_watch(void) {
+  char directory[] = "/tmp/barista_state_watch.XXXXXX";
+  assert(mkdtemp(directory));
+  char path[256], other[256], temporary[256];
+  snprintf(path, sizeof(path), "%s/state.json", directory);
+  snprintf(other, sizeof(other), "%s/other.json", directory);
+  snprintf(temporary, sizeof(temporary), "%s/state.json.tmp", directory);
+
+  StateWatch watch;
+  assert(watch_open(&watch, path) == 0);
+  write_file(path, "{}");
+  assert(watch_fired(&watch));
+  assert(!watch_fired(&watch));
+  write_file(temporary, "{\"widgets\": {}}");
+#ifndef __APPLE__
+  /* kqueue only reports that the directory changed, not which entry. */
+  assert(!watch_fired(&watch));
+#else
+  watch_fired(&watch);
+#endif
+  assert(rename(temporary, path) == 0);
+  assert(watch_fired(&watch));
+  write_file(path, "{\"widgets\": {\"clock\": true}}");
+  assert(watch_fired(&watch));
+  write_file(other, "{}");
+#ifndef __APPLE__
+  assert(!watch_fired(&watch));
+#endif
+  watch_close(&watch);
+
+  unlink(path);
+  unlink(other);
+  rmdir(directory);
+}
+
+/* state.json round-trips through render and decode, is replaced without a
+ * stray temporary, and the journal replays everything but a torn last line. */
+static int snapshot_matches_file(const char *snapshot, const char *path) {
+  static uint64_t image[4096];
+  static char text[16384];
+  FILE *file = fopen(snapshot, "rb");
+  assert(file);
+  size_t size = fread(image, 1, sizeof(image), file);
+  fclose(file);
+  file = fopen(path, "rb");
+  assert(file);
+  size_t length = fread(text, 1, sizeof(text), file);
+  fclose(file);
+  BaristaSnapshot opened;
+  return barista_snapshot_open(&opened, image, size) && barista_snapshot_matches(&opened, text, length);
+}
+
+static void test_persistence(void) {
+  char home[] = "/tmp/barista_state_home.XXXXXX";
+  assert(mkdtemp(home));
+  char directory[256], path[256], journal[300], snapshot[300];
+  snprintf(directory, sizeof(directory), "%s/.config", home);
+  assert(mkdir(directory, 0755) == 0);
+  snprintf(directory, sizeof(directory), "%s/.config/sketchybar", home);
+  assert(mkdir(directory, 0755) == 0);
+  char *saved_home = getenv("HOME") ? strdup(getenv("HOME")) : NULL;
+  setenv("HOME", home, 1);
+  state_config_path(path, sizeof(path));
+  snprintf(journal, sizeof(journal), "%s.journal", path);
+  snapshot_path(snapshot, sizeof(snapshot));
+
+  fresh_segment();
+  write_file(path, "{\"widgets\": {\"clock\": true, \"battery\": false}}");
+  load_json_state();
+  assert(set_value("space.2.icon", "a\tb\\c\"d"));
+  assert(set_value("appearance.bar_height", "40"));
+  assert(set_value("appearance.font_family", "Mono\nLisa"));
+  unsigned saves = g_saves;
+  save_json_state();
+  assert(g_saves == saves + 1);
+  StateData saved = {0}, decoded = {0};
+  read_state(&saved);
+  assert(!saved.dirty && saved.widget_count == 2);
+  assert(state_copy(&decoded, &saved) == 0);
+  assert(set_text(&decoded.spaces[1].icon, NULL));
+  decoded.appearance.bar_height = 0;
+  decoded.appearance.font_family[0] = '\0';
+  assert(decode_state_file(&decoded) == 1);
+  assert(strcmp(decoded.spaces[1].icon, "a\tb\\c\"d") == 0);
+  assert(decoded.appearance.bar_height == 40);
+  assert(strcmp(decoded.appearance.font_family, "Mono\nLisa") == 0);
+  DIR *entries = opendir(directory);
+  assert(entries);
+  int files = 0;
+  for (struct dirent *entry; (entry = readdir(entries));) {
+    if (entry->d_name[0] != '.') {
+      assert(strcmp(entry->d_name, "state.json") == 0 || strcmp(entry->d_name, "state.json.snapshot") == 0);
+      files++;
+    }
+  }
+  closedir(entries);
+  assert(files == 2);
+
+  /* The snapshot describes the bytes just saved, and follows outside edits. */
+  assert(snapshot_matches_file(snapshot, path));
+  assert(refresh_snapshot() == 0);
+  write_file(path, "{\"widgets\": {\"clock\": false}}");
+  assert(!snapshot_matches_file(snapshot, path));
+  assert(refresh_snapshot() == 1);
+  assert(snapshot_matches_file(snapshot, path));
+  write_file(path, "{\"widgets\": ");
+  assert(refresh_snapshot() == -1);
+  save_json_state();
+  assert(snapshot_matches_file(snapshot, path));
+
+  StateData after = {0};
+  assert(state_copy(&after, &saved) == 0);
+  TextBuffer text = {0};
+  after.widgets[0].enabled = !after.widgets[0].enabled;
+  assert(set_text(&space_at(&after, 3)->icon, "x\ty\n\\"));
+  snprintf(after.spaces[0].mode, sizeof(after.spaces[0].mode), "stack");
+  after.appearance.bar_color = 0xFF203040;
+  assert(journal_changes(&saved, &after, &text) == 4);
+  assert(journal_append(text.bytes, text.length) == 0);
+  const char *torn = "space.4.icon\tlost";
+  assert(journal_append(torn, strlen(torn)) == 0);
+  StateData replayed = {0};
+  assert(state_copy(&replayed, &saved) == 0);
+  assert(journal_replay(&replayed) == 4);
+  assert(replayed.widgets[0].enabled == after.widgets[0].enabled);
+  assert(strcmp(replayed.spaces[2].icon, "x\ty\n\\") == 0);
+  assert(strcmp(replayed.spaces[0].mode, "stack") == 0);
+  assert(replayed.appearance.bar_color == 0xFF203040);
+  assert(space_or_empty(&replayed, 3)->icon == NULL);
+
+  /* Loading applies the journal; saving folds it in and removes it. */
+  load_json_state();
+  read_state(&replayed);
+  assert(replayed.dirty && strcmp(replayed.spaces[2].icon, "x\ty\n\\") == 0);
+  save_json_state();
+  assert(access(journal, F_OK) != 0);
+  fresh_segment();
+  load_json_state();
+  read_state(&replayed);
+  assert(!replayed.dirty && replayed.appearance.bar_color == 0xFF203040);
+
+  /* A save that raced a commit rebases the journal onto the file it wrote,
+   * keeping what changed since its snapshot; with nothing newer it goes. */
+  size_t file_length = 0;
+  char *file = read_state_file(&file_length);
+  assert(file);
+  assert(state_copy(&after, &replayed) == 0);
+  assert(set_text(&space_at(&after, 6)->icon, "late"));
+  journal_rebase(&replayed, &after, file, file_length);
+  fresh_segment();
+  load_json_state();
+  StateData rebased = {0};
+  read_state(&rebased);
+  assert(rebased.dirty && strcmp(rebased.spaces[5].icon, "late") == 0);
+  assert(rebased.appearance.bar_color == 0xFF203040);
+  state_free(&rebased);
+  journal_rebase(&after, &after, file, file_length);
+  assert(access(journal, F_OK) != 0);
+  free(file);
+  fresh_segment();
+  load_json_state();
+
+  /* A journal names the state.json it continues. One written before another
+   * writer replaced the file (Lua, with no daemon running) is dropped rather
+   * than replayed over the newer file. */
+  assert(state_copy(&after, &replayed) == 0);
+  assert(set_text(&space_at(&after, 5)->icon, "old"));
+  text.length = 0;
+  assert(journal_changes(&replayed, &after, &text) == 1);
+  assert(journal_append(text.bytes, text.length) == 0);
+  FILE *journal_file = fopen(journal, "r");
+  char header[64];
+  assert(journal_file && fgets(header, sizeof(header), journal_file));
+  fclose(journal_file);
+  assert(strncmp(header, "#base\t", 6) == 0);
+  write_file(path, "{\"space_icons\": {\"5\": \"new\"}}");
+  fresh_segment();
+  load_json_state();
+  read_state(&replayed);
+  assert(strcmp(replayed.spaces[4].icon, "new") == 0 && !replayed.dirty);
+  assert(access(journal, F_OK) != 0);
+
+  /* Widget lists and integrations have no records; state.json is rewritten. */
+  text.length = 0;
+  assert(state_copy(&after, &saved) == 0);
+  after.widget_count--;
+  assert(journal_changes(&saved, &after, &text) == -1);
+  assert(state_copy(&after, &saved) == 0);
+  after.integrations.emacs_enabled = !after.integrations.emacs_enabled;
+  assert(journal_changes(&saved, &after, &text) == -1);
+  free(text.bytes);
+  state_free(&saved);
+  state_free(&decoded);
+  state_free(&after);
+  state_free(&replayed);
+
+  if (saved_home) {
+    setenv("HOME", saved_home, 1);
+    free(saved_home);
+  } else {
+    unsetenv("HOME");
+  }
+  unlink(path);
+  unlink(snapshot);
+  rmdir(directory);
+  snprintf(directory, sizeof(directory), "%s/.config", home);
+  rmdir(directory);
+  rmdir(home);
+}
+
+int main(void) {
+  snprintf(segment, sizeof(segment), "/barista_state_test.%d", (int)getpid());
+  setenv("BARISTA_STATE_SHM", segment, 1);
+
+  test_segment_name();
+  test_init_once();
+  test_abandoned_setup();
+  test_incompatible_layout();
+  test_legacy_layout();
+  test_layout_growth();
+  test_dead_writer();
+  test_stress();
+  test_diff_payload();
+  test_get_set();
+  test_socket_path();
+  test_watch();
+  test_persistence();
+
+  detach_state();
+  shm_unlink(segment);
+  puts("test_state_manager.c: ok");
+  return 0;
+}
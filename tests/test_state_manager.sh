@@ -0,0 +1,195 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+HELPERS="$ROOT_DIR/helpers"
+TMP_DIR="$(mktemp -d)"
+SEGMENT="/barista_state_sh.$$"
+MOCK_PID=""
+DAEMON_PID=""
+cleanup() {
+  [[ -n "$DAEMON_PID" ]] && kill "$DAEMON_PID" 2>/dev/null
+  [[ -n "$MOCK_PID" ]] && kill "$MOCK_PID" 2>/dev/null
+  rm -f "/dev/shm${SEGMENT}"
+  rm -rf "$TMP_DIR"
+}
+trap cleanup EXIT
+
+SHARED=("$HELPERS/barista_transport.c" "$HELPERS/barista_payload.c" "$HELPERS/barista_cli.c")
+CC_BIN="${CC:-cc}"
+"$CC_BIN" -std=c99 -Wall -Wextra -Werror -O2 \
+  "$ROOT_DIR/tests/test_state_manager.c" "$HELPERS/barista_json.c" "$HELPERS/barista_snapshot.c" "${SHARED[@]}" -lpthread -o "$TMP_DIR/test_state_manager"
+"$TMP_DIR/test_state_manager" >/dev/null
+
+# The CLI reads state.json once into the segment; later invocations see it.
+"$CC_BIN" -std=c99 -Wall -Wextra -Werror -O2 \
+  "$HELPERS/state_manager.c" "$HELPERS/barista_json.c" "$HELPERS/barista_snapshot.c" "${SHARED[@]}" -lpthread -o "$TMP_DIR/state_manager"
+mkdir -p "$TMP_DIR/home/.config/sketchybar"
+cat >"$TMP_DIR/home/.config/sketchybar/state.json" <<'JSON'
+{
+  "menus": {"widgets": {"decoy": true}},
+  "widgets": {
+    "clock": true,
+    "battery": false,
+    "volume": {"enabled": true}
+  },
+  "window_defaults": {"apps": {"com.example.\"quoted\"": {"space": 2}}},
+  "space_icons": {"1": "\u2318", "2": "{}", "99": "x", "20": "T", "3": "a glyph far longer than thirty-two bytes"},
+  "space_modes": {"4": "a-mode-too-long-to-fit"}
+}
+JSON
+
+"$CC_BIN" -std=c99 -Wall -Wextra -Werror \
+  "$HELPERS/barista_mock_bar.c" "$HELPERS/barista_transport.c" -o "$TMP_DIR/barista_mock_bar"
+BAR_SOCKET="$TMP_DIR/bar.sock"
+STATE_SOCKET="$TMP_DIR/state.sock"
+"$TMP_DIR/barista_mock_bar" --socket "$BAR_SOCKET" --auto-add --log "$TMP_DIR/bar.log" &
+MOCK_PID=$!
+for _ in $(seq 100); do [[ -S "$BAR_SOCKET" ]] && break; sleep 0.02; done
+
+run_state() {
+  HOME="$TMP_DIR/home" BARISTA_STATE_SHM="$SEGMENT" BARISTA_STATE_SOCKET="$STATE_SOCKET" \
+    BARISTA_TRANSPORT_SOCKET="$BAR_SOCKET" BARISTA_BUSD_DISABLE=1 "$TMP_DIR/state_manager" "$@"
+}
+
+# Waits for the mock bar to log exactly this request.
+expect_push() {
+  for _ in $(seq 100); do
+    grep -Fqx -- "$1" "$TMP_DIR/bar.log" && return 0
+    sleep 0.02
+  done
+  echo "FAIL: bar never got: $1" >&2
+  cat "$TMP_DIR/bar.log" >&2
+  return 1
+}
+
+# Waits until the daemon itself answers a command.
+expect_daemon() {
+  for _ in $(seq 150); do
+    BARISTA_STATE_DAEMON=required run_state get widget.clock >/dev/null 2>&1 && return 0
+    sleep 0.02
+  done
+  echo "FAIL: the daemon never answered on $STATE_SOCKET" >&2
+  return 1
+}
+
+# Waits for a file to contain a line matching the pattern.
+expect_line() {
+  for _ in $(seq 150); do
+    grep -q -- "$1" "$2" 2>/dev/null && return 0
+    sleep 0.02
+  done
+  echo "FAIL: $2 never matched: $1" >&2
+  return 1
+}
+
+STATE_FILE="$TMP_DIR/home/.config/sketchybar/state.json"
+JOURNAL="$STATE_FILE.journal"
+run_state init 2>"$TMP_DIR/init.err" >/dev/null
+# Spaces and icons load however many and long; a mode past its field is
+# reported, not silently cut short.
+! grep -q "space_icons" "$TMP_DIR/init.err"
+grep -q "not loading space_modes.4: value too long" "$TMP_DIR/init.err"
+[[ "$(run_state widget clock)" == "clock: on" ]]
+[[ "$(run_state widget battery)" == "battery: off" ]]
+[[ "$(run_state widget volume)" == "volume: off" ]]
+[[ -z "$(run_state widget decoy)" ]]
+[[ "$(run_state get-space-icons)" == $'1\t⌘\n2\t{}\n3\ta glyph far longer than thirty-two bytes\n20\tT\n99\tx' ]]
+run_state widget battery toggle >/dev/null
+[[ "$(run_state widget battery)" == "battery: on" ]]
+grep -q '"battery": true' "$STATE_FILE"
+[[ ! -e "$JOURNAL" ]]
+# Every save leaves a snapshot of state.json for the Lua side to map.
+[[ -s "$STATE_FILE.snapshot" ]]
+[[ "$(run_state snapshot)" == "Snapshot current" ]]
+expect_push "--set battery drawing=on"
+stats="$(run_state stats)"
+grep -q "Generation: " <<<"$stats"
+
+# serve: the CLI hands commands to the daemon, which pushes only what changed.
+HOME="$TMP_DIR/home" BARISTA_STATE_SHM="$SEGMENT" BARISTA_TRANSPORT_SOCKET="$BAR_SOCKET" \
+  BARISTA_BUSD_DISABLE=1 "$TMP_DIR/state_manager" serve --socket "$STATE_SOCKET" --save-ms 300 &
+DAEMON_PID=$!
+expect_daemon
+# A second daemon must not take the socket from the first.
+if HOME="$TMP_DIR/home" BARISTA_STATE_SHM="$SEGMENT" BARISTA_TRANSPORT_SOCKET="$BAR_SOCKET" \
+  BARISTA_BUSD_DISABLE=1 "$TMP_DIR/state_manager" serve --socket "$STATE_SOCKET" 2>/dev/null; then
+  echo "FAIL: serve started over a live daemon" >&2
+  exit 1
+fi
+expect_daemon
+: >"$TMP_DIR/bar.log"
+run_state set widget.clock off
+[[ "$(run_state get widget.clock)" == "off" ]]
+[[ "$(run_state widget clock)" == "clock: off" ]]
+expect_push "--set clock drawing=off"
+# The change is journaled at once and folded into state.json after a pause.
+expect_line $'^widget.clock\toff$' "$JOURNAL"
+expect_line '"clock": false' "$STATE_FILE"
+for _ in $(seq 100); do [[ -e "$JOURNAL" ]] || break; sleep 0.02; done
+[[ ! -e "$JOURNAL" ]]
+ls "$TMP_DIR/home/.config/sketchybar" | grep -vq tmp
+run_state appearance bar_height 36 >/dev/null
+expect_push "--bar height=36"
+[[ "$(run_state get appearance.bar_height)" == "36" ]]
+if run_state get widget.decoy 2>/dev/null; then
+  echo "FAIL: get must fail for an unknown widget" >&2
+  exit 1
+fi
+if run_state frobnicate >/dev/null; then
+  echo "FAIL: unknown commands must fail through the daemon" >&2
+  exit 1
+fi
+
+# An outside edit, saved the way editors do, arrives as one batched diff
+# and gets a fresh snapshot.
+rm -f "$STATE_FILE.snapshot"
+cat >"$TMP_DIR/home/.config/sketchybar/state.json.tmp" <<'JSON'
+{
+  "widgets": {"clock": true, "battery": true, "volume": false},
+  "appearance": {"bar_height": 36, "bar_color": "0xFF101010"},
+  "space_icons": {"1": "⌘", "2": "B"}
+}
+JSON
+mv "$TMP_DIR/home/.config/sketchybar/state.json.tmp" "$STATE_FILE"
+expect_push "--set clock drawing=on --set space.2 icon=B --bar color=0xFF101010"
+[[ "$(run_state get-space-icons)" == $'1\t⌘\n2\tB' ]]
+[[ "$(wc -l <"$TMP_DIR/bar.log")" -eq 3 ]]
+for _ in $(seq 100); do [[ -s "$STATE_FILE.snapshot" ]] && break; sleep 0.02; done
+[[ "$(run_state snapshot)" == "Snapshot current" ]]
+
+# A burst of changes is journaled line by line and written out once.
+inode="$(stat -c %i "$STATE_FILE")"
+for icon in a b c; do run_state space-icon 3 "$icon" >/dev/null; done
+expect_line $'^space.3.icon\tc$' "$JOURNAL"
+[[ "$(stat -c %i "$STATE_FILE")" == "$inode" ]]
+expect_line '"3": "c"' "$STATE_FILE"
+[[ "$(grep -c . "$JOURNAL" 2>/dev/null || true)" -le 3 ]]
+
+# Stopping the daemon writes what is still pending.
+run_state space-icon 4 z >/dev/null
+kill "$DAEMON_PID"
+wait "$DAEMON_PID"
+DAEMON_PID=""
+[[ ! -e "$STATE_SOCKET" ]]
+grep -q '"4": "z"' "$STATE_FILE"
+[[ ! -e "$JOURNAL" ]]
+[[ "$(run_state widget clock)" == "clock: on" ]]
+
+# After a crash the journal brings back what state.json missed.
+HOME="$TMP_DIR/home" BARISTA_STATE_SHM="$SEGMENT" BARISTA_TRANSPORT_SOCKET="$BAR_SOCKET" \
+  BARISTA_BUSD_DISABLE=1 "$TMP_DIR/state_manager" serve --socket "$STATE_SOCKET" --save-ms 60000 &
+DAEMON_PID=$!
+expect_daemon
+BARISTA_STATE_DAEMON=required run_state space-icon 5 y >/dev/null
+expect_line $'^space.5.icon\ty$' "$JOURNAL"
+kill -9 "$DAEMON_PID"
+wait "$DAEMON_PID" 2>/dev/null || true
+DAEMON_PID=""
+rm -f "/dev/shm${SEGMENT}" "$STATE_SOCKET"
+! grep -q '"5": "y"' "$STATE_FILE"
+[[ "$(run_state get-space-icons)" == *$'5\ty'* ]]
+grep -q '"5": "y"' "$STATE_FILE"
+[[ ! -e "$JOURNAL" ]]
+
+printf '%s\n' "state_manager tests passed"
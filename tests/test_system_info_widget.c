@@ -14,8 +14,8 @@
 static const char *token_at(const Payload *payload, size_t wanted) {
     size_t index = 0;
     size_t offset = 0;
-    while (offset + 1 < payload->length && payload->bytes[offset] != 0) {
-        const char *token = (const char *)payload->bytes + offset;
+    while (offset + 1 < payload->wire.length && payload->wire.bytes[offset] != 0) {
+        const char *token = (const char *)payload->wire.bytes + offset;
         if (index == wanted) return token;
         offset += strlen(token) + 1;
         index++;
@@ -24,7 +24,7 @@ static const char *token_at(const Payload *payload, size_t wanted) {
 }
 
 static bool payload_has_token(const Payload *payload, const char *wanted) {
-    for (size_t index = 0; index < payload->arguments; index++) {
+    for (size_t index = 0; index < payload->wire.arguments; index++) {
         const char *token = token_at(payload, index);
         if (token && strcmp(token, wanted) == 0) return true;
     }
@@ -33,7 +33,7 @@ static bool payload_has_token(const Payload *payload, const char *wanted) {
 
 static bool payload_has_prefix(const Payload *payload, const char *prefix) {
     size_t prefix_length = strlen(prefix);
-    for (size_t index = 0; index < payload->arguments; index++) {
+    for (size_t index = 0; index < payload->wire.arguments; index++) {
         const char *token = token_at(payload, index);
         if (token && strncmp(token, prefix, prefix_length) == 0) return true;
     }
@@ -117,9 +117,9 @@ static void test_popup_payload(void) {
     payload_init(&payload);
     assert(build_popup_payload(&rows, &info, &payload));
     assert(payload_finish(&payload));
-    assert(payload.arguments == 35);
-    assert(payload.bytes[payload.length - 1] == 0);
-    assert(payload.bytes[payload.length - 2] == 0);
+    assert(payload.wire.arguments == 35);
+    assert(payload.wire.bytes[payload.wire.length - 1] == 0);
+    assert(payload.wire.bytes[payload.wire.length - 2] == 0);
 
     assert_group(&payload, 0, "system_info.cpu", "label=CPU Usage: 67% (Load: 2.50)");
     assert_group(&payload, 5, "system_info.mem", "label=Memory: 11/32G (34%)");
@@ -146,7 +146,7 @@ static void test_popup_payload(void) {
     payload_init(&payload);
     assert(build_popup_payload(&rows, &info, &payload));
     assert(payload_finish(&payload));
-    assert(payload.arguments == 10);
+    assert(payload.wire.arguments == 10);
     assert(payload_has_token(&payload, "system_info.mem"));
     assert(payload_has_token(&payload, "system_info.uptime"));
     assert(!payload_has_prefix(&payload, "system_info.cpu"));
@@ -168,11 +168,19 @@ static void test_placeholders_and_routine(void) {
     assert(payload_has_token(&payload, "label=Uptime: --"));
     assert(payload_has_token(&payload, "label=Top CPU: --"));
 
+    /* A network probe that missed the deadline is unknown, not offline. */
+    PopupRows network = {.mask = ROW_NET};
+    empty.missed_rows = ROW_NET;
+    payload_init(&payload);
+    assert(build_popup_payload(&network, &empty, &payload));
+    assert(payload_finish(&payload));
+    assert(payload_has_token(&payload, "label=Network: --"));
+
     SystemInfo info = fixture_info();
     payload_init(&payload);
     assert(build_routine_payload(&info, &payload));
     assert(payload_finish(&payload));
-    assert(payload.arguments == 7);
+    assert(payload.wire.arguments == 7);
     assert(strcmp(token_at(&payload, 0), "--set") == 0);
     assert(strcmp(token_at(&payload, 1), "system_info") == 0);
     assert(payload_has_token(&payload, "label=67% 11/32G"));
@@ -190,14 +198,58 @@ static void test_sanitizer_and_bounds(void) {
         assert(payload_add_token(&payload, "x"));
     }
     assert(!payload_add_token(&payload, "overflow"));
-    assert(payload.failed);
+    assert(payload.wire.failed);
 
     char long_token[MAX_TOKEN_BYTES + 2];
     memset(long_token, 'x', sizeof(long_token));
     long_token[sizeof(long_token) - 1] = '\0';
     payload_init(&payload);
     assert(!payload_add_token(&payload, long_token));
-    assert(payload.failed);
+    assert(payload.wire.failed);
+}
+
+static void test_sent_cache_suppression(void) {
+    char path[] = "/tmp/barista-sent-cache-test-XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    setenv("BARISTA_SENT_CACHE_PATH", path, 1);
+
+    SystemInfo info = fixture_info();
+    static Payload payload;
+    payload_init(&payload);
+    payload.use_sent_cache = true;
+    assert(build_routine_payload(&info, &payload));
+    assert(payload.wire.arguments == 7 && payload.suppressed == 0);
+    payload_settle_sent_cache(&payload, true);
+
+    payload_init(&payload);
+    payload.use_sent_cache = true;
+    assert(build_routine_payload(&info, &payload));
+    assert(payload.wire.arguments == 0 && payload.suppressed == 5);
+
+    info.cpu_percent = 91;
+    payload_init(&payload);
+    payload.use_sent_cache = true;
+    assert(build_routine_payload(&info, &payload));
+    assert(payload_finish(&payload));
+    assert(strcmp(token_at(&payload, 0), "--set") == 0);
+    assert(strcmp(token_at(&payload, 1), "system_info") == 0);
+    assert(payload_has_prefix(&payload, "label="));
+    assert(payload_has_prefix(&payload, "icon.color="));
+    assert(!payload_has_prefix(&payload, "icon="));
+    assert(!payload_has_prefix(&payload, "label.font.style="));
+    payload_settle_sent_cache(&payload, false);
+
+    /* A failed send forgets the checked properties, including the skipped
+     * ones, since a fallback path may have applied its own values. */
+    payload_init(&payload);
+    payload.use_sent_cache = true;
+    assert(build_routine_payload(&info, &payload));
+    assert(payload.wire.arguments == 7);
+
+    unsetenv("BARISTA_SENT_CACHE_PATH");
+    unlink(path);
 }
 
 static void test_response_parser(void) {
@@ -205,11 +257,11 @@ static void test_response_parser(void) {
     const char notice[] = "notice\0";
     const char failure[] = "[!] Item not found\0";
     const char unterminated[] = {'o', 'k'};
-    assert(response_is_success(success, sizeof(success)));
-    assert(response_is_success(notice, sizeof(notice)));
-    assert(!response_is_success(failure, sizeof(failure)));
-    assert(!response_is_success(unterminated, sizeof(unterminated)));
-    assert(!response_is_success(success, MAX_PAYLOAD_BYTES + 1));
+    assert(barista_response_status(success, sizeof(success)) == 1);
+    assert(barista_response_status(notice, sizeof(notice)) == 1);
+    assert(barista_response_status(failure, sizeof(failure)) == 0);
+    assert(barista_response_status(unterminated, sizeof(unterminated)) < 0);
+    assert(barista_response_status(success, BARISTA_TRANSPORT_MAX_RESPONSE_BYTES + 1) < 0);
 }
 
 static void test_memory_vm_stats_and_floor_labels(void) {
@@ -368,6 +420,310 @@ static void test_probe_parsers_and_bounds(void) {
     assert(!capture_process("/usr/bin/yes", yes_arguments, output, sizeof(output), 100));
 }
 
+static void test_cpu_tick_percent(void) {
+    char directory[] = "/tmp/barista-cpu-sample.XXXXXX";
+    assert(mkdtemp(directory));
+    setenv("TMPDIR", directory, 1);
+    char path[1024];
+    assert(barista_cpu_sample_path(path, sizeof(path)));
+
+    /* The first run has no earlier sample and falls back to the load
+     * average; once enough ticks pass, later runs measure the interval. */
+    double percent = -1.0;
+    assert(!cpu_tick_percent(&percent));
+    SystemInfo info = {0};
+    get_cpu_info(&info);
+    assert(info.cpu_available && info.cpu_percent >= 0 && info.cpu_percent <= 100);
+    usleep(1100000);
+    assert(cpu_tick_percent(&percent));
+    assert(percent >= 0.0 && percent <= 100.0);
+    unlink(path);
+    rmdir(directory);
+    unsetenv("TMPDIR");
+}
+
+static void test_top_process_sampler(void) {
+    char directory[] = "/tmp/barista-top-sampler.XXXXXX";
+    assert(mkdtemp(directory));
+    setenv("TMPDIR", directory, 1);
+    char state_path[1024];
+    assert(barista_top_state_path(state_path, sizeof(state_path)));
+
+    /* The sampler ranks by default. Without root it cannot see other
+     * users' processes, so the first scan hands over to ps without the
+     * settle wait, and later refreshes go to ps without scanning. */
+    ProcessSample sample = {0};
+    uint64_t start = monotonic_milliseconds();
+    bool sampled = sample_top_process(&sample);
+    assert(sampled == !g_top_use_ps);
+    if (geteuid() != 0) {
+        assert(!sampled);
+        assert(monotonic_milliseconds() - start < PROCESS_SETTLE_MICROSECONDS / 1000);
+        assert(!sample_top_process(&sample));
+    }
+    setenv("BARISTA_SYSTEM_INFO_TOP", "native", 1);
+
+    /* The first refresh scans twice; the second compares against the scan
+     * the first one saved. */
+    unlink(state_path);
+    assert(sample_top_process(&sample));
+    assert(sample.pid >= 0 && sample.cpu >= 0.0 && sample.fallback_name[0] != '\0');
+    assert(access(state_path, F_OK) == 0);
+    start = monotonic_milliseconds();
+    assert(sample_top_process(&sample));
+    assert(monotonic_milliseconds() - start < PROCESS_SETTLE_MICROSECONDS / 1000);
+
+    /* The daemon keeps its table in memory: no state file and no settle
+     * wait after it starts, and an idle table is rescanned before its
+     * baseline ages out. */
+    unlink(state_path);
+    resident_top_start();
+    assert(g_resident_top);
+    start = monotonic_milliseconds();
+    for (int round = 0; round < 3; round++) assert(sample_top_process(&sample));
+    usleep(PROCESS_SETTLE_MICROSECONDS);
+    assert(sample_top_process(&sample));
+    assert(monotonic_milliseconds() - start < 2 * PROCESS_SETTLE_MICROSECONDS / 1000);
+    assert(access(state_path, F_OK) != 0);
+    uint64_t scanned = g_resident_top_scanned_ns;
+    resident_top_keep_fresh();
+    assert(g_resident_top_scanned_ns == scanned);
+    g_resident_top_scanned_ns -= PROCESS_BASELINE_MAX_AGE_NS;
+    resident_top_keep_fresh();
+    assert(g_resident_top_scanned_ns > scanned);
+    barista_top_destroy(g_resident_top);
+    g_resident_top = NULL;
+
+    /* A daemon refused a process drops its table and ranks with ps. */
+    unsetenv("BARISTA_SYSTEM_INFO_TOP");
+    g_top_use_ps = false;
+    resident_top_start();
+    assert(!g_resident_top == g_top_use_ps);
+    if (geteuid() != 0) assert(!g_resident_top);
+    barista_top_destroy(g_resident_top);
+    g_resident_top = NULL;
+    g_top_use_ps = false;
+
+    setenv("BARISTA_SYSTEM_INFO_TOP", "ps", 1);
+    assert(!sample_top_process(&sample));
+    assert(ps_top_process(&sample));
+    unsetenv("BARISTA_SYSTEM_INFO_TOP");
+    unlink(state_path);
+    rmdir(directory);
+    unsetenv("TMPDIR");
+}
+
+/* Stands in for the probes: every row it reads carries `fake_generation`. */
+static int fake_generation = 0;
+static uint32_t fake_gathered_rows = 0;
+static uint64_t fake_now = 0;
+static uint32_t fake_missed_rows = 0;
+
+static uint32_t fake_gather(const PopupRows *rows, int timeout_ms, SystemInfo *info) {
+    (void)timeout_ms;
+    SystemInfo fixture = fixture_info();
+    fixture.cpu_percent = fake_generation;
+    fixture.disk_percent = fake_generation;
+    fixture.process_cpu = fake_generation;
+    snprintf(fixture.network_ip, sizeof(fixture.network_ip), "10.0.0.%d", fake_generation);
+    uint32_t read = rows->mask & ~fake_missed_rows;
+    copy_rows(info, &fixture, read);
+    info->missed_rows = rows->mask & fake_missed_rows;
+    fake_gathered_rows |= rows->mask;
+    return read;
+}
+
+static uint64_t fake_clock(void) {
+    return fake_now;
+}
+
+static void test_row_cache(void) {
+    static RowCache cache;
+    SystemInfo answer;
+    row_cache_init(&cache, fake_gather);
+    fake_generation = 1;
+    fake_now = 1000;
+    row_cache_prime(&cache, fake_clock);
+    assert(fake_gathered_rows == ALL_POPUP_ROWS);
+
+    /* Inside every TTL nothing is read again. */
+    fake_gathered_rows = 0;
+    fake_generation = 2;
+    assert(row_cache_answer(&cache, ALL_POPUP_ROWS, 1500, &answer) == 0);
+    assert(fake_gathered_rows == 0);
+    assert(answer.cpu_percent == 1 && answer.disk_percent == 1 && answer.uptime_available);
+
+    /* A cheap row past its TTL is read before answering; only the asked-for
+     * rows are copied out. */
+    assert(row_cache_answer(&cache, ROW_CPU | ROW_MEM, 2000, &answer) == 0);
+    assert(fake_gathered_rows == ROW_CPU);
+    assert(answer.cpu_percent == 2 && answer.memory_available && !answer.disk_available);
+
+    /* Slow rows are served as cached and queued instead. The top-process row
+     * brings the CPU row along. */
+    fake_gathered_rows = 0;
+    fake_generation = 3;
+    assert(row_cache_answer(&cache, ROW_NET, 11000, &answer) == ROW_NET);
+    assert(fake_gathered_rows == 0 && strcmp(answer.network_ip, "10.0.0.1") == 0);
+    assert(row_cache_answer(&cache, ROW_PROCS, 11000, &answer) == ROW_PROCS);
+    assert(fake_gathered_rows == ROW_CPU);
+    assert(answer.cpu_percent == 3 && answer.process_cpu == 1.0);
+    assert(cache.queued == (ROW_NET | ROW_PROCS));
+
+    /* A client parks only while one of its rows is in flight. */
+    assert(row_cache_add_waiter(&cache, 41, ROW_NET));
+    assert(!row_cache_add_waiter(&cache, 42, ROW_MEM));
+
+    uint32_t refreshing = row_cache_begin_refresh(&cache);
+    assert(refreshing == (ROW_NET | ROW_PROCS) && cache.queued == 0);
+    /* Asking again mid-refresh does not queue the row twice. */
+    assert(row_cache_answer(&cache, ROW_NET, 11500, &answer) == ROW_NET);
+    assert(cache.queued == 0);
+
+    SystemInfo fresh = {0};
+    PopupRows gathered = {.mask = refreshing};
+    fake_gather(&gathered, 0, &fresh);
+    RowWaiter ready[DAEMON_MAX_WAITERS];
+    assert(row_cache_finish_refresh(&cache, &fresh, refreshing, 12000, ready) == 1);
+    assert(ready[0].fd == 41 && cache.waiter_count == 0);
+    assert(row_cache_answer(&cache, ROW_NET, 12500, &answer) == 0);
+    assert(strcmp(answer.network_ip, "10.0.0.3") == 0);
+
+    /* A waiter whose rows were queued again during a refresh keeps waiting
+     * for the next one. */
+    assert(row_cache_answer(&cache, ROW_DISK, 45000, &answer) == ROW_DISK);
+    refreshing = row_cache_begin_refresh(&cache);
+    assert(refreshing == ROW_DISK);
+    assert(row_cache_answer(&cache, ROW_NET, 45000, &answer) == ROW_NET);
+    assert(row_cache_add_waiter(&cache, 43, ROW_DISK));
+    assert(row_cache_add_waiter(&cache, 44, ROW_NET | ROW_DISK));
+    assert(row_cache_finish_refresh(&cache, &fresh, refreshing, 45100, ready) == 1);
+    assert(ready[0].fd == 43 && cache.waiter_count == 1 && cache.waiters[0].fd == 44);
+
+    /* A slow row that was never read is read inline once. */
+    static RowCache cold;
+    row_cache_init(&cold, fake_gather);
+    fake_gathered_rows = 0;
+    assert(row_cache_answer(&cold, ROW_DISK, 100, &answer) == 0);
+    assert(fake_gathered_rows == ROW_DISK && answer.disk_available);
+
+    /* A row that misses the deadline keeps its cached value and is asked
+     * for again next time; one never read is reported as missed. */
+    fake_generation = 7;
+    fake_missed_rows = ROW_CPU | ROW_UPTIME;
+    fake_gathered_rows = 0;
+    assert(row_cache_answer(&cache, ROW_CPU | ROW_MEM, 60000, &answer) == 0);
+    assert(fake_gathered_rows == (ROW_CPU | ROW_MEM));
+    assert(answer.cpu_percent == 3 && answer.missed_rows == 0);
+    assert(row_cache_answer(&cold, ROW_UPTIME, 200, &answer) == 0);
+    assert(!answer.uptime_available && answer.missed_rows == ROW_UPTIME);
+    fake_missed_rows = 0;
+    fake_gathered_rows = 0;
+    assert(row_cache_answer(&cache, ROW_CPU, 60001, &answer) == 0);
+    assert(fake_gathered_rows == ROW_CPU && answer.cpu_percent == 7);
+}
+
+static void test_daemon_protocol(void) {
+    static RowCache cache;
+    row_cache_init(&cache, fake_gather);
+    fake_generation = 5;
+    fake_now = 1; /* every row is long stale by the daemon's clock */
+    row_cache_prime(&cache, fake_clock);
+
+    int pair[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+    DaemonRequest request = {.magic = DAEMON_MAGIC, .rows = ROW_UPTIME, .info_bytes = sizeof(SystemInfo)};
+    assert(barista_frame_write(pair[1], &request, sizeof(request), DAEMON_FRAME_FOLLOW_UP, 100) == 0);
+    daemon_handle(&cache, pair[0]);
+    SystemInfo info = {0};
+    bool revalidating = true;
+    assert(daemon_read_reply(pair[1], 100, &info, &revalidating));
+    assert(!revalidating && info.uptime_available && !info.cpu_available);
+    close(pair[1]);
+
+    /* A request from another build is dropped without a reply. */
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+    request.info_bytes = sizeof(SystemInfo) + 1;
+    assert(barista_frame_write(pair[1], &request, sizeof(request), 0, 100) == 0);
+    daemon_handle(&cache, pair[0]);
+    assert(!daemon_read_reply(pair[1], 100, &info, NULL));
+    close(pair[1]);
+
+    /* A stale slow row: the cached value now, the refreshed one after. */
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+    request.rows = ROW_NET;
+    request.info_bytes = sizeof(SystemInfo);
+    fake_generation = 6;
+    assert(barista_frame_write(pair[1], &request, sizeof(request), DAEMON_FRAME_FOLLOW_UP, 100) == 0);
+    daemon_handle(&cache, pair[0]);
+    assert(daemon_read_reply(pair[1], 100, &info, &revalidating));
+    assert(revalidating && strcmp(info.network_ip, "10.0.0.5") == 0);
+    assert(cache.waiter_count == 1);
+
+    uint32_t rows = row_cache_begin_refresh(&cache);
+    SystemInfo fresh = {0};
+    PopupRows gathered = {.mask = rows};
+    fake_gather(&gathered, 0, &fresh);
+    RowWaiter ready[DAEMON_MAX_WAITERS];
+    size_t ready_count = row_cache_finish_refresh(&cache, &fresh, rows, monotonic_milliseconds(), ready);
+    assert(ready_count == 1);
+    daemon_answer_final(&cache, ready[0].fd, ready[0].rows);
+    assert(daemon_read_reply(pair[1], 100, &info, &revalidating));
+    assert(!revalidating && strcmp(info.network_ip, "10.0.0.6") == 0);
+    close(pair[1]);
+}
+
+/* The real probes on the pool: every row lands in time and carries the
+ * latency of the probe that read it. */
+static void test_gather_rows(void) {
+    SystemInfo info = {0};
+    info.missed_rows = ROW_UPTIME;
+    PopupRows rows = {.mask = ROW_SWAP | ROW_UPTIME};
+    assert(gather_rows(&rows, 5000, &info) == rows.mask);
+    assert(info.missed_rows == 0 && info.uptime_available);
+    assert(!info.cpu_available && info.probe_microseconds[row_index(ROW_CPU)] == 0);
+
+    SystemInfo cached = {0};
+    copy_rows(&cached, &info, ROW_UPTIME);
+    assert(cached.probe_microseconds[row_index(ROW_UPTIME)]
+           == info.probe_microseconds[row_index(ROW_UPTIME)]);
+    assert(cached.uptime_seconds == info.uptime_seconds && !cached.swap_available);
+
+    setenv("BARISTA_SYSTEM_INFO_DEADLINE_MS", "25", 1);
+    assert(gather_deadline_ms() == 25);
+    setenv("BARISTA_SYSTEM_INFO_DEADLINE_MS", "soon", 1);
+    assert(gather_deadline_ms() == DEFAULT_GATHER_DEADLINE_MS);
+    unsetenv("BARISTA_SYSTEM_INFO_DEADLINE_MS");
+}
+
+static void test_daemon_socket_path(void) {
+    char path[256];
+    unsetenv("BARISTA_SYSTEM_INFO_SOCKET");
+    setenv("TMPDIR", "/tmp/", 1);
+    setenv("BAR_NAME", "work", 1);
+    assert(daemon_socket_path(path, sizeof(path)));
+    assert(strcmp(path, "/tmp/barista_system_info.work.sock") == 0);
+    setenv("BAR_NAME", "../escape", 1);
+    assert(!daemon_socket_path(path, sizeof(path)));
+    setenv("BARISTA_SYSTEM_INFO_SOCKET", "/tmp/explicit.sock", 1);
+    assert(daemon_socket_path(path, sizeof(path)) && strcmp(path, "/tmp/explicit.sock") == 0);
+    assert(!daemon_socket_path(path, 8));
+    unsetenv("BARISTA_SYSTEM_INFO_SOCKET");
+    unsetenv("BAR_NAME");
+    unsetenv("TMPDIR");
+
+    setenv("BARISTA_SYSTEM_INFO_DAEMON", "disabled", 1);
+    assert(daemon_client_disabled());
+    setenv("BARISTA_SYSTEM_INFO_DAEMON", "0", 1);
+    assert(daemon_client_disabled());
+    SystemInfo info;
+    assert(daemon_request(ROW_CPU, false, &info, NULL) < 0);
+    setenv("BARISTA_SYSTEM_INFO_DAEMON", "1", 1);
+    assert(!daemon_client_disabled());
+    unsetenv("BARISTA_SYSTEM_INFO_DAEMON");
+    assert(!daemon_client_disabled());
+}
+
 typedef struct {
     const char *path;
     char *const *arguments;
@@ -463,10 +819,17 @@ int main(void) {
     test_popup_payload();
     test_placeholders_and_routine();
     test_sanitizer_and_bounds();
+    test_sent_cache_suppression();
     test_response_parser();
     test_memory_vm_stats_and_floor_labels();
     test_wifi_interface_candidates();
     test_probe_parsers_and_bounds();
+    test_cpu_tick_percent();
+    test_top_process_sampler();
+    test_row_cache();
+    test_daemon_protocol();
+    test_gather_rows();
+    test_daemon_socket_path();
     test_concurrent_capture_descriptor_isolation();
     puts("test_system_info_widget.c: ok");
     return 0;
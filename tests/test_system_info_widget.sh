@@ -8,19 +8,27 @@ fi
 
 ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
 TMP_DIR="$(mktemp -d)"
+DAEMON_PID=""
 cleanup() {
+  if [ -n "$DAEMON_PID" ]; then
+    kill "$DAEMON_PID" 2>/dev/null || true
+  fi
   rm -rf "$TMP_DIR"
 }
 trap cleanup EXIT
 
+# The probe checks below must not be answered by a daemon the developer has
+# running; the resident-mode check at the end opts back in.
+export BARISTA_SYSTEM_INFO_DAEMON=0
+
 clang -std=c99 -Wall -Wextra -Werror -O2 \
-  "$ROOT_DIR/tests/test_system_info_widget.c" \
+  "$ROOT_DIR/tests/test_system_info_widget.c" "$ROOT_DIR/helpers/barista_transport.c" "$ROOT_DIR/helpers/barista_sent_cache.c" "$ROOT_DIR/helpers/barista_payload.c" "$ROOT_DIR/helpers/barista_top.c" "$ROOT_DIR/helpers/barista_cpu_sample.c" "$ROOT_DIR/helpers/barista_probe.c" "$ROOT_DIR/helpers/barista_route.c" "$ROOT_DIR/helpers/barista_executor.c" \
   -framework CoreFoundation -framework IOKit -framework SystemConfiguration \
   -o "$TMP_DIR/system_info_widget_test"
 "$TMP_DIR/system_info_widget_test"
 
 clang -std=c99 -Wall -Wextra -Werror -O2 \
-  "$ROOT_DIR/helpers/system_info_widget.c" \
+  "$ROOT_DIR/helpers/system_info_widget.c" "$ROOT_DIR/helpers/barista_transport.c" "$ROOT_DIR/helpers/barista_sent_cache.c" "$ROOT_DIR/helpers/barista_payload.c" "$ROOT_DIR/helpers/barista_top.c" "$ROOT_DIR/helpers/barista_cpu_sample.c" "$ROOT_DIR/helpers/barista_probe.c" "$ROOT_DIR/helpers/barista_route.c" "$ROOT_DIR/helpers/barista_executor.c" \
   -framework CoreFoundation -framework IOKit -framework SystemConfiguration \
   -o "$TMP_DIR/system_info_popup_helper"
 
@@ -72,6 +80,17 @@ assert tokens[:2] == [b"--set", b"system_info.uptime"]
 assert any(token.startswith(b"label=Uptime: ") for token in tokens)
 PY
 
+# --timings reports every probe it ran, the CPU row included for procs.
+BARISTA_SYSTEM_INFO_ROWS=uptime,procs \
+  "$TMP_DIR/system_info_popup_helper" popup_refresh --dump0 --timings \
+  > /dev/null 2> "$TMP_DIR/timings.txt"
+grep -Eq $'^uptime\t[0-9]+\.[0-9]{3}\tok$' "$TMP_DIR/timings.txt"
+grep -Eq $'^cpu\t[0-9]+\.[0-9]{3}\tok$' "$TMP_DIR/timings.txt"
+if ! grep -Eq $'^procs\t' "$TMP_DIR/timings.txt"; then
+  echo "FAIL: --timings should report every probe it ran" >&2
+  exit 1
+fi
+
 BARISTA_SYSTEM_INFO_ROWS=net \
   "$TMP_DIR/system_info_popup_helper" popup_refresh --dump0 > "$TMP_DIR/network-payload.bin"
 python3 - "$TMP_DIR/network-payload.bin" <<'PY'
@@ -108,10 +127,57 @@ assert labels[0] != b"label=Top CPU: --"
 assert labels[0].endswith(b"%")
 PY
 
+BARISTA_SYSTEM_INFO_TOP=ps BARISTA_SYSTEM_INFO_ROWS=procs \
+  "$TMP_DIR/system_info_popup_helper" popup_refresh --dump0 > "$TMP_DIR/ps-process-payload.bin"
+python3 - "$TMP_DIR/ps-process-payload.bin" <<'PY'
+from pathlib import Path
+import sys
+tokens = Path(sys.argv[1]).read_bytes()[:-2].split(b"\0")
+labels = [token for token in tokens if token.startswith(b"label=Top CPU: ")]
+assert len(labels) == 1 and labels[0] != b"label=Top CPU: --"
+PY
+
 if BAR_NAME="barista-system-info-missing-$$" BARISTA_SYSTEM_INFO_ROWS=uptime \
   "$TMP_DIR/system_info_popup_helper" popup_refresh >/dev/null 2>&1; then
   echo "FAIL: unavailable SketchyBar IPC should return nonzero for shell fallback" >&2
   exit 1
 fi
 
+SOCKET="$TMP_DIR/system_info.sock"
+BARISTA_SYSTEM_INFO_SOCKET="$SOCKET" "$TMP_DIR/system_info_popup_helper" --daemon &
+DAEMON_PID=$!
+for _ in $(seq 1 100); do
+  [ -S "$SOCKET" ] && break
+  sleep 0.05
+done
+if [ ! -S "$SOCKET" ]; then
+  echo "FAIL: the resident helper should listen once its cache is primed" >&2
+  exit 1
+fi
+if ! BARISTA_SYSTEM_INFO_SOCKET="$SOCKET" "$TMP_DIR/system_info_popup_helper" --daemon 2>/dev/null; then
+  echo "FAIL: a second resident helper should leave the running one alone" >&2
+  exit 1
+fi
+if "$TMP_DIR/system_info_popup_helper" --daemon popup_refresh >/dev/null 2>&1; then
+  echo "FAIL: --daemon should not combine with a one-shot action" >&2
+  exit 1
+fi
+BARISTA_SYSTEM_INFO_DAEMON=1 BARISTA_SYSTEM_INFO_SOCKET="$SOCKET" BARISTA_SYSTEM_INFO_ROWS=disk,net,uptime,procs \
+  "$TMP_DIR/system_info_popup_helper" popup_refresh --dump0 > "$TMP_DIR/daemon-payload.bin"
+python3 - "$TMP_DIR/daemon-payload.bin" <<'PY'
+from pathlib import Path
+import sys
+tokens = Path(sys.argv[1]).read_bytes()[:-2].split(b"\0")
+for item in (b"system_info.disk", b"system_info.net", b"system_info.uptime", b"system_info.procs"):
+    assert item in tokens, item
+assert any(token.startswith(b"label=Uptime: ") and token != b"label=Uptime: --" for token in tokens)
+PY
+kill "$DAEMON_PID"
+wait "$DAEMON_PID" 2>/dev/null || true
+DAEMON_PID=""
+if [ -e "$SOCKET" ]; then
+  echo "FAIL: the resident helper should remove its socket on SIGTERM" >&2
+  exit 1
+fi
+
 printf 'test_system_info_widget.sh: ok\n'
@@ -24,11 +24,14 @@ if [[ -z "$CC_BIN" ]]; then
   exit 0
 fi
 
+"$CC_BIN" -Wall -Wextra -Werror -c \
+  "$ROOT_DIR/helpers/barista_transport.c" \
+  -o "$TMP_DIR/barista_transport.o"
 "$CC_BIN" -fobjc-arc -Wall -Wextra -Werror \
   -framework Foundation \
   -framework CoreAudio \
   -framework AudioToolbox \
-  "$SOURCE" \
+  "$SOURCE" "$TMP_DIR/barista_transport.o" \
   -o "$HELPER"
 
 cat > "$TMP_DIR/test_response.m" <<EOF
@@ -42,13 +45,14 @@ int main(void) {
   const char error[] = "[!] semantic failure";
   const char missingTerminator[] = {'o', 'k'};
   const char embeddedTerminator[] = {'o', 'k', '\0', '[', '!', ']', '\0'};
-  if (!response_is_success(success, sizeof(success))) return 1;
-  if (!response_is_success(notice, sizeof(notice))) return 2;
-  if (response_is_success(error, sizeof(error))) return 3;
-  if (response_is_success(missingTerminator, sizeof(missingTerminator))) return 4;
-  if (!response_is_success(embeddedTerminator, sizeof(embeddedTerminator))) return 5;
-  if (response_is_success(NULL, 1)) return 6;
-  if (response_is_success(success, kMaxPayloadBytes + 1)) return 7;
+  if (barista_response_status(success, sizeof(success)) != 1) return 1;
+  if (barista_response_status(notice, sizeof(notice)) != 1) return 2;
+  if (barista_response_status(error, sizeof(error)) != 0) return 3;
+  if (barista_response_status(missingTerminator, sizeof(missingTerminator)) >= 0) return 4;
+  if (barista_response_status(embeddedTerminator, sizeof(embeddedTerminator)) != 1) return 5;
+  if (barista_response_status(NULL, 1) >= 0) return 6;
+  if (barista_response_status(success, BARISTA_TRANSPORT_MAX_RESPONSE_BYTES + 1) >= 0) return 7;
+  if (send_payload([NSData dataWithBytes:"x" length:1])) return 8;
   return 0;
 }
 EOF
@@ -56,7 +60,8 @@ EOF
   -framework Foundation \
   -framework CoreAudio \
   -framework AudioToolbox \
-  "$TMP_DIR/test_response.m" \
+  -I"$ROOT_DIR/helpers" \
+  "$TMP_DIR/test_response.m" "$TMP_DIR/barista_transport.o" \
   -o "$TMP_DIR/test_response"
 "$TMP_DIR/test_response"
 